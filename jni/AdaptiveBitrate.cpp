@@ -0,0 +1,221 @@
+/************************************************************************************
+
+Filename    :   AdaptiveBitrate.cpp
+Content     :   Throughput estimation and buffer based rendition selection
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "AdaptiveBitrate.h"
+
+#include <math.h>
+
+#include "Kernel/OVR_Alg.h"
+
+namespace OVR {
+
+static const double	FAST_HALF_LIFE_SECONDS = 2.0;
+static const double	SLOW_HALF_LIFE_SECONDS = 5.0;
+static const int	MIN_SAMPLE_BYTES = 16 * 1024;		// smaller downloads mostly measure latency
+static const SInt64	MIN_ESTIMATE_BYTES = 128 * 1024;
+static const double	MIN_BUFFER_SECONDS = 10.0;
+static const double	BUFFER_SECONDS_PER_RENDITION = 2.0;
+static const double	THROUGHPUT_SAFETY = 0.9;
+static const int	MIN_SEGMENTS_BETWEEN_UPSWITCHES = 2;
+
+//==============================================================
+// ThroughputEstimator
+
+void ThroughputEstimator::Ewma::Add( const double weight, const double value )
+{
+	const double alpha = pow( 0.5, weight / HalfLife );
+	Estimate = value * ( 1.0 - alpha ) + alpha * Estimate;
+	TotalWeight += weight;
+}
+
+double ThroughputEstimator::Ewma::Get() const
+{
+	// the average starts at zero, so divide that bias out while there's little weight
+	const double zeroFactor = 1.0 - pow( 0.5, TotalWeight / HalfLife );
+	return ( zeroFactor > 0.0 ) ? Estimate / zeroFactor : 0.0;
+}
+
+ThroughputEstimator::ThroughputEstimator()
+{
+	Fast.HalfLife = FAST_HALF_LIFE_SECONDS;
+	Slow.HalfLife = SLOW_HALF_LIFE_SECONDS;
+	Reset();
+}
+
+void ThroughputEstimator::Reset()
+{
+	Fast.Estimate = 0.0;
+	Fast.TotalWeight = 0.0;
+	Slow.Estimate = 0.0;
+	Slow.TotalWeight = 0.0;
+	BytesSampled = 0;
+}
+
+void ThroughputEstimator::AddSample( const SInt64 bytes, const double seconds )
+{
+	if ( bytes < MIN_SAMPLE_BYTES || seconds <= 0.0 )
+	{
+		return;
+	}
+	const double bitsPerSecond = bytes * 8.0 / seconds;
+	Fast.Add( seconds, bitsPerSecond );
+	Slow.Add( seconds, bitsPerSecond );
+	BytesSampled += bytes;
+}
+
+double ThroughputEstimator::GetEstimate() const
+{
+	if ( BytesSampled < MIN_ESTIMATE_BYTES )
+	{
+		return 0.0;
+	}
+	return Alg::Min( Fast.Get(), Slow.Get() );
+}
+
+//==============================================================
+// AbrController
+
+AbrController::AbrController()
+	: SegmentSeconds( 1.0 )
+	, BufferTarget( 20.0 )
+	, V( 0.0 )
+	, Gamma( 0.0 )
+	, Placeholder( 0.0 )
+	, Current( 0 )
+	, SegmentsSinceSwitch( 0 )
+	, Switches( 0 )
+{
+}
+
+void AbrController::SetBitrates( const Array< int > & bitrates, const double segmentSeconds )
+{
+	Bitrates = bitrates;
+	SegmentSeconds = Alg::Max( segmentSeconds, 0.1 );
+	Placeholder = 0.0;
+	Current = 0;
+	SegmentsSinceSwitch = 0;
+	Switches = 0;
+	UpdateParameters();
+}
+
+void AbrController::SetBufferTarget( const double seconds )
+{
+	BufferTarget = seconds;
+	UpdateParameters();
+}
+
+void AbrController::UpdateParameters()
+{
+	Utilities.Resize( Bitrates.GetSize() );
+	for ( int i = 0; i < Bitrates.GetSizeI(); i++ )
+	{
+		// the lowest rendition has utility 1
+		Utilities[i] = log( static_cast< double >( Alg::Max( Bitrates[i], 1 ) ) / Alg::Max( Bitrates[0], 1 ) ) + 1.0;
+	}
+	if ( Bitrates.GetSizeI() < 2 )
+	{
+		V = 0.0;
+		Gamma = 0.0;
+		return;
+	}
+	// the highest rendition is chosen once the buffer reaches the target
+	const double target = Alg::Max( BufferTarget, MIN_BUFFER_SECONDS + BUFFER_SECONDS_PER_RENDITION * Bitrates.GetSizeI() );
+	Gamma = ( Utilities.Back() - 1.0 ) / ( target / MIN_BUFFER_SECONDS - 1.0 );
+	V = MIN_BUFFER_SECONDS / Gamma;
+}
+
+int AbrController::ChooseBola( const double bufferSeconds ) const
+{
+	int best = 0;
+	double bestScore = 0.0;
+	for ( int i = 0; i < Bitrates.GetSizeI(); i++ )
+	{
+		const double score = ( V * ( Utilities[i] + Gamma ) - bufferSeconds ) / Alg::Max( Bitrates[i], 1 );
+		if ( i == 0 || score >= bestScore )
+		{
+			best = i;
+			bestScore = score;
+		}
+	}
+	return best;
+}
+
+// The buffer level above which BOLA prefers the rendition to every lower one.
+double AbrController::GetMinBufferFor( const int rendition ) const
+{
+	double minBuffer = 0.0;
+	for ( int i = rendition - 1; i >= 0; i-- )
+	{
+		if ( Utilities[i] < Utilities[rendition] )
+		{
+			const double level = V * ( Gamma + ( Bitrates[rendition] * Utilities[i] - Bitrates[i] * Utilities[rendition] ) /
+				static_cast< double >( Bitrates[rendition] - Bitrates[i] ) );
+			minBuffer = Alg::Max( minBuffer, level );
+		}
+	}
+	return minBuffer;
+}
+
+int AbrController::ChooseThroughput( const double throughput ) const
+{
+	int best = 0;
+	for ( int i = 1; i < Bitrates.GetSizeI(); i++ )
+	{
+		if ( Bitrates[i] <= throughput * THROUGHPUT_SAFETY )
+		{
+			best = i;
+		}
+	}
+	return best;
+}
+
+int AbrController::ChooseRendition( const double bufferSeconds, const double throughput )
+{
+	if ( Bitrates.GetSizeI() < 2 )
+	{
+		return 0;
+	}
+
+	int choice;
+	if ( bufferSeconds < SegmentSeconds )
+	{
+		choice = ChooseThroughput( throughput );
+		Placeholder = Alg::Max( 0.0, GetMinBufferFor( choice ) - bufferSeconds );
+	}
+	else
+	{
+		const int sustainable = ( throughput > 0.0 ) ? ChooseThroughput( throughput ) : Current;
+		// the placeholder only holds what the throughput can still sustain
+		Placeholder = Alg::Min( Placeholder, Alg::Max( 0.0, GetMinBufferFor( sustainable ) - bufferSeconds ) );
+		Placeholder = Alg::Min( Placeholder, Alg::Max( 0.0, BufferTarget - bufferSeconds ) );
+		choice = ChooseBola( bufferSeconds + Placeholder );
+		if ( choice > Current )
+		{
+			choice = ( SegmentsSinceSwitch >= MIN_SEGMENTS_BETWEEN_UPSWITCHES ) ?
+				Alg::Min( Current + 1, Alg::Max( sustainable, Current ) ) : Current;
+		}
+	}
+
+	SegmentsSinceSwitch++;
+	if ( choice != Current )
+	{
+		Current = choice;
+		SegmentsSinceSwitch = 0;
+		Switches++;
+	}
+	return Current;
+}
+
+}
@@ -0,0 +1,110 @@
+/************************************************************************************
+
+Filename    :   AdaptiveBitrate.h
+Content     :   Throughput estimation and buffer based rendition selection
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_AdaptiveBitrate_h )
+#define OVR_AdaptiveBitrate_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+
+namespace OVR {
+
+//==============================================================
+// ThroughputEstimator
+//
+// Two exponentially weighted averages over segment downloads, weighted by
+// download time so a long download counts for more than a short one. The
+// estimate is the lower of the two: the fast one reacts to a drop at once,
+// the slow one keeps a short burst from raising the estimate.
+class ThroughputEstimator
+{
+public:
+						ThroughputEstimator();
+
+	void				Reset();
+	void				AddSample( const SInt64 bytes, const double seconds );
+
+	// Bits per second, 0 until enough has been downloaded to tell.
+	double				GetEstimate() const;
+
+private:
+	struct Ewma
+	{
+		double			HalfLife;
+		double			Estimate;
+		double			TotalWeight;
+
+		void			Add( const double weight, const double value );
+		double			Get() const;
+	};
+
+	Ewma				Fast;
+	Ewma				Slow;
+	SInt64				BytesSampled;
+};
+
+//==============================================================
+// AbrController
+//
+// BOLA: each rendition has a utility, the log of its bitrate relative to
+// the lowest, and the choice maximizes ( V * ( utility + gamma ) - buffer )
+// / bitrate, so an empty buffer picks the lowest rendition and a buffer at
+// the target picks the highest. V and gamma come from the buffer target.
+//
+// On top of that, for hysteresis: switching up goes one rendition at a
+// time, not more often than every few segments, and not above what the
+// throughput estimate can sustain. Switching down is immediate. While the
+// buffer is under one segment, at startup or after a stall, the choice
+// follows throughput alone, and a placeholder is added to the buffer so the
+// first BOLA choice carries on from there instead of dropping back down.
+class AbrController
+{
+public:
+						AbrController();
+
+	// Bits per second, ascending.
+	void				SetBitrates( const Array< int > & bitrates, const double segmentSeconds );
+	void				SetBufferTarget( const double seconds );
+
+	// Rendition for the next segment, given the seconds buffered ahead of the
+	// play position and the throughput estimate in bits per second, 0 if none.
+	int					ChooseRendition( const double bufferSeconds, const double throughput );
+
+	int					GetCurrent() const			{ return Current; }
+	int					GetNumRenditions() const	{ return Bitrates.GetSizeI(); }
+	int					GetBitrate( const int rendition ) const	{ return Bitrates[rendition]; }
+	int					GetSwitches() const			{ return Switches; }
+
+private:
+	Array< int >		Bitrates;
+	Array< double >		Utilities;
+	double				SegmentSeconds;
+	double				BufferTarget;
+	double				V;
+	double				Gamma;
+	double				Placeholder;		// seconds added to the real buffer
+	int					Current;
+	int					SegmentsSinceSwitch;
+	int					Switches;
+
+	void				UpdateParameters();
+	int					ChooseBola( const double bufferSeconds ) const;
+	double				GetMinBufferFor( const int rendition ) const;
+	int					ChooseThroughput( const double throughput ) const;
+};
+
+}
+
+#endif // OVR_AdaptiveBitrate_h
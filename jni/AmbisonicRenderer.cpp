@@ -0,0 +1,368 @@
+/************************************************************************************
+
+Filename    :   AmbisonicRenderer.cpp
+Content     :   Head tracked first order ambisonics to binaural renderer
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "AmbisonicRenderer.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "WavFile.h"
+
+namespace OVR {
+
+// ACN channel order
+static const int	CHANNEL_W = 0;
+static const int	CHANNEL_Y = 1;
+static const int	CHANNEL_Z = 2;
+static const int	CHANNEL_X = 3;
+
+// spherical head model, Brown and Duda
+static const double	HEAD_RADIUS = 0.0875;		// meters
+static const double	SPEED_OF_SOUND = 343.0;		// meters per second
+static const double	SHADOW_ALPHA_MIN = 0.1;
+static const double	SHADOW_THETA_MIN = 150.0 * M_PI / 180.0;
+static const int	MODEL_FADE_TAPS = 32;
+
+static double GetSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+AmbisonicRenderer::AmbisonicRenderer()
+	: SampleRate( 48000 )
+	, PartitionCount( 0 )
+	, SpectraHead( 0 )
+	, BlockCount( 0 )
+	, BlockSecondsTotal( 0.0 )
+	, BlockSecondsMax( 0.0 )
+{
+	pthread_mutex_init( &RotationMutex, NULL );
+	for ( int i = 0; i < 9; i++ )
+	{
+		Rotation[i] = TargetRotation[i] = ( i % 4 == 0 ) ? 1.0f : 0.0f;
+	}
+}
+
+AmbisonicRenderer::~AmbisonicRenderer()
+{
+	pthread_mutex_destroy( &RotationMutex );
+}
+
+void AmbisonicRenderer::Init( const int sampleRate )
+{
+	SampleRate = sampleRate;
+	Fft.Init( FFT_SIZE );
+
+	Array< float > re;
+	Array< float > im;
+	re.Resize( FFT_SIZE );
+	im.Resize( FFT_SIZE );
+
+	Array< float > filters[CHANNELS];
+	for ( int c = 0; c < CHANNELS; c++ )
+	{
+		filters[c].Resize( BLOCK_FRAMES );
+		memset( filters[c].GetDataPtr(), 0, BLOCK_FRAMES * sizeof( float ) );
+	}
+
+	// Virtual speakers on the corners of a cube, decoded with max-rE weights,
+	// each heard through a head shadow filter and interaural delay for the left ear.
+	const double headDelay = HEAD_RADIUS / SPEED_OF_SOUND;
+	const double omega0 = SPEED_OF_SOUND / HEAD_RADIUS;
+	const double corner = 1.0 / sqrt( 3.0 );
+	const double maxRE = 1.0 / sqrt( 3.0 );
+	const int speakerCount = 8;
+	for ( int s = 0; s < speakerCount; s++ )
+	{
+		const double x = ( s & 1 ) ? corner : -corner;
+		const double y = ( s & 2 ) ? corner : -corner;
+		const double z = ( s & 4 ) ? corner : -corner;
+
+		// angle between the speaker and the left ear, which is +Y
+		const double theta = acos( y );
+		const double alpha = ( 1.0 + SHADOW_ALPHA_MIN * 0.5 ) + ( 1.0 - SHADOW_ALPHA_MIN * 0.5 ) * cos( theta / SHADOW_THETA_MIN * M_PI );
+		const double delay = ( y >= 0.0 ) ? -headDelay * y : headDelay * ( theta - M_PI * 0.5 );
+		const double delaySamples = ( delay + headDelay ) * SampleRate + 4.0;
+
+		for ( int k = 0; k <= FFT_SIZE / 2; k++ )
+		{
+			const double omega = 2.0 * M_PI * k * SampleRate / FFT_SIZE;
+			const double w = omega / ( 2.0 * omega0 );
+			// ( 1 + j alpha w ) / ( 1 + j w )
+			const double hr = ( 1.0 + alpha * w * w ) / ( 1.0 + w * w );
+			const double hi = w * ( alpha - 1.0 ) / ( 1.0 + w * w );
+			const double phase = -2.0 * M_PI * k * delaySamples / FFT_SIZE;
+			re[k] = static_cast< float >( hr * cos( phase ) - hi * sin( phase ) );
+			im[k] = static_cast< float >( hr * sin( phase ) + hi * cos( phase ) );
+			if ( k > 0 && k < FFT_SIZE / 2 )
+			{
+				re[FFT_SIZE - k] = re[k];
+				im[FFT_SIZE - k] = -im[k];
+			}
+		}
+		im[0] = 0.0f;
+		im[FFT_SIZE / 2] = 0.0f;
+		Fft.Inverse( re.GetDataPtr(), im.GetDataPtr() );
+
+		const float weights[CHANNELS] =
+		{
+			1.0f / speakerCount,
+			static_cast< float >( 3.0 * maxRE * y / speakerCount ),
+			static_cast< float >( 3.0 * maxRE * z / speakerCount ),
+			static_cast< float >( 3.0 * maxRE * x / speakerCount )
+		};
+		for ( int t = 0; t < BLOCK_FRAMES; t++ )
+		{
+			const int fromEnd = BLOCK_FRAMES - t;
+			const float fade = ( fromEnd < MODEL_FADE_TAPS ) ? static_cast< float >( fromEnd ) / MODEL_FADE_TAPS : 1.0f;
+			for ( int c = 0; c < CHANNELS; c++ )
+			{
+				filters[c][t] += weights[c] * fade * re[t];
+			}
+		}
+	}
+
+	const float * pointers[CHANNELS];
+	for ( int c = 0; c < CHANNELS; c++ )
+	{
+		pointers[c] = filters[c].GetDataPtr();
+	}
+	SetFilters( pointers, BLOCK_FRAMES );
+}
+
+bool AmbisonicRenderer::LoadFilters( const char * path )
+{
+	WavFile wav;
+	if ( !wav.Open( path ) )
+	{
+		return false;
+	}
+	if ( wav.GetChannels() != CHANNELS || wav.GetSampleRate() != SampleRate || wav.GetFrameCount() <= 0 )
+	{
+		LOG( "AmbisonicRenderer: '%s' needs %i channels at %i Hz", path, CHANNELS, SampleRate );
+		return false;
+	}
+	const int length = static_cast< int >( Alg::Min( wav.GetFrameCount(), ( SInt64 )MAX_FILTER_LENGTH ) );
+	Array< float > interleaved;
+	interleaved.Resize( length * CHANNELS );
+	wav.ReadFrames( 0, length, interleaved.GetDataPtr() );
+
+	Array< float > filters[CHANNELS];
+	const float * pointers[CHANNELS];
+	for ( int c = 0; c < CHANNELS; c++ )
+	{
+		filters[c].Resize( length );
+		for ( int t = 0; t < length; t++ )
+		{
+			filters[c][t] = interleaved[t * CHANNELS + c];
+		}
+		pointers[c] = filters[c].GetDataPtr();
+	}
+	SetFilters( pointers, length );
+	LOG( "AmbisonicRenderer: %i tap filters from '%s', %i partitions", length, path, PartitionCount );
+	return true;
+}
+
+void AmbisonicRenderer::SetFilters( const float * const * filters, const int length )
+{
+	PartitionCount = Alg::Max( 1, ( length + BLOCK_FRAMES - 1 ) / BLOCK_FRAMES );
+	FilterRe.Resize( CHANNELS * PartitionCount * FFT_SIZE );
+	FilterIm.Resize( CHANNELS * PartitionCount * FFT_SIZE );
+	for ( int c = 0; c < CHANNELS; c++ )
+	{
+		for ( int p = 0; p < PartitionCount; p++ )
+		{
+			// each partition is zero padded to the FFT size for overlap-save
+			float * re = GetFilterRe( c, p );
+			float * im = GetFilterIm( c, p );
+			memset( re, 0, FFT_SIZE * sizeof( float ) );
+			memset( im, 0, FFT_SIZE * sizeof( float ) );
+			const int first = p * BLOCK_FRAMES;
+			const int count = Alg::Min( BLOCK_FRAMES, length - first );
+			memcpy( re, filters[c] + first, count * sizeof( float ) );
+			Fft.Forward( re, im );
+		}
+	}
+
+	SpectraRe.Resize( CHANNELS * PartitionCount * FFT_SIZE );
+	SpectraIm.Resize( CHANNELS * PartitionCount * FFT_SIZE );
+	Window.Resize( CHANNELS * FFT_SIZE );
+	SumRe.Resize( FFT_SIZE );
+	SumIm.Resize( FFT_SIZE );
+	DiffRe.Resize( FFT_SIZE );
+	DiffIm.Resize( FFT_SIZE );
+	ScratchRe.Resize( FFT_SIZE );
+	ScratchIm.Resize( FFT_SIZE );
+	Reset();
+}
+
+void AmbisonicRenderer::Reset()
+{
+	memset( SpectraRe.GetDataPtr(), 0, SpectraRe.GetSize() * sizeof( float ) );
+	memset( SpectraIm.GetDataPtr(), 0, SpectraIm.GetSize() * sizeof( float ) );
+	memset( Window.GetDataPtr(), 0, Window.GetSize() * sizeof( float ) );
+	SpectraHead = 0;
+}
+
+void AmbisonicRenderer::SetHeadRotation( const Matrix4f & viewMatrix )
+{
+	// ambisonic X forward, Y left, Z up is OVR -Z, -X, +Y
+	static const float toWorld[3][3] =
+	{
+		{  0.0f, -1.0f,  0.0f },
+		{  0.0f,  0.0f,  1.0f },
+		{ -1.0f,  0.0f,  0.0f }
+	};
+
+	// toWorld^T * view * toWorld
+	float viewToWorld[3][3];
+	for ( int i = 0; i < 3; i++ )
+	{
+		for ( int j = 0; j < 3; j++ )
+		{
+			viewToWorld[i][j] = 0.0f;
+			for ( int k = 0; k < 3; k++ )
+			{
+				viewToWorld[i][j] += viewMatrix.M[i][k] * toWorld[k][j];
+			}
+		}
+	}
+	float rotation[9];
+	for ( int i = 0; i < 3; i++ )
+	{
+		for ( int j = 0; j < 3; j++ )
+		{
+			rotation[i * 3 + j] = 0.0f;
+			for ( int k = 0; k < 3; k++ )
+			{
+				rotation[i * 3 + j] += toWorld[k][i] * viewToWorld[k][j];
+			}
+		}
+	}
+
+	pthread_mutex_lock( &RotationMutex );
+	memcpy( TargetRotation, rotation, sizeof( rotation ) );
+	pthread_mutex_unlock( &RotationMutex );
+}
+
+void AmbisonicRenderer::Render( const float * foa, float * stereo )
+{
+	const double start = GetSeconds();
+
+	// the audio thread never waits on the VR thread, a missed update is picked up next block
+	float target[9];
+	memcpy( target, Rotation, sizeof( target ) );
+	if ( pthread_mutex_trylock( &RotationMutex ) == 0 )
+	{
+		memcpy( target, TargetRotation, sizeof( target ) );
+		pthread_mutex_unlock( &RotationMutex );
+	}
+
+	// rotate X Y Z, interpolating from the last block's rotation to avoid zipper noise
+	float * windowW = &Window[CHANNEL_W * FFT_SIZE + BLOCK_FRAMES];
+	float * windowY = &Window[CHANNEL_Y * FFT_SIZE + BLOCK_FRAMES];
+	float * windowZ = &Window[CHANNEL_Z * FFT_SIZE + BLOCK_FRAMES];
+	float * windowX = &Window[CHANNEL_X * FFT_SIZE + BLOCK_FRAMES];
+	float delta[9];
+	for ( int i = 0; i < 9; i++ )
+	{
+		delta[i] = ( target[i] - Rotation[i] ) * ( 1.0f / BLOCK_FRAMES );
+	}
+	for ( int f = 0; f < BLOCK_FRAMES; f++ )
+	{
+		float m[9];
+		for ( int i = 0; i < 9; i++ )
+		{
+			m[i] = Rotation[i] + delta[i] * ( f + 1 );
+		}
+		const float * in = foa + f * CHANNELS;
+		const float x = in[CHANNEL_X];
+		const float y = in[CHANNEL_Y];
+		const float z = in[CHANNEL_Z];
+		windowW[f] = in[CHANNEL_W];
+		windowX[f] = m[0] * x + m[1] * y + m[2] * z;
+		windowY[f] = m[3] * x + m[4] * y + m[5] * z;
+		windowZ[f] = m[6] * x + m[7] * y + m[8] * z;
+	}
+	memcpy( Rotation, target, sizeof( Rotation ) );
+
+	// spectra of the last two blocks into the delay line
+	const int slot = SpectraHead;
+	for ( int c = 0; c < CHANNELS; c++ )
+	{
+		float * window = &Window[c * FFT_SIZE];
+		float * re = GetSpectrumRe( c, slot );
+		float * im = GetSpectrumIm( c, slot );
+		memcpy( re, window, FFT_SIZE * sizeof( float ) );
+		memset( im, 0, FFT_SIZE * sizeof( float ) );
+		Fft.Forward( re, im );
+		memcpy( window, window + BLOCK_FRAMES, BLOCK_FRAMES * sizeof( float ) );
+	}
+
+	memset( SumRe.GetDataPtr(), 0, FFT_SIZE * sizeof( float ) );
+	memset( SumIm.GetDataPtr(), 0, FFT_SIZE * sizeof( float ) );
+	memset( DiffRe.GetDataPtr(), 0, FFT_SIZE * sizeof( float ) );
+	memset( DiffIm.GetDataPtr(), 0, FFT_SIZE * sizeof( float ) );
+	for ( int p = 0; p < PartitionCount; p++ )
+	{
+		const int s = ( slot - p + PartitionCount ) % PartitionCount;
+		for ( int c = 0; c < CHANNELS; c++ )
+		{
+			float * accRe = ( c == CHANNEL_Y ) ? DiffRe.GetDataPtr() : SumRe.GetDataPtr();
+			float * accIm = ( c == CHANNEL_Y ) ? DiffIm.GetDataPtr() : SumIm.GetDataPtr();
+			ComplexMultiplyAccumulate( accRe, accIm, GetSpectrumRe( c, s ), GetSpectrumIm( c, s ),
+					GetFilterRe( c, p ), GetFilterIm( c, p ), FFT_SIZE );
+		}
+	}
+
+	// Both ears are real signals, so one inverse transform of left + j right gives them both.
+	for ( int k = 0; k < FFT_SIZE; k++ )
+	{
+		const float leftRe = SumRe[k] + DiffRe[k];
+		const float leftIm = SumIm[k] + DiffIm[k];
+		const float rightRe = SumRe[k] - DiffRe[k];
+		const float rightIm = SumIm[k] - DiffIm[k];
+		ScratchRe[k] = leftRe - rightIm;
+		ScratchIm[k] = leftIm + rightRe;
+	}
+	Fft.Inverse( ScratchRe.GetDataPtr(), ScratchIm.GetDataPtr() );
+
+	// overlap-save, only the second half is free of circular wrap around
+	for ( int f = 0; f < BLOCK_FRAMES; f++ )
+	{
+		stereo[f * 2 + 0] = ScratchRe[BLOCK_FRAMES + f];
+		stereo[f * 2 + 1] = ScratchIm[BLOCK_FRAMES + f];
+	}
+	SpectraHead = ( slot + 1 ) % PartitionCount;
+
+	const double seconds = GetSeconds() - start;
+	BlockCount++;
+	BlockSecondsTotal += seconds;
+	BlockSecondsMax = Alg::Max( BlockSecondsMax, seconds );
+}
+
+void AmbisonicRenderer::ResetStats()
+{
+	BlockCount = 0;
+	BlockSecondsTotal = 0.0;
+	BlockSecondsMax = 0.0;
+}
+
+}
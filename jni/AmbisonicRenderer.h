@@ -0,0 +1,118 @@
+/************************************************************************************
+
+Filename    :   AmbisonicRenderer.h
+Content     :   Head tracked first order ambisonics to binaural renderer
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_AmbisonicRenderer_h )
+#define OVR_AmbisonicRenderer_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_Math.h"
+#include "AudioDsp.h"
+
+namespace OVR {
+
+//==============================================================
+// AmbisonicRenderer
+//
+// Renders AmbiX (ACN channel order W Y Z X, SN3D) first order ambisonics to
+// binaural stereo. Each block the sound field is rotated against the head,
+// then convolved with spherical harmonic domain HRIRs for the left ear by
+// uniformly partitioned overlap-save convolution; the right ear is the
+// left ear mirrored, which only flips the sign of the Y filter.
+//
+// Nothing here touches the platform, so blocks can be rendered offline from
+// WAV input as well as from the audio callback.
+class AmbisonicRenderer
+{
+public:
+	static const int	CHANNELS = 4;
+	static const int	BLOCK_FRAMES = 256;
+	static const int	MAX_FILTER_LENGTH = 4096;
+
+						AmbisonicRenderer();
+						~AmbisonicRenderer();
+
+	// Builds HRIRs from a spherical head model sampled by eight virtual speakers.
+	void				Init( const int sampleRate );
+
+	// Replaces the model with measured filters: a 4 channel WAV of left ear
+	// HRIRs, one per ambisonic channel, at the renderer's sample rate.
+	bool				LoadFilters( const char * path );
+
+	// Clears the convolution history, after a seek or a pause.
+	void				Reset();
+
+	// Any thread. The view matrix takes world directions to the head; the
+	// front of the sound field is world -Z, where the video is centered.
+	void				SetHeadRotation( const Matrix4f & viewMatrix );
+
+	// BLOCK_FRAMES interleaved W Y Z X frames in, interleaved stereo out.
+	void				Render( const float * foa, float * stereo );
+
+	int					GetSampleRate() const			{ return SampleRate; }
+
+	// Render cost against the real time budget of a block.
+	int					GetBlockCount() const			{ return BlockCount; }
+	double				GetBlockSecondsAverage() const	{ return BlockCount > 0 ? BlockSecondsTotal / BlockCount : 0.0; }
+	double				GetBlockSecondsMax() const		{ return BlockSecondsMax; }
+	double				GetBlockBudgetSeconds() const	{ return static_cast< double >( BLOCK_FRAMES ) / SampleRate; }
+	void				ResetStats();
+
+private:
+	static const int	FFT_SIZE = BLOCK_FRAMES * 2;
+
+	AudioFft			Fft;
+	int					SampleRate;
+	int					PartitionCount;
+
+	// FFT_SIZE bins per partition per channel
+	Array< float >		FilterRe;
+	Array< float >		FilterIm;
+
+	// Frequency domain delay line of input spectra, PartitionCount per channel.
+	Array< float >		SpectraRe;
+	Array< float >		SpectraIm;
+	int					SpectraHead;
+
+	// previous and current block of each rotated channel
+	Array< float >		Window;
+
+	Array< float >		SumRe;		// W, Z and X, the same at both ears
+	Array< float >		SumIm;
+	Array< float >		DiffRe;		// Y, opposite at the two ears
+	Array< float >		DiffIm;
+	Array< float >		ScratchRe;
+	Array< float >		ScratchIm;
+
+	float				Rotation[9];		// applied to X Y Z at the end of the last block
+	float				TargetRotation[9];
+	pthread_mutex_t		RotationMutex;
+
+	int					BlockCount;
+	double				BlockSecondsTotal;
+	double				BlockSecondsMax;
+
+	void				SetFilters( const float * const * filters, const int length );
+	float *				GetFilterRe( const int channel, const int partition ) { return &FilterRe[( channel * PartitionCount + partition ) * FFT_SIZE]; }
+	float *				GetFilterIm( const int channel, const int partition ) { return &FilterIm[( channel * PartitionCount + partition ) * FFT_SIZE]; }
+	float *				GetSpectrumRe( const int channel, const int slot )	{ return &SpectraRe[( channel * PartitionCount + slot ) * FFT_SIZE]; }
+	float *				GetSpectrumIm( const int channel, const int slot )	{ return &SpectraIm[( channel * PartitionCount + slot ) * FFT_SIZE]; }
+};
+
+}
+
+#endif // OVR_AmbisonicRenderer_h
@@ -0,0 +1,128 @@
+/************************************************************************************
+
+Filename    :   AmbisonicSoundtrack.cpp
+Content     :   Plays an AmbiX sidecar in sync with the movie player
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "AmbisonicSoundtrack.h"
+
+#include <string.h>
+
+#include "Kernel/OVR_String.h"
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+// The player's position is only published every 100 ms and extrapolated in
+// between, so small differences are noise rather than drift.
+static const int	RESYNC_THRESHOLD_MS = 120;
+
+// optional measured HRIRs replacing the head model
+static const char *	HrirPath = "/sdcard/Oculus/360Videos/ambix_hrir.wav";
+
+AmbisonicSoundtrack::AmbisonicSoundtrack()
+	: State( NULL )
+	, Cursor( -1 )
+	, ResyncCount( 0 )
+	, FiltersReady( false )
+{
+}
+
+bool AmbisonicSoundtrack::Open( const char * videoPath, const PlaybackStateBlock & state )
+{
+	Close();
+
+	String path( videoPath );
+	const char * dot = strrchr( videoPath, '.' );
+	const char * slash = strrchr( videoPath, '/' );
+	if ( dot != NULL && dot > slash )
+	{
+		path = String( videoPath, dot - videoPath );
+	}
+	path += ".ambix.wav";
+	if ( !Wav.Open( path.ToCStr() ) )
+	{
+		return false;
+	}
+	if ( Wav.GetChannels() != AmbisonicRenderer::CHANNELS || Wav.GetSampleRate() != AudioOutput::SAMPLE_RATE )
+	{
+		LOG( "AmbisonicSoundtrack: '%s' is %i channels at %i Hz, needs %i at %i Hz", path.ToCStr(),
+			Wav.GetChannels(), Wav.GetSampleRate(), AmbisonicRenderer::CHANNELS, AudioOutput::SAMPLE_RATE );
+		Wav.Close();
+		return false;
+	}
+
+	// the filters only depend on the output rate, so they are built once
+	if ( !FiltersReady )
+	{
+		Renderer.Init( AudioOutput::SAMPLE_RATE );
+		Renderer.LoadFilters( HrirPath );
+		FiltersReady = true;
+	}
+	Renderer.Reset();
+	Renderer.ResetStats();
+
+	State = &state;
+	Cursor = -1;
+	ResyncCount = 0;
+	LOG( "AmbisonicSoundtrack: '%s', %.1f seconds", path.ToCStr(), static_cast< double >( Wav.GetFrameCount() ) / Wav.GetSampleRate() );
+	return true;
+}
+
+void AmbisonicSoundtrack::Close()
+{
+	Wav.Close();
+	State = NULL;
+	Cursor = -1;
+}
+
+void AmbisonicSoundtrack::MixAudio( float * stereo, const int frames )
+{
+	if ( State == NULL )
+	{
+		return;
+	}
+	// a write in progress keeps the last state for this buffer
+	State->TryRead( LastState );
+	if ( !LastState.Playing )
+	{
+		Cursor = -1;
+		return;
+	}
+
+	const int sampleRate = Wav.GetSampleRate();
+	const SInt64 expected = static_cast< SInt64 >( LastState.GetPositionAt( PlaybackStateBlock::GetTimeInSeconds() ) ) * sampleRate / 1000;
+	const SInt64 drift = ( Cursor > expected ) ? Cursor - expected : expected - Cursor;
+	if ( Cursor < 0 || drift > static_cast< SInt64 >( RESYNC_THRESHOLD_MS ) * sampleRate / 1000 )
+	{
+		if ( Cursor >= 0 )
+		{
+			ResyncCount++;
+		}
+		Cursor = expected;
+		Renderer.Reset();
+	}
+
+	for ( int frame = 0; frame + AmbisonicRenderer::BLOCK_FRAMES <= frames; frame += AmbisonicRenderer::BLOCK_FRAMES )
+	{
+		Wav.ReadFrames( Cursor, AmbisonicRenderer::BLOCK_FRAMES, FoaBlock );
+		Renderer.Render( FoaBlock, StereoBlock );
+		float * out = stereo + frame * 2;
+		for ( int i = 0; i < AmbisonicRenderer::BLOCK_FRAMES * 2; i++ )
+		{
+			out[i] += StereoBlock[i];
+		}
+		Cursor += AmbisonicRenderer::BLOCK_FRAMES;
+	}
+}
+
+}
@@ -0,0 +1,65 @@
+/************************************************************************************
+
+Filename    :   AmbisonicSoundtrack.h
+Content     :   Plays an AmbiX sidecar in sync with the movie player
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_AmbisonicSoundtrack_h )
+#define OVR_AmbisonicSoundtrack_h
+
+#include "AudioOutput.h"
+#include "AmbisonicRenderer.h"
+#include "PlaybackState.h"
+#include "WavFile.h"
+
+namespace OVR {
+
+//==============================================================
+// AmbisonicSoundtrack
+//
+// MediaPlayer only gives us its stereo mix, so the sound field comes from
+// a 4 channel AmbiX WAV next to the video (name.ambix.wav) and the player's
+// own audio is muted. The audio thread follows the position published in
+// the playback state block, jumping when it drifts too far.
+class AmbisonicSoundtrack : public AudioSource
+{
+public:
+						AmbisonicSoundtrack();
+
+	// Returns false if the video has no usable sidecar.
+	bool				Open( const char * videoPath, const PlaybackStateBlock & state );
+	void				Close();
+	bool				IsOpen() const		{ return Wav.IsOpen(); }
+
+	void				SetHeadRotation( const Matrix4f & viewMatrix )	{ Renderer.SetHeadRotation( viewMatrix ); }
+	const AmbisonicRenderer & GetRenderer() const	{ return Renderer; }
+	int					GetResyncCount() const	{ return ResyncCount; }
+
+	// AudioSource
+	virtual void		MixAudio( float * stereo, const int frames );
+
+private:
+	const PlaybackStateBlock *	State;
+	WavFile				Wav;
+	AmbisonicRenderer	Renderer;
+	PlaybackStateData	LastState;
+	SInt64				Cursor;			// next frame to render, -1 after a pause
+	int					ResyncCount;
+	bool				FiltersReady;
+
+	float				FoaBlock[AmbisonicRenderer::BLOCK_FRAMES * AmbisonicRenderer::CHANNELS];
+	float				StereoBlock[AmbisonicRenderer::BLOCK_FRAMES * 2];
+};
+
+}
+
+#endif // OVR_AmbisonicSoundtrack_h
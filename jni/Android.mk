@@ -8,6 +8,22 @@ LOCAL_SRC_FILES := libjpeg.a
 
 include $(PREBUILT_STATIC_LIBRARY)
 
+# The AES blocks on the ARMv8 Crypto Extensions, the only code built for
+# them. CommonEncryption.cpp checks getauxval before calling it, so the rest
+# of the library still runs on ARMv7.
+include $(CLEAR_VARS)
+LOCAL_ARM_MODE  := arm
+LOCAL_MODULE := commonencryption_armce
+LOCAL_SRC_FILES := CommonEncryptionArmCe.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../../../VRLib/jni/LibOVR/Src
+ifeq ($(TARGET_ARCH_ABI),arm64-v8a)
+LOCAL_CFLAGS += -march=armv8-a+crypto
+else
+LOCAL_CFLAGS += -march=armv8-a -mfpu=crypto-neon-fp-armv8
+endif
+
+include $(BUILD_STATIC_LIBRARY)
+
 include $(CLEAR_VARS)					# clean everything up to prepare for a module
 include ../../VRLib/import_vrlib.mk		# import VRLib for this module.  Do NOT call $(CLEAR_VARS) until after building your module.
 										# use += instead of := when defining the following variables: LOCAL_LDLIBS, LOCAL_CFLAGS, LOCAL_C_INCLUDES, LOCAL_STATIC_LIBRARIES 
@@ -15,8 +31,9 @@ include ../../VRLib/import_vrlib.mk		# import VRLib for this module.  Do NOT cal
 include ../../VRLib/cflags.mk
 
 LOCAL_MODULE    := oculus360videos		# generate oculus360videos.so
-LOCAL_SRC_FILES  := Oculus360Videos.cpp VideoBrowser.cpp VideoMenu.cpp VideosMetaData.cpp OVR_TurboJpeg.cpp
+LOCAL_SRC_FILES  := Oculus360Videos.cpp VideoBrowser.cpp VideoMenu.cpp VideosMetaData.cpp OVR_TurboJpeg.cpp XmlScanner.cpp HttpClient.cpp PlaybackState.cpp SurfaceTexturePool.cpp PlaylistSession.cpp MediaContainer.cpp KeyframeIndex.cpp SeekScheduler.cpp PositionJournal.cpp TrickPlay.cpp WavFile.cpp AudioDsp.cpp AmbisonicRenderer.cpp AudioOutput.cpp AmbisonicSoundtrack.cpp UiSoundMixer.cpp Subtitles.cpp ChapterIndex.cpp Faststart.cpp CacheProxy.cpp DownloadManager.cpp AdaptiveBitrate.cpp HlsPlaylist.cpp CommonEncryption.cpp WebDavSource.cpp LocalizedStrings.cpp ThumbnailCache.cpp
 
-LOCAL_STATIC_LIBRARIES += jpeg
+LOCAL_STATIC_LIBRARIES += jpeg commonencryption_armce
+LOCAL_LDLIBS += -lOpenSLES
 
 include $(BUILD_SHARED_LIBRARY)			# start building based on everything since CLEAR_VARS
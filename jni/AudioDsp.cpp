@@ -0,0 +1,198 @@
+/************************************************************************************
+
+Filename    :   AudioDsp.cpp
+Content     :   FFT and vectorized kernels for the native audio renderers
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "AudioDsp.h"
+
+#include <math.h>
+
+#include "Kernel/OVR_Alg.h"
+
+#if defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#elif defined( __SSE__ )
+#include <xmmintrin.h>
+#endif
+
+namespace OVR {
+
+//==============================================================
+// AudioFft
+
+AudioFft::AudioFft()
+	: Size( 0 )
+{
+}
+
+void AudioFft::Init( const int size )
+{
+	Size = size;
+	int bits = 0;
+	while ( ( 1 << bits ) < size )
+	{
+		bits++;
+	}
+
+	BitReverse.Resize( size );
+	for ( int i = 0; i < size; i++ )
+	{
+		int reversed = 0;
+		for ( int b = 0; b < bits; b++ )
+		{
+			reversed |= ( ( i >> b ) & 1 ) << ( bits - 1 - b );
+		}
+		BitReverse[i] = reversed;
+	}
+
+	CosTable.Resize( size / 2 );
+	SinTable.Resize( size / 2 );
+	for ( int k = 0; k < size / 2; k++ )
+	{
+		const double angle = 2.0 * M_PI * k / size;
+		CosTable[k] = static_cast< float >( cos( angle ) );
+		SinTable[k] = static_cast< float >( sin( angle ) );
+	}
+}
+
+void AudioFft::Transform( float * re, float * im, const float sign ) const
+{
+	for ( int i = 0; i < Size; i++ )
+	{
+		const int j = BitReverse[i];
+		if ( j > i )
+		{
+			Alg::Swap( re[i], re[j] );
+			Alg::Swap( im[i], im[j] );
+		}
+	}
+
+	for ( int length = 2; length <= Size; length <<= 1 )
+	{
+		const int half = length >> 1;
+		const int step = Size / length;
+		for ( int i = 0; i < Size; i += length )
+		{
+			for ( int k = 0; k < half; k++ )
+			{
+				const float wr = CosTable[k * step];
+				const float wi = sign * SinTable[k * step];
+				const int a = i + k;
+				const int b = a + half;
+				const float tr = re[b] * wr - im[b] * wi;
+				const float ti = re[b] * wi + im[b] * wr;
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+void AudioFft::Forward( float * re, float * im ) const
+{
+	Transform( re, im, -1.0f );
+}
+
+void AudioFft::Inverse( float * re, float * im ) const
+{
+	Transform( re, im, 1.0f );
+	const float scale = 1.0f / Size;
+	for ( int i = 0; i < Size; i++ )
+	{
+		re[i] *= scale;
+		im[i] *= scale;
+	}
+}
+
+//==============================================================
+// Kernels
+
+void ComplexMultiplyAccumulate( float * accRe, float * accIm,
+		const float * aRe, const float * aIm,
+		const float * bRe, const float * bIm, const int count )
+{
+	int i = 0;
+#if defined( __ARM_NEON__ )
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const float32x4_t ar = vld1q_f32( aRe + i );
+		const float32x4_t ai = vld1q_f32( aIm + i );
+		const float32x4_t br = vld1q_f32( bRe + i );
+		const float32x4_t bi = vld1q_f32( bIm + i );
+		float32x4_t re = vld1q_f32( accRe + i );
+		float32x4_t im = vld1q_f32( accIm + i );
+		re = vmlaq_f32( re, ar, br );
+		re = vmlsq_f32( re, ai, bi );
+		im = vmlaq_f32( im, ar, bi );
+		im = vmlaq_f32( im, ai, br );
+		vst1q_f32( accRe + i, re );
+		vst1q_f32( accIm + i, im );
+	}
+#elif defined( __SSE__ )
+	for ( ; i + 4 <= count; i += 4 )
+	{
+		const __m128 ar = _mm_loadu_ps( aRe + i );
+		const __m128 ai = _mm_loadu_ps( aIm + i );
+		const __m128 br = _mm_loadu_ps( bRe + i );
+		const __m128 bi = _mm_loadu_ps( bIm + i );
+		const __m128 re = _mm_sub_ps( _mm_mul_ps( ar, br ), _mm_mul_ps( ai, bi ) );
+		const __m128 im = _mm_add_ps( _mm_mul_ps( ar, bi ), _mm_mul_ps( ai, br ) );
+		_mm_storeu_ps( accRe + i, _mm_add_ps( _mm_loadu_ps( accRe + i ), re ) );
+		_mm_storeu_ps( accIm + i, _mm_add_ps( _mm_loadu_ps( accIm + i ), im ) );
+	}
+#endif
+	for ( ; i < count; i++ )
+	{
+		accRe[i] += aRe[i] * bRe[i] - aIm[i] * bIm[i];
+		accIm[i] += aRe[i] * bIm[i] + aIm[i] * bRe[i];
+	}
+}
+
+void MixMonoToStereo( float * stereo, const float * mono, const int frames,
+		const float gainLeft, const float gainRight )
+{
+	int i = 0;
+#if defined( __ARM_NEON__ )
+	const float32x4_t left = vdupq_n_f32( gainLeft );
+	const float32x4_t right = vdupq_n_f32( gainRight );
+	for ( ; i + 4 <= frames; i += 4 )
+	{
+		const float32x4_t m = vld1q_f32( mono + i );
+		float32x4x2_t out = vld2q_f32( stereo + i * 2 );
+		out.val[0] = vmlaq_f32( out.val[0], m, left );
+		out.val[1] = vmlaq_f32( out.val[1], m, right );
+		vst2q_f32( stereo + i * 2, out );
+	}
+#elif defined( __SSE__ )
+	const __m128 left = _mm_set1_ps( gainLeft );
+	const __m128 right = _mm_set1_ps( gainRight );
+	for ( ; i + 4 <= frames; i += 4 )
+	{
+		const __m128 m = _mm_loadu_ps( mono + i );
+		const __m128 l = _mm_mul_ps( m, left );
+		const __m128 r = _mm_mul_ps( m, right );
+		float * out = stereo + i * 2;
+		_mm_storeu_ps( out, _mm_add_ps( _mm_loadu_ps( out ), _mm_unpacklo_ps( l, r ) ) );
+		_mm_storeu_ps( out + 4, _mm_add_ps( _mm_loadu_ps( out + 4 ), _mm_unpackhi_ps( l, r ) ) );
+	}
+#endif
+	for ( ; i < frames; i++ )
+	{
+		stereo[i * 2 + 0] += mono[i] * gainLeft;
+		stereo[i * 2 + 1] += mono[i] * gainRight;
+	}
+}
+
+}
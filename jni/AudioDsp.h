@@ -0,0 +1,61 @@
+/************************************************************************************
+
+Filename    :   AudioDsp.h
+Content     :   FFT and vectorized kernels for the native audio renderers
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_AudioDsp_h )
+#define OVR_AudioDsp_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+
+namespace OVR {
+
+//==============================================================
+// AudioFft
+//
+// Radix-2 complex FFT on separate real and imaginary arrays, in place.
+// The tables are built once by Init, so transforms don't allocate.
+class AudioFft
+{
+public:
+					AudioFft();
+
+	void			Init( const int size );		// power of two
+	int				GetSize() const				{ return Size; }
+
+	void			Forward( float * re, float * im ) const;
+	// scaled by 1 / size, so Inverse( Forward( x ) ) == x
+	void			Inverse( float * re, float * im ) const;
+
+private:
+	int				Size;
+	Array< int >	BitReverse;
+	Array< float >	CosTable;		// Size / 2 entries of cos( 2 pi k / Size )
+	Array< float >	SinTable;
+
+	void			Transform( float * re, float * im, const float sign ) const;
+};
+
+// acc += a * b for count complex values. NEON on ARM, SSE on x86.
+void	ComplexMultiplyAccumulate( float * accRe, float * accIm,
+			const float * aRe, const float * aIm,
+			const float * bRe, const float * bIm, const int count );
+
+// Interleaved stereo += mono * gain per side, the inner loop of the voice mixer.
+void	MixMonoToStereo( float * stereo, const float * mono, const int frames,
+			const float gainLeft, const float gainRight );
+
+}
+
+#endif // OVR_AudioDsp_h
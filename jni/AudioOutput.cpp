@@ -0,0 +1,181 @@
+/************************************************************************************
+
+Filename    :   AudioOutput.cpp
+Content     :   OpenSL ES stereo output that mixes native audio sources
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "AudioOutput.h"
+
+#include <string.h>
+
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+AudioOutput::AudioOutput()
+	: EngineObject( NULL )
+	, Engine( NULL )
+	, OutputMixObject( NULL )
+	, PlayerObject( NULL )
+	, Play( NULL )
+	, BufferQueue( NULL )
+	, NextBuffer( 0 )
+	, SourceCount( 0 )
+{
+	pthread_mutex_init( &SourceMutex, NULL );
+}
+
+AudioOutput::~AudioOutput()
+{
+	Close();
+	pthread_mutex_destroy( &SourceMutex );
+}
+
+bool AudioOutput::Open()
+{
+	Close();
+
+	if ( slCreateEngine( &EngineObject, 0, NULL, 0, NULL, NULL ) != SL_RESULT_SUCCESS ||
+		( *EngineObject )->Realize( EngineObject, SL_BOOLEAN_FALSE ) != SL_RESULT_SUCCESS ||
+		( *EngineObject )->GetInterface( EngineObject, SL_IID_ENGINE, &Engine ) != SL_RESULT_SUCCESS )
+	{
+		LOG( "AudioOutput: couldn't create the engine" );
+		Close();
+		return false;
+	}
+
+	if ( ( *Engine )->CreateOutputMix( Engine, &OutputMixObject, 0, NULL, NULL ) != SL_RESULT_SUCCESS ||
+		( *OutputMixObject )->Realize( OutputMixObject, SL_BOOLEAN_FALSE ) != SL_RESULT_SUCCESS )
+	{
+		LOG( "AudioOutput: couldn't create the output mix" );
+		Close();
+		return false;
+	}
+
+	SLDataLocator_AndroidSimpleBufferQueue bufferQueueLocator = { SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, BUFFER_COUNT };
+	SLDataFormat_PCM format =
+	{
+		SL_DATAFORMAT_PCM, 2, SL_SAMPLINGRATE_48,
+		SL_PCMSAMPLEFORMAT_FIXED_16, SL_PCMSAMPLEFORMAT_FIXED_16,
+		SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT, SL_BYTEORDER_LITTLEENDIAN
+	};
+	SLDataSource source = { &bufferQueueLocator, &format };
+	SLDataLocator_OutputMix outputMixLocator = { SL_DATALOCATOR_OUTPUTMIX, OutputMixObject };
+	SLDataSink sink = { &outputMixLocator, NULL };
+
+	const SLInterfaceID ids[1] = { SL_IID_BUFFERQUEUE };
+	const SLboolean required[1] = { SL_BOOLEAN_TRUE };
+	if ( ( *Engine )->CreateAudioPlayer( Engine, &PlayerObject, &source, &sink, 1, ids, required ) != SL_RESULT_SUCCESS ||
+		( *PlayerObject )->Realize( PlayerObject, SL_BOOLEAN_FALSE ) != SL_RESULT_SUCCESS ||
+		( *PlayerObject )->GetInterface( PlayerObject, SL_IID_PLAY, &Play ) != SL_RESULT_SUCCESS ||
+		( *PlayerObject )->GetInterface( PlayerObject, SL_IID_BUFFERQUEUE, &BufferQueue ) != SL_RESULT_SUCCESS ||
+		( *BufferQueue )->RegisterCallback( BufferQueue, BufferQueueCallback, this ) != SL_RESULT_SUCCESS )
+	{
+		LOG( "AudioOutput: couldn't create the player" );
+		Close();
+		return false;
+	}
+
+	// prime the queue, the callback keeps it full from then on
+	for ( int i = 0; i < BUFFER_COUNT; i++ )
+	{
+		FillBuffer();
+	}
+	if ( ( *Play )->SetPlayState( Play, SL_PLAYSTATE_PLAYING ) != SL_RESULT_SUCCESS )
+	{
+		LOG( "AudioOutput: couldn't start the player" );
+		Close();
+		return false;
+	}
+	LOG( "AudioOutput: %i Hz, %i frame buffers", SAMPLE_RATE, BUFFER_FRAMES );
+	return true;
+}
+
+void AudioOutput::Close()
+{
+	// destroying the player waits for a callback in progress
+	if ( PlayerObject != NULL )
+	{
+		( *Play )->SetPlayState( Play, SL_PLAYSTATE_STOPPED );
+		( *PlayerObject )->Destroy( PlayerObject );
+	}
+	if ( OutputMixObject != NULL )
+	{
+		( *OutputMixObject )->Destroy( OutputMixObject );
+	}
+	if ( EngineObject != NULL )
+	{
+		( *EngineObject )->Destroy( EngineObject );
+	}
+	EngineObject = NULL;
+	Engine = NULL;
+	OutputMixObject = NULL;
+	PlayerObject = NULL;
+	Play = NULL;
+	BufferQueue = NULL;
+	NextBuffer = 0;
+}
+
+bool AudioOutput::AddSource( AudioSource * source )
+{
+	pthread_mutex_lock( &SourceMutex );
+	const bool added = SourceCount < MAX_SOURCES;
+	if ( added )
+	{
+		Sources[SourceCount++] = source;
+	}
+	pthread_mutex_unlock( &SourceMutex );
+	return added;
+}
+
+void AudioOutput::RemoveSource( AudioSource * source )
+{
+	pthread_mutex_lock( &SourceMutex );
+	for ( int i = 0; i < SourceCount; i++ )
+	{
+		if ( Sources[i] == source )
+		{
+			Sources[i] = Sources[--SourceCount];
+			break;
+		}
+	}
+	pthread_mutex_unlock( &SourceMutex );
+}
+
+void AudioOutput::BufferQueueCallback( SLAndroidSimpleBufferQueueItf queue, void * context )
+{
+	static_cast< AudioOutput * >( context )->FillBuffer();
+}
+
+void AudioOutput::FillBuffer()
+{
+	memset( Mix, 0, sizeof( Mix ) );
+
+	// Sources are only added and removed between videos, so this is rarely contended.
+	pthread_mutex_lock( &SourceMutex );
+	for ( int i = 0; i < SourceCount; i++ )
+	{
+		Sources[i]->MixAudio( Mix, BUFFER_FRAMES );
+	}
+	pthread_mutex_unlock( &SourceMutex );
+
+	SInt16 * buffer = Buffers[NextBuffer];
+	for ( int i = 0; i < BUFFER_FRAMES * 2; i++ )
+	{
+		const float sample = Mix[i] * 32767.0f;
+		buffer[i] = static_cast< SInt16 >( sample > 32767.0f ? 32767.0f : ( sample < -32768.0f ? -32768.0f : sample ) );
+	}
+	( *BufferQueue )->Enqueue( BufferQueue, buffer, sizeof( Buffers[0] ) );
+	NextBuffer = ( NextBuffer + 1 ) % BUFFER_COUNT;
+}
+
+}
@@ -0,0 +1,84 @@
+/************************************************************************************
+
+Filename    :   AudioOutput.h
+Content     :   OpenSL ES stereo output that mixes native audio sources
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_AudioOutput_h )
+#define OVR_AudioOutput_h
+
+#include <pthread.h>
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+
+#include "Kernel/OVR_Types.h"
+
+namespace OVR {
+
+//==============================================================
+// AudioSource
+class AudioSource
+{
+public:
+	virtual			~AudioSource() {}
+
+	// Audio thread. Adds frames of interleaved stereo to the mix, must not block.
+	virtual void	MixAudio( float * stereo, const int frames ) = 0;
+};
+
+//==============================================================
+// AudioOutput
+//
+// A buffer queue player fed from its own callback, so sources are mixed on
+// the OpenSL ES audio thread one buffer ahead of the hardware.
+class AudioOutput
+{
+public:
+	static const int	SAMPLE_RATE = 48000;
+	static const int	BUFFER_FRAMES = 256;
+	static const int	BUFFER_COUNT = 2;
+	static const int	MAX_SOURCES = 4;
+
+						AudioOutput();
+						~AudioOutput();
+
+	bool				Open();
+	void				Close();
+	bool				IsOpen() const		{ return PlayerObject != NULL; }
+
+	// Once RemoveSource returns the audio thread no longer uses the source.
+	bool				AddSource( AudioSource * source );
+	void				RemoveSource( AudioSource * source );
+
+private:
+	SLObjectItf			EngineObject;
+	SLEngineItf			Engine;
+	SLObjectItf			OutputMixObject;
+	SLObjectItf			PlayerObject;
+	SLPlayItf			Play;
+	SLAndroidSimpleBufferQueueItf	BufferQueue;
+
+	SInt16				Buffers[BUFFER_COUNT][BUFFER_FRAMES * 2];
+	int					NextBuffer;
+	float				Mix[BUFFER_FRAMES * 2];
+
+	pthread_mutex_t		SourceMutex;
+	AudioSource *		Sources[MAX_SOURCES];
+	int					SourceCount;
+
+	static void			BufferQueueCallback( SLAndroidSimpleBufferQueueItf queue, void * context );
+	void				FillBuffer();
+};
+
+}
+
+#endif // OVR_AudioOutput_h
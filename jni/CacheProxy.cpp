@@ -0,0 +1,1189 @@
+/************************************************************************************
+
+Filename    :   CacheProxy.cpp
+Content     :   Loopback HTTP proxy serving streamed videos from an on-disk cache
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "CacheProxy.h"
+
+#include <dirent.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "HttpClient.h"
+
+namespace OVR {
+
+static const int	MAX_REQUEST_BYTES = 8 * 1024;
+static const int	CLIENT_IDLE_SECONDS = 30;
+static const int	UPSTREAM_TIMEOUT_MS = 10000;
+static const char *	LENGTH_FILE_NAME = "length";
+static const char *	SEGMENT_SUFFIX = ".seg";
+static const char *	PLAYLIST_SUFFIX = ".m3u8";
+static const int	MAX_PLAYLIST_BYTES = 4 * 1024 * 1024;
+static const int	LISTED_AHEAD_SEGMENTS = 2;
+static const double	MAX_SEGMENT_SKEW_SECONDS = 0.05;		// EXTINF rounding
+
+static double GetSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// FNV-1a, the key only has to tell urls apart within one cache
+static UInt64 HashUrl( const char * url )
+{
+	UInt64 hash = 14695981039346656037ull;
+	for ( const char * p = url; *p != 0; p++ )
+	{
+		hash ^= static_cast< UByte >( *p );
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static bool SendAll( const int socket, const char * data, const int length )
+{
+	int done = 0;
+	while ( done < length )
+	{
+		const ssize_t n = send( socket, data + done, length - done, MSG_NOSIGNAL );
+		if ( n < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if ( n <= 0 )
+		{
+			return false;
+		}
+		done += static_cast< int >( n );
+	}
+	return true;
+}
+
+// The player's process ignores SIGPIPE, as all Android app processes do, so
+// sendfile to a closed socket fails with EPIPE instead of killing it.
+static bool SendFileRange( const int socket, const int fd, const int offset, const int count )
+{
+	off_t position = offset;
+	int remaining = count;
+	while ( remaining > 0 )
+	{
+		const ssize_t n = sendfile( socket, fd, &position, remaining );
+		if ( n < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if ( n <= 0 )
+		{
+			return false;
+		}
+		remaining -= static_cast< int >( n );
+	}
+	return true;
+}
+
+// Value of a request header, without leading spaces, or false if absent.
+static bool FindHeader( const char * request, const char * name, String & outValue )
+{
+	const int nameLength = static_cast< int >( strlen( name ) );
+	for ( const char * line = strstr( request, "\r\n" ); line != NULL; line = strstr( line, "\r\n" ) )
+	{
+		line += 2;
+		if ( strncasecmp( line, name, nameLength ) == 0 && line[nameLength] == ':' )
+		{
+			const char * value = line + nameLength + 1;
+			while ( *value == ' ' || *value == '\t' )
+			{
+				value++;
+			}
+			const char * end = strstr( value, "\r\n" );
+			outValue = ( end != NULL ) ? String( value, end - value ) : String( value );
+			return true;
+		}
+	}
+	return false;
+}
+
+//==============================================================
+// Cache files
+
+struct CachedFile
+{
+	String	Path;
+	time_t	Time;
+	SInt64	Size;
+};
+
+static bool CachedFileOlder( const CachedFile & a, const CachedFile & b )
+{
+	return a.Time < b.Time;
+}
+
+// Segment files of every resource directory under cacheDir.
+static void ListSegments( const String & cacheDir, Array< CachedFile > & outFiles )
+{
+	DIR * dir = opendir( cacheDir.ToCStr() );
+	if ( dir == NULL )
+	{
+		return;
+	}
+	for ( struct dirent * entry = readdir( dir ); entry != NULL; entry = readdir( dir ) )
+	{
+		if ( entry->d_name[0] == '.' )
+		{
+			continue;
+		}
+		const String resourceDir = cacheDir + entry->d_name + "/";
+		DIR * segments = opendir( resourceDir.ToCStr() );
+		if ( segments == NULL )
+		{
+			continue;
+		}
+		for ( struct dirent * segment = readdir( segments ); segment != NULL; segment = readdir( segments ) )
+		{
+			const char * suffix = strstr( segment->d_name, SEGMENT_SUFFIX );
+			struct stat st;
+			CachedFile file;
+			file.Path = resourceDir + segment->d_name;
+			if ( suffix != NULL && suffix[strlen( SEGMENT_SUFFIX )] == 0 && stat( file.Path.ToCStr(), &st ) == 0 )
+			{
+				file.Time = st.st_mtime;
+				file.Size = st.st_size;
+				outFiles.PushBack( file );
+			}
+		}
+		closedir( segments );
+	}
+	closedir( dir );
+}
+
+//==============================================================
+// CacheProxy
+
+CacheProxy::CacheProxy()
+	: MaxCacheBytes( 0 )
+	, ListenSocket( -1 )
+	, Port( 0 )
+	, Exiting( false )
+	, CacheBytes( 0 )
+	, Hits( 0 )
+	, Misses( 0 )
+	, BytesServed( 0 )
+	, Requests( 0 )
+	, FirstByteSecondsTotal( 0.0 )
+	, PositionTime( 0.0 )
+	, PositionSeconds( 0.0 )
+	, Playing( false )
+	, AdaptiveSegments( 0 )
+	, AdaptiveBitsTotal( 0.0 )
+{
+	pthread_mutex_init( &Mutex, NULL );
+	pthread_cond_init( &Wake, NULL );
+	for ( int i = 0; i < MAX_CLIENTS; i++ )
+	{
+		Clients[i].Socket = -1;
+		Clients[i].Finished = false;
+		Clients[i].Proxy = this;
+	}
+}
+
+CacheProxy::~CacheProxy()
+{
+	Stop();
+	for ( int i = 0; i < Streams.GetSizeI(); i++ )
+	{
+		delete Streams[i];
+	}
+	pthread_cond_destroy( &Wake );
+	pthread_mutex_destroy( &Mutex );
+}
+
+bool CacheProxy::Start( const char * cacheDir, const SInt64 maxCacheBytes )
+{
+	Stop();
+
+	CacheDir = cacheDir;
+	if ( CacheDir.IsEmpty() || CacheDir.ToCStr()[CacheDir.GetSize() - 1] != '/' )
+	{
+		CacheDir += "/";
+	}
+	mkdir( CacheDir.ToCStr(), 0700 );
+	// room for several read-ahead windows, or the window evicts itself
+	MaxCacheBytes = Alg::Max( maxCacheBytes, static_cast< SInt64 >( SEGMENT_BYTES ) * READ_AHEAD_SEGMENTS * 4 );
+
+	const int listenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+	if ( listenSocket < 0 )
+	{
+		LOG( "CacheProxy: socket failed: %s", strerror( errno ) );
+		return false;
+	}
+	// loopback only, on whatever port is free
+	struct sockaddr_in address;
+	memset( &address, 0, sizeof( address ) );
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	address.sin_port = 0;
+	socklen_t addressLength = sizeof( address );
+	if ( bind( listenSocket, ( struct sockaddr * )&address, sizeof( address ) ) != 0 ||
+		listen( listenSocket, MAX_CLIENTS ) != 0 ||
+		getsockname( listenSocket, ( struct sockaddr * )&address, &addressLength ) != 0 )
+	{
+		LOG( "CacheProxy: can't listen: %s", strerror( errno ) );
+		close( listenSocket );
+		return false;
+	}
+	Port = ntohs( address.sin_port );
+
+	ScanCache();
+	Exiting = false;
+	ListenSocket = listenSocket;
+	if ( pthread_create( &AcceptThread, NULL, AcceptThreadFunction, this ) != 0 )
+	{
+		LOG( "CacheProxy: pthread_create failed" );
+		close( ListenSocket );
+		ListenSocket = -1;
+		return false;
+	}
+	if ( pthread_create( &PrefetchThread, NULL, PrefetchThreadFunction, this ) != 0 )
+	{
+		LOG( "CacheProxy: pthread_create failed" );
+		Stop();
+		return false;
+	}
+	LOG( "CacheProxy: port %i, %.1f of %.1f MB cached", Port, CacheBytes / ( 1024.0 * 1024.0 ), MaxCacheBytes / ( 1024.0 * 1024.0 ) );
+	return true;
+}
+
+void CacheProxy::Stop()
+{
+	if ( ListenSocket < 0 )
+	{
+		return;
+	}
+	pthread_mutex_lock( &Mutex );
+	Exiting = true;
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+
+	// shutdown wakes the threads blocked in accept and recv
+	shutdown( ListenSocket, SHUT_RDWR );
+	pthread_join( AcceptThread, NULL );
+	pthread_join( PrefetchThread, NULL );
+	close( ListenSocket );
+	ListenSocket = -1;
+
+	pthread_mutex_lock( &Mutex );
+	for ( int i = 0; i < MAX_CLIENTS; i++ )
+	{
+		if ( Clients[i].Socket >= 0 )
+		{
+			shutdown( Clients[i].Socket, SHUT_RDWR );
+		}
+	}
+	pthread_mutex_unlock( &Mutex );
+	ReapClients( true );
+
+	InFlight.Clear();
+	PrefetchQueue.Clear();
+	LogStats();
+}
+
+bool CacheProxy::IsPlaylistUrl( const char * url )
+{
+	HttpUrl parsed;
+	if ( url == NULL || !parsed.Parse( url ) )
+	{
+		return false;
+	}
+	const char * query = strchr( parsed.Path.ToCStr(), '?' );
+	const int pathLength = ( query != NULL ) ? static_cast< int >( query - parsed.Path.ToCStr() ) : static_cast< int >( parsed.Path.GetSize() );
+	const int suffixLength = static_cast< int >( strlen( PLAYLIST_SUFFIX ) );
+	return pathLength > suffixLength &&
+		strncasecmp( parsed.Path.ToCStr() + pathLength - suffixLength, PLAYLIST_SUFFIX, suffixLength ) == 0;
+}
+
+String CacheProxy::GetProxyUrl( const char * url )
+{
+	HttpUrl parsed;
+	if ( ListenSocket < 0 || url == NULL || strncmp( url, "http://", 7 ) != 0 || !parsed.Parse( url ) )
+	{
+		return String( url );
+	}
+	char key[32];
+	snprintf( key, sizeof( key ), "%016llx", ( unsigned long long )HashUrl( url ) );
+	const bool playlist = IsPlaylistUrl( url );
+
+	pthread_mutex_lock( &Mutex );
+	bool found = false;
+	for ( int i = 0; i < Resources.GetSizeI() && !found; i++ )
+	{
+		found = ( Resources[i].Key == key );
+	}
+	if ( !found )
+	{
+		Resource resource;
+		resource.Url = url;
+		resource.Key = key;
+		resource.Length = -1;
+		resource.StreamIndex = -1;
+		if ( playlist )
+		{
+			resource.StreamIndex = Streams.GetSizeI();
+			Streams.PushBack( new AdaptiveStream );
+		}
+		else
+		{
+			LoadLength( resource );
+		}
+		Resources.PushBack( resource );
+	}
+	pthread_mutex_unlock( &Mutex );
+
+	// the player goes by the extension to recognize a playlist
+	char proxyUrl[64];
+	snprintf( proxyUrl, sizeof( proxyUrl ), "http://127.0.0.1:%i/%s%s", Port, key, playlist ? PLAYLIST_SUFFIX : "" );
+	return String( proxyUrl );
+}
+
+void CacheProxy::SetPlayPosition( const double positionSeconds, const bool playing )
+{
+	pthread_mutex_lock( &Mutex );
+	PositionTime = GetSeconds();
+	PositionSeconds = positionSeconds;
+	Playing = playing;
+	pthread_mutex_unlock( &Mutex );
+}
+
+double CacheProxy::GetPlayPosition( const double timeInSeconds ) const
+{
+	return Playing ? PositionSeconds + ( timeInSeconds - PositionTime ) : PositionSeconds;
+}
+
+void CacheProxy::GetStats( int & outHits, int & outMisses, SInt64 & outBytesServed, double & outFirstByteSeconds ) const
+{
+	pthread_mutex_lock( &Mutex );
+	outHits = Hits;
+	outMisses = Misses;
+	outBytesServed = BytesServed;
+	outFirstByteSeconds = ( Requests > 0 ) ? FirstByteSecondsTotal / Requests : 0.0;
+	pthread_mutex_unlock( &Mutex );
+}
+
+void CacheProxy::LogStats() const
+{
+	int hits;
+	int misses;
+	SInt64 bytes;
+	double firstByte;
+	GetStats( hits, misses, bytes, firstByte );
+	if ( hits + misses > 0 )
+	{
+		LOG( "CacheProxy: %i hits, %i misses (%.0f%%), %.1f MB served, %.1f ms to first byte",
+			hits, misses, 100.0 * hits / ( hits + misses ), bytes / ( 1024.0 * 1024.0 ), firstByte * 1000.0 );
+	}
+	pthread_mutex_lock( &Mutex );
+	if ( AdaptiveSegments > 0 )
+	{
+		LOG( "CacheProxy: %i adaptive segments, %.2f Mbps average, %.2f Mbps estimated throughput",
+			AdaptiveSegments, AdaptiveBitsTotal / AdaptiveSegments * 1e-6, Throughput.GetEstimate() * 1e-6 );
+	}
+	pthread_mutex_unlock( &Mutex );
+}
+
+//==============================
+// threads
+
+void * CacheProxy::AcceptThreadFunction( void * param )
+{
+	pthread_setname_np( pthread_self(), "CacheProxy" );
+	static_cast< CacheProxy * >( param )->AcceptLoop();
+	return NULL;
+}
+
+void * CacheProxy::ClientThreadFunction( void * param )
+{
+	Client * client = static_cast< Client * >( param );
+	client->Proxy->ServeClient( client->Socket );
+	pthread_mutex_lock( &client->Proxy->Mutex );
+	client->Finished = true;
+	pthread_mutex_unlock( &client->Proxy->Mutex );
+	return NULL;
+}
+
+void * CacheProxy::PrefetchThreadFunction( void * param )
+{
+	pthread_setname_np( pthread_self(), "CacheReadAhead" );
+	static_cast< CacheProxy * >( param )->PrefetchLoop();
+	return NULL;
+}
+
+void CacheProxy::ReapClients( const bool all )
+{
+	for ( int i = 0; i < MAX_CLIENTS; i++ )
+	{
+		pthread_mutex_lock( &Mutex );
+		const bool reap = Clients[i].Socket >= 0 && ( all || Clients[i].Finished );
+		pthread_mutex_unlock( &Mutex );
+		if ( reap )
+		{
+			pthread_join( Clients[i].Thread, NULL );
+			close( Clients[i].Socket );
+			Clients[i].Socket = -1;
+			Clients[i].Finished = false;
+		}
+	}
+}
+
+void CacheProxy::AcceptLoop()
+{
+	while ( !Exiting )
+	{
+		const int socket = accept( ListenSocket, NULL, NULL );
+		if ( socket < 0 )
+		{
+			if ( errno == EINTR || errno == ECONNABORTED )
+			{
+				continue;
+			}
+			break;
+		}
+		ReapClients( false );
+		int slot = -1;
+		for ( int i = 0; i < MAX_CLIENTS && slot < 0; i++ )
+		{
+			slot = ( Clients[i].Socket < 0 ) ? i : -1;
+		}
+		if ( slot < 0 )
+		{
+			LOG( "CacheProxy: too many connections" );
+			close( socket );
+			continue;
+		}
+		Clients[slot].Socket = socket;
+		Clients[slot].Finished = false;
+		if ( pthread_create( &Clients[slot].Thread, NULL, ClientThreadFunction, &Clients[slot] ) != 0 )
+		{
+			LOG( "CacheProxy: pthread_create failed" );
+			close( socket );
+			Clients[slot].Socket = -1;
+		}
+	}
+}
+
+void CacheProxy::PrefetchLoop()
+{
+	HttpConnection upstream;
+	upstream.SetTimeoutMs( UPSTREAM_TIMEOUT_MS );
+	for ( ;; )
+	{
+		pthread_mutex_lock( &Mutex );
+		while ( PrefetchQueue.GetSizeI() == 0 && !Exiting )
+		{
+			pthread_cond_wait( &Wake, &Mutex );
+		}
+		if ( Exiting )
+		{
+			pthread_mutex_unlock( &Mutex );
+			break;
+		}
+		const SegmentRef ref = PrefetchQueue[0];
+		PrefetchQueue.RemoveAt( 0 );
+		pthread_mutex_unlock( &Mutex );
+
+		bool fetched;
+		EnsureSegment( ref.ResourceIndex, ref.Index, upstream, fetched );
+	}
+}
+
+//==============================
+// requests
+
+void CacheProxy::ServeClient( const int socket )
+{
+	struct timeval timeout;
+	timeout.tv_sec = CLIENT_IDLE_SECONDS;
+	timeout.tv_usec = 0;
+	setsockopt( socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+	// the header and the sendfile body are separate writes; without this the
+	// tail of each response waits on the player's delayed ack
+	const int one = 1;
+	setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+
+	HttpConnection upstream;
+	upstream.SetTimeoutMs( UPSTREAM_TIMEOUT_MS );
+
+	char request[MAX_REQUEST_BYTES + 1];
+	int used = 0;
+	while ( !Exiting )
+	{
+		request[used] = 0;
+		char * end = strstr( request, "\r\n\r\n" );
+		if ( end == NULL )
+		{
+			if ( used >= MAX_REQUEST_BYTES )
+			{
+				break;
+			}
+			const ssize_t n = recv( socket, request + used, MAX_REQUEST_BYTES - used, 0 );
+			if ( n < 0 && errno == EINTR )
+			{
+				continue;
+			}
+			if ( n <= 0 )
+			{
+				break;
+			}
+			used += static_cast< int >( n );
+			continue;
+		}
+
+		end[2] = 0;		// keep the last header's line break for FindHeader
+		bool keepAlive = true;
+		if ( !ServeRequest( socket, request, upstream, keepAlive ) || !keepAlive )
+		{
+			break;
+		}
+		// anything after this request was pipelined behind it
+		const int consumed = static_cast< int >( end + 4 - request );
+		memmove( request, request + consumed, used - consumed );
+		used -= consumed;
+	}
+}
+
+bool CacheProxy::ServeRequest( const int socket, const char * request, HttpConnection & upstream, bool & outKeepAlive )
+{
+	const double start = GetSeconds();
+
+	char method[8] = { 0 };
+	char path[64] = { 0 };
+	if ( sscanf( request, "%7s %63s", method, path ) != 2 )
+	{
+		return false;
+	}
+	String connection;
+	outKeepAlive = !( FindHeader( request, "Connection", connection ) && strcasecmp( connection.ToCStr(), "close" ) == 0 );
+	const bool head = strcmp( method, "HEAD" ) == 0;
+
+	// /key for a file, /key.m3u8 and /key/segment.ts for an adaptive stream
+	const int keyLength = static_cast< int >( strcspn( path + 1, "./" ) );
+	const String key( path + 1, keyLength );
+	const int segment = ( path[1 + keyLength] == '/' ) ? atoi( path + 2 + keyLength ) : -1;
+
+	pthread_mutex_lock( &Mutex );
+	int resourceIndex = -1;
+	for ( int i = 0; i < Resources.GetSizeI() && resourceIndex < 0; i++ )
+	{
+		resourceIndex = ( Resources[i].Key == key ) ? i : -1;
+	}
+	SInt64 length = ( resourceIndex >= 0 ) ? Resources[resourceIndex].Length : -1;
+	const bool adaptive = resourceIndex >= 0 && Resources[resourceIndex].StreamIndex >= 0;
+	pthread_mutex_unlock( &Mutex );
+
+	if ( resourceIndex < 0 || ( !head && strcmp( method, "GET" ) != 0 ) || ( !adaptive && path[1 + keyLength] != 0 ) )
+	{
+		static const char notFound[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+		return SendAll( socket, notFound, sizeof( notFound ) - 1 );
+	}
+	if ( adaptive )
+	{
+		return ServeAdaptive( socket, resourceIndex, segment, head, upstream, outKeepAlive );
+	}
+
+	// the first segment's response tells the length
+	bool fetched = false;
+	if ( length < 0 )
+	{
+		if ( !EnsureSegment( resourceIndex, 0, upstream, fetched ) )
+		{
+			static const char badGateway[] = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n";
+			SendAll( socket, badGateway, sizeof( badGateway ) - 1 );
+			return false;
+		}
+		pthread_mutex_lock( &Mutex );
+		length = Resources[resourceIndex].Length;
+		pthread_mutex_unlock( &Mutex );
+	}
+
+	// bytes=first-last, bytes=first- and bytes=-suffix
+	SInt64 first = 0;
+	SInt64 last = length - 1;
+	String range;
+	const bool ranged = FindHeader( request, "Range", range ) && strncmp( range.ToCStr(), "bytes=", 6 ) == 0;
+	if ( ranged )
+	{
+		const char * spec = range.ToCStr() + 6;
+		if ( spec[0] == '-' )
+		{
+			first = Alg::Max( length - static_cast< SInt64 >( atoll( spec + 1 ) ), static_cast< SInt64 >( 0 ) );
+		}
+		else
+		{
+			first = static_cast< SInt64 >( atoll( spec ) );
+			const char * dash = strchr( spec, '-' );
+			if ( dash != NULL && dash[1] >= '0' && dash[1] <= '9' )
+			{
+				last = Alg::Min( static_cast< SInt64 >( atoll( dash + 1 ) ), length - 1 );
+			}
+		}
+	}
+
+	char header[512];
+	if ( first >= length || first > last )
+	{
+		snprintf( header, sizeof( header ), "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\nContent-Length: 0\r\n\r\n",
+			( long long )length );
+		return SendAll( socket, header, static_cast< int >( strlen( header ) ) );
+	}
+
+	pthread_mutex_lock( &Mutex );
+	const String contentType = Resources[resourceIndex].ContentType.IsEmpty() ? String( "application/octet-stream" ) : Resources[resourceIndex].ContentType;
+	pthread_mutex_unlock( &Mutex );
+	if ( ranged )
+	{
+		snprintf( header, sizeof( header ), "HTTP/1.1 206 Partial Content\r\nContent-Type: %s\r\nAccept-Ranges: bytes\r\n"
+			"Content-Range: bytes %lld-%lld/%lld\r\nContent-Length: %lld\r\n%s\r\n",
+			contentType.ToCStr(), ( long long )first, ( long long )last, ( long long )length, ( long long )( last - first + 1 ),
+			outKeepAlive ? "" : "Connection: close\r\n" );
+	}
+	else
+	{
+		snprintf( header, sizeof( header ), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nAccept-Ranges: bytes\r\nContent-Length: %lld\r\n%s\r\n",
+			contentType.ToCStr(), ( long long )length, outKeepAlive ? "" : "Connection: close\r\n" );
+	}
+	if ( !SendAll( socket, header, static_cast< int >( strlen( header ) ) ) )
+	{
+		return false;
+	}
+	if ( head )
+	{
+		return true;
+	}
+
+	Resource resource;
+	resource.Key = key;
+	const int firstSegment = static_cast< int >( first / SEGMENT_BYTES );
+	const int lastSegment = static_cast< int >( last / SEGMENT_BYTES );
+	for ( int index = firstSegment; index <= lastSegment; index++ )
+	{
+		QueueReadAhead( resourceIndex, index + 1 );
+
+		const SInt64 segmentStart = static_cast< SInt64 >( index ) * SEGMENT_BYTES;
+		const int offset = static_cast< int >( Alg::Max( first, segmentStart ) - segmentStart );
+		const int count = static_cast< int >( Alg::Min( last + 1, segmentStart + SEGMENT_BYTES ) - segmentStart ) - offset;
+
+		// a segment can be evicted between the check and the open, then it is fetched again
+		const String segmentPath = GetSegmentPath( resource, index );
+		int fd = -1;
+		bool fetchedAny = false;
+		for ( int attempt = 0; attempt < 2 && fd < 0; attempt++ )
+		{
+			if ( !EnsureSegment( resourceIndex, index, upstream, fetched ) )
+			{
+				return false;
+			}
+			fetchedAny = fetchedAny || fetched;
+			fd = open( segmentPath.ToCStr(), O_RDONLY );
+		}
+		if ( fd < 0 )
+		{
+			return false;
+		}
+		if ( !fetchedAny )
+		{
+			utimes( segmentPath.ToCStr(), NULL );	// recently used
+		}
+		const bool sent = SendFileRange( socket, fd, offset, count );
+		close( fd );
+		if ( !sent )
+		{
+			return false;
+		}
+
+		pthread_mutex_lock( &Mutex );
+		if ( index == firstSegment )
+		{
+			Requests++;
+			FirstByteSecondsTotal += GetSeconds() - start;
+		}
+		Hits += fetchedAny ? 0 : 1;
+		Misses += fetchedAny ? 1 : 0;
+		BytesServed += count;
+		pthread_mutex_unlock( &Mutex );
+	}
+	return true;
+}
+
+//==============================
+// adaptive streams
+
+bool CacheProxy::LoadStream( const String & url, AdaptiveStream & stream, HttpConnection & upstream ) const
+{
+	Array< UByte > body;
+	HlsPlaylist master;
+	if ( !HttpFetch( upstream, url.ToCStr(), -1, -1, body ) || body.GetSizeI() > MAX_PLAYLIST_BYTES ||
+		!master.Parse( reinterpret_cast< const char * >( body.GetDataPtr() ), body.GetSizeI(), url.ToCStr() ) )
+	{
+		LOG( "CacheProxy: can't load playlist %s", url.ToCStr() );
+		return false;
+	}
+	stream.Adaptive = false;
+	if ( !master.IsMaster() )
+	{
+		return true;	// a single rendition, nothing to choose
+	}
+
+	Array< int > bitrates;
+	stream.Variants.Resize( master.Variants.GetSize() );
+	for ( int i = 0; i < master.Variants.GetSizeI(); i++ )
+	{
+		HlsPlaylist & variant = stream.Variants[i];
+		if ( !HttpFetch( upstream, master.Variants[i].Url.ToCStr(), -1, -1, body ) || body.GetSizeI() > MAX_PLAYLIST_BYTES ||
+			!variant.Parse( reinterpret_cast< const char * >( body.GetDataPtr() ), body.GetSizeI(), master.Variants[i].Url.ToCStr() ) )
+		{
+			LOG( "CacheProxy: can't load variant %s", master.Variants[i].Url.ToCStr() );
+			return true;
+		}
+		// segment n of every variant has to cover the same time and decode on its own
+		bool aligned = variant.EndList && variant.Plain && variant.Segments.GetSizeI() > 0 &&
+			variant.Segments.GetSizeI() == stream.Variants[0].Segments.GetSizeI();
+		for ( int j = 0; j < variant.Segments.GetSizeI() && aligned; j++ )
+		{
+			aligned = fabs( variant.Segments[j].Seconds - stream.Variants[0].Segments[j].Seconds ) <= MAX_SEGMENT_SKEW_SECONDS;
+		}
+		if ( !aligned )
+		{
+			LOG( "CacheProxy: %s can't be switched per segment, playing it directly", url.ToCStr() );
+			return true;
+		}
+		bitrates.PushBack( master.Variants[i].Bandwidth );
+	}
+
+	const HlsPlaylist & timing = stream.Variants[0];
+	stream.TargetDuration = static_cast< int >( timing.TargetDuration + 0.999 );
+	stream.SegmentStarts.Resize( timing.Segments.GetSize() );
+	double start = 0.0;
+	for ( int i = 0; i < timing.Segments.GetSizeI(); i++ )
+	{
+		stream.SegmentStarts[i] = start;
+		start += timing.Segments[i].Seconds;
+	}
+	stream.Listed.Clear();
+
+	stream.Abr.SetBitrates( bitrates, start / timing.Segments.GetSizeI() );
+	stream.Adaptive = true;
+	LOG( "CacheProxy: %s has %i variants, %i segments", url.ToCStr(), bitrates.GetSizeI(), timing.Segments.GetSizeI() );
+	return true;
+}
+
+// Picks the variants of the segments up to LISTED_AHEAD_SEGMENTS past the
+// requested one, or past the one playing if that is further on.
+void CacheProxy::PickVariants( AdaptiveStream & stream, const int segment, const double now )
+{
+	const double position = GetPlayPosition( now );
+	int playing = 0;
+	while ( playing + 1 < stream.SegmentStarts.GetSizeI() && stream.SegmentStarts[playing + 1] <= position )
+	{
+		playing++;
+	}
+	const int last = Alg::Min( Alg::Max( segment, playing ) + LISTED_AHEAD_SEGMENTS, stream.SegmentStarts.GetSizeI() - 1 );
+	while ( stream.Listed.GetSizeI() <= last )
+	{
+		// the buffer is how far the segment starts ahead of what is playing
+		const double buffer = Alg::Max( stream.SegmentStarts[stream.Listed.GetSizeI()] - position, 0.0 );
+		stream.Listed.PushBack( stream.Abr.ChooseRendition( buffer, Throughput.GetEstimate() ) );
+	}
+}
+
+String CacheProxy::BuildPlaylist( const AdaptiveStream & stream, const String & key ) const
+{
+	const HlsPlaylist & timing = stream.Variants[0];
+	const bool complete = stream.Listed.GetSizeI() == timing.Segments.GetSizeI();
+	char line[128];
+	snprintf( line, sizeof( line ), "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:%i\n#EXT-X-MEDIA-SEQUENCE:0\n%s",
+		stream.TargetDuration, complete ? "" : "#EXT-X-PLAYLIST-TYPE:EVENT\n" );
+	String playlist( line );
+	for ( int i = 0; i < stream.Listed.GetSizeI(); i++ )
+	{
+		if ( i > 0 && stream.Listed[i] != stream.Listed[i - 1] )
+		{
+			playlist += "#EXT-X-DISCONTINUITY\n";
+		}
+		// relative to /key.m3u8
+		snprintf( line, sizeof( line ), "#EXTINF:%.3f,\n%s/%i.ts\n", timing.Segments[i].Seconds, key.ToCStr(), i );
+		playlist += line;
+	}
+	if ( complete )
+	{
+		playlist += "#EXT-X-ENDLIST\n";
+	}
+	return playlist;
+}
+
+bool CacheProxy::ServeAdaptive( const int socket, const int resourceIndex, const int segment, const bool head,
+		HttpConnection & upstream, const bool keepAlive )
+{
+	pthread_mutex_lock( &Mutex );
+	AdaptiveStream * stream = Streams[Resources[resourceIndex].StreamIndex];
+	const String url = Resources[resourceIndex].Url;
+	const String key = Resources[resourceIndex].Key;
+	while ( stream->Loading && !Exiting )
+	{
+		pthread_cond_wait( &Wake, &Mutex );
+	}
+	if ( !stream->Loaded && !Exiting )
+	{
+		stream->Loading = true;
+		pthread_mutex_unlock( &Mutex );
+		AdaptiveStream loaded;
+		const bool ok = LoadStream( url, loaded, upstream );
+		pthread_mutex_lock( &Mutex );
+		if ( ok )
+		{
+			stream->Adaptive = loaded.Adaptive;
+			stream->Variants = loaded.Variants;
+			stream->SegmentStarts = loaded.SegmentStarts;
+			stream->Listed = loaded.Listed;
+			stream->TargetDuration = loaded.TargetDuration;
+			stream->Abr = loaded.Abr;
+			stream->Loaded = true;
+		}
+		stream->Loading = false;
+		pthread_cond_broadcast( &Wake );
+	}
+	const bool loaded = stream->Loaded;
+	const bool adaptive = stream->Adaptive;
+	const int segmentCount = stream->SegmentStarts.GetSizeI();
+	pthread_mutex_unlock( &Mutex );
+
+	char header[512];
+	if ( !loaded )
+	{
+		static const char badGateway[] = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n";
+		SendAll( socket, badGateway, sizeof( badGateway ) - 1 );
+		return false;
+	}
+	if ( !adaptive || segment >= segmentCount )
+	{
+		if ( segment >= 0 )
+		{
+			static const char notFound[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+			return SendAll( socket, notFound, sizeof( notFound ) - 1 );
+		}
+		snprintf( header, sizeof( header ), "HTTP/1.1 302 Found\r\nLocation: %s\r\nContent-Length: 0\r\n\r\n", url.ToCStr() );
+		return SendAll( socket, header, static_cast< int >( strlen( header ) ) );
+	}
+
+	if ( segment < 0 )
+	{
+		pthread_mutex_lock( &Mutex );
+		PickVariants( *stream, 0, GetSeconds() );
+		const String playlist = BuildPlaylist( *stream, key );
+		pthread_mutex_unlock( &Mutex );
+		snprintf( header, sizeof( header ), "HTTP/1.1 200 OK\r\nContent-Type: application/vnd.apple.mpegurl\r\nContent-Length: %i\r\n%s\r\n",
+			static_cast< int >( playlist.GetSize() ), keepAlive ? "" : "Connection: close\r\n" );
+		return SendAll( socket, header, static_cast< int >( strlen( header ) ) ) &&
+			( head || SendAll( socket, playlist.ToCStr(), static_cast< int >( playlist.GetSize() ) ) );
+	}
+
+	// the variant listed for the segment, so the discontinuities are where the player was told
+	pthread_mutex_lock( &Mutex );
+	const double now = GetSeconds();
+	PickVariants( *stream, segment, now );
+	const int variant = stream->Listed[segment];
+	const String segmentUrl = stream->Variants[variant].Segments[segment].Url;
+	const int bitrate = stream->Abr.GetBitrate( variant );
+	pthread_mutex_unlock( &Mutex );
+
+	Array< UByte > body;
+	if ( !HttpFetch( upstream, segmentUrl.ToCStr(), -1, -1, body ) )
+	{
+		LOG( "CacheProxy: fetch of %s failed", segmentUrl.ToCStr() );
+		static const char badGateway[] = "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n\r\n";
+		SendAll( socket, badGateway, sizeof( badGateway ) - 1 );
+		return false;
+	}
+	const double seconds = GetSeconds() - now;
+
+	pthread_mutex_lock( &Mutex );
+	Throughput.AddSample( body.GetSizeI(), seconds );
+	AdaptiveSegments++;
+	AdaptiveBitsTotal += bitrate;
+	BytesServed += body.GetSizeI();
+	pthread_mutex_unlock( &Mutex );
+
+	snprintf( header, sizeof( header ), "HTTP/1.1 200 OK\r\nContent-Type: video/mp2t\r\nContent-Length: %i\r\n%s\r\n",
+		body.GetSizeI(), keepAlive ? "" : "Connection: close\r\n" );
+	return SendAll( socket, header, static_cast< int >( strlen( header ) ) ) &&
+		( head || SendAll( socket, reinterpret_cast< const char * >( body.GetDataPtr() ), body.GetSizeI() ) );
+}
+
+//==============================
+// cache
+
+String CacheProxy::GetSegmentPath( const Resource & resource, const int index ) const
+{
+	char name[32];
+	snprintf( name, sizeof( name ), "/%08x%s", index, SEGMENT_SUFFIX );
+	return CacheDir + resource.Key + name;
+}
+
+bool CacheProxy::LoadLength( Resource & resource ) const
+{
+	const String path = CacheDir + resource.Key + "/" + LENGTH_FILE_NAME;
+	FILE * f = fopen( path.ToCStr(), "r" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	long long length = -1;
+	char contentType[128] = { 0 };
+	const int fields = fscanf( f, "%lld %127s", &length, contentType );
+	fclose( f );
+	if ( fields < 1 || length < 0 )
+	{
+		return false;
+	}
+	resource.Length = length;
+	resource.ContentType = contentType;
+	return true;
+}
+
+void CacheProxy::SaveLength( const Resource & resource ) const
+{
+	const String path = CacheDir + resource.Key + "/" + LENGTH_FILE_NAME;
+	FILE * f = fopen( path.ToCStr(), "w" );
+	if ( f != NULL )
+	{
+		fprintf( f, "%lld %s\n", ( long long )resource.Length, resource.ContentType.ToCStr() );
+		fclose( f );
+	}
+}
+
+bool CacheProxy::EnsureSegment( const int resourceIndex, const int index, HttpConnection & upstream, bool & outFetched )
+{
+	outFetched = false;
+
+	pthread_mutex_lock( &Mutex );
+	const String path = GetSegmentPath( Resources[resourceIndex], index );
+	for ( ;; )
+	{
+		if ( Exiting )
+		{
+			pthread_mutex_unlock( &Mutex );
+			return false;
+		}
+		if ( access( path.ToCStr(), F_OK ) == 0 )
+		{
+			pthread_mutex_unlock( &Mutex );
+			return true;
+		}
+		bool inFlight = false;
+		for ( int i = 0; i < InFlight.GetSizeI() && !inFlight; i++ )
+		{
+			inFlight = InFlight[i].ResourceIndex == resourceIndex && InFlight[i].Index == index;
+		}
+		if ( !inFlight )
+		{
+			break;
+		}
+		// the read-ahead thread or another connection is already fetching it
+		pthread_cond_wait( &Wake, &Mutex );
+	}
+	SegmentRef ref;
+	ref.ResourceIndex = resourceIndex;
+	ref.Index = index;
+	InFlight.PushBack( ref );
+	pthread_mutex_unlock( &Mutex );
+
+	const bool fetched = FetchSegment( resourceIndex, index, upstream );
+
+	pthread_mutex_lock( &Mutex );
+	for ( int i = 0; i < InFlight.GetSizeI(); i++ )
+	{
+		if ( InFlight[i].ResourceIndex == resourceIndex && InFlight[i].Index == index )
+		{
+			InFlight.RemoveAt( i );
+			break;
+		}
+	}
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+
+	outFetched = fetched;
+	return fetched;
+}
+
+bool CacheProxy::FetchSegment( const int resourceIndex, const int index, HttpConnection & upstream )
+{
+	pthread_mutex_lock( &Mutex );
+	Resource resource = Resources[resourceIndex];
+	pthread_mutex_unlock( &Mutex );
+
+	const SInt64 start = static_cast< SInt64 >( index ) * SEGMENT_BYTES;
+	if ( resource.Length >= 0 && start >= resource.Length )
+	{
+		return false;
+	}
+	SInt64 end = start + SEGMENT_BYTES - 1;
+	if ( resource.Length >= 0 )
+	{
+		end = Alg::Min( end, resource.Length - 1 );
+	}
+
+	Array< UByte > body;
+	HttpResponse response;
+	if ( !HttpFetch( upstream, resource.Url.ToCStr(), start, end, body, &response ) )
+	{
+		LOG( "CacheProxy: fetch of segment %i failed with %i", index, response.StatusCode );
+		return false;
+	}
+	SInt64 total = response.TotalLength;
+	if ( response.StatusCode == 200 )
+	{
+		// a server ignoring ranges is only usable for a resource that fits in one segment
+		if ( start != 0 || body.GetSizeI() > SEGMENT_BYTES )
+		{
+			LOG( "CacheProxy: upstream ignores range requests" );
+			return false;
+		}
+		total = body.GetSizeI();
+	}
+	if ( total < 0 || body.GetSizeI() != static_cast< int >( Alg::Min( total - start, static_cast< SInt64 >( SEGMENT_BYTES ) ) ) )
+	{
+		LOG( "CacheProxy: unexpected response for segment %i", index );
+		return false;
+	}
+
+	const String dir = CacheDir + resource.Key;
+	mkdir( dir.ToCStr(), 0700 );
+	const String path = GetSegmentPath( resource, index );
+	const String partialPath = path + ".tmp";
+	FILE * f = fopen( partialPath.ToCStr(), "wb" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	const bool written = fwrite( body.GetDataPtr(), 1, body.GetSize(), f ) == body.GetSize();
+	if ( fclose( f ) != 0 || !written || rename( partialPath.ToCStr(), path.ToCStr() ) != 0 )
+	{
+		unlink( partialPath.ToCStr() );
+		return false;
+	}
+
+	pthread_mutex_lock( &Mutex );
+	const bool newLength = Resources[resourceIndex].Length < 0;
+	Resources[resourceIndex].Length = total;
+	if ( Resources[resourceIndex].ContentType.IsEmpty() )
+	{
+		Resources[resourceIndex].ContentType = response.ContentType;
+	}
+	resource = Resources[resourceIndex];
+	CacheBytes += body.GetSizeI();
+	const bool overBudget = CacheBytes > MaxCacheBytes;
+	pthread_mutex_unlock( &Mutex );
+
+	if ( newLength )
+	{
+		SaveLength( resource );
+	}
+	if ( overBudget )
+	{
+		Evict();
+	}
+	return true;
+}
+
+void CacheProxy::QueueReadAhead( const int resourceIndex, const int nextIndex )
+{
+	pthread_mutex_lock( &Mutex );
+	const SInt64 length = Resources[resourceIndex].Length;
+	const int segmentCount = ( length >= 0 ) ? static_cast< int >( ( length + SEGMENT_BYTES - 1 ) / SEGMENT_BYTES ) : nextIndex;
+	// after a seek the old window is no use, only the latest read position counts
+	PrefetchQueue.Clear();
+	for ( int i = nextIndex; i < nextIndex + READ_AHEAD_SEGMENTS && i < segmentCount; i++ )
+	{
+		if ( access( GetSegmentPath( Resources[resourceIndex], i ).ToCStr(), F_OK ) != 0 )
+		{
+			SegmentRef ref;
+			ref.ResourceIndex = resourceIndex;
+			ref.Index = i;
+			PrefetchQueue.PushBack( ref );
+		}
+	}
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+}
+
+void CacheProxy::ScanCache()
+{
+	Array< CachedFile > files;
+	ListSegments( CacheDir, files );
+	SInt64 total = 0;
+	for ( int i = 0; i < files.GetSizeI(); i++ )
+	{
+		total += files[i].Size;
+	}
+	pthread_mutex_lock( &Mutex );
+	CacheBytes = total;
+	pthread_mutex_unlock( &Mutex );
+	if ( total > MaxCacheBytes )
+	{
+		Evict();
+	}
+}
+
+void CacheProxy::Evict()
+{
+	// down to 90% of the budget, so eviction doesn't run on every new segment
+	Array< CachedFile > files;
+	ListSegments( CacheDir, files );
+	Alg::QuickSort( files, CachedFileOlder );
+	SInt64 total = 0;
+	for ( int i = 0; i < files.GetSizeI(); i++ )
+	{
+		total += files[i].Size;
+	}
+	const SInt64 target = MaxCacheBytes / 10 * 9;
+	int removed = 0;
+	for ( int i = 0; i < files.GetSizeI() && total > target; i++ )
+	{
+		if ( unlink( files[i].Path.ToCStr() ) == 0 )
+		{
+			total -= files[i].Size;
+			removed++;
+		}
+	}
+	pthread_mutex_lock( &Mutex );
+	CacheBytes = total;
+	pthread_mutex_unlock( &Mutex );
+	LOG( "CacheProxy: evicted %i segments, %.1f MB cached", removed, total / ( 1024.0 * 1024.0 ) );
+}
+
+}
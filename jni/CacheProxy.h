@@ -0,0 +1,182 @@
+/************************************************************************************
+
+Filename    :   CacheProxy.h
+Content     :   Loopback HTTP proxy serving streamed videos from an on-disk cache
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_CacheProxy_h )
+#define OVR_CacheProxy_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+#include "AdaptiveBitrate.h"
+#include "HlsPlaylist.h"
+
+namespace OVR {
+
+class HttpConnection;
+
+//==============================================================
+// CacheProxy
+//
+// The player is given http://127.0.0.1:port/key instead of the upstream
+// url, and its range requests are answered from fixed size segment files
+// under the cache directory. Missing segments are fetched upstream with
+// range requests, and the segments after the one being read are fetched
+// ahead on a separate thread. Cached segments go to the socket with
+// sendfile, without passing through user space.
+//
+// Segments are evicted least recently used first once the cache is over
+// its budget.
+//
+// An HLS master playlist is served as a single media playlist instead, and
+// each of its segments is fetched from the variant AbrController picks for
+// it, from the buffer ahead of the play position and the throughput of the
+// segments so far. That needs variants with aligned, self-contained
+// segments of the same durations; anything else is redirected to the
+// original url.
+//
+// The player has to be told where the variant changes, so the playlist is
+// an EVENT playlist that only lists the segments whose variant has been
+// picked, a few ahead of the one playing or requested, with a
+// discontinuity wherever it changes. The player reloads it as it goes, and
+// it ends once every segment is listed.
+class CacheProxy
+{
+public:
+	static const int	SEGMENT_BYTES = 256 * 1024;
+	static const int	READ_AHEAD_SEGMENTS = 8;
+	static const int	MAX_CLIENTS = 4;
+
+						CacheProxy();
+						~CacheProxy();
+
+	bool				Start( const char * cacheDir, const SInt64 maxCacheBytes );
+	void				Stop();
+	bool				IsRunning() const		{ return ListenSocket >= 0; }
+
+	// The loopback url for a plain http:// url, the url itself for anything
+	// else or when the proxy isn't running.
+	String				GetProxyUrl( const char * url );
+
+	// True for an HLS playlist url, which the proxy adapts per segment.
+	static bool			IsPlaylistUrl( const char * url );
+
+	// The player's position, for the buffer level of adaptive streams.
+	void				SetPlayPosition( const double positionSeconds, const bool playing );
+
+	// Segments served from the cache and fetched for the player, and the
+	// average time from a request to its first body byte.
+	void				GetStats( int & outHits, int & outMisses, SInt64 & outBytesServed, double & outFirstByteSeconds ) const;
+	void				LogStats() const;
+
+private:
+	struct Resource
+	{
+		String			Url;
+		String			Key;
+		SInt64			Length;			// -1 until the first response
+		String			ContentType;
+		int				StreamIndex;	// into Streams for an HLS playlist, else -1
+	};
+
+	struct AdaptiveStream
+	{
+		bool					Loading;
+		bool					Loaded;
+		bool					Adaptive;	// false when the playlist has to be redirected
+		Array< HlsPlaylist >	Variants;	// media playlists by ascending bandwidth
+		Array< double >			SegmentStarts;
+		Array< int >			Listed;		// the variant of each segment listed so far
+		int						TargetDuration;
+		AbrController			Abr;
+
+								AdaptiveStream() : Loading( false ), Loaded( false ), Adaptive( false ), TargetDuration( 0 ) {}
+	};
+
+	struct SegmentRef
+	{
+		int				ResourceIndex;
+		int				Index;
+	};
+
+	struct Client
+	{
+		pthread_t		Thread;
+		int				Socket;			// -1 when the slot is free
+		bool			Finished;
+		CacheProxy *	Proxy;
+	};
+
+	String				CacheDir;
+	SInt64				MaxCacheBytes;
+	int					ListenSocket;
+	int					Port;
+
+	pthread_t			AcceptThread;
+	pthread_t			PrefetchThread;
+	mutable pthread_mutex_t	Mutex;
+	pthread_cond_t		Wake;
+	volatile bool		Exiting;
+
+	Array< Resource >	Resources;
+	Array< SegmentRef >	InFlight;
+	Array< SegmentRef >	PrefetchQueue;
+	Client				Clients[MAX_CLIENTS];
+	SInt64				CacheBytes;
+
+	int					Hits;
+	int					Misses;
+	SInt64				BytesServed;
+	int					Requests;
+	double				FirstByteSecondsTotal;
+
+	Array< AdaptiveStream * >	Streams;
+	ThroughputEstimator	Throughput;
+	double				PositionTime;
+	double				PositionSeconds;
+	bool				Playing;
+	int					AdaptiveSegments;
+	double				AdaptiveBitsTotal;
+
+	static void *		AcceptThreadFunction( void * param );
+	static void *		ClientThreadFunction( void * param );
+	static void *		PrefetchThreadFunction( void * param );
+	void				AcceptLoop();
+	void				PrefetchLoop();
+	void				ServeClient( const int socket );
+	bool				ServeRequest( const int socket, const char * request, HttpConnection & upstream, bool & outKeepAlive );
+	void				ReapClients( const bool all );
+	bool				ServeAdaptive( const int socket, const int resourceIndex, const int segment, const bool head,
+							HttpConnection & upstream, const bool keepAlive );
+	bool				LoadStream( const String & url, AdaptiveStream & stream, HttpConnection & upstream ) const;
+	void				PickVariants( AdaptiveStream & stream, const int segment, const double now );
+	String				BuildPlaylist( const AdaptiveStream & stream, const String & key ) const;
+	double				GetPlayPosition( const double timeInSeconds ) const;
+
+	String				GetSegmentPath( const Resource & resource, const int index ) const;
+	bool				LoadLength( Resource & resource ) const;
+	void				SaveLength( const Resource & resource ) const;
+	// Fetches the segment unless it is cached or being fetched already, then waits for it.
+	bool				EnsureSegment( const int resourceIndex, const int index, HttpConnection & upstream, bool & outFetched );
+	bool				FetchSegment( const int resourceIndex, const int index, HttpConnection & upstream );
+	void				QueueReadAhead( const int resourceIndex, const int nextIndex );
+	void				ScanCache();
+	void				Evict();
+};
+
+}
+
+#endif // OVR_CacheProxy_h
@@ -0,0 +1,412 @@
+/************************************************************************************
+
+Filename    :   ChapterIndex.cpp
+Content     :   Chapter start times and titles, read from the container
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "ChapterIndex.h"
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "MediaContainer.h"
+
+namespace OVR {
+
+static const int MAX_CHAPTERS = 1024;
+static const int MAX_TITLE_BYTES = 512;
+// chapter track sample tables are tiny, anything bigger isn't a chapter track
+static const int MAX_TABLE_BYTES = 256 * 1024;
+
+ChapterIndex::ChapterIndex()
+{
+}
+
+void ChapterIndex::Clear()
+{
+	StartsMs.Clear();
+	TitleOffsets.Clear();
+	Titles.Clear();
+}
+
+void ChapterIndex::Swap( ChapterIndex & other )
+{
+	Alg::Swap( StartsMs, other.StartsMs );
+	Alg::Swap( TitleOffsets, other.TitleOffsets );
+	Alg::Swap( Titles, other.Titles );
+}
+
+// Titles are UTF-8, except QuickTime text samples that start with a
+// UTF-16 byte order mark.
+void ChapterIndex::AddChapter( const int startMs, const UByte * title, const int length )
+{
+	if ( StartsMs.GetSizeI() >= MAX_CHAPTERS || startMs < 0 )
+	{
+		return;
+	}
+	StartsMs.PushBack( startMs );
+	TitleOffsets.PushBack( Titles.GetSizeI() );
+
+	const int count = Alg::Min( length, MAX_TITLE_BYTES );
+	if ( count >= 2 && ( ( title[0] == 0xFE && title[1] == 0xFF ) || ( title[0] == 0xFF && title[1] == 0xFE ) ) )
+	{
+		const bool bigEndian = title[0] == 0xFE;
+		for ( int i = 2; i + 1 < count; i += 2 )
+		{
+			const UInt32 c = bigEndian ? ( ( title[i] << 8 ) | title[i + 1] ) : ( ( title[i + 1] << 8 ) | title[i] );
+			if ( c >= 0xD800 && c < 0xE000 )
+			{
+				Titles.PushBack( '?' );		// surrogate pairs aren't worth decoding for a title
+			}
+			else if ( c < 0x80 )
+			{
+				Titles.PushBack( static_cast< char >( c ) );
+			}
+			else if ( c < 0x800 )
+			{
+				Titles.PushBack( static_cast< char >( 0xC0 | ( c >> 6 ) ) );
+				Titles.PushBack( static_cast< char >( 0x80 | ( c & 0x3F ) ) );
+			}
+			else
+			{
+				Titles.PushBack( static_cast< char >( 0xE0 | ( c >> 12 ) ) );
+				Titles.PushBack( static_cast< char >( 0x80 | ( ( c >> 6 ) & 0x3F ) ) );
+				Titles.PushBack( static_cast< char >( 0x80 | ( c & 0x3F ) ) );
+			}
+		}
+	}
+	else
+	{
+		for ( int i = 0; i < count && title[i] != 0; i++ )
+		{
+			Titles.PushBack( static_cast< char >( title[i] ) );
+		}
+	}
+	Titles.PushBack( 0 );
+}
+
+void ChapterIndex::Finish()
+{
+	// chapters are stored in order, which insertion sort handles in one pass
+	for ( int i = 1; i < StartsMs.GetSizeI(); i++ )
+	{
+		for ( int j = i; j > 0 && StartsMs[j] < StartsMs[j - 1]; j-- )
+		{
+			Alg::Swap( StartsMs[j], StartsMs[j - 1] );
+			Alg::Swap( TitleOffsets[j], TitleOffsets[j - 1] );
+		}
+	}
+}
+
+bool ChapterIndex::BuildFromFile( const char * path, const volatile bool * cancel )
+{
+	Clear();
+
+	MediaFile file;
+	if ( !file.Open( path ) )
+	{
+		return false;
+	}
+
+	UByte magic[8];
+	if ( !file.Read( 0, magic, sizeof( magic ) ) )
+	{
+		return false;
+	}
+	bool built = false;
+	if ( ReadBE32( magic ) == MKV_ID_EBML )
+	{
+		built = BuildFromMatroska( file, cancel );
+	}
+	else if ( ReadBE32( magic + 4 ) == MP4_FOURCC( 'f', 't', 'y', 'p' ) )
+	{
+		built = BuildFromMp4( file, cancel );
+	}
+	if ( !built || StartsMs.GetSizeI() == 0 )
+	{
+		Clear();
+		return false;
+	}
+	Finish();
+	LOG( "ChapterIndex: %i chapters", StartsMs.GetSizeI() );
+	return true;
+}
+
+bool ChapterIndex::BuildFromMp4( const MediaFile & file, const volatile bool * cancel )
+{
+	Mp4Box moov;
+	if ( !Mp4FindTopLevel( file, MP4_FOURCC( 'm', 'o', 'o', 'v' ), moov ) )
+	{
+		return false;
+	}
+	// files written by tools that add both carry the same chapters twice
+	return ReadNeroChapters( file, moov ) || ReadQuickTimeChapters( file, moov, cancel );
+}
+
+bool ChapterIndex::ReadNeroChapters( const MediaFile & file, const Mp4Box & moov )
+{
+	Mp4Box udta;
+	Mp4Box chpl;
+	Array< UByte > data;
+	if ( !Mp4FindChild( file, moov, MP4_FOURCC( 'u', 'd', 't', 'a' ), udta ) ||
+		!Mp4FindChild( file, udta, MP4_FOURCC( 'c', 'h', 'p', 'l' ), chpl ) ||
+		chpl.GetDataSize() > MAX_TABLE_BYTES ||
+		!file.ReadArray( chpl.DataOffset, static_cast< int >( chpl.GetDataSize() ), data ) )
+	{
+		return false;
+	}
+
+	// version / flags, 4 more reserved bytes in version 1, chapter count, then
+	// each chapter as a start in 100 ns units and a length prefixed title
+	int offset = ( data.GetSizeI() > 0 && data[0] == 1 ) ? 8 : 4;
+	if ( offset >= data.GetSizeI() )
+	{
+		return false;
+	}
+	const int count = data[offset++];
+	for ( int i = 0; i < count && offset + 9 <= data.GetSizeI(); i++ )
+	{
+		const UInt64 start = ReadBE64( &data[offset] );
+		const int length = Alg::Min( static_cast< int >( data[offset + 8] ), data.GetSizeI() - offset - 9 );
+		AddChapter( static_cast< int >( start / 10000 ), &data[offset + 9], length );
+		offset += 9 + length;
+	}
+	return StartsMs.GetSizeI() > 0;
+}
+
+static bool ReadBoxData( const MediaFile & file, const Mp4Box & parent, const UInt32 type, const int minSize, Array< UByte > & out )
+{
+	Mp4Box box;
+	return Mp4FindChild( file, parent, type, box ) && box.GetDataSize() >= minSize && box.GetDataSize() <= MAX_TABLE_BYTES &&
+		file.ReadArray( box.DataOffset, static_cast< int >( box.GetDataSize() ), out );
+}
+
+static bool ReadTrackId( const MediaFile & file, const Mp4Box & trak, UInt32 & outId )
+{
+	Array< UByte > tkhd;
+	if ( !ReadBoxData( file, trak, MP4_FOURCC( 't', 'k', 'h', 'd' ), 24, tkhd ) )
+	{
+		return false;
+	}
+	// version 1 has 64 bit creation and modification times
+	outId = ( tkhd[0] == 1 ) ? ReadBE32( &tkhd[20] ) : ReadBE32( &tkhd[12] );
+	return true;
+}
+
+bool ChapterIndex::ReadQuickTimeChapters( const MediaFile & file, const Mp4Box & moov, const volatile bool * cancel )
+{
+	// A tref / chap in any track names the text track that holds the chapters.
+	UInt32 chapterTrackId = 0;
+	Mp4Box trak;
+	for ( SInt64 offset = moov.DataOffset; chapterTrackId == 0 && Mp4ReadBox( file, offset, moov.End, trak ); offset = trak.End )
+	{
+		Mp4Box tref;
+		Array< UByte > chap;
+		if ( trak.Type == MP4_FOURCC( 't', 'r', 'a', 'k' ) &&
+			Mp4FindChild( file, trak, MP4_FOURCC( 't', 'r', 'e', 'f' ), tref ) &&
+			ReadBoxData( file, tref, MP4_FOURCC( 'c', 'h', 'a', 'p' ), 4, chap ) )
+		{
+			chapterTrackId = ReadBE32( &chap[0] );
+		}
+	}
+	if ( chapterTrackId == 0 )
+	{
+		return false;
+	}
+
+	bool found = false;
+	for ( SInt64 offset = moov.DataOffset; !found && Mp4ReadBox( file, offset, moov.End, trak ); offset = trak.End )
+	{
+		UInt32 id;
+		found = trak.Type == MP4_FOURCC( 't', 'r', 'a', 'k' ) && ReadTrackId( file, trak, id ) && id == chapterTrackId;
+	}
+	UInt32 timescale;
+	Mp4Box mdia;
+	Mp4Box minf;
+	Mp4Box stbl;
+	if ( !found || !Mp4ReadTrackTimescale( file, trak, timescale ) ||
+		!Mp4FindChild( file, trak, MP4_FOURCC( 'm', 'd', 'i', 'a' ), mdia ) ||
+		!Mp4FindChild( file, mdia, MP4_FOURCC( 'm', 'i', 'n', 'f' ), minf ) ||
+		!Mp4FindChild( file, minf, MP4_FOURCC( 's', 't', 'b', 'l' ), stbl ) )
+	{
+		return false;
+	}
+
+	Array< UByte > stts;
+	Array< UByte > stsz;
+	Array< UByte > stsc;
+	Array< UByte > chunks;
+	bool largeOffsets = false;
+	if ( !ReadBoxData( file, stbl, MP4_FOURCC( 's', 't', 't', 's' ), 8, stts ) ||
+		!ReadBoxData( file, stbl, MP4_FOURCC( 's', 't', 's', 'z' ), 12, stsz ) ||
+		!ReadBoxData( file, stbl, MP4_FOURCC( 's', 't', 's', 'c' ), 8, stsc ) )
+	{
+		return false;
+	}
+	if ( !ReadBoxData( file, stbl, MP4_FOURCC( 's', 't', 'c', 'o' ), 8, chunks ) )
+	{
+		if ( !ReadBoxData( file, stbl, MP4_FOURCC( 'c', 'o', '6', '4' ), 8, chunks ) )
+		{
+			return false;
+		}
+		largeOffsets = true;
+	}
+
+	// all full boxes: version / flags, then the entry count
+	const UInt32 fixedSize = ReadBE32( &stsz[4] );
+	const int sampleCount = Alg::Min( static_cast< int >( ReadBE32( &stsz[8] ) ), MAX_CHAPTERS );
+	if ( fixedSize == 0 && stsz.GetSizeI() < 12 + sampleCount * 4 )
+	{
+		return false;
+	}
+	const int sttsCount = Alg::Min( static_cast< int >( ReadBE32( &stts[4] ) ), ( stts.GetSizeI() - 8 ) / 8 );
+	const int stscCount = Alg::Min( static_cast< int >( ReadBE32( &stsc[4] ) ), ( stsc.GetSizeI() - 8 ) / 12 );
+	const int chunkEntrySize = largeOffsets ? 8 : 4;
+	const int chunkCount = Alg::Min( static_cast< int >( ReadBE32( &chunks[4] ) ), ( chunks.GetSizeI() - 8 ) / chunkEntrySize );
+
+	int sample = 0;
+	int sttsEntry = 0;
+	int sttsUsed = 0;
+	UInt64 time = 0;
+	for ( int entry = 0; entry < stscCount && sample < sampleCount; entry++ )
+	{
+		const int firstChunk = static_cast< int >( ReadBE32( &stsc[8 + entry * 12] ) );
+		const int samplesPerChunk = static_cast< int >( ReadBE32( &stsc[8 + entry * 12 + 4] ) );
+		const int lastChunk = ( entry + 1 < stscCount ) ? static_cast< int >( ReadBE32( &stsc[8 + ( entry + 1 ) * 12] ) ) - 1 : chunkCount;
+		for ( int chunk = firstChunk; chunk <= Alg::Min( lastChunk, chunkCount ) && chunk >= 1 && sample < sampleCount; chunk++ )
+		{
+			const UByte * entryData = &chunks[8 + ( chunk - 1 ) * chunkEntrySize];
+			SInt64 sampleOffset = static_cast< SInt64 >( largeOffsets ? ReadBE64( entryData ) : ReadBE32( entryData ) );
+			for ( int s = 0; s < samplesPerChunk && sample < sampleCount; s++, sample++ )
+			{
+				if ( cancel != NULL && *cancel )
+				{
+					return false;
+				}
+				const int size = static_cast< int >( ( fixedSize != 0 ) ? fixedSize : ReadBE32( &stsz[12 + sample * 4] ) );
+
+				// text samples are a 16 bit length followed by the text, then optional style boxes
+				UByte text[2 + MAX_TITLE_BYTES];
+				const int readSize = Alg::Min( size, static_cast< int >( sizeof( text ) ) );
+				if ( readSize >= 2 && file.Read( sampleOffset, text, readSize ) )
+				{
+					const int length = Alg::Min( static_cast< int >( ReadBE16( text ) ), readSize - 2 );
+					AddChapter( static_cast< int >( time * 1000 / timescale ), text + 2, length );
+				}
+				sampleOffset += size;
+
+				// advance the decode time by this sample's duration
+				if ( sttsEntry < sttsCount )
+				{
+					time += ReadBE32( &stts[8 + sttsEntry * 8 + 4] );
+					if ( ++sttsUsed >= static_cast< int >( ReadBE32( &stts[8 + sttsEntry * 8] ) ) )
+					{
+						sttsEntry++;
+						sttsUsed = 0;
+					}
+				}
+			}
+		}
+	}
+	return StartsMs.GetSizeI() > 0;
+}
+
+bool ChapterIndex::BuildFromMatroska( const MediaFile & file, const volatile bool * cancel )
+{
+	const SInt64 fileSize = file.GetSize();
+	EbmlElement header;
+	EbmlElement segment;
+	if ( !EbmlReadElement( file, 0, fileSize, header ) || header.Size == EBML_UNKNOWN_SIZE ||
+		!EbmlReadElement( file, header.DataOffset + header.Size, fileSize, segment ) ||
+		segment.Id != MKV_ID_SEGMENT )
+	{
+		return false;
+	}
+
+	// Chapters normally come before the clusters, which are skipped by size if not.
+	const SInt64 segmentEnd = segment.GetEnd( fileSize );
+	EbmlElement chapters;
+	bool haveChapters = false;
+	EbmlElement element;
+	for ( SInt64 offset = segment.DataOffset; !haveChapters && EbmlReadElement( file, offset, segmentEnd, element ); offset = element.DataOffset + element.Size )
+	{
+		if ( ( cancel != NULL && *cancel ) || element.Size == EBML_UNKNOWN_SIZE )
+		{
+			return false;
+		}
+		if ( element.Id == MKV_ID_CHAPTERS )
+		{
+			chapters = element;
+			haveChapters = true;
+		}
+	}
+
+	// only the first edition, others are alternate cuts of the same video
+	EbmlElement edition;
+	if ( !haveChapters || !EbmlFindChild( file, chapters, fileSize, MKV_ID_EDITION_ENTRY, edition ) || edition.Size == EBML_UNKNOWN_SIZE )
+	{
+		return false;
+	}
+	EbmlElement atom;
+	for ( SInt64 offset = edition.DataOffset; EbmlReadElement( file, offset, edition.DataOffset + edition.Size, atom ); offset = atom.DataOffset + atom.Size )
+	{
+		if ( atom.Size == EBML_UNKNOWN_SIZE )
+		{
+			break;
+		}
+		EbmlElement start;
+		EbmlElement flag;
+		if ( atom.Id != MKV_ID_CHAPTER_ATOM || !EbmlFindChild( file, atom, fileSize, MKV_ID_CHAPTER_TIME_START, start ) ||
+			( EbmlFindChild( file, atom, fileSize, MKV_ID_CHAPTER_FLAG_HIDDEN, flag ) && EbmlReadUInt( file, flag ) != 0 ) ||
+			( EbmlFindChild( file, atom, fileSize, MKV_ID_CHAPTER_FLAG_ENABLED, flag ) && EbmlReadUInt( file, flag, 1 ) == 0 ) )
+		{
+			continue;
+		}
+		// times are in nanoseconds regardless of the timecode scale
+		const int startMs = static_cast< int >( EbmlReadUInt( file, start ) / 1000000 );
+		EbmlElement display;
+		EbmlElement chapString;
+		Array< UByte > title;
+		if ( EbmlFindChild( file, atom, fileSize, MKV_ID_CHAPTER_DISPLAY, display ) &&
+			EbmlFindChild( file, display, fileSize, MKV_ID_CHAP_STRING, chapString ) &&
+			EbmlReadString( file, chapString, title ) )
+		{
+			AddChapter( startMs, title.GetDataPtr(), title.GetSizeI() );
+		}
+		else
+		{
+			AddChapter( startMs, NULL, 0 );
+		}
+	}
+	return StartsMs.GetSizeI() > 0;
+}
+
+int ChapterIndex::FindChapter( const int positionMs ) const
+{
+	// last chapter starting at or before the position
+	int lo = 0;
+	int hi = StartsMs.GetSizeI();
+	while ( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if ( StartsMs[mid] <= positionMs )
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo - 1;
+}
+
+}
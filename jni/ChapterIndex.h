@@ -0,0 +1,69 @@
+/************************************************************************************
+
+Filename    :   ChapterIndex.h
+Content     :   Chapter start times and titles, read from the container
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_ChapterIndex_h )
+#define OVR_ChapterIndex_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+
+namespace OVR {
+
+class MediaFile;
+struct Mp4Box;
+
+//==============================================================
+// ChapterIndex
+//
+// Nero chpl boxes and QuickTime chapter text tracks in MP4, Chapters in
+// Matroska. Titles are packed into one buffer so a datum only carries
+// three arrays, however many chapters there are.
+class ChapterIndex
+{
+public:
+					ChapterIndex();
+
+	// Returns false if the file has no chapters.
+	bool			BuildFromFile( const char * path, const volatile bool * cancel = NULL );
+	void			Clear();
+
+	bool			IsEmpty() const					{ return StartsMs.GetSizeI() == 0; }
+	int				GetCount() const				{ return StartsMs.GetSizeI(); }
+	int				GetStartMs( const int i ) const	{ return StartsMs[i]; }
+	// UTF-8, may be empty.
+	const char *	GetTitle( const int i ) const	{ return &Titles[TitleOffsets[i]]; }
+
+	// Chapter playing at positionMs, -1 before the first one starts.
+	int				FindChapter( const int positionMs ) const;
+
+	void			Swap( ChapterIndex & other );
+
+private:
+	Array< int >	StartsMs;		// ascending
+	Array< int >	TitleOffsets;
+	Array< char >	Titles;			// nul terminated titles back to back
+
+	void			AddChapter( const int startMs, const UByte * title, const int length );
+	void			Finish();
+
+	bool			BuildFromMp4( const MediaFile & file, const volatile bool * cancel );
+	bool			ReadNeroChapters( const MediaFile & file, const Mp4Box & moov );
+	bool			ReadQuickTimeChapters( const MediaFile & file, const Mp4Box & moov, const volatile bool * cancel );
+	bool			BuildFromMatroska( const MediaFile & file, const volatile bool * cancel );
+};
+
+}
+
+#endif // OVR_ChapterIndex_h
@@ -0,0 +1,1358 @@
+/************************************************************************************
+
+Filename    :   CommonEncryption.cpp
+Content     :   ISO/IEC 23001-7 Common Encryption, 'cenc' and 'cbcs' sample decryption
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "CommonEncryption.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Kernel/OVR_JSON.h"
+#include "Android/LogUtils.h"
+#include "HttpClient.h"
+#include "MediaContainer.h"
+
+#if defined( __arm__ ) || defined( __aarch64__ )
+#define OVR_AES_ARMV8
+#include <sys/auxv.h>
+#include "CommonEncryptionArmCe.h"
+#elif ( defined( __x86_64__ ) || defined( __i386__ ) ) && defined( __GNUC__ )
+#define OVR_AES_NI
+#include <cpuid.h>
+#include <wmmintrin.h>
+#endif
+
+namespace OVR {
+
+static const int	MAX_LICENSE_BYTES = 64 * 1024;
+static const int	MAX_MOOV_BYTES = 16 * 1024 * 1024;
+static const int	MAX_FRAGMENT_BYTES = 64 * 1024 * 1024;
+
+//==============================================================
+// AES tables, built once
+
+static UByte	Sbox[256];
+static UByte	InverseSbox[256];
+static UInt32	Te[4][256];			// SubBytes and MixColumns, one table per byte rotation
+static UInt32	Td[4][256];			// InvSubBytes and InvMixColumns
+
+typedef void ( *CtrBlocksFunc )( const UByte * keys, UByte * data, const int numBlocks, UByte counter[16] );
+typedef void ( *CbcBlocksFunc )( const UByte * inverseKeys, UByte * data, const int numBlocks, UByte iv[16] );
+
+static CtrBlocksFunc	CtrBlocks;
+static CbcBlocksFunc	CbcBlocks;
+static const char *		Implementation;
+static pthread_once_t	AesOnce = PTHREAD_ONCE_INIT;
+
+static inline UByte Xtime( const UByte x )
+{
+	return ( UByte )( ( x << 1 ) ^ ( ( x & 0x80 ) ? 0x1B : 0x00 ) );
+}
+
+static UByte GfMultiply( UByte a, UByte b )
+{
+	UByte product = 0;
+	while ( b != 0 )
+	{
+		if ( b & 1 )
+		{
+			product ^= a;
+		}
+		a = Xtime( a );
+		b >>= 1;
+	}
+	return product;
+}
+
+static inline UInt32 RotateRight( const UInt32 x, const int bits )
+{
+	return ( bits == 0 ) ? x : ( x >> bits ) | ( x << ( 32 - bits ) );
+}
+
+static inline UByte RotateLeft8( const UByte x, const int bits )
+{
+	return ( UByte )( ( x << bits ) | ( x >> ( 8 - bits ) ) );
+}
+
+static void IncrementCounter( UByte counter[16], const int blocks )
+{
+	WriteBE64( counter + 8, ReadBE64( counter + 8 ) + blocks );
+}
+
+static void BuildTables()
+{
+	// walk the multiplicative group with generator 3 and its inverse together
+	UByte p = 1;
+	UByte q = 1;
+	do
+	{
+		p = p ^ Xtime( p );
+		q ^= q << 1;
+		q ^= q << 2;
+		q ^= q << 4;
+		q ^= ( q & 0x80 ) ? 0x09 : 0x00;
+		const UByte affine = q ^ RotateLeft8( q, 1 ) ^ RotateLeft8( q, 2 ) ^ RotateLeft8( q, 3 ) ^ RotateLeft8( q, 4 );
+		Sbox[p] = affine ^ 0x63;
+	} while ( p != 1 );
+	Sbox[0] = 0x63;
+
+	for ( int i = 0; i < 256; i++ )
+	{
+		InverseSbox[Sbox[i]] = ( UByte )i;
+	}
+
+	for ( int i = 0; i < 256; i++ )
+	{
+		const UByte s = Sbox[i];
+		const UInt32 te = ( ( UInt32 )GfMultiply( s, 2 ) << 24 ) | ( ( UInt32 )s << 16 ) | ( ( UInt32 )s << 8 ) | GfMultiply( s, 3 );
+		const UByte si = InverseSbox[i];
+		const UInt32 td = ( ( UInt32 )GfMultiply( si, 14 ) << 24 ) | ( ( UInt32 )GfMultiply( si, 9 ) << 16 ) |
+			( ( UInt32 )GfMultiply( si, 13 ) << 8 ) | GfMultiply( si, 11 );
+		for ( int r = 0; r < 4; r++ )
+		{
+			Te[r][i] = RotateRight( te, r * 8 );
+			Td[r][i] = RotateRight( td, r * 8 );
+		}
+	}
+}
+
+//==============================================================
+// Table implementation
+
+static void EncryptBlockTables( const UByte * keys, const UByte in[16], UByte out[16] )
+{
+	UInt32 s0 = ReadBE32( in + 0 ) ^ ReadBE32( keys + 0 );
+	UInt32 s1 = ReadBE32( in + 4 ) ^ ReadBE32( keys + 4 );
+	UInt32 s2 = ReadBE32( in + 8 ) ^ ReadBE32( keys + 8 );
+	UInt32 s3 = ReadBE32( in + 12 ) ^ ReadBE32( keys + 12 );
+	for ( int round = 1; round < 10; round++ )
+	{
+		const UByte * k = keys + round * 16;
+		const UInt32 t0 = Te[0][s0 >> 24] ^ Te[1][( s1 >> 16 ) & 0xFF] ^ Te[2][( s2 >> 8 ) & 0xFF] ^ Te[3][s3 & 0xFF] ^ ReadBE32( k + 0 );
+		const UInt32 t1 = Te[0][s1 >> 24] ^ Te[1][( s2 >> 16 ) & 0xFF] ^ Te[2][( s3 >> 8 ) & 0xFF] ^ Te[3][s0 & 0xFF] ^ ReadBE32( k + 4 );
+		const UInt32 t2 = Te[0][s2 >> 24] ^ Te[1][( s3 >> 16 ) & 0xFF] ^ Te[2][( s0 >> 8 ) & 0xFF] ^ Te[3][s1 & 0xFF] ^ ReadBE32( k + 8 );
+		const UInt32 t3 = Te[0][s3 >> 24] ^ Te[1][( s0 >> 16 ) & 0xFF] ^ Te[2][( s1 >> 8 ) & 0xFF] ^ Te[3][s2 & 0xFF] ^ ReadBE32( k + 12 );
+		s0 = t0;
+		s1 = t1;
+		s2 = t2;
+		s3 = t3;
+	}
+	const UByte * k = keys + 160;
+	WriteBE32( out + 0, ( ( UInt32 )Sbox[s0 >> 24] << 24 | ( UInt32 )Sbox[( s1 >> 16 ) & 0xFF] << 16 | ( UInt32 )Sbox[( s2 >> 8 ) & 0xFF] << 8 | Sbox[s3 & 0xFF] ) ^ ReadBE32( k + 0 ) );
+	WriteBE32( out + 4, ( ( UInt32 )Sbox[s1 >> 24] << 24 | ( UInt32 )Sbox[( s2 >> 16 ) & 0xFF] << 16 | ( UInt32 )Sbox[( s3 >> 8 ) & 0xFF] << 8 | Sbox[s0 & 0xFF] ) ^ ReadBE32( k + 4 ) );
+	WriteBE32( out + 8, ( ( UInt32 )Sbox[s2 >> 24] << 24 | ( UInt32 )Sbox[( s3 >> 16 ) & 0xFF] << 16 | ( UInt32 )Sbox[( s0 >> 8 ) & 0xFF] << 8 | Sbox[s1 & 0xFF] ) ^ ReadBE32( k + 8 ) );
+	WriteBE32( out + 12, ( ( UInt32 )Sbox[s3 >> 24] << 24 | ( UInt32 )Sbox[( s0 >> 16 ) & 0xFF] << 16 | ( UInt32 )Sbox[( s1 >> 8 ) & 0xFF] << 8 | Sbox[s2 & 0xFF] ) ^ ReadBE32( k + 12 ) );
+}
+
+static void DecryptBlockTables( const UByte * keys, const UByte in[16], UByte out[16] )
+{
+	UInt32 s0 = ReadBE32( in + 0 ) ^ ReadBE32( keys + 0 );
+	UInt32 s1 = ReadBE32( in + 4 ) ^ ReadBE32( keys + 4 );
+	UInt32 s2 = ReadBE32( in + 8 ) ^ ReadBE32( keys + 8 );
+	UInt32 s3 = ReadBE32( in + 12 ) ^ ReadBE32( keys + 12 );
+	for ( int round = 1; round < 10; round++ )
+	{
+		const UByte * k = keys + round * 16;
+		const UInt32 t0 = Td[0][s0 >> 24] ^ Td[1][( s3 >> 16 ) & 0xFF] ^ Td[2][( s2 >> 8 ) & 0xFF] ^ Td[3][s1 & 0xFF] ^ ReadBE32( k + 0 );
+		const UInt32 t1 = Td[0][s1 >> 24] ^ Td[1][( s0 >> 16 ) & 0xFF] ^ Td[2][( s3 >> 8 ) & 0xFF] ^ Td[3][s2 & 0xFF] ^ ReadBE32( k + 4 );
+		const UInt32 t2 = Td[0][s2 >> 24] ^ Td[1][( s1 >> 16 ) & 0xFF] ^ Td[2][( s0 >> 8 ) & 0xFF] ^ Td[3][s3 & 0xFF] ^ ReadBE32( k + 8 );
+		const UInt32 t3 = Td[0][s3 >> 24] ^ Td[1][( s2 >> 16 ) & 0xFF] ^ Td[2][( s1 >> 8 ) & 0xFF] ^ Td[3][s0 & 0xFF] ^ ReadBE32( k + 12 );
+		s0 = t0;
+		s1 = t1;
+		s2 = t2;
+		s3 = t3;
+	}
+	const UByte * k = keys + 160;
+	WriteBE32( out + 0, ( ( UInt32 )InverseSbox[s0 >> 24] << 24 | ( UInt32 )InverseSbox[( s3 >> 16 ) & 0xFF] << 16 | ( UInt32 )InverseSbox[( s2 >> 8 ) & 0xFF] << 8 | InverseSbox[s1 & 0xFF] ) ^ ReadBE32( k + 0 ) );
+	WriteBE32( out + 4, ( ( UInt32 )InverseSbox[s1 >> 24] << 24 | ( UInt32 )InverseSbox[( s0 >> 16 ) & 0xFF] << 16 | ( UInt32 )InverseSbox[( s3 >> 8 ) & 0xFF] << 8 | InverseSbox[s2 & 0xFF] ) ^ ReadBE32( k + 4 ) );
+	WriteBE32( out + 8, ( ( UInt32 )InverseSbox[s2 >> 24] << 24 | ( UInt32 )InverseSbox[( s1 >> 16 ) & 0xFF] << 16 | ( UInt32 )InverseSbox[( s0 >> 8 ) & 0xFF] << 8 | InverseSbox[s3 & 0xFF] ) ^ ReadBE32( k + 8 ) );
+	WriteBE32( out + 12, ( ( UInt32 )InverseSbox[s3 >> 24] << 24 | ( UInt32 )InverseSbox[( s2 >> 16 ) & 0xFF] << 16 | ( UInt32 )InverseSbox[( s1 >> 8 ) & 0xFF] << 8 | InverseSbox[s0 & 0xFF] ) ^ ReadBE32( k + 12 ) );
+}
+
+static void CtrBlocksTables( const UByte * keys, UByte * data, const int numBlocks, UByte counter[16] )
+{
+	UByte stream[16];
+	for ( int i = 0; i < numBlocks; i++, data += 16 )
+	{
+		EncryptBlockTables( keys, counter, stream );
+		for ( int j = 0; j < 16; j++ )
+		{
+			data[j] ^= stream[j];
+		}
+		IncrementCounter( counter, 1 );
+	}
+}
+
+static void CbcBlocksTables( const UByte * inverseKeys, UByte * data, const int numBlocks, UByte iv[16] )
+{
+	UByte cipher[16];
+	UByte plain[16];
+	for ( int i = 0; i < numBlocks; i++, data += 16 )
+	{
+		memcpy( cipher, data, 16 );
+		DecryptBlockTables( inverseKeys, cipher, plain );
+		for ( int j = 0; j < 16; j++ )
+		{
+			data[j] = plain[j] ^ iv[j];
+		}
+		memcpy( iv, cipher, 16 );
+	}
+}
+
+//==============================================================
+// ARMv8 Crypto Extensions
+//
+// The blocks are in CommonEncryptionArmCe.cpp, the only file built for the
+// instructions, and are only called after the auxiliary vector reports them.
+#if defined( OVR_AES_ARMV8 )
+
+#if !defined( AT_HWCAP2 )
+#define AT_HWCAP2 26
+#endif
+
+static bool HasAesInstructions()
+{
+#if defined( __aarch64__ )
+	return ( getauxval( AT_HWCAP ) & ( 1 << 3 ) ) != 0;		// HWCAP_AES
+#else
+	return ( getauxval( AT_HWCAP2 ) & ( 1 << 0 ) ) != 0;		// HWCAP2_AES
+#endif
+}
+
+#endif // OVR_AES_ARMV8
+
+//==============================================================
+// AES-NI
+//
+// Compiled for the instructions with a target attribute and only called
+// after cpuid reports them, so the rest of the build needs no -maes.
+#if defined( OVR_AES_NI )
+
+static bool HasAesInstructions()
+{
+	unsigned int a, b, c, d;
+	return __get_cpuid( 1, &a, &b, &c, &d ) && ( c & ( 1 << 25 ) ) != 0 && ( d & ( 1 << 26 ) ) != 0;	// AES, SSE2
+}
+
+__attribute__(( target( "aes,sse2" ) ))
+static inline __m128i CounterSse( const UInt64 high, const UInt64 low )
+{
+	return _mm_set_epi64x( ( long long )__builtin_bswap64( low ), ( long long )high );
+}
+
+__attribute__(( target( "aes,sse2" ) ))
+static void CtrBlocksAesNi( const UByte * keys, UByte * data, const int numBlocks, UByte counter[16] )
+{
+	__m128i k[11];
+	for ( int i = 0; i < 11; i++ )
+	{
+		k[i] = _mm_loadu_si128( reinterpret_cast< const __m128i * >( keys + i * 16 ) );
+	}
+	UInt64 high;
+	memcpy( &high, counter, 8 );
+	UInt64 low = ReadBE64( counter + 8 );
+	int i = 0;
+	for ( ; i + 4 <= numBlocks; i += 4, low += 4, data += 64 )
+	{
+		__m128i b0 = _mm_xor_si128( CounterSse( high, low + 0 ), k[0] );
+		__m128i b1 = _mm_xor_si128( CounterSse( high, low + 1 ), k[0] );
+		__m128i b2 = _mm_xor_si128( CounterSse( high, low + 2 ), k[0] );
+		__m128i b3 = _mm_xor_si128( CounterSse( high, low + 3 ), k[0] );
+		for ( int round = 1; round < 10; round++ )
+		{
+			b0 = _mm_aesenc_si128( b0, k[round] );
+			b1 = _mm_aesenc_si128( b1, k[round] );
+			b2 = _mm_aesenc_si128( b2, k[round] );
+			b3 = _mm_aesenc_si128( b3, k[round] );
+		}
+		__m128i * out = reinterpret_cast< __m128i * >( data );
+		_mm_storeu_si128( out + 0, _mm_xor_si128( _mm_loadu_si128( out + 0 ), _mm_aesenclast_si128( b0, k[10] ) ) );
+		_mm_storeu_si128( out + 1, _mm_xor_si128( _mm_loadu_si128( out + 1 ), _mm_aesenclast_si128( b1, k[10] ) ) );
+		_mm_storeu_si128( out + 2, _mm_xor_si128( _mm_loadu_si128( out + 2 ), _mm_aesenclast_si128( b2, k[10] ) ) );
+		_mm_storeu_si128( out + 3, _mm_xor_si128( _mm_loadu_si128( out + 3 ), _mm_aesenclast_si128( b3, k[10] ) ) );
+	}
+	for ( ; i < numBlocks; i++, low++, data += 16 )
+	{
+		__m128i b = _mm_xor_si128( CounterSse( high, low ), k[0] );
+		for ( int round = 1; round < 10; round++ )
+		{
+			b = _mm_aesenc_si128( b, k[round] );
+		}
+		__m128i * out = reinterpret_cast< __m128i * >( data );
+		_mm_storeu_si128( out, _mm_xor_si128( _mm_loadu_si128( out ), _mm_aesenclast_si128( b, k[10] ) ) );
+	}
+	WriteBE64( counter + 8, low );
+}
+
+__attribute__(( target( "aes,sse2" ) ))
+static void CbcBlocksAesNi( const UByte * inverseKeys, UByte * data, const int numBlocks, UByte iv[16] )
+{
+	__m128i k[11];
+	for ( int i = 0; i < 11; i++ )
+	{
+		k[i] = _mm_loadu_si128( reinterpret_cast< const __m128i * >( inverseKeys + i * 16 ) );
+	}
+	__m128i previous = _mm_loadu_si128( reinterpret_cast< const __m128i * >( iv ) );
+	int i = 0;
+	for ( ; i + 4 <= numBlocks; i += 4, data += 64 )
+	{
+		__m128i * block = reinterpret_cast< __m128i * >( data );
+		const __m128i c0 = _mm_loadu_si128( block + 0 );
+		const __m128i c1 = _mm_loadu_si128( block + 1 );
+		const __m128i c2 = _mm_loadu_si128( block + 2 );
+		const __m128i c3 = _mm_loadu_si128( block + 3 );
+		__m128i b0 = _mm_xor_si128( c0, k[0] );
+		__m128i b1 = _mm_xor_si128( c1, k[0] );
+		__m128i b2 = _mm_xor_si128( c2, k[0] );
+		__m128i b3 = _mm_xor_si128( c3, k[0] );
+		for ( int round = 1; round < 10; round++ )
+		{
+			b0 = _mm_aesdec_si128( b0, k[round] );
+			b1 = _mm_aesdec_si128( b1, k[round] );
+			b2 = _mm_aesdec_si128( b2, k[round] );
+			b3 = _mm_aesdec_si128( b3, k[round] );
+		}
+		_mm_storeu_si128( block + 0, _mm_xor_si128( _mm_aesdeclast_si128( b0, k[10] ), previous ) );
+		_mm_storeu_si128( block + 1, _mm_xor_si128( _mm_aesdeclast_si128( b1, k[10] ), c0 ) );
+		_mm_storeu_si128( block + 2, _mm_xor_si128( _mm_aesdeclast_si128( b2, k[10] ), c1 ) );
+		_mm_storeu_si128( block + 3, _mm_xor_si128( _mm_aesdeclast_si128( b3, k[10] ), c2 ) );
+		previous = c3;
+	}
+	for ( ; i < numBlocks; i++, data += 16 )
+	{
+		__m128i * block = reinterpret_cast< __m128i * >( data );
+		const __m128i c = _mm_loadu_si128( block );
+		__m128i b = _mm_xor_si128( c, k[0] );
+		for ( int round = 1; round < 10; round++ )
+		{
+			b = _mm_aesdec_si128( b, k[round] );
+		}
+		_mm_storeu_si128( block, _mm_xor_si128( _mm_aesdeclast_si128( b, k[10] ), previous ) );
+		previous = c;
+	}
+	_mm_storeu_si128( reinterpret_cast< __m128i * >( iv ), previous );
+}
+
+#endif // OVR_AES_NI
+
+// The instructions when the CPU has them, unless tables are asked for.
+static void SelectAes( const bool tables )
+{
+	CtrBlocks = CtrBlocksTables;
+	CbcBlocks = CbcBlocksTables;
+	Implementation = "tables";
+#if defined( OVR_AES_ARMV8 )
+	if ( !tables && HasAesInstructions() )
+	{
+		CtrBlocks = AesCtrBlocksArmCe;
+		CbcBlocks = AesCbcBlocksArmCe;
+		Implementation = "armv8-ce";
+	}
+#elif defined( OVR_AES_NI )
+	if ( !tables && HasAesInstructions() )
+	{
+		CtrBlocks = CtrBlocksAesNi;
+		CbcBlocks = CbcBlocksAesNi;
+		Implementation = "aes-ni";
+	}
+#endif
+}
+
+static void InitAes()
+{
+	BuildTables();
+	SelectAes( false );
+	LOG( "Aes128: using %s", Implementation );
+}
+
+//==============================================================
+// Aes128
+
+Aes128::Aes128()
+{
+	memset( RoundKeys, 0, sizeof( RoundKeys ) );
+	memset( InverseRoundKeys, 0, sizeof( InverseRoundKeys ) );
+}
+
+void Aes128::SetKey( const UByte key[16] )
+{
+	pthread_once( &AesOnce, InitAes );
+
+	UInt32 w[44];
+	for ( int i = 0; i < 4; i++ )
+	{
+		w[i] = ReadBE32( key + i * 4 );
+	}
+	UByte rcon = 1;
+	for ( int i = 4; i < 44; i++ )
+	{
+		UInt32 t = w[i - 1];
+		if ( ( i & 3 ) == 0 )
+		{
+			t = ( ( UInt32 )Sbox[( t >> 16 ) & 0xFF] << 24 ) | ( ( UInt32 )Sbox[( t >> 8 ) & 0xFF] << 16 ) |
+				( ( UInt32 )Sbox[t & 0xFF] << 8 ) | Sbox[t >> 24];
+			t ^= ( UInt32 )rcon << 24;
+			rcon = Xtime( rcon );
+		}
+		w[i] = w[i - 4] ^ t;
+	}
+	for ( int i = 0; i < 44; i++ )
+	{
+		WriteBE32( RoundKeys + i * 4, w[i] );
+	}
+
+	// the equivalent inverse cipher runs the rounds backwards with
+	// InvMixColumns applied to the inner round keys
+	for ( int round = 0; round <= 10; round++ )
+	{
+		for ( int j = 0; j < 4; j++ )
+		{
+			UInt32 t = w[( 10 - round ) * 4 + j];
+			if ( round > 0 && round < 10 )
+			{
+				t = Td[0][Sbox[t >> 24]] ^ Td[1][Sbox[( t >> 16 ) & 0xFF]] ^ Td[2][Sbox[( t >> 8 ) & 0xFF]] ^ Td[3][Sbox[t & 0xFF]];
+			}
+			WriteBE32( InverseRoundKeys + round * 16 + j * 4, t );
+		}
+	}
+}
+
+void Aes128::Ctr( UByte * data, const int length, UByte counter[16], int & blockOffset ) const
+{
+	int done = 0;
+	if ( blockOffset > 0 && length > 0 )
+	{
+		// finish the block the previous range stopped in
+		UByte stream[16];
+		UByte blockCounter[16];
+		memset( stream, 0, sizeof( stream ) );
+		memcpy( blockCounter, counter, 16 );
+		CtrBlocks( RoundKeys, stream, 1, blockCounter );
+		const int count = Alg::Min( 16 - blockOffset, length );
+		for ( int i = 0; i < count; i++ )
+		{
+			data[i] ^= stream[blockOffset + i];
+		}
+		done = count;
+		blockOffset += count;
+		if ( blockOffset == 16 )
+		{
+			IncrementCounter( counter, 1 );
+			blockOffset = 0;
+		}
+	}
+
+	const int blocks = ( length - done ) / 16;
+	if ( blocks > 0 )
+	{
+		CtrBlocks( RoundKeys, data + done, blocks, counter );
+		done += blocks * 16;
+	}
+
+	if ( done < length )
+	{
+		UByte stream[16];
+		UByte blockCounter[16];
+		memset( stream, 0, sizeof( stream ) );
+		memcpy( blockCounter, counter, 16 );
+		CtrBlocks( RoundKeys, stream, 1, blockCounter );
+		blockOffset = length - done;
+		for ( int i = 0; i < blockOffset; i++ )
+		{
+			data[done + i] ^= stream[i];
+		}
+	}
+}
+
+void Aes128::DecryptCbc( UByte * data, const int numBlocks, UByte iv[16] ) const
+{
+	if ( numBlocks > 0 )
+	{
+		CbcBlocks( InverseRoundKeys, data, numBlocks, iv );
+	}
+}
+
+const char * Aes128::GetImplementation()
+{
+	pthread_once( &AesOnce, InitAes );
+	return Implementation;
+}
+
+bool Aes128::SetImplementation( const char * name )
+{
+	pthread_once( &AesOnce, InitAes );
+	SelectAes( strcmp( name, "tables" ) == 0 );
+	return strcmp( Implementation, name ) == 0;
+}
+
+//==============================================================
+// Keys
+
+static int HexValue( const char c )
+{
+	if ( c >= '0' && c <= '9' ) return c - '0';
+	if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+	if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+	return -1;
+}
+
+bool CencParseKid( const char * text, UByte outKid[16] )
+{
+	int count = 0;
+	for ( const char * p = text; *p != '\0'; p++ )
+	{
+		if ( *p == '-' )
+		{
+			continue;
+		}
+		const int high = HexValue( p[0] );
+		const int low = ( high >= 0 ) ? HexValue( p[1] ) : -1;
+		if ( low < 0 || count == 16 )
+		{
+			return false;
+		}
+		outKid[count++] = ( UByte )( ( high << 4 ) | low );
+		p++;
+	}
+	return count == 16;
+}
+
+static const char * BASE64URL = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Unpadded, as ClearKey wants.
+static String Base64UrlEncode( const UByte * data, const int length )
+{
+	String out;
+	for ( int i = 0; i < length; i += 3 )
+	{
+		const int count = Alg::Min( 3, length - i );
+		const UInt32 bits = ( ( UInt32 )data[i] << 16 ) | ( count > 1 ? ( UInt32 )data[i + 1] << 8 : 0 ) | ( count > 2 ? data[i + 2] : 0 );
+		char chars[5] = { BASE64URL[( bits >> 18 ) & 63], BASE64URL[( bits >> 12 ) & 63], BASE64URL[( bits >> 6 ) & 63], BASE64URL[bits & 63], 0 };
+		chars[count + 1] = '\0';
+		out += chars;
+	}
+	return out;
+}
+
+// Accepts both alphabets, with or without padding.
+static int Base64Decode( const char * text, UByte * out, const int maxBytes )
+{
+	UInt32 bits = 0;
+	int numBits = 0;
+	int length = 0;
+	for ( const char * p = text; *p != '\0' && *p != '='; p++ )
+	{
+		const char * found = strchr( BASE64URL, *p );
+		const int value = ( *p == '+' ) ? 62 : ( *p == '/' ) ? 63 : ( found != NULL ) ? static_cast< int >( found - BASE64URL ) : -1;
+		if ( value < 0 )
+		{
+			return -1;
+		}
+		bits = ( bits << 6 ) | value;
+		numBits += 6;
+		if ( numBits >= 8 )
+		{
+			numBits -= 8;
+			if ( length == maxBytes )
+			{
+				return -1;
+			}
+			out[length++] = ( UByte )( bits >> numBits );
+		}
+	}
+	return length;
+}
+
+bool CencRequestClearKeys( HttpConnection & connection, const char * licenseUrl,
+		const Array< CencKey > & kids, Array< CencKey > & outKeys )
+{
+	HttpUrl url;
+	if ( !url.Parse( licenseUrl ) )
+	{
+		LOG( "CencRequestClearKeys: unsupported license url %s", licenseUrl );
+		return false;
+	}
+
+	String request = "{\"kids\":[";
+	for ( int i = 0; i < kids.GetSizeI(); i++ )
+	{
+		request += ( i > 0 ) ? ",\"" : "\"";
+		request += Base64UrlEncode( kids[i].Kid, 16 );
+		request += "\"";
+	}
+	request += "],\"type\":\"temporary\"}";
+
+	// a kept-alive socket may have been dropped, so retry once on a fresh one
+	HttpResponse response;
+	bool sent = false;
+	for ( int attempt = 0; attempt < 2 && !sent; attempt++ )
+	{
+		sent = connection.SendRequest( "POST", url, "Content-Type: application/json\r\n",
+					request.ToCStr(), static_cast< int >( request.GetSize() ) ) &&
+				connection.ReadResponseHeader( response );
+		if ( !sent )
+		{
+			connection.Close();
+		}
+	}
+	if ( !sent || !response.IsSuccess() )
+	{
+		LOG( "CencRequestClearKeys: license request to %s failed with %i", licenseUrl, sent ? response.StatusCode : 0 );
+		if ( sent )
+		{
+			connection.DiscardBody();
+		}
+		return false;
+	}
+	Array< UByte > body;
+	if ( !connection.ReadBodyToArray( body, MAX_LICENSE_BYTES ) )
+	{
+		return false;
+	}
+	body.PushBack( 0 );
+
+	JSON * json = JSON::Parse( reinterpret_cast< const char * >( body.GetDataPtr() ) );
+	if ( json == NULL )
+	{
+		LOG( "CencRequestClearKeys: malformed license from %s", licenseUrl );
+		return false;
+	}
+	const int numKeys = outKeys.GetSizeI();
+	const JsonReader license( json );
+	JsonReader keys( license.GetChildByName( "keys" ) );
+	if ( keys.IsArray() )
+	{
+		while ( !keys.IsEndOfArray() )
+		{
+			const JsonReader entry( keys.GetNextArrayElement() );
+			CencKey key;
+			if ( entry.GetChildStringByName( "kty" ) == "oct" &&
+				Base64Decode( entry.GetChildStringByName( "kid" ).ToCStr(), key.Kid, 16 ) == 16 &&
+				Base64Decode( entry.GetChildStringByName( "k" ).ToCStr(), key.Key, 16 ) == 16 )
+			{
+				outKeys.PushBack( key );
+			}
+		}
+	}
+	json->Release();
+
+	LOG( "CencRequestClearKeys: %i keys from %s", outKeys.GetSizeI() - numKeys, licenseUrl );
+	return outKeys.GetSizeI() > numKeys;
+}
+
+//==============================================================
+// Boxes in memory
+//
+// Offsets are ints: segments are held in memory, so they are far smaller
+// than 2 GB, and every size is checked against its parent before use.
+struct BufferBox
+{
+	UInt32	Type;
+	int		Offset;
+	int		DataOffset;
+	int		End;
+};
+
+static bool ReadBufferBox( const UByte * data, const int offset, const int end, BufferBox & outBox )
+{
+	if ( end - offset < 8 )
+	{
+		return false;
+	}
+	SInt64 size = ReadBE32( data + offset );
+	int header = 8;
+	if ( size == 1 )
+	{
+		if ( end - offset < 16 )
+		{
+			return false;
+		}
+		size = static_cast< SInt64 >( ReadBE64( data + offset + 8 ) );
+		header = 16;
+	}
+	else if ( size == 0 )
+	{
+		size = end - offset;
+	}
+	if ( size < header || size > end - offset )
+	{
+		return false;
+	}
+	outBox.Type = ReadBE32( data + offset + 4 );
+	outBox.Offset = offset;
+	outBox.DataOffset = offset + header;
+	outBox.End = offset + static_cast< int >( size );
+	return true;
+}
+
+static bool FindBufferBox( const UByte * data, const int start, const int end, const UInt32 type, BufferBox & outBox )
+{
+	for ( int offset = start; offset < end; offset = outBox.End )
+	{
+		if ( !ReadBufferBox( data, offset, end, outBox ) )
+		{
+			return false;
+		}
+		if ( outBox.Type == type )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//==============================================================
+// CencDecryptor
+
+CencDecryptor::CencDecryptor()
+	: TrackId( 0 )
+	, Scheme( 0 )
+	, Protected( false )
+	, HasKey( false )
+	, IvSize( 0 )
+	, CryptBlocks( 0 )
+	, SkipBlocks( 0 )
+{
+	memset( Kid, 0, sizeof( Kid ) );
+	memset( ConstantIv, 0, sizeof( ConstantIv ) );
+}
+
+// The track_ID of a trak, 0 if it has no tkhd.
+static UInt32 ReadTrackId( const UByte * data, const BufferBox & trak )
+{
+	BufferBox tkhd;
+	if ( !FindBufferBox( data, trak.DataOffset, trak.End, MP4_FOURCC( 't', 'k', 'h', 'd' ), tkhd ) )
+	{
+		return 0;
+	}
+	// after version, flags and the creation and modification times
+	const int field = ( data[tkhd.DataOffset] == 1 ) ? 20 : 12;
+	return ( tkhd.End - tkhd.DataOffset >= field + 4 ) ? ReadBE32( data + tkhd.DataOffset + field ) : 0;
+}
+
+bool CencDecryptor::ParseInit( const UByte * data, const int length, const UInt32 trackId )
+{
+	Protected = false;
+	TrackId = trackId;
+	BufferBox moov;
+	if ( !FindBufferBox( data, 0, length, MP4_FOURCC( 'm', 'o', 'o', 'v' ), moov ) )
+	{
+		return false;
+	}
+
+	// the first protected sample entry of any track; DASH puts one track in each init segment
+	BufferBox trak;
+	for ( int offset = moov.DataOffset; FindBufferBox( data, offset, moov.End, MP4_FOURCC( 't', 'r', 'a', 'k' ), trak ); offset = trak.End )
+	{
+		if ( trackId != 0 && ReadTrackId( data, trak ) != trackId )
+		{
+			continue;
+		}
+		BufferBox mdia, minf, stbl, stsd;
+		if ( !FindBufferBox( data, trak.DataOffset, trak.End, MP4_FOURCC( 'm', 'd', 'i', 'a' ), mdia ) ||
+			!FindBufferBox( data, mdia.DataOffset, mdia.End, MP4_FOURCC( 'm', 'i', 'n', 'f' ), minf ) ||
+			!FindBufferBox( data, minf.DataOffset, minf.End, MP4_FOURCC( 's', 't', 'b', 'l' ), stbl ) ||
+			!FindBufferBox( data, stbl.DataOffset, stbl.End, MP4_FOURCC( 's', 't', 's', 'd' ), stsd ) )
+		{
+			continue;
+		}
+
+		BufferBox entry;
+		for ( int entryOffset = stsd.DataOffset + 8; entryOffset < stsd.End && ReadBufferBox( data, entryOffset, stsd.End, entry ); entryOffset = entry.End )
+		{
+			// past the visual or audio sample entry fields
+			const int fieldBytes = ( entry.Type == MP4_FOURCC( 'e', 'n', 'c', 'a' ) ) ? 28 : 78;
+			BufferBox sinf, schm, schi, tenc;
+			if ( entry.DataOffset + fieldBytes > entry.End ||
+				!FindBufferBox( data, entry.DataOffset + fieldBytes, entry.End, MP4_FOURCC( 's', 'i', 'n', 'f' ), sinf ) ||
+				!FindBufferBox( data, sinf.DataOffset, sinf.End, MP4_FOURCC( 's', 'c', 'h', 'm' ), schm ) ||
+				!FindBufferBox( data, sinf.DataOffset, sinf.End, MP4_FOURCC( 's', 'c', 'h', 'i' ), schi ) ||
+				!FindBufferBox( data, schi.DataOffset, schi.End, MP4_FOURCC( 't', 'e', 'n', 'c' ), tenc ) ||
+				schm.End - schm.DataOffset < 12 || tenc.End - tenc.DataOffset < 24 )
+			{
+				continue;
+			}
+
+			// from here on only this track's fragments are decrypted
+			TrackId = ReadTrackId( data, trak );
+			Scheme = ReadBE32( data + schm.DataOffset + 4 );
+			if ( Scheme != MP4_FOURCC( 'c', 'e', 'n', 'c' ) && Scheme != MP4_FOURCC( 'c', 'b', 'c', 's' ) )
+			{
+				LOG( "CencDecryptor: unsupported scheme %c%c%c%c", ( char )( Scheme >> 24 ), ( char )( Scheme >> 16 ), ( char )( Scheme >> 8 ), ( char )Scheme );
+				return false;
+			}
+
+			const UByte * t = data + tenc.DataOffset;
+			const int version = t[0];
+			CryptBlocks = ( version > 0 ) ? ( t[5] >> 4 ) : 0;
+			SkipBlocks = ( version > 0 ) ? ( t[5] & 15 ) : 0;
+			Protected = t[6] != 0;
+			IvSize = t[7];
+			memcpy( Kid, t + 8, 16 );
+			memset( ConstantIv, 0, sizeof( ConstantIv ) );
+			if ( IvSize != 0 && IvSize != 8 && IvSize != 16 )
+			{
+				return false;
+			}
+			if ( Protected && IvSize == 0 )
+			{
+				const int constantIvSize = ( tenc.End - tenc.DataOffset > 24 ) ? t[24] : 0;
+				if ( ( constantIvSize != 8 && constantIvSize != 16 ) || tenc.End - tenc.DataOffset < 25 + constantIvSize )
+				{
+					return false;
+				}
+				memcpy( ConstantIv, t + 25, constantIvSize );
+			}
+			return true;
+		}
+	}
+	// no protected sample entry, the track is in the clear
+	return true;
+}
+
+bool CencDecryptor::SetKey( const Array< CencKey > & keys )
+{
+	for ( int i = 0; i < keys.GetSizeI(); i++ )
+	{
+		if ( memcmp( keys[i].Kid, Kid, 16 ) == 0 )
+		{
+			Aes.SetKey( keys[i].Key );
+			HasKey = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CencDecryptor::DecryptSegment( UByte * data, const int length, const SInt64 dataOffset ) const
+{
+	if ( !Protected )
+	{
+		return true;
+	}
+	if ( !HasKey )
+	{
+		return false;
+	}
+	BufferBox box;
+	for ( int offset = 0; offset < length; offset = box.End )
+	{
+		if ( !ReadBufferBox( data, offset, length, box ) )
+		{
+			return false;
+		}
+		if ( box.Type == MP4_FOURCC( 'm', 'o', 'o', 'f' ) && !DecryptFragment( data, length, box.Offset, box.End, dataOffset ) )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CencDecryptor::DecryptFragment( UByte * data, const int length, const int moofStart, const int moofEnd,
+		const SInt64 dataOffset ) const
+{
+	static const UInt32 TFHD_BASE_DATA_OFFSET = 0x000001;
+	static const UInt32 TFHD_SAMPLE_DESCRIPTION_INDEX = 0x000002;
+	static const UInt32 TFHD_DEFAULT_DURATION = 0x000008;
+	static const UInt32 TFHD_DEFAULT_SIZE = 0x000010;
+	static const UInt32 TRUN_DATA_OFFSET = 0x000001;
+	static const UInt32 TRUN_FIRST_SAMPLE_FLAGS = 0x000004;
+	static const UInt32 TRUN_SAMPLE_SIZE = 0x000200;
+	static const UInt32 SENC_SUBSAMPLES = 0x000002;
+
+	BufferBox traf;
+	for ( int trafOffset = moofStart + 8; FindBufferBox( data, trafOffset, moofEnd, MP4_FOURCC( 't', 'r', 'a', 'f' ), traf ); trafOffset = traf.End )
+	{
+		BufferBox tfhd;
+		if ( !FindBufferBox( data, traf.DataOffset, traf.End, MP4_FOURCC( 't', 'f', 'h', 'd' ), tfhd ) ||
+			tfhd.End - tfhd.DataOffset < 8 )
+		{
+			return false;
+		}
+		const UByte * h = data + tfhd.DataOffset;
+		const int hSize = tfhd.End - tfhd.DataOffset;
+		const UInt32 tfhdFlags = ReadBE32( h ) & 0xFFFFFF;
+		if ( TrackId != 0 && ReadBE32( h + 4 ) != TrackId )
+		{
+			continue;
+		}
+		int field = 8;
+		SInt64 base = moofStart;
+		if ( tfhdFlags & TFHD_BASE_DATA_OFFSET )
+		{
+			if ( hSize < field + 8 )
+			{
+				return false;
+			}
+			base = static_cast< SInt64 >( ReadBE64( h + field ) ) - dataOffset;
+			field += 8;
+		}
+		field += ( tfhdFlags & TFHD_SAMPLE_DESCRIPTION_INDEX ) ? 4 : 0;
+		field += ( tfhdFlags & TFHD_DEFAULT_DURATION ) ? 4 : 0;
+		UInt32 defaultSize = 0;
+		if ( tfhdFlags & TFHD_DEFAULT_SIZE )
+		{
+			if ( hSize < field + 4 )
+			{
+				return false;
+			}
+			defaultSize = ReadBE32( h + field );
+		}
+
+		// sample auxiliary information, from senc when present
+		const UByte * aux = NULL;
+		int auxEnd = 0;
+		int auxCount = 0;
+		bool fromSenc = false;
+		bool auxSubsamples = false;
+		const UByte * auxSizes = NULL;		// saiz sizes, NULL when every entry is auxDefaultSize
+		int auxDefaultSize = 0;
+		BufferBox senc, saiz, saio;
+		if ( FindBufferBox( data, traf.DataOffset, traf.End, MP4_FOURCC( 's', 'e', 'n', 'c' ), senc ) )
+		{
+			if ( senc.End - senc.DataOffset < 8 )
+			{
+				return false;
+			}
+			auxSubsamples = ( ReadBE32( data + senc.DataOffset ) & SENC_SUBSAMPLES ) != 0;
+			auxCount = static_cast< int >( ReadBE32( data + senc.DataOffset + 4 ) );
+			aux = data + senc.DataOffset + 8;
+			auxEnd = senc.End;
+			fromSenc = true;
+		}
+		else if ( FindBufferBox( data, traf.DataOffset, traf.End, MP4_FOURCC( 's', 'a', 'i', 'z' ), saiz ) &&
+			FindBufferBox( data, traf.DataOffset, traf.End, MP4_FOURCC( 's', 'a', 'i', 'o' ), saio ) )
+		{
+			const UByte * z = data + saiz.DataOffset;
+			const int zType = ( ReadBE32( z ) & 1 ) ? 8 : 0;
+			const UByte * o = data + saio.DataOffset;
+			const int oType = ( ReadBE32( o ) & 1 ) ? 8 : 0;
+			if ( saiz.End - saiz.DataOffset < 9 + zType || saio.End - saio.DataOffset < ( o[0] == 0 ? 12 : 16 ) + oType ||
+				ReadBE32( o + 4 + oType ) != 1 )
+			{
+				return false;
+			}
+			auxDefaultSize = z[4 + zType];
+			auxCount = static_cast< int >( ReadBE32( z + 5 + zType ) );
+			if ( auxDefaultSize == 0 )
+			{
+				if ( auxCount < 0 || auxCount > saiz.End - saiz.DataOffset - 9 - zType )
+				{
+					return false;
+				}
+				auxSizes = z + 9 + zType;
+			}
+			const SInt64 auxOffset = ( o[0] == 0 ) ? ReadBE32( o + 8 + oType ) : static_cast< SInt64 >( ReadBE64( o + 8 + oType ) );
+			if ( base + auxOffset < 0 || base + auxOffset > length )
+			{
+				return false;
+			}
+			aux = data + base + auxOffset;
+			auxEnd = length;
+		}
+		else
+		{
+			// a protected track with no sample information in this fragment
+			return false;
+		}
+
+		// walk the samples of every trun, consuming one aux entry per sample
+		int sample = 0;
+		const UByte * auxPos = aux;
+		SInt64 dataPos = base;
+		BufferBox trun;
+		for ( int trunOffset = traf.DataOffset; FindBufferBox( data, trunOffset, traf.End, MP4_FOURCC( 't', 'r', 'u', 'n' ), trun ); trunOffset = trun.End )
+		{
+			const UByte * r = data + trun.DataOffset;
+			const int rSize = trun.End - trun.DataOffset;
+			if ( rSize < 8 )
+			{
+				return false;
+			}
+			const UInt32 trunFlags = ReadBE32( r ) & 0xFFFFFF;
+			const int count = static_cast< int >( ReadBE32( r + 4 ) );
+			int pos = 8;
+			if ( trunFlags & TRUN_DATA_OFFSET )
+			{
+				if ( rSize < pos + 4 )
+				{
+					return false;
+				}
+				dataPos = base + static_cast< SInt32 >( ReadBE32( r + pos ) );
+				pos += 4;
+			}
+			pos += ( trunFlags & TRUN_FIRST_SAMPLE_FLAGS ) ? 4 : 0;
+			int sampleFieldBytes = 0;
+			for ( UInt32 bit = 0x100; bit <= 0x800; bit <<= 1 )
+			{
+				sampleFieldBytes += ( trunFlags & bit ) ? 4 : 0;
+			}
+			const int sizeField = ( trunFlags & 0x100 ) ? 4 : 0;
+			if ( count < 0 || count > auxCount - sample || static_cast< SInt64 >( count ) * sampleFieldBytes > rSize - pos )
+			{
+				return false;
+			}
+
+			for ( int i = 0; i < count; i++, sample++, pos += sampleFieldBytes )
+			{
+				const UInt32 sampleSize = ( trunFlags & TRUN_SAMPLE_SIZE ) ? ReadBE32( r + pos + sizeField ) : defaultSize;
+				if ( dataPos < 0 || static_cast< SInt64 >( sampleSize ) > length - dataPos )
+				{
+					return false;
+				}
+
+				int entrySize;
+				if ( fromSenc )
+				{
+					entrySize = IvSize;
+					if ( auxSubsamples )
+					{
+						if ( auxEnd - ( auxPos - data ) < IvSize + 2 )
+						{
+							return false;
+						}
+						entrySize += 2 + 6 * ReadBE16( auxPos + IvSize );
+					}
+				}
+				else
+				{
+					entrySize = ( auxSizes != NULL ) ? auxSizes[sample] : auxDefaultSize;
+				}
+				if ( auxEnd - ( auxPos - data ) < entrySize ||
+					!DecryptSample( data + dataPos, static_cast< int >( sampleSize ), auxPos, entrySize ) )
+				{
+					return false;
+				}
+				auxPos += entrySize;
+				dataPos += sampleSize;
+			}
+		}
+	}
+	return true;
+}
+
+bool CencDecryptor::DecryptSample( UByte * sample, const int sampleSize, const UByte * aux, const int auxSize ) const
+{
+	if ( auxSize < IvSize )
+	{
+		return false;
+	}
+	UByte iv[16];
+	memset( iv, 0, sizeof( iv ) );
+	memcpy( iv, ( IvSize > 0 ) ? aux : ConstantIv, ( IvSize > 0 ) ? IvSize : sizeof( ConstantIv ) );
+
+	// without subsamples the whole sample is one protected range
+	const int numSubsamples = ( auxSize > IvSize + 1 ) ? ReadBE16( aux + IvSize ) : 0;
+	const UByte * subsample = aux + IvSize + 2;
+	if ( auxSize < IvSize + ( numSubsamples > 0 ? 2 + 6 * numSubsamples : 0 ) )
+	{
+		return false;
+	}
+
+	UByte counter[16];
+	memcpy( counter, iv, sizeof( counter ) );
+	int blockOffset = 0;
+	int pos = 0;
+	for ( int i = 0; i < Alg::Max( numSubsamples, 1 ); i++ )
+	{
+		int clearBytes = 0;
+		SInt64 protectedBytes = sampleSize;
+		if ( numSubsamples > 0 )
+		{
+			clearBytes = ReadBE16( subsample + i * 6 );
+			protectedBytes = ReadBE32( subsample + i * 6 + 2 );
+		}
+		if ( clearBytes + protectedBytes > sampleSize - pos )
+		{
+			return false;
+		}
+		pos += clearBytes;
+		UByte * range = sample + pos;
+		const int rangeBytes = static_cast< int >( protectedBytes );
+		pos += rangeBytes;
+
+		if ( Scheme == MP4_FOURCC( 'c', 'e', 'n', 'c' ) )
+		{
+			// one key stream runs through all protected ranges of the sample
+			Aes.Ctr( range, rangeBytes, counter, blockOffset );
+			continue;
+		}
+
+		// 'cbcs': the chain restarts at each subsample, encrypted blocks are
+		// chained across the skipped ones, and a partial last block is clear
+		UByte chain[16];
+		memcpy( chain, iv, sizeof( chain ) );
+		const int blocks = rangeBytes / 16;
+		if ( CryptBlocks == 0 )
+		{
+			Aes.DecryptCbc( range, blocks, chain );
+			continue;
+		}
+		for ( int b = 0; b < blocks; b += CryptBlocks + SkipBlocks )
+		{
+			Aes.DecryptCbc( range + b * 16, Alg::Min( CryptBlocks, blocks - b ), chain );
+		}
+	}
+	return true;
+}
+
+//==============================================================
+// Protected files
+
+static bool PwriteAll( const int fd, const UByte * data, const int length, const SInt64 offset )
+{
+	int done = 0;
+	while ( done < length )
+	{
+		const ssize_t n = pwrite64( fd, data + done, length - done, offset + done );
+		if ( n < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if ( n <= 0 )
+		{
+			return false;
+		}
+		done += static_cast< int >( n );
+	}
+	return true;
+}
+
+static bool ReadMoov( const MediaFile & file, Mp4Box & outMoov, Array< UByte > & outData )
+{
+	return Mp4FindTopLevel( file, MP4_FOURCC( 'm', 'o', 'o', 'v' ), outMoov ) &&
+		outMoov.End - outMoov.Offset <= MAX_MOOV_BYTES &&
+		file.ReadArray( outMoov.Offset, static_cast< int >( outMoov.End - outMoov.Offset ), outData );
+}
+
+// A decryptor for each protected track of moov.
+static bool ParseProtectedTracks( const Array< UByte > & moov, Array< CencDecryptor > & outTracks )
+{
+	const UByte * data = moov.GetDataPtr();
+	const int length = moov.GetSizeI();
+	BufferBox trak;
+	for ( int offset = 8; FindBufferBox( data, offset, length, MP4_FOURCC( 't', 'r', 'a', 'k' ), trak ); offset = trak.End )
+	{
+		const UInt32 trackId = ReadTrackId( data, trak );
+		CencDecryptor track;
+		if ( trackId == 0 || !track.ParseInit( data, length, trackId ) )
+		{
+			return false;
+		}
+		if ( track.IsProtected() )
+		{
+			outTracks.PushBack( track );
+		}
+	}
+	return true;
+}
+
+// Sample auxiliary information is what a track fragment needs decrypting
+// for, and it is dropped once it has been.
+static bool HasSampleInfo( const UByte * data, const int moofEnd )
+{
+	BufferBox traf, info;
+	for ( int offset = 8; FindBufferBox( data, offset, moofEnd, MP4_FOURCC( 't', 'r', 'a', 'f' ), traf ); offset = traf.End )
+	{
+		if ( FindBufferBox( data, traf.DataOffset, traf.End, MP4_FOURCC( 's', 'e', 'n', 'c' ), info ) ||
+			FindBufferBox( data, traf.DataOffset, traf.End, MP4_FOURCC( 's', 'a', 'i', 'z' ), info ) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Renames the children of types[] under start..end to 'free', which every reader skips.
+static void FreeBoxes( UByte * data, const int start, const int end, const UInt32 * types, const int numTypes )
+{
+	BufferBox box;
+	for ( int offset = start; offset < end && ReadBufferBox( data, offset, end, box ); offset = box.End )
+	{
+		for ( int i = 0; i < numTypes; i++ )
+		{
+			if ( box.Type == types[i] )
+			{
+				WriteBE32( data + box.Offset + 4, MP4_FOURCC( 'f', 'r', 'e', 'e' ) );
+			}
+		}
+	}
+}
+
+static void FreeSampleInfo( UByte * data, const int moofEnd )
+{
+	static const UInt32 trafTypes[] = { MP4_FOURCC( 's', 'e', 'n', 'c' ), MP4_FOURCC( 's', 'a', 'i', 'z' ), MP4_FOURCC( 's', 'a', 'i', 'o' ) };
+	static const UInt32 moofTypes[] = { MP4_FOURCC( 'p', 's', 's', 'h' ) };
+	BufferBox traf;
+	for ( int offset = 8; FindBufferBox( data, offset, moofEnd, MP4_FOURCC( 't', 'r', 'a', 'f' ), traf ); offset = traf.End )
+	{
+		FreeBoxes( data, traf.DataOffset, traf.End, trafTypes, 3 );
+	}
+	FreeBoxes( data, 8, moofEnd, moofTypes, 1 );
+}
+
+// encv and enca entries get their original format back from sinf/frma,
+// and sinf and pssh are dropped.
+static void ClearSampleEntries( UByte * data, const int length )
+{
+	static const UInt32 moovTypes[] = { MP4_FOURCC( 'p', 's', 's', 'h' ) };
+	static const UInt32 entryTypes[] = { MP4_FOURCC( 's', 'i', 'n', 'f' ) };
+	BufferBox trak;
+	for ( int offset = 8; FindBufferBox( data, offset, length, MP4_FOURCC( 't', 'r', 'a', 'k' ), trak ); offset = trak.End )
+	{
+		BufferBox mdia, minf, stbl, stsd;
+		if ( !FindBufferBox( data, trak.DataOffset, trak.End, MP4_FOURCC( 'm', 'd', 'i', 'a' ), mdia ) ||
+			!FindBufferBox( data, mdia.DataOffset, mdia.End, MP4_FOURCC( 'm', 'i', 'n', 'f' ), minf ) ||
+			!FindBufferBox( data, minf.DataOffset, minf.End, MP4_FOURCC( 's', 't', 'b', 'l' ), stbl ) ||
+			!FindBufferBox( data, stbl.DataOffset, stbl.End, MP4_FOURCC( 's', 't', 's', 'd' ), stsd ) )
+		{
+			continue;
+		}
+		BufferBox entry;
+		for ( int entryOffset = stsd.DataOffset + 8; entryOffset < stsd.End && ReadBufferBox( data, entryOffset, stsd.End, entry ); entryOffset = entry.End )
+		{
+			const int fieldBytes = ( entry.Type == MP4_FOURCC( 'e', 'n', 'c', 'a' ) ) ? 28 : 78;
+			BufferBox sinf, frma;
+			if ( ( entry.Type != MP4_FOURCC( 'e', 'n', 'c', 'v' ) && entry.Type != MP4_FOURCC( 'e', 'n', 'c', 'a' ) ) ||
+				entry.DataOffset + fieldBytes > entry.End ||
+				!FindBufferBox( data, entry.DataOffset + fieldBytes, entry.End, MP4_FOURCC( 's', 'i', 'n', 'f' ), sinf ) ||
+				!FindBufferBox( data, sinf.DataOffset, sinf.End, MP4_FOURCC( 'f', 'r', 'm', 'a' ), frma ) ||
+				frma.End - frma.DataOffset < 4 )
+			{
+				continue;
+			}
+			WriteBE32( data + entry.Offset + 4, ReadBE32( data + frma.DataOffset ) );
+			FreeBoxes( data, entry.DataOffset + fieldBytes, entry.End, entryTypes, 1 );
+		}
+	}
+	FreeBoxes( data, 8, length, moovTypes, 1 );
+}
+
+bool CencReadFileKids( const char * path, Array< CencKey > & outKids )
+{
+	MediaFile file;
+	Mp4Box moovBox;
+	Array< UByte > moov;
+	Array< CencDecryptor > tracks;
+	if ( !file.Open( path ) || !ReadMoov( file, moovBox, moov ) || !ParseProtectedTracks( moov, tracks ) )
+	{
+		return false;
+	}
+	for ( int i = 0; i < tracks.GetSizeI(); i++ )
+	{
+		bool listed = false;
+		for ( int j = 0; j < outKids.GetSizeI() && !listed; j++ )
+		{
+			listed = memcmp( outKids[j].Kid, tracks[i].GetKid(), 16 ) == 0;
+		}
+		if ( !listed )
+		{
+			CencKey kid;
+			memcpy( kid.Kid, tracks[i].GetKid(), 16 );
+			memset( kid.Key, 0, 16 );
+			outKids.PushBack( kid );
+		}
+	}
+	return tracks.GetSizeI() > 0;
+}
+
+bool CencDecryptFile( const char * path, const Array< CencKey > & keys )
+{
+	MediaFile file;
+	Mp4Box moovBox;
+	Array< UByte > moov;
+	Array< CencDecryptor > tracks;
+	if ( !file.Open( path ) || !ReadMoov( file, moovBox, moov ) || !ParseProtectedTracks( moov, tracks ) )
+	{
+		LOG( "CencDecryptFile: %s isn't an MP4 we can read", path );
+		return false;
+	}
+	if ( tracks.GetSizeI() == 0 )
+	{
+		return true;
+	}
+	for ( int i = 0; i < tracks.GetSizeI(); i++ )
+	{
+		if ( !tracks[i].SetKey( keys ) )
+		{
+			LOG( "CencDecryptFile: no key for a track of %s", path );
+			return false;
+		}
+	}
+	const int fd = open( path, O_WRONLY | O_LARGEFILE );
+	if ( fd < 0 )
+	{
+		LOG( "CencDecryptFile: can't open %s: %s", path, strerror( errno ) );
+		return false;
+	}
+
+	// each moof with the mdat after it, which its samples are in
+	bool ok = true;
+	int fragments = 0;
+	int decrypted = 0;
+	Array< UByte > fragment;
+	Mp4Box box;
+	for ( SInt64 offset = 0; ok && offset < file.GetSize(); offset = box.End )
+	{
+		ok = Mp4ReadBox( file, offset, file.GetSize(), box );
+		if ( !ok || box.Type != MP4_FOURCC( 'm', 'o', 'o', 'f' ) )
+		{
+			continue;
+		}
+		fragments++;
+		Mp4Box mdat;
+		const SInt64 end = ( box.End < file.GetSize() && Mp4ReadBox( file, box.End, file.GetSize(), mdat ) &&
+			mdat.Type == MP4_FOURCC( 'm', 'd', 'a', 't' ) ) ? mdat.End : box.End;
+		const int moofEnd = static_cast< int >( box.End - box.Offset );
+		ok = end - box.Offset <= MAX_FRAGMENT_BYTES &&
+			file.ReadArray( box.Offset, moofEnd, fragment );
+		if ( !ok || !HasSampleInfo( fragment.GetDataPtr(), moofEnd ) )
+		{
+			continue;		// clear, or decrypted by an earlier call
+		}
+		ok = file.ReadArray( box.Offset, static_cast< int >( end - box.Offset ), fragment );
+		for ( int i = 0; i < tracks.GetSizeI() && ok; i++ )
+		{
+			ok = tracks[i].DecryptSegment( fragment.GetDataPtr(), fragment.GetSizeI(), box.Offset );
+		}
+		if ( ok )
+		{
+			FreeSampleInfo( fragment.GetDataPtr(), moofEnd );
+			ok = PwriteAll( fd, fragment.GetDataPtr(), fragment.GetSizeI(), box.Offset );
+			decrypted++;
+		}
+	}
+	if ( ok && fragments == 0 )
+	{
+		// the sample tables of a plain MP4 would need their own aux info walk
+		LOG( "CencDecryptFile: %s isn't fragmented", path );
+		ok = false;
+	}
+	if ( ok )
+	{
+		ClearSampleEntries( moov.GetDataPtr(), moov.GetSizeI() );
+		ok = PwriteAll( fd, moov.GetDataPtr(), moov.GetSizeI(), moovBox.Offset );
+	}
+	ok = fdatasync( fd ) == 0 && ok;
+	close( fd );
+	LOG( "CencDecryptFile: %s, %i of %i fragments decrypted%s", path, decrypted, fragments, ok ? "" : ", failed" );
+	return ok;
+}
+
+}
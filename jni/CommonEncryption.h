@@ -0,0 +1,142 @@
+/************************************************************************************
+
+Filename    :   CommonEncryption.h
+Content     :   ISO/IEC 23001-7 Common Encryption, 'cenc' and 'cbcs' sample decryption
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_CommonEncryption_h )
+#define OVR_CommonEncryption_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+class HttpConnection;
+
+//==============================================================
+// Aes128
+//
+// AES-128 in the two modes Common Encryption uses, in place. Runs on the
+// ARMv8 Crypto Extensions or AES-NI when the CPU has them, and on lookup
+// tables otherwise. The tables are not constant time, which
+// is acceptable for content keys but not for anything secret beyond that.
+class Aes128
+{
+public:
+						Aes128();
+
+	void				SetKey( const UByte key[16] );
+
+	// XORs the key stream into data. counter is the block holding the next
+	// byte and blockOffset the position inside it; both advance, so calls
+	// on consecutive ranges continue one stream. As CENC specifies, only
+	// the low 64 bits of the counter are incremented.
+	void				Ctr( UByte * data, const int length, UByte counter[16], int & blockOffset ) const;
+
+	// Decrypts whole blocks, leaving iv at the last ciphertext block so
+	// the chain can be continued.
+	void				DecryptCbc( UByte * data, const int numBlocks, UByte iv[16] ) const;
+
+	// "armv8-ce", "aes-ni" or "tables".
+	static const char *	GetImplementation();
+
+	// Switches every Aes128 to "tables" or back to the instructions, so the
+	// tests can check one against the other. False if the CPU doesn't have
+	// them. Not safe while another thread is decrypting.
+	static bool			SetImplementation( const char * name );
+
+private:
+	UByte				RoundKeys[11 * 16];
+	UByte				InverseRoundKeys[11 * 16];	// equivalent inverse cipher, in decryption order
+};
+
+//==============================================================
+// CencKey
+struct CencKey
+{
+	UByte	Kid[16];
+	UByte	Key[16];
+};
+
+// "01234567-89ab-cdef-0123-456789abcdef" or plain hex, as cenc:default_KID writes it.
+bool	CencParseKid( const char * text, UByte outKid[16] );
+
+// Asks a W3C ClearKey license server for the keys of kids, appending them to outKeys.
+bool	CencRequestClearKeys( HttpConnection & connection, const char * licenseUrl,
+				const Array< CencKey > & kids, Array< CencKey > & outKeys );
+
+//==============================================================
+// CencDecryptor
+//
+// Reads the track encryption defaults from an init segment's tenc, then
+// decrypts the samples of fragmented MP4 media segments in place. Sample
+// auxiliary information comes from senc, or from saiz / saio when a
+// packager leaves senc out. Key rotation through sample groups is not
+// supported; every sample uses the default key.
+class CencDecryptor
+{
+public:
+						CencDecryptor();
+
+	// trackId picks one track of a multi-track moov, 0 the first protected
+	// one. Fragments of the other tracks are left alone.
+	bool				ParseInit( const UByte * data, const int length, const UInt32 trackId = 0 );
+	bool				IsProtected() const		{ return Protected; }
+	const UByte *		GetKid() const			{ return Kid; }
+
+	// Picks the key for the track's default KID.
+	bool				SetKey( const Array< CencKey > & keys );
+
+	// Decrypts every protected sample of every fragment, in place. Returns
+	// false for a malformed segment, whose contents are then undefined.
+	// dataOffset is the file offset of data, which an absolute base data
+	// offset in tfhd counts from.
+	bool				DecryptSegment( UByte * data, const int length, const SInt64 dataOffset = 0 ) const;
+
+private:
+	UInt32				TrackId;			// of the track fragments to decrypt, 0 for all
+	UInt32				Scheme;				// 'cenc' or 'cbcs'
+	bool				Protected;
+	bool				HasKey;
+	int					IvSize;				// per sample, 0 with a constant IV
+	UByte				Kid[16];
+	UByte				ConstantIv[16];
+	int					CryptBlocks;		// 'cbcs' pattern, 0:0 means every block
+	int					SkipBlocks;
+	Aes128				Aes;
+
+	bool				DecryptFragment( UByte * data, const int length, const int moofStart, const int moofEnd,
+							const SInt64 dataOffset ) const;
+	bool				DecryptSample( UByte * sample, const int sampleSize, const UByte * aux, const int auxSize ) const;
+};
+
+//==============================================================
+// Protected files
+//
+// The player has no CENC support, so a downloaded fragmented MP4 is
+// decrypted in place before it is handed over.
+
+// Appends the KIDs of the file's protected tracks. False for a clear file,
+// or one that isn't an MP4.
+bool	CencReadFileKids( const char * path, Array< CencKey > & outKids );
+
+// Decrypts every fragment in place, then turns the protected sample entries
+// back into their original formats, so the file plays as a clear one.
+// Nothing moves, and a fragment is marked as decrypted in the same write
+// that stores it, so an interrupted call can simply be repeated.
+bool	CencDecryptFile( const char * path, const Array< CencKey > & keys );
+
+}
+
+#endif // OVR_CommonEncryption_h
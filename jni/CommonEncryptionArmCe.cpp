@@ -0,0 +1,139 @@
+/************************************************************************************
+
+Filename    :   CommonEncryptionArmCe.cpp
+Content     :   AES-128 blocks on the ARMv8 Crypto Extensions
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "CommonEncryptionArmCe.h"
+
+// Empty on other CPUs, the host tests build it too.
+#if defined( __arm__ ) || defined( __aarch64__ )
+
+#if !defined( __ARM_FEATURE_CRYPTO )
+#error "CommonEncryptionArmCe.cpp must be built with -march=armv8-a -mfpu=crypto-neon-fp-armv8, see Android.mk"
+#endif
+
+#include <arm_neon.h>
+
+#include "MediaContainer.h"
+
+namespace OVR {
+
+// Four blocks at a time, since AESE / AESMC have a latency of several cycles
+// but issue every cycle.
+
+static inline uint8x16_t EncryptNeon( uint8x16_t b, const uint8x16_t * k )
+{
+	for ( int round = 0; round < 9; round++ )
+	{
+		b = vaesmcq_u8( vaeseq_u8( b, k[round] ) );
+	}
+	return veorq_u8( vaeseq_u8( b, k[9] ), k[10] );
+}
+
+static inline uint8x16_t DecryptNeon( uint8x16_t b, const uint8x16_t * k )
+{
+	for ( int round = 0; round < 9; round++ )
+	{
+		b = vaesimcq_u8( vaesdq_u8( b, k[round] ) );
+	}
+	return veorq_u8( vaesdq_u8( b, k[9] ), k[10] );
+}
+
+static inline uint8x16_t CounterNeon( const uint8x8_t high, const UInt64 low )
+{
+	return vcombine_u8( high, vrev64_u8( vcreate_u8( low ) ) );
+}
+
+void AesCtrBlocksArmCe( const UByte * keys, UByte * data, const int numBlocks, UByte counter[16] )
+{
+	uint8x16_t k[11];
+	for ( int i = 0; i < 11; i++ )
+	{
+		k[i] = vld1q_u8( keys + i * 16 );
+	}
+	const uint8x8_t high = vld1_u8( counter );
+	UInt64 low = ReadBE64( counter + 8 );
+	int i = 0;
+	for ( ; i + 4 <= numBlocks; i += 4, low += 4, data += 64 )
+	{
+		uint8x16_t b0 = CounterNeon( high, low + 0 );
+		uint8x16_t b1 = CounterNeon( high, low + 1 );
+		uint8x16_t b2 = CounterNeon( high, low + 2 );
+		uint8x16_t b3 = CounterNeon( high, low + 3 );
+		for ( int round = 0; round < 9; round++ )
+		{
+			b0 = vaesmcq_u8( vaeseq_u8( b0, k[round] ) );
+			b1 = vaesmcq_u8( vaeseq_u8( b1, k[round] ) );
+			b2 = vaesmcq_u8( vaeseq_u8( b2, k[round] ) );
+			b3 = vaesmcq_u8( vaeseq_u8( b3, k[round] ) );
+		}
+		b0 = veorq_u8( vaeseq_u8( b0, k[9] ), k[10] );
+		b1 = veorq_u8( vaeseq_u8( b1, k[9] ), k[10] );
+		b2 = veorq_u8( vaeseq_u8( b2, k[9] ), k[10] );
+		b3 = veorq_u8( vaeseq_u8( b3, k[9] ), k[10] );
+		vst1q_u8( data + 0, veorq_u8( vld1q_u8( data + 0 ), b0 ) );
+		vst1q_u8( data + 16, veorq_u8( vld1q_u8( data + 16 ), b1 ) );
+		vst1q_u8( data + 32, veorq_u8( vld1q_u8( data + 32 ), b2 ) );
+		vst1q_u8( data + 48, veorq_u8( vld1q_u8( data + 48 ), b3 ) );
+	}
+	for ( ; i < numBlocks; i++, low++, data += 16 )
+	{
+		vst1q_u8( data, veorq_u8( vld1q_u8( data ), EncryptNeon( CounterNeon( high, low ), k ) ) );
+	}
+	WriteBE64( counter + 8, low );
+}
+
+void AesCbcBlocksArmCe( const UByte * inverseKeys, UByte * data, const int numBlocks, UByte iv[16] )
+{
+	uint8x16_t k[11];
+	for ( int i = 0; i < 11; i++ )
+	{
+		k[i] = vld1q_u8( inverseKeys + i * 16 );
+	}
+	uint8x16_t previous = vld1q_u8( iv );
+	int i = 0;
+	for ( ; i + 4 <= numBlocks; i += 4, data += 64 )
+	{
+		const uint8x16_t c0 = vld1q_u8( data + 0 );
+		const uint8x16_t c1 = vld1q_u8( data + 16 );
+		const uint8x16_t c2 = vld1q_u8( data + 32 );
+		const uint8x16_t c3 = vld1q_u8( data + 48 );
+		uint8x16_t b0 = c0;
+		uint8x16_t b1 = c1;
+		uint8x16_t b2 = c2;
+		uint8x16_t b3 = c3;
+		for ( int round = 0; round < 9; round++ )
+		{
+			b0 = vaesimcq_u8( vaesdq_u8( b0, k[round] ) );
+			b1 = vaesimcq_u8( vaesdq_u8( b1, k[round] ) );
+			b2 = vaesimcq_u8( vaesdq_u8( b2, k[round] ) );
+			b3 = vaesimcq_u8( vaesdq_u8( b3, k[round] ) );
+		}
+		vst1q_u8( data + 0, veorq_u8( veorq_u8( vaesdq_u8( b0, k[9] ), k[10] ), previous ) );
+		vst1q_u8( data + 16, veorq_u8( veorq_u8( vaesdq_u8( b1, k[9] ), k[10] ), c0 ) );
+		vst1q_u8( data + 32, veorq_u8( veorq_u8( vaesdq_u8( b2, k[9] ), k[10] ), c1 ) );
+		vst1q_u8( data + 48, veorq_u8( veorq_u8( vaesdq_u8( b3, k[9] ), k[10] ), c2 ) );
+		previous = c3;
+	}
+	for ( ; i < numBlocks; i++, data += 16 )
+	{
+		const uint8x16_t c = vld1q_u8( data );
+		vst1q_u8( data, veorq_u8( DecryptNeon( c, k ), previous ) );
+		previous = c;
+	}
+	vst1q_u8( iv, previous );
+}
+
+}
+
+#endif // __arm__ || __aarch64__
@@ -0,0 +1,32 @@
+/************************************************************************************
+
+Filename    :   CommonEncryptionArmCe.h
+Content     :   AES-128 blocks on the ARMv8 Crypto Extensions
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_CommonEncryptionArmCe_h )
+#define OVR_CommonEncryptionArmCe_h
+
+#include "Kernel/OVR_Types.h"
+
+namespace OVR {
+
+// Only CommonEncryptionArmCe.cpp is built with -mfpu=crypto-neon-fp-armv8,
+// so these use instructions an ARMv7 CPU doesn't have. Aes128 only picks
+// them once getauxval reports HWCAP2_AES. keys are the 11 round keys of
+// Aes128, inverseKeys its equivalent inverse cipher keys.
+void	AesCtrBlocksArmCe( const UByte * keys, UByte * data, const int numBlocks, UByte counter[16] );
+void	AesCbcBlocksArmCe( const UByte * inverseKeys, UByte * data, const int numBlocks, UByte iv[16] );
+
+}
+
+#endif // OVR_CommonEncryptionArmCe_h
@@ -0,0 +1,537 @@
+/************************************************************************************
+
+Filename    :   DownloadManager.cpp
+Content     :   Parallel ranged downloads of videos for offline viewing
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "DownloadManager.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "HttpClient.h"
+#include "CommonEncryption.h"
+
+namespace OVR {
+
+static const int	FETCH_TIMEOUT_MS = 15000;
+static const int	MAX_FAILURES = 8;			// in a row, then the download is left for a later resume
+static const int	RETRY_DELAY_MS = 1000;
+static const int	MAX_REDIRECTS = 4;
+static const char	CHUNKS_MAGIC[8] = { 'O', 'V', 'R', 'D', 'L', 'C', 'K', '1' };
+
+// Written at the start of name.chunks, followed by one bit per chunk.
+struct ChunksHeader
+{
+	char	Magic[8];
+	SInt64	TotalLength;
+	SInt32	ChunkBytes;
+	char	ETag[68];
+};
+
+static double GetSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool PwriteAll( const int fd, const UByte * data, const int length, const SInt64 offset )
+{
+	int done = 0;
+	while ( done < length )
+	{
+		const ssize_t n = pwrite64( fd, data + done, length - done, offset + done );
+		if ( n < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if ( n <= 0 )
+		{
+			return false;
+		}
+		done += static_cast< int >( n );
+	}
+	return true;
+}
+
+// One byte request, to learn the length and check that ranges are honored.
+static bool ProbeUrl( HttpConnection & connection, const char * url, SInt64 & outLength, String & outETag )
+{
+	String location( url );
+	for ( int redirect = 0; redirect <= MAX_REDIRECTS; redirect++ )
+	{
+		HttpUrl parsed;
+		HttpResponse response;
+		if ( !parsed.Parse( location.ToCStr() ) ||
+			!connection.SendRequest( "GET", parsed, "Range: bytes=0-0\r\n", NULL, 0 ) ||
+			!connection.ReadResponseHeader( response ) )
+		{
+			connection.Close();
+			return false;
+		}
+		if ( response.StatusCode >= 300 && response.StatusCode < 400 && !response.Location.IsEmpty() )
+		{
+			connection.DiscardBody();
+			location = parsed.Resolve( response.Location.ToCStr() );
+			continue;
+		}
+		if ( response.StatusCode != 206 || response.TotalLength < 0 )
+		{
+			// don't read a whole video to find out the server ignores ranges
+			LOG( "Download: %s answered %i to a range request", location.ToCStr(), response.StatusCode );
+			connection.Close();
+			return false;
+		}
+		outLength = response.TotalLength;
+		outETag = response.ETag;
+		return connection.DiscardBody();
+	}
+	return false;
+}
+
+//==============================================================
+// DownloadManager
+
+DownloadManager::DownloadManager()
+	: Exiting( false )
+	, Active( false )
+	, Preparing( false )
+	, Abandoning( false )
+	, TotalLength( 0 )
+	, ChunkCount( 0 )
+	, DoneCount( 0 )
+	, Failures( 0 )
+	, ClaimedCount( 0 )
+	, DataFile( -1 )
+	, ChunksFile( -1 )
+	, StartTime( 0.0 )
+{
+	pthread_mutex_init( &Mutex, NULL );
+	pthread_cond_init( &Wake, NULL );
+}
+
+DownloadManager::~DownloadManager()
+{
+	Stop();
+	pthread_cond_destroy( &Wake );
+	pthread_mutex_destroy( &Mutex );
+}
+
+void DownloadManager::Start()
+{
+	if ( Threads.GetSizeI() > 0 )
+	{
+		return;
+	}
+	Exiting = false;
+	for ( int i = 0; i < CONNECTIONS; i++ )
+	{
+		pthread_t thread;
+		if ( pthread_create( &thread, NULL, ThreadFunction, this ) != 0 )
+		{
+			LOG( "Download: pthread_create failed" );
+			break;
+		}
+		Threads.PushBack( thread );
+	}
+}
+
+void DownloadManager::Stop()
+{
+	if ( Threads.GetSizeI() == 0 )
+	{
+		return;
+	}
+	pthread_mutex_lock( &Mutex );
+	Exiting = true;
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+
+	// chunks in flight finish first, so the bitmap matches the data
+	for ( int i = 0; i < Threads.GetSizeI(); i++ )
+	{
+		pthread_join( Threads[i], NULL );
+	}
+	Threads.Clear();
+
+	if ( Active )
+	{
+		CloseCurrent( false );
+	}
+	Queue.Clear();
+}
+
+void DownloadManager::Enqueue( const char * url, const char * path, const char * licenseUrl )
+{
+	if ( access( path, F_OK ) == 0 || IsQueued( url ) )
+	{
+		return;
+	}
+	Job job;
+	job.Url = url;
+	job.Path = path;
+	job.LicenseUrl = ( licenseUrl != NULL ) ? licenseUrl : "";
+	pthread_mutex_lock( &Mutex );
+	Queue.PushBack( job );
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+}
+
+bool DownloadManager::IsQueued( const char * url ) const
+{
+	pthread_mutex_lock( &Mutex );
+	bool queued = ( Active || Preparing ) && Current.Url == url;
+	for ( int i = 0; i < Queue.GetSizeI() && !queued; i++ )
+	{
+		queued = Queue[i].Url == url;
+	}
+	pthread_mutex_unlock( &Mutex );
+	return queued;
+}
+
+void DownloadManager::TakeFinished( Array< String > & outPaths )
+{
+	outPaths.Clear();
+	pthread_mutex_lock( &Mutex );
+	for ( int i = 0; i < Finished.GetSizeI(); i++ )
+	{
+		outPaths.PushBack( Finished[i] );
+	}
+	Finished.Clear();
+	pthread_mutex_unlock( &Mutex );
+}
+
+float DownloadManager::GetProgress() const
+{
+	pthread_mutex_lock( &Mutex );
+	const float progress = ( Active && ChunkCount > 0 ) ? static_cast< float >( DoneCount ) / ChunkCount : -1.0f;
+	pthread_mutex_unlock( &Mutex );
+	return progress;
+}
+
+void * DownloadManager::ThreadFunction( void * param )
+{
+	pthread_setname_np( pthread_self(), "Download" );
+	static_cast< DownloadManager * >( param )->Run();
+	return NULL;
+}
+
+// Every thread takes whatever is next: preparing the next queued url when
+// nothing is active, otherwise the lowest chunk nobody has claimed.
+void DownloadManager::Run()
+{
+	HttpConnection connection;
+	connection.SetTimeoutMs( FETCH_TIMEOUT_MS );
+	for ( ;; )
+	{
+		pthread_mutex_lock( &Mutex );
+		int chunk = -1;
+		bool prepare = false;
+		Job job;
+		while ( !Exiting )
+		{
+			if ( Active && !Abandoning )
+			{
+				for ( int i = 0; i < ChunkCount && chunk < 0; i++ )
+				{
+					chunk = ( ( Done[i >> 3] & ( 1 << ( i & 7 ) ) ) == 0 && !Claimed[i] ) ? i : -1;
+				}
+				if ( chunk >= 0 )
+				{
+					Claimed[chunk] = 1;
+					ClaimedCount++;
+					break;
+				}
+			}
+			else if ( !Active && !Preparing && Queue.GetSizeI() > 0 )
+			{
+				job = Queue[0];
+				Queue.RemoveAt( 0 );
+				Current = job;
+				Preparing = true;
+				prepare = true;
+				break;
+			}
+			pthread_cond_wait( &Wake, &Mutex );
+		}
+		pthread_mutex_unlock( &Mutex );
+
+		if ( prepare )
+		{
+			const bool prepared = Prepare( job, connection );
+			pthread_mutex_lock( &Mutex );
+			Preparing = false;
+			pthread_cond_broadcast( &Wake );
+			pthread_mutex_unlock( &Mutex );
+			if ( !prepared )
+			{
+				LOG( "Download: couldn't start %s", job.Url.ToCStr() );
+			}
+			continue;
+		}
+		if ( chunk < 0 )
+		{
+			break;		// exiting
+		}
+
+		const bool fetched = FetchChunk( chunk, connection );
+
+		pthread_mutex_lock( &Mutex );
+		Claimed[chunk] = 0;
+		ClaimedCount--;
+		if ( fetched )
+		{
+			Done[chunk >> 3] |= static_cast< UByte >( 1 << ( chunk & 7 ) );
+			DoneCount++;
+			Failures = 0;
+			// only after the data itself is on the card
+			pwrite64( ChunksFile, &Done[chunk >> 3], 1, sizeof( ChunksHeader ) + ( chunk >> 3 ) );
+		}
+		else if ( ++Failures >= MAX_FAILURES && !Abandoning )
+		{
+			LOG( "Download: giving up on %s for now, %i of %i chunks done", Current.Url.ToCStr(), DoneCount, ChunkCount );
+			Abandoning = true;
+		}
+		const bool complete = ClaimedCount == 0 && DoneCount == ChunkCount;
+		if ( ClaimedCount == 0 && Abandoning && !complete )
+		{
+			CloseCurrent( false );
+		}
+		pthread_cond_broadcast( &Wake );
+		pthread_mutex_unlock( &Mutex );
+
+		if ( complete )
+		{
+			Finish( connection );
+		}
+
+		if ( !fetched )
+		{
+			// a dropped connection is opened again on the next request
+			connection.Close();
+			usleep( RETRY_DELAY_MS * 1000 );
+		}
+	}
+}
+
+bool DownloadManager::Prepare( const Job & job, HttpConnection & connection )
+{
+	SInt64 totalLength = 0;
+	String etag;
+	if ( !ProbeUrl( connection, job.Url.ToCStr(), totalLength, etag ) )
+	{
+		return false;
+	}
+	const int chunkCount = static_cast< int >( ( totalLength + CHUNK_BYTES - 1 ) / CHUNK_BYTES );
+	const int bitmapBytes = ( chunkCount + 7 ) / 8;
+
+	ChunksHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.Magic, CHUNKS_MAGIC, sizeof( header.Magic ) );
+	header.TotalLength = totalLength;
+	header.ChunkBytes = CHUNK_BYTES;
+	strncpy( header.ETag, etag.ToCStr(), sizeof( header.ETag ) - 1 );
+
+	// the bitmap is only trusted if it was written for the same resource
+	const String dataPath = job.Path + ".download";
+	const String chunksPath = job.Path + ".chunks";
+	Array< UByte > done;
+	done.Resize( bitmapBytes );
+	memset( done.GetDataPtr(), 0, bitmapBytes );
+	const int chunksFile = open( chunksPath.ToCStr(), O_RDWR | O_CREAT, 0644 );
+	if ( chunksFile < 0 )
+	{
+		LOG( "Download: can't open %s: %s", chunksPath.ToCStr(), strerror( errno ) );
+		return false;
+	}
+	ChunksHeader stored;
+	const bool resume = access( dataPath.ToCStr(), F_OK ) == 0 &&
+		pread( chunksFile, &stored, sizeof( stored ), 0 ) == sizeof( stored ) &&
+		memcmp( &stored, &header, sizeof( header ) ) == 0 &&
+		pread( chunksFile, done.GetDataPtr(), bitmapBytes, sizeof( header ) ) == bitmapBytes;
+	if ( !resume )
+	{
+		memset( done.GetDataPtr(), 0, bitmapBytes );
+		if ( ftruncate( chunksFile, 0 ) != 0 ||
+			!PwriteAll( chunksFile, reinterpret_cast< const UByte * >( &header ), sizeof( header ), 0 ) ||
+			( bitmapBytes > 0 && !PwriteAll( chunksFile, done.GetDataPtr(), bitmapBytes, sizeof( header ) ) ) )
+		{
+			close( chunksFile );
+			return false;
+		}
+		unlink( dataPath.ToCStr() );
+	}
+
+	int doneCount = 0;
+	for ( int i = 0; i < chunkCount; i++ )
+	{
+		doneCount += ( done[i >> 3] >> ( i & 7 ) ) & 1;
+	}
+
+	struct statfs fs;
+	const SInt64 remaining = totalLength - static_cast< SInt64 >( doneCount ) * CHUNK_BYTES;
+	if ( statfs( chunksPath.ToCStr(), &fs ) == 0 && static_cast< SInt64 >( fs.f_bavail ) * fs.f_bsize < remaining )
+	{
+		LOG( "Download: not enough space for %s", job.Path.ToCStr() );
+		close( chunksFile );
+		return false;
+	}
+
+	const int dataFile = open( dataPath.ToCStr(), O_RDWR | O_CREAT | O_LARGEFILE, 0644 );
+	if ( dataFile < 0 )
+	{
+		LOG( "Download: can't open %s: %s", dataPath.ToCStr(), strerror( errno ) );
+		close( chunksFile );
+		return false;
+	}
+
+	LOG( "Download: %s, %.1f MB, %i of %i chunks already done", job.Url.ToCStr(),
+		totalLength / ( 1024.0 * 1024.0 ), doneCount, chunkCount );
+
+	pthread_mutex_lock( &Mutex );
+	Current = job;
+	ETag = etag;
+	TotalLength = totalLength;
+	ChunkCount = chunkCount;
+	DoneCount = doneCount;
+	Failures = 0;
+	Done = done;
+	Claimed.Resize( chunkCount );
+	for ( int i = 0; i < chunkCount; i++ )
+	{
+		Claimed[i] = 0;
+	}
+	ClaimedCount = 0;
+	DataFile = dataFile;
+	ChunksFile = chunksFile;
+	StartTime = GetSeconds();
+	Active = true;
+	Abandoning = false;
+	pthread_mutex_unlock( &Mutex );
+
+	// nothing left to fetch, only to finish, as when decrypting failed before
+	if ( doneCount == chunkCount )
+	{
+		Finish( connection );
+	}
+	return true;
+}
+
+bool DownloadManager::FetchChunk( const int chunk, HttpConnection & connection )
+{
+	// the fields of the active download don't change while a chunk is claimed
+	const SInt64 start = static_cast< SInt64 >( chunk ) * CHUNK_BYTES;
+	const SInt64 end = Alg::Min( start + CHUNK_BYTES, TotalLength ) - 1;
+
+	Array< UByte > body;
+	HttpResponse response;
+	if ( !HttpFetch( connection, Current.Url.ToCStr(), start, end, body, &response ) )
+	{
+		return false;
+	}
+	if ( response.StatusCode != 206 || response.RangeStart != start ||
+		body.GetSizeI() != static_cast< int >( end - start + 1 ) )
+	{
+		LOG( "Download: bad response for chunk %i", chunk );
+		return false;
+	}
+	if ( !ETag.IsEmpty() && !response.ETag.IsEmpty() && response.ETag != ETag )
+	{
+		// the file changed upstream, so the chunks so far are from another version
+		LOG( "Download: %s changed while downloading", Current.Url.ToCStr() );
+		pthread_mutex_lock( &Mutex );
+		Failures = MAX_FAILURES;
+		pthread_mutex_unlock( &Mutex );
+		return false;
+	}
+	if ( !PwriteAll( DataFile, body.GetDataPtr(), body.GetSizeI(), start ) || fdatasync( DataFile ) != 0 )
+	{
+		LOG( "Download: write failed: %s", strerror( errno ) );
+		return false;
+	}
+	return true;
+}
+
+// Runs without the mutex, since decrypting takes a while. The download
+// stays active meanwhile, so the other threads find no chunk and wait.
+void DownloadManager::Finish( HttpConnection & connection )
+{
+	const bool decrypted = Decrypt( connection );
+	pthread_mutex_lock( &Mutex );
+	CloseCurrent( decrypted );
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+}
+
+bool DownloadManager::Decrypt( HttpConnection & connection ) const
+{
+	const String dataPath = Current.Path + ".download";
+	Array< CencKey > kids;
+	if ( !CencReadFileKids( dataPath.ToCStr(), kids ) )
+	{
+		return true;		// in the clear
+	}
+	if ( Current.LicenseUrl.IsEmpty() )
+	{
+		LOG( "Download: %s is protected and has no license server", Current.Url.ToCStr() );
+		return false;
+	}
+	const double start = GetSeconds();
+	Array< CencKey > keys;
+	if ( !CencRequestClearKeys( connection, Current.LicenseUrl.ToCStr(), kids, keys ) ||
+		!CencDecryptFile( dataPath.ToCStr(), keys ) )
+	{
+		LOG( "Download: couldn't decrypt %s", Current.Path.ToCStr() );
+		return false;
+	}
+	LOG( "Download: decrypted %s in %.1f s", Current.Path.ToCStr(), GetSeconds() - start );
+	return true;
+}
+
+void DownloadManager::CloseCurrent( const bool finished )
+{
+	close( DataFile );
+	close( ChunksFile );
+	DataFile = -1;
+	ChunksFile = -1;
+	Active = false;
+	Abandoning = false;
+
+	if ( finished )
+	{
+		const String dataPath = Current.Path + ".download";
+		const String chunksPath = Current.Path + ".chunks";
+		if ( rename( dataPath.ToCStr(), Current.Path.ToCStr() ) == 0 )
+		{
+			unlink( chunksPath.ToCStr() );
+			Finished.PushBack( Current.Path );
+			const double seconds = GetSeconds() - StartTime;
+			LOG( "Download: finished %s, %.1f MB in %.1f s", Current.Path.ToCStr(),
+				TotalLength / ( 1024.0 * 1024.0 ), seconds );
+		}
+		else
+		{
+			LOG( "Download: can't rename %s: %s", dataPath.ToCStr(), strerror( errno ) );
+		}
+	}
+}
+
+}
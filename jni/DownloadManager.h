@@ -0,0 +1,109 @@
+/************************************************************************************
+
+Filename    :   DownloadManager.h
+Content     :   Parallel ranged downloads of videos for offline viewing
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_DownloadManager_h )
+#define OVR_DownloadManager_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+class HttpConnection;
+
+//==============================================================
+// DownloadManager
+//
+// Downloads one url at a time, split into fixed size chunks that several
+// keep-alive connections fetch in parallel and write straight to their
+// offsets in name.download. A bitmap of the finished chunks is kept in
+// name.chunks next to it, so a download that is stopped, or loses its
+// connections, continues where it was when the same url is queued again.
+// The finished file is renamed to its final name.
+//
+// A protected fragmented MP4 is decrypted in place before that, with the
+// keys from the ClearKey license server it was queued with, on the thread
+// that stored the last chunk. A protected file that can't be decrypted
+// keeps its finished chunks, and is tried again when it is queued again.
+class DownloadManager
+{
+public:
+	static const int	CHUNK_BYTES = 1024 * 1024;
+	static const int	CONNECTIONS = 4;
+
+						DownloadManager();
+						~DownloadManager();
+
+	void				Start();
+	void				Stop();
+
+	// The server has to answer range requests.
+	void				Enqueue( const char * url, const char * path, const char * licenseUrl = NULL );
+	bool				IsQueued( const char * url ) const;
+
+	// Paths finished since the last call, for the VR thread to add to the browser.
+	void				TakeFinished( Array< String > & outPaths );
+
+	// Fraction of the current download, -1 when idle.
+	float				GetProgress() const;
+
+private:
+	struct Job
+	{
+		String			Url;
+		String			Path;
+		String			LicenseUrl;
+	};
+
+	Array< pthread_t >	Threads;
+	mutable pthread_mutex_t	Mutex;
+	pthread_cond_t		Wake;
+	volatile bool		Exiting;
+
+	Array< Job >		Queue;
+	Array< String >		Finished;
+
+	// the active download, valid while Active is set
+	bool				Active;
+	bool				Preparing;
+	bool				Abandoning;			// no new chunks, closed when the claimed ones return
+	Job					Current;
+	String				ETag;
+	SInt64				TotalLength;
+	int					ChunkCount;
+	int					DoneCount;
+	int					Failures;			// consecutive, reset by any finished chunk
+	Array< UByte >		Done;				// the bitmap as stored after the header
+	Array< UByte >		Claimed;
+	int					ClaimedCount;
+	int					DataFile;
+	int					ChunksFile;
+	double				StartTime;
+
+	static void *		ThreadFunction( void * param );
+	void				Run();
+	bool				Prepare( const Job & job, HttpConnection & connection );
+	bool				FetchChunk( const int chunk, HttpConnection & connection );
+	void				Finish( HttpConnection & connection );
+	bool				Decrypt( HttpConnection & connection ) const;
+	void				CloseCurrent( const bool finished );
+};
+
+}
+
+#endif // OVR_DownloadManager_h
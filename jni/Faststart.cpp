@@ -0,0 +1,577 @@
+/************************************************************************************
+
+Filename    :   Faststart.cpp
+Content     :   Background rewrite of local MP4s so the moov box comes first
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "Faststart.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/time.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "MediaContainer.h"
+
+namespace OVR {
+
+static const int	COPY_BLOCK_BYTES = 1024 * 1024;
+static const int	MAX_MOOV_BYTES = 32 * 1024 * 1024;
+static const SInt64	FREE_SPACE_MARGIN = 64 * 1024 * 1024;
+static const char *	PARTIAL_SUFFIX = ".faststart";
+
+static double GetSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool IsMp4Extension( const char * path )
+{
+	const char * dot = strrchr( path, '.' );
+	if ( dot == NULL )
+	{
+		return false;
+	}
+	return strcasecmp( dot, ".mp4" ) == 0 || strcasecmp( dot, ".m4v" ) == 0 ||
+		strcasecmp( dot, ".3gp" ) == 0 || strcasecmp( dot, ".3g2" ) == 0;
+}
+
+static bool WriteFully( const int fd, const SInt64 offset, const UByte * data, const int size )
+{
+	int done = 0;
+	while ( done < size )
+	{
+		const ssize_t w = pwrite( fd, data + done, size - done, offset + done );
+		if ( w < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if ( w <= 0 )
+		{
+			return false;
+		}
+		done += static_cast< int >( w );
+	}
+	return true;
+}
+
+//==============================================================
+// moov rewriting
+
+struct MoovShift
+{
+	SInt64	InsertOffset;	// where moov goes, the first mdat
+	SInt64	MoovEnd;		// end of moov in the source
+	SInt64	OldSize;
+	SInt64	NewSize;
+};
+
+static UInt64 ShiftOffset( const UInt64 offset, const MoovShift & shift )
+{
+	if ( offset >= static_cast< UInt64 >( shift.MoovEnd ) )
+	{
+		return offset + shift.NewSize - shift.OldSize;
+	}
+	if ( offset >= static_cast< UInt64 >( shift.InsertOffset ) )
+	{
+		return offset + shift.NewSize;
+	}
+	return offset;
+}
+
+static bool IsMoovContainer( const UInt32 type )
+{
+	// only the boxes on the way down to the chunk offset tables
+	return type == MP4_FOURCC( 'm', 'o', 'o', 'v' ) || type == MP4_FOURCC( 't', 'r', 'a', 'k' ) ||
+		type == MP4_FOURCC( 'm', 'd', 'i', 'a' ) || type == MP4_FOURCC( 'm', 'i', 'n', 'f' ) ||
+		type == MP4_FOURCC( 's', 't', 'b', 'l' );
+}
+
+static void AppendBE32( Array< UByte > & out, const UInt32 value )
+{
+	const int at = out.GetSizeI();
+	out.Resize( at + 4 );
+	WriteBE32( &out[at], value );
+}
+
+static void AppendBE64( Array< UByte > & out, const UInt64 value )
+{
+	const int at = out.GetSizeI();
+	out.Resize( at + 8 );
+	WriteBE64( &out[at], value );
+}
+
+// Copies the boxes in data to out, patching chunk offsets. outOverflow is set
+// if a 32 bit offset no longer fits, when largeOffsets is false.
+static bool CopyMoovBoxes( const UByte * data, const int size, const MoovShift & shift, const bool largeOffsets,
+		Array< UByte > & out, bool & outOverflow )
+{
+	for ( int offset = 0; offset < size; )
+	{
+		if ( size - offset < 8 )
+		{
+			return false;
+		}
+		SInt64 boxSize = ReadBE32( data + offset );
+		const UInt32 type = ReadBE32( data + offset + 4 );
+		int headerSize = 8;
+		if ( boxSize == 1 )
+		{
+			if ( size - offset < 16 )
+			{
+				return false;
+			}
+			boxSize = static_cast< SInt64 >( ReadBE64( data + offset + 8 ) );
+			headerSize = 16;
+		}
+		else if ( boxSize == 0 )
+		{
+			boxSize = size - offset;
+		}
+		if ( boxSize < headerSize || boxSize > size - offset )
+		{
+			return false;
+		}
+		const UByte * body = data + offset + headerSize;
+		const int bodySize = static_cast< int >( boxSize ) - headerSize;
+
+		if ( IsMoovContainer( type ) )
+		{
+			const int start = out.GetSizeI();
+			AppendBE32( out, 0 );
+			AppendBE32( out, type );
+			if ( !CopyMoovBoxes( body, bodySize, shift, largeOffsets, out, outOverflow ) )
+			{
+				return false;
+			}
+			WriteBE32( &out[start], static_cast< UInt32 >( out.GetSizeI() - start ) );
+		}
+		else if ( type == MP4_FOURCC( 's', 't', 'c', 'o' ) || type == MP4_FOURCC( 'c', 'o', '6', '4' ) )
+		{
+			const bool sourceLarge = ( type == MP4_FOURCC( 'c', 'o', '6', '4' ) );
+			const int entrySize = sourceLarge ? 8 : 4;
+			if ( bodySize < 8 )
+			{
+				return false;
+			}
+			const int count = static_cast< int >( ReadBE32( body + 4 ) );
+			if ( count < 0 || count > ( bodySize - 8 ) / entrySize )
+			{
+				return false;
+			}
+			const bool writeLarge = sourceLarge || largeOffsets;
+			const int start = out.GetSizeI();
+			AppendBE32( out, 0 );
+			AppendBE32( out, writeLarge ? MP4_FOURCC( 'c', 'o', '6', '4' ) : MP4_FOURCC( 's', 't', 'c', 'o' ) );
+			AppendBE32( out, ReadBE32( body ) & 0x00FFFFFF );	// version 0, same flags
+			AppendBE32( out, static_cast< UInt32 >( count ) );
+			for ( int i = 0; i < count; i++ )
+			{
+				const UByte * entry = body + 8 + i * entrySize;
+				const UInt64 moved = ShiftOffset( sourceLarge ? ReadBE64( entry ) : ReadBE32( entry ), shift );
+				if ( writeLarge )
+				{
+					AppendBE64( out, moved );
+				}
+				else
+				{
+					outOverflow = outOverflow || moved > 0xFFFFFFFFull;
+					AppendBE32( out, static_cast< UInt32 >( moved ) );
+				}
+			}
+			WriteBE32( &out[start], static_cast< UInt32 >( out.GetSizeI() - start ) );
+		}
+		else
+		{
+			const int at = out.GetSizeI();
+			out.Resize( at + static_cast< int >( boxSize ) );
+			memcpy( &out[at], data + offset, static_cast< size_t >( boxSize ) );
+		}
+		offset += static_cast< int >( boxSize );
+	}
+	return true;
+}
+
+bool BuildFaststartMoov( const UByte * moov, const int moovSize, const SInt64 insertOffset,
+		const SInt64 moovEnd, Array< UByte > & outMoov )
+{
+	// The size of the result doesn't depend on the offsets written into it, so
+	// one pass finds the size and a second writes the offsets for that size,
+	// twice over if the tables have to be widened.
+	MoovShift shift;
+	shift.InsertOffset = insertOffset;
+	shift.MoovEnd = moovEnd;
+	shift.OldSize = moovSize;
+	shift.NewSize = 0;
+	bool largeOffsets = false;
+	for ( int pass = 0; pass < 4; pass++ )
+	{
+		bool overflow = false;
+		outMoov.Clear();
+		if ( !CopyMoovBoxes( moov, moovSize, shift, largeOffsets, outMoov, overflow ) )
+		{
+			return false;
+		}
+		if ( overflow && !largeOffsets )
+		{
+			// every table goes to 64 bits, then the size changes once more
+			largeOffsets = true;
+			shift.NewSize = 0;
+			continue;
+		}
+		if ( shift.NewSize == outMoov.GetSizeI() )
+		{
+			return true;
+		}
+		shift.NewSize = outMoov.GetSizeI();
+	}
+	return false;
+}
+
+//==============================================================
+// FaststartTask
+
+FaststartTask::FaststartTask()
+	: Running( false )
+	, Exiting( false )
+	, Paused( false )
+	, Interrupt( false )
+{
+	pthread_mutex_init( &Mutex, NULL );
+	pthread_cond_init( &Wake, NULL );
+}
+
+FaststartTask::~FaststartTask()
+{
+	Stop();
+	pthread_cond_destroy( &Wake );
+	pthread_mutex_destroy( &Mutex );
+}
+
+void FaststartTask::Start( const Array< String > & paths )
+{
+	Stop();
+
+	Queue.Clear();
+	for ( int i = 0; i < paths.GetSizeI(); i++ )
+	{
+		if ( paths[i].ToCStr()[0] == '/' && IsMp4Extension( paths[i].ToCStr() ) )
+		{
+			Queue.PushBack( paths[i] );
+		}
+	}
+	if ( Queue.GetSizeI() == 0 )
+	{
+		return;
+	}
+	Exiting = false;
+	Interrupt = Paused;
+	if ( pthread_create( &Thread, NULL, ThreadFunction, this ) != 0 )
+	{
+		LOG( "FaststartTask: pthread_create failed" );
+		return;
+	}
+	Running = true;
+}
+
+void FaststartTask::Stop()
+{
+	if ( !Running )
+	{
+		return;
+	}
+	pthread_mutex_lock( &Mutex );
+	Exiting = true;
+	Interrupt = true;
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+	pthread_join( Thread, NULL );
+	Running = false;
+}
+
+void FaststartTask::SetPaused( const bool paused )
+{
+	pthread_mutex_lock( &Mutex );
+	Paused = paused;
+	Interrupt = paused || Exiting;
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+}
+
+void * FaststartTask::ThreadFunction( void * param )
+{
+	pthread_setname_np( pthread_self(), "Faststart" );
+	static_cast< FaststartTask * >( param )->Run();
+	return NULL;
+}
+
+void FaststartTask::Run()
+{
+	int rewritten = 0;
+	while ( Queue.GetSizeI() > 0 )
+	{
+		pthread_mutex_lock( &Mutex );
+		while ( Paused && !Exiting )
+		{
+			pthread_cond_wait( &Wake, &Mutex );
+		}
+		const bool exiting = Exiting;
+		pthread_mutex_unlock( &Mutex );
+		if ( exiting )
+		{
+			break;
+		}
+
+		SInt64 bytes = 0;
+		const double start = GetSeconds();
+		const eFaststartResult result = RemuxFile( Queue[0].ToCStr(), &Interrupt, &Mutex, bytes );
+		const double seconds = GetSeconds() - start;
+		if ( bytes > 0 )
+		{
+			LOG( "Faststart: '%s' %s, %.1f MB in %.1f s, %.1f MB/s", Queue[0].ToCStr(),
+				( result == FASTSTART_DONE ) ? "rewritten" : "interrupted",
+				bytes / ( 1024.0 * 1024.0 ), seconds, bytes / ( 1024.0 * 1024.0 ) / Alg::Max( seconds, 1e-3 ) );
+		}
+		if ( result == FASTSTART_INTERRUPTED )
+		{
+			continue;	// same file again once resumed
+		}
+		rewritten += ( result == FASTSTART_DONE ) ? 1 : 0;
+		Queue.RemoveAt( 0 );
+	}
+	LOG( "Faststart: %i files rewritten, %i left", rewritten, Queue.GetSizeI() );
+}
+
+bool FaststartTask::NeedsFaststart( const MediaFile & file )
+{
+	UByte magic[8];
+	if ( !file.Read( 0, magic, sizeof( magic ) ) || ReadBE32( magic + 4 ) != MP4_FOURCC( 'f', 't', 'y', 'p' ) )
+	{
+		return false;
+	}
+	bool sawMdat = false;
+	Mp4Box box;
+	for ( SInt64 offset = 0; Mp4ReadBox( file, offset, file.GetSize(), box ); offset = box.End )
+	{
+		if ( box.Type == MP4_FOURCC( 'm', 'o', 'o', 'f' ) )
+		{
+			return false;	// fragmented, moov is small and first already
+		}
+		if ( box.Type == MP4_FOURCC( 'm', 'd', 'a', 't' ) )
+		{
+			sawMdat = true;
+		}
+		if ( box.Type == MP4_FOURCC( 'm', 'o', 'o', 'v' ) )
+		{
+			return sawMdat;
+		}
+	}
+	return false;
+}
+
+eFaststartResult FaststartTask::RemuxFile( const char * path, const volatile bool * interrupt,
+		pthread_mutex_t * commitMutex, SInt64 & outBytesCopied )
+{
+	outBytesCopied = 0;
+
+	MediaFile source;
+	if ( !source.Open( path ) || !NeedsFaststart( source ) )
+	{
+		return FASTSTART_NOT_NEEDED;
+	}
+
+	// moov moves to the first mdat, everything else keeps its order
+	Mp4Box box;
+	Mp4Box moov;
+	SInt64 insertOffset = -1;
+	for ( SInt64 offset = 0; Mp4ReadBox( source, offset, source.GetSize(), box ); offset = box.End )
+	{
+		if ( box.Type == MP4_FOURCC( 'm', 'd', 'a', 't' ) && insertOffset < 0 )
+		{
+			insertOffset = box.Offset;
+		}
+		if ( box.Type == MP4_FOURCC( 'm', 'o', 'o', 'v' ) )
+		{
+			moov = box;
+			break;
+		}
+	}
+	const SInt64 moovSize = moov.End - moov.Offset;
+	if ( insertOffset < 0 || moovSize > MAX_MOOV_BYTES )
+	{
+		return FASTSTART_NOT_NEEDED;
+	}
+	Array< UByte > oldMoov;
+	Array< UByte > newMoov;
+	if ( !source.ReadArray( moov.Offset, static_cast< int >( moovSize ), oldMoov ) ||
+		!BuildFaststartMoov( oldMoov.GetDataPtr(), oldMoov.GetSizeI(), insertOffset, moov.End, newMoov ) )
+	{
+		LOG( "Faststart: can't rebuild moov of '%s'", path );
+		return FASTSTART_FAILED;
+	}
+	oldMoov.Clear();
+
+	const SInt64 newMoovSize = newMoov.GetSizeI();
+	const SInt64 headerSize = insertOffset + newMoovSize;
+	const SInt64 totalSize = source.GetSize() - moovSize + newMoovSize;
+
+	const String partialPath = String( path ) + PARTIAL_SUFFIX;
+	const int fd = open( partialPath.ToCStr(), O_RDWR | O_CREAT, 0644 );
+	if ( fd < 0 )
+	{
+		LOG( "Faststart: can't create '%s': %s", partialPath.ToCStr(), strerror( errno ) );
+		return FASTSTART_FAILED;
+	}
+
+	// Continue a partial file only if its header is what this source produces now.
+	Array< UByte > buffer;
+	Array< UByte > expected;
+	buffer.Resize( COPY_BLOCK_BYTES );
+	expected.Resize( COPY_BLOCK_BYTES );
+	SInt64 resumeOffset = 0;
+	struct stat partialStat;
+	if ( fstat( fd, &partialStat ) == 0 && partialStat.st_size >= headerSize && partialStat.st_size <= totalSize )
+	{
+		resumeOffset = partialStat.st_size;
+		for ( SInt64 at = 0; at < headerSize && resumeOffset > 0; at += COPY_BLOCK_BYTES )
+		{
+			const int count = static_cast< int >( Alg::Min( headerSize - at, static_cast< SInt64 >( COPY_BLOCK_BYTES ) ) );
+			const int fromSource = static_cast< int >( Alg::Max( Alg::Min( insertOffset - at, static_cast< SInt64 >( count ) ), static_cast< SInt64 >( 0 ) ) );
+			if ( pread( fd, buffer.GetDataPtr(), count, at ) != count ||
+				( fromSource > 0 && !source.Read( at, expected.GetDataPtr(), fromSource ) ) )
+			{
+				resumeOffset = 0;
+				break;
+			}
+			if ( count > fromSource )
+			{
+				memcpy( &expected[fromSource], &newMoov[static_cast< int >( at + fromSource - insertOffset )], count - fromSource );
+			}
+			if ( memcmp( buffer.GetDataPtr(), expected.GetDataPtr(), count ) != 0 )
+			{
+				resumeOffset = 0;
+			}
+		}
+	}
+	if ( resumeOffset > 0 )
+	{
+		LOG( "Faststart: resuming '%s' at %.1f of %.1f MB", path, resumeOffset / ( 1024.0 * 1024.0 ), totalSize / ( 1024.0 * 1024.0 ) );
+	}
+	else
+	{
+		struct statfs fs;
+		if ( statfs( partialPath.ToCStr(), &fs ) == 0 &&
+			static_cast< SInt64 >( fs.f_bavail ) * fs.f_bsize < totalSize + FREE_SPACE_MARGIN )
+		{
+			LOG( "Faststart: not enough space to rewrite '%s'", path );
+			close( fd );
+			unlink( partialPath.ToCStr() );
+			return FASTSTART_FAILED;
+		}
+		if ( ftruncate( fd, 0 ) != 0 || !WriteFully( fd, insertOffset, newMoov.GetDataPtr(), newMoov.GetSizeI() ) )
+		{
+			close( fd );
+			return FASTSTART_FAILED;
+		}
+		// the leading boxes, usually just ftyp
+		for ( SInt64 at = 0; at < insertOffset; at += COPY_BLOCK_BYTES )
+		{
+			const int count = static_cast< int >( Alg::Min( insertOffset - at, static_cast< SInt64 >( COPY_BLOCK_BYTES ) ) );
+			if ( !source.Read( at, buffer.GetDataPtr(), count ) || !WriteFully( fd, at, buffer.GetDataPtr(), count ) )
+			{
+				close( fd );
+				return FASTSTART_FAILED;
+			}
+		}
+		resumeOffset = headerSize;
+	}
+	newMoov.Clear();
+
+	// Everything after the header is a straight copy, source offsets before
+	// moov move up by the new moov, those after it by the growth.
+	for ( SInt64 at = resumeOffset; at < totalSize; )
+	{
+		if ( interrupt != NULL && *interrupt )
+		{
+			fdatasync( fd );
+			close( fd );
+			return FASTSTART_INTERRUPTED;
+		}
+		const SInt64 moovOutOffset = moov.Offset + newMoovSize;	// where the source's moov gap lands
+		const SInt64 sourceOffset = ( at < moovOutOffset ) ? at - newMoovSize : at - newMoovSize + moovSize;
+		const SInt64 runEnd = ( at < moovOutOffset ) ? moovOutOffset : totalSize;
+		const int count = static_cast< int >( Alg::Min( runEnd - at, static_cast< SInt64 >( COPY_BLOCK_BYTES ) ) );
+		if ( !source.Read( sourceOffset, buffer.GetDataPtr(), count ) || !WriteFully( fd, at, buffer.GetDataPtr(), count ) )
+		{
+			LOG( "Faststart: copy failed for '%s': %s", path, strerror( errno ) );
+			close( fd );
+			return FASTSTART_FAILED;
+		}
+		at += count;
+		outBytesCopied += count;
+	}
+
+	const bool synced = fdatasync( fd ) == 0;
+	close( fd );
+
+	// the rewritten file has to parse with moov first before it replaces anything
+	MediaFile check;
+	Mp4Box checkMoov;
+	if ( !synced || !check.Open( partialPath.ToCStr() ) || check.GetSize() != totalSize ||
+		!Mp4FindTopLevel( check, MP4_FOURCC( 'm', 'o', 'o', 'v' ), checkMoov ) || checkMoov.Offset != insertOffset )
+	{
+		LOG( "Faststart: '%s' did not verify", partialPath.ToCStr() );
+		unlink( partialPath.ToCStr() );
+		return FASTSTART_FAILED;
+	}
+	check.Close();
+
+	// keep the original dates, the browser may sort by them
+	struct stat sourceStat;
+	if ( stat( path, &sourceStat ) == 0 )
+	{
+		struct timeval times[2];
+		times[0].tv_sec = sourceStat.st_atime;
+		times[0].tv_usec = 0;
+		times[1].tv_sec = sourceStat.st_mtime;
+		times[1].tv_usec = 0;
+		utimes( partialPath.ToCStr(), times );
+	}
+
+	// Nothing is replaced after a pause; the player may be about to open the file.
+	pthread_mutex_lock( commitMutex );
+	const bool interrupted = interrupt != NULL && *interrupt;
+	const bool renamed = !interrupted && rename( partialPath.ToCStr(), path ) == 0;
+	pthread_mutex_unlock( commitMutex );
+	if ( interrupted )
+	{
+		return FASTSTART_INTERRUPTED;
+	}
+	if ( !renamed )
+	{
+		LOG( "Faststart: rename to '%s' failed: %s", path, strerror( errno ) );
+		unlink( partialPath.ToCStr() );
+		return FASTSTART_FAILED;
+	}
+	return FASTSTART_DONE;
+}
+
+}
@@ -0,0 +1,92 @@
+/************************************************************************************
+
+Filename    :   Faststart.h
+Content     :   Background rewrite of local MP4s so the moov box comes first
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_Faststart_h )
+#define OVR_Faststart_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+class MediaFile;
+
+enum eFaststartResult
+{
+	FASTSTART_DONE,
+	FASTSTART_NOT_NEEDED,		// moov already first, or not an MP4 we can rewrite
+	FASTSTART_INTERRUPTED,		// the partial output is kept and picked up next time
+	FASTSTART_FAILED
+};
+
+// Rebuilds moov to sit in front of the media data: chunk offsets of data
+// before moov move up by the new moov size, data after it by the growth.
+// stco tables that would overflow become co64. Returns false if the box
+// tree is malformed.
+bool	BuildFaststartMoov( const UByte * moov, const int moovSize, const SInt64 insertOffset,
+			const SInt64 moovEnd, Array< UByte > & outMoov );
+
+//==============================================================
+// FaststartTask
+//
+// Camera exports often write moov after mdat, which makes the player read
+// the tail of a multi-GB file before it can start. This rewrites those
+// files one at a time on a background thread, into name.faststart next to
+// the original, then renames it over the original.
+//
+// Copying runs in fixed size blocks and stops at the next block whenever
+// the task is paused or stopped. The partial file stays on the card, and
+// is continued from where it ended if its header still matches the source.
+class FaststartTask
+{
+public:
+						FaststartTask();
+						~FaststartTask();
+
+	// Queues the MP4 family files among paths, checking each is done on the thread.
+	void				Start( const Array< String > & paths );
+	void				Stop();
+
+	// Paused while a video plays, so the copy doesn't compete with the player
+	// for the card. No file is replaced once SetPaused( true ) returns.
+	void				SetPaused( const bool paused );
+
+	// Cheap check of the top level boxes.
+	static bool			NeedsFaststart( const MediaFile & file );
+
+	// One file, on the calling thread. interrupt is polled between blocks.
+	static eFaststartResult	RemuxFile( const char * path, const volatile bool * interrupt,
+								pthread_mutex_t * commitMutex, SInt64 & outBytesCopied );
+
+private:
+	pthread_t			Thread;
+	bool				Running;
+	pthread_mutex_t		Mutex;
+	pthread_cond_t		Wake;
+	volatile bool		Exiting;
+	volatile bool		Paused;
+	volatile bool		Interrupt;		// Exiting or Paused, as one flag for RemuxFile
+	Array< String >		Queue;
+
+	static void *		ThreadFunction( void * param );
+	void				Run();
+};
+
+}
+
+#endif // OVR_Faststart_h
@@ -0,0 +1,197 @@
+/************************************************************************************
+
+Filename    :   HlsPlaylist.cpp
+Content     :   HTTP Live Streaming master and media playlist parsing
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "HlsPlaylist.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "HttpClient.h"
+
+namespace OVR {
+
+static bool StartsWith( const String & line, const char * prefix )
+{
+	return strncmp( line.ToCStr(), prefix, strlen( prefix ) ) == 0;
+}
+
+// Value of NAME=value in an attribute list, with quoted values kept whole.
+static bool FindAttribute( const char * attributes, const char * name, String & outValue )
+{
+	const int nameLength = static_cast< int >( strlen( name ) );
+	const char * p = attributes;
+	while ( *p != 0 )
+	{
+		const char * equals = strchr( p, '=' );
+		if ( equals == NULL )
+		{
+			return false;
+		}
+		const bool match = ( equals - p == nameLength ) && strncmp( p, name, nameLength ) == 0;
+		const char * value = equals + 1;
+		const char * end = value;
+		if ( *value == '"' )
+		{
+			value++;
+			end = strchr( value, '"' );
+			if ( end == NULL )
+			{
+				return false;
+			}
+		}
+		else
+		{
+			end = value + strcspn( value, "," );
+		}
+		if ( match )
+		{
+			outValue = String( value, end - value );
+			return true;
+		}
+		p = end + ( *end == '"' ? 1 : 0 );
+		p += ( *p == ',' ) ? 1 : 0;
+	}
+	return false;
+}
+
+static bool VariantLess( const HlsVariant & a, const HlsVariant & b )
+{
+	return a.Bandwidth < b.Bandwidth;
+}
+
+bool HlsPlaylist::Parse( const char * text, const int length, const char * playlistUrl )
+{
+	Variants.Clear();
+	Segments.Clear();
+	TargetDuration = 0.0;
+	MediaSequence = 0;
+	EndList = false;
+	Plain = true;
+
+	HttpUrl base;
+	if ( !base.Parse( playlistUrl ) )
+	{
+		return false;
+	}
+
+	bool pendingVariant = false;
+	HlsVariant variant;
+	double segmentSeconds = -1.0;
+	bool first = true;
+	const char * end = text + length;
+	for ( const char * p = text; p < end; )
+	{
+		const char * lineEnd = p;
+		while ( lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r' )
+		{
+			lineEnd++;
+		}
+		const String line( p, lineEnd - p );
+		p = lineEnd;
+		while ( p < end && ( *p == '\n' || *p == '\r' ) )
+		{
+			p++;
+		}
+
+		if ( first )
+		{
+			if ( !StartsWith( line, "#EXTM3U" ) )
+			{
+				LOG( "HlsPlaylist: %s is not a playlist", playlistUrl );
+				return false;
+			}
+			first = false;
+			continue;
+		}
+		if ( line.IsEmpty() )
+		{
+			continue;
+		}
+
+		if ( StartsWith( line, "#EXT-X-STREAM-INF:" ) )
+		{
+			const char * attributes = line.ToCStr() + 18;
+			String value;
+			variant.Bandwidth = FindAttribute( attributes, "BANDWIDTH", value ) ? atoi( value.ToCStr() ) : 0;
+			variant.Width = 0;
+			variant.Height = 0;
+			if ( FindAttribute( attributes, "RESOLUTION", value ) )
+			{
+				variant.Width = atoi( value.ToCStr() );
+				const char * x = strchr( value.ToCStr(), 'x' );
+				variant.Height = ( x != NULL ) ? atoi( x + 1 ) : 0;
+			}
+			pendingVariant = true;
+		}
+		else if ( StartsWith( line, "#EXTINF:" ) )
+		{
+			segmentSeconds = atof( line.ToCStr() + 8 );
+		}
+		else if ( StartsWith( line, "#EXT-X-TARGETDURATION:" ) )
+		{
+			TargetDuration = atof( line.ToCStr() + 22 );
+		}
+		else if ( StartsWith( line, "#EXT-X-MEDIA-SEQUENCE:" ) )
+		{
+			MediaSequence = atoi( line.ToCStr() + 22 );
+		}
+		else if ( StartsWith( line, "#EXT-X-ENDLIST" ) )
+		{
+			EndList = true;
+		}
+		else if ( StartsWith( line, "#EXT-X-KEY:" ) || StartsWith( line, "#EXT-X-BYTERANGE:" ) || StartsWith( line, "#EXT-X-MAP:" ) )
+		{
+			Plain = Plain && strstr( line.ToCStr(), "METHOD=NONE" ) != NULL;
+		}
+		else if ( line.ToCStr()[0] != '#' )
+		{
+			const String url = base.Resolve( line.ToCStr() );
+			if ( pendingVariant )
+			{
+				variant.Url = url;
+				Variants.PushBack( variant );
+				pendingVariant = false;
+			}
+			else if ( segmentSeconds >= 0.0 )
+			{
+				HlsSegment segment;
+				segment.Seconds = segmentSeconds;
+				segment.Url = url;
+				Segments.PushBack( segment );
+				segmentSeconds = -1.0;
+			}
+		}
+	}
+
+	if ( Variants.GetSizeI() > 1 )
+	{
+		Alg::QuickSort( Variants, VariantLess );
+	}
+	return !first;
+}
+
+double HlsPlaylist::GetDuration() const
+{
+	double seconds = 0.0;
+	for ( int i = 0; i < Segments.GetSizeI(); i++ )
+	{
+		seconds += Segments[i].Seconds;
+	}
+	return seconds;
+}
+
+}
@@ -0,0 +1,66 @@
+/************************************************************************************
+
+Filename    :   HlsPlaylist.h
+Content     :   HTTP Live Streaming master and media playlist parsing
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HlsPlaylist_h )
+#define OVR_HlsPlaylist_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+struct HlsVariant
+{
+	int		Bandwidth;		// bits per second
+	int		Width;
+	int		Height;
+	String	Url;			// already resolved against the playlist url
+};
+
+struct HlsSegment
+{
+	double	Seconds;
+	String	Url;
+};
+
+//==============================================================
+// HlsPlaylist
+//
+// A master playlist fills Variants, a media playlist Segments. Alternate
+// renditions, I-frame playlists and session data are skipped.
+class HlsPlaylist
+{
+public:
+							HlsPlaylist() : TargetDuration( 0.0 ), MediaSequence( 0 ), EndList( false ), Plain( true ) {}
+
+	bool					Parse( const char * text, const int length, const char * playlistUrl );
+
+	bool					IsMaster() const	{ return Variants.GetSizeI() > 0; }
+	double					GetDuration() const;
+
+	Array< HlsVariant >		Variants;			// sorted by ascending bandwidth
+	Array< HlsSegment >		Segments;
+	double					TargetDuration;
+	int						MediaSequence;
+	bool					EndList;			// false for a live playlist
+	// No keys, byte ranges or init sections, so each segment stands alone
+	// and can be served from whichever variant.
+	bool					Plain;
+};
+
+}
+
+#endif // OVR_HlsPlaylist_h
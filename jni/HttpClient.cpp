@@ -0,0 +1,662 @@
+/************************************************************************************
+
+Filename    :   HttpClient.cpp
+Content     :   Blocking HTTP/1.1 client with keep-alive connections
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "HttpClient.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+static const int	DEFAULT_TIMEOUT_MS = 10000;
+static const int	MAX_REDIRECTS = 4;
+
+//==============================
+// HttpUrl
+bool HttpUrl::Parse( const char * url )
+{
+	static const char scheme[] = "http://";
+	if ( strncasecmp( url, scheme, sizeof( scheme ) - 1 ) != 0 )
+	{
+		return false;
+	}
+	const char * hostStart = url + sizeof( scheme ) - 1;
+	const char * hostEnd = hostStart;
+	while ( *hostEnd != '\0' && *hostEnd != '/' && *hostEnd != ':' && *hostEnd != '?' )
+	{
+		hostEnd++;
+	}
+	if ( hostEnd == hostStart )
+	{
+		return false;
+	}
+	Host = String( hostStart, hostEnd - hostStart );
+	Port = 80;
+
+	const char * p = hostEnd;
+	if ( *p == ':' )
+	{
+		Port = atoi( p + 1 );
+		while ( *p != '\0' && *p != '/' && *p != '?' )
+		{
+			p++;
+		}
+	}
+	Path = ( *p == '/' ) ? String( p ) : String( "/" ) + p;
+	return Port > 0;
+}
+
+String HttpUrl::Resolve( const char * reference ) const
+{
+	if ( strncasecmp( reference, "http://", 7 ) == 0 || strncasecmp( reference, "https://", 8 ) == 0 )
+	{
+		return String( reference );
+	}
+
+	char base[64];
+	snprintf( base, sizeof( base ), ":%i", Port );
+	String result = String( "http://" ) + Host + base;
+	if ( reference[0] == '/' )
+	{
+		return result + reference;
+	}
+
+	// strip the query and the last path component
+	const char * path = Path.ToCStr();
+	const char * query = strchr( path, '?' );
+	const char * end = ( query != NULL ) ? query : path + Path.GetSize();
+	while ( end > path && end[-1] != '/' )
+	{
+		end--;
+	}
+	result += String( path, end - path );
+	return result + reference;
+}
+
+String HttpUrl::ToString() const
+{
+	char port[16];
+	snprintf( port, sizeof( port ), ":%i", Port );
+	return String( "http://" ) + Host + port + Path;
+}
+
+//==============================
+// HttpResponse
+void HttpResponse::Reset()
+{
+	StatusCode = 0;
+	ContentLength = -1;
+	RangeStart = -1;
+	RangeEnd = -1;
+	TotalLength = -1;
+	Chunked = false;
+	KeepAlive = true;
+	ContentType.Clear();
+	ETag.Clear();
+	Location.Clear();
+}
+
+//==============================
+// HttpConnection
+HttpConnection::HttpConnection()
+	: Socket( -1 )
+	, TimeoutMs( DEFAULT_TIMEOUT_MS )
+	, Port( 0 )
+	, BufferPos( 0 )
+	, BufferEnd( 0 )
+	, BodyRemaining( 0 )
+	, ChunkRemaining( 0 )
+	, BodyChunked( false )
+	, BodyUntilClose( false )
+	, BodyDone( true )
+	, CloseAfterBody( false )
+{
+}
+
+HttpConnection::~HttpConnection()
+{
+	Close();
+}
+
+bool HttpConnection::IsOpenTo( const char * host, const int port ) const
+{
+	return Socket >= 0 && port == Port && strcasecmp( host, Host.ToCStr() ) == 0;
+}
+
+bool HttpConnection::Open( const char * host, const int port )
+{
+	if ( IsOpenTo( host, port ) )
+	{
+		return true;
+	}
+	Close();
+
+	struct addrinfo hints;
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	char portString[16];
+	snprintf( portString, sizeof( portString ), "%i", port );
+
+	struct addrinfo * addresses = NULL;
+	if ( getaddrinfo( host, portString, &hints, &addresses ) != 0 || addresses == NULL )
+	{
+		LOG( "HttpConnection: failed to resolve %s", host );
+		return false;
+	}
+
+	for ( struct addrinfo * a = addresses; a != NULL; a = a->ai_next )
+	{
+		const int s = socket( a->ai_family, a->ai_socktype, a->ai_protocol );
+		if ( s < 0 )
+		{
+			continue;
+		}
+
+		struct timeval tv;
+		tv.tv_sec = TimeoutMs / 1000;
+		tv.tv_usec = ( TimeoutMs % 1000 ) * 1000;
+		setsockopt( s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+		setsockopt( s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof( tv ) );
+		const int one = 1;
+		setsockopt( s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+
+		if ( connect( s, a->ai_addr, a->ai_addrlen ) == 0 )
+		{
+			Socket = s;
+			break;
+		}
+		close( s );
+	}
+	freeaddrinfo( addresses );
+
+	if ( Socket < 0 )
+	{
+		LOG( "HttpConnection: failed to connect to %s:%i", host, port );
+		return false;
+	}
+
+	Host = host;
+	Port = port;
+	BufferPos = BufferEnd = 0;
+	BodyDone = true;
+	return true;
+}
+
+void HttpConnection::Close()
+{
+	if ( Socket >= 0 )
+	{
+		close( Socket );
+		Socket = -1;
+	}
+	BufferPos = BufferEnd = 0;
+	BodyDone = true;
+}
+
+bool HttpConnection::WriteAll( const void * data, const int length )
+{
+	const UByte * p = static_cast< const UByte * >( data );
+	int remaining = length;
+	while ( remaining > 0 )
+	{
+		const ssize_t n = send( Socket, p, remaining, MSG_NOSIGNAL );
+		if ( n < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if ( n <= 0 )
+		{
+			return false;
+		}
+		p += n;
+		remaining -= n;
+	}
+	return true;
+}
+
+bool HttpConnection::SendRequest( const char * method, const HttpUrl & url,
+		const char * extraHeaders, const void * body, const int bodyLength )
+{
+	if ( !Open( url.Host.ToCStr(), url.Port ) )
+	{
+		return false;
+	}
+
+	String request = String( method ) + " " + url.Path + " HTTP/1.1\r\nHost: " + url.Host;
+	if ( url.Port != 80 )
+	{
+		char port[16];
+		snprintf( port, sizeof( port ), ":%i", url.Port );
+		request += port;
+	}
+	request += "\r\nUser-Agent: Oculus360Videos\r\nConnection: keep-alive\r\n";
+	if ( extraHeaders != NULL )
+	{
+		request += extraHeaders;
+	}
+	if ( body != NULL || strcmp( method, "POST" ) == 0 || strcmp( method, "PUT" ) == 0 )
+	{
+		char length[64];
+		snprintf( length, sizeof( length ), "Content-Length: %i\r\n", bodyLength );
+		request += length;
+	}
+	request += "\r\n";
+
+	if ( !WriteAll( request.ToCStr(), static_cast< int >( request.GetSize() ) ) ||
+		( body != NULL && bodyLength > 0 && !WriteAll( body, bodyLength ) ) )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool HttpConnection::Fill()
+{
+	if ( BufferPos < BufferEnd )
+	{
+		return true;
+	}
+	BufferPos = BufferEnd = 0;
+	for ( ;; )
+	{
+		const ssize_t n = recv( Socket, Buffer, sizeof( Buffer ), 0 );
+		if ( n < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if ( n <= 0 )
+		{
+			return false;
+		}
+		BufferEnd = static_cast< int >( n );
+		return true;
+	}
+}
+
+bool HttpConnection::ReadLine( String & outLine )
+{
+	outLine.Clear();
+	for ( ;; )
+	{
+		if ( !Fill() )
+		{
+			return false;
+		}
+		const UByte * start = Buffer + BufferPos;
+		const UByte * newline = static_cast< const UByte * >( memchr( start, '\n', BufferEnd - BufferPos ) );
+		if ( newline == NULL )
+		{
+			outLine.AppendString( reinterpret_cast< const char * >( start ), BufferEnd - BufferPos );
+			BufferPos = BufferEnd;
+			if ( outLine.GetSize() > 8192 )
+			{
+				return false;
+			}
+			continue;
+		}
+		int len = static_cast< int >( newline - start );
+		BufferPos += len + 1;
+		if ( len > 0 && start[len - 1] == '\r' )
+		{
+			len--;
+		}
+		outLine.AppendString( reinterpret_cast< const char * >( start ), len );
+		return true;
+	}
+}
+
+int HttpConnection::ReadRaw( void * buffer, const int maxBytes )
+{
+	if ( !Fill() )
+	{
+		return -1;
+	}
+	const int n = Alg::Min( maxBytes, BufferEnd - BufferPos );
+	memcpy( buffer, Buffer + BufferPos, n );
+	BufferPos += n;
+	return n;
+}
+
+static bool HeaderIs( const char * line, const char * name, const char ** outValue )
+{
+	const size_t len = strlen( name );
+	if ( strncasecmp( line, name, len ) != 0 || line[len] != ':' )
+	{
+		return false;
+	}
+	const char * v = line + len + 1;
+	while ( *v == ' ' || *v == '\t' )
+	{
+		v++;
+	}
+	*outValue = v;
+	return true;
+}
+
+bool HttpConnection::ReadResponseHeader( HttpResponse & response )
+{
+	response.Reset();
+	if ( Socket < 0 )
+	{
+		return false;
+	}
+
+	String line;
+	do
+	{
+		if ( !ReadLine( line ) )
+		{
+			Close();
+			return false;
+		}
+		if ( sscanf( line.ToCStr(), "HTTP/%*d.%*d %d", &response.StatusCode ) != 1 )
+		{
+			LOG( "HttpConnection: bad status line '%s'", line.ToCStr() );
+			Close();
+			return false;
+		}
+		const bool http10 = strncmp( line.ToCStr(), "HTTP/1.0", 8 ) == 0;
+		response.KeepAlive = !http10;
+
+		for ( ;; )
+		{
+			if ( !ReadLine( line ) )
+			{
+				Close();
+				return false;
+			}
+			if ( line.IsEmpty() )
+			{
+				break;
+			}
+			const char * value = NULL;
+			if ( HeaderIs( line.ToCStr(), "Content-Length", &value ) )
+			{
+				response.ContentLength = strtoll( value, NULL, 10 );
+			}
+			else if ( HeaderIs( line.ToCStr(), "Content-Range", &value ) )
+			{
+				long long start = -1, end = -1, total = -1;
+				if ( sscanf( value, "bytes %lld-%lld/%lld", &start, &end, &total ) >= 2 )
+				{
+					response.RangeStart = start;
+					response.RangeEnd = end;
+					response.TotalLength = total;
+				}
+				else if ( sscanf( value, "bytes */%lld", &total ) == 1 )
+				{
+					response.TotalLength = total;
+				}
+			}
+			else if ( HeaderIs( line.ToCStr(), "Transfer-Encoding", &value ) )
+			{
+				response.Chunked = strstr( value, "chunked" ) != NULL;
+			}
+			else if ( HeaderIs( line.ToCStr(), "Connection", &value ) )
+			{
+				if ( strncasecmp( value, "close", 5 ) == 0 )
+				{
+					response.KeepAlive = false;
+				}
+				else if ( strncasecmp( value, "keep-alive", 10 ) == 0 )
+				{
+					response.KeepAlive = true;
+				}
+			}
+			else if ( HeaderIs( line.ToCStr(), "Content-Type", &value ) )
+			{
+				response.ContentType = value;
+			}
+			else if ( HeaderIs( line.ToCStr(), "ETag", &value ) )
+			{
+				response.ETag = value;
+			}
+			else if ( HeaderIs( line.ToCStr(), "Location", &value ) )
+			{
+				response.Location = value;
+			}
+		}
+	// skip interim 1xx responses
+	} while ( response.StatusCode >= 100 && response.StatusCode < 200 );
+
+	if ( response.TotalLength < 0 && response.ContentLength >= 0 && response.StatusCode == 200 )
+	{
+		response.TotalLength = response.ContentLength;
+	}
+
+	BodyChunked = response.Chunked;
+	BodyRemaining = BodyChunked ? -1 : response.ContentLength;
+	ChunkRemaining = 0;
+	BodyUntilClose = !BodyChunked && response.ContentLength < 0 &&
+		response.StatusCode != 204 && response.StatusCode != 304;
+	BodyDone = !BodyChunked && !BodyUntilClose && BodyRemaining <= 0;
+	CloseAfterBody = !response.KeepAlive || BodyUntilClose;
+	if ( BodyDone && CloseAfterBody )
+	{
+		Close();
+	}
+	return true;
+}
+
+int HttpConnection::ReadBody( void * buffer, const int maxBytes )
+{
+	if ( BodyDone )
+	{
+		return 0;
+	}
+
+	int n = -1;
+	if ( BodyChunked )
+	{
+		if ( ChunkRemaining == 0 )
+		{
+			String line;
+			if ( !ReadLine( line ) )
+			{
+				Close();
+				return -1;
+			}
+			if ( line.IsEmpty() && !ReadLine( line ) )	// CRLF that ends the previous chunk
+			{
+				Close();
+				return -1;
+			}
+			ChunkRemaining = strtoll( line.ToCStr(), NULL, 16 );
+			if ( ChunkRemaining == 0 )
+			{
+				// consume trailers
+				do
+				{
+					if ( !ReadLine( line ) )
+					{
+						Close();
+						return -1;
+					}
+				} while ( !line.IsEmpty() );
+				BodyDone = true;
+				if ( CloseAfterBody )
+				{
+					Close();
+				}
+				return 0;
+			}
+		}
+		n = ReadRaw( buffer, static_cast< int >( Alg::Min< SInt64 >( maxBytes, ChunkRemaining ) ) );
+		if ( n > 0 )
+		{
+			ChunkRemaining -= n;
+		}
+	}
+	else if ( BodyUntilClose )
+	{
+		n = ReadRaw( buffer, maxBytes );
+		if ( n < 0 )
+		{
+			BodyDone = true;
+			Close();
+			return 0;
+		}
+	}
+	else
+	{
+		n = ReadRaw( buffer, static_cast< int >( Alg::Min< SInt64 >( maxBytes, BodyRemaining ) ) );
+		if ( n > 0 )
+		{
+			BodyRemaining -= n;
+			if ( BodyRemaining == 0 )
+			{
+				BodyDone = true;
+				if ( CloseAfterBody )
+				{
+					Close();
+				}
+			}
+		}
+	}
+
+	if ( n <= 0 )
+	{
+		Close();
+		return -1;
+	}
+	return n;
+}
+
+bool HttpConnection::ReadBodyToArray( Array< UByte > & outBody, const SInt64 maxBytes )
+{
+	outBody.Clear();
+	if ( BodyRemaining > 0 )
+	{
+		outBody.Reserve( static_cast< UPInt >( Alg::Min( BodyRemaining, maxBytes ) ) );
+	}
+	UByte chunk[16 * 1024];
+	for ( ;; )
+	{
+		const int n = ReadBody( chunk, sizeof( chunk ) );
+		if ( n == 0 )
+		{
+			return true;
+		}
+		if ( n < 0 || static_cast< SInt64 >( outBody.GetSize() ) + n > maxBytes )
+		{
+			Close();
+			return false;
+		}
+		outBody.Append( chunk, n );
+	}
+}
+
+bool HttpConnection::DiscardBody()
+{
+	UByte chunk[4096];
+	for ( ;; )
+	{
+		const int n = ReadBody( chunk, sizeof( chunk ) );
+		if ( n == 0 )
+		{
+			return true;
+		}
+		if ( n < 0 )
+		{
+			return false;
+		}
+	}
+}
+
+//==============================
+// HttpFetch
+bool HttpFetch( HttpConnection & connection, const char * url, const SInt64 rangeStart, const SInt64 rangeEnd,
+		Array< UByte > & outBody, HttpResponse * outResponse )
+{
+	static const SInt64 MAX_FETCH_BYTES = 256 * 1024 * 1024;
+
+	HttpResponse response;
+	String location( url );
+	for ( int redirect = 0; redirect <= MAX_REDIRECTS; redirect++ )
+	{
+		HttpUrl parsed;
+		if ( !parsed.Parse( location.ToCStr() ) )
+		{
+			LOG( "HttpFetch: unsupported url %s", location.ToCStr() );
+			return false;
+		}
+
+		char rangeHeader[96] = { 0 };
+		if ( rangeStart >= 0 )
+		{
+			if ( rangeEnd >= rangeStart )
+			{
+				snprintf( rangeHeader, sizeof( rangeHeader ), "Range: bytes=%lld-%lld\r\n", ( long long )rangeStart, ( long long )rangeEnd );
+			}
+			else
+			{
+				snprintf( rangeHeader, sizeof( rangeHeader ), "Range: bytes=%lld-\r\n", ( long long )rangeStart );
+			}
+		}
+
+		// A kept-alive socket may have been dropped by the server, so retry once on a fresh one.
+		bool sent = false;
+		for ( int attempt = 0; attempt < 2 && !sent; attempt++ )
+		{
+			sent = connection.SendRequest( "GET", parsed, rangeHeader, NULL, 0 ) &&
+				connection.ReadResponseHeader( response );
+			if ( !sent )
+			{
+				connection.Close();
+			}
+		}
+		if ( !sent )
+		{
+			return false;
+		}
+
+		if ( response.StatusCode >= 300 && response.StatusCode < 400 && !response.Location.IsEmpty() )
+		{
+			connection.DiscardBody();
+			location = parsed.Resolve( response.Location.ToCStr() );
+			continue;
+		}
+		break;
+	}
+
+	if ( outResponse != NULL )
+	{
+		*outResponse = response;
+	}
+	if ( !response.IsSuccess() )
+	{
+		connection.DiscardBody();
+		return false;
+	}
+	return connection.ReadBodyToArray( outBody, MAX_FETCH_BYTES );
+}
+
+}
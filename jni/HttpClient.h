@@ -0,0 +1,129 @@
+/************************************************************************************
+
+Filename    :   HttpClient.h
+Content     :   Blocking HTTP/1.1 client with keep-alive connections
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HttpClient_h )
+#define OVR_HttpClient_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+//==============================================================
+// HttpUrl
+struct HttpUrl
+{
+	String	Host;
+	int		Port;
+	String	Path;		// includes the query string, always starts with '/'
+
+			HttpUrl() : Port( 80 ) {}
+
+	// Only plain http:// is supported.
+	bool	Parse( const char * url );
+
+	// Resolves a reference found in a manifest against this url.
+	String	Resolve( const char * reference ) const;
+
+	String	ToString() const;
+};
+
+//==============================================================
+// HttpResponse
+struct HttpResponse
+{
+	int		StatusCode;
+	SInt64	ContentLength;		// -1 when unknown
+	SInt64	RangeStart;			// from Content-Range, -1 when absent
+	SInt64	RangeEnd;
+	SInt64	TotalLength;		// full resource size from Content-Range, -1 when unknown
+	bool	Chunked;
+	bool	KeepAlive;
+	String	ContentType;
+	String	ETag;
+	String	Location;
+
+			HttpResponse() { Reset(); }
+
+	void	Reset();
+	bool	IsSuccess() const	{ return StatusCode >= 200 && StatusCode < 300; }
+};
+
+//==============================================================
+// HttpConnection
+//
+// One socket to one host. Requests may be pipelined by calling SendRequest
+// several times before reading the responses back in order.
+class HttpConnection
+{
+public:
+						HttpConnection();
+						~HttpConnection();
+
+	// Reuses the open socket when it already points at the same host.
+	bool				Open( const char * host, const int port );
+	void				Close();
+	bool				IsOpen() const			{ return Socket >= 0; }
+	bool				IsOpenTo( const char * host, const int port ) const;
+
+	void				SetTimeoutMs( const int timeoutMs )	{ TimeoutMs = timeoutMs; }
+
+	// extraHeaders is a block of complete "Name: value\r\n" lines, or NULL.
+	bool				SendRequest( const char * method, const HttpUrl & url,
+								const char * extraHeaders, const void * body, const int bodyLength );
+
+	bool				ReadResponseHeader( HttpResponse & response );
+
+	// Returns the number of bytes read, 0 at the end of the body, -1 on error.
+	int					ReadBody( void * buffer, const int maxBytes );
+	bool				ReadBodyToArray( Array< UByte > & outBody, const SInt64 maxBytes );
+	bool				DiscardBody();
+
+	// Bytes of the current body not yet returned, -1 when unknown.
+	SInt64				GetBodyRemaining() const	{ return BodyRemaining; }
+
+private:
+	int					Socket;
+	int					TimeoutMs;
+	String				Host;
+	int					Port;
+
+	UByte				Buffer[16 * 1024];
+	int					BufferPos;
+	int					BufferEnd;
+
+	SInt64				BodyRemaining;
+	SInt64				ChunkRemaining;
+	bool				BodyChunked;
+	bool				BodyUntilClose;
+	bool				BodyDone;
+	bool				CloseAfterBody;
+
+	bool				Fill();
+	bool				ReadLine( String & outLine );
+	int					ReadRaw( void * buffer, const int maxBytes );
+	bool				WriteAll( const void * data, const int length );
+};
+
+// Fetches [rangeStart, rangeEnd] inclusive, or the whole resource when rangeStart < 0.
+// Follows up to a few redirects. The connection is reused when it already
+// points at the right host.
+bool	HttpFetch( HttpConnection & connection, const char * url, const SInt64 rangeStart, const SInt64 rangeEnd,
+				Array< UByte > & outBody, HttpResponse * outResponse = NULL );
+
+}
+
+#endif // OVR_HttpClient_h
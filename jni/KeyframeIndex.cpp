@@ -0,0 +1,420 @@
+/************************************************************************************
+
+Filename    :   KeyframeIndex.cpp
+Content     :   Sync sample times of a video, read from the container index
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "KeyframeIndex.h"
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "MediaContainer.h"
+
+namespace OVR {
+
+// sample tables larger than this are not worth reading for seeking
+static const int MAX_TABLE_BYTES = 16 * 1024 * 1024;
+
+KeyframeIndex::KeyframeIndex()
+{
+}
+
+void KeyframeIndex::Clear()
+{
+	TimesMs.Clear();
+}
+
+void KeyframeIndex::Swap( KeyframeIndex & other )
+{
+	Alg::Swap( TimesMs, other.TimesMs );
+}
+
+bool KeyframeIndex::BuildFromFile( const char * path, const volatile bool * cancel )
+{
+	Clear();
+
+	MediaFile file;
+	if ( !file.Open( path ) )
+	{
+		return false;
+	}
+
+	UByte magic[8];
+	if ( !file.Read( 0, magic, sizeof( magic ) ) )
+	{
+		return false;
+	}
+	bool built = false;
+	if ( ReadBE32( magic ) == MKV_ID_EBML )
+	{
+		built = BuildFromMatroska( file, cancel );
+	}
+	else if ( ReadBE32( magic + 4 ) == MP4_FOURCC( 'f', 't', 'y', 'p' ) )
+	{
+		built = BuildFromMp4( file, cancel );
+	}
+	if ( !built )
+	{
+		Clear();
+	}
+	return built;
+}
+
+bool KeyframeIndex::BuildFromMp4( const MediaFile & file, const volatile bool * cancel )
+{
+	Mp4Box moov;
+	Mp4Box trak;
+	UInt32 timescale;
+	if ( !Mp4FindTopLevel( file, MP4_FOURCC( 'm', 'o', 'o', 'v' ), moov ) ||
+		!Mp4FindTrack( file, moov, MP4_FOURCC( 'v', 'i', 'd', 'e' ), trak ) ||
+		!Mp4ReadTrackTimescale( file, trak, timescale ) )
+	{
+		return false;
+	}
+
+	Mp4Box mdia;
+	Mp4Box minf;
+	Mp4Box stbl;
+	Mp4Box stts;
+	Mp4Box stss;
+	if ( !Mp4FindChild( file, trak, MP4_FOURCC( 'm', 'd', 'i', 'a' ), mdia ) ||
+		!Mp4FindChild( file, mdia, MP4_FOURCC( 'm', 'i', 'n', 'f' ), minf ) ||
+		!Mp4FindChild( file, minf, MP4_FOURCC( 's', 't', 'b', 'l' ), stbl ) ||
+		!Mp4FindChild( file, stbl, MP4_FOURCC( 's', 't', 't', 's' ), stts ) )
+	{
+		return false;
+	}
+	if ( !Mp4FindChild( file, stbl, MP4_FOURCC( 's', 't', 's', 's' ), stss ) )
+	{
+		// no sync sample table means every sample is a keyframe, nothing to snap to
+		LOG( "KeyframeIndex: every sample is a sync sample" );
+		return false;
+	}
+	if ( stts.GetDataSize() > MAX_TABLE_BYTES || stss.GetDataSize() > MAX_TABLE_BYTES )
+	{
+		return false;
+	}
+
+	Array< UByte > sttsData;
+	Array< UByte > stssData;
+	if ( !file.ReadArray( stts.DataOffset, static_cast< int >( stts.GetDataSize() ), sttsData ) ||
+		!file.ReadArray( stss.DataOffset, static_cast< int >( stss.GetDataSize() ), stssData ) ||
+		sttsData.GetSizeI() < 8 || stssData.GetSizeI() < 8 )
+	{
+		return false;
+	}
+
+	// both are full boxes: version / flags, entry_count, entries
+	const int sttsCount = Alg::Min( static_cast< int >( ReadBE32( &sttsData[4] ) ), ( sttsData.GetSizeI() - 8 ) / 8 );
+	const int stssCount = Alg::Min( static_cast< int >( ReadBE32( &stssData[4] ) ), ( stssData.GetSizeI() - 8 ) / 4 );
+	TimesMs.Reserve( stssCount );
+
+	// Walk the runs of equal sample durations alongside the ascending sync sample numbers.
+	int sttsEntry = 0;
+	UInt32 runFirstSample = 1;
+	UInt64 runStartTime = 0;
+	for ( int i = 0; i < stssCount; i++ )
+	{
+		if ( cancel != NULL && *cancel )
+		{
+			return false;
+		}
+		const UInt32 sample = ReadBE32( &stssData[8 + i * 4] );
+		while ( sttsEntry < sttsCount )
+		{
+			const UInt32 runCount = ReadBE32( &sttsData[8 + sttsEntry * 8] );
+			if ( sample < runFirstSample + runCount )
+			{
+				break;
+			}
+			runStartTime += static_cast< UInt64 >( runCount ) * ReadBE32( &sttsData[8 + sttsEntry * 8 + 4] );
+			runFirstSample += runCount;
+			sttsEntry++;
+		}
+		if ( sttsEntry >= sttsCount || sample < runFirstSample )
+		{
+			break;
+		}
+		const UInt32 delta = ReadBE32( &sttsData[8 + sttsEntry * 8 + 4] );
+		const UInt64 time = runStartTime + static_cast< UInt64 >( sample - runFirstSample ) * delta;
+		const int ms = static_cast< int >( time * 1000 / timescale );
+		if ( TimesMs.GetSizeI() == 0 || ms > TimesMs.Back() )
+		{
+			TimesMs.PushBack( ms );
+		}
+	}
+	LOG( "KeyframeIndex: %i MP4 sync samples", TimesMs.GetSizeI() );
+	return TimesMs.GetSizeI() > 0;
+}
+
+bool KeyframeIndex::BuildFromMatroska( const MediaFile & file, const volatile bool * cancel )
+{
+	const SInt64 fileSize = file.GetSize();
+	EbmlElement header;
+	EbmlElement segment;
+	if ( !EbmlReadElement( file, 0, fileSize, header ) || header.Size == EBML_UNKNOWN_SIZE ||
+		!EbmlReadElement( file, header.DataOffset + header.Size, fileSize, segment ) ||
+		segment.Id != MKV_ID_SEGMENT )
+	{
+		return false;
+	}
+
+	UInt64 timecodeScale = 1000000;	// nanoseconds per timecode unit
+	UInt64 videoTrack = 0;
+	EbmlElement cues;
+	bool haveCues = false;
+
+	// Walk the top level elements of the segment. Clusters are skipped by size,
+	// so only their headers are read.
+	const SInt64 segmentEnd = segment.GetEnd( fileSize );
+	EbmlElement element;
+	for ( SInt64 offset = segment.DataOffset; !haveCues && EbmlReadElement( file, offset, segmentEnd, element ); )
+	{
+		if ( cancel != NULL && *cancel )
+		{
+			return false;
+		}
+		if ( element.Size == EBML_UNKNOWN_SIZE )
+		{
+			break;
+		}
+		if ( element.Id == MKV_ID_INFO )
+		{
+			EbmlElement scale;
+			if ( EbmlFindChild( file, element, fileSize, MKV_ID_TIMECODE_SCALE, scale ) )
+			{
+				timecodeScale = EbmlReadUInt( file, scale, timecodeScale );
+			}
+		}
+		else if ( element.Id == MKV_ID_TRACKS )
+		{
+			EbmlElement entry;
+			for ( SInt64 entryOffset = element.DataOffset; videoTrack == 0 && EbmlReadElement( file, entryOffset, element.DataOffset + element.Size, entry ); )
+			{
+				EbmlElement type;
+				EbmlElement number;
+				if ( entry.Id == MKV_ID_TRACK_ENTRY &&
+					EbmlFindChild( file, entry, fileSize, MKV_ID_TRACK_TYPE, type ) && EbmlReadUInt( file, type ) == 1 &&
+					EbmlFindChild( file, entry, fileSize, MKV_ID_TRACK_NUMBER, number ) )
+				{
+					videoTrack = EbmlReadUInt( file, number );
+				}
+				if ( entry.Size == EBML_UNKNOWN_SIZE )
+				{
+					break;
+				}
+				entryOffset = entry.DataOffset + entry.Size;
+			}
+		}
+		else if ( element.Id == MKV_ID_CUES )
+		{
+			cues = element;
+			haveCues = true;
+		}
+		offset = element.DataOffset + element.Size;
+	}
+	if ( !haveCues )
+	{
+		return false;
+	}
+
+	EbmlElement point;
+	for ( SInt64 offset = cues.DataOffset; EbmlReadElement( file, offset, cues.DataOffset + cues.Size, point ); offset = point.DataOffset + point.Size )
+	{
+		if ( cancel != NULL && *cancel )
+		{
+			return false;
+		}
+		if ( point.Size == EBML_UNKNOWN_SIZE )
+		{
+			break;
+		}
+		EbmlElement time;
+		if ( point.Id != MKV_ID_CUE_POINT || !EbmlFindChild( file, point, fileSize, MKV_ID_CUE_TIME, time ) )
+		{
+			continue;
+		}
+		// only cues of the video track, when the track is known
+		bool forVideo = ( videoTrack == 0 );
+		EbmlElement positions;
+		for ( SInt64 posOffset = point.DataOffset; !forVideo && EbmlReadElement( file, posOffset, point.DataOffset + point.Size, positions ); posOffset = positions.DataOffset + positions.Size )
+		{
+			EbmlElement track;
+			if ( positions.Size == EBML_UNKNOWN_SIZE )
+			{
+				break;
+			}
+			if ( positions.Id == MKV_ID_CUE_TRACK_POSITIONS && EbmlFindChild( file, positions, fileSize, MKV_ID_CUE_TRACK, track ) )
+			{
+				forVideo = EbmlReadUInt( file, track ) == videoTrack;
+			}
+		}
+		if ( !forVideo )
+		{
+			continue;
+		}
+		const int ms = static_cast< int >( EbmlReadUInt( file, time ) * timecodeScale / 1000000 );
+		if ( TimesMs.GetSizeI() == 0 || ms > TimesMs.Back() )
+		{
+			TimesMs.PushBack( ms );
+		}
+	}
+	LOG( "KeyframeIndex: %i Matroska cue points", TimesMs.GetSizeI() );
+	return TimesMs.GetSizeI() > 0;
+}
+
+int KeyframeIndex::LowerBound( const int ms ) const
+{
+	int lo = 0;
+	int hi = TimesMs.GetSizeI();
+	while ( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if ( TimesMs[mid] < ms )
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+int KeyframeIndex::Snap( const int targetMs, const int fromMs ) const
+{
+	const int count = TimesMs.GetSizeI();
+	if ( count == 0 )
+	{
+		return targetMs;
+	}
+
+	// nearest keyframe
+	const int upper = LowerBound( targetMs );
+	int nearest;
+	if ( upper >= count )
+	{
+		nearest = count - 1;
+	}
+	else if ( upper == 0 )
+	{
+		nearest = 0;
+	}
+	else
+	{
+		nearest = ( targetMs - TimesMs[upper - 1] <= TimesMs[upper] - targetMs ) ? upper - 1 : upper;
+	}
+
+	if ( targetMs > fromMs && TimesMs[nearest] <= fromMs )
+	{
+		// forward seek that would land at or behind the start, take the next keyframe
+		const int next = LowerBound( fromMs + 1 );
+		return ( next < count ) ? TimesMs[next] : targetMs;
+	}
+	if ( targetMs < fromMs && TimesMs[nearest] >= fromMs )
+	{
+		const int prev = LowerBound( fromMs ) - 1;
+		return ( prev >= 0 ) ? TimesMs[prev] : 0;
+	}
+	return TimesMs[nearest];
+}
+
+int KeyframeIndex::Floor( const int ms ) const
+{
+	if ( TimesMs.GetSizeI() == 0 )
+	{
+		return ms;
+	}
+	const int upper = LowerBound( ms + 1 );
+	return ( upper > 0 ) ? TimesMs[upper - 1] : 0;
+}
+
+//==============================================================
+// KeyframeIndexLoader
+
+KeyframeIndexLoader::KeyframeIndexLoader()
+	: Running( false )
+	, CancelRequested( false )
+	, Done( 0 )
+	, WithChapters( false )
+{
+}
+
+KeyframeIndexLoader::~KeyframeIndexLoader()
+{
+	Cancel();
+}
+
+void KeyframeIndexLoader::Start( const char * path, const bool withChapters )
+{
+	Cancel();
+
+	Path = path;
+	WithChapters = withChapters;
+	Result.Clear();
+	Chapters.Clear();
+	CancelRequested = false;
+	__atomic_store_n( &Done, 0, __ATOMIC_RELEASE );
+	if ( pthread_create( &Thread, NULL, ThreadFunction, this ) != 0 )
+	{
+		LOG( "KeyframeIndexLoader: pthread_create failed" );
+		return;
+	}
+	Running = true;
+}
+
+void KeyframeIndexLoader::Cancel()
+{
+	CancelRequested = true;
+	Join();
+}
+
+void KeyframeIndexLoader::Join()
+{
+	if ( Running )
+	{
+		pthread_join( Thread, NULL );
+		Running = false;
+	}
+}
+
+bool KeyframeIndexLoader::Poll( KeyframeIndex & out, ChapterIndex & outChapters )
+{
+	if ( !Running || __atomic_load_n( &Done, __ATOMIC_ACQUIRE ) == 0 )
+	{
+		return false;
+	}
+	Join();
+	out.Swap( Result );
+	Result.Clear();
+	if ( WithChapters )
+	{
+		outChapters.Swap( Chapters );
+		Chapters.Clear();
+	}
+	return true;
+}
+
+void * KeyframeIndexLoader::ThreadFunction( void * param )
+{
+	KeyframeIndexLoader * loader = static_cast< KeyframeIndexLoader * >( param );
+	loader->Result.BuildFromFile( loader->Path.ToCStr(), &loader->CancelRequested );
+	if ( loader->WithChapters )
+	{
+		loader->Chapters.BuildFromFile( loader->Path.ToCStr(), &loader->CancelRequested );
+	}
+	__atomic_store_n( &loader->Done, 1, __ATOMIC_RELEASE );
+	return NULL;
+}
+
+}
@@ -0,0 +1,105 @@
+/************************************************************************************
+
+Filename    :   KeyframeIndex.h
+Content     :   Sync sample times of a video, read from the container index
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_KeyframeIndex_h )
+#define OVR_KeyframeIndex_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+#include "ChapterIndex.h"
+
+namespace OVR {
+
+class MediaFile;
+
+//==============================================================
+// KeyframeIndex
+//
+// Presentation times of the video track's keyframes, from the MP4 stss / stts
+// tables or the Matroska Cues. Fragmented MP4 isn't indexed.
+class KeyframeIndex
+{
+public:
+					KeyframeIndex();
+
+	// Returns false if the file isn't a supported container or has no index.
+	bool			BuildFromFile( const char * path, const volatile bool * cancel = NULL );
+	void			Clear();
+
+	bool			IsEmpty() const					{ return TimesMs.GetSizeI() == 0; }
+	int				GetCount() const				{ return TimesMs.GetSizeI(); }
+	int				GetKeyframeMs( const int i ) const	{ return TimesMs[i]; }
+
+	// Keyframe nearest to targetMs that still moves away from fromMs in the
+	// direction of the seek, so small steps don't snap back where they started.
+	// Returns targetMs when there are no keyframes.
+	int				Snap( const int targetMs, const int fromMs ) const;
+
+	// Latest keyframe at or before ms, which shows the frame at ms first.
+	// Returns ms when there are no keyframes.
+	int				Floor( const int ms ) const;
+
+	void			Swap( KeyframeIndex & other );
+
+private:
+	Array< int >	TimesMs;		// ascending
+
+	// first index with TimesMs[i] >= ms
+	int				LowerBound( const int ms ) const;
+
+	bool			BuildFromMp4( const MediaFile & file, const volatile bool * cancel );
+	bool			BuildFromMatroska( const MediaFile & file, const volatile bool * cancel );
+};
+
+//==============================================================
+// KeyframeIndexLoader
+//
+// Builds a KeyframeIndex on its own thread, since reading the sample
+// tables of a long video can take a while on a cold file. The chapters
+// are read on the same thread, so neither delays the start of playback.
+class KeyframeIndexLoader
+{
+public:
+					KeyframeIndexLoader();
+					~KeyframeIndexLoader();
+
+	// Chapters are only read when withChapters is set, they don't change.
+	void			Start( const char * path, const bool withChapters );
+	void			Cancel();
+
+	// Returns true once, when the index has been built, and moves it to out.
+	// outChapters is only replaced if chapters were asked for.
+	bool			Poll( KeyframeIndex & out, ChapterIndex & outChapters );
+
+private:
+	pthread_t		Thread;
+	bool			Running;
+	volatile bool	CancelRequested;
+	int				Done;
+	String			Path;
+	bool			WithChapters;
+	KeyframeIndex	Result;
+	ChapterIndex	Chapters;
+
+	static void *	ThreadFunction( void * param );
+	void			Join();
+};
+
+}
+
+#endif // OVR_KeyframeIndex_h
@@ -0,0 +1,153 @@
+/************************************************************************************
+
+Filename    :   LocalizedStrings.cpp
+Content     :   Native table of the app's string resources
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "LocalizedStrings.h"
+
+#include <string.h>
+
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+static const char *	STRING_PREFIX = "@string/";
+static const int	STRING_PREFIX_LENGTH = 8;
+
+static UInt64 HashName( const char * name )
+{
+	UInt64 hash = 14695981039346656037ull;
+	for ( const char * p = name; *p != 0; p++ )
+	{
+		hash ^= static_cast< UByte >( *p );
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static const char * StripPrefix( const char * key )
+{
+	return ( strncmp( key, STRING_PREFIX, STRING_PREFIX_LENGTH ) == 0 ) ? key + STRING_PREFIX_LENGTH : key;
+}
+
+LocalizedStrings::LocalizedStrings()
+{
+}
+
+bool LocalizedStrings::Load( JNIEnv * jni, jobject activity )
+{
+	Text.Clear();
+	Entries.Clear();
+	EntryOfName.Clear();
+
+	jclass activityClass = jni->GetObjectClass( activity );
+	jmethodID tableId = jni->GetMethodID( activityClass, "getStringTableFromNative", "()[Ljava/lang/String;" );
+	jni->DeleteLocalRef( activityClass );
+	if ( tableId == NULL )
+	{
+		jni->ExceptionClear();
+		LOG( "Couldn't find getStringTableFromNative, strings will show their ids" );
+		return false;
+	}
+	jobjectArray table = ( jobjectArray )jni->CallObjectMethod( activity, tableId );
+	if ( table == NULL )
+	{
+		return false;
+	}
+
+	// name, value pairs
+	const int length = jni->GetArrayLength( table );
+	for ( int i = 0; i + 1 < length; i += 2 )
+	{
+		jstring jname = ( jstring )jni->GetObjectArrayElement( table, i );
+		jstring jvalue = ( jstring )jni->GetObjectArrayElement( table, i + 1 );
+		const char * name = jni->GetStringUTFChars( jname, NULL );
+		const char * value = jni->GetStringUTFChars( jvalue, NULL );
+		Add( name, value );
+		jni->ReleaseStringUTFChars( jvalue, value );
+		jni->ReleaseStringUTFChars( jname, name );
+		jni->DeleteLocalRef( jvalue );
+		jni->DeleteLocalRef( jname );
+	}
+	jni->DeleteLocalRef( table );
+	return Entries.GetSizeI() > 0;
+}
+
+void LocalizedStrings::Add( const char * name, const char * value )
+{
+	const UInt64 hash = HashName( name );
+	int existing;
+	if ( EntryOfName.Get( hash, &existing ) )
+	{
+		LOG( "LocalizedStrings: %s hashes the same as %s, keeping the first", name, &Text[Entries[existing].Name] );
+		return;
+	}
+	Entry entry;
+	entry.Name = Text.GetSizeI();
+	Text.Append( name, strlen( name ) + 1 );
+	entry.Value = Text.GetSizeI();
+	Text.Append( value, strlen( value ) + 1 );
+	EntryOfName.Set( hash, Entries.GetSizeI() );
+	Entries.PushBack( entry );
+}
+
+const char * LocalizedStrings::GetString( const char * key, const char * defaultStr ) const
+{
+	const char * name = StripPrefix( key );
+	int index;
+	if ( !EntryOfName.Get( HashName( name ), &index ) )
+	{
+		return defaultStr;
+	}
+	const Entry & entry = Entries[index];
+	if ( strcmp( &Text[entry.Name], name ) != 0 )
+	{
+		return defaultStr;
+	}
+	return &Text[entry.Value];
+}
+
+int LocalizedStrings::Format( const char * key, const char * defaultStr, const char * arg,
+		char * out, const int outSize ) const
+{
+	if ( outSize <= 0 )
+	{
+		return 0;
+	}
+	const char * format = GetString( key, defaultStr );
+	int length = 0;
+	for ( const char * p = format; *p != 0 && length < outSize - 1; p++ )
+	{
+		if ( p[0] == '%' && p[1] == '%' )
+		{
+			out[length++] = '%';
+			p++;
+		}
+		else if ( p[0] == '%' && p[1] == '1' && p[2] == '$' && p[3] == 's' )
+		{
+			for ( const char * a = arg; *a != 0 && length < outSize - 1; a++ )
+			{
+				out[length++] = *a;
+			}
+			p += 3;
+		}
+		else
+		{
+			out[length++] = *p;
+		}
+	}
+	out[length] = 0;
+	return length;
+}
+
+}
@@ -0,0 +1,77 @@
+/************************************************************************************
+
+Filename    :   LocalizedStrings.h
+Content     :   Native table of the app's string resources
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_LocalizedStrings_h )
+#define OVR_LocalizedStrings_h
+
+#include <jni.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_Hash.h"
+
+namespace OVR {
+
+//==============================================================
+// LocalizedStrings
+//
+// Every string resource of the app, fetched from the activity with a
+// single JNI call instead of one VrLocale::GetString round trip per
+// string. The activity resolves each string through the resource locale
+// fallback, values-de-rAT then values-de then values, so the table holds
+// what VrLocale would have returned. Names and values are packed into one
+// buffer and looked up by a hash of the name, so lookups and formatting
+// never allocate.
+class LocalizedStrings
+{
+public:
+	// Longest formatted string callers need a buffer for.
+	static const int	MAX_FORMATTED = 512;
+
+						LocalizedStrings();
+
+	// VR thread. Replaces the table with the activity's strings for the
+	// current locale, false when the activity has none to give.
+	bool				Load( JNIEnv * jni, jobject activity );
+
+	// Value of "@string/name", or of a bare "name", else defaultStr, as
+	// VrLocale::GetString falls back to its default.
+	const char *		GetString( const char * key, const char * defaultStr ) const;
+
+	// The string with %1$s replaced by arg and %% by %, as
+	// VrLocale::GetXliffFormattedString does, truncated to fit out.
+	// Returns the length written.
+	int					Format( const char * key, const char * defaultStr, const char * arg,
+								char * out, const int outSize ) const;
+
+	int					GetCount() const	{ return Entries.GetSizeI(); }
+
+private:
+	struct Entry
+	{
+		int				Name;			// offsets into Text
+		int				Value;
+	};
+
+	Array< char >		Text;
+	Array< Entry >		Entries;
+	Hash< UInt64, int >	EntryOfName;
+
+	void				Add( const char * name, const char * value );
+};
+
+}
+
+#endif // OVR_LocalizedStrings_h
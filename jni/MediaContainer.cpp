@@ -0,0 +1,337 @@
+/************************************************************************************
+
+Filename    :   MediaContainer.cpp
+Content     :   Box and element level readers for MP4 and Matroska files
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "MediaContainer.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+//==============================================================
+// MediaFile
+
+MediaFile::MediaFile()
+	: Fd( -1 )
+	, Size( 0 )
+{
+}
+
+MediaFile::~MediaFile()
+{
+	Close();
+}
+
+bool MediaFile::Open( const char * path )
+{
+	Close();
+	Fd = open( path, O_RDONLY );
+	if ( Fd < 0 )
+	{
+		LOG( "MediaFile: failed to open '%s': %s", path, strerror( errno ) );
+		return false;
+	}
+	struct stat st;
+	if ( fstat( Fd, &st ) != 0 )
+	{
+		Close();
+		return false;
+	}
+	Size = st.st_size;
+	return true;
+}
+
+void MediaFile::Close()
+{
+	if ( Fd >= 0 )
+	{
+		close( Fd );
+	}
+	Fd = -1;
+	Size = 0;
+}
+
+bool MediaFile::Read( const SInt64 offset, void * buffer, const int size ) const
+{
+	if ( Fd < 0 || offset < 0 || size < 0 || offset + size > Size )
+	{
+		return false;
+	}
+	UByte * dest = static_cast< UByte * >( buffer );
+	int done = 0;
+	while ( done < size )
+	{
+		const ssize_t r = pread( Fd, dest + done, size - done, offset + done );
+		if ( r < 0 && errno == EINTR )
+		{
+			continue;
+		}
+		if ( r <= 0 )
+		{
+			return false;
+		}
+		done += static_cast< int >( r );
+	}
+	return true;
+}
+
+bool MediaFile::ReadArray( const SInt64 offset, const int size, Array< UByte > & out ) const
+{
+	out.Resize( size );
+	return size == 0 || Read( offset, out.GetDataPtr(), size );
+}
+
+//==============================================================
+// MP4
+
+bool Mp4ReadBox( const MediaFile & file, const SInt64 offset, const SInt64 end, Mp4Box & outBox )
+{
+	if ( offset + 8 > end )
+	{
+		return false;
+	}
+	UByte header[16];
+	if ( !file.Read( offset, header, 8 ) )
+	{
+		return false;
+	}
+	SInt64 size = ReadBE32( header );
+	SInt64 headerSize = 8;
+	if ( size == 1 )
+	{
+		if ( offset + 16 > end || !file.Read( offset + 8, header + 8, 8 ) )
+		{
+			return false;
+		}
+		size = static_cast< SInt64 >( ReadBE64( header + 8 ) );
+		headerSize = 16;
+	}
+	else if ( size == 0 )
+	{
+		// extends to the end of the enclosing container
+		size = end - offset;
+	}
+	if ( size < headerSize || offset + size > end )
+	{
+		return false;
+	}
+	outBox.Type = ReadBE32( header + 4 );
+	outBox.Offset = offset;
+	outBox.DataOffset = offset + headerSize;
+	outBox.End = offset + size;
+	return true;
+}
+
+bool Mp4FindChild( const MediaFile & file, const Mp4Box & parent, const UInt32 type, Mp4Box & outBox, const int dataSkip )
+{
+	Mp4Box box;
+	for ( SInt64 offset = parent.DataOffset + dataSkip; Mp4ReadBox( file, offset, parent.End, box ); offset = box.End )
+	{
+		if ( box.Type == type )
+		{
+			outBox = box;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Mp4FindTopLevel( const MediaFile & file, const UInt32 type, Mp4Box & outBox )
+{
+	Mp4Box root;
+	root.DataOffset = 0;
+	root.End = file.GetSize();
+	return Mp4FindChild( file, root, type, outBox );
+}
+
+bool Mp4FindTrack( const MediaFile & file, const Mp4Box & moov, const UInt32 handlerType, Mp4Box & outTrak )
+{
+	Mp4Box trak;
+	for ( SInt64 offset = moov.DataOffset; Mp4ReadBox( file, offset, moov.End, trak ); offset = trak.End )
+	{
+		if ( trak.Type != MP4_FOURCC( 't', 'r', 'a', 'k' ) )
+		{
+			continue;
+		}
+		Mp4Box mdia;
+		Mp4Box hdlr;
+		UByte fields[12];
+		// hdlr: version / flags, pre_defined, handler_type
+		if ( Mp4FindChild( file, trak, MP4_FOURCC( 'm', 'd', 'i', 'a' ), mdia ) &&
+			Mp4FindChild( file, mdia, MP4_FOURCC( 'h', 'd', 'l', 'r' ), hdlr ) &&
+			hdlr.GetDataSize() >= 12 && file.Read( hdlr.DataOffset, fields, 12 ) &&
+			ReadBE32( fields + 8 ) == handlerType )
+		{
+			outTrak = trak;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Mp4ReadTrackTimescale( const MediaFile & file, const Mp4Box & trak, UInt32 & outTimescale )
+{
+	Mp4Box mdia;
+	Mp4Box mdhd;
+	if ( !Mp4FindChild( file, trak, MP4_FOURCC( 'm', 'd', 'i', 'a' ), mdia ) ||
+		!Mp4FindChild( file, mdia, MP4_FOURCC( 'm', 'd', 'h', 'd' ), mdhd ) )
+	{
+		return false;
+	}
+	UByte fields[24];
+	if ( mdhd.GetDataSize() < 24 || !file.Read( mdhd.DataOffset, fields, 24 ) )
+	{
+		return false;
+	}
+	// version 1 has 64 bit creation and modification times
+	outTimescale = ( fields[0] == 1 ) ? ReadBE32( fields + 20 ) : ReadBE32( fields + 12 );
+	return outTimescale != 0;
+}
+
+//==============================================================
+// EBML
+
+// Reads a variable length integer, the leading zero bits give the length.
+static bool ReadVint( const MediaFile & file, const SInt64 offset, const SInt64 end, const bool keepMarker,
+		UInt64 & outValue, int & outLength, bool & outAllOnes )
+{
+	UByte bytes[8];
+	if ( offset >= end || !file.Read( offset, bytes, 1 ) )
+	{
+		return false;
+	}
+	int length = 1;
+	UByte mask = 0x80;
+	while ( length <= 8 && ( bytes[0] & mask ) == 0 )
+	{
+		length++;
+		mask >>= 1;
+	}
+	if ( length > 8 || offset + length > end )
+	{
+		return false;
+	}
+	if ( length > 1 && !file.Read( offset + 1, bytes + 1, length - 1 ) )
+	{
+		return false;
+	}
+	UInt64 value = keepMarker ? bytes[0] : ( bytes[0] & ( mask - 1 ) );
+	bool allOnes = ( bytes[0] & ( mask - 1 ) ) == ( mask - 1 );
+	for ( int i = 1; i < length; i++ )
+	{
+		value = ( value << 8 ) | bytes[i];
+		allOnes = allOnes && bytes[i] == 0xFF;
+	}
+	outValue = value;
+	outLength = length;
+	outAllOnes = allOnes;
+	return true;
+}
+
+bool EbmlReadElement( const MediaFile & file, const SInt64 offset, const SInt64 end, EbmlElement & outElement )
+{
+	UInt64 id;
+	UInt64 size;
+	int idLength;
+	int sizeLength;
+	bool allOnes;
+	if ( !ReadVint( file, offset, end, true, id, idLength, allOnes ) || idLength > 4 )
+	{
+		return false;
+	}
+	if ( !ReadVint( file, offset + idLength, end, false, size, sizeLength, allOnes ) )
+	{
+		return false;
+	}
+	outElement.Id = static_cast< UInt32 >( id );
+	outElement.Offset = offset;
+	outElement.DataOffset = offset + idLength + sizeLength;
+	outElement.Size = allOnes ? EBML_UNKNOWN_SIZE : static_cast< SInt64 >( size );
+	if ( outElement.Size != EBML_UNKNOWN_SIZE && outElement.DataOffset + outElement.Size > end )
+	{
+		return false;
+	}
+	return true;
+}
+
+bool EbmlFindChild( const MediaFile & file, const EbmlElement & parent, const SInt64 limit, const UInt32 id, EbmlElement & outElement )
+{
+	const SInt64 end = parent.GetEnd( limit );
+	EbmlElement element;
+	for ( SInt64 offset = parent.DataOffset; EbmlReadElement( file, offset, end, element ); )
+	{
+		if ( element.Id == id )
+		{
+			outElement = element;
+			return true;
+		}
+		if ( element.Size == EBML_UNKNOWN_SIZE )
+		{
+			return false;
+		}
+		offset = element.DataOffset + element.Size;
+	}
+	return false;
+}
+
+UInt64 EbmlReadUInt( const MediaFile & file, const EbmlElement & element, const UInt64 defaultValue )
+{
+	UByte bytes[8];
+	if ( element.Size < 1 || element.Size > 8 || !file.Read( element.DataOffset, bytes, static_cast< int >( element.Size ) ) )
+	{
+		return defaultValue;
+	}
+	UInt64 value = 0;
+	for ( int i = 0; i < element.Size; i++ )
+	{
+		value = ( value << 8 ) | bytes[i];
+	}
+	return value;
+}
+
+double EbmlReadFloat( const MediaFile & file, const EbmlElement & element, const double defaultValue )
+{
+	UByte bytes[8];
+	if ( element.Size == 4 && file.Read( element.DataOffset, bytes, 4 ) )
+	{
+		const UInt32 bits = ReadBE32( bytes );
+		float value;
+		memcpy( &value, &bits, sizeof( value ) );
+		return value;
+	}
+	if ( element.Size == 8 && file.Read( element.DataOffset, bytes, 8 ) )
+	{
+		const UInt64 bits = ReadBE64( bytes );
+		double value;
+		memcpy( &value, &bits, sizeof( value ) );
+		return value;
+	}
+	return defaultValue;
+}
+
+bool EbmlReadString( const MediaFile & file, const EbmlElement & element, Array< UByte > & outUtf8 )
+{
+	if ( element.Size < 0 || element.Size > 64 * 1024 )
+	{
+		return false;
+	}
+	return file.ReadArray( element.DataOffset, static_cast< int >( element.Size ), outUtf8 );
+}
+
+}
@@ -0,0 +1,148 @@
+/************************************************************************************
+
+Filename    :   MediaContainer.h
+Content     :   Box and element level readers for MP4 and Matroska files
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_MediaContainer_h )
+#define OVR_MediaContainer_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+
+namespace OVR {
+
+//==============================================================
+// MediaFile
+//
+// Read only file accessed with positioned reads, so several readers can
+// share one descriptor without seeking.
+class MediaFile
+{
+public:
+					MediaFile();
+					~MediaFile();
+
+	bool			Open( const char * path );
+	void			Close();
+	bool			IsOpen() const		{ return Fd >= 0; }
+	SInt64			GetSize() const		{ return Size; }
+
+	// Returns false unless exactly size bytes could be read.
+	bool			Read( const SInt64 offset, void * buffer, const int size ) const;
+	bool			ReadArray( const SInt64 offset, const int size, Array< UByte > & out ) const;
+
+private:
+	int				Fd;
+	SInt64			Size;
+
+	// not copyable
+					MediaFile( const MediaFile & );
+	MediaFile &		operator = ( const MediaFile & );
+};
+
+// Big endian helpers used by both formats.
+inline UInt16	ReadBE16( const UByte * p ) { return ( UInt16 )( ( p[0] << 8 ) | p[1] ); }
+inline UInt32	ReadBE32( const UByte * p ) { return ( ( UInt32 )p[0] << 24 ) | ( ( UInt32 )p[1] << 16 ) | ( ( UInt32 )p[2] << 8 ) | p[3]; }
+inline UInt64	ReadBE64( const UByte * p ) { return ( ( UInt64 )ReadBE32( p ) << 32 ) | ReadBE32( p + 4 ); }
+inline void		WriteBE32( UByte * p, const UInt32 v ) { p[0] = ( UByte )( v >> 24 ); p[1] = ( UByte )( v >> 16 ); p[2] = ( UByte )( v >> 8 ); p[3] = ( UByte )v; }
+inline void		WriteBE64( UByte * p, const UInt64 v ) { WriteBE32( p, ( UInt32 )( v >> 32 ) ); WriteBE32( p + 4, ( UInt32 )v ); }
+
+//==============================================================
+// Mp4Box
+#define MP4_FOURCC( a, b, c, d ) ( ( ( UInt32 )( a ) << 24 ) | ( ( UInt32 )( b ) << 16 ) | ( ( UInt32 )( c ) << 8 ) | ( UInt32 )( d ) )
+
+struct Mp4Box
+{
+	UInt32	Type;
+	SInt64	Offset;			// of the box header
+	SInt64	DataOffset;		// first byte after the header
+	SInt64	End;			// one past the last byte of the box
+
+			Mp4Box() : Type( 0 ), Offset( 0 ), DataOffset( 0 ), End( 0 ) {}
+
+	SInt64	GetDataSize() const { return End - DataOffset; }
+};
+
+// Reads the box header at offset, which must be before end.
+bool	Mp4ReadBox( const MediaFile & file, const SInt64 offset, const SInt64 end, Mp4Box & outBox );
+
+// Finds the first child of type inside parent's data, skipping dataSkip
+// leading bytes, e.g. the fields of a full box or sample entry.
+bool	Mp4FindChild( const MediaFile & file, const Mp4Box & parent, const UInt32 type, Mp4Box & outBox, const int dataSkip = 0 );
+
+// Finds the first top level box of type.
+bool	Mp4FindTopLevel( const MediaFile & file, const UInt32 type, Mp4Box & outBox );
+
+// Finds the first trak in moov whose handler is handlerType, e.g. 'vide'.
+bool	Mp4FindTrack( const MediaFile & file, const Mp4Box & moov, const UInt32 handlerType, Mp4Box & outTrak );
+
+// Reads the timescale from a trak's mdia/mdhd.
+bool	Mp4ReadTrackTimescale( const MediaFile & file, const Mp4Box & trak, UInt32 & outTimescale );
+
+//==============================================================
+// EbmlElement
+//
+// Matroska / WebM elements. Ids keep their length marker bits, the
+// way the specification writes them, e.g. 0x18538067 for Segment.
+static const SInt64 EBML_UNKNOWN_SIZE = -1;
+
+enum eMatroskaId
+{
+	MKV_ID_EBML				= 0x1A45DFA3,
+	MKV_ID_SEGMENT			= 0x18538067,
+	MKV_ID_INFO				= 0x1549A966,
+	MKV_ID_TIMECODE_SCALE	= 0x2AD7B1,
+	MKV_ID_DURATION			= 0x4489,
+	MKV_ID_TRACKS			= 0x1654AE6B,
+	MKV_ID_TRACK_ENTRY		= 0xAE,
+	MKV_ID_TRACK_NUMBER		= 0xD7,
+	MKV_ID_TRACK_TYPE		= 0x83,
+	MKV_ID_CLUSTER			= 0x1F43B675,
+	MKV_ID_CUES				= 0x1C53BB6B,
+	MKV_ID_CUE_POINT		= 0xBB,
+	MKV_ID_CUE_TIME			= 0xB3,
+	MKV_ID_CUE_TRACK_POSITIONS	= 0xB7,
+	MKV_ID_CUE_TRACK		= 0xF7,
+	MKV_ID_CUE_CLUSTER_POSITION	= 0xF1,
+	MKV_ID_CHAPTERS			= 0x1043A770,
+	MKV_ID_EDITION_ENTRY	= 0x45B9,
+	MKV_ID_CHAPTER_ATOM		= 0xB6,
+	MKV_ID_CHAPTER_TIME_START	= 0x91,
+	MKV_ID_CHAPTER_FLAG_HIDDEN	= 0x98,
+	MKV_ID_CHAPTER_FLAG_ENABLED	= 0x4598,
+	MKV_ID_CHAPTER_DISPLAY	= 0x80,
+	MKV_ID_CHAP_STRING		= 0x85
+};
+
+struct EbmlElement
+{
+	UInt32	Id;
+	SInt64	Offset;			// of the element id
+	SInt64	DataOffset;
+	SInt64	Size;			// EBML_UNKNOWN_SIZE for live streams
+
+			EbmlElement() : Id( 0 ), Offset( 0 ), DataOffset( 0 ), Size( 0 ) {}
+
+	// End of the data, or limit when the size is unknown.
+	SInt64	GetEnd( const SInt64 limit ) const { return ( Size == EBML_UNKNOWN_SIZE ) ? limit : DataOffset + Size; }
+};
+
+bool	EbmlReadElement( const MediaFile & file, const SInt64 offset, const SInt64 end, EbmlElement & outElement );
+bool	EbmlFindChild( const MediaFile & file, const EbmlElement & parent, const SInt64 limit, const UInt32 id, EbmlElement & outElement );
+UInt64	EbmlReadUInt( const MediaFile & file, const EbmlElement & element, const UInt64 defaultValue = 0 );
+double	EbmlReadFloat( const MediaFile & file, const EbmlElement & element, const double defaultValue = 0.0 );
+bool	EbmlReadString( const MediaFile & file, const EbmlElement & element, Array< UByte > & outUtf8 );
+
+}
+
+#endif // OVR_MediaContainer_h
@@ -0,0 +1,61 @@
+/************************************************************************************
+
+Filename    :   MediaSource.h
+Content     :   Interface for video libraries that aren't on local storage
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_MediaSource_h )
+#define OVR_MediaSource_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+struct MediaSourceEntry
+{
+	String	Url;			// what the player opens
+	String	Category;		// name of the folder it was found in, as InitFromDirectory tags local files
+};
+
+//==============================================================
+// MediaSource
+//
+// A library the local directory scan can't see. A source lists itself on
+// its own threads after Start; the VR thread takes whatever it has found
+// so far each frame and adds it to the metadata, a folder at a time.
+class MediaSource
+{
+public:
+	virtual					~MediaSource() {}
+
+	virtual void			Start() = 0;
+	virtual void			Stop() = 0;
+
+	// Entries found since the last call.
+	virtual void			TakeEntries( Array< MediaSourceEntry > & outEntries ) = 0;
+
+	// True once everything has been listed and taken.
+	virtual bool			IsFinished() const = 0;
+
+	// Whether url is one of this source's entries.
+	virtual bool			Owns( const char * url ) const = 0;
+
+	// Local path of the entry's thumbnail, called from the browser's
+	// thumbnail thread. The file may not exist.
+	virtual String			GetThumbnailPath( const char * url ) const = 0;
+};
+
+}
+
+#endif // OVR_MediaSource_h
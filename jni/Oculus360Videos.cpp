@@ -13,7 +13,9 @@ of patent rights can be found in the PATENTS file in the same directory.
 
 *************************************************************************************/
 
+#include <stdio.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <jni.h>
@@ -42,10 +44,10 @@ of patent rights can be found in the PATENTS file in the same directory.
 
 #include "VideoBrowser.h"
 #include "VideoMenu.h"
-#include "VrLocale.h"
 #include "PathUtils.h"
 
 #include "VideosMetaData.h"
+#include "WebDavSource.h"
 
 static bool	RetailMode = false;
 
@@ -53,6 +55,22 @@ static const char * videosDirectory = "Oculus/360Videos/";
 static const char * videosLabel = "@string/app_name";
 static const float	FadeOutTime = 0.25f;
 static const float	FadeOverTime = 1.0f;
+static const char * HlsStreamingType = "hls";
+static const double	ProxyPositionSyncInterval = 1.0;
+static const double	PositionCheckpointInterval = 3.0;
+static const int	ResumeEndMarginMs = 5000;		// closer to the end than this starts over
+static const char * PositionJournalName = "resume_positions.journal";
+static const char * ProxyCacheName = "streamed";
+static const char * DownloadsCategory = "Downloads";
+static const char * NetworkSharesName = "network_shares.txt";	// next to the videos, one WebDAV url per line
+static const char * WebDavCacheName = "webdav";
+static const int	BrowserPanelPool = 64;
+static const SInt64	ProxyCacheBytes = 2048LL * 1024 * 1024;	// never more than half the free space
+static const int	ChapterRestartMs = 3000;		// previous within this of a chapter start goes back one more
+static const float	SubtitleDistance = 2.5f;		// meters in front of the viewer
+static const float	SubtitleDrop = 0.8f;			// meters below eye level
+static const float	SubtitleWidth = 1.8f;			// wrap width in meters
+static const float	SubtitleScale = 0.8f;
 
 extern "C" {
 
@@ -75,40 +93,98 @@ void Java_com_oculus_oculus360videossdk_MainActivity_nativeFrameAvailable( JNIEn
 
 jobject Java_com_oculus_oculus360videossdk_MainActivity_nativePrepareNewVideo( JNIEnv *jni, jclass clazz, jlong interfacePtr ) {
 
-	// set up a message queue to get the return message
-	// TODO: make a class that encapsulates this work
-	MessageQueue	result( 1 );
+	// Called by the java UI thread, never waits for the VR thread.
+	// Returns NULL if no texture is ready yet, the java side tries again shortly.
 	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
-	panoVids->app->GetMessageQueue().PostPrintf( "newVideo %p", &result );
+	jobject texobj;
+	const int index = panoVids->GetMovieTexturePool().Take( texobj );
+	if ( index == SurfaceTexturePool::INVALID_INDEX )
+	{
+		LOG( "nativePrepareNewVideo: no SurfaceTexture ready" );
+		return NULL;
+	}
+	if ( !panoVids->GetPlayerEvents().Post( PLAYER_EVENT_SURFACE_TAKEN, index ) )
+	{
+		// the VR thread would never hear about it, give it back and let java retry
+		LOG( "nativePrepareNewVideo: event ring full, returning SurfaceTexture %i", index );
+		panoVids->GetMovieTexturePool().Return( index );
+		return NULL;
+	}
+
+	return texobj;
+}
 
-	result.SleepUntilMessage();
-	const char * msg = result.GetNextMessage();
-	jobject	texobj;
-	sscanf( msg, "surfaceTexture %p", &texobj );
-	free( ( void * )msg );
+jobject Java_com_oculus_oculus360videossdk_MainActivity_nativePreparePreloadSurface( JNIEnv *jni, jclass clazz, jlong interfacePtr, int generation ) {
+	// Same as nativePrepareNewVideo, for the playlist's second player.
+	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
+	jobject texobj;
+	const int index = panoVids->GetMovieTexturePool().Take( texobj );
+	if ( index == SurfaceTexturePool::INVALID_INDEX )
+	{
+		LOG( "nativePreparePreloadSurface: no SurfaceTexture ready" );
+		return NULL;
+	}
+	if ( !panoVids->GetPlayerEvents().Post( PLAYER_EVENT_PRELOAD_SURFACE_TAKEN, index, generation ) )
+	{
+		LOG( "nativePreparePreloadSurface: event ring full, returning SurfaceTexture %i", index );
+		panoVids->GetMovieTexturePool().Return( index );
+		return NULL;
+	}
 
 	return texobj;
 }
 
+void Java_com_oculus_oculus360videossdk_MainActivity_nativePreloadReady( JNIEnv *jni, jclass clazz, jlong interfacePtr, int generation ) {
+	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
+	panoVids->GetPlayerEvents().Post( PLAYER_EVENT_PRELOAD_READY, generation );
+}
+
+void Java_com_oculus_oculus360videossdk_MainActivity_nativePreloadFailed( JNIEnv *jni, jclass clazz, jlong interfacePtr, int generation ) {
+	LOG( "nativePreloadFailed" );
+	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
+	panoVids->GetPlayerEvents().Post( PLAYER_EVENT_PRELOAD_FAILED, generation );
+}
+
 void Java_com_oculus_oculus360videossdk_MainActivity_nativeSetVideoSize( JNIEnv *jni, jclass clazz, jlong interfacePtr, int width, int height ) {
 	LOG( "nativeSetVideoSizes: width=%i height=%i", width, height );
 
 	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
-	panoVids->app->GetMessageQueue().PostPrintf( "video %i %i", width, height );
+	panoVids->GetPlaybackState().SetVideoSize( width, height );
+	panoVids->GetPlayerEvents().Post( PLAYER_EVENT_VIDEO_SIZE, width, height );
+}
+
+void Java_com_oculus_oculus360videossdk_MainActivity_nativeUpdatePlaybackState( JNIEnv *jni, jclass clazz, jlong interfacePtr,
+		jboolean playing, int position, int duration, int bufferedPercent, int completedSeekId ) {
+	// Called by the java UI thread whenever the player state may have changed.
+	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
+	panoVids->GetPlaybackState().Update( playing, position, duration, 0, duration > 0 ? ( int )( ( long long )duration * bufferedPercent / 100 ) : 0,
+			completedSeekId );
+}
+
+void Java_com_oculus_oculus360videossdk_MainActivity_nativeSeekComplete( JNIEnv *jni, jclass clazz, jlong interfacePtr, int seekId ) {
+	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
+	panoVids->GetPlayerEvents().Post( PLAYER_EVENT_SEEK_COMPLETE, seekId );
 }
 
 void Java_com_oculus_oculus360videossdk_MainActivity_nativeVideoCompletion( JNIEnv *jni, jclass clazz, jlong interfacePtr ) {
 	LOG( "nativeVideoCompletion" );
 
 	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
-	panoVids->app->GetMessageQueue().PostPrintf( "completion" );
+	panoVids->GetPlayerEvents().Post( PLAYER_EVENT_COMPLETION );
+}
+
+void Java_com_oculus_oculus360videossdk_MainActivity_nativeTrimMemory( JNIEnv *jni, jclass clazz, jlong interfacePtr, int level ) {
+	LOG( "nativeTrimMemory: %i", level );
+
+	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
+	panoVids->GetPlayerEvents().Post( PLAYER_EVENT_TRIM_MEMORY, level );
 }
 
 void Java_com_oculus_oculus360videossdk_MainActivity_nativeVideoStartError( JNIEnv *jni, jclass clazz, jlong interfacePtr ) {
 	LOG( "nativeVideoStartError" );
 
 	Oculus360Videos * panoVids = ( Oculus360Videos * )( ( ( App * )interfacePtr )->GetAppInterface() );
-	panoVids->app->GetMessageQueue().PostPrintf( "startError" );
+	panoVids->GetPlayerEvents().Post( PLAYER_EVENT_START_ERROR );
 }
 
 } // extern "C"
@@ -134,11 +210,30 @@ Oculus360Videos::Oculus360Videos()
 	, VideoMenuTimeLeft( 0.0f )
 	, UseSrgb( false )
 	, MovieTexture( NULL )
+	, StartVideoTime( 0.0 )
 	, CurrentVideoWidth( 0 )
 	, CurrentVideoHeight( 480 )
 	, BackgroundWidth( 0 )
 	, BackgroundHeight( 0 )
 	, FrameAvailable( false )
+	, StartMovieMethodId( NULL )
+	, StopMovieMethodId( NULL )
+	, PauseMovieMethodId( NULL )
+	, ResumeMovieMethodId( NULL )
+	, SeekToMethodId( NULL )
+	, PendingPlayCommand( PLAYER_COMMAND_NONE )
+	, Seeks( *this )
+	, AudioOpenFailed( false )
+	, SubtitlesHeadLocked( false )
+	, ActivePathHash( 0 )
+	, NextCheckpointTime( 0.0 )
+	, PlaylistMode( false )
+	, Playlist( *this )
+	, PreloadTextureIndex( -1 )
+	, PreloadMovieMethodId( NULL )
+	, PromotePreloadMethodId( NULL )
+	, DiscardPreloadMethodId( NULL )
+	, ProxyPositionSyncTime( 0.0 )
 {
 }
 
@@ -146,6 +241,27 @@ Oculus360Videos::~Oculus360Videos()
 {
 }
 
+// Absolute path of one of the Context directory getters, empty if it returns null.
+static String GetAppDirectory( JNIEnv * env, jobject activity, jclass activityClass, const char * getterName )
+{
+	String result;
+	jmethodID getterId = env->GetMethodID( activityClass, getterName, "()Ljava/io/File;" );
+	jobject dir = ( getterId != NULL ) ? env->CallObjectMethod( activity, getterId ) : NULL;
+	if ( dir != NULL )
+	{
+		jclass fileClass = env->GetObjectClass( dir );
+		jmethodID getPathId = env->GetMethodID( fileClass, "getAbsolutePath", "()Ljava/lang/String;" );
+		jstring jpath = ( jstring )env->CallObjectMethod( dir, getPathId );
+		const char * path = env->GetStringUTFChars( jpath, NULL );
+		result = path;
+		env->ReleaseStringUTFChars( jpath, path );
+		env->DeleteLocalRef( jpath );
+		env->DeleteLocalRef( fileClass );
+		env->DeleteLocalRef( dir );
+	}
+	return result;
+}
+
 //============================================================================================
 void Oculus360Videos::OneTimeInit( const char * fromPackage, const char * launchIntentJSON, const char * launchIntentURI )
 {
@@ -206,6 +322,27 @@ void Oculus360Videos::OneTimeInit( const char * fromPackage, const char * launch
 		"}\n"
 		);
 
+	PreviewPanoramaProgram = BuildProgram(
+		"uniform highp mat4 Mvpm;\n"
+		"uniform highp mat4 Texm;\n"
+		"attribute vec4 Position;\n"
+		"attribute vec2 TexCoord;\n"
+		"varying  highp vec2 oTexCoord;\n"
+		"void main()\n"
+		"{\n"
+		"   gl_Position = Mvpm * Position;\n"
+		"   oTexCoord = vec2( Texm * vec4( TexCoord, 0, 1 ) );\n"
+		"}\n"
+		,
+		"uniform sampler2D Texture0;\n"
+		"uniform lowp vec4 UniformColor;\n"
+		"varying highp vec2 oTexCoord;\n"
+		"void main()\n"
+		"{\n"
+		"	gl_FragColor = UniformColor * texture2D( Texture0, oTexCoord );\n"
+		"}\n"
+		);
+
 	SingleColorTextureProgram = BuildProgram(
 		"uniform highp mat4 Mvpm;\n"
 		"attribute highp vec4 Position;\n"
@@ -226,6 +363,57 @@ void Oculus360Videos::OneTimeInit( const char * fromPackage, const char * launch
 		"}\n"
 		);
 
+	// The journal lives in the app's private files directory.
+	const String filesDir = GetAppDirectory( app->GetVrJni(), app->GetJavaObject(), MainActivityClass, "getFilesDir" );
+	if ( !filesDir.IsEmpty() )
+	{
+		ResumePositions.Open( ( filesDir + "/" + PositionJournalName ).ToCStr() );
+	}
+	else
+	{
+		LOG( "Couldn't get the files directory, resume positions won't be saved" );
+	}
+
+	// Streamed segments go to the external cache, which is much larger than the internal one.
+	String cacheDir = GetAppDirectory( app->GetVrJni(), app->GetJavaObject(), MainActivityClass, "getExternalCacheDir" );
+	if ( cacheDir.IsEmpty() )
+	{
+		cacheDir = GetAppDirectory( app->GetVrJni(), app->GetJavaObject(), MainActivityClass, "getCacheDir" );
+	}
+	struct statfs fs;
+	if ( !cacheDir.IsEmpty() && statfs( cacheDir.ToCStr(), &fs ) == 0 )
+	{
+		const SInt64 freeBytes = static_cast< SInt64 >( fs.f_bavail ) * fs.f_bsize;
+		Proxy.Start( ( cacheDir + "/" + ProxyCacheName ).ToCStr(), Alg::Min( ProxyCacheBytes, freeBytes / 2 ) );
+	}
+
+	// Create the movie textures up front so starting a video doesn't have to wait for them.
+	MovieTexturePool.Init( app->GetVrJni() );
+
+	// The interface sounds are all in memory before the mixer can start;
+	// the output itself isn't opened until something plays through it.
+	LoadUiSound( "sv_select" );
+	LoadUiSound( "sv_release_active" );
+
+	// Look up the player methods once, they are called from the VR thread every frame.
+	JNIEnv * jni = app->GetVrJni();
+	StartMovieMethodId = jni->GetMethodID( MainActivityClass, "startMovieFromNative", "(Ljava/lang/String;I)V" );
+	StopMovieMethodId = jni->GetMethodID( MainActivityClass, "stopMovie", "()V" );
+	PauseMovieMethodId = jni->GetMethodID( MainActivityClass, "pauseMovie", "()V" );
+	ResumeMovieMethodId = jni->GetMethodID( MainActivityClass, "resumeMovie", "()V" );
+	SeekToMethodId = jni->GetMethodID( MainActivityClass, "seekToFromNative", "(II)V" );
+	if ( !StartMovieMethodId || !StopMovieMethodId || !PauseMovieMethodId || !ResumeMovieMethodId || !SeekToMethodId )
+	{
+		LOG( "Couldn't find MainActivity player methodIDs" );
+	}
+	PreloadMovieMethodId = jni->GetMethodID( MainActivityClass, "preloadMovieFromNative", "(Ljava/lang/String;II)V" );
+	PromotePreloadMethodId = jni->GetMethodID( MainActivityClass, "promotePreloadFromNative", "(I)V" );
+	DiscardPreloadMethodId = jni->GetMethodID( MainActivityClass, "discardPreloadFromNative", "(I)V" );
+	if ( !PreloadMovieMethodId || !PromotePreloadMethodId || !DiscardPreloadMethodId )
+	{
+		LOG( "Couldn't find MainActivity preload methodIDs, playlist mode won't preload" );
+	}
+
 	const char *launchPano = NULL;
 	if ( ( NULL != launchPano ) && launchPano[ 0 ] )
 	{
@@ -311,9 +499,34 @@ void Oculus360Videos::OneTimeInit( const char * fromPackage, const char * launch
 
 	MetaData->InitFromDirectory( videosDirectory, SearchPaths, fileExtensions );
 
-	String localizedAppName;
-	VrLocale::GetString( app->GetVrJni(), app->GetJavaObject(), videosLabel, videosLabel, localizedAppName );
-	MetaData->RenameCategory( ExtractFileBase( videosDirectory ), localizedAppName );
+	const double stringsStart = ovr_GetTimeInSeconds();
+	Strings.Load( app->GetVrJni(), app->GetJavaObject() );
+	LOG( "Localized strings: %i loaded in %.2f ms", Strings.GetCount(), ( ovr_GetTimeInSeconds() - stringsStart ) * 1000.0 );
+	MetaData->RenameCategory( ExtractFileBase( videosDirectory ), Strings.GetString( videosLabel, videosLabel ) );
+
+	// Files with moov at the end make the player read the tail of the file before it can start.
+	Array< String > scannedPaths;
+	const Array< OvrMetaData::Category > & categories = MetaData->GetCategories();
+	for ( int i = 0; i < categories.GetSizeI(); i++ )
+	{
+		Array< const OvrMetaDatum * > items;
+		MetaData->GetMetaData( categories[i], items );
+		for ( int j = 0; j < items.GetSizeI(); j++ )
+		{
+			scannedPaths.PushBack( items[j]->Url );
+		}
+	}
+	Faststart.Start( scannedPaths );
+
+	// Past this many videos a category pages through a window of panels.
+	MetaData->SetPanelPool( BrowserPanelPool );
+	// what the files look like now, for OnResume to compare against
+	MetaData->RescanFiles();
+	Downloads.Start();
+	if ( !cacheDir.IsEmpty() )
+	{
+		StartMediaSources( cacheDir.ToCStr(), fileExtensions.GoodExtensions );
+	}
 
 	// Start building the VideoMenu
 	VideoMenu = ( OvrVideoMenu * )app->GetGuiSys().GetMenu( OvrVideoMenu::MENU_NAME );
@@ -350,8 +563,9 @@ void Oculus360Videos::OneTimeInit( const char * fromPackage, const char * launch
 	Browser->SetScrollBarSpacingScale( 0.9f );
 	Browser->SetScrollBarRadiusScale( 1.0f );
 
+	Browser->SetMediaSources( MediaSources );
 	Browser->OneTimeInit();
-	Browser->BuildDirtyMenu( *MetaData );
+	Browser->ApplyChanges();
 
 	SetMenuState( MENU_BROWSER );
 }
@@ -377,14 +591,32 @@ void Oculus360Videos::OneTimeShutdown()
 
 	FreeTexture( BackgroundTexId );
 
-	if ( MovieTexture != NULL )
+	Playlist.Clear();
+	PlaylistItems.Clear();
+	MovieTexture = NULL;
+	MovieTexturePool.Shutdown();
+	ResumePositions.Close();
+
+	Faststart.Stop();
+	Downloads.Stop();
+	for ( int i = 0; i < MediaSources.GetSizeI(); i++ )
 	{
-		delete MovieTexture;
-		MovieTexture = NULL;
+		delete MediaSources[i];
+	}
+	MediaSources.Clear();
+	Proxy.Stop();
+	TrickPlay.Stop();
+	StopSoundtrack();
+	Audio.Close();
+	if ( UiSounds.GetMixCount() > 0 )
+	{
+		LOG( "UI sounds: %.3f ms average, %.3f ms max mix, %i voices max",
+			UiSounds.GetMixSecondsAverage() * 1000.0, UiSounds.GetMixSecondsMax() * 1000.0, UiSounds.GetVoicesMax() );
 	}
 
 	DeleteProgram( PanoramaProgram );
 	DeleteProgram( FadedPanoramaProgram );
+	DeleteProgram( PreviewPanoramaProgram );
 	DeleteProgram( SingleColorTextureProgram );
 }
 
@@ -434,62 +666,253 @@ void Oculus360Videos::Command( const char * msg )
 	// Always include the space in MatchesHead to prevent problems
 	// with commands with matching prefixes.
 
-	if ( MatchesHead( "newVideo ", msg ) )
+	if ( MatchesHead( "resume ", msg ) )
+	{
+		OnResume();
+		return;	// allow VrLib to handle it, too
+	}
+	else if ( MatchesHead( "pause ", msg ) )
+	{
+		OnPause();
+		return;	// allow VrLib to handle it, too
+	}
+}
+
+void Oculus360Videos::DrainPlayerEvents()
+{
+	// Player callbacks arrive as fixed size structs, no formatting, parsing or allocation here.
+	PlayerEvent event;
+	while ( PlayerEvents.Next( event ) )
 	{
-		delete MovieTexture;
-		MovieTexture = new SurfaceTexture( app->GetVrJni() );
-		LOG( "RC_NEW_VIDEO texId %i", MovieTexture->textureId );
+		switch ( event.Type )
+		{
+			case PLAYER_EVENT_VIDEO_SIZE:
+				CurrentVideoWidth = event.Arg0;
+				CurrentVideoHeight = event.Arg1;
+				if ( MenuState != MENU_VIDEO_PLAYING ) // If video is already being played dont change the state to video ready
+				{
+					SetMenuState( MENU_VIDEO_READY );
+				}
+				break;
+			case PLAYER_EVENT_COMPLETION:	// video complete, play the next one or return to menu
+				CheckpointPosition( 0 );	// watched to the end, start over next time
+				ActivePathHash = 0;
+				if ( PlaylistMode )
+				{
+					AdvancePlaylist();
+				}
+				else
+				{
+					SetMenuState( MENU_BROWSER );
+				}
+				break;
+			case PLAYER_EVENT_START_ERROR:
+				OnVideoStartError();
+				break;
+			case PLAYER_EVENT_SURFACE_TAKEN:
+				OnMovieSurfaceTaken( event.Arg0, event.PostTime );
+				break;
+			case PLAYER_EVENT_PRELOAD_SURFACE_TAKEN:
+				OnPreloadSurfaceTaken( event.Arg0, event.Arg1 );
+				break;
+			case PLAYER_EVENT_PRELOAD_READY:
+				Playlist.OnPreloadReady( event.Arg0 );
+				break;
+			case PLAYER_EVENT_PRELOAD_FAILED:
+				Playlist.OnPreloadFailed( event.Arg0 );
+				break;
+			case PLAYER_EVENT_SEEK_COMPLETE:
+				Seeks.OnSeekComplete( event.Arg0, event.PostTime );
+				break;
+			case PLAYER_EVENT_TRIM_MEMORY:
+				if ( Browser != NULL )
+				{
+					Browser->TrimMemory( event.Arg0 );
+				}
+				break;
+			default:
+				LOG( "DrainPlayerEvents: unknown event %i", event.Type );
+				break;
+		}
+	}
 
-		MessageQueue	* receiver;
-		sscanf( msg, "newVideo %p", &receiver );
+	// pick up textures java took and gave back because the ring was full
+	MovieTexturePool.Refill();
+}
 
-		receiver->PostPrintf( "surfaceTexture %p", MovieTexture->javaObject );
+void Oculus360Videos::OnMovieSurfaceTaken( const int poolIndex, const double takeTime )
+{
+	MovieTexturePool.Recycle( MovieTexture );
+	MovieTexture = MovieTexturePool.Get( poolIndex );
+	LOG( "Movie surface texId %i handed out %.1f ms after StartVideo, latched %.1f ms after",
+		MovieTexture != NULL ? static_cast< int >( MovieTexture->textureId ) : -1,
+		( takeTime - StartVideoTime ) * 1000.0, ( PlayerEventRing::GetTimeInSeconds() - StartVideoTime ) * 1000.0 );
 
-		// don't draw the screen until we have the new size
-		CurrentVideoWidth = 0;
+	// Publish the next free texture for the following start.
+	MovieTexturePool.Refill();
 
-		return;
+	// don't draw the screen until we have the new size
+	CurrentVideoWidth = 0;
+}
+
+void Oculus360Videos::OnPreloadSurfaceTaken( const int poolIndex, const int generation )
+{
+	if ( Playlist.IsActivePreload( generation ) && PreloadTextureIndex < 0 )
+	{
+		PreloadTextureIndex = poolIndex;
 	}
-	else if ( MatchesHead( "completion", msg ) ) // video complete, return to menu
+	else
 	{
-		SetMenuState( MENU_BROWSER );
+		// the preload was discarded before its surface arrived
+		MovieTexturePool.Recycle( MovieTexturePool.Get( poolIndex ) );
+	}
+	MovieTexturePool.Refill();
+}
+
+void Oculus360Videos::RecyclePreloadTexture()
+{
+	if ( PreloadTextureIndex >= 0 )
+	{
+		MovieTexturePool.Recycle( MovieTexturePool.Get( PreloadTextureIndex ) );
+		PreloadTextureIndex = -1;
+	}
+}
+
+void Oculus360Videos::SetPlaylistMode( const bool enabled )
+{
+	PlaylistMode = enabled;
+	if ( !PlaylistMode )
+	{
+		Playlist.Clear();
+		PlaylistItems.Clear();
+	}
+	else if ( ActiveVideo != NULL )
+	{
+		BuildPlaylist();
+	}
+}
+
+void Oculus360Videos::BuildPlaylist()
+{
+	PlaylistItems.Clear();
+	if ( MetaData == NULL || ActiveVideo == NULL || ActiveVideo->Tags.GetSizeI() == 0 )
+	{
+		Playlist.Clear();
 		return;
 	}
-	else if ( MatchesHead( "video ", msg ) )
+
+	// the playlist is the category the video was picked from
+	const Array< OvrMetaData::Category > & categories = MetaData->GetCategories();
+	for ( int i = 0; i < categories.GetSizeI(); i++ )
 	{
-		sscanf( msg, "video %i %i", &CurrentVideoWidth, &CurrentVideoHeight );
+		if ( categories[i].CategoryTag == ActiveVideo->Tags[0] )
+		{
+			MetaData->GetCategoryVideos( categories[i], PlaylistItems );
+			break;
+		}
+	}
 
-		if ( MenuState != MENU_VIDEO_PLAYING ) // If video is already being played dont change the state to video ready
+	int currentIndex = -1;
+	Array< String > urls;
+	for ( int i = 0; i < PlaylistItems.GetSizeI(); i++ )
+	{
+		if ( PlaylistItems[i] == ActiveVideo )
 		{
-			SetMenuState( MENU_VIDEO_READY );
+			currentIndex = i;
 		}
+		urls.PushBack( PlaylistItems[i]->Url );
+	}
+	Playlist.SetItems( urls, currentIndex );
+}
 
+void Oculus360Videos::AdvancePlaylist()
+{
+	const PlaylistSession::eAdvanceResult result = Playlist.Advance();
+	const int index = Playlist.GetCurrentIndex();
+	if ( result == PlaylistSession::ADVANCE_END || index < 0 || index >= PlaylistItems.GetSizeI() )
+	{
+		SetMenuState( MENU_BROWSER );
 		return;
 	}
-	else if ( MatchesHead( "resume ", msg ) )
+
+	ActiveVideo = PlaylistItems[index];
+	if ( result == PlaylistSession::ADVANCE_COLD )
 	{
-		OnResume();
-		return;	// allow VrLib to handle it, too
+		StartVideo( ovr_GetTimeInSeconds() );
+		return;
 	}
-	else if ( MatchesHead( "pause ", msg ) )
+
+	// The second player already has the start of the video decoded into its
+	// surface, swap textures and keep playing without a fade.
+	VideoName = ActiveVideo->Url;
+	LOG( "AdvancePlaylist: promoted preloaded '%s'", VideoName.ToCStr() );
+	MovieTexturePool.Recycle( MovieTexture );
+	MovieTexture = MovieTexturePool.Get( PreloadTextureIndex );
+	PreloadTextureIndex = -1;
+
+	PendingPlayCommand = PLAYER_COMMAND_NONE;
+	StartKeyframeIndex( VideoName.ToCStr() );
+	StartSoundtrack( VideoName.ToCStr() );
+	Subtitles.LoadForVideo( VideoName.ToCStr() );
+	ActivePathHash = PositionJournal::HashPath( VideoName.ToCStr() );
+	NextCheckpointTime = ovr_GetTimeInSeconds() + PositionCheckpointInterval;
+	PlaybackStateData state;
+	state.Playing = true;
+	PlaybackState.Write( state );
+}
+
+void Oculus360Videos::PreloadVideo( const char * url, const int generation )
+{
+	if ( PreloadMovieMethodId == NULL )
 	{
-		OnPause();
-		return;	// allow VrLib to handle it, too
+		Playlist.OnPreloadFailed( generation );
+		return;
 	}
-	else if ( MatchesHead( "startError", msg ) )
+	String playbackUrl = url;
+	for ( int i = 0; i < PlaylistItems.GetSizeI(); i++ )
 	{
-		// FIXME: this needs to do some parameter magic to fix xliff tags
-		String message;
-		VrLocale::GetString( app->GetVrJni(), app->GetJavaObject(), "@string/playback_failed", "@string/playback_failed", message );
-		String fileName = ExtractFile( ActiveVideo->Url );
-		message = VrLocale::GetXliffFormattedString( message, fileName );
-		BitmapFont & font = app->GetDefaultFont();
-		font.WordWrapText( message, 1.0f );
-		app->ShowInfoText( 4.5f, message );
-		SetMenuState( MENU_BROWSER );
-		return;
+		if ( PlaylistItems[i]->Url == url )
+		{
+			playbackUrl = GetPlaybackUrl( *PlaylistItems[i] );
+			break;
+		}
 	}
+	jstring jstr = app->GetVrJni()->NewStringUTF( playbackUrl.ToCStr() );
+	app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), PreloadMovieMethodId, jstr, generation, GetResumePosition( url ) );
+	app->GetVrJni()->DeleteLocalRef( jstr );
+}
 
+void Oculus360Videos::PromotePreload( const int generation )
+{
+	if ( PromotePreloadMethodId != NULL )
+	{
+		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), PromotePreloadMethodId, generation );
+	}
+}
+
+void Oculus360Videos::DiscardPreload( const int generation )
+{
+	if ( DiscardPreloadMethodId != NULL )
+	{
+		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), DiscardPreloadMethodId, generation );
+	}
+	RecyclePreloadTexture();
+}
+
+void Oculus360Videos::OnVideoStartError()
+{
+	if ( ActiveVideo == NULL )
+	{
+		return;
+	}
+	char formatted[LocalizedStrings::MAX_FORMATTED];
+	Strings.Format( "@string/playback_failed", "@string/playback_failed", ExtractFile( ActiveVideo->Url ).ToCStr(),
+		formatted, sizeof( formatted ) );
+	String message( formatted );
+	BitmapFont & font = app->GetDefaultFont();
+	font.WordWrapText( message, 1.0f );
+	app->ShowInfoText( 4.5f, message );
+	SetMenuState( MENU_BROWSER );
 }
 
 Matrix4f	Oculus360Videos::TexmForVideo( const int eye )
@@ -614,6 +1037,10 @@ Matrix4f Oculus360Videos::DrawEyeView( const int eye, const float fovDegrees )
 			glBindTexture( GL_TEXTURE_2D, 0 ); // don't leave it bound
 		}
 	}
+	else if ( ( MenuState == MENU_VIDEO_PLAYING ) && ( MovieTexture != NULL ) && DrawSeekPreview( eye, fovDegrees ) )
+	{
+		// the movie texture still shows the old position
+	}
 	else if ( ( MenuState == MENU_VIDEO_PLAYING ) && ( MovieTexture != NULL ) )
 	{
 		// draw animated movie panorama
@@ -647,6 +1074,44 @@ Matrix4f Oculus360Videos::DrawEyeView( const int eye, const float fovDegrees )
 	return mvp;
 }
 
+bool Oculus360Videos::DrawSeekPreview( const int eye, const float fovDegrees )
+{
+	if ( !Seeks.IsSeeking() && !Seeks.IsAwaitingFrame() )
+	{
+		return false;
+	}
+	GLuint texture;
+	Matrix4f cellTexm;
+	const int previewMs = Seeks.IsSeeking() ? Seeks.GetTargetMs() : GetCurrentPosition();
+	if ( !TrickPlay.GetPreview( previewMs, texture, cellTexm ) )
+	{
+		return false;
+	}
+
+	glActiveTexture( GL_TEXTURE0 );
+	glBindTexture( GL_TEXTURE_2D, texture );
+
+	glDisable( GL_DEPTH_TEST );
+	glDisable( GL_CULL_FACE );
+
+	glUseProgram( PreviewPanoramaProgram.program );
+	glUniform4f( PreviewPanoramaProgram.uColor, 1.0f, 1.0f, 1.0f, 1.0f );
+
+	const Matrix4f view = Scene.ViewMatrixForEye( 0 ) * Matrix4f::RotationY( M_PI / 2 );
+	const Matrix4f proj = Scene.ProjectionMatrixForEye( 0, fovDegrees );
+
+	// the thumbnail is a small copy of the whole frame, stereo layout included
+	const int toggleStereo = VideoMenu->IsOpenOrOpening() ? 0 : eye;
+	const Matrix4f texm = cellTexm * TexmForVideo( toggleStereo );
+
+	glUniformMatrix4fv( PreviewPanoramaProgram.uTexm, 1, GL_FALSE, texm.Transposed().M[ 0 ] );
+	glUniformMatrix4fv( PreviewPanoramaProgram.uMvp, 1, GL_FALSE, ( proj * view ).Transposed().M[ 0 ] );
+	Globe.Draw();
+
+	glBindTexture( GL_TEXTURE_2D, 0 );	// don't leave it bound
+	return true;
+}
+
 float Fade( double now, double start, double length )
 {
 	return OVR::Alg::Clamp( ( ( now - start ) / length ), 0.0, 1.0 );
@@ -654,48 +1119,50 @@ float Fade( double now, double start, double length )
 
 bool Oculus360Videos::IsVideoPlaying() const
 {
-	jmethodID methodId = app->GetVrJni()->GetMethodID( MainActivityClass, "isPlaying", "()Z" );
-	if ( !methodId )
-	{
-		LOG( "Couldn't find isPlaying methodID" );
-		return false;
-	}
-
-	bool isPlaying = app->GetVrJni()->CallBooleanMethod( app->GetJavaObject(), methodId );
-	return isPlaying;
+	return PlaybackState.Read().Playing;
 }
 
 void Oculus360Videos::PauseVideo( bool const force )
 {
 	LOG( "PauseVideo()" );
 
-	jmethodID methodId = app->GetVrJni()->GetMethodID( MainActivityClass,
-		"pauseMovie", "()V" );
-	if ( !methodId )
-	{
-		LOG( "Couldn't find pauseMovie methodID" );
-		return;
-	}
+	CheckpointPosition( GetCurrentPosition() );
 
-	app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), methodId );
+	// Sent with the next batch of player commands, reflect it in the state block right away.
+	PendingPlayCommand = PLAYER_COMMAND_PAUSE;
+	PlaybackState.SetPlaying( false );
 }
 
 void Oculus360Videos::StopVideo()
 {
 	LOG( "StopVideo()" );
 
-	jmethodID methodId = app->GetVrJni()->GetMethodID( MainActivityClass,
-		"stopMovie", "()V" );
-	if ( !methodId )
+	// The SurfaceTexture is recycled below, so the player has to stop now rather than with the next batch.
+	Playlist.Clear();
+	PlaylistItems.Clear();
+	CheckpointPosition( GetCurrentPosition() );
+	ActivePathHash = 0;
+	PendingPlayCommand = PLAYER_COMMAND_NONE;
+	LogSeekStats();
+	Seeks.Reset();
+	KeyframeLoader.Cancel();
+	Keyframes.Clear();
+	StopTrickPlay();
+	StopSoundtrack();
+	Subtitles.Clear();
+	if ( StopMovieMethodId != NULL )
 	{
-		LOG( "Couldn't find stopMovie methodID" );
-		return;
+		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), StopMovieMethodId );
 	}
+	PlaybackState.Write( PlaybackStateData() );
 
-	app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), methodId );
-
-	delete MovieTexture;
+	MovieTexturePool.Recycle( MovieTexture );
 	MovieTexture = NULL;
+
+	LOG( "Player events: %i drained, %.3f ms average, %.3f ms max latency, %i dropped",
+		PlayerEvents.GetLatencyCount(), PlayerEvents.GetLatencyAverage() * 1000.0,
+		PlayerEvents.GetLatencyMax() * 1000.0, PlayerEvents.GetDropped() );
+	PlayerEvents.ResetLatency();
 }
 
 void Oculus360Videos::ResumeVideo()
@@ -704,15 +1171,8 @@ void Oculus360Videos::ResumeVideo()
 
 	app->GetGuiSys().CloseMenu( app, Browser, false );
 
-	jmethodID methodId = app->GetVrJni()->GetMethodID( MainActivityClass,
-		"resumeMovie", "()V" );
-	if ( !methodId )
-	{
-		LOG( "Couldn't find resumeMovie methodID" );
-		return;
-	}
-
-	app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), methodId );
+	PendingPlayCommand = PLAYER_COMMAND_RESUME;
+	PlaybackState.SetPlaying( true );
 }
 
 void Oculus360Videos::StartVideo( const double nowTime )
@@ -722,20 +1182,30 @@ void Oculus360Videos::StartVideo( const double nowTime )
 		SetMenuState( MENU_VIDEO_LOADING );
 		VideoName = ActiveVideo->Url;
 		LOG( "StartVideo( %s )", ActiveVideo->Url.ToCStr() );
-		app->PlaySound( "sv_select" );
-
-		jmethodID startMovieMethodId = app->GetVrJni()->GetMethodID( MainActivityClass,
-			"startMovieFromNative", "(Ljava/lang/String;)V" );
+		PlayUiSound( "sv_select", Browser->GetMenuPose().Position );
 
-		if ( !startMovieMethodId )
+		if ( !StartMovieMethodId )
 		{
 			LOG( "Couldn't find startMovie methodID" );
 			return;
 		}
 
-		LOG( "moviePath = '%s'", ActiveVideo->Url.ToCStr() );
-		jstring jstr = app->GetVrJni()->NewStringUTF( ActiveVideo->Url );
-		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), startMovieMethodId, jstr );
+		PendingPlayCommand = PLAYER_COMMAND_NONE;
+		StartKeyframeIndex( ActiveVideo->Url.ToCStr() );
+		StartSoundtrack( ActiveVideo->Url.ToCStr() );
+		Subtitles.LoadForVideo( ActiveVideo->Url.ToCStr() );
+		PlaybackState.Write( PlaybackStateData() );
+
+		ActivePathHash = PositionJournal::HashPath( ActiveVideo->Url.ToCStr() );
+		NextCheckpointTime = ovr_GetTimeInSeconds() + PositionCheckpointInterval;
+		const int resumePosition = GetResumePosition( ActiveVideo->Url.ToCStr() );
+
+		StartVideoTime = PlayerEventRing::GetTimeInSeconds();
+		// resume positions stay keyed on the real url, only the player sees the proxy's
+		const String playbackUrl = GetPlaybackUrl( *ActiveVideo );
+		LOG( "moviePath = '%s' resume at %i", playbackUrl.ToCStr(), resumePosition );
+		jstring jstr = app->GetVrJni()->NewStringUTF( playbackUrl.ToCStr() );
+		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), StartMovieMethodId, jstr, resumePosition );
 		app->GetVrJni()->DeleteLocalRef( jstr );
 
 		LOG( "StartVideo done" );
@@ -746,64 +1216,346 @@ void Oculus360Videos::SeekTo( const int seekPos )
 {
 	if ( ActiveVideo )
 	{
-		jmethodID seekToMethodId = app->GetVrJni()->GetMethodID( MainActivityClass,
-			"seekToFromNative", "(I)V" );
+		const double now = PlaybackStateBlock::GetTimeInSeconds();
+		const int target = Seeks.RequestSeek( Alg::Max( seekPos, 0 ), GetCurrentPosition(), now );
+		PlaybackState.HoldPosition( target, Seeks.GetTargetId() );
+	}
+}
+
+void Oculus360Videos::SeekToRelative( const int seekRelativePos )
+{
+	if ( ActiveVideo )
+	{
+		// Continue from the target of a seek still pending or in flight, so bursts accumulate
+		// even if the player reports its old position in the meantime.
+		int seekPos = ( Seeks.IsSeeking() ? Seeks.GetTargetMs() : GetCurrentPosition() ) + seekRelativePos;
+		const int duration = GetDuration();
+		if ( duration > 0 && seekPos > duration )
+		{
+			seekPos = duration;
+		}
+		SeekTo( seekPos );
+	}
+}
+
+void Oculus360Videos::SeekToChapter( const int direction )
+{
+	const OvrVideosMetaDatum * videoData = static_cast< const OvrVideosMetaDatum * >( ActiveVideo );
+	if ( videoData == NULL || videoData->Chapters.IsEmpty() )
+	{
+		return;
+	}
+	const ChapterIndex & chapters = videoData->Chapters;
+
+	// Chapters are sought to on the keyframe at or before their start, so one
+	// just sought to counts as current even though the position is short of it.
+	const int position = Seeks.IsSeeking() ? Seeks.GetTargetMs() : GetCurrentPosition();
+	int current = chapters.FindChapter( position );
+	while ( current + 1 < chapters.GetCount() && Keyframes.Floor( chapters.GetStartMs( current + 1 ) ) <= position )
+	{
+		current++;
+	}
 
-		if ( !seekToMethodId )
+	int target;
+	if ( direction > 0 )
+	{
+		target = current + 1;
+		if ( target >= chapters.GetCount() )
 		{
-			LOG( "Couldn't find seekToMethodId methodID" );
 			return;
 		}
+	}
+	else
+	{
+		const bool justStarted = current < 0 || position - Keyframes.Floor( chapters.GetStartMs( current ) ) < ChapterRestartMs;
+		target = justStarted ? current - 1 : current;
+	}
+	const int targetMs = ( target >= 0 ) ? Keyframes.Floor( chapters.GetStartMs( target ) ) : 0;
+	LOG( "SeekToChapter: %i '%s' at %i", target, ( target >= 0 ) ? chapters.GetTitle( target ) : "", targetMs );
+	SeekTo( targetMs );
+}
 
-		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), seekToMethodId, seekPos );
+void Oculus360Videos::IssueSeek( const int positionMs, const int seekId )
+{
+	if ( SeekToMethodId != NULL )
+	{
+		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), SeekToMethodId, positionMs, seekId );
+		LOG( "SeekTo %i sent as seek %i", positionMs, seekId );
+	}
+}
 
-		LOG( "SeekTo %i done", seekPos );
+void Oculus360Videos::AbandonSeek( const int seekId )
+{
+	PlaybackState.ReleasePosition( seekId );
+}
+
+void Oculus360Videos::StartKeyframeIndex( const char * url )
+{
+	LogSeekStats();
+	Seeks.Reset();
+	Keyframes.Clear();
+	StopTrickPlay();
+	// only local files, streams are left to the player
+	if ( url != NULL && url[0] == '/' )
+	{
+		const OvrVideosMetaDatum * videoData = static_cast< const OvrVideosMetaDatum * >( ActiveVideo );
+		KeyframeLoader.Start( url, videoData != NULL && !videoData->ChaptersLoaded );
+		TrickPlay.Start( url );
+	}
+	else
+	{
+		KeyframeLoader.Cancel();
 	}
 }
 
-void Oculus360Videos::SeekToRelative( const int seekRelativePos )
+void Oculus360Videos::StartSoundtrack( const char * url )
 {
-	if ( ActiveVideo )
+	StopSoundtrack();
+	// the Java side mutes the player when the sidecar exists
+	if ( url != NULL && url[0] == '/' && Soundtrack.Open( url, PlaybackState ) )
 	{
-		jmethodID seekToMethodId = app->GetVrJni()->GetMethodID( MainActivityClass,
-			"seekToRelativeFromNative", "(I)V" );
+		if ( OpenAudio() )
+		{
+			Audio.AddSource( &Soundtrack );
+		}
+		else
+		{
+			Soundtrack.Close();
+		}
+	}
+}
 
-		if ( !seekToMethodId )
+void Oculus360Videos::StopSoundtrack()
+{
+	Audio.RemoveSource( &Soundtrack );
+	const AmbisonicRenderer & renderer = Soundtrack.GetRenderer();
+	if ( Soundtrack.IsOpen() && renderer.GetBlockCount() > 0 )
+	{
+		LOG( "Ambisonic soundtrack: %i blocks, %.3f ms average, %.3f ms max of a %.3f ms budget, %i resyncs",
+			renderer.GetBlockCount(), renderer.GetBlockSecondsAverage() * 1000.0, renderer.GetBlockSecondsMax() * 1000.0,
+			renderer.GetBlockBudgetSeconds() * 1000.0, Soundtrack.GetResyncCount() );
+	}
+	Soundtrack.Close();
+}
+
+// Opens the native output the first time a soundtrack or an interface
+// sound needs it, and doesn't try again if that failed.
+bool Oculus360Videos::OpenAudio()
+{
+	if ( !Audio.IsOpen() && !AudioOpenFailed )
+	{
+		AudioOpenFailed = !Audio.Open();
+		if ( !AudioOpenFailed )
 		{
-			LOG( "Couldn't find seekToMethodId methodID" );
-			return;
+			Audio.AddSource( &UiSounds );
 		}
+	}
+	return Audio.IsOpen();
+}
 
-		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), seekToMethodId, seekRelativePos );
+// Sounds not in the package are left to the platform's SoundManager.
+void Oculus360Videos::LoadUiSound( const char * name )
+{
+	String path( "assets/sounds/" );
+	path += name;
+	path += ".wav";
+	void * buffer = NULL;
+	int length = 0;
+	ovr_ReadFileFromApplicationPackage( path.ToCStr(), length, buffer );
+	if ( buffer != NULL )
+	{
+		WavFile wav;
+		if ( !wav.OpenMemory( buffer, length, path.ToCStr() ) || !UiSounds.AddSound( name, wav ) )
+		{
+			LOG( "LoadUiSound: couldn't use '%s'", path.ToCStr() );
+		}
+		wav.Close();
+		free( buffer );
+	}
+}
 
-		LOG( "SeekToRelative %i done", seekRelativePos );
+void Oculus360Videos::PlayUiSound( const char * name, const Vector3f & position )
+{
+	// the platform path is the fallback when the sound isn't ours or there is no native output
+	if ( !UiSounds.HasSound( name ) || !OpenAudio() || !UiSounds.Play( name, position, Scene.CenterViewMatrix() ) )
+	{
+		app->PlaySound( name );
 	}
 }
 
-int Oculus360Videos::GetCurrentPosition() const
+void Oculus360Videos::DrawSubtitles()
 {
-	jmethodID methodId = app->GetVrJni()->GetMethodID( MainActivityClass, "getCurrentPositionFromNative", "()I" );
-	if ( !methodId )
+	const int cueIndex = Subtitles.FindCue( GetCurrentPosition() );
+	if ( cueIndex < 0 )
 	{
-		LOG( "Couldn't find getCurrentPositionFromNative methodID" );
-		return -1;
+		return;
 	}
+	BitmapFont & font = app->GetDefaultFont();
+	const SubtitleCue & cue = Subtitles.GetLayout( cueIndex, font, SubtitleWidth );
+
+	// World locked text sits below the center of the video, where the view is recentered to.
+	const Vector3f offset( 0.0f, -SubtitleDrop, -SubtitleDistance );
+	const Vector3f position = SubtitlesHeadLocked ? Scene.CenterViewMatrix().Inverted().Transform( offset ) : offset;
+
+	fontParms_t parms;
+	parms.AlignHoriz = HORIZONTAL_CENTER;
+	parms.AlignVert = VERTICAL_CENTER;
+	parms.Billboard = true;
+	parms.TrackRoll = SubtitlesHeadLocked;
+	app->GetWorldFontSurface().DrawTextBillboarded3D( font, parms, position, SubtitleScale,
+		Vector4f( 1.0f, 1.0f, 1.0f, 1.0f ), cue.Layout.ToCStr() );
+}
 
-	int curPos = app->GetVrJni()->CallIntMethod( app->GetJavaObject(), methodId );
-	return curPos;
+void Oculus360Videos::StopTrickPlay()
+{
+	if ( TrickPlay.GetDecodedFrames() > 0 )
+	{
+		const double seconds = TrickPlay.GetDecodeSeconds();
+		LOG( "Trick play: %i frames decoded, %.1f frames/s, %i KB CPU, %i KB GPU",
+			TrickPlay.GetDecodedFrames(), seconds > 0.0 ? TrickPlay.GetDecodedFrames() / seconds : 0.0,
+			TrickPlay.GetCpuBytes() >> 10, TrickPlay.GetGpuBytes() >> 10 );
+	}
+	TrickPlay.Stop();
 }
 
-int Oculus360Videos::GetDuration() const
+void Oculus360Videos::LogSeekStats()
+{
+	if ( Seeks.GetIssuedCount() > 0 )
+	{
+		LOG( "Seeks: %i sent, %i coalesced, %.1f ms average to complete, %.1f ms average / %.1f ms max to first frame",
+			Seeks.GetIssuedCount(), Seeks.GetCoalescedCount(), Seeks.GetSeekLatencyAverage() * 1000.0,
+			Seeks.GetFirstFrameLatencyAverage() * 1000.0, Seeks.GetFirstFrameLatencyMax() * 1000.0 );
+	}
+	Seeks.ResetStats();
+}
+
+int Oculus360Videos::GetResumePosition( const char * url ) const
+{
+	int position;
+	int duration;
+	if ( !ResumePositions.GetPosition( PositionJournal::HashPath( url ), position, duration ) )
+	{
+		return 0;
+	}
+	if ( position < 0 || ( duration > 0 && position > duration - ResumeEndMarginMs ) )
+	{
+		return 0;
+	}
+	return position;
+}
+
+bool Oculus360Videos::CanDownloadVideo( const OvrMetaDatum * videoData ) const
+{
+	const OvrVideosMetaDatum * datum = static_cast< const OvrVideosMetaDatum * >( videoData );
+	return datum != NULL && SearchPaths.GetSizeI() > 0 && strncmp( datum->Url.ToCStr(), "http://", 7 ) == 0 &&
+		!Downloads.IsQueued( datum->Url.ToCStr() );
+}
+
+void Oculus360Videos::DownloadVideo( const OvrMetaDatum * videoData )
+{
+	if ( !CanDownloadVideo( videoData ) )
+	{
+		return;
+	}
+	// the last search path is the primary storage root
+	const String dir = SearchPaths.Back() + videosDirectory + DownloadsCategory + "/";
+	for ( const char * slash = strchr( dir.ToCStr() + SearchPaths.Back().GetSize(), '/' ); slash != NULL; slash = strchr( slash + 1, '/' ) )
+	{
+		mkdir( String( dir.ToCStr(), slash - dir.ToCStr() ).ToCStr(), 0755 );
+	}
+	String fileName = ExtractFile( videoData->Url );
+	const char * query = strchr( fileName.ToCStr(), '?' );
+	if ( query != NULL )
+	{
+		fileName = String( fileName.ToCStr(), query - fileName.ToCStr() );
+	}
+	const OvrVideosMetaDatum * datum = static_cast< const OvrVideosMetaDatum * >( videoData );
+	Downloads.Enqueue( videoData->Url.ToCStr(), ( dir + fileName ).ToCStr(), datum->StreamingLicenseUrl.ToCStr() );
+}
+
+// Each line of the first network_shares.txt found is the http url of a
+// WebDAV folder; blank lines and lines starting with # are skipped.
+void Oculus360Videos::StartMediaSources( const char * cacheDir, const Array< String > & extensions )
+{
+	FILE * f = NULL;
+	for ( int i = 0; i < SearchPaths.GetSizeI() && f == NULL; i++ )
+	{
+		f = fopen( ( SearchPaths[i] + videosDirectory + NetworkSharesName ).ToCStr(), "r" );
+	}
+	if ( f == NULL )
+	{
+		return;
+	}
+	const String sourceCacheDir = String( cacheDir ) + "/" + WebDavCacheName;
+	char line[1024];
+	while ( fgets( line, sizeof( line ), f ) != NULL )
+	{
+		char * start = line + strspn( line, " \t" );
+		char * end = start + strcspn( start, "\r\n" );
+		while ( end > start && ( end[-1] == ' ' || end[-1] == '\t' ) )
+		{
+			end--;
+		}
+		*end = 0;
+		if ( *start == 0 || *start == '#' )
+		{
+			continue;
+		}
+		LOG( "Listing network share %s", start );
+		MediaSource * source = new WebDavSource( start, sourceCacheDir.ToCStr(), extensions );
+		source->Start();
+		MediaSources.PushBack( source );
+	}
+	fclose( f );
+}
+
+String Oculus360Videos::GetPlaybackUrl( const OvrMetaDatum & datum )
 {
-	jmethodID methodId = app->GetVrJni()->GetMethodID( MainActivityClass, "getDurationFromNative", "()I" );
-	if ( !methodId )
+	// "none" opts a video out, and HLS goes through the proxy by default
+	// so it can pick the variant per segment
+	const OvrVideosMetaDatum & videoData = static_cast< const OvrVideosMetaDatum & >( datum );
+	const bool hls = videoData.StreamingType == HlsStreamingType || CacheProxy::IsPlaylistUrl( datum.Url.ToCStr() );
+	if ( ( videoData.StreamingProxy.IsEmpty() && !hls ) || videoData.StreamingProxy == "none" ||
+		!Proxy.IsRunning() )
 	{
-		LOG( "Couldn't find getDurationFromNative methodID" );
-		return -1;
+		return datum.Url;
 	}
+	return Proxy.GetProxyUrl( datum.Url.ToCStr() );
+}
 
-	int duration = app->GetVrJni()->CallIntMethod( app->GetJavaObject(), methodId );
-	return duration;
+void Oculus360Videos::CheckpointPosition( const int positionMs )
+{
+	// nothing is known about the video until the player reports its duration
+	const int duration = PlaybackState.Read().DurationMs;
+	if ( ActivePathHash != 0 && duration > 0 )
+	{
+		ResumePositions.Checkpoint( ActivePathHash, positionMs, duration );
+	}
+}
+
+int Oculus360Videos::GetCurrentPosition() const
+{
+	return PlaybackState.Read().GetPositionAt( PlaybackStateBlock::GetTimeInSeconds() );
+}
+
+int Oculus360Videos::GetDuration() const
+{
+	return PlaybackState.Read().DurationMs;
+}
+
+void Oculus360Videos::FlushPlayerCommands()
+{
+	Seeks.Update( PlaybackStateBlock::GetTimeInSeconds() );
+
+	if ( PendingPlayCommand == PLAYER_COMMAND_PAUSE && PauseMovieMethodId != NULL )
+	{
+		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), PauseMovieMethodId );
+	}
+	else if ( PendingPlayCommand == PLAYER_COMMAND_RESUME && ResumeMovieMethodId != NULL )
+	{
+		app->GetVrJni()->CallVoidMethod( app->GetJavaObject(), ResumeMovieMethodId );
+	}
+	PendingPlayCommand = PLAYER_COMMAND_NONE;
 }
 
 void Oculus360Videos::SetMenuState( const OvrMenuState state )
@@ -811,6 +1563,8 @@ void Oculus360Videos::SetMenuState( const OvrMenuState state )
 	OvrMenuState lastState = MenuState;
 	MenuState = state;
 	LOG( "%s to %s", MenuStateString( lastState ), MenuStateString( MenuState ) );
+	// before the player can open a file that might be replaced
+	Faststart.SetPaused( MenuState != MENU_BROWSER );
 	switch ( MenuState )
 	{
 	case MENU_NONE:
@@ -827,11 +1581,8 @@ void Oculus360Videos::SetMenuState( const OvrMenuState state )
 		}
 		break;
 	case MENU_VIDEO_LOADING:
-		if ( MovieTexture != NULL )
-		{
-			delete MovieTexture;
-			MovieTexture = NULL;
-		}
+		MovieTexturePool.Recycle( MovieTexture );
+		MovieTexture = NULL;
 		app->GetGuiSys().CloseMenu( app, Browser, false );
 		app->GetGuiSys().CloseMenu( app, VideoMenu, false );
 		Fader.StartFadeOut();
@@ -867,11 +1618,17 @@ const char* Oculus360Videos::MenuStateString( const OvrMenuState state )
 void Oculus360Videos::OnVideoActivated( const OvrMetaDatum * videoData )
 {
 	ActiveVideo = videoData;
+	if ( PlaylistMode )
+	{
+		BuildPlaylist();
+	}
 	StartVideo( ovr_GetTimeInSeconds() );
 }
 
 Matrix4f Oculus360Videos::Frame( const VrFrame vrFrame )
 {
+	DrainPlayerEvents();
+
 	// Disallow player foot movement, but we still want the head model
 	// movement for the swipe view.
 	VrFrame vrFrameWithoutMove = vrFrame;
@@ -879,13 +1636,61 @@ Matrix4f Oculus360Videos::Frame( const VrFrame vrFrame )
 	vrFrameWithoutMove.Input.sticks[ 0 ][ 1 ] = 0.0f;
 	Scene.Frame( app->GetVrViewParms(), vrFrameWithoutMove, app->GetSwapParms().ExternalVelocity );
 
+	if ( Proxy.IsRunning() && MenuState == MENU_VIDEO_PLAYING )
+	{
+		const double now = ovr_GetTimeInSeconds();
+		if ( now - ProxyPositionSyncTime > ProxyPositionSyncInterval )
+		{
+			ProxyPositionSyncTime = now;
+			Proxy.SetPlayPosition( GetCurrentPosition() * 0.001, IsVideoPlaying() );
+		}
+	}
+
+	TrickPlay.Frame();
+	Soundtrack.SetHeadRotation( Scene.CenterViewMatrix() );
+
+	ChapterIndex chapters;
+	if ( KeyframeLoader.Poll( Keyframes, chapters ) )
+	{
+		LOG( "Keyframe index: %i keyframes", Keyframes.GetCount() );
+		Seeks.SetKeyframeIndex( Keyframes.IsEmpty() ? NULL : &Keyframes );
+		const OvrVideosMetaDatum * videoData = static_cast< const OvrVideosMetaDatum * >( ActiveVideo );
+		if ( videoData != NULL && !videoData->ChaptersLoaded )
+		{
+			videoData->Chapters.Swap( chapters );
+			videoData->ChaptersLoaded = true;
+		}
+	}
+
+	Array< String > downloaded;
+	Downloads.TakeFinished( downloaded );
+	for ( int i = 0; i < downloaded.GetSizeI(); i++ )
+	{
+		MetaData->AddVideo( downloaded[i].ToCStr(), DownloadsCategory );
+	}
+	for ( int i = 0; i < MediaSources.GetSizeI(); i++ )
+	{
+		Array< MediaSourceEntry > found;
+		MediaSources[i]->TakeEntries( found );
+		for ( int j = 0; j < found.GetSizeI(); j++ )
+		{
+			MetaData->AddVideo( found[j].Url.ToCStr(), found[j].Category.ToCStr() );
+		}
+	}
+	Browser->ApplyChanges();
+
 	// Check for new video frames
 	// latch the latest movie frame to the texture.
 	if ( MovieTexture && CurrentVideoWidth ) {
+		const bool newFrame = FrameAvailable;
 		glActiveTexture( GL_TEXTURE0 );
 		MovieTexture->Update();
 		glBindTexture( GL_TEXTURE_EXTERNAL_OES, 0 );
 		FrameAvailable = false;
+		if ( newFrame )
+		{
+			Seeks.OnFrameLatched( PlaybackStateBlock::GetTimeInSeconds() );
+		}
 	}
 
 	if ( MenuState != MENU_BROWSER && MenuState != MENU_VIDEO_LOADING )
@@ -920,7 +1725,6 @@ Matrix4f Oculus360Videos::Frame( const VrFrame vrFrame )
 
 		if ( vrFrame.Input.buttonReleased & ( BUTTON_TOUCH | BUTTON_A ) )
 		{
-			app->PlaySound( "sv_release_active" );
 			if ( IsVideoPlaying() )
 			{
 				app->GetGuiSys().OpenMenu( app, app->GetGazeCursor(), OvrVideoMenu::MENU_NAME );
@@ -932,9 +1736,34 @@ Matrix4f Oculus360Videos::Frame( const VrFrame vrFrame )
 				app->GetGuiSys().CloseMenu( app, VideoMenu, false );
 				ResumeVideo();
 			}
+			PlayUiSound( "sv_release_active", VideoMenu->GetMenuPose().Position );
+		}
+	}
+
+	// Send this frame's player commands in one batch.
+	FlushPlayerCommands();
+
+	if ( MenuState == MENU_VIDEO_PLAYING && ActivePathHash != 0 && ovr_GetTimeInSeconds() >= NextCheckpointTime )
+	{
+		NextCheckpointTime = ovr_GetTimeInSeconds() + PositionCheckpointInterval;
+		const PlaybackStateData state = PlaybackState.Read();
+		if ( state.Playing )
+		{
+			CheckpointPosition( state.GetPositionAt( PlaybackStateBlock::GetTimeInSeconds() ) );
 		}
 	}
 
+	// Warm up the next video once this one is actually playing.
+	if ( PlaylistMode && MenuState == MENU_VIDEO_PLAYING )
+	{
+		Playlist.StartPreload();
+	}
+
+	if ( MenuState == MENU_VIDEO_PLAYING && !Subtitles.IsEmpty() )
+	{
+		DrawSubtitles();
+	}
+
 	// State transitions
 	if ( Fader.GetFadeState() != Fader::FADE_NONE )
 	{
@@ -961,22 +1790,38 @@ Matrix4f Oculus360Videos::Frame( const VrFrame vrFrame )
 void Oculus360Videos::OnResume()
 {
 	LOG( "Oculus360Videos::OnResume" );
+	Faststart.SetPaused( MenuState != MENU_BROWSER );
+	if ( Browser != NULL )
+	{
+		// the thumbnail budget shrunk for whatever was pressing while we were away
+		Browser->TrimMemory( 0 );
+	}
+	if ( MetaData != NULL )
+	{
+		// videos may have been deleted or replaced while we were away; the
+		// next frame's ApplyChanges rebuilds the rows they were in
+		MetaData->RescanFiles();
+	}
 	if ( VideoWasPlayingWhenPaused )
 	{
 		app->GetGuiSys().OpenMenu( app, app->GetGazeCursor(), OvrVideoMenu::MENU_NAME );
 		VideoMenu->RepositionMenu( app );
 		PauseVideo( false );
+		FlushPlayerCommands();
 	}
 }
 
 void Oculus360Videos::OnPause()
 {
 	LOG( "Oculus360Videos::OnPause" );
+	Faststart.SetPaused( true );
 	VideoWasPlayingWhenPaused = IsVideoPlaying();
 	if ( VideoWasPlayingWhenPaused )
 	{
 		PauseVideo( false );
 	}
+	// there may not be another frame before the activity pauses
+	FlushPlayerCommands();
 }
 
 }
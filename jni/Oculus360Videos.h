@@ -18,6 +18,22 @@ of patent rights can be found in the PATENTS file in the same directory.
 
 #include "VRMenu/Fader.h"
 #include "ModelView.h"
+#include "PlayerEventRing.h"
+#include "PlaybackState.h"
+#include "SurfaceTexturePool.h"
+#include "PlaylistSession.h"
+#include "KeyframeIndex.h"
+#include "SeekScheduler.h"
+#include "PositionJournal.h"
+#include "TrickPlay.h"
+#include "AudioOutput.h"
+#include "AmbisonicSoundtrack.h"
+#include "UiSoundMixer.h"
+#include "Subtitles.h"
+#include "Faststart.h"
+#include "CacheProxy.h"
+#include "DownloadManager.h"
+#include "LocalizedStrings.h"
 
 namespace OVR {
 
@@ -26,6 +42,7 @@ class OvrMetaData;
 struct OvrMetaDatum;
 class VideoBrowser;
 class OvrVideoMenu;
+class MediaSource;
 
 enum Action
 {
@@ -35,7 +52,7 @@ enum Action
 	ACT_VIDEOS,
 };
 
-class Oculus360Videos : public OVR::VrAppInterface
+class Oculus360Videos : public OVR::VrAppInterface, public PlaylistPlayerBackend, public SeekBackend
 {
 public:
 
@@ -68,6 +85,9 @@ public:
 	void 				StartVideo( const double nowTime );
 	void				SeekTo( const int seekPos );
 	void				SeekToRelative( const int seekRelativePos );
+	// Next chapter for a positive direction, else the start of this one or,
+	// right after it started, the previous one.
+	void				SeekToChapter( const int direction );
 	int					GetCurrentPosition() const;
 	int					GetDuration() const;
 
@@ -80,10 +100,23 @@ public:
 	OvrMenuState		GetCurrentState() const				{ return  MenuState; }
 
 	void				SetFrameAvailable( bool const a ) { FrameAvailable = a; }
+	PlayerEventRing &	GetPlayerEvents()	{ return PlayerEvents; }
+	PlaybackStateBlock &	GetPlaybackState()	{ return PlaybackState; }
+	SurfaceTexturePool &	GetMovieTexturePool()	{ return MovieTexturePool; }
 
 	void				OnVideoActivated( const OvrMetaDatum * videoData );
+	void				SetPlaylistMode( const bool enabled );
+	bool				GetPlaylistMode() const				{ return PlaylistMode; }
+	// Subtitles follow the head, or stay under the center of the video.
+	void				SetSubtitlesHeadLocked( const bool headLocked )	{ SubtitlesHeadLocked = headLocked; }
+	bool				GetSubtitlesHeadLocked() const		{ return SubtitlesHeadLocked; }
+	bool				HasSubtitles() const				{ return !Subtitles.IsEmpty(); }
 	const OvrMetaDatum * GetActiveVideo()	{ return ActiveVideo;  }
+	// Streamed http videos can be saved into the Downloads folder for offline viewing.
+	bool				CanDownloadVideo( const OvrMetaDatum * videoData ) const;
+	void				DownloadVideo( const OvrMetaDatum * videoData );
 	float				GetFadeLevel()		{ return CurrentFadeLevel; }
+	const LocalizedStrings &	GetStrings() const	{ return Strings; }
 
 private:
 	const char*			MenuStateString( const OvrMenuState state );
@@ -99,6 +132,7 @@ private:
 	GLuint				BackgroundTexId;
 	GlProgram			PanoramaProgram;
 	GlProgram			FadedPanoramaProgram;
+	GlProgram			PreviewPanoramaProgram;
 	GlProgram			SingleColorTextureProgram;
 
 	Array< String > 	SearchPaths;
@@ -118,7 +152,9 @@ private:
 
 	// video vars
 	String				VideoName;
-	SurfaceTexture	* 	MovieTexture;
+	SurfaceTexture	* 	MovieTexture;		// owned by MovieTexturePool
+	SurfaceTexturePool	MovieTexturePool;
+	double				StartVideoTime;		// for logging the time until the surface is handed out
 
 	// Set when MediaPlayer knows what the stream size is.
 	// current is the aspect size, texture may be twice as wide or high for 3D content.
@@ -130,9 +166,119 @@ private:
 
 	bool				FrameAvailable;
 
+	// Typed events from the Java player callbacks, drained at the top of Frame().
+	PlayerEventRing		PlayerEvents;
+
+	// Published by the Java player, read here without JNI.
+	PlaybackStateBlock	PlaybackState;
+
+	// Player methods are looked up once, and the commands of a frame are sent together.
+	enum ePlayerCommand
+	{
+		PLAYER_COMMAND_NONE,
+		PLAYER_COMMAND_PAUSE,
+		PLAYER_COMMAND_RESUME
+	};
+
+	jmethodID			StartMovieMethodId;
+	jmethodID			StopMovieMethodId;
+	jmethodID			PauseMovieMethodId;
+	jmethodID			ResumeMovieMethodId;
+	jmethodID			SeekToMethodId;
+	ePlayerCommand		PendingPlayCommand;
+
+	// Seeks are snapped to keyframes of the index built when the video opens,
+	// and only the latest target of a burst is sent to the player.
+	SeekScheduler		Seeks;
+	KeyframeIndex		Keyframes;
+	KeyframeIndexLoader	KeyframeLoader;
+
+	// Thumbnails from a trick-play sidecar, shown on the globe until the
+	// first frame after a seek is latched.
+	TrickPlayAtlas		TrickPlay;
+
+	// Binaural rendering of an ambisonic sidecar, rotated with the head.
+	AudioOutput			Audio;
+	bool				AudioOpenFailed;
+	AmbisonicSoundtrack	Soundtrack;
+
+	// Interface sounds mixed natively, positioned at the menu they came from.
+	UiSoundMixer		UiSounds;
+
+	// Sidecar subtitles, each cue wrapped once and drawn from the cache.
+	SubtitleTrack		Subtitles;
+	bool				SubtitlesHeadLocked;
+
+	// Moves moov to the front of scanned MP4s, only while the browser is up.
+	FaststartTask		Faststart;
+
+	// Plain http videos that ask for it play through a loopback caching proxy.
+	CacheProxy			Proxy;
+
+	// Finished downloads are added to the browser without a rescan.
+	DownloadManager		Downloads;
+
+	// String resources, fetched from the activity once instead of a JNI call per lookup.
+	LocalizedStrings	Strings;
+
+	// Network shares from network_shares.txt, added to the browser a folder at a time.
+	Array< MediaSource * >	MediaSources;
+
+	// Resume positions, checkpointed every few seconds while playing.
+	PositionJournal		ResumePositions;
+	UInt64				ActivePathHash;
+	double				NextCheckpointTime;
+
+	// Playlist mode auto-advances through the category of the active video,
+	// with the next video prepared on a second player while this one plays.
+	// Off until turned on from the video menu.
+	bool				PlaylistMode;
+	PlaylistSession		Playlist;
+	Array< const OvrMetaDatum * >	PlaylistItems;
+	int					PreloadTextureIndex;	// pool texture of the second player, -1 when none
+	jmethodID			PreloadMovieMethodId;
+	jmethodID			PromotePreloadMethodId;
+	jmethodID			DiscardPreloadMethodId;
+
+	// adaptive HLS through the proxy measures its buffer against the play position
+	double				ProxyPositionSyncTime;
+
 private:
 	void				OnResume();
 	void				OnPause();
+	void				DrainPlayerEvents();
+	void				FlushPlayerCommands();
+	void				OnVideoStartError();
+	void				OnMovieSurfaceTaken( const int poolIndex, const double takeTime );
+	void				OnPreloadSurfaceTaken( const int poolIndex, const int generation );
+	void				BuildPlaylist();
+	void				AdvancePlaylist();
+	void				RecyclePreloadTexture();
+
+	// PlaylistPlayerBackend
+	virtual void		PreloadVideo( const char * url, const int generation );
+	virtual void		PromotePreload( const int generation );
+	virtual void		DiscardPreload( const int generation );
+
+	// SeekBackend
+	virtual void		IssueSeek( const int positionMs, const int seekId );
+	virtual void		AbandonSeek( const int seekId );
+
+	void				StartKeyframeIndex( const char * url );
+	void				LogSeekStats();
+	void				StopTrickPlay();
+	void				StartSoundtrack( const char * url );
+	void				StopSoundtrack();
+	void				DrawSubtitles();
+	bool				OpenAudio();
+	void				LoadUiSound( const char * name );
+	void				PlayUiSound( const char * name, const Vector3f & position );
+	bool				DrawSeekPreview( const int eye, const float fovDegrees );
+
+	int					GetResumePosition( const char * url ) const;
+	String				GetPlaybackUrl( const OvrMetaDatum & datum );
+	void				CheckpointPosition( const int positionMs );
+	void				StartMediaSources( const char * cacheDir, const Array< String > & extensions );
 };
 
 }
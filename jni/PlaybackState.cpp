@@ -0,0 +1,195 @@
+/************************************************************************************
+
+Filename    :   PlaybackState.cpp
+Content     :   Seqlock protected playback state shared between the player and VR threads
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "PlaybackState.h"
+
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+namespace OVR {
+
+static const int MAX_READ_ATTEMPTS = 64;
+
+PlaybackStateData::PlaybackStateData()
+	: Playing( false )
+	, PositionMs( 0 )
+	, DurationMs( -1 )
+	, BufferedStartMs( 0 )
+	, BufferedEndMs( 0 )
+	, VideoWidth( 0 )
+	, VideoHeight( 0 )
+	, UpdateTime( 0.0 )
+{
+}
+
+int PlaybackStateData::GetPositionAt( const double timeInSeconds ) const
+{
+	if ( !Playing || timeInSeconds <= UpdateTime )
+	{
+		return PositionMs;
+	}
+	const int position = PositionMs + static_cast< int >( ( timeInSeconds - UpdateTime ) * 1000.0 );
+	return ( DurationMs > 0 && position > DurationMs ) ? DurationMs : position;
+}
+
+PlaybackStateBlock::PlaybackStateBlock()
+	: Sequence( 0 )
+	, HeldSeekId( 0 )
+{
+	pthread_mutex_init( &WriteMutex, NULL );
+}
+
+PlaybackStateBlock::~PlaybackStateBlock()
+{
+	pthread_mutex_destroy( &WriteMutex );
+}
+
+double PlaybackStateBlock::GetTimeInSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+UInt32 PlaybackStateBlock::GetSequence() const
+{
+	return __atomic_load_n( &Sequence, __ATOMIC_ACQUIRE );
+}
+
+void PlaybackStateBlock::BeginWrite()
+{
+	pthread_mutex_lock( &WriteMutex );
+	__atomic_store_n( &Sequence, Sequence + 1, __ATOMIC_RELAXED );
+	// the odd sequence must be visible before any of the data stores
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+}
+
+void PlaybackStateBlock::EndWrite()
+{
+	__atomic_store_n( &Sequence, Sequence + 1, __ATOMIC_RELEASE );
+	pthread_mutex_unlock( &WriteMutex );
+}
+
+void PlaybackStateBlock::Write( const PlaybackStateData & data )
+{
+	BeginWrite();
+	Data = data;
+	Data.UpdateTime = GetTimeInSeconds();
+	HeldSeekId = 0;
+	EndWrite();
+}
+
+void PlaybackStateBlock::SetPlaying( const bool playing )
+{
+	const double now = GetTimeInSeconds();
+	BeginWrite();
+	// fold the extrapolated time into the position so it doesn't jump
+	Data.PositionMs = Data.GetPositionAt( now );
+	Data.Playing = playing;
+	Data.UpdateTime = now;
+	EndWrite();
+}
+
+void PlaybackStateBlock::SetPosition( const int positionMs )
+{
+	BeginWrite();
+	Data.PositionMs = positionMs;
+	Data.UpdateTime = GetTimeInSeconds();
+	EndWrite();
+}
+
+void PlaybackStateBlock::HoldPosition( const int positionMs, const int seekId )
+{
+	BeginWrite();
+	Data.PositionMs = positionMs;
+	Data.UpdateTime = GetTimeInSeconds();
+	HeldSeekId = seekId;
+	EndWrite();
+}
+
+void PlaybackStateBlock::ReleasePosition( const int seekId )
+{
+	pthread_mutex_lock( &WriteMutex );
+	// nothing readers can see changes
+	if ( HeldSeekId == seekId )
+	{
+		HeldSeekId = 0;
+	}
+	pthread_mutex_unlock( &WriteMutex );
+}
+
+void PlaybackStateBlock::SetVideoSize( const int width, const int height )
+{
+	BeginWrite();
+	Data.VideoWidth = width;
+	Data.VideoHeight = height;
+	EndWrite();
+}
+
+void PlaybackStateBlock::Update( const bool playing, const int positionMs, const int durationMs,
+		const int bufferedStartMs, const int bufferedEndMs, const int completedSeekId )
+{
+	const double now = GetTimeInSeconds();
+	BeginWrite();
+	if ( HeldSeekId != 0 && completedSeekId >= HeldSeekId )
+	{
+		HeldSeekId = 0;
+	}
+	// a held position keeps extrapolating from the seek target
+	Data.PositionMs = ( HeldSeekId != 0 ) ? Data.GetPositionAt( now ) : positionMs;
+	Data.Playing = playing;
+	Data.DurationMs = durationMs;
+	Data.BufferedStartMs = bufferedStartMs;
+	Data.BufferedEndMs = bufferedEndMs;
+	Data.UpdateTime = now;
+	EndWrite();
+}
+
+bool PlaybackStateBlock::TryRead( PlaybackStateData & outData ) const
+{
+	for ( int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++ )
+	{
+		const UInt32 before = __atomic_load_n( &Sequence, __ATOMIC_ACQUIRE );
+		if ( before & 1 )
+		{
+			sched_yield();
+			continue;
+		}
+		PlaybackStateData copy;
+		memcpy( &copy, const_cast< const PlaybackStateData * >( &Data ), sizeof( copy ) );
+		// the copy must complete before the sequence is checked again
+		__atomic_thread_fence( __ATOMIC_ACQUIRE );
+		const UInt32 after = __atomic_load_n( &Sequence, __ATOMIC_RELAXED );
+		if ( before == after )
+		{
+			outData = copy;
+			return true;
+		}
+	}
+	return false;
+}
+
+PlaybackStateData PlaybackStateBlock::Read() const
+{
+	PlaybackStateData data;
+	while ( !TryRead( data ) )
+	{
+		sched_yield();
+	}
+	return data;
+}
+
+}
@@ -0,0 +1,97 @@
+/************************************************************************************
+
+Filename    :   PlaybackState.h
+Content     :   Seqlock protected playback state shared between the player and VR threads
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_PlaybackState_h )
+#define OVR_PlaybackState_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+
+namespace OVR {
+
+//==============================================================
+// PlaybackStateData
+struct PlaybackStateData
+{
+	bool	Playing;
+	SInt32	PositionMs;
+	SInt32	DurationMs;			// -1 when unknown
+	SInt32	BufferedStartMs;
+	SInt32	BufferedEndMs;
+	SInt32	VideoWidth;
+	SInt32	VideoHeight;
+	double	UpdateTime;			// PlaybackStateBlock::GetTimeInSeconds() of the write
+
+			PlaybackStateData();
+
+	// Position extrapolated to timeInSeconds while playing.
+	int		GetPositionAt( const double timeInSeconds ) const;
+};
+
+//==============================================================
+// PlaybackStateBlock
+//
+// Written by the player side, read by the VR thread without JNI or locks.
+// Readers retry if a write was in progress or completed while they copied.
+// Writers are serialized with a mutex, since both the Java UI thread and
+// the VR thread's optimistic updates write to it.
+//
+// While a seek is pending the VR thread holds the position at the seek's
+// target. Player reports then keep it until they say the seek, or a later
+// one, completed, so the periodic updates can't drag it back to where the
+// player was before the seek.
+class PlaybackStateBlock
+{
+public:
+						PlaybackStateBlock();
+						~PlaybackStateBlock();
+
+	void				Write( const PlaybackStateData & data );
+
+	// Read-modify-write of individual fields, for optimistic updates.
+	void				SetPlaying( const bool playing );
+	void				SetPosition( const int positionMs );
+	void				HoldPosition( const int positionMs, const int seekId );
+	// Gives the position back to the player reports if seekId still holds it.
+	void				ReleasePosition( const int seekId );
+	void				SetVideoSize( const int width, const int height );
+
+	// Player state report, keeps the video size. completedSeekId is the
+	// latest seek the player has finished, 0 before the first.
+	void				Update( const bool playing, const int positionMs, const int durationMs,
+								const int bufferedStartMs, const int bufferedEndMs, const int completedSeekId = 0 );
+
+	// Returns false if a writer kept interfering, outData is then unchanged.
+	bool				TryRead( PlaybackStateData & outData ) const;
+	PlaybackStateData	Read() const;
+
+	UInt32				GetSequence() const;
+
+	static double		GetTimeInSeconds();
+
+private:
+	UInt32				Sequence;		// odd while a write is in progress
+	PlaybackStateData	Data;
+	pthread_mutex_t		WriteMutex;
+	int					HeldSeekId;		// writers only, 0 when the reports own the position
+
+	void				BeginWrite();
+	void				EndWrite();
+};
+
+}
+
+#endif // OVR_PlaybackState_h
@@ -0,0 +1,185 @@
+/************************************************************************************
+
+Filename    :   PlayerEventRing.h
+Content     :   Lock-free single producer / single consumer ring of player events
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_PlayerEventRing_h )
+#define OVR_PlayerEventRing_h
+
+#include <time.h>
+
+#include "Kernel/OVR_Types.h"
+
+namespace OVR {
+
+//==============================================================
+// SpscRing
+//
+// Fixed capacity ring for exactly one producer thread and one consumer
+// thread. Neither side ever blocks or allocates. Capacity must be a
+// power of two. Head and Tail live on separate cache lines so the two
+// threads don't fight over the same line.
+template< class T, int CAPACITY >
+class SpscRing
+{
+public:
+	SpscRing() : Head( 0 ), Tail( 0 )
+	{
+		OVR_COMPILER_ASSERT( ( CAPACITY & ( CAPACITY - 1 ) ) == 0 );
+	}
+
+	// Producer side. Returns false when the ring is full.
+	bool Push( const T & item )
+	{
+		const UInt32 tail = __atomic_load_n( &Tail, __ATOMIC_RELAXED );
+		const UInt32 head = __atomic_load_n( &Head, __ATOMIC_ACQUIRE );
+		if ( tail - head >= static_cast< UInt32 >( CAPACITY ) )
+		{
+			return false;
+		}
+		Items[tail & ( CAPACITY - 1 )] = item;
+		__atomic_store_n( &Tail, tail + 1, __ATOMIC_RELEASE );
+		return true;
+	}
+
+	// Consumer side. Returns false when the ring is empty.
+	bool Pop( T & outItem )
+	{
+		const UInt32 head = __atomic_load_n( &Head, __ATOMIC_RELAXED );
+		const UInt32 tail = __atomic_load_n( &Tail, __ATOMIC_ACQUIRE );
+		if ( head == tail )
+		{
+			return false;
+		}
+		outItem = Items[head & ( CAPACITY - 1 )];
+		__atomic_store_n( &Head, head + 1, __ATOMIC_RELEASE );
+		return true;
+	}
+
+	bool IsEmpty() const
+	{
+		return __atomic_load_n( &Head, __ATOMIC_ACQUIRE ) == __atomic_load_n( &Tail, __ATOMIC_ACQUIRE );
+	}
+
+private:
+	static const int CACHE_LINE = 64;
+
+	UInt32	Head;
+	UByte	HeadPad[CACHE_LINE - sizeof( UInt32 )];
+	UInt32	Tail;
+	UByte	TailPad[CACHE_LINE - sizeof( UInt32 )];
+	T		Items[CAPACITY];
+};
+
+//==============================================================
+// PlayerEvent
+enum ePlayerEventType
+{
+	PLAYER_EVENT_VIDEO_SIZE,	// Arg0 = width, Arg1 = height
+	PLAYER_EVENT_COMPLETION,
+	PLAYER_EVENT_START_ERROR,
+	PLAYER_EVENT_SURFACE_TAKEN,	// Arg0 = SurfaceTexturePool index
+	PLAYER_EVENT_PRELOAD_SURFACE_TAKEN,	// Arg0 = SurfaceTexturePool index, Arg1 = preload generation
+	PLAYER_EVENT_PRELOAD_READY,		// Arg0 = preload generation
+	PLAYER_EVENT_PRELOAD_FAILED,	// Arg0 = preload generation
+	PLAYER_EVENT_SEEK_COMPLETE,		// Arg0 = seek id
+	PLAYER_EVENT_TRIM_MEMORY,		// Arg0 = onTrimMemory level
+	PLAYER_EVENT_MAX
+};
+
+struct PlayerEvent
+{
+	SInt32	Type;
+	SInt32	Arg0;
+	SInt32	Arg1;
+	double	PostTime;		// PlayerEventRing::GetTimeInSeconds() when posted
+};
+
+//==============================================================
+// PlayerEventRing
+//
+// Events from the Java player callbacks, which all arrive on the activity's
+// UI thread, drained by the VR thread at the top of every frame.
+class PlayerEventRing
+{
+public:
+	PlayerEventRing() : Dropped( 0 )
+	{
+		ResetLatency();
+	}
+
+	// Producer side.
+	bool Post( const ePlayerEventType type, const int arg0 = 0, const int arg1 = 0 )
+	{
+		PlayerEvent event;
+		event.Type = type;
+		event.Arg0 = arg0;
+		event.Arg1 = arg1;
+		event.PostTime = GetTimeInSeconds();
+		if ( !Ring.Push( event ) )
+		{
+			__atomic_add_fetch( &Dropped, 1, __ATOMIC_RELAXED );
+			return false;
+		}
+		return true;
+	}
+
+	// Consumer side, records how long the event waited in the ring.
+	bool Next( PlayerEvent & outEvent )
+	{
+		if ( !Ring.Pop( outEvent ) )
+		{
+			return false;
+		}
+		const double latency = GetTimeInSeconds() - outEvent.PostTime;
+		LatencyCount++;
+		LatencyTotal += latency;
+		if ( latency > LatencyMax )
+		{
+			LatencyMax = latency;
+		}
+		return true;
+	}
+
+	int		GetLatencyCount() const			{ return LatencyCount; }
+	double	GetLatencyAverage() const		{ return LatencyCount > 0 ? LatencyTotal / LatencyCount : 0.0; }
+	double	GetLatencyMax() const			{ return LatencyMax; }
+	int		GetDropped() const				{ return __atomic_load_n( &Dropped, __ATOMIC_RELAXED ); }
+
+	void ResetLatency()
+	{
+		LatencyCount = 0;
+		LatencyTotal = 0.0;
+		LatencyMax = 0.0;
+	}
+
+	static double GetTimeInSeconds()
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+	}
+
+private:
+	SpscRing< PlayerEvent, 64 >	Ring;
+	int		Dropped;
+
+	// consumer only
+	int		LatencyCount;
+	double	LatencyTotal;
+	double	LatencyMax;
+};
+
+}
+
+#endif // OVR_PlayerEventRing_h
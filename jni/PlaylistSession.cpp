@@ -0,0 +1,152 @@
+/************************************************************************************
+
+Filename    :   PlaylistSession.cpp
+Content     :   Auto-advance through a list of videos with a warm preloaded next player
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "PlaylistSession.h"
+
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+PlaylistSession::PlaylistSession( PlaylistPlayerBackend & backend )
+	: Backend( backend )
+	, CurrentIndex( -1 )
+	, PreloadIndex( -1 )
+	, FailedIndex( -1 )
+	, State( PRELOAD_NONE )
+	, Generation( 0 )
+{
+}
+
+PlaylistSession::~PlaylistSession()
+{
+	OVR_ASSERT( State == PRELOAD_NONE );
+}
+
+int PlaylistSession::GetNextIndex() const
+{
+	if ( CurrentIndex < 0 || CurrentIndex + 1 >= Urls.GetSizeI() )
+	{
+		return -1;
+	}
+	return CurrentIndex + 1;
+}
+
+bool PlaylistSession::IsActivePreload( const int generation ) const
+{
+	return State != PRELOAD_NONE && generation == Generation;
+}
+
+void PlaylistSession::SetItems( const Array< String > & urls, const int currentIndex )
+{
+	// keep a preload that is still for the right item, so re-selecting from
+	// the same category doesn't throw the work away
+	const String preloadUrl = ( PreloadIndex >= 0 ) ? Urls[PreloadIndex] : String();
+
+	Urls = urls;
+	CurrentIndex = currentIndex;
+	FailedIndex = -1;
+
+	const int next = GetNextIndex();
+	if ( State != PRELOAD_NONE && ( next < 0 || Urls[next] != preloadUrl ) )
+	{
+		Discard();
+	}
+	else
+	{
+		PreloadIndex = ( State != PRELOAD_NONE ) ? next : -1;
+	}
+}
+
+void PlaylistSession::Clear()
+{
+	Discard();
+	Urls.Clear();
+	CurrentIndex = -1;
+	FailedIndex = -1;
+}
+
+void PlaylistSession::StartPreload()
+{
+	if ( State != PRELOAD_NONE )
+	{
+		return;
+	}
+	const int next = GetNextIndex();
+	if ( next < 0 || next == FailedIndex || Urls[next].IsEmpty() )
+	{
+		return;
+	}
+	Generation++;
+	PreloadIndex = next;
+	State = PRELOAD_PREPARING;
+	LOG( "PlaylistSession: preloading %i '%s' (%i)", next, Urls[next].ToCStr(), Generation );
+	Backend.PreloadVideo( Urls[next].ToCStr(), Generation );
+}
+
+void PlaylistSession::OnPreloadReady( const int generation )
+{
+	if ( !IsActivePreload( generation ) )
+	{
+		return;
+	}
+	State = PRELOAD_READY;
+	LOG( "PlaylistSession: preload %i ready (%i)", PreloadIndex, generation );
+}
+
+void PlaylistSession::OnPreloadFailed( const int generation )
+{
+	if ( !IsActivePreload( generation ) )
+	{
+		return;
+	}
+	LOG( "PlaylistSession: preload %i failed (%i)", PreloadIndex, generation );
+	FailedIndex = PreloadIndex;
+	Discard();
+}
+
+PlaylistSession::eAdvanceResult PlaylistSession::Advance()
+{
+	const int next = GetNextIndex();
+	if ( next < 0 )
+	{
+		Discard();
+		return ADVANCE_END;
+	}
+
+	CurrentIndex = next;
+	if ( State == PRELOAD_READY && PreloadIndex == next )
+	{
+		Backend.PromotePreload( Generation );
+		State = PRELOAD_NONE;
+		PreloadIndex = -1;
+		return ADVANCE_PROMOTED;
+	}
+
+	// still preparing, a cold start is no slower than waiting for it
+	Discard();
+	return ADVANCE_COLD;
+}
+
+void PlaylistSession::Discard()
+{
+	if ( State != PRELOAD_NONE )
+	{
+		Backend.DiscardPreload( Generation );
+	}
+	State = PRELOAD_NONE;
+	PreloadIndex = -1;
+}
+
+}
@@ -0,0 +1,104 @@
+/************************************************************************************
+
+Filename    :   PlaylistSession.h
+Content     :   Auto-advance through a list of videos with a warm preloaded next player
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_PlaylistSession_h )
+#define OVR_PlaylistSession_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+//==============================================================
+// PlaylistPlayerBackend
+//
+// The second player session. Each preload carries a generation so
+// completions of a discarded preload can be told apart from the
+// current one. The app drives the Java MediaPlayer through this,
+// a fake implementation can drive the session without a device.
+class PlaylistPlayerBackend
+{
+public:
+	virtual			~PlaylistPlayerBackend() {}
+
+	// Prepare url on the second player and buffer its start, paused.
+	virtual void	PreloadVideo( const char * url, const int generation ) = 0;
+	// Make the prepared player the current one and start it.
+	virtual void	PromotePreload( const int generation ) = 0;
+	// Release the second player.
+	virtual void	DiscardPreload( const int generation ) = 0;
+};
+
+//==============================================================
+// PlaylistSession
+//
+// Preload, promote, discard state machine for the item after the current
+// one. VR thread only; the backend's callbacks are forwarded to
+// OnPreloadReady / OnPreloadFailed by the caller.
+class PlaylistSession
+{
+public:
+	enum ePreloadState
+	{
+		PRELOAD_NONE,
+		PRELOAD_PREPARING,
+		PRELOAD_READY
+	};
+
+	enum eAdvanceResult
+	{
+		ADVANCE_END,		// no more items
+		ADVANCE_PROMOTED,	// the preloaded player is now playing the next item
+		ADVANCE_COLD		// the next item has to be started the normal way
+	};
+
+					PlaylistSession( PlaylistPlayerBackend & backend );
+					~PlaylistSession();
+
+	// An empty url marks an item that can't be preloaded. Keeps a preload
+	// that is still for the item after currentIndex.
+	void			SetItems( const Array< String > & urls, const int currentIndex );
+	void			Clear();
+
+	// Starts preloading the next item if nothing is preloaded yet.
+	void			StartPreload();
+
+	void			OnPreloadReady( const int generation );
+	void			OnPreloadFailed( const int generation );
+
+	// The current item finished, moves on to the next one.
+	eAdvanceResult	Advance();
+
+	int				GetCurrentIndex() const		{ return CurrentIndex; }
+	int				GetNextIndex() const;
+	ePreloadState	GetPreloadState() const		{ return State; }
+	bool			IsActivePreload( const int generation ) const;
+
+private:
+	PlaylistPlayerBackend &	Backend;
+	Array< String >	Urls;
+	int				CurrentIndex;
+	int				PreloadIndex;		// item being preloaded, -1 when none
+	int				FailedIndex;		// don't keep retrying an item that failed to prepare
+	ePreloadState	State;
+	int				Generation;
+
+	void			Discard();
+};
+
+}
+
+#endif // OVR_PlaylistSession_h
@@ -0,0 +1,426 @@
+/************************************************************************************
+
+Filename    :   PositionJournal.cpp
+Content     :   Memory mapped append-only journal of video resume positions
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "PositionJournal.h"
+
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+static const UInt32	JOURNAL_MAGIC = 0x4A504F56;	// "VOPJ"
+static const UInt32	JOURNAL_VERSION = 1;
+static const int	JOURNAL_HEADER_SIZE = 64;
+static const int	JOURNAL_CAPACITY = 4096;		// records, 128 KB
+
+PositionJournal::PositionJournal()
+	: Fd( -1 )
+	, Mapping( NULL )
+	, Records( NULL )
+	, Capacity( 0 )
+	, Count( 0 )
+	, Sequence( 0 )
+	, UpdateOrder( 0 )
+	, CompactRunning( false )
+	, CompactDone( 0 )
+	, CompactOk( false )
+	, CompactUpdateOrder( 0 )
+{
+}
+
+PositionJournal::~PositionJournal()
+{
+	Close();
+}
+
+UInt64 PositionJournal::HashPath( const char * path )
+{
+	// FNV-1a
+	UInt64 hash = 14695981039346656037ULL;
+	for ( const UByte * p = reinterpret_cast< const UByte * >( path ); *p != 0; p++ )
+	{
+		hash ^= *p;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+UInt32 PositionJournal::ComputeChecksum( const Record & record )
+{
+	UInt32 sum = 2166136261U;
+	const UByte * bytes = reinterpret_cast< const UByte * >( &record );
+	for ( UPInt i = 0; i < offsetof( Record, Checksum ); i++ )
+	{
+		sum ^= bytes[i];
+		sum *= 16777619U;
+	}
+	return ( sum == 0 ) ? 1 : sum;
+}
+
+bool PositionJournal::Open( const char * path )
+{
+	Close();
+	Path = path;
+	if ( !Compact() || !Map() )
+	{
+		LOG( "PositionJournal: couldn't open '%s'", path );
+		Close();
+		return false;
+	}
+	LOG( "PositionJournal: %i videos", Positions.GetSizeI() );
+	return true;
+}
+
+void PositionJournal::Close()
+{
+	if ( CompactRunning )
+	{
+		// finish it so the checkpoints that only made it to memory are written
+		FinishCompaction();
+	}
+	Unmap();
+	Positions.Clear();
+	PositionIndex.Clear();
+	Count = 0;
+	Sequence = 0;
+	UpdateOrder = 0;
+}
+
+void PositionJournal::Unmap()
+{
+	if ( Mapping != NULL )
+	{
+		munmap( Mapping, JOURNAL_HEADER_SIZE + Capacity * sizeof( Record ) );
+	}
+	if ( Fd >= 0 )
+	{
+		close( Fd );
+	}
+	Mapping = NULL;
+	Records = NULL;
+	Fd = -1;
+	Capacity = 0;
+}
+
+void PositionJournal::SetLatest( const UInt64 pathHash, const int positionMs, const int durationMs )
+{
+	int index;
+	if ( !PositionIndex.Get( pathHash, &index ) )
+	{
+		index = Positions.GetSizeI();
+		Latest latest;
+		latest.PathHash = pathHash;
+		Positions.PushBack( latest );
+		PositionIndex.Set( pathHash, index );
+	}
+	Positions[index].PositionMs = positionMs;
+	Positions[index].DurationMs = durationMs;
+	Positions[index].UpdateOrder = ++UpdateOrder;
+}
+
+bool PositionJournal::UpdatedEarlier( const Latest & a, const Latest & b )
+{
+	return a.UpdateOrder < b.UpdateOrder;
+}
+
+// Reads whatever is valid of the existing journal, then writes the latest
+// record of each video to a new file that replaces it atomically.
+bool PositionJournal::Compact()
+{
+	Positions.Clear();
+	PositionIndex.Clear();
+	UpdateOrder = 0;
+
+	const int fd = open( Path.ToCStr(), O_RDONLY );
+	if ( fd >= 0 )
+	{
+		UByte header[JOURNAL_HEADER_SIZE];
+		if ( read( fd, header, sizeof( header ) ) == ( ssize_t )sizeof( header ) &&
+			*reinterpret_cast< UInt32 * >( header ) == JOURNAL_MAGIC &&
+			*reinterpret_cast< UInt32 * >( header + 4 ) == JOURNAL_VERSION )
+		{
+			Record record;
+			while ( read( fd, &record, sizeof( record ) ) == ( ssize_t )sizeof( record ) )
+			{
+				// the first torn or unwritten record ends the journal
+				if ( record.Checksum == 0 || record.Checksum != ComputeChecksum( record ) )
+				{
+					break;
+				}
+				SetLatest( record.PathHash, record.PositionMs, record.DurationMs );
+			}
+		}
+		close( fd );
+	}
+
+	String tempPath = Path;
+	tempPath += ".tmp";
+	Array< Latest > kept = Positions;
+	if ( !WriteCompacted( tempPath.ToCStr(), kept ) || rename( tempPath.ToCStr(), Path.ToCStr() ) != 0 )
+	{
+		LOG( "PositionJournal: compacting '%s' failed: %s", Path.ToCStr(), strerror( errno ) );
+		unlink( tempPath.ToCStr() );
+		return false;
+	}
+
+	// index the kept videos in their new order, the stalest ones are gone
+	Positions.Clear();
+	PositionIndex.Clear();
+	UpdateOrder = 0;
+	for ( int i = 0; i < kept.GetSizeI(); i++ )
+	{
+		SetLatest( kept[i].PathHash, kept[i].PositionMs, kept[i].DurationMs );
+	}
+	Count = kept.GetSizeI();
+	Sequence = static_cast< UInt32 >( Count );
+	return true;
+}
+
+// Writes the latest record of each video to tempPath and syncs it, leaving
+// positions holding the kept videos in the order they were written.
+// Doesn't touch the journal's members, the compaction worker calls it too.
+bool PositionJournal::WriteCompacted( const char * tempPath, Array< Latest > & positions )
+{
+	// positions is in order of each video's first record, the records are
+	// rewritten oldest update first, so dropping the head drops the stalest
+	Alg::QuickSort( positions, UpdatedEarlier );
+	const int keep = Alg::Min( positions.GetSizeI(), JOURNAL_CAPACITY / 2 );
+	const int firstKept = positions.GetSizeI() - keep;
+
+	// ftruncate zero fills, so every record after the compacted ones reads as unwritten
+	const int out = open( tempPath, O_RDWR | O_CREAT | O_TRUNC, 0600 );
+	if ( out < 0 )
+	{
+		LOG( "PositionJournal: open '%s' failed: %s", tempPath, strerror( errno ) );
+		return false;
+	}
+	bool ok = ftruncate( out, JOURNAL_HEADER_SIZE + JOURNAL_CAPACITY * sizeof( Record ) ) == 0;
+
+	UByte header[JOURNAL_HEADER_SIZE];
+	memset( header, 0, sizeof( header ) );
+	*reinterpret_cast< UInt32 * >( header ) = JOURNAL_MAGIC;
+	*reinterpret_cast< UInt32 * >( header + 4 ) = JOURNAL_VERSION;
+	ok = ok && write( out, header, sizeof( header ) ) == ( ssize_t )sizeof( header );
+
+	Array< Latest > kept;
+	for ( int i = firstKept; ok && i < positions.GetSizeI(); i++ )
+	{
+		Record record;
+		memset( &record, 0, sizeof( record ) );
+		record.PathHash = positions[i].PathHash;
+		record.PositionMs = positions[i].PositionMs;
+		record.DurationMs = positions[i].DurationMs;
+		record.Sequence = static_cast< UInt32 >( kept.GetSizeI() + 1 );
+		record.Checksum = ComputeChecksum( record );
+		ok = write( out, &record, sizeof( record ) ) == ( ssize_t )sizeof( record );
+		kept.PushBack( positions[i] );
+	}
+	ok = ok && fsync( out ) == 0;
+	close( out );
+	positions = kept;
+	return ok;
+}
+
+void * PositionJournal::CompactThreadFunction( void * param )
+{
+	PositionJournal * journal = static_cast< PositionJournal * >( param );
+	journal->CompactOk = WriteCompacted( journal->CompactTempPath.ToCStr(), journal->CompactPositions );
+	__atomic_store_n( &journal->CompactDone, 1, __ATOMIC_RELEASE );
+	return NULL;
+}
+
+void PositionJournal::StartCompaction()
+{
+	CompactPositions = Positions;
+	CompactUpdateOrder = UpdateOrder;
+	CompactTempPath = Path;
+	CompactTempPath += ".tmp";
+	CompactOk = false;
+	__atomic_store_n( &CompactDone, 0, __ATOMIC_RELEASE );
+	if ( pthread_create( &CompactThread, NULL, CompactThreadFunction, this ) != 0 )
+	{
+		LOG( "PositionJournal: pthread_create failed" );
+		return;
+	}
+	CompactRunning = true;
+}
+
+// Appends the videos updated since the snapshot to the compacted file, then
+// renames it over the journal. Until the rename the old journal has every
+// checkpoint that reached the file, after it the new one does.
+void PositionJournal::FinishCompaction()
+{
+	pthread_join( CompactThread, NULL );
+	CompactRunning = false;
+
+	Array< Latest > changed;
+	for ( int i = 0; i < Positions.GetSizeI(); i++ )
+	{
+		if ( Positions[i].UpdateOrder > CompactUpdateOrder )
+		{
+			changed.PushBack( Positions[i] );
+		}
+	}
+	Alg::QuickSort( changed, UpdatedEarlier );
+	const int kept = CompactPositions.GetSizeI();
+	const int firstChanged = Alg::Max( 0, changed.GetSizeI() - ( JOURNAL_CAPACITY - kept ) );
+
+	bool ok = CompactOk;
+	const int fd = ok ? open( CompactTempPath.ToCStr(), O_RDWR ) : -1;
+	ok = ok && fd >= 0;
+	for ( int i = firstChanged; ok && i < changed.GetSizeI(); i++ )
+	{
+		Record record;
+		memset( &record, 0, sizeof( record ) );
+		record.PathHash = changed[i].PathHash;
+		record.PositionMs = changed[i].PositionMs;
+		record.DurationMs = changed[i].DurationMs;
+		record.Sequence = static_cast< UInt32 >( kept + i - firstChanged + 1 );
+		record.Checksum = ComputeChecksum( record );
+		const off_t offset = JOURNAL_HEADER_SIZE + ( kept + i - firstChanged ) * sizeof( Record );
+		ok = pwrite( fd, &record, sizeof( record ), offset ) == ( ssize_t )sizeof( record );
+	}
+	if ( fd >= 0 )
+	{
+		close( fd );
+	}
+	if ( !ok || rename( CompactTempPath.ToCStr(), Path.ToCStr() ) != 0 )
+	{
+		// the old journal is still complete, the next checkpoint tries again
+		LOG( "PositionJournal: compacting '%s' failed: %s", Path.ToCStr(), strerror( errno ) );
+		unlink( CompactTempPath.ToCStr() );
+		CompactPositions.Clear();
+		return;
+	}
+
+	Unmap();
+	Positions.Clear();
+	PositionIndex.Clear();
+	UpdateOrder = 0;
+	for ( int i = 0; i < kept; i++ )
+	{
+		SetLatest( CompactPositions[i].PathHash, CompactPositions[i].PositionMs, CompactPositions[i].DurationMs );
+	}
+	for ( int i = firstChanged; i < changed.GetSizeI(); i++ )
+	{
+		SetLatest( changed[i].PathHash, changed[i].PositionMs, changed[i].DurationMs );
+	}
+	CompactPositions.Clear();
+	Count = Positions.GetSizeI();
+	Sequence = static_cast< UInt32 >( Count );
+	if ( !Map() )
+	{
+		// the positions stay readable, nothing more is recorded
+		LOG( "PositionJournal: couldn't map '%s'", Path.ToCStr() );
+		Count = 0;
+	}
+}
+
+bool PositionJournal::Map()
+{
+	Fd = open( Path.ToCStr(), O_RDWR );
+	if ( Fd < 0 )
+	{
+		return false;
+	}
+	Capacity = JOURNAL_CAPACITY;
+	void * mapping = mmap( NULL, JOURNAL_HEADER_SIZE + Capacity * sizeof( Record ), PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0 );
+	if ( mapping == MAP_FAILED )
+	{
+		LOG( "PositionJournal: mmap failed: %s", strerror( errno ) );
+		close( Fd );
+		Fd = -1;
+		Capacity = 0;
+		return false;
+	}
+	Mapping = static_cast< UByte * >( mapping );
+	Records = reinterpret_cast< Record * >( Mapping + JOURNAL_HEADER_SIZE );
+	return true;
+}
+
+void PositionJournal::Checkpoint( const UInt64 pathHash, const int positionMs, const int durationMs )
+{
+	if ( Records == NULL )
+	{
+		return;
+	}
+
+	if ( CompactRunning && __atomic_load_n( &CompactDone, __ATOMIC_ACQUIRE ) != 0 )
+	{
+		FinishCompaction();
+		if ( Records == NULL )
+		{
+			return;
+		}
+	}
+	if ( !CompactRunning && Count >= Capacity - Capacity / 4 )
+	{
+		StartCompaction();
+	}
+	if ( Count >= Capacity && !CompactRunning )
+	{
+		// full and no worker to compact it, rewrite it with one record per video here
+		Unmap();
+		if ( !Compact() || !Map() )
+		{
+			Close();
+			return;
+		}
+	}
+	SetLatest( pathHash, positionMs, durationMs );
+	if ( Count >= Capacity )
+	{
+		// the worker hasn't finished yet, the position is written when it does
+		return;
+	}
+
+	Record next;
+	next.PathHash = pathHash;
+	next.PositionMs = positionMs;
+	next.DurationMs = durationMs;
+	next.Sequence = ++Sequence;
+	next.Checksum = ComputeChecksum( next );
+
+	Record & record = Records[Count];
+	record.PathHash = next.PathHash;
+	record.PositionMs = next.PositionMs;
+	record.DurationMs = next.DurationMs;
+	record.Sequence = next.Sequence;
+	// the fields must be in place before the checksum marks the record valid
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	record.Checksum = next.Checksum;
+	Count++;
+}
+
+bool PositionJournal::GetPosition( const UInt64 pathHash, int & outPositionMs, int & outDurationMs ) const
+{
+	int index;
+	if ( !PositionIndex.Get( pathHash, &index ) )
+	{
+		return false;
+	}
+	outPositionMs = Positions[index].PositionMs;
+	outDurationMs = Positions[index].DurationMs;
+	return true;
+}
+
+}
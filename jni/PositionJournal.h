@@ -0,0 +1,116 @@
+/************************************************************************************
+
+Filename    :   PositionJournal.h
+Content     :   Memory mapped append-only journal of video resume positions
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_PositionJournal_h )
+#define OVR_PositionJournal_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+#include "Kernel/OVR_Hash.h"
+
+namespace OVR {
+
+//==============================================================
+// PositionJournal
+//
+// Fixed size records are appended to a shared file mapping, so a checkpoint
+// is a few stores into the page cache and survives the process crashing.
+// Each record carries a checksum written last; a record torn by a crash
+// fails it and ends the journal. Open() compacts the journal to the latest
+// record per video, writing a new file and renaming it over the old one.
+// When there are more videos than half the capacity, the ones updated
+// longest ago are dropped.
+// A journal that fills up during a session is compacted the same way on a
+// worker thread, from a snapshot of the latest positions, while checkpoints
+// keep going to the old file. The first checkpoint after the worker is done
+// appends what changed since the snapshot and renames the new file into
+// place, so neither the rewrite nor its fsync stalls the VR thread.
+// Not thread safe, the VR thread owns it.
+class PositionJournal
+{
+public:
+						PositionJournal();
+						~PositionJournal();
+
+	bool				Open( const char * path );
+	void				Close();
+	bool				IsOpen() const		{ return Records != NULL; }
+
+	static UInt64		HashPath( const char * path );
+
+	// Records the position of a video, duration may be -1 when unknown.
+	void				Checkpoint( const UInt64 pathHash, const int positionMs, const int durationMs );
+
+	// Returns false if nothing was recorded for the video.
+	bool				GetPosition( const UInt64 pathHash, int & outPositionMs, int & outDurationMs ) const;
+
+private:
+	struct Record
+	{
+		UInt64	PathHash;
+		SInt32	PositionMs;
+		SInt32	DurationMs;
+		UInt32	Sequence;
+		UInt32	Checksum;		// of the fields above, 0 is never valid
+	};
+
+	struct Latest
+	{
+		UInt64	PathHash;
+		SInt32	PositionMs;
+		SInt32	DurationMs;
+		UInt32	UpdateOrder;	// of the last checkpoint, increasing over the file
+	};
+
+	String				Path;
+	int					Fd;
+	UByte *				Mapping;
+	Record *			Records;
+	int					Capacity;
+	int					Count;
+	UInt32				Sequence;
+	UInt32				UpdateOrder;
+
+	Array< Latest >		Positions;
+	Hash< UInt64, int >	PositionIndex;		// path hash to index in Positions
+
+	// background compaction, the worker only touches CompactPositions and CompactOk
+	pthread_t			CompactThread;
+	bool				CompactRunning;
+	int					CompactDone;
+	bool				CompactOk;
+	UInt32				CompactUpdateOrder;	// UpdateOrder when the snapshot was taken
+	Array< Latest >		CompactPositions;	// the snapshot, then the records written
+	String				CompactTempPath;
+
+	static UInt32		ComputeChecksum( const Record & record );
+	static bool			UpdatedEarlier( const Latest & a, const Latest & b );
+	static bool			WriteCompacted( const char * tempPath, Array< Latest > & positions );
+	static void *		CompactThreadFunction( void * param );
+
+	bool				Map();
+	void				Unmap();
+	bool				Compact();
+	void				StartCompaction();
+	void				FinishCompaction();
+	void				SetLatest( const UInt64 pathHash, const int positionMs, const int durationMs );
+};
+
+}
+
+#endif // OVR_PositionJournal_h
@@ -0,0 +1,141 @@
+/************************************************************************************
+
+Filename    :   SeekScheduler.cpp
+Content     :   Coalesces seek requests and snaps them to keyframes
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "SeekScheduler.h"
+
+#include "Android/LogUtils.h"
+#include "KeyframeIndex.h"
+
+namespace OVR {
+
+// a player that never reports completion must not block seeking forever
+static const double SEEK_TIMEOUT = 2.0;
+
+SeekScheduler::SeekScheduler( SeekBackend & backend )
+	: Backend( backend )
+	, Index( NULL )
+	, LastId( 0 )
+{
+	Reset();
+	ResetStats();
+}
+
+void SeekScheduler::SetKeyframeIndex( const KeyframeIndex * index )
+{
+	Index = index;
+}
+
+void SeekScheduler::Reset()
+{
+	Index = NULL;
+	PendingMs = -1;
+	PendingId = 0;
+	InFlightMs = -1;
+	InFlightId = 0;
+	InFlightTime = 0.0;
+	BurstStartTime = 0.0;
+	AwaitingFrame = false;
+}
+
+void SeekScheduler::ResetStats()
+{
+	IssuedCount = 0;
+	CoalescedCount = 0;
+	TimedOutCount = 0;
+	StaleCount = 0;
+	SeekLatencyCount = 0;
+	SeekLatencyTotal = 0.0;
+	FirstFrameCount = 0;
+	FirstFrameTotal = 0.0;
+	FirstFrameMax = 0.0;
+}
+
+int SeekScheduler::RequestSeek( const int targetMs, const int fromMs, const double now )
+{
+	if ( !IsSeeking() && !AwaitingFrame )
+	{
+		BurstStartTime = now;
+	}
+	if ( PendingMs >= 0 )
+	{
+		CoalescedCount++;
+	}
+	int snapped = ( Index != NULL ) ? Index->Snap( targetMs, fromMs ) : targetMs;
+	if ( snapped < 0 )
+	{
+		snapped = 0;
+	}
+	PendingMs = snapped;
+	PendingId = ++LastId;
+	AwaitingFrame = false;
+	return snapped;
+}
+
+void SeekScheduler::Update( const double now )
+{
+	if ( InFlightMs >= 0 && now - InFlightTime > SEEK_TIMEOUT )
+	{
+		LOG( "SeekScheduler: seek %i to %i timed out", InFlightId, InFlightMs );
+		TimedOutCount++;
+		InFlightMs = -1;
+		Backend.AbandonSeek( InFlightId );
+	}
+	if ( PendingMs < 0 || InFlightMs >= 0 )
+	{
+		return;
+	}
+	InFlightMs = PendingMs;
+	InFlightId = PendingId;
+	InFlightTime = now;
+	PendingMs = -1;
+	IssuedCount++;
+	Backend.IssueSeek( InFlightMs, InFlightId );
+}
+
+void SeekScheduler::OnSeekComplete( const int seekId, const double now )
+{
+	if ( InFlightMs < 0 || seekId != InFlightId )
+	{
+		// timed out, or from before a Reset()
+		LOG( "SeekScheduler: ignoring completion of seek %i", seekId );
+		StaleCount++;
+		return;
+	}
+	SeekLatencyCount++;
+	SeekLatencyTotal += now - InFlightTime;
+	InFlightMs = -1;
+
+	// the frame that counts is the one after the last seek of the burst
+	AwaitingFrame = ( PendingMs < 0 );
+	Update( now );
+}
+
+void SeekScheduler::OnFrameLatched( const double now )
+{
+	if ( !AwaitingFrame )
+	{
+		return;
+	}
+	AwaitingFrame = false;
+	const double latency = now - BurstStartTime;
+	FirstFrameCount++;
+	FirstFrameTotal += latency;
+	if ( latency > FirstFrameMax )
+	{
+		FirstFrameMax = latency;
+	}
+}
+
+}
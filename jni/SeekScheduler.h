@@ -0,0 +1,114 @@
+/************************************************************************************
+
+Filename    :   SeekScheduler.h
+Content     :   Coalesces seek requests and snaps them to keyframes
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_SeekScheduler_h )
+#define OVR_SeekScheduler_h
+
+#include "Kernel/OVR_Types.h"
+
+namespace OVR {
+
+class KeyframeIndex;
+
+//==============================================================
+// SeekBackend
+//
+// The player the scheduler sends seeks to. OnSeekComplete must be called
+// on the scheduler with the seek's id once the player reports it done.
+class SeekBackend
+{
+public:
+	virtual			~SeekBackend() {}
+
+	virtual void	IssueSeek( const int positionMs, const int seekId ) = 0;
+	// The player didn't report the seek in time, stop waiting for it.
+	virtual void	AbandonSeek( const int seekId ) = 0;
+};
+
+//==============================================================
+// SeekScheduler
+//
+// At most one seek is in flight. Requests made while one is in flight
+// replace each other, so a burst of swipes results in the first seek and
+// the latest target only. VR thread only, times are in seconds.
+//
+// Every request gets an id, increasing for the life of the scheduler, and
+// a completion only counts for the seek with its id. A completion that
+// arrives after its seek timed out is dropped instead of ending the next one.
+class SeekScheduler
+{
+public:
+					SeekScheduler( SeekBackend & backend );
+
+	// The index must stay valid until it is replaced or Reset() is called.
+	void			SetKeyframeIndex( const KeyframeIndex * index );
+	// Keeps the id sequence, completions still queued for the old video don't match.
+	void			Reset();
+
+	// Returns the keyframe snapped target that will be sent.
+	int				RequestSeek( const int targetMs, const int fromMs, const double now );
+
+	// Sends the latest request if nothing is in flight.
+	void			Update( const double now );
+
+	void			OnSeekComplete( const int seekId, const double now );
+	void			OnFrameLatched( const double now );
+
+	bool			IsSeeking() const			{ return PendingMs >= 0 || InFlightMs >= 0; }
+	int				GetTargetMs() const			{ return PendingMs >= 0 ? PendingMs : InFlightMs; }
+	// id of the latest request, which carries the target
+	int				GetTargetId() const			{ return PendingMs >= 0 ? PendingId : InFlightId; }
+	// the last seek completed but no frame from the new position has been latched yet
+	bool			IsAwaitingFrame() const		{ return AwaitingFrame; }
+
+	int				GetIssuedCount() const		{ return IssuedCount; }
+	int				GetCoalescedCount() const	{ return CoalescedCount; }
+	int				GetCompletedCount() const	{ return FirstFrameCount; }
+	int				GetTimedOutCount() const	{ return TimedOutCount; }
+	int				GetStaleCount() const		{ return StaleCount; }
+	// issue to player reported completion
+	double			GetSeekLatencyAverage() const	{ return SeekLatencyCount > 0 ? SeekLatencyTotal / SeekLatencyCount : 0.0; }
+	// first request of a burst to the first frame latched after it
+	double			GetFirstFrameLatencyAverage() const	{ return FirstFrameCount > 0 ? FirstFrameTotal / FirstFrameCount : 0.0; }
+	double			GetFirstFrameLatencyMax() const		{ return FirstFrameMax; }
+	void			ResetStats();
+
+private:
+	SeekBackend &			Backend;
+	const KeyframeIndex *	Index;
+
+	int				PendingMs;			// -1 when none
+	int				PendingId;
+	int				InFlightMs;			// -1 when none
+	int				InFlightId;
+	int				LastId;
+	double			InFlightTime;
+	double			BurstStartTime;
+	bool			AwaitingFrame;
+
+	int				IssuedCount;
+	int				CoalescedCount;
+	int				TimedOutCount;
+	int				StaleCount;
+	int				SeekLatencyCount;
+	double			SeekLatencyTotal;
+	int				FirstFrameCount;
+	double			FirstFrameTotal;
+	double			FirstFrameMax;
+};
+
+}
+
+#endif // OVR_SeekScheduler_h
@@ -0,0 +1,332 @@
+/************************************************************************************
+
+Filename    :   Subtitles.cpp
+Content     :   SRT and WebVTT sidecar subtitles with a sorted cue index
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "Subtitles.h"
+
+#include <string.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "BitmapFont.h"
+#include "MediaContainer.h"
+
+namespace OVR {
+
+static const int	MAX_SUBTITLE_BYTES = 4 * 1024 * 1024;
+
+static bool IsDigit( const char c )
+{
+	return c >= '0' && c <= '9';
+}
+
+bool ParseCueTimestamp( const char * text, int & outMs )
+{
+	const char * p = text;
+	while ( *p == ' ' || *p == '\t' )
+	{
+		p++;
+	}
+
+	int fields[3];
+	int count = 0;
+	for ( ; ; )
+	{
+		if ( !IsDigit( *p ) )
+		{
+			return false;
+		}
+		int value = 0;
+		while ( IsDigit( *p ) )
+		{
+			value = value * 10 + ( *p++ - '0' );
+		}
+		fields[count++] = value;
+		if ( *p != ':' || count == 3 )
+		{
+			break;
+		}
+		p++;
+	}
+	if ( count < 2 )
+	{
+		return false;
+	}
+
+	int ms = 0;
+	if ( *p == '.' || *p == ',' )
+	{
+		p++;
+		int digits = 0;
+		for ( ; IsDigit( *p ) && digits < 3; digits++ )
+		{
+			ms = ms * 10 + ( *p++ - '0' );
+		}
+		for ( ; digits < 3; digits++ )
+		{
+			ms *= 10;
+		}
+	}
+	const int seconds = ( count == 3 ) ? ( fields[0] * 60 + fields[1] ) * 60 + fields[2] : fields[0] * 60 + fields[1];
+	outMs = seconds * 1000 + ms;
+	return true;
+}
+
+// Drops markup, <i> and <c.yellow> in either format and {\an8} from SSA
+// styled SRT, and decodes the entities WebVTT requires.
+static void AppendPlainText( String & out, const char * line )
+{
+	for ( const char * p = line; *p != 0; )
+	{
+		if ( *p == '<' || *p == '{' )
+		{
+			const char close = ( *p == '<' ) ? '>' : '}';
+			const char * end = strchr( p, close );
+			if ( end != NULL )
+			{
+				p = end + 1;
+				continue;
+			}
+		}
+		if ( *p == '&' )
+		{
+			static const char * entities[][2] = { { "&amp;", "&" }, { "&lt;", "<" }, { "&gt;", ">" }, { "&nbsp;", " " } };
+			bool decoded = false;
+			for ( int i = 0; i < 4 && !decoded; i++ )
+			{
+				const int length = static_cast< int >( strlen( entities[i][0] ) );
+				if ( strncmp( p, entities[i][0], length ) == 0 )
+				{
+					out += entities[i][1];
+					p += length;
+					decoded = true;
+				}
+			}
+			if ( decoded )
+			{
+				continue;
+			}
+		}
+		out.AppendChar( static_cast< UByte >( *p ) );
+		p++;
+	}
+}
+
+SubtitleTrack::SubtitleTrack()
+	: LayoutWidth( 0.0f )
+{
+}
+
+void SubtitleTrack::Clear()
+{
+	Cues.Clear();
+	MaxEndMs.Clear();
+	LayoutWidth = 0.0f;
+}
+
+bool SubtitleTrack::LoadForVideo( const char * videoPath )
+{
+	Clear();
+	if ( videoPath == NULL || videoPath[0] != '/' )
+	{
+		return false;
+	}
+	String base( videoPath );
+	const char * dot = strrchr( videoPath, '.' );
+	const char * slash = strrchr( videoPath, '/' );
+	if ( dot != NULL && dot > slash )
+	{
+		base = String( videoPath, dot - videoPath );
+	}
+	return LoadFile( ( base + ".srt" ).ToCStr() ) || LoadFile( ( base + ".vtt" ).ToCStr() );
+}
+
+bool SubtitleTrack::LoadFile( const char * path )
+{
+	Clear();
+	MediaFile file;
+	Array< UByte > text;
+	if ( !file.Open( path ) || file.GetSize() > MAX_SUBTITLE_BYTES ||
+		!file.ReadArray( 0, static_cast< int >( file.GetSize() ), text ) )
+	{
+		return false;
+	}
+	if ( !Parse( reinterpret_cast< const char * >( text.GetDataPtr() ), text.GetSizeI() ) )
+	{
+		return false;
+	}
+	LOG( "Subtitles: %i cues from '%s'", Cues.GetSizeI(), path );
+	return true;
+}
+
+bool SubtitleTrack::Parse( const char * text, const int length )
+{
+	Clear();
+	if ( length <= 0 )
+	{
+		return false;
+	}
+
+	Array< char > buffer;
+	buffer.Resize( length + 1 );
+	memcpy( buffer.GetDataPtr(), text, length );
+	buffer[length] = 0;
+
+	char * line = buffer.GetDataPtr();
+	// UTF-8 byte order mark
+	if ( length >= 3 && memcmp( line, "\xEF\xBB\xBF", 3 ) == 0 )
+	{
+		line += 3;
+	}
+
+	// Cue numbers in SRT and cue identifiers, NOTE and STYLE blocks in WebVTT
+	// all come outside of a cue, so only timing lines and the text after them matter.
+	bool inCue = false;
+	int startMs = 0;
+	int endMs = 0;
+	String cueText;
+	while ( line != NULL )
+	{
+		char * next = strchr( line, '\n' );
+		if ( next != NULL )
+		{
+			*next++ = 0;
+		}
+		const int lineLength = static_cast< int >( strlen( line ) );
+		if ( lineLength > 0 && line[lineLength - 1] == '\r' )
+		{
+			line[lineLength - 1] = 0;
+		}
+
+		const char * arrow = strstr( line, "-->" );
+		if ( arrow != NULL )
+		{
+			if ( inCue )
+			{
+				AddCue( startMs, endMs, cueText );
+			}
+			inCue = ParseCueTimestamp( line, startMs ) && ParseCueTimestamp( arrow + 3, endMs ) && endMs > startMs;
+			cueText.Clear();
+		}
+		else if ( line[0] == 0 )
+		{
+			if ( inCue )
+			{
+				AddCue( startMs, endMs, cueText );
+			}
+			inCue = false;
+		}
+		else if ( inCue )
+		{
+			if ( !cueText.IsEmpty() )
+			{
+				cueText += "\n";
+			}
+			AppendPlainText( cueText, line );
+		}
+		line = next;
+	}
+	if ( inCue )
+	{
+		AddCue( startMs, endMs, cueText );
+	}
+
+	Finish();
+	return Cues.GetSizeI() > 0;
+}
+
+void SubtitleTrack::AddCue( const int startMs, const int endMs, const String & text )
+{
+	if ( text.IsEmpty() )
+	{
+		return;
+	}
+	SubtitleCue cue;
+	cue.StartMs = startMs;
+	cue.EndMs = endMs;
+	cue.Text = text;
+	cue.LineCount = 0;
+	Cues.PushBack( cue );
+}
+
+void SubtitleTrack::Finish()
+{
+	// files are nearly always in order already, which insertion sort handles in one pass
+	for ( int i = 1; i < Cues.GetSizeI(); i++ )
+	{
+		for ( int j = i; j > 0 && Cues[j].StartMs < Cues[j - 1].StartMs; j-- )
+		{
+			Alg::Swap( Cues[j], Cues[j - 1] );
+		}
+	}
+	MaxEndMs.Resize( Cues.GetSize() );
+	for ( int i = 0; i < Cues.GetSizeI(); i++ )
+	{
+		MaxEndMs[i] = ( i > 0 ) ? Alg::Max( MaxEndMs[i - 1], Cues[i].EndMs ) : Cues[i].EndMs;
+	}
+}
+
+int SubtitleTrack::FindCue( const int positionMs ) const
+{
+	// last cue starting at or before the position
+	int lo = 0;
+	int hi = Cues.GetSizeI();
+	while ( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if ( Cues[mid].StartMs <= positionMs )
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	// an earlier, longer cue may still be showing, until no cue up to i ends after the position
+	for ( int i = lo - 1; i >= 0 && MaxEndMs[i] > positionMs; i-- )
+	{
+		if ( Cues[i].EndMs > positionMs )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+const SubtitleCue & SubtitleTrack::GetLayout( const int index, BitmapFont & font, const float widthMeters )
+{
+	if ( widthMeters != LayoutWidth )
+	{
+		for ( int i = 0; i < Cues.GetSizeI(); i++ )
+		{
+			Cues[i].Layout.Clear();
+		}
+		LayoutWidth = widthMeters;
+	}
+	SubtitleCue & cue = Cues[index];
+	if ( cue.Layout.IsEmpty() )
+	{
+		cue.Layout = cue.Text;
+		font.WordWrapText( cue.Layout, widthMeters );
+		cue.LineCount = 1;
+		for ( const char * p = cue.Layout.ToCStr(); *p != 0; p++ )
+		{
+			cue.LineCount += ( *p == '\n' ) ? 1 : 0;
+		}
+	}
+	return cue;
+}
+
+}
@@ -0,0 +1,83 @@
+/************************************************************************************
+
+Filename    :   Subtitles.h
+Content     :   SRT and WebVTT sidecar subtitles with a sorted cue index
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_Subtitles_h )
+#define OVR_Subtitles_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+class BitmapFont;
+
+// hh:mm:ss.ttt or mm:ss.ttt, with ',' before the milliseconds in SRT.
+// Shared with the WebVTT thumbnail tracks.
+bool	ParseCueTimestamp( const char * text, int & outMs );
+
+//==============================================================
+// SubtitleCue
+struct SubtitleCue
+{
+	int				StartMs;
+	int				EndMs;
+	String			Text;			// tags stripped, lines separated by '\n'
+	String			Layout;			// Text word wrapped for the font, empty until first shown
+	int				LineCount;
+};
+
+//==============================================================
+// SubtitleTrack
+//
+// Cues are sorted by start time once, when loaded, so finding the cue for
+// the playback position is a binary search. Overlapping cues are allowed;
+// the latest one to start wins. Word wrapping is done the first time a
+// cue is shown and kept, so a frame only draws the cached layout.
+class SubtitleTrack
+{
+public:
+						SubtitleTrack();
+
+	// Looks for name.srt, then name.vtt next to a local video.
+	bool				LoadForVideo( const char * videoPath );
+	bool				LoadFile( const char * path );
+
+	// Either format; both are timing lines followed by text, ended by a blank line.
+	bool				Parse( const char * text, const int length );
+
+	void				Clear();
+	bool				IsEmpty() const			{ return Cues.GetSizeI() == 0; }
+	int					GetCueCount() const		{ return Cues.GetSizeI(); }
+	const SubtitleCue &	GetCue( const int index ) const	{ return Cues[index]; }
+
+	// Index of the cue showing at positionMs, -1 when none.
+	int					FindCue( const int positionMs ) const;
+
+	// The cue's text wrapped to widthMeters, laid out on first use.
+	const SubtitleCue &	GetLayout( const int index, BitmapFont & font, const float widthMeters );
+
+private:
+	Array< SubtitleCue >	Cues;
+	Array< int >			MaxEndMs;		// latest end of the cues up to and including each one
+	float					LayoutWidth;
+
+	void				AddCue( const int startMs, const int endMs, const String & text );
+	void				Finish();
+};
+
+}
+
+#endif // OVR_Subtitles_h
@@ -0,0 +1,144 @@
+/************************************************************************************
+
+Filename    :   SurfaceTexturePool.cpp
+Content     :   Pre-allocated SurfaceTextures handed to the Java player without blocking
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "SurfaceTexturePool.h"
+
+#include "Android/LogUtils.h"
+#include "SurfaceTexture.h"
+
+namespace OVR {
+
+SurfaceTexturePool::SurfaceTexturePool()
+	: Slot( 0 )
+	, PublishedCount( 0 )
+	, Returned( 0 )
+{
+}
+
+SurfaceTexturePool::~SurfaceTexturePool()
+{
+	OVR_ASSERT( Textures.GetSizeI() == 0 );
+}
+
+void SurfaceTexturePool::Init( JNIEnv * jni, const int poolSize )
+{
+	OVR_ASSERT( Textures.GetSizeI() == 0 );
+	OVR_ASSERT( poolSize <= MAX_POOL_SIZE );
+
+	for ( int i = 0; i < poolSize; i++ )
+	{
+		SurfaceTexture * texture = new SurfaceTexture( jni );
+		Textures.PushBack( texture );
+		JavaObjects.PushBack( texture->javaObject );
+		FreeList.PushBack( i );
+	}
+	// the arrays are never resized after this, so Take() can index them from other threads
+	__atomic_store_n( &PublishedCount, poolSize, __ATOMIC_RELEASE );
+	LOG( "SurfaceTexturePool: created %i textures", poolSize );
+
+	Refill();
+}
+
+void SurfaceTexturePool::Shutdown()
+{
+	__atomic_store_n( &Slot, 0, __ATOMIC_RELEASE );
+	__atomic_store_n( &PublishedCount, 0, __ATOMIC_RELEASE );
+	__atomic_store_n( &Returned, 0, __ATOMIC_RELEASE );
+
+	for ( int i = 0; i < Textures.GetSizeI(); i++ )
+	{
+		delete Textures[i];
+	}
+	Textures.Clear();
+	JavaObjects.Clear();
+	FreeList.Clear();
+}
+
+void SurfaceTexturePool::Refill()
+{
+	const UInt32 returned = __atomic_exchange_n( &Returned, 0, __ATOMIC_ACQ_REL );
+	for ( int i = 0; returned != 0 && i < Textures.GetSizeI(); i++ )
+	{
+		if ( returned & ( 1u << i ) )
+		{
+			FreeList.PushBack( i );
+		}
+	}
+
+	if ( __atomic_load_n( &Slot, __ATOMIC_ACQUIRE ) != 0 )
+	{
+		return;
+	}
+	if ( FreeList.GetSizeI() == 0 )
+	{
+		LOG( "SurfaceTexturePool: no free texture to publish" );
+		return;
+	}
+	const int index = FreeList[0];
+	FreeList.RemoveAt( 0 );
+	// only the VR thread ever fills the slot, so a plain store can't lose a texture
+	__atomic_store_n( &Slot, index + 1, __ATOMIC_RELEASE );
+}
+
+void SurfaceTexturePool::Recycle( SurfaceTexture * texture )
+{
+	if ( texture == NULL )
+	{
+		return;
+	}
+	for ( int i = 0; i < Textures.GetSizeI(); i++ )
+	{
+		if ( Textures[i] == texture )
+		{
+			FreeList.PushBack( i );
+			Refill();
+			return;
+		}
+	}
+	LOG( "SurfaceTexturePool: recycled texture %i is not from the pool", texture->textureId );
+	OVR_ASSERT( false );
+}
+
+SurfaceTexture * SurfaceTexturePool::Get( const int index ) const
+{
+	if ( index < 0 || index >= Textures.GetSizeI() )
+	{
+		return NULL;
+	}
+	return Textures[index];
+}
+
+int SurfaceTexturePool::Take( jobject & outJavaObject )
+{
+	outJavaObject = NULL;
+	const int slot = __atomic_exchange_n( &Slot, 0, __ATOMIC_ACQ_REL );
+	if ( slot == 0 || slot > __atomic_load_n( &PublishedCount, __ATOMIC_ACQUIRE ) )
+	{
+		return INVALID_INDEX;
+	}
+	outJavaObject = JavaObjects[slot - 1];
+	return slot - 1;
+}
+
+void SurfaceTexturePool::Return( const int index )
+{
+	if ( index < 0 || index >= __atomic_load_n( &PublishedCount, __ATOMIC_ACQUIRE ) )
+	{
+		return;
+	}
+	__atomic_fetch_or( &Returned, 1u << index, __ATOMIC_RELEASE );
+}
+
+}
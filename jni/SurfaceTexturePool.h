@@ -0,0 +1,74 @@
+/************************************************************************************
+
+Filename    :   SurfaceTexturePool.h
+Content     :   Pre-allocated SurfaceTextures handed to the Java player without blocking
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_SurfaceTexturePool_h )
+#define OVR_SurfaceTexturePool_h
+
+#include <jni.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+
+namespace OVR {
+
+class SurfaceTexture;
+
+//==============================================================
+// SurfaceTexturePool
+//
+// The textures are created, recycled and destroyed on the VR thread, which
+// owns the GL context. One free texture at a time is published in a slot
+// that any thread can take with a single atomic exchange, so the Java UI
+// thread never waits for the VR thread to reach its message queue.
+//
+// Recycled textures go to the back of the free list, so a texture that a
+// player was just detached from isn't handed out again right away.
+//
+// A thread that took a texture but can't hand it on, because the event
+// telling the VR thread about it didn't fit, gives it back with Return().
+// The next Refill() puts it on the free list.
+class SurfaceTexturePool
+{
+public:
+	static const int	DEFAULT_POOL_SIZE = 3;
+	static const int	INVALID_INDEX = -1;
+	static const int	MAX_POOL_SIZE = 32;	// bits of Returned
+
+						SurfaceTexturePool();
+						~SurfaceTexturePool();
+
+	// VR thread only.
+	void				Init( JNIEnv * jni, const int poolSize = DEFAULT_POOL_SIZE );
+	void				Shutdown();
+	void				Refill();
+	void				Recycle( SurfaceTexture * texture );
+	SurfaceTexture *	Get( const int index ) const;
+
+	// Any thread. Returns INVALID_INDEX and a NULL object when the slot is empty.
+	int					Take( jobject & outJavaObject );
+	void				Return( const int index );
+
+private:
+	Array< SurfaceTexture * >	Textures;
+	Array< jobject >			JavaObjects;	// global refs, immutable once published
+	Array< int >				FreeList;		// VR thread only, oldest first
+	int							Slot;			// texture index + 1, 0 when empty
+	int							PublishedCount;	// entries of JavaObjects visible to Take()
+	UInt32						Returned;		// bit per index given back by Return()
+};
+
+}
+
+#endif // OVR_SurfaceTexturePool_h
@@ -0,0 +1,218 @@
+/************************************************************************************
+
+Filename    :   ThumbnailCache.cpp
+Content     :   Decoded browser thumbnails, evicted least recently viewed first
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "ThumbnailCache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+ThumbnailCache::ThumbnailCache( const int budgetBytes )
+	: Views( 0 )
+	, Budget( budgetBytes )
+	, Bytes( 0 )
+{
+	pthread_mutex_init( &Mutex, NULL );
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+	for ( int i = 0; i < Entries.GetSizeI(); i++ )
+	{
+		free( Entries[i].Pixels );
+	}
+	pthread_mutex_destroy( &Mutex );
+}
+
+void ThumbnailCache::AddPlaceholder( const char * filename )
+{
+	pthread_mutex_lock( &Mutex );
+	if ( !IsPlaceholder( filename ) )
+	{
+		Placeholders.PushBack( filename );
+		// one that was cached before stops counting against the budget
+		const int index = FindEntry( filename );
+		if ( index >= 0 )
+		{
+			Entries[index].Placeholder = true;
+			Bytes -= Entries[index].Width * Entries[index].Height * 4;
+		}
+	}
+	pthread_mutex_unlock( &Mutex );
+}
+
+unsigned char * ThumbnailCache::Find( const char * filename, int & width, int & height )
+{
+	unsigned char * pixels = NULL;
+	pthread_mutex_lock( &Mutex );
+	const int index = FindEntry( filename );
+	if ( index >= 0 )
+	{
+		Entry & entry = Entries[index];
+		const size_t size = entry.Width * entry.Height * 4;
+		pixels = static_cast< unsigned char * >( malloc( size ) );
+		memcpy( pixels, entry.Pixels, size );
+		width = entry.Width;
+		height = entry.Height;
+		entry.LastView = ++Views;
+	}
+	pthread_mutex_unlock( &Mutex );
+	return pixels;
+}
+
+void ThumbnailCache::Store( const char * filename, const unsigned char * pixels, const int width, const int height )
+{
+	const int size = width * height * 4;
+	pthread_mutex_lock( &Mutex );
+	const int index = FindEntry( filename );
+	if ( index >= 0 )
+	{
+		RemoveEntry( index );
+	}
+	const bool placeholder = IsPlaceholder( filename );
+	if ( placeholder || size <= Budget )
+	{
+		if ( !placeholder )
+		{
+			EvictTo( Budget - size );
+		}
+		Entry entry;
+		entry.Filename = filename;
+		entry.Pixels = static_cast< unsigned char * >( malloc( size ) );
+		memcpy( entry.Pixels, pixels, size );
+		entry.Width = width;
+		entry.Height = height;
+		entry.LastView = ++Views;
+		entry.Placeholder = placeholder;
+		Entries.PushBack( entry );
+		Bytes += placeholder ? 0 : size;
+	}
+	pthread_mutex_unlock( &Mutex );
+}
+
+void ThumbnailCache::Forget( const String & filename )
+{
+	pthread_mutex_lock( &Mutex );
+	const int index = FindEntry( filename.ToCStr() );
+	if ( index >= 0 )
+	{
+		RemoveEntry( index );
+	}
+	pthread_mutex_unlock( &Mutex );
+}
+
+void ThumbnailCache::SetBudget( const int budgetBytes )
+{
+	pthread_mutex_lock( &Mutex );
+	Budget = budgetBytes;
+	EvictTo( Budget );
+	LOG( "ThumbnailCache::SetBudget %i KB, %i thumbnails of %i KB kept", Budget / 1024, Entries.GetSizeI(), Bytes / 1024 );
+	pthread_mutex_unlock( &Mutex );
+}
+
+bool ThumbnailCache::Contains( const char * filename ) const
+{
+	pthread_mutex_lock( &Mutex );
+	const bool found = FindEntry( filename ) >= 0;
+	pthread_mutex_unlock( &Mutex );
+	return found;
+}
+
+int ThumbnailCache::GetBudget() const
+{
+	pthread_mutex_lock( &Mutex );
+	const int budget = Budget;
+	pthread_mutex_unlock( &Mutex );
+	return budget;
+}
+
+int ThumbnailCache::GetBytes() const
+{
+	pthread_mutex_lock( &Mutex );
+	int bytes = Bytes;
+	for ( int i = 0; i < Entries.GetSizeI(); i++ )
+	{
+		bytes += Entries[i].Placeholder ? Entries[i].Width * Entries[i].Height * 4 : 0;
+	}
+	pthread_mutex_unlock( &Mutex );
+	return bytes;
+}
+
+int ThumbnailCache::GetCount() const
+{
+	pthread_mutex_lock( &Mutex );
+	const int count = Entries.GetSizeI();
+	pthread_mutex_unlock( &Mutex );
+	return count;
+}
+
+int ThumbnailCache::FindEntry( const char * filename ) const
+{
+	for ( int i = 0; i < Entries.GetSizeI(); i++ )
+	{
+		if ( Entries[i].Filename == filename )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool ThumbnailCache::IsPlaceholder( const char * filename ) const
+{
+	for ( int i = 0; i < Placeholders.GetSizeI(); i++ )
+	{
+		if ( Placeholders[i] == filename )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThumbnailCache::RemoveEntry( const int index )
+{
+	Entry & entry = Entries[index];
+	Bytes -= entry.Placeholder ? 0 : entry.Width * entry.Height * 4;
+	free( entry.Pixels );
+	Entries.RemoveAt( index );
+}
+
+// The cache holds a few dozen thumbnails, few enough to look for the least
+// recently viewed one on each eviction.
+void ThumbnailCache::EvictTo( const int budgetBytes )
+{
+	while ( Bytes > budgetBytes )
+	{
+		int oldest = -1;
+		for ( int i = 0; i < Entries.GetSizeI(); i++ )
+		{
+			if ( !Entries[i].Placeholder && ( oldest < 0 || Entries[i].LastView < Entries[oldest].LastView ) )
+			{
+				oldest = i;
+			}
+		}
+		if ( oldest < 0 )
+		{
+			break;
+		}
+		RemoveEntry( oldest );
+	}
+}
+
+}
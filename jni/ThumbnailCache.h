@@ -0,0 +1,91 @@
+/************************************************************************************
+
+Filename    :   ThumbnailCache.h
+Content     :   Decoded browser thumbnails, evicted least recently viewed first
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_ThumbnailCache_h )
+#define OVR_ThumbnailCache_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+//==============================================================
+// ThumbnailCache
+//
+// Keeps the thumbnails the browser decoded, so a category that is rebuilt
+// or scrolled back to doesn't read and scale them again. Every Find() of a
+// thumbnail counts as a view of it, and when a new one doesn't fit the
+// budget the one viewed longest ago goes first.
+//
+// Placeholders, the images panels show when a video has no thumbnail of
+// its own or for a page panel, are decoded once and shared by all of
+// those panels. They are kept whatever the budget, and don't count against
+// it, because a category can show any number of them.
+//
+// Called from the VR thread and the thumbnail thread.
+class ThumbnailCache
+{
+public:
+	explicit			ThumbnailCache( const int budgetBytes );
+						~ThumbnailCache();
+
+	void				AddPlaceholder( const char * filename );
+
+	// Returns a copy the caller frees, or NULL if the thumbnail isn't cached.
+	unsigned char *		Find( const char * filename, int & width, int & height );
+
+	// Copies the pixels, RGBA, evicting what it takes to fit the budget.
+	// A thumbnail larger than the whole budget isn't kept.
+	void				Store( const char * filename, const unsigned char * pixels, const int width, const int height );
+	void				Forget( const String & filename );
+
+	// Evicts down to the new budget. 0 keeps only the placeholders.
+	void				SetBudget( const int budgetBytes );
+
+	bool				Contains( const char * filename ) const;	// doesn't count as a view
+	int					GetBudget() const;
+	int					GetBytes() const;		// placeholders included
+	int					GetCount() const;
+
+private:
+	struct Entry
+	{
+		String			Filename;
+		unsigned char *	Pixels;
+		int				Width;
+		int				Height;
+		UInt32			LastView;
+		bool			Placeholder;
+	};
+
+	mutable pthread_mutex_t	Mutex;
+	Array< Entry >		Entries;
+	Array< String >		Placeholders;
+	UInt32				Views;
+	int					Budget;
+	int					Bytes;				// of the entries that aren't placeholders
+
+	int					FindEntry( const char * filename ) const;
+	bool				IsPlaceholder( const char * filename ) const;
+	void				RemoveEntry( const int index );
+	void				EvictTo( const int budgetBytes );
+};
+
+}
+
+#endif // OVR_ThumbnailCache_h
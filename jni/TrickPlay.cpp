@@ -0,0 +1,562 @@
+/************************************************************************************
+
+Filename    :   TrickPlay.cpp
+Content     :   Seek preview thumbnails from BIF or WebVTT sprite sheet sidecars
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "TrickPlay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "MediaContainer.h"
+#include "Subtitles.h"
+#include "OVR_TurboJpeg.h"
+
+namespace OVR {
+
+static const int	MAX_JPEG_BYTES = 4 * 1024 * 1024;
+static const int	MAX_SIDECAR_BYTES = 16 * 1024 * 1024;
+
+static double GetSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static UInt32 ReadLE32( const UByte * p )
+{
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( ( UInt32 )p[3] << 24 );
+}
+
+//==============================================================
+// TrickPlayIndex
+
+bool TrickPlayIndex::LoadForVideo( const char * videoPath )
+{
+	if ( videoPath == NULL || videoPath[0] != '/' )
+	{
+		return false;
+	}
+	String base( videoPath );
+	const char * dot = strrchr( videoPath, '.' );
+	const char * slash = strrchr( videoPath, '/' );
+	if ( dot != NULL && dot > slash )
+	{
+		base = String( videoPath, dot - videoPath );
+	}
+	return LoadBif( ( base + ".bif" ).ToCStr() ) || LoadWebVtt( ( base + ".thumbs.vtt" ).ToCStr() );
+}
+
+bool TrickPlayIndex::LoadBif( const char * path )
+{
+	Images.Clear();
+	Frames.Clear();
+
+	MediaFile file;
+	if ( !file.Open( path ) )
+	{
+		return false;
+	}
+	static const UByte magic[8] = { 0x89, 0x42, 0x49, 0x46, 0x0D, 0x0A, 0x1A, 0x0A };
+	UByte header[64];
+	if ( !file.Read( 0, header, sizeof( header ) ) || memcmp( header, magic, sizeof( magic ) ) != 0 )
+	{
+		return false;
+	}
+	const int count = static_cast< int >( ReadLE32( header + 12 ) );
+	UInt32 multiplier = ReadLE32( header + 16 );
+	if ( multiplier == 0 )
+	{
+		multiplier = 1000;
+	}
+	if ( count <= 0 || count > 100000 )
+	{
+		return false;
+	}
+
+	// count entries plus the terminating one, which only marks the end of the last image
+	Array< UByte > table;
+	if ( !file.ReadArray( 64, ( count + 1 ) * 8, table ) )
+	{
+		return false;
+	}
+	for ( int i = 0; i < count; i++ )
+	{
+		const UInt32 timestamp = ReadLE32( &table[i * 8] );
+		const UInt32 offset = ReadLE32( &table[i * 8 + 4] );
+		const UInt32 nextOffset = ReadLE32( &table[i * 8 + 12] );
+		if ( nextOffset <= offset || nextOffset - offset > static_cast< UInt32 >( MAX_JPEG_BYTES ) )
+		{
+			continue;
+		}
+		TrickPlayImage image;
+		image.Path = path;
+		image.Offset = offset;
+		image.Length = static_cast< int >( nextOffset - offset );
+
+		TrickPlayFrame frame;
+		frame.TimeMs = static_cast< int >( static_cast< UInt64 >( timestamp ) * multiplier );
+		frame.Image = Images.GetSizeI();
+		frame.X = frame.Y = frame.Width = frame.Height = 0;
+		Images.PushBack( image );
+		Frames.PushBack( frame );
+	}
+	LOG( "TrickPlay: %i BIF frames in '%s'", Frames.GetSizeI(), path );
+	return Frames.GetSizeI() > 0;
+}
+
+bool TrickPlayIndex::LoadWebVtt( const char * path )
+{
+	Images.Clear();
+	Frames.Clear();
+
+	MediaFile file;
+	Array< UByte > text;
+	if ( !file.Open( path ) || file.GetSize() > MAX_SIDECAR_BYTES ||
+		!file.ReadArray( 0, static_cast< int >( file.GetSize() ), text ) )
+	{
+		return false;
+	}
+	text.PushBack( 0 );
+
+	String directory( path );
+	const char * slash = strrchr( path, '/' );
+	if ( slash != NULL )
+	{
+		directory = String( path, slash - path + 1 );
+	}
+
+	int cueStart = -1;
+	char * line = reinterpret_cast< char * >( text.GetDataPtr() );
+	while ( line != NULL && *line != 0 )
+	{
+		char * next = strchr( line, '\n' );
+		if ( next != NULL )
+		{
+			*next++ = 0;
+		}
+		const int len = static_cast< int >( strlen( line ) );
+		if ( len > 0 && line[len - 1] == '\r' )
+		{
+			line[len - 1] = 0;
+		}
+
+		if ( strstr( line, "-->" ) != NULL )
+		{
+			if ( !ParseCueTimestamp( line, cueStart ) )
+			{
+				cueStart = -1;
+			}
+		}
+		else if ( cueStart >= 0 && line[0] != 0 )
+		{
+			// the payload of a thumbnail cue: image[#xywh=x,y,w,h]
+			TrickPlayFrame frame;
+			frame.TimeMs = cueStart;
+			frame.X = frame.Y = frame.Width = frame.Height = 0;
+			char * fragment = strstr( line, "#xywh=" );
+			if ( fragment != NULL )
+			{
+				sscanf( fragment + 6, "%d,%d,%d,%d", &frame.X, &frame.Y, &frame.Width, &frame.Height );
+				*fragment = 0;
+			}
+			// only local images, relative to the track
+			if ( strstr( line, "://" ) == NULL )
+			{
+				const String imagePath = ( line[0] == '/' ) ? String( line ) : directory + line;
+				frame.Image = -1;
+				for ( int i = Images.GetSizeI() - 1; i >= 0 && frame.Image < 0; i-- )
+				{
+					if ( Images[i].Path == imagePath )
+					{
+						frame.Image = i;
+					}
+				}
+				if ( frame.Image < 0 )
+				{
+					TrickPlayImage image;
+					image.Path = imagePath;
+					image.Offset = 0;
+					image.Length = 0;	// whole file
+					frame.Image = Images.GetSizeI();
+					Images.PushBack( image );
+				}
+				if ( Frames.GetSizeI() == 0 || frame.TimeMs > Frames.Back().TimeMs )
+				{
+					Frames.PushBack( frame );
+				}
+			}
+			cueStart = -1;
+		}
+		line = next;
+	}
+	LOG( "TrickPlay: %i WebVTT frames from %i images in '%s'", Frames.GetSizeI(), Images.GetSizeI(), path );
+	return Frames.GetSizeI() > 0;
+}
+
+void TrickPlayIndex::Decimate( const int maxFrames )
+{
+	if ( maxFrames <= 0 || Frames.GetSizeI() <= maxFrames )
+	{
+		return;
+	}
+	const int stride = ( Frames.GetSizeI() + maxFrames - 1 ) / maxFrames;
+	Array< TrickPlayFrame > kept;
+	for ( int i = 0; i < Frames.GetSizeI(); i += stride )
+	{
+		kept.PushBack( Frames[i] );
+	}
+	Frames = kept;
+}
+
+int TrickPlayIndex::FindFrame( const int timeMs ) const
+{
+	int lo = 0;
+	int hi = Frames.GetSizeI();
+	while ( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if ( Frames[mid].TimeMs <= timeMs )
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo - 1;
+}
+
+//==============================================================
+// TrickPlayAtlas
+
+TrickPlayAtlas::TrickPlayAtlas()
+	: CellWidth( 0 )
+	, CellHeight( 0 )
+	, CellsPerRow( 0 )
+	, CellsPerPage( 0 )
+	, PageCount( 0 )
+	, Running( false )
+	, StopRequested( false )
+	, DecodedFrames( 0 )
+	, DecodeSeconds( 0.0 )
+	, CpuBytes( 0 )
+{
+	pthread_mutex_init( &Mutex, NULL );
+	for ( int i = 0; i < MAX_PAGES; i++ )
+	{
+		Pages[i].State = PAGE_FILLING;
+		Pages[i].Pixels = NULL;
+		Pages[i].Texture = 0;
+	}
+}
+
+TrickPlayAtlas::~TrickPlayAtlas()
+{
+	Stop();
+	pthread_mutex_destroy( &Mutex );
+}
+
+bool TrickPlayAtlas::Start( const char * videoPath )
+{
+	Stop();
+	if ( !Index.LoadForVideo( videoPath ) )
+	{
+		return false;
+	}
+	StopRequested = false;
+	if ( pthread_create( &Thread, NULL, ThreadFunction, this ) != 0 )
+	{
+		LOG( "TrickPlayAtlas: pthread_create failed" );
+		return false;
+	}
+	Running = true;
+	return true;
+}
+
+// VR thread, the textures are deleted here.
+void TrickPlayAtlas::Stop()
+{
+	StopRequested = true;
+	if ( Running )
+	{
+		pthread_join( Thread, NULL );
+		Running = false;
+	}
+	for ( int i = 0; i < MAX_PAGES; i++ )
+	{
+		free( Pages[i].Pixels );
+		Pages[i].Pixels = NULL;
+		if ( Pages[i].Texture != 0 )
+		{
+			glDeleteTextures( 1, &Pages[i].Texture );
+		}
+		Pages[i].Texture = 0;
+		Pages[i].State = PAGE_FILLING;
+	}
+	Index.Images.Clear();
+	Index.Frames.Clear();
+	CellWidth = CellHeight = CellsPerRow = CellsPerPage = PageCount = 0;
+	DecodedFrames = 0;
+	DecodeSeconds = 0.0;
+	CpuBytes = 0;
+}
+
+void * TrickPlayAtlas::ThreadFunction( void * param )
+{
+	static_cast< TrickPlayAtlas * >( param )->DecodeAll();
+	return NULL;
+}
+
+void TrickPlayAtlas::DecodeAll()
+{
+	int decodedImage = -1;
+	UByte * rgba = NULL;
+	int width = 0;
+	int height = 0;
+	int currentPage = -1;
+	Array< UByte > jpeg;
+	MediaFile file;
+	String openPath;
+
+	for ( int i = 0; !StopRequested; i++ )
+	{
+		pthread_mutex_lock( &Mutex );
+		const bool more = i < Index.Frames.GetSizeI();
+		const TrickPlayFrame frame = more ? Index.Frames[i] : TrickPlayFrame();
+		pthread_mutex_unlock( &Mutex );
+		if ( !more )
+		{
+			break;
+		}
+
+		if ( frame.Image != decodedImage )
+		{
+			const double start = GetSeconds();
+			free( rgba );
+			rgba = NULL;
+			decodedImage = frame.Image;
+			const TrickPlayImage & image = Index.Images[frame.Image];
+			if ( openPath != image.Path )
+			{
+				openPath = image.Path;
+				file.Open( image.Path.ToCStr() );
+			}
+			const int length = ( image.Length > 0 ) ? image.Length : static_cast< int >( Alg::Min( file.GetSize(), ( SInt64 )MAX_JPEG_BYTES ) );
+			if ( file.IsOpen() && file.ReadArray( image.Offset, length, jpeg ) )
+			{
+				rgba = TurboJpegLoadFromMemory( jpeg.GetDataPtr(), jpeg.GetSizeI(), &width, &height );
+			}
+			pthread_mutex_lock( &Mutex );
+			DecodeSeconds += GetSeconds() - start;
+			pthread_mutex_unlock( &Mutex );
+		}
+		if ( rgba == NULL )
+		{
+			continue;
+		}
+
+		if ( CellsPerPage == 0 )
+		{
+			// the first frame decides the cell size for all of them
+			const int frameWidth = ( frame.Width > 0 ) ? frame.Width : width;
+			const int frameHeight = ( frame.Height > 0 ) ? frame.Height : height;
+			const int cellWidth = Alg::Min( frameWidth, static_cast< int >( MAX_CELL_WIDTH ) );
+			const int cellHeight = Alg::Max( 1, frameHeight * cellWidth / Alg::Max( frameWidth, 1 ) );
+			pthread_mutex_lock( &Mutex );
+			CellWidth = cellWidth;
+			CellHeight = Alg::Min( cellHeight, static_cast< int >( PAGE_SIZE ) );
+			CellsPerRow = PAGE_SIZE / CellWidth;
+			CellsPerPage = CellsPerRow * ( PAGE_SIZE / CellHeight );
+			Index.Decimate( CellsPerPage * MAX_PAGES );
+			PageCount = ( Index.Frames.GetSizeI() + CellsPerPage - 1 ) / CellsPerPage;
+			pthread_mutex_unlock( &Mutex );
+			LOG( "TrickPlayAtlas: %ix%i cells, %i frames on %i pages", CellWidth, CellHeight, Index.Frames.GetSizeI(), PageCount );
+			// decimation renumbers the frames after the first
+			if ( i > 0 )
+			{
+				i = -1;
+				continue;
+			}
+		}
+
+		const int page = i / CellsPerPage;
+		if ( page >= PageCount )
+		{
+			break;
+		}
+		if ( page != currentPage )
+		{
+			if ( currentPage >= 0 )
+			{
+				FinishPage( currentPage );
+			}
+			currentPage = page;
+			const int bytes = PAGE_SIZE * PAGE_SIZE * 4;
+			Pages[page].Pixels = static_cast< UByte * >( calloc( bytes, 1 ) );
+			pthread_mutex_lock( &Mutex );
+			CpuBytes += bytes;
+			pthread_mutex_unlock( &Mutex );
+		}
+		if ( Pages[page].Pixels == NULL )
+		{
+			continue;
+		}
+		CopyToCell( rgba, width, height, frame, i );
+		pthread_mutex_lock( &Mutex );
+		DecodedFrames++;
+		pthread_mutex_unlock( &Mutex );
+	}
+	if ( currentPage >= 0 && !StopRequested )
+	{
+		FinishPage( currentPage );
+	}
+	free( rgba );
+	if ( !StopRequested )
+	{
+		LOG( "TrickPlayAtlas: %i frames decoded in %.1f ms", DecodedFrames, DecodeSeconds * 1000.0 );
+	}
+}
+
+// Nearest sample scaling of the frame's region into its cell.
+void TrickPlayAtlas::CopyToCell( const UByte * rgba, const int width, const int height,
+		const TrickPlayFrame & frame, const int frameIndex )
+{
+	const int srcX = Alg::Clamp( frame.X, 0, width - 1 );
+	const int srcY = Alg::Clamp( frame.Y, 0, height - 1 );
+	const int srcW = Alg::Min( ( frame.Width > 0 ) ? frame.Width : width, width - srcX );
+	const int srcH = Alg::Min( ( frame.Height > 0 ) ? frame.Height : height, height - srcY );
+
+	const int cell = frameIndex % CellsPerPage;
+	const int cellX = ( cell % CellsPerRow ) * CellWidth;
+	const int cellY = ( cell / CellsPerRow ) * CellHeight;
+	UByte * dest = Pages[frameIndex / CellsPerPage].Pixels;
+	for ( int y = 0; y < CellHeight; y++ )
+	{
+		const UByte * srcRow = rgba + ( ( srcY + y * srcH / CellHeight ) * width + srcX ) * 4;
+		UInt32 * destRow = reinterpret_cast< UInt32 * >( dest + ( ( cellY + y ) * PAGE_SIZE + cellX ) * 4 );
+		for ( int x = 0; x < CellWidth; x++ )
+		{
+			memcpy( &destRow[x], srcRow + ( x * srcW / CellWidth ) * 4, 4 );
+		}
+	}
+}
+
+void TrickPlayAtlas::FinishPage( const int page )
+{
+	pthread_mutex_lock( &Mutex );
+	Pages[page].State = PAGE_READY;
+	pthread_mutex_unlock( &Mutex );
+}
+
+void TrickPlayAtlas::Frame()
+{
+	int page = -1;
+	pthread_mutex_lock( &Mutex );
+	for ( int i = 0; i < PageCount && page < 0; i++ )
+	{
+		if ( Pages[i].State == PAGE_READY )
+		{
+			page = i;
+		}
+	}
+	pthread_mutex_unlock( &Mutex );
+	if ( page < 0 )
+	{
+		return;
+	}
+
+	// the worker doesn't touch a page once it is ready
+	Page & p = Pages[page];
+	glGenTextures( 1, &p.Texture );
+	glBindTexture( GL_TEXTURE_2D, p.Texture );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, PAGE_SIZE, PAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, p.Pixels );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+	glBindTexture( GL_TEXTURE_2D, 0 );
+
+	free( p.Pixels );
+	pthread_mutex_lock( &Mutex );
+	p.Pixels = NULL;
+	p.State = PAGE_UPLOADED;
+	CpuBytes -= PAGE_SIZE * PAGE_SIZE * 4;
+	pthread_mutex_unlock( &Mutex );
+}
+
+bool TrickPlayAtlas::GetPreview( const int timeMs, GLuint & outTexture, Matrix4f & outTexm ) const
+{
+	pthread_mutex_lock( &Mutex );
+	const int frame = ( CellsPerPage > 0 ) ? Index.FindFrame( timeMs ) : -1;
+	const int page = ( frame >= 0 ) ? frame / CellsPerPage : -1;
+	const bool ready = page >= 0 && page < PageCount && Pages[page].State == PAGE_UPLOADED;
+	if ( ready )
+	{
+		const int cell = frame % CellsPerPage;
+		const float scale = 1.0f / PAGE_SIZE;
+		const float u0 = ( cell % CellsPerRow ) * CellWidth * scale;
+		const float v0 = ( cell / CellsPerRow ) * CellHeight * scale;
+		outTexm = Matrix4f(
+			CellWidth * scale, 0, 0, u0,
+			0, CellHeight * scale, 0, v0,
+			0, 0, 1, 0,
+			0, 0, 0, 1 );
+		outTexture = Pages[page].Texture;
+	}
+	pthread_mutex_unlock( &Mutex );
+	return ready;
+}
+
+int TrickPlayAtlas::GetDecodedFrames() const
+{
+	pthread_mutex_lock( &Mutex );
+	const int frames = DecodedFrames;
+	pthread_mutex_unlock( &Mutex );
+	return frames;
+}
+
+double TrickPlayAtlas::GetDecodeSeconds() const
+{
+	pthread_mutex_lock( &Mutex );
+	const double seconds = DecodeSeconds;
+	pthread_mutex_unlock( &Mutex );
+	return seconds;
+}
+
+int TrickPlayAtlas::GetCpuBytes() const
+{
+	pthread_mutex_lock( &Mutex );
+	const int bytes = CpuBytes;
+	pthread_mutex_unlock( &Mutex );
+	return bytes;
+}
+
+int TrickPlayAtlas::GetGpuBytes() const
+{
+	int pages = 0;
+	pthread_mutex_lock( &Mutex );
+	for ( int i = 0; i < PageCount; i++ )
+	{
+		pages += ( Pages[i].State == PAGE_UPLOADED ) ? 1 : 0;
+	}
+	pthread_mutex_unlock( &Mutex );
+	return pages * PAGE_SIZE * PAGE_SIZE * 4;
+}
+
+}
@@ -0,0 +1,141 @@
+/************************************************************************************
+
+Filename    :   TrickPlay.h
+Content     :   Seek preview thumbnails from BIF or WebVTT sprite sheet sidecars
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_TrickPlay_h )
+#define OVR_TrickPlay_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+#include "Kernel/OVR_Math.h"
+#include "Android/GlUtils.h"
+
+namespace OVR {
+
+//==============================================================
+// TrickPlayIndex
+//
+// Where each preview frame comes from. A BIF file holds one JPEG per frame;
+// a WebVTT thumbnail track points at regions of JPEG mosaics with #xywh.
+struct TrickPlayImage
+{
+	String	Path;
+	SInt64	Offset;			// of the JPEG in Path
+	int		Length;
+};
+
+struct TrickPlayFrame
+{
+	int		TimeMs;
+	int		Image;			// index into Images
+	int		X;				// region of the image, Width 0 for the whole image
+	int		Y;
+	int		Width;
+	int		Height;
+};
+
+class TrickPlayIndex
+{
+public:
+	Array< TrickPlayImage >	Images;
+	Array< TrickPlayFrame >	Frames;		// ascending TimeMs
+
+	// Looks for name.bif, then name.thumbs.vtt next to a local video.
+	bool			LoadForVideo( const char * videoPath );
+	bool			LoadBif( const char * path );
+	bool			LoadWebVtt( const char * path );
+
+	// Keeps every stride'th frame so the atlas stays within its memory budget.
+	void			Decimate( const int maxFrames );
+
+	// Last frame at or before timeMs, -1 when there is none.
+	int				FindFrame( const int timeMs ) const;
+};
+
+//==============================================================
+// TrickPlayAtlas
+//
+// Decodes the frames of an index on a worker thread and packs them into
+// fixed size cells of a few atlas pages. Finished pages are uploaded by
+// the VR thread, one per Frame(), after which their CPU copy is freed.
+class TrickPlayAtlas
+{
+public:
+	static const int	PAGE_SIZE = 1024;
+	static const int	MAX_PAGES = 6;
+	static const int	MAX_CELL_WIDTH = 256;
+
+						TrickPlayAtlas();
+						~TrickPlayAtlas();
+
+	// Returns false if the video has no trick-play sidecar.
+	bool				Start( const char * videoPath );
+	void				Stop();
+
+	// VR thread, uploads at most one finished page.
+	void				Frame();
+
+	// Texture and texture matrix mapping 0-1 to the preview frame for timeMs.
+	bool				GetPreview( const int timeMs, GLuint & outTexture, Matrix4f & outTexm ) const;
+
+	// Stats for the decode log.
+	int					GetDecodedFrames() const;
+	double				GetDecodeSeconds() const;
+	int					GetCpuBytes() const;
+	int					GetGpuBytes() const;
+
+private:
+	enum ePageState
+	{
+		PAGE_FILLING,
+		PAGE_READY,
+		PAGE_UPLOADED
+	};
+
+	struct Page
+	{
+		ePageState	State;
+		UByte *		Pixels;			// RGBA, freed after upload
+		GLuint		Texture;
+	};
+
+	TrickPlayIndex		Index;
+	int					CellWidth;
+	int					CellHeight;
+	int					CellsPerRow;
+	int					CellsPerPage;
+	Page				Pages[MAX_PAGES];
+	int					PageCount;
+
+	mutable pthread_mutex_t	Mutex;
+	pthread_t			Thread;
+	bool				Running;
+	volatile bool		StopRequested;
+	int					DecodedFrames;
+	double				DecodeSeconds;
+	int					CpuBytes;
+
+	static void *		ThreadFunction( void * param );
+	void				DecodeAll();
+	void				CopyToCell( const UByte * rgba, const int width, const int height,
+								const TrickPlayFrame & frame, const int frameIndex );
+	void				FinishPage( const int page );
+};
+
+}
+
+#endif // OVR_TrickPlay_h
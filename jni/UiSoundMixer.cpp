@@ -0,0 +1,226 @@
+/************************************************************************************
+
+Filename    :   UiSoundMixer.cpp
+Content     :   Low latency native mixer for positioned interface sounds
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UiSoundMixer.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+#include "AudioDsp.h"
+#include "WavFile.h"
+
+namespace OVR {
+
+// sounds closer than this play at full gain
+static const float	REFERENCE_DISTANCE = 3.0f;
+
+static double GetSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+UiSoundMixer::UiSoundMixer()
+	: PendingCount( 0 )
+	, VoiceCount( 0 )
+	, MixCount( 0 )
+	, MixSecondsTotal( 0.0 )
+	, MixSecondsMax( 0.0 )
+	, VoicesMax( 0 )
+{
+	pthread_mutex_init( &PendingMutex, NULL );
+}
+
+UiSoundMixer::~UiSoundMixer()
+{
+	pthread_mutex_destroy( &PendingMutex );
+}
+
+int UiSoundMixer::FindSound( const char * name ) const
+{
+	for ( int i = 0; i < Sounds.GetSizeI(); i++ )
+	{
+		if ( Sounds[i].Name == name )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+// replaces a sound of the same name
+void UiSoundMixer::SetSound( const Sound & sound )
+{
+	const int existing = FindSound( sound.Name.ToCStr() );
+	if ( existing >= 0 )
+	{
+		Sounds[existing] = sound;
+	}
+	else
+	{
+		Sounds.PushBack( sound );
+	}
+}
+
+bool UiSoundMixer::AddSound( const char * name, const WavFile & wav )
+{
+	if ( !wav.IsOpen() || wav.GetFrameCount() <= 0 )
+	{
+		return false;
+	}
+	const int channels = wav.GetChannels();
+	Array< float > interleaved;
+	wav.ReadAll( interleaved );
+
+	// down mix, then linear resampling to the output rate
+	const int sourceFrames = static_cast< int >( wav.GetFrameCount() );
+	Array< float > mono;
+	mono.Resize( sourceFrames );
+	for ( int i = 0; i < sourceFrames; i++ )
+	{
+		float sum = 0.0f;
+		for ( int c = 0; c < channels; c++ )
+		{
+			sum += interleaved[i * channels + c];
+		}
+		mono[i] = sum / channels;
+	}
+
+	Sound sound;
+	sound.Name = name;
+	const double step = static_cast< double >( wav.GetSampleRate() ) / AudioOutput::SAMPLE_RATE;
+	const int frames = static_cast< int >( sourceFrames / step );
+	sound.Samples.Resize( frames );
+	for ( int i = 0; i < frames; i++ )
+	{
+		const double t = i * step;
+		const int i0 = static_cast< int >( t );
+		const int i1 = Alg::Min( i0 + 1, sourceFrames - 1 );
+		const float f = static_cast< float >( t - i0 );
+		sound.Samples[i] = mono[i0] + ( mono[i1] - mono[i0] ) * f;
+	}
+	SetSound( sound );
+	return true;
+}
+
+bool UiSoundMixer::Play( const char * name, const Vector3f & position, const Matrix4f & viewMatrix, const float gain )
+{
+	const int soundIndex = FindSound( name );
+	if ( soundIndex < 0 )
+	{
+		return false;
+	}
+
+	// constant power pan by the head relative direction, x is to the right
+	const Vector3f local = viewMatrix.Transform( position );
+	const float distance = local.Length();
+	const float pan = ( distance > 1e-4f ) ? Alg::Clamp( local.x / distance, -1.0f, 1.0f ) : 0.0f;
+	const float angle = ( pan + 1.0f ) * static_cast< float >( M_PI ) * 0.25f;
+	const float attenuation = ( distance > REFERENCE_DISTANCE ) ? REFERENCE_DISTANCE / distance : 1.0f;
+
+	Voice voice;
+	voice.SoundIndex = soundIndex;
+	voice.Position = 0;
+	voice.GainLeft = gain * attenuation * cosf( angle );
+	voice.GainRight = gain * attenuation * sinf( angle );
+
+	pthread_mutex_lock( &PendingMutex );
+	const bool queued = PendingCount < MAX_PENDING;
+	if ( queued )
+	{
+		Pending[PendingCount++] = voice;
+	}
+	pthread_mutex_unlock( &PendingMutex );
+	return queued;
+}
+
+void UiSoundMixer::StartVoice( const Voice & voice )
+{
+	if ( VoiceCount < MAX_VOICES )
+	{
+		Voices[VoiceCount++] = voice;
+		return;
+	}
+	// steal the voice furthest along, it has the least left to play
+	int oldest = 0;
+	for ( int i = 1; i < VoiceCount; i++ )
+	{
+		if ( Voices[i].Position > Voices[oldest].Position )
+		{
+			oldest = i;
+		}
+	}
+	Voices[oldest] = voice;
+}
+
+void UiSoundMixer::MixAudio( float * stereo, const int frames )
+{
+	const double start = GetSeconds();
+
+	// the audio thread never waits on Play(), anything queued meanwhile starts next buffer
+	if ( pthread_mutex_trylock( &PendingMutex ) == 0 )
+	{
+		for ( int i = 0; i < PendingCount; i++ )
+		{
+			StartVoice( Pending[i] );
+		}
+		PendingCount = 0;
+		pthread_mutex_unlock( &PendingMutex );
+	}
+	if ( VoiceCount == 0 )
+	{
+		return;
+	}
+	VoicesMax = Alg::Max( VoicesMax, VoiceCount );
+
+	for ( int i = 0; i < VoiceCount; )
+	{
+		Voice & voice = Voices[i];
+		const Array< float > & samples = Sounds[voice.SoundIndex].Samples;
+		const int count = Alg::Min( frames, samples.GetSizeI() - voice.Position );
+		if ( count > 0 )
+		{
+			MixMonoToStereo( stereo, &samples[voice.Position], count, voice.GainLeft, voice.GainRight );
+			voice.Position += count;
+		}
+		if ( voice.Position >= samples.GetSizeI() )
+		{
+			Voices[i] = Voices[--VoiceCount];
+		}
+		else
+		{
+			i++;
+		}
+	}
+
+	const double seconds = GetSeconds() - start;
+	MixCount++;
+	MixSecondsTotal += seconds;
+	MixSecondsMax = Alg::Max( MixSecondsMax, seconds );
+}
+
+void UiSoundMixer::ResetStats()
+{
+	MixCount = 0;
+	MixSecondsTotal = 0.0;
+	MixSecondsMax = 0.0;
+	VoicesMax = 0;
+}
+
+}
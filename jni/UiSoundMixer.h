@@ -0,0 +1,103 @@
+/************************************************************************************
+
+Filename    :   UiSoundMixer.h
+Content     :   Low latency native mixer for positioned interface sounds
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_UiSoundMixer_h )
+#define OVR_UiSoundMixer_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+#include "Kernel/OVR_Math.h"
+#include "AudioOutput.h"
+
+namespace OVR {
+
+class WavFile;
+
+//==============================================================
+// UiSoundMixer
+//
+// Sounds are decoded to mono at the output rate when they are added, so a
+// voice is only a read position and a pair of gains. Play() queues a voice
+// for the audio thread, which starts it with its next buffer.
+//
+// Sounds have to be added before the mixer is attached to an output.
+class UiSoundMixer : public AudioSource
+{
+public:
+	static const int	MAX_VOICES = 32;
+	static const int	MAX_PENDING = MAX_VOICES;
+
+						UiSoundMixer();
+						~UiSoundMixer();
+
+	bool				AddSound( const char * name, const WavFile & wav );
+	bool				HasSound( const char * name ) const	{ return FindSound( name ) >= 0; }
+
+	// Pans and attenuates the sound by where position is relative to the head.
+	// Returns false if the sound is unknown.
+	bool				Play( const char * name, const Vector3f & position, const Matrix4f & viewMatrix, const float gain = 1.0f );
+
+	// AudioSource
+	virtual void		MixAudio( float * stereo, const int frames );
+
+	// Mix cost per buffer, for the log.
+	int					GetMixCount() const			{ return MixCount; }
+	double				GetMixSecondsAverage() const	{ return MixCount > 0 ? MixSecondsTotal / MixCount : 0.0; }
+	double				GetMixSecondsMax() const		{ return MixSecondsMax; }
+	int					GetVoicesMax() const		{ return VoicesMax; }
+	void				ResetStats();
+
+private:
+	struct Sound
+	{
+		String			Name;
+		Array< float >	Samples;
+	};
+
+	struct Voice
+	{
+		int				SoundIndex;
+		int				Position;
+		float			GainLeft;
+		float			GainRight;
+	};
+
+	Array< Sound >		Sounds;
+
+	// written by Play(), drained by the audio thread when it gets the lock
+	pthread_mutex_t		PendingMutex;
+	Voice				Pending[MAX_PENDING];
+	int					PendingCount;
+
+	// audio thread only
+	Voice				Voices[MAX_VOICES];
+	int					VoiceCount;
+
+	int					MixCount;
+	double				MixSecondsTotal;
+	double				MixSecondsMax;
+	int					VoicesMax;
+
+	int					FindSound( const char * name ) const;
+	void				SetSound( const Sound & sound );
+	void				StartVoice( const Voice & voice );
+};
+
+}
+
+#endif // OVR_UiSoundMixer_h
@@ -20,8 +20,8 @@ of patent rights can be found in the PATENTS file in the same directory.
 #include "PackageFiles.h"
 #include "ImageData.h"
 #include "Oculus360Videos.h"
-#include "VrLocale.h"
 #include "BitmapFont.h"
+#include "3rdParty/stb/stb_image.h"
 #include <OVR_TurboJpeg.h>
 #include "linux/stat.h"
 #include <unistd.h>
@@ -43,8 +43,36 @@ VideoBrowser * VideoBrowser::Create(
 		thumbWidth + horizontalPadding, thumbHeight + verticalPadding, SwipeRadius, numSwipePanels, thumbWidth, thumbHeight );
 }
 
+const char * const VideoBrowser::NoThumbnail = "assets/no_thumbnail.png";
+const char * const VideoBrowser::PagePanelThumb = "assets/directory_thumbnail.png";
+
+// ComponentCallbacks2 levels.
+static const int TrimMemoryRunningLow = 10;
+static const int TrimMemoryRunningCritical = 15;
+static const int TrimMemoryUiHidden = 20;
+
 void VideoBrowser::OnPanelActivated( const OvrMetaDatum * panelData )
 {
+	const OvrVideosMetaDatum * videosDatum = static_cast< const OvrVideosMetaDatum * >( panelData );
+	if ( videosDatum != NULL && videosDatum->PanelPage != 0 )
+	{
+		const int category = FindShowingCategory( panelData->Id );
+		if ( category < 0 || !VideoMetaData.MovePanelWindow( *videosDatum ) )
+		{
+			return;
+		}
+		// The rebuilt category opens at the end of the new page facing the
+		// old one, past the page panel that leads back.
+		WindowMoved = true;
+		const OvrMetaData::Category & moved = VideoMetaData.GetCategories()[category];
+		const int last = moved.DatumIndicies.GetSizeI() - 1;
+		SetScrollAnchor( category, moved.DatumIndicies[( videosDatum->PanelPage > 0 ) ? Alg::Min( 1, last ) : Alg::Max( 0, last - 1 )] );
+		return;
+	}
+	if ( panelData != NULL )
+	{
+		SetScrollAnchor( FindShowingCategory( panelData->Id ), panelData->Id );
+	}
 	Oculus360Videos * videos = ( Oculus360Videos * )AppPtr->GetAppInterface();
 	OVR_ASSERT( videos );
 	videos->OnVideoActivated( panelData );
@@ -58,6 +86,12 @@ unsigned char * VideoBrowser::CreateAndCacheThumbnail( const char * soureFile, c
 
 unsigned char * VideoBrowser::LoadThumbnail( const char * filename, int & width, int & height )
 {
+	unsigned char * cached = Thumbnails.Find( filename, width, height );
+	if ( cached != NULL )
+	{
+		return cached;
+	}
+
 	LOG( "VideoBrowser::LoadThumbnail loading on %s", filename );
 	unsigned char * orig = NULL;
 		
@@ -67,7 +101,13 @@ unsigned char * VideoBrowser::LoadThumbnail( const char * filename, int & width,
 		int length = 0;
 		ovr_ReadFileFromApplicationPackage( filename, length, buffer );
 
-		if ( buffer )
+		if ( buffer && strstr( filename, ".png" ) )
+		{
+			int components;
+			orig = stbi_load_from_memory( reinterpret_cast< const stbi_uc * >( buffer ), length, &width, &height, &components, 4 );
+			free( buffer );
+		}
+		else if ( buffer )
 		{
 			orig = TurboJpegLoadFromMemory( reinterpret_cast< const unsigned char * >( buffer ), length, &width, &height );
 			free( buffer );
@@ -90,6 +130,7 @@ unsigned char * VideoBrowser::LoadThumbnail( const char * filename, int & width,
 		if ( ThumbWidth == width && ThumbHeight == height )
 		{
 			LOG( "VideoBrowser::LoadThumbnail skip resize on %s", filename );
+			Thumbnails.Store( filename, orig, width, height );
 			return orig;
 		}
 
@@ -102,6 +143,7 @@ unsigned char * VideoBrowser::LoadThumbnail( const char * filename, int & width,
 			width = ThumbWidth;
 			height = ThumbHeight;
 
+			Thumbnails.Store( filename, outBuffer, width, height );
 			return outBuffer;
 		}
 	}
@@ -112,8 +154,155 @@ unsigned char * VideoBrowser::LoadThumbnail( const char * filename, int & width,
 	return NULL;
 }
 
+void VideoBrowser::SetMediaSources( const Array< MediaSource * > & sources )
+{
+	MediaSources.Clear();
+	for ( int i = 0; i < sources.GetSizeI(); i++ )
+	{
+		MediaSources.PushBack( sources[i] );
+	}
+}
+
+void VideoBrowser::ApplyChanges()
+{
+	Array< OvrVideosMetaData::CategoryChanges > changes;
+	VideoMetaData.TakeChanges( changes );
+	// the startup build has no changes, only dirty categories
+	bool dirty = false;
+	for ( int i = 0; i < VideoMetaData.GetCategories().GetSizeI() && !dirty; i++ )
+	{
+		dirty = VideoMetaData.GetCategories()[i].Dirty;
+	}
+	if ( changes.GetSizeI() == 0 && !WindowMoved && !dirty )
+	{
+		return;
+	}
+	WindowMoved = false;
+
+	const Array< OvrMetaDatum * > & metaData = VideoMetaData.GetMetaData();
+	for ( int i = 0; i < changes.GetSizeI(); i++ )
+	{
+		for ( int j = 0; j < changes[i].Updated.GetSizeI(); j++ )
+		{
+			const String & url = metaData[changes[i].Updated[j]]->Url;
+			Thumbnails.Forget( ThumbName( url ) );
+			Thumbnails.Forget( AlternateThumbName( url ) );
+		}
+	}
+
+	// only categories showing one of the changed videos are dirty
+	Array< int > rebuilt;
+	for ( int i = 0; i < VideoMetaData.GetCategories().GetSizeI(); i++ )
+	{
+		if ( VideoMetaData.GetCategories()[i].Dirty )
+		{
+			rebuilt.PushBack( i );
+		}
+	}
+	BuildDirtyMenu( VideoMetaData );
+
+	// A rebuild starts the category over at its first panel. Turn it back to
+	// the anchor, at the index the inserted and removed videos moved it to.
+	for ( int i = 0; i < rebuilt.GetSizeI(); i++ )
+	{
+		const int category = rebuilt[i];
+		if ( category >= ScrollAnchors.GetSizeI() || ScrollAnchors[category] < 0 )
+		{
+			continue;
+		}
+		const Array< int > & ids = VideoMetaData.GetCategories()[category].DatumIndicies;
+		for ( int j = 0; j < ids.GetSizeI(); j++ )
+		{
+			if ( ids[j] == ScrollAnchors[category] )
+			{
+				SetCategoryRotation( category, j );
+				break;
+			}
+		}
+	}
+}
+
+void VideoBrowser::SetScrollAnchor( const int categoryIndex, const int datumId )
+{
+	if ( categoryIndex < 0 )
+	{
+		return;
+	}
+	while ( ScrollAnchors.GetSizeI() <= categoryIndex )
+	{
+		ScrollAnchors.PushBack( -1 );
+	}
+	ScrollAnchors[categoryIndex] = datumId;
+}
+
+// The category whose panels include the datum's, or -1.
+int VideoBrowser::FindShowingCategory( const int datumId ) const
+{
+	for ( int i = 0; i < VideoMetaData.GetCategories().GetSizeI(); i++ )
+	{
+		const Array< int > & ids = VideoMetaData.GetCategories()[i].DatumIndicies;
+		for ( int j = 0; j < ids.GetSizeI(); j++ )
+		{
+			if ( ids[j] == datumId )
+			{
+				return i;
+			}
+		}
+	}
+	return -1;
+}
+
+void VideoBrowser::TrimMemory( const int level )
+{
+	// The decoded copies only save decoding again, so they go first. In the
+	// background that is all: the panels' pool stays as it is, or resuming
+	// would rebuild every category for a budget that is back to full.
+	const int cacheBudget = ( level >= TrimMemoryRunningLow ) ? 0 : ThumbnailCacheSize * PanelBytes;
+	Thumbnails.SetBudget( cacheBudget );
+	if ( level >= TrimMemoryUiHidden )
+	{
+		LOG( "VideoBrowser::TrimMemory %i: decoded thumbnails dropped, %i KB resident", level, GetResidentThumbnailBytes() / 1024 );
+		return;
+	}
+
+	const int budget = ( level >= TrimMemoryRunningCritical ) ? ThumbnailBudgetBytes / 4 :
+			( level >= TrimMemoryRunningLow ) ? ThumbnailBudgetBytes / 2 : ThumbnailBudgetBytes;
+
+	// The rest is one texture per panel the browser builds. Fewer panels
+	// dirty the categories, and the next ApplyChanges rebuilds them without
+	// the textures of the panels they lost.
+	VideoMetaData.SetPanelBudget( Alg::Max( 1, ( budget - cacheBudget ) / PanelBytes ) );
+	LOG( "VideoBrowser::TrimMemory %i: %i KB of thumbnails resident once rebuilt", level, GetResidentThumbnailBytes() / 1024 );
+}
+
+int VideoBrowser::GetResidentThumbnailBytes() const
+{
+	return VideoMetaData.GetShownPanelCount() * PanelBytes + Thumbnails.GetBytes();
+}
+
+const MediaSource * VideoBrowser::FindMediaSource( const String & url ) const
+{
+	for ( int i = 0; i < MediaSources.GetSizeI(); i++ )
+	{
+		if ( MediaSources[i]->Owns( url.ToCStr() ) )
+		{
+			return MediaSources[i];
+		}
+	}
+	return NULL;
+}
+
 String VideoBrowser::ThumbName( const String & s )
 {
+	if ( strncmp( s.ToCStr(), "page://", 7 ) == 0 )
+	{
+		return PagePanelThumb;
+	}
+	const MediaSource * source = FindMediaSource( s );
+	if ( source != NULL )
+	{
+		return source->GetThumbnailPath( s.ToCStr() );
+	}
 	String	ts( s );
 	ts = OVR::StringUtils::SetFileExtensionString( ts, ".pvr" );
 	return ts;
@@ -121,6 +310,11 @@ String VideoBrowser::ThumbName( const String & s )
 
 String VideoBrowser::AlternateThumbName( const String & s )
 {
+	const MediaSource * source = FindMediaSource( s );
+	if ( source != NULL )
+	{
+		return source->GetThumbnailPath( s.ToCStr() );
+	}
 	String	ts( s );
 	ts = OVR::StringUtils::SetFileExtensionString( ts, ".thm" );
 	return ts;
@@ -129,9 +323,10 @@ String VideoBrowser::AlternateThumbName( const String & s )
 
 void VideoBrowser::OnMediaNotFound( App * app, String & title, String & imageFile, String & message )
 {
-	VrLocale::GetString( app->GetVrJni(), app->GetJavaObject(), "@string/app_name", "@string/app_name", title );
+	const LocalizedStrings & strings = ( ( Oculus360Videos * )app->GetAppInterface() )->GetStrings();
+	title = strings.GetString( "@string/app_name", "@string/app_name" );
 	imageFile = "assets/sdcard.png";
-	VrLocale::GetString( app->GetVrJni(), app->GetJavaObject(), "@string/media_not_found", "@string/media_not_found", message );
+	message = strings.GetString( "@string/media_not_found", "@string/media_not_found" );
 	BitmapFont & font = app->GetDefaultFont();
 	OVR::Array< OVR::String > wholeStrs;
 	wholeStrs.PushBack( "Gear VR" );
@@ -140,14 +335,23 @@ void VideoBrowser::OnMediaNotFound( App * app, String & title, String & imageFil
 
 String VideoBrowser::GetCategoryTitle( char const * key, char const * defaultStr ) const
 {
-	String outStr;
-	VrLocale::GetString( AppPtr->GetVrJni(), AppPtr->GetJavaObject(), key, defaultStr, outStr );
-	return outStr;
+	const Oculus360Videos * videos = ( Oculus360Videos * )AppPtr->GetAppInterface();
+	return String( videos->GetStrings().GetString( key, defaultStr ) );
 }
 
 String VideoBrowser::GetPanelTitle( const OvrMetaDatum & panelData ) const
 {
 	const OvrVideosMetaDatum * const videosDatum = static_cast< const OvrVideosMetaDatum * const >( &panelData );
+	if ( videosDatum != NULL && videosDatum->PanelPage != 0 )
+	{
+		int first;
+		int last;
+		VideoMetaData.GetPageRange( *videosDatum, first, last );
+		char range[32];
+		snprintf( range, sizeof( range ), " %i-%i", first, last );
+		return GetCategoryTitle( videosDatum->PanelPage < 0 ? "@string/previous_videos" : "@string/more_videos",
+			videosDatum->PanelPage < 0 ? "Previous" : "More" ) + range;
+	}
 	if ( videosDatum != NULL )
 	{
 		return videosDatum->Title;
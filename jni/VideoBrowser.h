@@ -16,8 +16,12 @@ of patent rights can be found in the PATENTS file in the same directory.
 #ifndef OVR_VideoBrowser_h
 #define OVR_VideoBrowser_h
 
+#include <stdlib.h>
+
 #include "VRMenu/FolderBrowser.h"
 #include "VideosMetaData.h"
+#include "MediaSource.h"
+#include "ThumbnailCache.h"
 
 namespace OVR
 {
@@ -57,6 +61,29 @@ public:
 	// Display appropriate info if we fail to find media
 	virtual void OnMediaNotFound( App * app, String & title, String & imageFile, String & message );
 
+	// Videos from these sources take their thumbnails from the source's cache.
+	void		SetMediaSources( const Array< MediaSource * > & sources );
+
+	// Called every frame on the VR thread. Rebuilds the categories that
+	// added, removed or updated videos left dirty, and the ones whose window
+	// a page panel moved, outside the panel's event. Thumbnails of unchanged
+	// panels come from the decoded cache, so a rebuild doesn't read them
+	// again, and a rebuilt category is turned back to the video it was at,
+	// wherever the changes moved it.
+	void		ApplyChanges();
+
+	// Fits thumbnail memory to the budget for an Android onTrimMemory
+	// level, 0 once the pressure is over: half of it for RUNNING_LOW, a
+	// quarter for RUNNING_CRITICAL, and no decoded cache under either.
+	// UI_HIDDEN and the levels above it come while the app isn't in front,
+	// so they only drop the decoded cache: the panels keep their pool, and
+	// the categories aren't rebuilt on resume.
+	void		TrimMemory( const int level );
+
+	// Bytes of the decoded cache and of the textures the panels the
+	// categories show hold, one thumbnail each.
+	int			GetResidentThumbnailBytes() const;
+
 protected:
 	// Called from the base class when building a cateory.
 	virtual String				GetCategoryTitle( char const * key, char const * defaultStr ) const;
@@ -76,12 +103,35 @@ private:
 		unsigned thumbHeight )
 		: OvrFolderBrowser( app, metaData,
 		panelWidth, panelHeight, radius, numSwipePanels, thumbWidth, thumbHeight )
+		, VideoMetaData( metaData )
+		, WindowMoved( false )
+		, PanelBytes( thumbWidth * thumbHeight * 4 )
+		, Thumbnails( ThumbnailCacheSize * PanelBytes )
 	{
+		Thumbnails.AddPlaceholder( NoThumbnail );
+		Thumbnails.AddPlaceholder( PagePanelThumb );
+		// the whole budget, until memory runs low
+		TrimMemory( 0 );
 	}
 
-	virtual ~VideoBrowser()
-	{
-	}
+	virtual ~VideoBrowser() {}
+
+	static const char * const	NoThumbnail;
+	static const char * const	PagePanelThumb;
+	static const int	ThumbnailBudgetBytes = 32 * 1024 * 1024;
+	static const int	ThumbnailCacheSize = 32;
+
+	Array< const MediaSource * >	MediaSources;
+	OvrVideosMetaData &	VideoMetaData;
+	bool				WindowMoved;
+	Array< int >		ScrollAnchors;		// by category, the datum id its panels were turned to or -1
+
+	int					PanelBytes;			// a panel's thumbnail texture
+	ThumbnailCache		Thumbnails;			// decoded, shared with the thumbnail thread
+
+	const MediaSource *	FindMediaSource( const String & url ) const;
+	void				SetScrollAnchor( const int categoryIndex, const int datumId );
+	int					FindShowingCategory( const int datumId ) const;
 };
 
 }
@@ -29,6 +29,11 @@ namespace OVR {
 const VRMenuId_t OvrVideoMenu::ID_CENTER_ROOT( 1000 );
 const VRMenuId_t OvrVideoMenu::ID_BROWSER_BUTTON( 1000 + 1011 );
 const VRMenuId_t OvrVideoMenu::ID_VIDEO_BUTTON( 1000 + 1012 );
+const VRMenuId_t OvrVideoMenu::ID_PREV_CHAPTER_BUTTON( 1000 + 1013 );
+const VRMenuId_t OvrVideoMenu::ID_NEXT_CHAPTER_BUTTON( 1000 + 1014 );
+const VRMenuId_t OvrVideoMenu::ID_DOWNLOAD_BUTTON( 1000 + 1015 );
+const VRMenuId_t OvrVideoMenu::ID_PLAYLIST_BUTTON( 1000 + 1016 );
+const VRMenuId_t OvrVideoMenu::ID_SUBTITLES_BUTTON( 1000 + 1017 );
 
 char const * OvrVideoMenu::MENU_NAME = "VideoMenu";
 
@@ -140,6 +145,13 @@ private:
 
 			titleWithPos += buf;
 			titleWithPos += ")";
+
+			const int chapter = CurrentVideo->Chapters.FindChapter( curPos );
+			if ( chapter >= 0 && CurrentVideo->Chapters.GetTitle( chapter )[0] != 0 )
+			{
+				titleWithPos += "\n";
+				titleWithPos += CurrentVideo->Chapters.GetTitle( chapter );
+			}
 			self->SetText( titleWithPos );
 		}
 	}
@@ -173,6 +185,11 @@ OvrVideoMenu::OvrVideoMenu( App * app, Oculus360Videos * videos, OvrVRMenuMgr &
 	, AttributionHandle( 0 )
 	, BrowserButtonHandle( 0 )
 	, VideoControlButtonHandle( 0 )
+	, PrevChapterButtonHandle( 0 )
+	, NextChapterButtonHandle( 0 )
+	, DownloadButtonHandle( 0 )
+	, PlaylistButtonHandle( 0 )
+	, SubtitlesButtonHandle( 0 )
 	, Radius( radius )
 	, ButtonCoolDown( 0.0f )
 	, OpenTime( 0.0 )
@@ -266,6 +283,161 @@ OvrVideoMenu::OvrVideoMenu( App * app, Oculus360Videos * videos, OvrVRMenuMgr &
 	OVR_ASSERT( controlButtonObject != NULL );
 	OVR_UNUSED( controlButtonObject );
 
+	//Chapter buttons, text only and shown for videos with chapters
+	Posef prevChapterPose( Quatf(), -RIGHT * ICON_HEIGHT * 4.0f );
+
+	comps.PushBack( new OvrDefaultComponent( Vector3f( 0.0f, 0.0f, 0.05f ), 1.05f, 0.25f, 0.0f, Vector4f( 1.0f ), Vector4f( 1.0f ) ) );
+	comps.PushBack( new OvrButton_OnUp( this, ID_PREV_CHAPTER_BUTTON ) );
+	VRMenuObjectParms prevChapterParms( VRMENU_BUTTON, comps, VRMenuSurfaceParms(), "<<",
+		prevChapterPose, Vector3f( 1.0f ), Posef(), Vector3f( 1.0f ), fontParms,
+		ID_PREV_CHAPTER_BUTTON, VRMenuObjectFlags_t(),
+		VRMenuObjectInitFlags_t( VRMENUOBJECT_INIT_FORCE_POSITION ) );
+	parms.PushBack( &prevChapterParms );
+
+	AddItems( MenuMgr, Font, parms, AttributionHandle, false );
+	parms.Clear();
+	comps.Clear();
+
+	Posef nextChapterPose( Quatf(), RIGHT * ICON_HEIGHT * 4.0f );
+
+	comps.PushBack( new OvrDefaultComponent( Vector3f( 0.0f, 0.0f, 0.05f ), 1.05f, 0.25f, 0.0f, Vector4f( 1.0f ), Vector4f( 1.0f ) ) );
+	comps.PushBack( new OvrButton_OnUp( this, ID_NEXT_CHAPTER_BUTTON ) );
+	VRMenuObjectParms nextChapterParms( VRMENU_BUTTON, comps, VRMenuSurfaceParms(), ">>",
+		nextChapterPose, Vector3f( 1.0f ), Posef(), Vector3f( 1.0f ), fontParms,
+		ID_NEXT_CHAPTER_BUTTON, VRMenuObjectFlags_t(),
+		VRMenuObjectInitFlags_t( VRMENUOBJECT_INIT_FORCE_POSITION ) );
+	parms.PushBack( &nextChapterParms );
+
+	AddItems( MenuMgr, Font, parms, AttributionHandle, false );
+	parms.Clear();
+	comps.Clear();
+
+	PrevChapterButtonHandle = attributionObject->ChildHandleForId( MenuMgr, ID_PREV_CHAPTER_BUTTON );
+	NextChapterButtonHandle = attributionObject->ChildHandleForId( MenuMgr, ID_NEXT_CHAPTER_BUTTON );
+	ShowChapterButtons( false );
+
+	//Download button, text only and shown for streamed videos
+	Posef downloadPose( Quatf(), DOWN * ICON_HEIGHT * 4.0f );
+
+	comps.PushBack( new OvrDefaultComponent( Vector3f( 0.0f, 0.0f, 0.05f ), 1.05f, 0.25f, 0.0f, Vector4f( 1.0f ), Vector4f( 1.0f ) ) );
+	comps.PushBack( new OvrButton_OnUp( this, ID_DOWNLOAD_BUTTON ) );
+	VRMenuObjectParms downloadParms( VRMENU_BUTTON, comps, VRMenuSurfaceParms(), "Download",
+		downloadPose, Vector3f( 1.0f ), Posef(), Vector3f( 1.0f ), fontParms,
+		ID_DOWNLOAD_BUTTON, VRMenuObjectFlags_t(),
+		VRMenuObjectInitFlags_t( VRMENUOBJECT_INIT_FORCE_POSITION ) );
+	parms.PushBack( &downloadParms );
+
+	AddItems( MenuMgr, Font, parms, AttributionHandle, false );
+	parms.Clear();
+	comps.Clear();
+
+	DownloadButtonHandle = attributionObject->ChildHandleForId( MenuMgr, ID_DOWNLOAD_BUTTON );
+	ShowDownloadButton( false );
+
+	//Playlist button, text only, toggles playing the rest of the category
+	Posef playlistPose( Quatf(), UP * ICON_HEIGHT * 4.0f );
+
+	comps.PushBack( new OvrDefaultComponent( Vector3f( 0.0f, 0.0f, 0.05f ), 1.05f, 0.25f, 0.0f, Vector4f( 1.0f ), Vector4f( 1.0f ) ) );
+	comps.PushBack( new OvrButton_OnUp( this, ID_PLAYLIST_BUTTON ) );
+	VRMenuObjectParms playlistParms( VRMENU_BUTTON, comps, VRMenuSurfaceParms(),
+		videos->GetStrings().GetString( "@string/playlist_off", "Playlist: Off" ),
+		playlistPose, Vector3f( 1.0f ), Posef(), Vector3f( 1.0f ), fontParms,
+		ID_PLAYLIST_BUTTON, VRMenuObjectFlags_t(),
+		VRMenuObjectInitFlags_t( VRMENUOBJECT_INIT_FORCE_POSITION ) );
+	parms.PushBack( &playlistParms );
+
+	AddItems( MenuMgr, Font, parms, AttributionHandle, false );
+	parms.Clear();
+	comps.Clear();
+
+	PlaylistButtonHandle = attributionObject->ChildHandleForId( MenuMgr, ID_PLAYLIST_BUTTON );
+
+	//Subtitles button, text only, only shown when the video has subtitles
+	Posef subtitlesPose( Quatf(), UP * ICON_HEIGHT * 5.0f );
+
+	comps.PushBack( new OvrDefaultComponent( Vector3f( 0.0f, 0.0f, 0.05f ), 1.05f, 0.25f, 0.0f, Vector4f( 1.0f ), Vector4f( 1.0f ) ) );
+	comps.PushBack( new OvrButton_OnUp( this, ID_SUBTITLES_BUTTON ) );
+	VRMenuObjectParms subtitlesParms( VRMENU_BUTTON, comps, VRMenuSurfaceParms(),
+		videos->GetStrings().GetString( "@string/subtitles_video", "Subtitles: Video" ),
+		subtitlesPose, Vector3f( 1.0f ), Posef(), Vector3f( 1.0f ), fontParms,
+		ID_SUBTITLES_BUTTON, VRMenuObjectFlags_t(),
+		VRMenuObjectInitFlags_t( VRMENUOBJECT_INIT_FORCE_POSITION ) );
+	parms.PushBack( &subtitlesParms );
+
+	AddItems( MenuMgr, Font, parms, AttributionHandle, false );
+	parms.Clear();
+	comps.Clear();
+
+	SubtitlesButtonHandle = attributionObject->ChildHandleForId( MenuMgr, ID_SUBTITLES_BUTTON );
+}
+
+void OvrVideoMenu::ShowChapterButtons( const bool show )
+{
+	const menuHandle_t handles[2] = { PrevChapterButtonHandle, NextChapterButtonHandle };
+	for ( int i = 0; i < 2; i++ )
+	{
+		VRMenuObject * button = MenuMgr.ToObject( handles[i] );
+		if ( button == NULL )
+		{
+			continue;
+		}
+		if ( show )
+		{
+			button->RemoveFlags( VRMENUOBJECT_DONT_RENDER );
+		}
+		else
+		{
+			button->AddFlags( VRMENUOBJECT_DONT_RENDER );
+		}
+	}
+}
+
+void OvrVideoMenu::ShowDownloadButton( const bool show )
+{
+	VRMenuObject * button = MenuMgr.ToObject( DownloadButtonHandle );
+	if ( button == NULL )
+	{
+		return;
+	}
+	if ( show )
+	{
+		button->RemoveFlags( VRMENUOBJECT_DONT_RENDER );
+	}
+	else
+	{
+		button->AddFlags( VRMENUOBJECT_DONT_RENDER );
+	}
+}
+
+void OvrVideoMenu::UpdatePlaylistButton()
+{
+	VRMenuObject * button = MenuMgr.ToObject( PlaylistButtonHandle );
+	if ( button != NULL )
+	{
+		const LocalizedStrings & strings = Videos->GetStrings();
+		button->SetText( Videos->GetPlaylistMode() ? strings.GetString( "@string/playlist_on", "Playlist: On" ) :
+				strings.GetString( "@string/playlist_off", "Playlist: Off" ) );
+	}
+}
+
+void OvrVideoMenu::UpdateSubtitlesButton()
+{
+	VRMenuObject * button = MenuMgr.ToObject( SubtitlesButtonHandle );
+	if ( button == NULL )
+	{
+		return;
+	}
+	if ( Videos->HasSubtitles() )
+	{
+		const LocalizedStrings & strings = Videos->GetStrings();
+		button->SetText( Videos->GetSubtitlesHeadLocked() ? strings.GetString( "@string/subtitles_head", "Subtitles: Head" ) :
+				strings.GetString( "@string/subtitles_video", "Subtitles: Video" ) );
+		button->RemoveFlags( VRMENUOBJECT_DONT_RENDER );
+	}
+	else
+	{
+		button->AddFlags( VRMENUOBJECT_DONT_RENDER );
+	}
 }
 
 OvrVideoMenu::~OvrVideoMenu()
@@ -278,6 +450,12 @@ void OvrVideoMenu::Open_Impl( App * app, OvrGazeCursor & gazeCursor )
 	ButtonCoolDown = BUTTON_COOL_DOWN_SECONDS;
 
 	OpenTime = ovr_GetTimeInSeconds();
+
+	const OvrVideosMetaDatum * videoData = static_cast< const OvrVideosMetaDatum * >( Videos->GetActiveVideo() );
+	ShowChapterButtons( videoData != NULL && videoData->Chapters.GetCount() > 1 );
+	ShowDownloadButton( Videos->CanDownloadVideo( videoData ) );
+	UpdatePlaylistButton();
+	UpdateSubtitlesButton();
 }
 
 void OvrVideoMenu::Frame_Impl( App * app, VrFrame const & vrFrame, OvrVRMenuMgr & menuMgr, BitmapFont const & font, BitmapFontSurface & fontSurface, gazeCursorUserId_t const gazeUserId )
@@ -303,6 +481,29 @@ void OvrVideoMenu::OnItemEvent_Impl( App * app, VRMenuId_t const itemId, VRMenuE
 		{
 			Videos->SeekTo( 0 );
 		}
+		else if ( itemId.Get() == ID_PREV_CHAPTER_BUTTON.Get() )
+		{
+			Videos->SeekToChapter( -1 );
+		}
+		else if ( itemId.Get() == ID_NEXT_CHAPTER_BUTTON.Get() )
+		{
+			Videos->SeekToChapter( 1 );
+		}
+		else if ( itemId.Get() == ID_DOWNLOAD_BUTTON.Get() && Videos->CanDownloadVideo( Videos->GetActiveVideo() ) )
+		{
+			Videos->DownloadVideo( Videos->GetActiveVideo() );
+			ShowDownloadButton( false );
+		}
+		else if ( itemId.Get() == ID_PLAYLIST_BUTTON.Get() )
+		{
+			Videos->SetPlaylistMode( !Videos->GetPlaylistMode() );
+			UpdatePlaylistButton();
+		}
+		else if ( itemId.Get() == ID_SUBTITLES_BUTTON.Get() && Videos->HasSubtitles() )
+		{
+			Videos->SetSubtitlesHeadLocked( !Videos->GetSubtitlesHeadLocked() );
+			UpdateSubtitlesButton();
+		}
 	}
 }
 
@@ -36,6 +36,11 @@ public:
 	static const VRMenuId_t ID_CENTER_ROOT;
 	static const VRMenuId_t	ID_BROWSER_BUTTON;
 	static const VRMenuId_t	ID_VIDEO_BUTTON;
+	static const VRMenuId_t	ID_PREV_CHAPTER_BUTTON;
+	static const VRMenuId_t	ID_NEXT_CHAPTER_BUTTON;
+	static const VRMenuId_t	ID_DOWNLOAD_BUTTON;
+	static const VRMenuId_t	ID_PLAYLIST_BUTTON;
+	static const VRMenuId_t	ID_SUBTITLES_BUTTON;
 
 	// only one of these every needs to be created
 	static  OvrVideoMenu *		Create(
@@ -71,6 +76,11 @@ private:
 	menuHandle_t			AttributionHandle;
 	menuHandle_t			BrowserButtonHandle;
 	menuHandle_t			VideoControlButtonHandle;
+	menuHandle_t			PrevChapterButtonHandle;
+	menuHandle_t			NextChapterButtonHandle;
+	menuHandle_t			DownloadButtonHandle;
+	menuHandle_t			PlaylistButtonHandle;
+	menuHandle_t			SubtitlesButtonHandle;
 
 	const float				Radius;
 
@@ -78,6 +88,10 @@ private:
 
 	double					OpenTime;
 
+	void					ShowChapterButtons( const bool show );
+	void					ShowDownloadButton( const bool show );
+	void					UpdatePlaylistButton();
+	void					UpdateSubtitlesButton();
 };
 
 }
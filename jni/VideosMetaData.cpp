@@ -12,7 +12,13 @@ Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
 
 #include "VideosMetaData.h"
 
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
 #include "Kernel/OVR_JSON.h"
+#include "Android/LogUtils.h"
 #include "VrCommon.h"
 
 namespace OVR {
@@ -23,12 +29,57 @@ const char * const THUMBNAIL_URL_INNER 				= "thumbnail_url";
 const char * const STREAMING_TYPE_INNER 			= "streaming_type";
 const char * const STREAMING_PROXY_INNER 			= "streaming_proxy";
 const char * const STREAMING_SECURITY_LEVEL_INNER 	= "streaming_security_level";
+const char * const STREAMING_LICENSE_URL_INNER 		= "streaming_license_url";
 const char * const DEFAULT_AUTHOR_NAME				= "Unspecified Author";
+const char * const PAGE_PREVIOUS_URL				= "page://previous/";
+const char * const PAGE_NEXT_URL					= "page://next/";
+
+static UInt64 HashUrl( const char * url )
+{
+	UInt64 hash = 14695981039346656037ull;
+	for ( const char * p = url; *p != 0; p++ )
+	{
+		hash ^= static_cast< UByte >( *p );
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static bool IsPageUrl( const char * url )
+{
+	return strncmp( url, "page://", 7 ) == 0;
+}
+
+// Network share urls are percent encoded, which the title shouldn't show.
+static String DecodeTitle( const String & title )
+{
+	Array< char > decoded;
+	for ( const char * p = title.ToCStr(); *p != 0; p++ )
+	{
+		unsigned int value;
+		if ( *p == '%' && isxdigit( p[1] ) && isxdigit( p[2] ) && sscanf( p + 1, "%2x", &value ) == 1 )
+		{
+			decoded.PushBack( static_cast< char >( value ) );
+			p += 2;
+		}
+		else
+		{
+			decoded.PushBack( *p );
+		}
+	}
+	return String( decoded.GetDataPtr(), decoded.GetSize() );
+}
 
 OvrVideosMetaDatum::OvrVideosMetaDatum( const String& url )
 	: Author( DEFAULT_AUTHOR_NAME )
+	, ChaptersLoaded( false )
+	, PanelPage( 0 )
 {
 	Title = ExtractFileBase( url );
+	if ( strncmp( url.ToCStr(), "http://", 7 ) == 0 )
+	{
+		Title = DecodeTitle( Title );
+	}
 }
 
 OvrMetaDatum * OvrVideosMetaData::CreateMetaDatum( const char* url ) const
@@ -36,6 +87,539 @@ OvrMetaDatum * OvrVideosMetaData::CreateMetaDatum( const char* url ) const
 	return new OvrVideosMetaDatum( url );
 }
 
+const OvrMetaDatum * OvrVideosMetaData::AddVideo( const char * url, const char * categoryTag )
+{
+	Array< OvrMetaDatum * > & metaData = GetMetaData();
+	IndexUrls();
+	UInt64 urlKey;
+	if ( IsPageUrl( url ) || FindUrl( url, urlKey ) >= 0 )
+	{
+		return NULL;
+	}
+
+	int categoryIndex = FindCategory( categoryTag );
+	if ( categoryIndex < 0 )
+	{
+		AddCategory( categoryTag );
+		categoryIndex = GetCategories().GetSizeI() - 1;
+	}
+
+	OvrMetaDatum * datum = CreateMetaDatum( url );
+	datum->Id = metaData.GetSizeI();
+	datum->Url = url;
+	datum->Tags.PushBack( categoryTag );
+	metaData.PushBack( datum );
+	UrlIndex.Set( urlKey, datum->Id );
+	IndexedCount++;
+
+	PruneWindows();
+	Category & category = GetCategory( categoryIndex );
+	GetChanges( category.CategoryTag ).Inserted.PushBack( datum->Id );
+	PanelWindow * window = FindWindow( category.CategoryTag );
+	if ( window != NULL )
+	{
+		window->DatumIds.PushBack( datum->Id );
+		BindWindow( *window, category );
+	}
+	else
+	{
+		category.DatumIndicies.PushBack( datum->Id );
+		category.Dirty = true;
+		UpdateWindow( categoryIndex );
+	}
+	if ( PanelBudget > 0 && FitPanelPool() )
+	{
+		UpdateWindows();
+	}
+	return datum;
+}
+
+bool OvrVideosMetaData::RemoveVideo( const char * url )
+{
+	Array< OvrMetaDatum * > & metaData = GetMetaData();
+	IndexUrls();
+	UInt64 urlKey;
+	const int id = FindUrl( url, urlKey );
+	if ( id < 0 )
+	{
+		return false;
+	}
+	// removing the key would cut off the urls probed past it
+	UrlIndex.Set( urlKey, -1 );
+	while ( RemovedIds.GetSizeI() <= id )
+	{
+		RemovedIds.PushBack( 0 );
+	}
+	RemovedIds[id] = 1;
+
+	OvrMetaDatum * datum = metaData[id];
+	for ( int t = 0; t < datum->Tags.GetSizeI(); t++ )
+	{
+		const int categoryIndex = FindCategory( datum->Tags[t] );
+		if ( categoryIndex < 0 )
+		{
+			continue;
+		}
+		// Without a window the category holds at most the pool. A window's
+		// DatumIds keeps the id until the prune, only the browser's panels
+		// are searched here to know whether it shows the video.
+		Category & category = GetCategory( categoryIndex );
+		PanelWindow * window = FindWindow( category.CategoryTag );
+		if ( window != NULL )
+		{
+			window->Removed++;
+		}
+		for ( int i = 0; i < category.DatumIndicies.GetSizeI(); i++ )
+		{
+			if ( category.DatumIndicies[i] == id )
+			{
+				if ( window == NULL )
+				{
+					category.DatumIndicies.RemoveAt( i );
+				}
+				category.Dirty = true;
+				break;
+			}
+		}
+		GetChanges( category.CategoryTag ).Removed.PushBack( id );
+	}
+	datum->Tags.Clear();
+	return true;
+}
+
+void OvrVideosMetaData::MarkUpdated( const OvrMetaDatum & datum )
+{
+	for ( int t = 0; t < datum.Tags.GetSizeI(); t++ )
+	{
+		const int categoryIndex = FindCategory( datum.Tags[t] );
+		if ( categoryIndex < 0 )
+		{
+			continue;
+		}
+		// with a window the browser holds at most the pool, so this stays short
+		Category & category = GetCategory( categoryIndex );
+		for ( int i = 0; i < category.DatumIndicies.GetSizeI(); i++ )
+		{
+			if ( category.DatumIndicies[i] == datum.Id )
+			{
+				category.Dirty = true;
+				break;
+			}
+		}
+		GetChanges( category.CategoryTag ).Updated.PushBack( datum.Id );
+	}
+}
+
+void OvrVideosMetaData::RescanFiles()
+{
+	const Array< OvrMetaDatum * > & metaData = GetMetaData();
+	Stamps.Resize( metaData.GetSizeI() );
+	for ( int i = 0; i < metaData.GetSizeI(); i++ )
+	{
+		// removed videos have no tags left, and page panels never had any
+		const OvrMetaDatum & datum = *metaData[i];
+		if ( datum.Url.ToCStr()[0] != '/' || datum.Tags.GetSizeI() == 0 )
+		{
+			continue;
+		}
+		struct stat st;
+		if ( stat( datum.Url.ToCStr(), &st ) != 0 )
+		{
+			LOG( "OvrVideosMetaData::RescanFiles %s is gone", datum.Url.ToCStr() );
+			RemoveVideo( datum.Url.ToCStr() );
+			continue;
+		}
+		FileStamp & stamp = Stamps[i];
+		if ( stamp.Known && ( stamp.Size != st.st_size || stamp.ModifiedTime != st.st_mtime ) )
+		{
+			LOG( "OvrVideosMetaData::RescanFiles %s changed", datum.Url.ToCStr() );
+			MarkUpdated( datum );
+		}
+		stamp.Size = st.st_size;
+		stamp.ModifiedTime = st.st_mtime;
+		stamp.Known = true;
+	}
+}
+
+void OvrVideosMetaData::TakeChanges( Array< CategoryChanges > & outChanges )
+{
+	PruneWindows();
+	outChanges = Changes;
+	Changes.Clear();
+}
+
+void OvrVideosMetaData::SetPanelPool( const int poolSize )
+{
+	PruneWindows();
+	MaxPanelPool = poolSize;
+	FitPanelPool();
+	UpdateWindows();
+}
+
+void OvrVideosMetaData::SetPanelBudget( const int maxPanels )
+{
+	PruneWindows();
+	PanelBudget = maxPanels;
+	if ( FitPanelPool() )
+	{
+		UpdateWindows();
+	}
+}
+
+int OvrVideosMetaData::GetShownPanelCount() const
+{
+	int count = 0;
+	for ( int i = 0; i < GetCategories().GetSizeI(); i++ )
+	{
+		count += GetCategories()[i].DatumIndicies.GetSizeI();
+	}
+	return count;
+}
+
+// Steps the pool down from the one set until the budget holds, a panel a
+// category at a time, down to a pool of one. Returns true if it changed,
+// for the caller to rebind the windows.
+bool OvrVideosMetaData::FitPanelPool()
+{
+	int pool = MaxPanelPool;
+	if ( PanelBudget > 0 && CountPanels( pool ) > PanelBudget )
+	{
+		int largest = 0;
+		for ( int i = 0; i < GetCategories().GetSizeI(); i++ )
+		{
+			const PanelWindow * window = FindWindow( GetCategories()[i].CategoryTag );
+			largest = Alg::Max( largest, ( window != NULL ) ? window->DatumIds.GetSizeI() - window->Removed : GetCategories()[i].DatumIndicies.GetSizeI() );
+		}
+		pool = ( pool > 0 ) ? Alg::Min( pool, largest ) : largest;
+		while ( pool > 1 && CountPanels( pool ) > PanelBudget )
+		{
+			pool--;
+		}
+	}
+	if ( pool == PanelPool )
+	{
+		return false;
+	}
+	LOG( "OvrVideosMetaData::FitPanelPool %i panels a category for a budget of %i", pool, PanelBudget );
+	PanelPool = pool;
+	return true;
+}
+
+// The panels every category would show with the pool: all of a category's
+// videos up to it, past it the pool and both page panels at worst.
+int OvrVideosMetaData::CountPanels( const int poolSize ) const
+{
+	int count = 0;
+	for ( int i = 0; i < GetCategories().GetSizeI(); i++ )
+	{
+		const PanelWindow * window = FindWindow( GetCategories()[i].CategoryTag );
+		const int videos = ( window != NULL ) ? window->DatumIds.GetSizeI() - window->Removed : GetCategories()[i].DatumIndicies.GetSizeI();
+		count += ( poolSize > 0 && videos > poolSize ) ? poolSize + 2 : videos;
+	}
+	return count;
+}
+
+bool OvrVideosMetaData::MovePanelWindow( const OvrVideosMetaDatum & pagePanel )
+{
+	PruneWindows();
+	PanelWindow * window = NULL;
+	for ( int i = 0; i < Windows.GetSizeI() && window == NULL; i++ )
+	{
+		window = ( Windows[i].PreviousPanel == pagePanel.Id || Windows[i].NextPanel == pagePanel.Id ) ? &Windows[i] : NULL;
+	}
+	if ( window == NULL )
+	{
+		return false;
+	}
+	int first;
+	int last;
+	GetPageRange( pagePanel, first, last );
+	if ( first - 1 == window->Start )
+	{
+		return false;
+	}
+	window->Start = first - 1;
+	for ( int i = 0; i < GetCategories().GetSizeI(); i++ )
+	{
+		if ( GetCategories()[i].CategoryTag == window->CategoryTag )
+		{
+			BindWindow( *window, GetCategory( i ) );
+		}
+	}
+	return true;
+}
+
+void OvrVideosMetaData::GetPageRange( const OvrVideosMetaDatum & pagePanel, int & outFirst, int & outLast ) const
+{
+	outFirst = 0;
+	outLast = 0;
+	for ( int i = 0; i < Windows.GetSizeI(); i++ )
+	{
+		const PanelWindow & window = Windows[i];
+		if ( window.PreviousPanel == pagePanel.Id || window.NextPanel == pagePanel.Id )
+		{
+			const int total = window.DatumIds.GetSizeI();
+			const int count = ( PanelPool > 0 ) ? Alg::Min( PanelPool, total ) : total;
+			const int start = Alg::Max( 0, Alg::Min( window.Start + pagePanel.PanelPage * count, total - count ) );
+			outFirst = start + 1;
+			outLast = start + count;
+			return;
+		}
+	}
+}
+
+void OvrVideosMetaData::GetCategoryVideos( const Category & category, Array< const OvrMetaDatum * > & outVideos )
+{
+	PruneWindows();
+	const PanelWindow * window = FindWindow( category.CategoryTag );
+	if ( window == NULL )
+	{
+		GetMetaData( category, outVideos );
+		return;
+	}
+	const Array< OvrMetaDatum * > & metaData = GetMetaData();
+	outVideos.Clear();
+	for ( int i = 0; i < window->DatumIds.GetSizeI(); i++ )
+	{
+		outVideos.PushBack( metaData[window->DatumIds[i]] );
+	}
+}
+
+// Drops the removed videos from the windows, in one pass over each window
+// however many went since the last prune. The window keeps showing the same
+// videos, it only moves back by the removed ones before it.
+void OvrVideosMetaData::PruneWindows()
+{
+	for ( int w = 0; w < Windows.GetSizeI(); w++ )
+	{
+		PanelWindow & window = Windows[w];
+		if ( window.Removed == 0 )
+		{
+			continue;
+		}
+		int kept = 0;
+		int start = window.Start;
+		for ( int i = 0; i < window.DatumIds.GetSizeI(); i++ )
+		{
+			const int id = window.DatumIds[i];
+			if ( id < RemovedIds.GetSizeI() && RemovedIds[id] != 0 )
+			{
+				start -= ( i < window.Start ) ? 1 : 0;
+				continue;
+			}
+			window.DatumIds[kept++] = window.DatumIds[i];
+		}
+		window.DatumIds.Resize( kept );
+		window.Start = Alg::Max( 0, start );
+		window.Removed = 0;
+		const int categoryIndex = FindCategory( window.CategoryTag );
+		if ( categoryIndex >= 0 )
+		{
+			BindWindow( window, GetCategory( categoryIndex ) );
+		}
+	}
+}
+
+void OvrVideosMetaData::UpdateWindows()
+{
+	for ( int i = 0; i < GetCategories().GetSizeI(); i++ )
+	{
+		UpdateWindow( i );
+	}
+}
+
+// Gives the category its window once it outgrows the pool.
+void OvrVideosMetaData::UpdateWindow( const int categoryIndex )
+{
+	Category & category = GetCategory( categoryIndex );
+	PanelWindow * window = FindWindow( category.CategoryTag );
+	if ( window == NULL )
+	{
+		if ( PanelPool <= 0 || category.DatumIndicies.GetSizeI() <= PanelPool )
+		{
+			return;
+		}
+		PanelWindow added;
+		added.CategoryTag = category.CategoryTag;
+		for ( int i = 0; i < category.DatumIndicies.GetSizeI(); i++ )
+		{
+			added.DatumIds.PushBack( category.DatumIndicies[i] );
+		}
+		added.Start = 0;
+		added.Removed = 0;
+		added.PreviousPanel = AddPagePanel( category.CategoryTag, -1 )->Id;
+		added.NextPanel = AddPagePanel( category.CategoryTag, 1 )->Id;
+		Windows.PushBack( added );
+		window = &Windows.Back();
+	}
+	BindWindow( *window, category );
+}
+
+// Hands the browser the window's videos, between the page panels that lead
+// out of it. The category is only dirtied when that changes what it shows.
+void OvrVideosMetaData::BindWindow( const PanelWindow & window, Category & category ) const
+{
+	const int total = window.DatumIds.GetSizeI();
+	const int count = ( PanelPool > 0 ) ? Alg::Min( PanelPool, total ) : total;
+	const int start = Alg::Max( 0, Alg::Min( window.Start, total - count ) );
+
+	Array< int > ids;
+	if ( start > 0 )
+	{
+		ids.PushBack( window.PreviousPanel );
+	}
+	for ( int i = start; i < start + count; i++ )
+	{
+		ids.PushBack( window.DatumIds[i] );
+	}
+	if ( start + count < total )
+	{
+		ids.PushBack( window.NextPanel );
+	}
+
+	bool same = ids.GetSizeI() == category.DatumIndicies.GetSizeI();
+	for ( int i = 0; i < ids.GetSizeI() && same; i++ )
+	{
+		same = ids[i] == category.DatumIndicies[i];
+	}
+	if ( !same )
+	{
+		category.DatumIndicies.Clear();
+		for ( int i = 0; i < ids.GetSizeI(); i++ )
+		{
+			category.DatumIndicies.PushBack( ids[i] );
+		}
+		category.Dirty = true;
+	}
+}
+
+// The directory scan doesn't come through AddVideo, so index what it added
+// first. Page panels are left out; no url of theirs should find them.
+void OvrVideosMetaData::IndexUrls()
+{
+	const Array< OvrMetaDatum * > & metaData = GetMetaData();
+	for ( ; IndexedCount < metaData.GetSizeI(); IndexedCount++ )
+	{
+		const char * url = metaData[IndexedCount]->Url.ToCStr();
+		UInt64 urlKey;
+		if ( !IsPageUrl( url ) && FindUrl( url, urlKey ) < 0 )
+		{
+			UrlIndex.Set( urlKey, IndexedCount );
+		}
+	}
+}
+
+// The id of the url's datum, or -1 with outKey where it would go. Urls whose
+// hashes collide take the keys after it, so the probe runs on past other urls
+// and removed ones until it reaches a key that was never used.
+int OvrVideosMetaData::FindUrl( const char * url, UInt64 & outKey )
+{
+	const Array< OvrMetaDatum * > & metaData = GetMetaData();
+	bool haveFree = false;
+	for ( UInt64 key = HashUrl( url ); ; key++ )
+	{
+		int id;
+		if ( !UrlIndex.Get( key, &id ) )
+		{
+			outKey = haveFree ? outKey : key;
+			return -1;
+		}
+		if ( id < 0 )
+		{
+			outKey = haveFree ? outKey : key;
+			haveFree = true;
+		}
+		else if ( metaData[id]->Url == url )
+		{
+			outKey = key;
+			return id;
+		}
+	}
+}
+
+int OvrVideosMetaData::FindCategory( const String & categoryTag ) const
+{
+	for ( int i = 0; i < GetCategories().GetSizeI(); i++ )
+	{
+		if ( GetCategories()[i].CategoryTag == categoryTag )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+OvrVideosMetaData::CategoryChanges & OvrVideosMetaData::GetChanges( const String & categoryTag )
+{
+	for ( int i = 0; i < Changes.GetSizeI(); i++ )
+	{
+		if ( Changes[i].CategoryTag == categoryTag )
+		{
+			return Changes[i];
+		}
+	}
+	CategoryChanges added;
+	added.CategoryTag = categoryTag;
+	Changes.PushBack( added );
+	return Changes.Back();
+}
+
+OvrVideosMetaData::PanelWindow * OvrVideosMetaData::FindWindow( const String & categoryTag )
+{
+	for ( int i = 0; i < Windows.GetSizeI(); i++ )
+	{
+		if ( Windows[i].CategoryTag == categoryTag )
+		{
+			return &Windows[i];
+		}
+	}
+	return NULL;
+}
+
+const OvrVideosMetaData::PanelWindow * OvrVideosMetaData::FindWindow( const String & categoryTag ) const
+{
+	for ( int i = 0; i < Windows.GetSizeI(); i++ )
+	{
+		if ( Windows[i].CategoryTag == categoryTag )
+		{
+			return &Windows[i];
+		}
+	}
+	return NULL;
+}
+
+OvrVideosMetaDatum * OvrVideosMetaData::AddPagePanel( const String & categoryTag, const int page )
+{
+	Array< OvrMetaDatum * > & metaData = GetMetaData();
+	const String url = String( page < 0 ? PAGE_PREVIOUS_URL : PAGE_NEXT_URL ) + categoryTag;
+	OvrVideosMetaDatum * panel = static_cast< OvrVideosMetaDatum * >( CreateMetaDatum( url.ToCStr() ) );
+	panel->Id = metaData.GetSizeI();
+	panel->Url = url;
+	panel->PanelPage = page;
+	metaData.PushBack( panel );
+	return panel;
+}
+
+// The page panels are datums only so the browser can show them; a saved
+// one would come back on the next start as a video that can't be played.
+JSON * OvrVideosMetaData::MetaDataToJson() const
+{
+	JSON * file = OvrMetaData::MetaDataToJson();
+	JSON * data = ( file != NULL ) ? file->GetItemByName( "data" ) : NULL;
+	JSON * item = ( data != NULL ) ? data->GetFirstItem() : NULL;
+	while ( item != NULL )
+	{
+		JSON * next = data->GetNextItem( item );
+		if ( IsPageUrl( JsonReader( item ).GetChildStringByName( "url" ).ToCStr() ) )
+		{
+			item->RemoveNode();
+			item->Release();
+		}
+		item = next;
+	}
+	return file;
+}
+
 void OvrVideosMetaData::ExtractExtendedData( const JsonReader & jsonDatum, OvrMetaDatum & datum ) const
 {
 	OvrVideosMetaDatum * videoData = static_cast< OvrVideosMetaDatum * >( &datum );
@@ -47,6 +631,7 @@ void OvrVideosMetaData::ExtractExtendedData( const JsonReader & jsonDatum, OvrMe
 		videoData->StreamingType 			= jsonDatum.GetChildStringByName( STREAMING_TYPE_INNER );
 		videoData->StreamingProxy 			= jsonDatum.GetChildStringByName( STREAMING_PROXY_INNER );
 		videoData->StreamingSecurityLevel 	= jsonDatum.GetChildStringByName( STREAMING_SECURITY_LEVEL_INNER );
+		videoData->StreamingLicenseUrl 		= jsonDatum.GetChildStringByName( STREAMING_LICENSE_URL_INNER );
 
 		if ( videoData->Title.IsEmpty() )
 		{
@@ -65,7 +650,7 @@ void OvrVideosMetaData::ExtendedDataToJson( const OvrMetaDatum & datum, JSON * o
 	if ( outDatumObject )
 	{
 		const OvrVideosMetaDatum * const videoData = static_cast< const OvrVideosMetaDatum * const >( &datum );
-		if ( videoData )
+		if ( videoData && videoData->PanelPage == 0 )
 		{
 			outDatumObject->AddStringItem( TITLE_INNER, 					videoData->Title.ToCStr() );
 			outDatumObject->AddStringItem( AUTHOR_INNER, 					videoData->Author.ToCStr() );
@@ -73,6 +658,7 @@ void OvrVideosMetaData::ExtendedDataToJson( const OvrMetaDatum & datum, JSON * o
 			outDatumObject->AddStringItem( STREAMING_TYPE_INNER, 			videoData->StreamingType.ToCStr() );
 			outDatumObject->AddStringItem( STREAMING_PROXY_INNER, 			videoData->StreamingProxy.ToCStr() );
 			outDatumObject->AddStringItem( STREAMING_SECURITY_LEVEL_INNER, 	videoData->StreamingSecurityLevel.ToCStr() );
+			outDatumObject->AddStringItem( STREAMING_LICENSE_URL_INNER, 	videoData->StreamingLicenseUrl.ToCStr() );
 		}
 	}
 }
@@ -85,6 +671,9 @@ void OvrVideosMetaData::SwapExtendedData( OvrMetaDatum * left, OvrMetaDatum * ri
 	{
 		Alg::Swap( leftVideoData->Title, rightVideoData->Title );
 		Alg::Swap( leftVideoData->Author, rightVideoData->Author );
+		leftVideoData->Chapters.Swap( rightVideoData->Chapters );
+		Alg::Swap( leftVideoData->ChaptersLoaded, rightVideoData->ChaptersLoaded );
+		Alg::Swap( leftVideoData->PanelPage, rightVideoData->PanelPage );
 	}
 }
 
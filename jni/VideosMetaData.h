@@ -15,7 +15,9 @@ Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
 #define OVR_VideosMetaData_h
 
 #include "Kernel/OVR_String.h"
+#include "Kernel/OVR_Hash.h"
 #include "VRMenu/MetaDataManager.h"
+#include "ChapterIndex.h"
 
 namespace OVR {
 
@@ -29,6 +31,15 @@ struct OvrVideosMetaDatum : public OvrMetaDatum
 	String  StreamingType;
 	String  StreamingProxy;
 	String  StreamingSecurityLevel;
+	String  StreamingLicenseUrl;		// ClearKey license server of a protected download
+
+	// Read from the container the first time the video plays, not saved with the rest.
+	mutable ChapterIndex	Chapters;
+	mutable bool			ChaptersLoaded;
+
+	// -1 or 1 on the page panels of a virtualized category, 0 on videos.
+	// Page panels belong to no category's tags and aren't saved.
+	int		PanelPage;
 
 	OvrVideosMetaDatum( const String& url );
 };
@@ -38,13 +49,122 @@ struct OvrVideosMetaDatum : public OvrMetaDatum
 class OvrVideosMetaData : public OvrMetaData
 {
 public:
+	// What changed in one category since the last TakeChanges, as datum ids.
+	struct CategoryChanges
+	{
+		String			CategoryTag;
+		Array< int >	Inserted;
+		Array< int >	Removed;
+		Array< int >	Updated;
+	};
+
+	OvrVideosMetaData() : PanelPool( 0 ), MaxPanelPool( 0 ), PanelBudget( 0 ), IndexedCount( 0 ) {}
 	virtual ~OvrVideosMetaData() {}
 
+	// Adds a file that arrived after the directory scan, such as a finished
+	// download, to the category, creating it if needed. Returns NULL if the
+	// url is already known.
+	const OvrMetaDatum *	AddVideo( const char * url, const char * categoryTag );
+
+	// Takes the video out of its category. The datum stays allocated, since
+	// ids are indices, but belongs to no category. Returns false for an
+	// unknown url. A window drops its removed videos in one pass, on the
+	// next TakeChanges or anything else that reads it, so removing doesn't
+	// cost a search and a shift of the whole category each time.
+	bool					RemoveVideo( const char * url );
+
+	// Records that something a panel shows for the datum, such as its title
+	// or thumbnail, changed.
+	void					MarkUpdated( const OvrMetaDatum & datum );
+
+	// Checks the files of the local videos against the last rescan. Videos
+	// whose file is gone are removed, ones whose size or modification time
+	// changed are marked updated. The first rescan of a video only records it.
+	void					RescanFiles();
+
+	// The changes since the last call. Adding, removing and updating only
+	// dirty a category when the browser shows the videos involved, so
+	// BuildDirtyMenu leaves every other category as it is.
+	void					TakeChanges( Array< CategoryChanges > & outChanges );
+
+	// Categories larger than poolSize show the browser a window of poolSize
+	// videos, with a page panel at either end that moves the window, so the
+	// panels the browser builds don't grow with the category. 0 shows every
+	// video.
+	void					SetPanelPool( const int poolSize );
+
+	// Every panel the browser builds holds a thumbnail texture. With a
+	// budget the pool shrinks below the one set until the panels of all
+	// categories together, page panels included, fit in maxPanels, and is
+	// fitted again as videos are added. 0 lifts the budget.
+	void					SetPanelBudget( const int maxPanels );
+
+	// The pool in effect, and the panels every category shows with it.
+	int						GetPanelPool() const { return PanelPool; }
+	int						GetShownPanelCount() const;
+
+	// Moves the window of the page panel's category by a page, leaving the
+	// category dirty for BuildDirtyMenu. Returns false if it didn't move.
+	bool					MovePanelWindow( const OvrVideosMetaDatum & pagePanel );
+
+	// The videos a page panel leads to, counted from 1.
+	void					GetPageRange( const OvrVideosMetaDatum & pagePanel, int & outFirst, int & outLast ) const;
+
+	// Every video of the category, not only the window the browser shows.
+	void					GetCategoryVideos( const Category & category, Array< const OvrMetaDatum * > & outVideos );
+
+	// What the base writes to the meta file, without the page panels.
+	JSON *					MetaDataToJson() const;
+
 protected:
 	virtual OvrMetaDatum *	CreateMetaDatum( const char* url ) const;
 	virtual	void			ExtractExtendedData( const JsonReader & jsonDatum, OvrMetaDatum & outDatum ) const;
 	virtual	void			ExtendedDataToJson( const OvrMetaDatum & datum, JSON * outDatumObject ) const;
 	virtual void			SwapExtendedData( OvrMetaDatum * left, OvrMetaDatum * right ) const;
+
+private:
+	struct PanelWindow
+	{
+		String			CategoryTag;
+		Array< int >	DatumIds;			// every video of the category
+		int				Start;
+		int				PreviousPanel;		// datum ids of the page panels
+		int				NextPanel;
+		int				Removed;			// videos of DatumIds removed since the last prune
+	};
+
+	struct FileStamp
+	{
+		SInt64			Size;
+		SInt64			ModifiedTime;
+		bool			Known;
+
+		FileStamp() : Size( 0 ), ModifiedTime( 0 ), Known( false ) {}
+	};
+
+	int						PanelPool;
+	int						MaxPanelPool;		// as set, before the budget
+	int						PanelBudget;
+	Array< PanelWindow >	Windows;
+	Hash< UInt64, int >		UrlIndex;			// url hash, probed on collision, to datum id or -1 once removed
+	int						IndexedCount;		// datums already in UrlIndex
+	Array< CategoryChanges >	Changes;
+	Array< FileStamp >		Stamps;				// by datum id, as of the last rescan
+	Array< UByte >			RemovedIds;			// by datum id, 1 once removed, so a prune doesn't read every datum
+
+	void					IndexUrls();
+	int						FindUrl( const char * url, UInt64 & outKey );
+	int						FindCategory( const String & categoryTag ) const;
+	CategoryChanges &		GetChanges( const String & categoryTag );
+	bool					FitPanelPool();
+	int						CountPanels( const int poolSize ) const;
+	void					PruneWindows();
+	void					UpdateWindows();
+	void					UpdateWindow( const int categoryIndex );
+	void					BindWindow( const PanelWindow & window, Category & category ) const;
+	PanelWindow *			FindWindow( const String & categoryTag );
+	const PanelWindow *		FindWindow( const String & categoryTag ) const;
+	OvrVideosMetaDatum *	AddPagePanel( const String & categoryTag, const int page );
 };
 
 }
@@ -0,0 +1,245 @@
+/************************************************************************************
+
+Filename    :   WavFile.cpp
+Content     :   Memory mapped reader for PCM and float WAV files
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "WavFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Android/LogUtils.h"
+
+namespace OVR {
+
+static const int	WAVE_FORMAT_PCM = 1;
+static const int	WAVE_FORMAT_IEEE_FLOAT = 3;
+static const int	WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+static UInt32 ReadLE32( const UByte * p )
+{
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( ( UInt32 )p[3] << 24 );
+}
+
+static UInt16 ReadLE16( const UByte * p )
+{
+	return ( UInt16 )( p[0] | ( p[1] << 8 ) );
+}
+
+WavFile::WavFile()
+	: Fd( -1 )
+	, Mapping( NULL )
+	, MappingSize( 0 )
+	, Data( NULL )
+	, Format( SAMPLE_INT16 )
+	, Channels( 0 )
+	, SampleRate( 0 )
+	, FrameBytes( 0 )
+	, FrameCount( 0 )
+{
+}
+
+WavFile::~WavFile()
+{
+	Close();
+}
+
+bool WavFile::Open( const char * path )
+{
+	Close();
+
+	Fd = open( path, O_RDONLY );
+	if ( Fd < 0 )
+	{
+		return false;
+	}
+	struct stat st;
+	if ( fstat( Fd, &st ) != 0 || st.st_size < 44 )
+	{
+		Close();
+		return false;
+	}
+	MappingSize = st.st_size;
+	Mapping = mmap( NULL, MappingSize, PROT_READ, MAP_SHARED, Fd, 0 );
+	if ( Mapping == MAP_FAILED )
+	{
+		Mapping = NULL;
+		Close();
+		return false;
+	}
+	madvise( Mapping, MappingSize, MADV_SEQUENTIAL );
+	if ( !Parse( static_cast< const UByte * >( Mapping ), MappingSize, path ) )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool WavFile::OpenMemory( const void * data, const int size, const char * name )
+{
+	Close();
+	if ( data == NULL || size < 44 || !Parse( static_cast< const UByte * >( data ), size, name ) )
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+bool WavFile::Parse( const UByte * file, const SInt64 fileSize, const char * path )
+{
+	if ( memcmp( file, "RIFF", 4 ) != 0 || memcmp( file + 8, "WAVE", 4 ) != 0 )
+	{
+		LOG( "WavFile: '%s' is not a WAVE file", path );
+		return false;
+	}
+
+	int formatTag = 0;
+	int bitsPerSample = 0;
+	const UByte * data = NULL;
+	SInt64 dataSize = 0;
+	for ( SInt64 offset = 12; offset + 8 <= fileSize; )
+	{
+		const UByte * chunk = file + offset;
+		const SInt64 chunkSize = ReadLE32( chunk + 4 );
+		const SInt64 available = Alg::Min( chunkSize, fileSize - offset - 8 );
+		if ( memcmp( chunk, "fmt ", 4 ) == 0 && available >= 16 )
+		{
+			formatTag = ReadLE16( chunk + 8 );
+			Channels = ReadLE16( chunk + 10 );
+			SampleRate = static_cast< int >( ReadLE32( chunk + 12 ) );
+			bitsPerSample = ReadLE16( chunk + 22 );
+			if ( formatTag == WAVE_FORMAT_EXTENSIBLE && available >= 40 )
+			{
+				// the first two bytes of the sub format GUID are the format tag
+				formatTag = ReadLE16( chunk + 32 );
+			}
+		}
+		else if ( memcmp( chunk, "data", 4 ) == 0 )
+		{
+			data = chunk + 8;
+			dataSize = available;
+			break;
+		}
+		// chunks are padded to an even size
+		offset += 8 + chunkSize + ( chunkSize & 1 );
+	}
+
+	if ( formatTag == WAVE_FORMAT_PCM && bitsPerSample == 16 )
+	{
+		Format = SAMPLE_INT16;
+	}
+	else if ( formatTag == WAVE_FORMAT_PCM && bitsPerSample == 24 )
+	{
+		Format = SAMPLE_INT24;
+	}
+	else if ( formatTag == WAVE_FORMAT_IEEE_FLOAT && bitsPerSample == 32 )
+	{
+		Format = SAMPLE_FLOAT32;
+	}
+	else
+	{
+		LOG( "WavFile: '%s' has unsupported format %i, %i bits", path, formatTag, bitsPerSample );
+		return false;
+	}
+	if ( data == NULL || Channels <= 0 || SampleRate <= 0 )
+	{
+		LOG( "WavFile: '%s' has no data", path );
+		return false;
+	}
+
+	Data = data;
+	FrameBytes = Channels * bitsPerSample / 8;
+	FrameCount = dataSize / FrameBytes;
+	return true;
+}
+
+void WavFile::Close()
+{
+	if ( Mapping != NULL )
+	{
+		munmap( Mapping, MappingSize );
+	}
+	if ( Fd >= 0 )
+	{
+		close( Fd );
+	}
+	Fd = -1;
+	Mapping = NULL;
+	MappingSize = 0;
+	Data = NULL;
+	Channels = 0;
+	SampleRate = 0;
+	FrameBytes = 0;
+	FrameCount = 0;
+}
+
+void WavFile::ReadFrames( const SInt64 firstFrame, const int frameCount, float * out ) const
+{
+	int frame = 0;
+	// silence before the start
+	for ( ; frame < frameCount && firstFrame + frame < 0; frame++ )
+	{
+		memset( out + frame * Channels, 0, Channels * sizeof( float ) );
+	}
+
+	const int end = static_cast< int >( Alg::Max( Alg::Min( ( SInt64 )frameCount, FrameCount - firstFrame ), ( SInt64 )frame ) );
+	const int samples = ( end - frame ) * Channels;
+	if ( samples > 0 )
+	{
+		const UByte * src = Data + ( firstFrame + frame ) * FrameBytes;
+		float * dest = out + frame * Channels;
+		switch ( Format )
+		{
+			case SAMPLE_INT16:
+				for ( int i = 0; i < samples; i++ )
+				{
+					dest[i] = static_cast< SInt16 >( ReadLE16( src + i * 2 ) ) * ( 1.0f / 32768.0f );
+				}
+				break;
+			case SAMPLE_INT24:
+				for ( int i = 0; i < samples; i++ )
+				{
+					const UByte * p = src + i * 3;
+					const SInt32 value = static_cast< SInt32 >( ( p[0] << 8 ) | ( p[1] << 16 ) | ( ( UInt32 )p[2] << 24 ) ) >> 8;
+					dest[i] = value * ( 1.0f / 8388608.0f );
+				}
+				break;
+			case SAMPLE_FLOAT32:
+				memcpy( dest, src, samples * sizeof( float ) );
+				break;
+		}
+	}
+
+	// and after the end
+	if ( end < frameCount )
+	{
+		memset( out + end * Channels, 0, ( frameCount - end ) * Channels * sizeof( float ) );
+	}
+}
+
+void WavFile::ReadAll( Array< float > & out ) const
+{
+	out.Resize( static_cast< UPInt >( FrameCount * Channels ) );
+	if ( FrameCount > 0 )
+	{
+		ReadFrames( 0, static_cast< int >( FrameCount ), out.GetDataPtr() );
+	}
+}
+
+}
@@ -0,0 +1,80 @@
+/************************************************************************************
+
+Filename    :   WavFile.h
+Content     :   Memory mapped reader for PCM and float WAV files
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_WavFile_h )
+#define OVR_WavFile_h
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+
+namespace OVR {
+
+//==============================================================
+// WavFile
+//
+// 16 bit, 24 bit and 32 bit float samples, any channel count. The data
+// chunk is mapped rather than read, so frames can be pulled from any
+// thread, including an audio callback, once the file is open. Files read
+// from the application package are parsed in place instead.
+class WavFile
+{
+public:
+					WavFile();
+					~WavFile();
+
+	bool			Open( const char * path );
+	// The caller keeps data alive until Close, name is only for the log.
+	bool			OpenMemory( const void * data, const int size, const char * name );
+	void			Close();
+	bool			IsOpen() const				{ return Data != NULL; }
+
+	int				GetChannels() const			{ return Channels; }
+	int				GetSampleRate() const		{ return SampleRate; }
+	SInt64			GetFrameCount() const		{ return FrameCount; }
+
+	// Interleaved floats in -1 to 1. Frames outside the file read as silence.
+	void			ReadFrames( const SInt64 firstFrame, const int frameCount, float * out ) const;
+
+	// Whole file, for short sounds that are preloaded.
+	void			ReadAll( Array< float > & out ) const;
+
+private:
+	enum eSampleFormat
+	{
+		SAMPLE_INT16,
+		SAMPLE_INT24,
+		SAMPLE_FLOAT32
+	};
+
+	int				Fd;
+	void *			Mapping;
+	SInt64			MappingSize;
+	const UByte *	Data;
+	eSampleFormat	Format;
+	int				Channels;
+	int				SampleRate;
+	int				FrameBytes;
+	SInt64			FrameCount;
+
+	bool			Parse( const UByte * file, const SInt64 fileSize, const char * path );
+
+	// not copyable
+					WavFile( const WavFile & );
+	WavFile &		operator = ( const WavFile & );
+};
+
+}
+
+#endif // OVR_WavFile_h
@@ -0,0 +1,830 @@
+/************************************************************************************
+
+Filename    :   WebDavSource.cpp
+Content     :   Videos on a WebDAV network share, listed with pipelined PROPFIND
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "WebDavSource.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Android/LogUtils.h"
+#include "HttpClient.h"
+#include "XmlScanner.h"
+
+namespace OVR {
+
+static const int	LIST_TIMEOUT_MS = 15000;
+static const int	THUMBNAIL_TIMEOUT_MS = 10000;
+static const SInt64	MAX_LISTING_BYTES = 32 * 1024 * 1024;
+static const SInt64	MAX_THUMBNAIL_BYTES = 4 * 1024 * 1024;
+static const int	MAX_FAILURES = 4;			// in a row, then the walk stops where it is
+static const int	RETRY_DELAY_MS = 1000;
+static const char	LISTINGS_MAGIC[] = "OVRDAV1";
+
+static const char	PROPFIND_BODY[] =
+	"<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+	"<D:propfind xmlns:D=\"DAV:\"><D:prop><D:resourcetype/><D:getetag/></D:prop></D:propfind>";
+
+static const char *	THUMBNAIL_EXTENSIONS[] = { ".jpg", ".jpeg", ".thm" };
+
+static double GetSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static UInt64 HashUrl( const char * url, const int length )
+{
+	UInt64 hash = 14695981039346656037ull;
+	for ( int i = 0; i < length; i++ )
+	{
+		hash ^= static_cast< UByte >( url[i] );
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static UInt64 HashUrl( const String & url )
+{
+	return HashUrl( url.ToCStr(), static_cast< int >( url.GetSize() ) );
+}
+
+static int HexValue( const char c )
+{
+	return ( c >= '0' && c <= '9' ) ? c - '0' : ( c >= 'a' && c <= 'f' ) ? c - 'a' + 10 : ( c >= 'A' && c <= 'F' ) ? c - 'A' + 10 : -1;
+}
+
+static String PercentDecode( const char * start, const char * end )
+{
+	// the escapes are UTF-8 bytes already, so they can't go through String::AppendChar
+	Array< char > decoded;
+	for ( const char * p = start; p < end; p++ )
+	{
+		if ( *p == '%' && end - p >= 3 && HexValue( p[1] ) >= 0 && HexValue( p[2] ) >= 0 )
+		{
+			decoded.PushBack( static_cast< char >( HexValue( p[1] ) * 16 + HexValue( p[2] ) ) );
+			p += 2;
+		}
+		else
+		{
+			decoded.PushBack( *p );
+		}
+	}
+	return String( decoded.GetDataPtr(), decoded.GetSize() );
+}
+
+// The last path component of url, [outStart, outEnd), ignoring a trailing slash.
+static void FindName( const String & url, const char * & outStart, const char * & outEnd )
+{
+	const char * start = url.ToCStr();
+	const char * end = start + url.GetSize();
+	if ( end > start && end[-1] == '/' )
+	{
+		end--;
+	}
+	const char * name = end;
+	while ( name > start && name[-1] != '/' )
+	{
+		name--;
+	}
+	outStart = name;
+	outEnd = end;
+}
+
+// Servers differ in how they encode and slash the folder's own href.
+static String FolderKey( const String & url )
+{
+	const char * start = url.ToCStr();
+	const char * end = start + url.GetSize();
+	if ( end > start && end[-1] == '/' )
+	{
+		end--;
+	}
+	return PercentDecode( start, end );
+}
+
+// Length of url without its extension, or -1 if it has one of extensions.
+static int StripExtension( const String & url, const char * const * extensions, const int count )
+{
+	const char * start;
+	const char * end;
+	FindName( url, start, end );
+	const char * dot = end;
+	while ( dot > start && *dot != '.' )
+	{
+		dot--;
+	}
+	if ( *dot != '.' )
+	{
+		return -1;
+	}
+	for ( int i = 0; i < count; i++ )
+	{
+		if ( strlen( extensions[i] ) == static_cast< size_t >( end - dot ) && strncasecmp( dot, extensions[i], end - dot ) == 0 )
+		{
+			return static_cast< int >( dot - url.ToCStr() );
+		}
+	}
+	return -1;
+}
+
+static bool WriteFileAtomic( const String & path, const UByte * data, const int length )
+{
+	const String temp = path + ".tmp";
+	FILE * f = fopen( temp.ToCStr(), "wb" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	const bool written = fwrite( data, 1, length, f ) == static_cast< size_t >( length );
+	if ( fclose( f ) != 0 || !written || rename( temp.ToCStr(), path.ToCStr() ) != 0 )
+	{
+		unlink( temp.ToCStr() );
+		return false;
+	}
+	return true;
+}
+
+//==============================================================
+// WebDavSource
+
+WebDavSource::WebDavSource( const char * rootUrl, const char * cacheDir, const Array< String > & extensions )
+	: CacheDir( cacheDir )
+	, Extensions( extensions )
+	, Exiting( false )
+	, Walking( false )
+	, NextFolder( 0 )
+	, NextThumbnail( 0 )
+	, RequestCount( 0 )
+	, RevalidatedCount( 0 )
+{
+	// the same form HttpUrl::Resolve produces, so Owns can compare prefixes
+	HttpUrl parsed;
+	if ( parsed.Parse( rootUrl ) )
+	{
+		RootUrl = parsed.ToString();
+		if ( RootUrl.GetSize() > 0 && RootUrl.ToCStr()[RootUrl.GetSize() - 1] != '/' )
+		{
+			RootUrl += "/";
+		}
+	}
+	else
+	{
+		LOG( "WebDav: unsupported share url %s", rootUrl );
+	}
+
+	char name[32];
+	snprintf( name, sizeof( name ), "/%016llx.listings", ( unsigned long long )HashUrl( RootUrl ) );
+	ListingsPath = CacheDir + name;
+
+	pthread_mutex_init( &Mutex, NULL );
+	pthread_cond_init( &Wake, NULL );
+}
+
+WebDavSource::~WebDavSource()
+{
+	Stop();
+	pthread_cond_destroy( &Wake );
+	pthread_mutex_destroy( &Mutex );
+}
+
+void WebDavSource::Start()
+{
+	if ( Threads.GetSizeI() > 0 || RootUrl.IsEmpty() )
+	{
+		return;
+	}
+	if ( mkdir( CacheDir.ToCStr(), 0755 ) != 0 && errno != EEXIST )
+	{
+		LOG( "WebDav: can't create %s: %s", CacheDir.ToCStr(), strerror( errno ) );
+	}
+	LoadListings();
+
+	Exiting = false;
+	Walking = true;
+	Folders.Clear();
+	NextFolder = 0;
+	Thumbnails.Clear();
+	NextThumbnail = 0;
+	RequestCount = 0;
+	RevalidatedCount = 0;
+
+	pthread_t thread;
+	if ( pthread_create( &thread, NULL, ListThreadFunction, this ) != 0 )
+	{
+		LOG( "WebDav: pthread_create failed" );
+		Walking = false;
+		return;
+	}
+	Threads.PushBack( thread );
+	for ( int i = 0; i < THUMBNAIL_CONNECTIONS; i++ )
+	{
+		if ( pthread_create( &thread, NULL, ThumbnailThreadFunction, this ) != 0 )
+		{
+			LOG( "WebDav: pthread_create failed" );
+			break;
+		}
+		Threads.PushBack( thread );
+	}
+}
+
+void WebDavSource::Stop()
+{
+	if ( Threads.GetSizeI() == 0 )
+	{
+		return;
+	}
+	pthread_mutex_lock( &Mutex );
+	Exiting = true;
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+
+	for ( int i = 0; i < Threads.GetSizeI(); i++ )
+	{
+		pthread_join( Threads[i], NULL );
+	}
+	Threads.Clear();
+	Walking = false;
+}
+
+void WebDavSource::TakeEntries( Array< MediaSourceEntry > & outEntries )
+{
+	outEntries.Clear();
+	pthread_mutex_lock( &Mutex );
+	for ( int i = NextFolder; i < Folders.GetSizeI(); i++ )
+	{
+		Folder & folder = Folders[i];
+		if ( folder.ThumbnailsLeft != 0 )
+		{
+			continue;
+		}
+		for ( int j = 0; j < folder.Entries.GetSizeI(); j++ )
+		{
+			outEntries.PushBack( folder.Entries[j] );
+		}
+		folder.Entries.Clear();
+		folder.ThumbnailsLeft = -1;		// handed over
+	}
+	while ( NextFolder < Folders.GetSizeI() && Folders[NextFolder].ThumbnailsLeft < 0 )
+	{
+		NextFolder++;
+	}
+	pthread_mutex_unlock( &Mutex );
+}
+
+bool WebDavSource::IsFinished() const
+{
+	pthread_mutex_lock( &Mutex );
+	const bool finished = !Walking && NextFolder == Folders.GetSizeI();
+	pthread_mutex_unlock( &Mutex );
+	return finished;
+}
+
+bool WebDavSource::Owns( const char * url ) const
+{
+	return !RootUrl.IsEmpty() && strncmp( url, RootUrl.ToCStr(), RootUrl.GetSize() ) == 0;
+}
+
+String WebDavSource::GetThumbnailPath( const char * url ) const
+{
+	char name[32];
+	snprintf( name, sizeof( name ), "/%016llx.jpg", ( unsigned long long )HashUrl( url, static_cast< int >( strlen( url ) ) ) );
+	return CacheDir + name;
+}
+
+void * WebDavSource::ListThreadFunction( void * param )
+{
+	pthread_setname_np( pthread_self(), "WebDavList" );
+	static_cast< WebDavSource * >( param )->ListAll();
+	return NULL;
+}
+
+void * WebDavSource::ThumbnailThreadFunction( void * param )
+{
+	pthread_setname_np( pthread_self(), "WebDavThumb" );
+	static_cast< WebDavSource * >( param )->FetchThumbnails();
+	return NULL;
+}
+
+// Walks the share breadth first. Up to PIPELINE_DEPTH PROPFINDs are sent
+// ahead of the response being read, and the folders found are queued as
+// the responses come back in order.
+void WebDavSource::ListAll()
+{
+	const double startTime = GetSeconds();
+
+	HttpConnection connection;
+	connection.SetTimeoutMs( LIST_TIMEOUT_MS );
+
+	Array< String > pending;
+	int nextPending = 0;
+	Hash< UInt64, int > queued;			// symbolic links can make the tree a graph
+	pending.PushBack( RootUrl );
+	queued.Set( HashUrl( RootUrl ), 0 );
+
+	Array< String > inFlight;
+	Listed.Clear();
+	int failures = 0;
+	while ( !Exiting && ( nextPending < pending.GetSizeI() || inFlight.GetSizeI() > 0 ) )
+	{
+		while ( inFlight.GetSizeI() < PIPELINE_DEPTH && nextPending < pending.GetSizeI() )
+		{
+			const String & url = pending[nextPending];
+			HttpUrl parsed;
+			if ( !parsed.Parse( url.ToCStr() ) )
+			{
+				nextPending++;
+				continue;
+			}
+			String headers( "Depth: 1\r\nContent-Type: application/xml; charset=utf-8\r\n" );
+			int cached;
+			if ( CachedIndex.Get( HashUrl( url ), &cached ) && !Cached[cached].ETag.IsEmpty() )
+			{
+				headers += String( "If-None-Match: " ) + Cached[cached].ETag + "\r\n";
+			}
+			if ( !connection.SendRequest( "PROPFIND", parsed, headers.ToCStr(), PROPFIND_BODY, sizeof( PROPFIND_BODY ) - 1 ) )
+			{
+				break;
+			}
+			RequestCount++;
+			inFlight.PushBack( url );
+			nextPending++;
+		}
+
+		bool connected = inFlight.GetSizeI() > 0;
+		HttpResponse response;
+		if ( connected && connection.ReadResponseHeader( response ) )
+		{
+			const String url = inFlight[0];
+			int cached = -1;
+			CachedIndex.Get( HashUrl( url ), &cached );
+
+			Listing listing;
+			bool found = false;
+			if ( ( response.StatusCode == 304 || response.StatusCode == 412 ) && cached >= 0 )
+			{
+				connected = connection.DiscardBody();
+				listing = Cached[cached];
+				found = true;
+				RevalidatedCount++;
+			}
+			else if ( response.StatusCode == 207 )
+			{
+				Array< UByte > body;
+				connected = connection.ReadBodyToArray( body, MAX_LISTING_BYTES );
+				found = connected && ParseListing( body.GetDataPtr(), body.GetSizeI(), url, listing );
+				if ( connected && !found )
+				{
+					LOG( "WebDav: unreadable listing of %s", url.ToCStr() );
+				}
+			}
+			else
+			{
+				LOG( "WebDav: PROPFIND %s answered %i", url.ToCStr(), response.StatusCode );
+				connected = connection.DiscardBody();
+			}
+
+			if ( connected )
+			{
+				inFlight.RemoveAt( 0 );
+				failures = 0;
+			}
+			if ( found )
+			{
+				for ( int i = 0; i < listing.Children.GetSizeI(); i++ )
+				{
+					const Resource & child = listing.Children[i];
+					const UInt64 hash = HashUrl( child.Url );
+					if ( child.Collection && Owns( child.Url.ToCStr() ) && queued.Get( hash ) == NULL )
+					{
+						queued.Set( hash, 0 );
+						pending.PushBack( child.Url );
+					}
+				}
+				AddFolder( listing, cached >= 0 ? &Cached[cached] : NULL );
+				Listed.PushBack( listing );
+			}
+		}
+		else
+		{
+			connected = false;
+		}
+
+		// A server that closes after each response answers one request per
+		// connection; that's slow but not a failure.
+		const bool dropped = connected && !connection.IsOpen() && inFlight.GetSizeI() > 0;
+		if ( !connected || dropped )
+		{
+			// everything still in flight goes again on a new connection
+			connection.Close();
+			Array< String > retry( inFlight );
+			for ( int i = nextPending; i < pending.GetSizeI(); i++ )
+			{
+				retry.PushBack( pending[i] );
+			}
+			pending = retry;
+			nextPending = 0;
+			inFlight.Clear();
+		}
+		if ( !connected )
+		{
+			if ( ++failures > MAX_FAILURES )
+			{
+				LOG( "WebDav: giving up on %s with %i folders unlisted", RootUrl.ToCStr(), pending.GetSizeI() );
+				break;
+			}
+			usleep( RETRY_DELAY_MS * 1000 );
+		}
+	}
+
+	if ( !Exiting )
+	{
+		SaveListings();
+	}
+	LOG( "WebDav: listed %i folders of %s in %.2f s, %i requests, %i unchanged",
+		Listed.GetSizeI(), RootUrl.ToCStr(), GetSeconds() - startTime, RequestCount, RevalidatedCount );
+
+	pthread_mutex_lock( &Mutex );
+	Walking = false;
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+}
+
+bool WebDavSource::ParseListing( const UByte * body, const int length, const String & url, Listing & outListing ) const
+{
+	HttpUrl base;
+	if ( !base.Parse( url.ToCStr() ) )
+	{
+		return false;
+	}
+	outListing.Url = url;
+	outListing.ETag.Clear();
+	outListing.Children.Clear();
+
+	const String selfKey = FolderKey( url );
+	bool multistatus = false;
+	String href;
+	Resource resource;
+	XmlScanner xml( reinterpret_cast< const char * >( body ), length );
+	for ( ;; )
+	{
+		const XmlScanner::eToken token = xml.Next();
+		if ( token == XmlScanner::XML_END )
+		{
+			break;
+		}
+		if ( token == XmlScanner::XML_ERROR )
+		{
+			return false;
+		}
+		if ( token == XmlScanner::XML_START_TAG )
+		{
+			if ( xml.NameIs( "multistatus" ) )
+			{
+				multistatus = true;
+			}
+			else if ( xml.NameIs( "response" ) )
+			{
+				href.Clear();
+				resource.ETag.Clear();
+				resource.Collection = false;
+			}
+			else if ( xml.NameIs( "href" ) )
+			{
+				href = xml.ReadElementText();
+			}
+			else if ( xml.NameIs( "getetag" ) )
+			{
+				resource.ETag = xml.ReadElementText();
+			}
+			else if ( xml.NameIs( "collection" ) )
+			{
+				resource.Collection = true;
+			}
+		}
+		else if ( token == XmlScanner::XML_END_TAG && xml.NameIs( "response" ) && !href.IsEmpty() )
+		{
+			resource.Url = base.Resolve( href.ToCStr() );
+			if ( FolderKey( resource.Url ) == selfKey )
+			{
+				outListing.ETag = resource.ETag;
+				continue;
+			}
+			if ( resource.Collection && resource.Url.ToCStr()[resource.Url.GetSize() - 1] != '/' )
+			{
+				resource.Url += "/";
+			}
+			outListing.Children.PushBack( resource );
+		}
+	}
+	return multistatus;
+}
+
+// Collects the folder's videos and queues the sidecar thumbnails that
+// aren't already cached from an unchanged listing.
+void WebDavSource::AddFolder( const Listing & listing, const Listing * previous )
+{
+	const int thumbnailExtensions = sizeof( THUMBNAIL_EXTENSIONS ) / sizeof( THUMBNAIL_EXTENSIONS[0] );
+
+	// sidecars by the url without their extension
+	Hash< UInt64, int > sidecars;
+	for ( int i = 0; i < listing.Children.GetSizeI(); i++ )
+	{
+		const Resource & child = listing.Children[i];
+		const int baseLength = child.Collection ? -1 : StripExtension( child.Url, THUMBNAIL_EXTENSIONS, thumbnailExtensions );
+		if ( baseLength >= 0 )
+		{
+			sidecars.Set( HashUrl( child.Url.ToCStr(), baseLength ), i );
+		}
+	}
+	Hash< UInt64, int > previousETags;
+	for ( int i = 0; previous != NULL && i < previous->Children.GetSizeI(); i++ )
+	{
+		previousETags.Set( HashUrl( previous->Children[i].Url ), i );
+	}
+
+	// the share's root folder is named after the server
+	String category;
+	HttpUrl parsed;
+	if ( parsed.Parse( listing.Url.ToCStr() ) && parsed.Path == "/" )
+	{
+		category = parsed.Host;
+	}
+	else
+	{
+		const char * nameStart;
+		const char * nameEnd;
+		FindName( listing.Url, nameStart, nameEnd );
+		category = PercentDecode( nameStart, nameEnd );
+	}
+
+	Folder folder;
+	folder.ThumbnailsLeft = 0;
+	Array< ThumbnailJob > jobs;
+	for ( int i = 0; i < listing.Children.GetSizeI(); i++ )
+	{
+		const Resource & child = listing.Children[i];
+		if ( child.Collection || !IsVideo( child.Url ) )
+		{
+			continue;
+		}
+		MediaSourceEntry entry;
+		entry.Url = child.Url;
+		entry.Category = category;
+		folder.Entries.PushBack( entry );
+
+		const char * extension = strrchr( child.Url.ToCStr(), '.' );
+		int sidecar;
+		if ( !sidecars.Get( HashUrl( child.Url.ToCStr(), static_cast< int >( extension - child.Url.ToCStr() ) ), &sidecar ) )
+		{
+			continue;
+		}
+		const Resource & thumbnail = listing.Children[sidecar];
+		const String path = GetThumbnailPath( child.Url.ToCStr() );
+		int old;
+		if ( !thumbnail.ETag.IsEmpty() && previousETags.Get( HashUrl( thumbnail.Url ), &old ) &&
+			previous->Children[old].ETag == thumbnail.ETag && access( path.ToCStr(), F_OK ) == 0 )
+		{
+			continue;
+		}
+		ThumbnailJob job;
+		job.Url = thumbnail.Url;
+		job.Path = path;
+		jobs.PushBack( job );
+	}
+	if ( folder.Entries.GetSizeI() == 0 )
+	{
+		return;
+	}
+
+	pthread_mutex_lock( &Mutex );
+	folder.ThumbnailsLeft = jobs.GetSizeI();
+	Folders.PushBack( folder );
+	for ( int i = 0; i < jobs.GetSizeI(); i++ )
+	{
+		jobs[i].Folder = Folders.GetSizeI() - 1;
+		Thumbnails.PushBack( jobs[i] );
+	}
+	pthread_cond_broadcast( &Wake );
+	pthread_mutex_unlock( &Mutex );
+}
+
+// Each thread pipelines up to PIPELINE_DEPTH GETs on its own connection.
+// Whatever the pipeline doesn't answer, a redirect or anything still in
+// flight when the server closes, is fetched again on its own.
+void WebDavSource::FetchThumbnails()
+{
+	HttpConnection connection;
+	connection.SetTimeoutMs( THUMBNAIL_TIMEOUT_MS );
+	Array< ThumbnailJob > batch;
+	for ( ;; )
+	{
+		pthread_mutex_lock( &Mutex );
+		while ( !Exiting && Walking && NextThumbnail == Thumbnails.GetSizeI() )
+		{
+			pthread_cond_wait( &Wake, &Mutex );
+		}
+		if ( Exiting || NextThumbnail == Thumbnails.GetSizeI() )
+		{
+			pthread_mutex_unlock( &Mutex );
+			break;
+		}
+		batch.Clear();
+		while ( batch.GetSizeI() < PIPELINE_DEPTH && NextThumbnail < Thumbnails.GetSizeI() )
+		{
+			batch.PushBack( Thumbnails[NextThumbnail++] );
+		}
+		if ( NextThumbnail == Thumbnails.GetSizeI() )
+		{
+			Thumbnails.Clear();
+			NextThumbnail = 0;
+		}
+		pthread_mutex_unlock( &Mutex );
+
+		int sent = 0;
+		for ( ; sent < batch.GetSizeI(); sent++ )
+		{
+			HttpUrl parsed;
+			if ( !parsed.Parse( batch[sent].Url.ToCStr() ) || !connection.SendRequest( "GET", parsed, NULL, NULL, 0 ) )
+			{
+				break;
+			}
+		}
+
+		Array< int > again;
+		for ( int i = 0; i < batch.GetSizeI(); i++ )
+		{
+			batch[i].Saved = false;
+			HttpResponse response;
+			if ( i >= sent || !connection.ReadResponseHeader( response ) )
+			{
+				sent = i;
+				again.PushBack( i );
+				continue;
+			}
+			Array< UByte > body;
+			if ( response.IsSuccess() )
+			{
+				batch[i].Saved = connection.ReadBodyToArray( body, MAX_THUMBNAIL_BYTES ) &&
+					WriteFileAtomic( batch[i].Path, body.GetDataPtr(), body.GetSizeI() );
+			}
+			else
+			{
+				connection.DiscardBody();
+				if ( response.StatusCode >= 300 && response.StatusCode < 400 )
+				{
+					again.PushBack( i );
+				}
+			}
+		}
+		if ( sent < batch.GetSizeI() )
+		{
+			connection.Close();
+		}
+		for ( int i = 0; i < again.GetSizeI(); i++ )
+		{
+			ThumbnailJob & job = batch[again[i]];
+			Array< UByte > body;
+			job.Saved = HttpFetch( connection, job.Url.ToCStr(), -1, -1, body ) &&
+				WriteFileAtomic( job.Path, body.GetDataPtr(), body.GetSizeI() );
+		}
+
+		pthread_mutex_lock( &Mutex );
+		for ( int i = 0; i < batch.GetSizeI(); i++ )
+		{
+			if ( !batch[i].Saved )
+			{
+				LOG( "WebDav: couldn't fetch thumbnail %s", batch[i].Url.ToCStr() );
+				unlink( batch[i].Path.ToCStr() );
+			}
+			Folders[batch[i].Folder].ThumbnailsLeft--;
+		}
+		pthread_mutex_unlock( &Mutex );
+	}
+}
+
+bool WebDavSource::IsVideo( const String & url ) const
+{
+	const char * start;
+	const char * end;
+	FindName( url, start, end );
+	const char * dot = end;
+	while ( dot > start && *dot != '.' )
+	{
+		dot--;
+	}
+	for ( int i = 0; i < Extensions.GetSizeI() && *dot == '.'; i++ )
+	{
+		if ( Extensions[i].GetSize() == static_cast< UPInt >( end - dot ) &&
+			strncasecmp( dot, Extensions[i].ToCStr(), end - dot ) == 0 )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// One line per resource: "D\tetag\turl" opens a folder and "C" or "F"
+// lines follow for its subfolders and files.
+void WebDavSource::LoadListings()
+{
+	Cached.Clear();
+	CachedIndex.Clear();
+	FILE * f = fopen( ListingsPath.ToCStr(), "rb" );
+	if ( f == NULL )
+	{
+		return;
+	}
+	char line[4096];
+	if ( fgets( line, sizeof( line ), f ) == NULL || strncmp( line, LISTINGS_MAGIC, sizeof( LISTINGS_MAGIC ) - 1 ) != 0 )
+	{
+		fclose( f );
+		return;
+	}
+	while ( fgets( line, sizeof( line ), f ) != NULL )
+	{
+		char * end = line + strlen( line );
+		if ( end == line || end[-1] != '\n' )
+		{
+			break;		// truncated, or a line longer than any url we write
+		}
+		*--end = 0;
+		char * etag = strchr( line, '\t' );
+		char * url = ( etag != NULL ) ? strchr( etag + 1, '\t' ) : NULL;
+		if ( url == NULL || etag != line + 1 )
+		{
+			break;
+		}
+		*url++ = 0;
+		etag++;
+		if ( line[0] == 'D' )
+		{
+			Listing listing;
+			listing.Url = url;
+			listing.ETag = etag;
+			CachedIndex.Set( HashUrl( listing.Url ), Cached.GetSizeI() );
+			Cached.PushBack( listing );
+		}
+		else if ( ( line[0] == 'C' || line[0] == 'F' ) && Cached.GetSizeI() > 0 )
+		{
+			Resource resource;
+			resource.Url = url;
+			resource.ETag = etag;
+			resource.Collection = line[0] == 'C';
+			Cached.Back().Children.PushBack( resource );
+		}
+	}
+	fclose( f );
+}
+
+void WebDavSource::SaveListings() const
+{
+	const String temp = ListingsPath + ".tmp";
+	FILE * f = fopen( temp.ToCStr(), "wb" );
+	if ( f == NULL )
+	{
+		LOG( "WebDav: can't write %s: %s", temp.ToCStr(), strerror( errno ) );
+		return;
+	}
+	fprintf( f, "%s\n", LISTINGS_MAGIC );
+	for ( int i = 0; i < Listed.GetSizeI(); i++ )
+	{
+		const Listing & listing = Listed[i];
+		// a folder without an ETag can't be revalidated, so there's no point keeping it
+		if ( listing.ETag.IsEmpty() || strpbrk( listing.ETag.ToCStr(), "\t\n" ) != NULL )
+		{
+			continue;
+		}
+		fprintf( f, "D\t%s\t%s\n", listing.ETag.ToCStr(), listing.Url.ToCStr() );
+		for ( int j = 0; j < listing.Children.GetSizeI(); j++ )
+		{
+			const Resource & child = listing.Children[j];
+			const bool plain = strpbrk( child.ETag.ToCStr(), "\t\n" ) == NULL;
+			fprintf( f, "%c\t%s\t%s\n", child.Collection ? 'C' : 'F', plain ? child.ETag.ToCStr() : "", child.Url.ToCStr() );
+		}
+	}
+	if ( fclose( f ) != 0 || rename( temp.ToCStr(), ListingsPath.ToCStr() ) != 0 )
+	{
+		LOG( "WebDav: can't write %s", ListingsPath.ToCStr() );
+		unlink( temp.ToCStr() );
+	}
+}
+
+}
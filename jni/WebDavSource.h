@@ -0,0 +1,128 @@
+/************************************************************************************
+
+Filename    :   WebDavSource.h
+Content     :   Videos on a WebDAV network share, listed with pipelined PROPFIND
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_WebDavSource_h )
+#define OVR_WebDavSource_h
+
+#include <pthread.h>
+
+#include "Kernel/OVR_Hash.h"
+#include "MediaSource.h"
+
+namespace OVR {
+
+class HttpConnection;
+
+//==============================================================
+// WebDavSource
+//
+// Walks a share one directory at a time with PROPFIND Depth:1, keeping
+// several requests pipelined on one keep-alive connection so a tree of
+// small folders costs about one round trip per PIPELINE_DEPTH folders.
+// Listings are saved in the cache directory with the ETag of their folder
+// and revalidated with If-None-Match on the next start. A video's sidecar
+// thumbnail, name.jpg or name.thm next to it, is downloaded to the cache
+// by a few parallel connections before its folder is handed over, so the
+// browser finds every thumbnail when it builds the folder.
+class WebDavSource : public MediaSource
+{
+public:
+	static const int		PIPELINE_DEPTH = 8;
+	static const int		THUMBNAIL_CONNECTIONS = 4;
+
+							// extensions are lower case with the dot, as in OvrMetaDataFileExtensions.
+							WebDavSource( const char * rootUrl, const char * cacheDir, const Array< String > & extensions );
+	virtual					~WebDavSource();
+
+	virtual void			Start();
+	virtual void			Stop();
+	virtual void			TakeEntries( Array< MediaSourceEntry > & outEntries );
+	virtual bool			IsFinished() const;
+	virtual bool			Owns( const char * url ) const;
+	virtual String			GetThumbnailPath( const char * url ) const;
+
+	// Requests sent and folders answered from the cache by the last walk.
+	int						GetRequestCount() const		{ return RequestCount; }
+	int						GetRevalidatedCount() const	{ return RevalidatedCount; }
+
+private:
+	struct Resource
+	{
+		String				Url;			// absolute, still percent encoded
+		String				ETag;
+		bool				Collection;
+	};
+
+	struct Listing
+	{
+		String				Url;
+		String				ETag;			// of the folder itself, empty when the server has none
+		Array< Resource >	Children;
+	};
+
+	struct Folder
+	{
+		Array< MediaSourceEntry >	Entries;
+		int					ThumbnailsLeft;
+	};
+
+	struct ThumbnailJob
+	{
+		String				Url;			// of the sidecar
+		String				Path;
+		int					Folder;
+		bool				Saved;
+	};
+
+	String					RootUrl;
+	String					CacheDir;
+	String					ListingsPath;
+	Array< String >			Extensions;
+
+	Array< pthread_t >		Threads;
+	mutable pthread_mutex_t	Mutex;
+	pthread_cond_t			Wake;
+	volatile bool			Exiting;
+
+	// previous run's listings, read at Start and only by the listing thread
+	Array< Listing >		Cached;
+	Hash< UInt64, int >		CachedIndex;
+	Array< Listing >		Listed;
+
+	// shared with the thumbnail threads and the VR thread
+	bool					Walking;
+	Array< Folder >			Folders;
+	int						NextFolder;			// first folder not yet handed over
+	Array< ThumbnailJob >	Thumbnails;
+	int						NextThumbnail;
+
+	volatile int			RequestCount;
+	volatile int			RevalidatedCount;
+
+	static void *			ListThreadFunction( void * param );
+	static void *			ThumbnailThreadFunction( void * param );
+	void					ListAll();
+	void					FetchThumbnails();
+
+	bool					ParseListing( const UByte * body, const int length, const String & url, Listing & outListing ) const;
+	void					AddFolder( const Listing & listing, const Listing * previous );
+	void					LoadListings();
+	void					SaveListings() const;
+	bool					IsVideo( const String & name ) const;
+};
+
+}
+
+#endif // OVR_WebDavSource_h
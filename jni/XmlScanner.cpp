@@ -0,0 +1,336 @@
+/************************************************************************************
+
+Filename    :   XmlScanner.cpp
+Content     :   Minimal pull scanner for manifests and service responses
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "XmlScanner.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace OVR {
+
+static bool IsSpace( const char c )
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+XmlScanner::XmlScanner( const char * text, const int length )
+	: Cur( text )
+	, End( text + length )
+	, Depth( 0 )
+	, PendingEndTag( false )
+{
+}
+
+bool XmlScanner::NameIs( const char * name ) const
+{
+	return strcmp( Name.ToCStr(), name ) == 0;
+}
+
+bool XmlScanner::GetAttribute( const char * name, String & outValue ) const
+{
+	for ( int i = 0; i < Attributes.GetSizeI(); i++ )
+	{
+		if ( strcmp( Attributes[i].Name.ToCStr(), name ) == 0 )
+		{
+			outValue = Attributes[i].Value;
+			return true;
+		}
+	}
+	return false;
+}
+
+String XmlScanner::GetAttribute( const char * name ) const
+{
+	String value;
+	GetAttribute( name, value );
+	return value;
+}
+
+bool XmlScanner::SkipPast( const char * terminator )
+{
+	const int len = static_cast< int >( strlen( terminator ) );
+	for ( ; Cur + len <= End; Cur++ )
+	{
+		if ( memcmp( Cur, terminator, len ) == 0 )
+		{
+			Cur += len;
+			return true;
+		}
+	}
+	Cur = End;
+	return false;
+}
+
+const char * XmlScanner::LocalName( const char * start, const char * end )
+{
+	for ( const char * p = start; p < end; p++ )
+	{
+		if ( *p == ':' )
+		{
+			return p + 1;
+		}
+	}
+	return start;
+}
+
+void XmlScanner::DecodeEntities( const char * start, const char * end, String & out )
+{
+	out.Clear();
+	const char * run = start;
+	for ( const char * p = start; p < end; p++ )
+	{
+		if ( *p != '&' )
+		{
+			continue;
+		}
+		const char * semi = p + 1;
+		while ( semi < end && *semi != ';' && semi - p < 10 )
+		{
+			semi++;
+		}
+		if ( semi >= end || *semi != ';' )
+		{
+			continue;
+		}
+
+		unsigned int c = 0;
+		const int len = static_cast< int >( semi - p - 1 );
+		if ( len == 3 && strncmp( p + 1, "amp", 3 ) == 0 )			{ c = '&'; }
+		else if ( len == 2 && strncmp( p + 1, "lt", 2 ) == 0 )		{ c = '<'; }
+		else if ( len == 2 && strncmp( p + 1, "gt", 2 ) == 0 )		{ c = '>'; }
+		else if ( len == 4 && strncmp( p + 1, "quot", 4 ) == 0 )	{ c = '"'; }
+		else if ( len == 4 && strncmp( p + 1, "apos", 4 ) == 0 )	{ c = '\''; }
+		else if ( len > 1 && p[1] == '#' )
+		{
+			c = ( p[2] == 'x' ) ? strtoul( p + 3, NULL, 16 ) : strtoul( p + 2, NULL, 10 );
+		}
+		if ( c == 0 )
+		{
+			continue;
+		}
+
+		out.AppendString( run, p - run );
+		out.AppendChar( c );
+		run = semi + 1;
+		p = semi;
+	}
+	out.AppendString( run, end - run );
+}
+
+void XmlScanner::ParseStartTag()
+{
+	// Cur points just past '<'
+	const char * nameStart = Cur;
+	while ( Cur < End && !IsSpace( *Cur ) && *Cur != '>' && *Cur != '/' )
+	{
+		Cur++;
+	}
+	const char * local = LocalName( nameStart, Cur );
+	Name = String( local, Cur - local );
+	Attributes.Clear();
+
+	for ( ;; )
+	{
+		while ( Cur < End && IsSpace( *Cur ) )
+		{
+			Cur++;
+		}
+		if ( Cur >= End )
+		{
+			return;
+		}
+		if ( *Cur == '>' )
+		{
+			Cur++;
+			return;
+		}
+		if ( *Cur == '/' )
+		{
+			PendingEndTag = true;
+			SkipPast( ">" );
+			return;
+		}
+
+		const char * attrStart = Cur;
+		while ( Cur < End && *Cur != '=' && !IsSpace( *Cur ) && *Cur != '>' && *Cur != '/' )
+		{
+			Cur++;
+		}
+		const char * attrEnd = Cur;
+		while ( Cur < End && IsSpace( *Cur ) )
+		{
+			Cur++;
+		}
+		if ( Cur >= End || *Cur != '=' )
+		{
+			continue;	// attribute without a value
+		}
+		Cur++;
+		while ( Cur < End && IsSpace( *Cur ) )
+		{
+			Cur++;
+		}
+		if ( Cur >= End || ( *Cur != '"' && *Cur != '\'' ) )
+		{
+			continue;
+		}
+		const char quote = *Cur++;
+		const char * valueStart = Cur;
+		while ( Cur < End && *Cur != quote )
+		{
+			Cur++;
+		}
+
+		Attribute attr;
+		const char * attrLocal = LocalName( attrStart, attrEnd );
+		attr.Name = String( attrLocal, attrEnd - attrLocal );
+		DecodeEntities( valueStart, Cur, attr.Value );
+		Attributes.PushBack( attr );
+
+		if ( Cur < End )
+		{
+			Cur++;
+		}
+	}
+}
+
+XmlScanner::eToken XmlScanner::Next()
+{
+	if ( PendingEndTag )
+	{
+		PendingEndTag = false;
+		Depth--;
+		return XML_END_TAG;
+	}
+
+	while ( Cur < End )
+	{
+		if ( *Cur != '<' )
+		{
+			const char * textStart = Cur;
+			while ( Cur < End && *Cur != '<' )
+			{
+				Cur++;
+			}
+			const char * textEnd = Cur;
+			while ( textStart < textEnd && IsSpace( *textStart ) )
+			{
+				textStart++;
+			}
+			while ( textEnd > textStart && IsSpace( textEnd[-1] ) )
+			{
+				textEnd--;
+			}
+			if ( textStart < textEnd )
+			{
+				DecodeEntities( textStart, textEnd, Text );
+				return XML_TEXT;
+			}
+			continue;
+		}
+
+		if ( End - Cur >= 9 && memcmp( Cur, "<![CDATA[", 9 ) == 0 )
+		{
+			const char * dataStart = Cur + 9;
+			if ( !SkipPast( "]]>" ) )
+			{
+				return XML_ERROR;
+			}
+			Text = String( dataStart, ( Cur - 3 ) - dataStart );
+			return XML_TEXT;
+		}
+		if ( End - Cur >= 4 && memcmp( Cur, "<!--", 4 ) == 0 )
+		{
+			if ( !SkipPast( "-->" ) )
+			{
+				return XML_ERROR;
+			}
+			continue;
+		}
+		if ( End - Cur >= 2 && ( Cur[1] == '?' || Cur[1] == '!' ) )
+		{
+			if ( !SkipPast( ">" ) )
+			{
+				return XML_ERROR;
+			}
+			continue;
+		}
+		if ( End - Cur >= 2 && Cur[1] == '/' )
+		{
+			const char * nameStart = Cur + 2;
+			if ( !SkipPast( ">" ) )
+			{
+				return XML_ERROR;
+			}
+			const char * nameEnd = Cur - 1;
+			while ( nameEnd > nameStart && IsSpace( nameEnd[-1] ) )
+			{
+				nameEnd--;
+			}
+			const char * local = LocalName( nameStart, nameEnd );
+			Name = String( local, nameEnd - local );
+			Depth--;
+			return XML_END_TAG;
+		}
+
+		Cur++;
+		ParseStartTag();
+		Depth++;
+		return XML_START_TAG;
+	}
+	return XML_END;
+}
+
+String XmlScanner::ReadElementText()
+{
+	String result;
+	const int depth = Depth;
+	for ( ;; )
+	{
+		const eToken token = Next();
+		if ( token == XML_END || token == XML_ERROR )
+		{
+			break;
+		}
+		if ( token == XML_TEXT && Depth == depth )
+		{
+			result += Text;
+		}
+		if ( token == XML_END_TAG && Depth < depth )
+		{
+			break;
+		}
+	}
+	return result;
+}
+
+void XmlScanner::SkipElement()
+{
+	const int depth = Depth;
+	for ( ;; )
+	{
+		const eToken token = Next();
+		if ( token == XML_END || token == XML_ERROR )
+		{
+			break;
+		}
+		if ( token == XML_END_TAG && Depth < depth )
+		{
+			break;
+		}
+	}
+}
+
+}
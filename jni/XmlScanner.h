@@ -0,0 +1,90 @@
+/************************************************************************************
+
+Filename    :   XmlScanner.h
+Content     :   Minimal pull scanner for manifests and service responses
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_XmlScanner_h )
+#define OVR_XmlScanner_h
+
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+//==============================================================
+// XmlScanner
+//
+// Walks an XML document one token at a time without building a tree.
+// Namespace prefixes are stripped from element and attribute names, so
+// "D:href" and "href" compare the same. An empty element ( <a/> ) is
+// reported as a start tag immediately followed by its end tag.
+class XmlScanner
+{
+public:
+	enum eToken
+	{
+		XML_END,
+		XML_START_TAG,
+		XML_END_TAG,
+		XML_TEXT,
+		XML_ERROR
+	};
+
+					XmlScanner( const char * text, const int length );
+
+	eToken			Next();
+
+	// Name of the element for XML_START_TAG / XML_END_TAG.
+	const String &	GetName() const		{ return Name; }
+	bool			NameIs( const char * name ) const;
+
+	// Entity decoded text for XML_TEXT, leading and trailing white space removed.
+	const String &	GetText() const		{ return Text; }
+
+	// Attributes of the most recent start tag.
+	bool			GetAttribute( const char * name, String & outValue ) const;
+	String			GetAttribute( const char * name ) const;
+
+	// Depth of the current element, 1 for the root element.
+	int				GetDepth() const	{ return Depth; }
+
+	// Collects the text content of the current element and consumes up to its end tag.
+	String			ReadElementText();
+
+	// Consumes everything up to and including the end tag of the current element.
+	void			SkipElement();
+
+private:
+	struct Attribute
+	{
+		String	Name;
+		String	Value;
+	};
+
+	const char *		Cur;
+	const char *		End;
+	String				Name;
+	String				Text;
+	Array< Attribute >	Attributes;
+	int					Depth;
+	bool				PendingEndTag;
+
+	bool				SkipPast( const char * terminator );
+	void				ParseStartTag();
+	static void			DecodeEntities( const char * start, const char * end, String & out );
+	static const char *	LocalName( const char * start, const char * end );
+};
+
+}
+
+#endif // OVR_XmlScanner_h
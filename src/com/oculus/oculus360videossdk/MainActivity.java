@@ -14,15 +14,21 @@ of patent rights can be found in the PATENTS file in the same directory.
 *************************************************************************************/
 package com.oculus.oculus360videossdk;
 
+import java.io.File;
 import java.io.IOException;
+import java.lang.reflect.Field;
+import java.util.Arrays;
 
 import android.content.SharedPreferences.Editor;
 import android.graphics.SurfaceTexture;
 import android.media.MediaPlayer;
 import android.os.Bundle;
+import android.os.Handler;
+import android.os.SystemClock;
 import android.util.Log;
 import android.view.Surface;
 import android.view.SurfaceHolder;
+import android.content.ComponentCallbacks2;
 import android.content.Context;
 import android.content.Intent;
 import android.media.AudioManager;
@@ -35,6 +41,8 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 		MediaPlayer.OnVideoSizeChangedListener,
 		MediaPlayer.OnCompletionListener,
 		MediaPlayer.OnErrorListener,
+		MediaPlayer.OnBufferingUpdateListener,
+		MediaPlayer.OnSeekCompleteListener,
 		AudioManager.OnAudioFocusChangeListener {
 
 	public static final String TAG = "Oculus360Videos";
@@ -49,6 +57,12 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 	public static native SurfaceTexture nativePrepareNewVideo(long appPtr );
 	public static native void nativeFrameAvailable( long appPtr );
 	public static native void nativeVideoCompletion( long appPtr );
+	public static native void nativeSeekComplete( long appPtr, int seekId );
+	public static native SurfaceTexture nativePreparePreloadSurface( long appPtr, int generation );
+	public static native void nativePreloadReady( long appPtr, int generation );
+	public static native void nativePreloadFailed( long appPtr, int generation );
+	public static native void nativeTrimMemory( long appPtr, int level );
+	public static native void nativeUpdatePlaybackState( long appPtr, boolean playing, int position, int duration, int bufferedPercent, int completedSeekId );
 	public static native long nativeSetAppInterface( VrActivity act, String fromPackageNameString, String commandString, String uriString );
 
 	SurfaceTexture movieTexture = null;
@@ -56,6 +70,40 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 	MediaPlayer mediaPlayer = null;	
 	AudioManager audioManager = null;
 
+	// Videos with an ambisonic sidecar are heard through the native renderer,
+	// the player's own stereo mix is muted.
+	static final String AMBISONIC_SUFFIX = ".ambix.wav";
+	float movieVolume = 1.0f;
+
+	// The native side reads the player state from a shared block instead of
+	// calling back into java, so publish it whenever it may have changed and
+	// periodically while playing.
+	static final int PLAYBACK_STATE_INTERVAL_MS = 100;
+	static final int SURFACE_RETRY_DELAY_MS = 10;
+
+	// Second player for the playlist, prepared and paused on the next video
+	// while the current one plays. The native side decides when to preload,
+	// promote or discard it.
+	MediaPlayer preloadPlayer = null;
+	SurfaceTexture preloadTexture = null;
+	Surface preloadSurface = null;
+	String preloadPath = null;
+	volatile int preloadGeneration = 0;
+	boolean preloadPrepared = false;
+	Handler playbackStateHandler = null;
+	int bufferedPercent = 0;
+	// ids of native seeks, so a late completion can't end a later seek
+	volatile int lastSeekId = 0;
+	volatile int completedSeekId = 0;
+	final Runnable playbackStateRunnable = new Runnable() {
+		@Override
+		public void run() {
+			if ( publishPlaybackState() ) {
+				playbackStateHandler.postDelayed( this, PLAYBACK_STATE_INTERVAL_MS );
+			}
+		}
+	};
+
 	// ==================================================================================
 
 	void requestAudioFocus()
@@ -92,17 +140,39 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 		appPtr = nativeSetAppInterface( this, fromPackageNameString, commandString, uriString );
 
 		audioManager = (AudioManager) getSystemService( Context.AUDIO_SERVICE );
+		playbackStateHandler = new Handler();
 	}
 	
 	@Override
 	protected void onDestroy() {	
 		Log.d(TAG, "onDestroy");
+
+		playbackStateHandler.removeCallbacks( playbackStateRunnable );
+		discardPreload();
 		
 		// Abandon audio focus if we still hold it
 		releaseAudioFocus();
 
 		super.onDestroy();	
 	}
+
+	// The native side sheds thumbnail memory, which otherwise competes with the decoder's buffers.
+	@Override
+	public void onTrimMemory( int level ) {
+		super.onTrimMemory( level );
+		Log.d( TAG, "onTrimMemory " + level );
+		if ( appPtr != 0 ) {
+			nativeTrimMemory( appPtr, level );
+		}
+	}
+
+	@Override
+	public void onLowMemory() {
+		super.onLowMemory();
+		if ( appPtr != 0 ) {
+			nativeTrimMemory( appPtr, ComponentCallbacks2.TRIM_MEMORY_COMPLETE );
+		}
+	}
 	
 	// --
 	// --> MediaPlayer.OnErrorListener START
@@ -129,9 +199,46 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 
 	public void onCompletion(MediaPlayer mp) {
 		Log.v(TAG, String.format("onCompletion"));
+		publishPlaybackState();
 		nativeVideoCompletion(appPtr);
 	}
 
+	public void onSeekComplete(MediaPlayer mp) {
+		// MediaPlayer reports a burst of seeks once, for the last one
+		completedSeekId = lastSeekId;
+		nativeSeekComplete(appPtr, completedSeekId);
+		schedulePlaybackState();
+	}
+
+	public void onBufferingUpdate(MediaPlayer mp, int percent) {
+		bufferedPercent = percent;
+	}
+
+	// Returns true while the player is playing. Must be called on the UI thread.
+	boolean publishPlaybackState() {
+		boolean playing = false;
+		int position = 0;
+		int duration = -1;
+		try {
+			if ( mediaPlayer != null ) {
+				playing = mediaPlayer.isPlaying();
+				position = mediaPlayer.getCurrentPosition();
+				duration = mediaPlayer.getDuration();
+			}
+		}
+		catch( IllegalStateException ise ) {
+			Log.d( TAG, "publishPlaybackState(): Caught illegalStateException: " + ise.toString() );
+		}
+		nativeUpdatePlaybackState( appPtr, playing, position, duration, bufferedPercent, completedSeekId );
+		return playing;
+	}
+
+	// Safe to call from any thread, restarts the periodic updates.
+	void schedulePlaybackState() {
+		playbackStateHandler.removeCallbacks( playbackStateRunnable );
+		playbackStateHandler.post( playbackStateRunnable );
+	}
+
 	public void onFrameAvailable(SurfaceTexture surfaceTexture) {
 		nativeFrameAvailable(appPtr);
 	}
@@ -168,27 +275,7 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 		}
 
 		releaseAudioFocus();
-	}
-
-	public boolean isPlaying() {
-		try
-		{
-			if ( mediaPlayer != null ) {
-				boolean playing = mediaPlayer.isPlaying();
-				if ( playing ) {
-					Log.d( TAG, "isPlaying() = true" );
-				} else {
-					Log.d( TAG, "isPlaying() = false" );
-			}
-			return playing;
-		}
-			Log.d( TAG, "isPlaying() - NO MEDIA PLAYER" );
-		}
-		catch( IllegalStateException ise )
-		{
-			Log.d( TAG, "isPlaying(): Caught illegalStateException: " + ise.toString() );
-		}
-		return false;
+		schedulePlaybackState();
 	}
 
 	public void pauseMovie() {
@@ -202,6 +289,7 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 		catch( IllegalStateException ise ) {
 			Log.d( TAG, "pauseMovie(): Caught illegalStateException: " + ise.toString() );
 		}
+		schedulePlaybackState();
 	}
 
 	public void resumeMovie() {
@@ -210,101 +298,286 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 			if (mediaPlayer != null) {
 				Log.d(TAG, "movie started" );
 				mediaPlayer.start();
-				mediaPlayer.setVolume(1.0f, 1.0f);
+				mediaPlayer.setVolume(movieVolume, movieVolume);
 			}
 		}
 		catch( IllegalStateException ise ) {
 			Log.d( TAG, "resumeMovie(): Caught illegalStateException: " + ise.toString() );
 		}
+		schedulePlaybackState();
 	}
 
 	// called from native code for starting movie
-	public void seekToFromNative( final int seekPos ) {
-		Log.d( TAG, "seekToFromNative to " + seekPos );
+	public void seekToFromNative( final int seekPos, final int seekId ) {
+		Log.d( TAG, "seekToFromNative to " + seekPos + " as seek " + seekId );
 		try {
 			if (mediaPlayer != null) {
+				lastSeekId = seekId;
 				mediaPlayer.seekTo(seekPos);
 			}
 		}
 		catch( IllegalStateException ise ) {
 			Log.d( TAG, "seekToFromNative(): Caught illegalStateException: " + ise.toString() );
 		}
+		schedulePlaybackState();
 	}
 
-	// customize
-	public void seekToRelativeFromNative( final int relativePos ) {
-		Log.d( TAG, "seekToRelativeFromNative to " + relativePos );
-		try {
-			if (mediaPlayer != null) {
-				int curPos = mediaPlayer.getCurrentPosition();
-				int seekPos = curPos + relativePos;
-				if (seekPos < 0) seekPos = 0;
+	// called from native code once, every string resource as name, value pairs
+	// resolved for the current locale, so lookups don't need a call each
+	public String[] getStringTableFromNative() {
+		final Field[] fields = R.string.class.getFields();
+		final String[] table = new String[fields.length * 2];
+		int count = 0;
+		for ( Field field : fields ) {
+			try {
+				table[count + 1] = getResources().getString( field.getInt( null ) );
+				table[count] = field.getName();
+				count += 2;
+			} catch ( IllegalAccessException e ) {
+				Log.e( TAG, "getStringTableFromNative(): " + field.getName() + ": " + e.toString() );
+			}
+		}
+		return Arrays.copyOf( table, count );
+	}
 
-				int duration = mediaPlayer.getDuration();
-				if (duration != -1 && seekPos > duration) seekPos = duration;
+	// called from native code for preloading the next playlist movie
+	public void preloadMovieFromNative( final String pathName, final int generation, final int resumePos ) {
+		Log.d( TAG, "preloadMovieFromNative " + generation );
+		runOnUiThread( new Runnable() {
+			@Override
+			public void run() {
+				preloadMovie( pathName, generation, resumePos );
+			}
+		});
+	}
 
-				mediaPlayer.seekTo(seekPos);
+	public void promotePreloadFromNative( final int generation ) {
+		Log.d( TAG, "promotePreloadFromNative " + generation );
+		runOnUiThread( new Runnable() {
+			@Override
+			public void run() {
+				promotePreload( generation );
 			}
+		});
+	}
+
+	public void discardPreloadFromNative( final int generation ) {
+		Log.d( TAG, "discardPreloadFromNative " + generation );
+		runOnUiThread( new Runnable() {
+			@Override
+			public void run() {
+				if ( generation == preloadGeneration ) {
+					discardPreload();
+				}
+			}
+		});
+	}
+
+	static float playerVolume( final String pathName ) {
+		if ( pathName == null || !pathName.startsWith( "/" ) ) {
+			return 1.0f;
 		}
-		catch( IllegalStateException ise ) {
-			Log.d( TAG, "seekToFromNative(): Caught illegalStateException: " + ise.toString() );
-		}
+		final int dot = pathName.lastIndexOf( '.' );
+		final String base = ( dot > pathName.lastIndexOf( '/' ) ) ? pathName.substring( 0, dot ) : pathName;
+		return new File( base + AMBISONIC_SUFFIX ).exists() ? 0.0f : 1.0f;
 	}
 
-	// customize
-	public int getCurrentPositionFromNative() {
-		Log.d( TAG, "getCurrentPositionFromNative");
-		try {
-			if (mediaPlayer != null) {
-				return mediaPlayer.getCurrentPosition();
+	void preloadMovie( final String pathName, final int generation, final int resumePos ) {
+		discardPreload();
+
+		SurfaceTexture texture = nativePreparePreloadSurface( appPtr, generation );
+		if ( texture == null ) {
+			nativePreloadFailed( appPtr, generation );
+			return;
+		}
+		preloadGeneration = generation;
+		preloadPath = pathName;
+		preloadPrepared = false;
+		preloadTexture = texture;
+		preloadTexture.setOnFrameAvailableListener( this );
+		preloadSurface = new Surface( preloadTexture );
+
+		final MediaPlayer player = new MediaPlayer();
+		preloadPlayer = player;
+		player.setSurface( preloadSurface );
+		player.setOnPreparedListener( new MediaPlayer.OnPreparedListener() {
+			public void onPrepared( MediaPlayer mp ) {
+				if ( mp != preloadPlayer ) {
+					return;
+				}
+				if ( mp.getVideoWidth() == 0 ) {
+					// nothing to pre-roll without a video track
+					if ( resumePos > 0 ) {
+						mp.seekTo( resumePos );
+					}
+					preloadPrepared = true;
+					nativePreloadReady( appPtr, generation );
+					return;
+				}
+				// Pre-roll: play muted until the first frame reaches the surface,
+				// so the decoder has the first GOP when the player is promoted.
+				mp.setVolume( 0.0f, 0.0f );
+				if ( resumePos > 0 ) {
+					mp.seekTo( resumePos );
+				} else {
+					mp.start();
+				}
+			}
+		});
+		player.setOnSeekCompleteListener( new MediaPlayer.OnSeekCompleteListener() {
+			public void onSeekComplete( MediaPlayer mp ) {
+				if ( mp == preloadPlayer && !preloadPrepared ) {
+					mp.start();
+				}
+			}
+		});
+		player.setOnInfoListener( new MediaPlayer.OnInfoListener() {
+			public boolean onInfo( MediaPlayer mp, int what, int extra ) {
+				if ( mp != preloadPlayer || preloadPrepared || what != MediaPlayer.MEDIA_INFO_VIDEO_RENDERING_START ) {
+					return false;
+				}
+				// hold on the first frame until the promote
+				mp.pause();
+				preloadPrepared = true;
+				nativePreloadReady( appPtr, generation );
+				return true;
+			}
+		});
+		player.setOnErrorListener( new MediaPlayer.OnErrorListener() {
+			public boolean onError( MediaPlayer mp, int what, int extra ) {
+				Log.e( TAG, "preload MediaPlayer error - what : " + what + ", extra : " + extra );
+				if ( mp == preloadPlayer ) {
+					nativePreloadFailed( appPtr, generation );
+					discardPreload();
+				}
+				return true;
 			}
-			return -1;
+		});
+		try {
+			player.setDataSource( pathName );
+			player.prepareAsync();
+		}
+		catch( IOException t ) {
+			Log.e( TAG, "preload setDataSource failed: " + t.getMessage() );
+			nativePreloadFailed( appPtr, generation );
+			discardPreload();
 		}
 		catch( IllegalStateException ise ) {
-			Log.d( TAG, "getCurrentPositionFromNative(): Caught illegalStateException: " + ise.toString() );
-			return -1;
+			Log.e( TAG, "preload prepareAsync(): Caught illegalStateException: " + ise.toString() );
+			nativePreloadFailed( appPtr, generation );
+			discardPreload();
 		}
 	}
 
-	// customize
-	public int getDurationFromNative() {
-		Log.d( TAG, "getDurationFromNative");
-		try {
-			if (mediaPlayer != null) {
-				return mediaPlayer.getDuration();
+	void promotePreload( final int generation ) {
+		if ( preloadPlayer == null || !preloadPrepared || generation != preloadGeneration ) {
+			Log.e( TAG, "promotePreload: no prepared player for " + generation );
+			return;
+		}
+		movieVolume = playerVolume( preloadPath );
+
+		synchronized (this) {
+			if ( mediaPlayer != null ) {
+				mediaPlayer.release();
+			}
+			if ( movieSurface != null ) {
+				movieSurface.release();
 			}
-			return -1;
+			mediaPlayer = preloadPlayer;
+			movieTexture = preloadTexture;
+			movieSurface = preloadSurface;
+			preloadPlayer = null;
+			preloadTexture = null;
+			preloadSurface = null;
+		}
+
+		mediaPlayer.setOnPreparedListener( null );
+		mediaPlayer.setOnInfoListener( null );
+		mediaPlayer.setOnErrorListener( this );
+		mediaPlayer.setOnVideoSizeChangedListener( this );
+		mediaPlayer.setOnCompletionListener( this );
+		mediaPlayer.setOnBufferingUpdateListener( this );
+		mediaPlayer.setOnSeekCompleteListener( this );
+		mediaPlayer.setLooping( false );
+		try {
+			mediaPlayer.start();
+			mediaPlayer.setVolume( movieVolume, movieVolume );
 		}
 		catch( IllegalStateException ise ) {
-			Log.d( TAG, "getDurationFromNative(): Caught illegalStateException: " + ise.toString() );
-			return -1;
+			Log.d( TAG, "promotePreload start(): Caught illegalStateException: " + ise.toString() );
+		}
+
+		final int width = mediaPlayer.getVideoWidth();
+		final int height = mediaPlayer.getVideoHeight();
+		if ( width != 0 && height != 0 ) {
+			nativeSetVideoSize( appPtr, width, height );
+		}
+
+		Editor edit = getPreferences( MODE_PRIVATE ).edit();
+		edit.putString( "currentMovie", preloadPath );
+		edit.apply();
+		preloadPath = null;
+
+		bufferedPercent = 0;
+		schedulePlaybackState();
+	}
+
+	void discardPreload() {
+		synchronized (this) {
+			if ( preloadPlayer != null ) {
+				preloadPlayer.release();
+				preloadPlayer = null;
+			}
+			if ( preloadSurface != null ) {
+				preloadSurface.release();
+				preloadSurface = null;
+			}
+			// the texture itself belongs to the native pool
+			preloadTexture = null;
+			preloadPath = null;
+			preloadPrepared = false;
 		}
 	}
 
 	// called from native code for starting movie
-	public void startMovieFromNative( final String pathName ) {
+	public void startMovieFromNative( final String pathName, final int resumePos ) {
 		Log.d( TAG, "startMovieFromNative" );
     	runOnUiThread( new Thread() {
 			@Override
     		public void run() {
 				Log.d( TAG, "startMovieFromNative" );
-			 	startMovie( pathName );
+			 	startMovie( pathName, resumePos );
     		}
     	});
 	}
 
-	public void startMovie(String pathName) {
+	public void startMovie(final String pathName, final int resumePos) {
 		Log.v(TAG, "startMovie " + pathName);
 		
 		synchronized (this) 
 		{
+			// Take one of the SurfaceTextures the native code keeps ready.
+			// This doesn't wait for the VR thread, if none is ready yet
+			// try again shortly.
+			SurfaceTexture texture = nativePrepareNewVideo(appPtr);
+			if (texture == null) {
+				Log.v(TAG, "startMovie: no SurfaceTexture ready, retrying");
+				playbackStateHandler.postDelayed( new Runnable() {
+					@Override
+					public void run() {
+						startMovie( pathName, resumePos );
+					}
+				}, SURFACE_RETRY_DELAY_MS );
+				return;
+			}
+
 			// Request audio focus
 			requestAudioFocus();
-		
-			// Have native code pause any playing movie,
-			// allocate a new external texture,
-			// and create a surfaceTexture with it.
-			movieTexture = nativePrepareNewVideo(appPtr);
+
+			if (movieSurface != null) {
+				movieSurface.release();
+			}
+			movieTexture = texture;
 			movieTexture.setOnFrameAvailableListener(this);
 			movieSurface = new Surface(movieTexture);
 
@@ -319,6 +592,8 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 			}
 			mediaPlayer.setOnVideoSizeChangedListener(this);
 			mediaPlayer.setOnCompletionListener(this);
+			mediaPlayer.setOnBufferingUpdateListener(this);
+			mediaPlayer.setOnSeekCompleteListener(this);
 			mediaPlayer.setSurface(movieSurface);
 
 			try {
@@ -330,18 +605,20 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 
 			try {
 				Log.v(TAG, "mediaPlayer.prepare");
+				final long prepareStart = SystemClock.elapsedRealtime();
 				mediaPlayer.prepare();
+				// files with moov at the end are slow here until the native faststart task rewrites them
+				Log.v(TAG, "mediaPlayer.prepare took " + ( SystemClock.elapsedRealtime() - prepareStart ) + " ms");
 			} catch (IOException t) {
 				Log.e(TAG, "mediaPlayer.prepare failed:" + t.getMessage());
 			}
 			Log.v(TAG, "mediaPlayer.start");
 
-			// If this movie has a saved position, seek there before starting
+			// If this movie has a position in the native resume journal, seek there before starting
 			// This seems to make movie switching crashier.
-			final int seekPos = getPreferences(MODE_PRIVATE).getInt(pathName + "_pos", 0);
-			if (seekPos > 0) {
+			if (resumePos > 0) {
 				try {
-					mediaPlayer.seekTo(seekPos);
+					mediaPlayer.seekTo(resumePos);
 				}
 				catch( IllegalStateException ise ) {
 					Log.d( TAG, "mediaPlayer.seekTo(): Caught illegalStateException: " + ise.toString() );
@@ -357,14 +634,18 @@ public class MainActivity extends VrActivity implements SurfaceHolder.Callback,
 				Log.d( TAG, "mediaPlayer.start(): Caught illegalStateException: " + ise.toString() );
 			}
 			
-			mediaPlayer.setVolume(1.0f, 1.0f);
+			movieVolume = playerVolume( pathName );
+			mediaPlayer.setVolume(movieVolume, movieVolume);
 
 			// Save the current movie now that it was successfully started
 			Editor edit = getPreferences(MODE_PRIVATE).edit();
 			edit.putString("currentMovie", pathName);
-			edit.commit();
+			edit.apply();
 		}
 
+		bufferedPercent = 0;
+		schedulePlaybackState();
+
 		Log.v(TAG, "returning");
 	}
 }
@@ -0,0 +1,284 @@
+/************************************************************************************
+
+Filename    :   CencMp4.h
+Content     :   Writes small 'cenc' protected fragmented MP4 files for the tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_CencMp4_h )
+#define OVR_CencMp4_h
+
+#include <string.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Mp4Builder.h"
+#include "CommonEncryption.h"
+
+namespace OVR {
+
+//==============================================================
+// CencMp4
+//
+// Track 1 is 'cenc' protected video, track 2 clear audio. Each fragment
+// has a traf for both; the first fragment of every pair describes its
+// samples with senc, the second with saiz / saio and an absolute base data
+// offset. Every video sample keeps a 5 byte clear header, as NAL units do.
+// The offsets of the samples in the file are kept to check them against.
+class CencMp4
+{
+public:
+	static const int	VIDEO_TRACK = 1;
+	static const int	AUDIO_TRACK = 2;
+	static const int	CLEAR_HEADER = 5;
+
+	struct Sample
+	{
+		int				Offset;
+		int				Track;
+		Array< UByte >	Clear;
+	};
+
+	Mp4Builder			File;
+	Array< Sample >		Samples;
+
+	CencMp4( const UByte kid[16], const UByte key[16] )
+		: Seed( 1 )
+	{
+		memcpy( Kid, kid, 16 );
+		Aes.SetKey( key );
+	}
+
+	void				WriteHeader()
+	{
+		File.Open( "ftyp" );
+		File.Chars( "iso6" );
+		File.U32( 0 );
+		File.Chars( "iso6dash" );
+		File.Close();
+
+		File.Open( "moov" );
+		File.OpenFull( "mvhd" );
+		File.Zeros( 96 );
+		File.Close();
+		Track( VIDEO_TRACK, "vide" );
+		Track( AUDIO_TRACK, "soun" );
+		File.OpenFull( "pssh" );
+		File.U32( 0x1077efec );		// the W3C common system id
+		File.U32( 0xc0b24d02 );
+		File.U32( 0xace33c1e );
+		File.U32( 0x52e2fb4b );
+		File.U32( 0 );
+		File.Close();
+		File.Close();
+	}
+
+	void				WriteFragment( const int index, const int numSamples )
+	{
+		const bool senc = ( index & 1 ) == 0;
+		const int moofStart = File.GetSize();
+		Array< UByte > video[2];
+		Array< int > sizes[2];
+		for ( int track = 0; track < 2; track++ )
+		{
+			for ( int i = 0; i < numSamples; i++ )
+			{
+				const int size = ( track == 0 ) ? 100 + ( ( index * 7 + i ) * 37 ) % 900 : 64 + i % 64;
+				sizes[track].PushBack( size );
+				for ( int b = 0; b < size; b++ )
+				{
+					Seed = Seed * 1664525u + 1013904223u;
+					video[track].PushBack( static_cast< UByte >( Seed >> 24 ) );
+				}
+			}
+		}
+		const int auxEntry = 8 + 2 + 6;
+
+		File.Open( "moof" );
+		File.OpenFull( "mfhd" );
+		File.U32( index + 1 );
+		File.Close();
+		int dataOffsetFields[2];
+		int saioField = 0;
+		for ( int track = 0; track < 2; track++ )
+		{
+			File.Open( "traf" );
+			File.Open( "tfhd" );
+			const bool absolute = !senc && track == 0;
+			File.U32( absolute ? 0x000001 : 0x020000 );		// base-data-offset, or default-base-is-moof
+			File.U32( track + 1 );
+			if ( absolute )
+			{
+				File.U64( moofStart );
+			}
+			File.Close();
+			File.Open( "trun" );
+			File.U32( 0x000201 );		// data offset and sample sizes
+			File.U32( numSamples );
+			dataOffsetFields[track] = File.GetSize();
+			File.U32( 0 );
+			for ( int i = 0; i < numSamples; i++ )
+			{
+				File.U32( sizes[track][i] );
+			}
+			File.Close();
+			if ( track == 0 && senc )
+			{
+				File.Open( "senc" );
+				File.U32( 0x000002 );
+				File.U32( numSamples );
+				for ( int i = 0; i < numSamples; i++ )
+				{
+					AuxEntry( index, i, sizes[0][i] );
+				}
+				File.Close();
+			}
+			else if ( track == 0 )
+			{
+				File.Open( "saiz" );
+				File.U32( 0 );
+				File.U8( auxEntry );
+				File.U32( numSamples );
+				File.Close();
+				File.Open( "saio" );
+				File.U32( 0 );
+				File.U32( 1 );
+				saioField = File.GetSize();
+				File.U32( 0 );
+				File.Close();
+			}
+			File.Close();
+		}
+		File.Close();
+
+		// the aux entries of a saiz fragment come first in mdat
+		File.Open( "mdat" );
+		if ( !senc )
+		{
+			File.Patch32( saioField, static_cast< UInt32 >( File.GetSize() - moofStart ) );
+			for ( int i = 0; i < numSamples; i++ )
+			{
+				AuxEntry( index, i, sizes[0][i] );
+			}
+		}
+		int pos[2] = { 0, 0 };
+		for ( int track = 0; track < 2; track++ )
+		{
+			File.Patch32( dataOffsetFields[track], static_cast< UInt32 >( File.GetSize() - moofStart ) );
+			for ( int i = 0; i < numSamples; i++ )
+			{
+				Sample sample;
+				sample.Offset = File.GetSize();
+				sample.Track = track + 1;
+				sample.Clear.Resize( sizes[track][i] );
+				memcpy( &sample.Clear[0], &video[track][pos[track]], sizes[track][i] );
+				pos[track] += sizes[track][i];
+				Array< UByte > stored( sample.Clear );
+				if ( track == 0 )
+				{
+					UByte counter[16];
+					memset( counter, 0, sizeof( counter ) );
+					MakeIv( index, i, counter );
+					int blockOffset = 0;
+					Aes.Ctr( &stored[CLEAR_HEADER], stored.GetSizeI() - CLEAR_HEADER, counter, blockOffset );
+				}
+				for ( int b = 0; b < stored.GetSizeI(); b++ )
+				{
+					File.U8( stored[b] );
+				}
+				Samples.PushBack( sample );
+			}
+		}
+		File.Close();
+	}
+
+private:
+	UByte				Kid[16];
+	Aes128				Aes;
+	UInt32				Seed;
+
+	void				Track( const int trackId, const char * handler )
+	{
+		const bool video = trackId == VIDEO_TRACK;
+		File.Open( "trak" );
+		File.OpenFull( "tkhd" );
+		File.U32( 0 );			// creation_time
+		File.U32( 0 );			// modification_time
+		File.U32( trackId );
+		File.Zeros( 68 );
+		File.Close();
+		File.OpenMedia( handler, 90000, 0 );
+		File.Open( "minf" );
+		File.Open( "stbl" );
+		File.OpenFull( "stsd" );
+		File.U32( 1 );
+		File.Open( video ? "encv" : "mp4a" );
+		File.Zeros( video ? 78 : 28 );
+		if ( video )
+		{
+			File.Open( "avcC" );
+			File.U8( 1 );
+			File.Close();
+			File.Open( "sinf" );
+			File.Open( "frma" );
+			File.Chars( "avc1" );
+			File.Close();
+			File.OpenFull( "schm" );
+			File.Chars( "cenc" );
+			File.U32( 0x00010000 );
+			File.Close();
+			File.Open( "schi" );
+			File.OpenFull( "tenc" );
+			File.U8( 0 );
+			File.U8( 0 );
+			File.U8( 1 );			// protected
+			File.U8( 8 );			// per sample IV size
+			for ( int i = 0; i < 16; i++ )
+			{
+				File.U8( Kid[i] );
+			}
+			File.Close();
+			File.Close();
+			File.Close();
+		}
+		File.Close();
+		File.Close();
+		File.Close();
+		File.Close();
+		File.Close();
+		File.Close();
+	}
+
+	static void			MakeIv( const int fragment, const int sample, UByte iv[8] )
+	{
+		for ( int i = 0; i < 8; i++ )
+		{
+			iv[i] = static_cast< UByte >( fragment * 31 + sample * 7 + i );
+		}
+	}
+
+	void				AuxEntry( const int fragment, const int sample, const int size )
+	{
+		UByte iv[8];
+		MakeIv( fragment, sample, iv );
+		for ( int i = 0; i < 8; i++ )
+		{
+			File.U8( iv[i] );
+		}
+		File.U16( 1 );
+		File.U16( CLEAR_HEADER );
+		File.U32( size - CLEAR_HEADER );
+	}
+};
+
+}	// namespace OVR
+
+#endif // OVR_CencMp4_h
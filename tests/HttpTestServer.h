@@ -0,0 +1,618 @@
+/************************************************************************************
+
+Filename    :   HttpTestServer.h
+Content     :   Loopback HTTP/1.1 server standing in for CDNs and shares in the tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HttpTestServer_h )
+#define OVR_HttpTestServer_h
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+//==============================================================
+// HttpTestServer
+//
+// Serves files from memory with ranges, keep-alive, pipelining and ETags,
+// on a thread per connection. A handler can answer anything else, e.g.
+// PROPFIND or generated playlists. Latency, a per-connection byte rate and
+// connections cut mid body can be injected to test the clients against a
+// bad network.
+class HttpTestServer
+{
+public:
+	struct Request
+	{
+		String			Method;
+		String			Path;
+		String			Headers;		// "Name: value\r\n" lines
+		Array< UByte >	Body;
+
+		// The value of a header, empty when absent.
+		String			GetHeader( const char * name ) const
+		{
+			const char * line = Headers.ToCStr();
+			const size_t nameLength = strlen( name );
+			while ( *line != 0 )
+			{
+				const char * end = strstr( line, "\r\n" );
+				if ( end == NULL )
+				{
+					break;
+				}
+				if ( strncasecmp( line, name, nameLength ) == 0 && line[nameLength] == ':' )
+				{
+					const char * value = line + nameLength + 1;
+					while ( *value == ' ' )
+					{
+						value++;
+					}
+					return String( value, end - value );
+				}
+				line = end + 2;
+			}
+			return String();
+		}
+	};
+
+	struct Reply
+	{
+		int				Status;
+		String			ContentType;
+		String			Headers;		// extra "Name: value\r\n" lines
+		Array< UByte >	Body;
+
+						Reply() : Status( 200 ) {}
+
+		void			SetBody( const char * text )
+		{
+			Body.Resize( static_cast< int >( strlen( text ) ) );
+			if ( Body.GetSizeI() > 0 )
+			{
+				memcpy( &Body[0], text, Body.GetSize() );
+			}
+		}
+	};
+
+	// Returns false to fall through to the files.
+	typedef bool		( *Handler )( void * user, const Request & request, Reply & outReply );
+
+						HttpTestServer()
+							: ListenSocket( -1 )
+							, Port( 0 )
+							, Exiting( false )
+							, RequestHandler( NULL )
+							, HandlerUser( NULL )
+							, LatencyMs( 0 )
+							, BytesPerSecond( 0 )
+							, DropEvery( 0 )
+							, DropAfterBytes( 0 )
+							, Requests( 0 )
+							, Connections( 0 )
+							, BodyBytes( 0 )
+							, Dropped( 0 )
+						{
+							pthread_mutex_init( &Mutex, NULL );
+						}
+
+						~HttpTestServer()
+						{
+							Stop();
+							pthread_mutex_destroy( &Mutex );
+						}
+
+	bool				Start()
+	{
+		ListenSocket = socket( AF_INET, SOCK_STREAM, 0 );
+		if ( ListenSocket < 0 )
+		{
+			return false;
+		}
+		const int reuse = 1;
+		setsockopt( ListenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof( reuse ) );
+		struct sockaddr_in address;
+		memset( &address, 0, sizeof( address ) );
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+		socklen_t length = sizeof( address );
+		if ( bind( ListenSocket, ( struct sockaddr * )&address, sizeof( address ) ) != 0 ||
+			listen( ListenSocket, 64 ) != 0 ||
+			getsockname( ListenSocket, ( struct sockaddr * )&address, &length ) != 0 )
+		{
+			close( ListenSocket );
+			ListenSocket = -1;
+			return false;
+		}
+		Port = ntohs( address.sin_port );
+		Exiting = false;
+		if ( pthread_create( &AcceptThread, NULL, AcceptThreadFunction, this ) != 0 )
+		{
+			close( ListenSocket );
+			ListenSocket = -1;
+			return false;
+		}
+		return true;
+	}
+
+	void				Stop()
+	{
+		if ( ListenSocket < 0 )
+		{
+			return;
+		}
+		Exiting = true;
+		pthread_join( AcceptThread, NULL );
+		close( ListenSocket );
+		ListenSocket = -1;
+		for ( int i = 0; i < ClientThreads.GetSizeI(); i++ )
+		{
+			pthread_join( ClientThreads[i], NULL );
+		}
+		ClientThreads.Clear();
+	}
+
+	int					GetPort() const		{ return Port; }
+
+	String				GetUrl( const char * path ) const
+	{
+		char url[64];
+		snprintf( url, sizeof( url ), "http://127.0.0.1:%i", Port );
+		return String( url ) + path;
+	}
+
+	void				AddFile( const char * path, const void * data, const int size,
+							const char * contentType = "application/octet-stream", const char * etag = NULL )
+	{
+		pthread_mutex_lock( &Mutex );
+		int index = FindFile( path );
+		if ( index < 0 )
+		{
+			index = Files.GetSizeI();
+			Files.PushBack( File() );
+		}
+		File & file = Files[index];
+		file.Path = path;
+		file.ContentType = contentType;
+		file.ETag = ( etag != NULL ) ? etag : "";
+		file.Data.Resize( size );
+		if ( size > 0 )
+		{
+			memcpy( &file.Data[0], data, size );
+		}
+		pthread_mutex_unlock( &Mutex );
+	}
+
+	void				RemoveFile( const char * path )
+	{
+		pthread_mutex_lock( &Mutex );
+		const int index = FindFile( path );
+		if ( index >= 0 )
+		{
+			Files.RemoveAt( index );
+		}
+		pthread_mutex_unlock( &Mutex );
+	}
+
+	void				SetHandler( Handler handler, void * user )	{ RequestHandler = handler; HandlerUser = user; }
+
+	// Delay before each response header.
+	void				SetLatencyMs( const int ms )				{ LatencyMs = ms; }
+	// Body rate of each connection, 0 for as fast as possible.
+	void				SetBytesPerSecond( const SInt64 rate )		{ BytesPerSecond = rate; }
+	// Every nth response body is cut off after afterBytes, and its connection closed.
+	void				SetDropEvery( const int n, const SInt64 afterBytes )	{ DropEvery = n; DropAfterBytes = afterBytes; }
+
+	int					GetRequests() const			{ return __atomic_load_n( &Requests, __ATOMIC_SEQ_CST ); }
+	int					GetConnections() const		{ return __atomic_load_n( &Connections, __ATOMIC_SEQ_CST ); }
+	SInt64				GetBodyBytes() const		{ return __atomic_load_n( &BodyBytes, __ATOMIC_SEQ_CST ); }
+	int					GetDropped() const			{ return __atomic_load_n( &Dropped, __ATOMIC_SEQ_CST ); }
+
+	// Every "METHOD path" seen, in order.
+	void				GetLog( Array< String > & out )
+	{
+		pthread_mutex_lock( &Mutex );
+		out = Log;
+		pthread_mutex_unlock( &Mutex );
+	}
+
+	void				ResetCounters()
+	{
+		pthread_mutex_lock( &Mutex );
+		Requests = 0;
+		Connections = 0;
+		BodyBytes = 0;
+		Dropped = 0;
+		Log.Clear();
+		pthread_mutex_unlock( &Mutex );
+	}
+
+private:
+	struct File
+	{
+		String			Path;
+		String			ContentType;
+		String			ETag;
+		Array< UByte >	Data;
+	};
+
+	struct ClientParms
+	{
+		HttpTestServer *	Server;
+		int					Socket;
+	};
+
+	int					ListenSocket;
+	int					Port;
+	pthread_t			AcceptThread;
+	Array< pthread_t >	ClientThreads;
+	volatile bool		Exiting;
+	pthread_mutex_t		Mutex;
+	Array< File >		Files;
+	Array< String >		Log;
+
+	Handler				RequestHandler;
+	void *				HandlerUser;
+	volatile int		LatencyMs;
+	volatile SInt64		BytesPerSecond;
+	volatile int		DropEvery;
+	volatile SInt64		DropAfterBytes;
+
+	int					Requests;
+	int					Connections;
+	SInt64				BodyBytes;
+	int					Dropped;
+
+	int					FindFile( const char * path ) const
+	{
+		for ( int i = 0; i < Files.GetSizeI(); i++ )
+		{
+			if ( strcmp( Files[i].Path.ToCStr(), path ) == 0 )
+			{
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	static double		GetSeconds()
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_MONOTONIC, &ts );
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+	}
+
+	static void *		AcceptThreadFunction( void * param )
+	{
+		static_cast< HttpTestServer * >( param )->AcceptLoop();
+		return NULL;
+	}
+
+	static void *		ClientThreadFunction( void * param )
+	{
+		ClientParms * parms = static_cast< ClientParms * >( param );
+		parms->Server->ServeClient( parms->Socket );
+		close( parms->Socket );
+		delete parms;
+		return NULL;
+	}
+
+	void				AcceptLoop()
+	{
+		while ( !Exiting )
+		{
+			struct pollfd fd;
+			fd.fd = ListenSocket;
+			fd.events = POLLIN;
+			if ( poll( &fd, 1, 20 ) <= 0 )
+			{
+				continue;
+			}
+			const int socket = accept( ListenSocket, NULL, NULL );
+			if ( socket < 0 )
+			{
+				continue;
+			}
+			__atomic_add_fetch( &Connections, 1, __ATOMIC_SEQ_CST );
+			ClientParms * parms = new ClientParms;
+			parms->Server = this;
+			parms->Socket = socket;
+			pthread_t thread;
+			if ( pthread_create( &thread, NULL, ClientThreadFunction, parms ) != 0 )
+			{
+				close( socket );
+				delete parms;
+				continue;
+			}
+			ClientThreads.PushBack( thread );
+		}
+	}
+
+	// Waits for data, giving up when the server stops.
+	bool				WaitReadable( const int socket ) const
+	{
+		while ( !Exiting )
+		{
+			struct pollfd fd;
+			fd.fd = socket;
+			fd.events = POLLIN;
+			const int ready = poll( &fd, 1, 20 );
+			if ( ready > 0 )
+			{
+				return true;
+			}
+			if ( ready < 0 && errno != EINTR )
+			{
+				return false;
+			}
+		}
+		return false;
+	}
+
+	bool				SendAll( const int socket, const void * data, const int length ) const
+	{
+		const char * p = static_cast< const char * >( data );
+		for ( int sent = 0; sent < length; )
+		{
+			const ssize_t n = send( socket, p + sent, length - sent, MSG_NOSIGNAL );
+			if ( n < 0 && errno == EINTR )
+			{
+				continue;
+			}
+			if ( n <= 0 )
+			{
+				return false;
+			}
+			sent += static_cast< int >( n );
+		}
+		return true;
+	}
+
+	void				ServeClient( const int socket )
+	{
+		Array< char > buffer;
+		for ( ;; )
+		{
+			// the header, then the body if it has a length
+			int headerEnd = -1;
+			for ( ;; )
+			{
+				buffer.PushBack( 0 );
+				const char * end = strstr( &buffer[0], "\r\n\r\n" );
+				buffer.PopBack();
+				if ( end != NULL )
+				{
+					headerEnd = static_cast< int >( end - &buffer[0] ) + 4;
+					break;
+				}
+				if ( !ReadMore( socket, buffer ) )
+				{
+					return;
+				}
+			}
+			Request request;
+			buffer.PushBack( 0 );
+			const char * text = &buffer[0];
+			const char * space = strchr( text, ' ' );
+			const char * space2 = ( space != NULL ) ? strchr( space + 1, ' ' ) : NULL;
+			const char * lineEnd = strstr( text, "\r\n" );
+			if ( space == NULL || space2 == NULL || space2 > lineEnd )
+			{
+				return;
+			}
+			request.Method = String( text, space - text );
+			request.Path = String( space + 1, space2 - space - 1 );
+			request.Headers = String( lineEnd + 2, text + headerEnd - 2 - ( lineEnd + 2 ) );
+			buffer.PopBack();
+
+			const int bodyLength = atoi( request.GetHeader( "Content-Length" ).ToCStr() );
+			while ( buffer.GetSizeI() < headerEnd + bodyLength )
+			{
+				if ( !ReadMore( socket, buffer ) )
+				{
+					return;
+				}
+			}
+			request.Body.Resize( bodyLength );
+			if ( bodyLength > 0 )
+			{
+				memcpy( &request.Body[0], &buffer[headerEnd], bodyLength );
+			}
+			buffer.RemoveMultipleAt( 0, headerEnd + bodyLength );
+
+			if ( !Respond( socket, request ) )
+			{
+				return;
+			}
+		}
+	}
+
+	bool				ReadMore( const int socket, Array< char > & buffer ) const
+	{
+		if ( !WaitReadable( socket ) )
+		{
+			return false;
+		}
+		char data[16 * 1024];
+		const ssize_t n = recv( socket, data, sizeof( data ), 0 );
+		if ( n <= 0 )
+		{
+			return false;
+		}
+		const int at = buffer.GetSizeI();
+		buffer.Resize( at + static_cast< int >( n ) );
+		memcpy( &buffer[at], data, n );
+		return true;
+	}
+
+	bool				Respond( const int socket, const Request & request )
+	{
+		const int number = __atomic_add_fetch( &Requests, 1, __ATOMIC_SEQ_CST );
+		pthread_mutex_lock( &Mutex );
+		Log.PushBack( request.Method + " " + request.Path );
+		pthread_mutex_unlock( &Mutex );
+		if ( LatencyMs > 0 )
+		{
+			usleep( LatencyMs * 1000 );
+		}
+
+		Reply reply;
+		const bool head = request.Method == "HEAD";
+		const bool closeAfter = strcasecmp( request.GetHeader( "Connection" ).ToCStr(), "close" ) == 0;
+		SInt64 first = 0;
+		SInt64 last = -1;
+		bool ranged = false;
+		if ( RequestHandler == NULL || !RequestHandler( HandlerUser, request, reply ) )
+		{
+			pthread_mutex_lock( &Mutex );
+			const int index = FindFile( request.Path.ToCStr() );
+			if ( index < 0 || ( request.Method != "GET" && !head ) )
+			{
+				reply.Status = ( index < 0 ) ? 404 : 405;
+			}
+			else if ( !Files[index].ETag.IsEmpty() && request.GetHeader( "If-None-Match" ) == Files[index].ETag )
+			{
+				reply.Status = 304;
+				reply.Headers = String( "ETag: " ) + Files[index].ETag + "\r\n";
+			}
+			else
+			{
+				const File & file = Files[index];
+				reply.ContentType = file.ContentType;
+				if ( !file.ETag.IsEmpty() )
+				{
+					reply.Headers = String( "ETag: " ) + file.ETag + "\r\n";
+				}
+				const SInt64 length = file.Data.GetSizeI();
+				last = length - 1;
+				const String range = request.GetHeader( "Range" );
+				if ( strncmp( range.ToCStr(), "bytes=", 6 ) == 0 )
+				{
+					ranged = true;
+					const char * spec = range.ToCStr() + 6;
+					if ( spec[0] == '-' )
+					{
+						first = length - atoll( spec + 1 );
+						first = ( first < 0 ) ? 0 : first;
+					}
+					else
+					{
+						first = atoll( spec );
+						const char * dash = strchr( spec, '-' );
+						if ( dash != NULL && dash[1] >= '0' && dash[1] <= '9' )
+						{
+							last = atoll( dash + 1 );
+							last = ( last > length - 1 ) ? length - 1 : last;
+						}
+					}
+				}
+				if ( ranged && ( first >= length || first > last ) )
+				{
+					reply.Status = 416;
+					char header[64];
+					snprintf( header, sizeof( header ), "Content-Range: bytes */%lld\r\n", ( long long )length );
+					reply.Headers += header;
+				}
+				else
+				{
+					reply.Status = ranged ? 206 : 200;
+					if ( ranged )
+					{
+						char header[128];
+						snprintf( header, sizeof( header ), "Content-Range: bytes %lld-%lld/%lld\r\n",
+							( long long )first, ( long long )last, ( long long )length );
+						reply.Headers += header;
+					}
+					reply.Body.Resize( static_cast< int >( last - first + 1 ) );
+					if ( last >= first )
+					{
+						memcpy( &reply.Body[0], &file.Data[static_cast< int >( first )], reply.Body.GetSize() );
+					}
+				}
+			}
+			pthread_mutex_unlock( &Mutex );
+		}
+
+		const char * reason = ( reply.Status == 200 ) ? "OK" : ( reply.Status == 206 ) ? "Partial Content" :
+			( reply.Status == 207 ) ? "Multi-Status" : ( reply.Status == 304 ) ? "Not Modified" :
+			( reply.Status == 404 ) ? "Not Found" : ( reply.Status == 416 ) ? "Range Not Satisfiable" : "Status";
+		char header[512];
+		snprintf( header, sizeof( header ), "HTTP/1.1 %i %s\r\nContent-Length: %i\r\n%s%s%s%s%s\r\n",
+			reply.Status, reason, reply.Body.GetSizeI(),
+			reply.ContentType.IsEmpty() ? "" : "Content-Type: ", reply.ContentType.ToCStr(), reply.ContentType.IsEmpty() ? "" : "\r\n",
+			reply.Status == 206 || reply.Status == 200 ? "Accept-Ranges: bytes\r\n" : "",
+			closeAfter ? "Connection: close\r\n" : "" );
+		const String fullHeader = String( header, strlen( header ) - 2 ) + reply.Headers + "\r\n";
+		if ( !SendAll( socket, fullHeader.ToCStr(), static_cast< int >( fullHeader.GetSize() ) ) )
+		{
+			return false;
+		}
+		if ( head || reply.Body.GetSizeI() == 0 )
+		{
+			return !closeAfter;
+		}
+
+		// the body in pieces, at the connection's rate, maybe cut short
+		const bool drop = DropEvery > 0 && ( number % DropEvery ) == 0;
+		const int limit = drop ? static_cast< int >( ( DropAfterBytes < reply.Body.GetSizeI() ) ? DropAfterBytes : reply.Body.GetSizeI() - 1 ) : reply.Body.GetSizeI();
+		const double start = GetSeconds();
+		const SInt64 rate = BytesPerSecond;
+		for ( int sent = 0; sent < limit; )
+		{
+			const int piece = ( limit - sent < 16 * 1024 ) ? limit - sent : 16 * 1024;
+			if ( !SendAll( socket, &reply.Body[sent], piece ) )
+			{
+				return false;
+			}
+			sent += piece;
+			__atomic_add_fetch( &BodyBytes, piece, __ATOMIC_SEQ_CST );
+			if ( rate > 0 )
+			{
+				const double due = start + static_cast< double >( sent ) / rate;
+				const double now = GetSeconds();
+				if ( due > now )
+				{
+					usleep( static_cast< useconds_t >( ( due - now ) * 1e6 ) );
+				}
+			}
+			if ( Exiting )
+			{
+				return false;
+			}
+		}
+		if ( drop )
+		{
+			__atomic_add_fetch( &Dropped, 1, __ATOMIC_SEQ_CST );
+			return false;
+		}
+		return !closeAfter;
+	}
+};
+
+}	// namespace OVR
+
+#endif // OVR_HttpTestServer_h
@@ -0,0 +1,129 @@
+/************************************************************************************
+
+Filename    :   Mp4Builder.h
+Content     :   Writes small MP4 box trees for the container tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_Mp4Builder_h )
+#define OVR_Mp4Builder_h
+
+#include <stdio.h>
+
+#include "Kernel/OVR_Types.h"
+#include "Kernel/OVR_Array.h"
+
+namespace OVR {
+
+//==============================================================
+// Mp4Builder
+//
+// Boxes are opened and closed like scopes, the sizes are patched in on
+// Close(). Only as much of each box is written as the modules read.
+class Mp4Builder
+{
+public:
+	void	Open( const char * type )
+	{
+		Starts.PushBack( Bytes.GetSizeI() );
+		U32( 0 );
+		Chars( type );
+	}
+
+	void	Close()
+	{
+		const int start = Starts.Back();
+		Starts.PopBack();
+		Patch32( start, static_cast< UInt32 >( Bytes.GetSizeI() - start ) );
+	}
+
+	// Version and flags of a full box.
+	void	OpenFull( const char * type, const UByte version = 0 )
+	{
+		Open( type );
+		U32( static_cast< UInt32 >( version ) << 24 );
+	}
+
+	void	U8( const UByte v )		{ Bytes.PushBack( v ); }
+	void	U16( const UInt16 v )	{ U8( static_cast< UByte >( v >> 8 ) ); U8( static_cast< UByte >( v ) ); }
+	void	U32( const UInt32 v )	{ U16( static_cast< UInt16 >( v >> 16 ) ); U16( static_cast< UInt16 >( v ) ); }
+	void	U64( const UInt64 v )	{ U32( static_cast< UInt32 >( v >> 32 ) ); U32( static_cast< UInt32 >( v ) ); }
+	void	Chars( const char * s )	{ for ( ; *s != '\0'; s++ ) { U8( static_cast< UByte >( *s ) ); } }
+	void	Zeros( const int count )	{ for ( int i = 0; i < count; i++ ) { U8( 0 ); } }
+
+	void	Patch32( const int offset, const UInt32 v )
+	{
+		Bytes[offset + 0] = static_cast< UByte >( v >> 24 );
+		Bytes[offset + 1] = static_cast< UByte >( v >> 16 );
+		Bytes[offset + 2] = static_cast< UByte >( v >> 8 );
+		Bytes[offset + 3] = static_cast< UByte >( v );
+	}
+
+	int		GetSize() const			{ return Bytes.GetSizeI(); }
+	const UByte * GetData() const	{ return Bytes.GetSizeI() > 0 ? &Bytes[0] : NULL; }
+
+	bool	WriteFile( const char * path ) const
+	{
+		FILE * f = fopen( path, "wb" );
+		if ( f == NULL )
+		{
+			return false;
+		}
+		const bool written = fwrite( GetData(), 1, Bytes.GetSize(), f ) == Bytes.GetSize();
+		return fclose( f ) == 0 && written;
+	}
+
+	// mdia with mdhd and hdlr; the caller adds minf and closes mdia.
+	void	OpenMedia( const char * handler, const UInt32 timescale, const UInt32 duration )
+	{
+		Open( "mdia" );
+		OpenFull( "mdhd" );
+		U32( 0 );			// creation_time
+		U32( 0 );			// modification_time
+		U32( timescale );
+		U32( duration );
+		U32( 0 );			// language, pre_defined
+		Close();
+		OpenFull( "hdlr" );
+		U32( 0 );			// pre_defined
+		Chars( handler );
+		Zeros( 12 );
+		U8( 0 );			// empty name
+		Close();
+	}
+
+	// stts with a single run and stss, inside stbl.
+	void	SampleTables( const UInt32 sampleCount, const UInt32 sampleDelta, const Array< UInt32 > & syncSamples )
+	{
+		Open( "stbl" );
+		OpenFull( "stts" );
+		U32( 1 );
+		U32( sampleCount );
+		U32( sampleDelta );
+		Close();
+		OpenFull( "stss" );
+		U32( syncSamples.GetSize() );
+		for ( int i = 0; i < syncSamples.GetSizeI(); i++ )
+		{
+			U32( syncSamples[i] );
+		}
+		Close();
+		Close();
+	}
+
+private:
+	Array< UByte >	Bytes;
+	Array< int >	Starts;
+};
+
+}	// namespace OVR
+
+#endif // OVR_Mp4Builder_h
@@ -0,0 +1,423 @@
+/************************************************************************************
+
+Filename    :   TestAdaptiveBitrate.cpp
+Content     :   Throughput estimation, rendition choice and a trace driven simulator
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Kernel/OVR_String.h"
+#include "AdaptiveBitrate.h"
+
+using namespace OVR;
+
+static const int	LADDER_MBPS[] = { 1, 2, 4, 6, 10, 16 };
+static const int	LADDER_SIZE = sizeof( LADDER_MBPS ) / sizeof( LADDER_MBPS[0] );
+
+static Array< int > Ladder()
+{
+	Array< int > bitrates;
+	for ( int i = 0; i < LADDER_SIZE; i++ )
+	{
+		bitrates.PushBack( LADDER_MBPS[i] * 1000000 );
+	}
+	return bitrates;
+}
+
+//==============================================================
+// Bandwidth traces: piecewise constant, looped when a session outlasts them.
+
+struct Trace
+{
+	String				Name;
+	Array< double >		Seconds;		// of each piece
+	Array< double >		Mbps;
+	double				TotalSeconds;
+
+						Trace() : TotalSeconds( 0.0 ) {}
+
+	void				Add( const double seconds, const double mbps )
+	{
+		Seconds.PushBack( seconds );
+		Mbps.PushBack( mbps );
+		TotalSeconds += seconds;
+	}
+
+	// When a download of bits started at start finishes.
+	double				Download( const double start, double bits ) const
+	{
+		double time = start;
+		double pieceStart = floor( start / TotalSeconds ) * TotalSeconds;
+		int piece = 0;
+		while ( pieceStart + Seconds[piece] <= time )
+		{
+			pieceStart += Seconds[piece];
+			piece = ( piece + 1 ) % Seconds.GetSizeI();
+		}
+		while ( bits > 0.0 )
+		{
+			const double left = pieceStart + Seconds[piece] - time;
+			const double rate = Mbps[piece] * 1e6;
+			if ( rate * left >= bits )
+			{
+				return time + bits / rate;
+			}
+			bits -= rate * left;
+			time += left;
+			pieceStart += Seconds[piece];
+			piece = ( piece + 1 ) % Seconds.GetSizeI();
+		}
+		return time;
+	}
+};
+
+static UInt32 NextRandom( UInt32 & state )
+{
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+static double RandomUnit( UInt32 & state )
+{
+	return NextRandom( state ) / 16777216.0;
+}
+
+// Plenty, then a minute at 3 Mbps, then plenty again.
+static Trace StepTrace()
+{
+	Trace trace;
+	trace.Name = "step";
+	trace.Add( 120.0, 25.0 );
+	trace.Add( 60.0, 3.0 );
+	trace.Add( 420.0, 25.0 );
+	return trace;
+}
+
+// Home Wi-Fi shared with other traffic: a random walk around 8 Mbps with a
+// dropout to well under the lowest rendition every minute or so.
+static Trace WifiTrace( UInt32 seed )
+{
+	Trace trace;
+	trace.Name = "congested wifi";
+	double mbps = 8.0;
+	for ( int second = 0; second < 600; second++ )
+	{
+		if ( RandomUnit( seed ) < 1.0 / 60.0 )
+		{
+			const int dropout = 2 + static_cast< int >( RandomUnit( seed ) * 4.0 );
+			trace.Add( dropout, 0.4 );
+			second += dropout;
+		}
+		mbps = Alg::Max( 1.5, Alg::Min( 20.0, mbps * exp( ( RandomUnit( seed ) - 0.5 ) * 0.4 ) + ( 8.0 - mbps ) * 0.05 ) );
+		trace.Add( 1.0, mbps );
+	}
+	return trace;
+}
+
+// A recorded trace of "timestamp megabits-per-second" lines, the format of
+// the public HSDPA and FCC broadband traces.
+static bool LoadTrace( const char * path, Trace & outTrace )
+{
+	FILE * f = fopen( path, "r" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	outTrace = Trace();
+	outTrace.Name = path;
+	double previous = -1.0;
+	double previousMbps = 0.0;
+	double timestamp;
+	double mbps;
+	while ( fscanf( f, "%lf %lf", &timestamp, &mbps ) == 2 )
+	{
+		if ( previous >= 0.0 && timestamp > previous )
+		{
+			outTrace.Add( timestamp - previous, previousMbps );
+		}
+		previous = timestamp;
+		previousMbps = Alg::Max( mbps, 0.01 );
+	}
+	fclose( f );
+	return outTrace.Seconds.GetSizeI() > 0;
+}
+
+//==============================================================
+// The simulated player fetches one segment at a time, waits while the
+// buffer is full, and stalls when it runs dry. Rebuffering counts from the
+// first frame on; the wait for the first segment is the startup time.
+
+enum ePolicy
+{
+	POLICY_ABR,				// AbrController with the ThroughputEstimator
+	POLICY_THROUGHPUT,		// the highest rendition under 90% of the estimate
+	POLICY_HIGHEST
+};
+
+static const char * POLICY_NAMES[] = { "bola", "throughput", "highest" };
+
+struct Session
+{
+	double			SegmentSeconds;
+	double			ContentSeconds;
+	double			MaxBufferSeconds;
+	double			RoundTripSeconds;
+
+					Session() : SegmentSeconds( 4.0 ), ContentSeconds( 600.0 ), MaxBufferSeconds( 30.0 ), RoundTripSeconds( 0.05 ) {}
+};
+
+struct SessionResult
+{
+	double			RebufferRatio;
+	double			RebufferSeconds;
+	double			StartupSeconds;
+	double			AverageMbps;
+	int				Switches;
+};
+
+static SessionResult Simulate( const Trace & trace, const ePolicy policy, const Session & session )
+{
+	const Array< int > bitrates = Ladder();
+	AbrController abr;
+	abr.SetBitrates( bitrates, session.SegmentSeconds );
+	ThroughputEstimator throughput;
+
+	SessionResult result;
+	result.RebufferSeconds = 0.0;
+	result.StartupSeconds = 0.0;
+	result.Switches = 0;
+	double bitsTotal = 0.0;
+	double time = 0.0;
+	double buffer = 0.0;
+	int previous = -1;
+	const int segments = static_cast< int >( session.ContentSeconds / session.SegmentSeconds );
+	for ( int segment = 0; segment < segments; segment++ )
+	{
+		if ( buffer > session.MaxBufferSeconds - session.SegmentSeconds )
+		{
+			const double wait = buffer - ( session.MaxBufferSeconds - session.SegmentSeconds );
+			time += wait;
+			buffer -= wait;
+		}
+
+		int rendition = bitrates.GetSizeI() - 1;
+		if ( policy == POLICY_ABR )
+		{
+			rendition = abr.ChooseRendition( buffer, throughput.GetEstimate() );
+		}
+		else if ( policy == POLICY_THROUGHPUT )
+		{
+			rendition = 0;
+			for ( int i = 1; i < bitrates.GetSizeI(); i++ )
+			{
+				rendition = ( bitrates[i] <= throughput.GetEstimate() * 0.9 ) ? i : rendition;
+			}
+		}
+
+		const double bits = bitrates[rendition] * session.SegmentSeconds;
+		const double finished = trace.Download( time + session.RoundTripSeconds, bits );
+		const double elapsed = finished - time;
+		if ( segment == 0 )
+		{
+			result.StartupSeconds = elapsed;
+		}
+		else if ( elapsed > buffer )
+		{
+			result.RebufferSeconds += elapsed - buffer;
+		}
+		buffer = Alg::Max( buffer - elapsed, 0.0 ) + session.SegmentSeconds;
+		time = finished;
+		throughput.AddSample( static_cast< SInt64 >( bits / 8.0 ), elapsed );
+
+		bitsTotal += bits;
+		result.Switches += ( previous >= 0 && rendition != previous );
+		previous = rendition;
+	}
+	const double played = segments * session.SegmentSeconds;
+	result.RebufferRatio = result.RebufferSeconds / ( played + result.RebufferSeconds );
+	result.AverageMbps = bitsTotal / played * 1e-6;
+	return result;
+}
+
+//==============================================================
+
+UNIT_TEST( EstimateNeedsEnoughData )
+{
+	ThroughputEstimator estimator;
+	CHECK_EQUAL( 0, estimator.GetEstimate() );
+	// latency dominated: ignored
+	estimator.AddSample( 8 * 1024, 0.001 );
+	CHECK_EQUAL( 0, estimator.GetEstimate() );
+	estimator.AddSample( 64 * 1024, 0.1 );
+	CHECK_EQUAL( 0, estimator.GetEstimate() );
+	estimator.AddSample( 64 * 1024, 0.1 );
+	CHECK_NEAR( 64 * 1024 * 8 / 0.1, estimator.GetEstimate(), 1.0 );
+	estimator.Reset();
+	CHECK_EQUAL( 0, estimator.GetEstimate() );
+}
+
+UNIT_TEST( EstimateFollowsDropsAtOnceAndRisesSlowly )
+{
+	ThroughputEstimator estimator;
+	for ( int i = 0; i < 20; i++ )
+	{
+		estimator.AddSample( 1000000, 1.0 );		// 8 Mbps
+	}
+	CHECK_NEAR( 8e6, estimator.GetEstimate(), 1e3 );
+
+	// two seconds at 2 Mbps take the estimate most of the way down
+	estimator.AddSample( 500000, 2.0 );
+	const double dropped = estimator.GetEstimate();
+	CHECK( dropped < 5.5e6 );
+
+	// a short burst moves it, but the slow average keeps it far from the burst's rate
+	estimator.AddSample( 4000000, 0.5 );			// 64 Mbps
+	CHECK( estimator.GetEstimate() > dropped );
+	CHECK( estimator.GetEstimate() < 16e6 );
+}
+
+UNIT_TEST( EmptyBufferFollowsThroughput )
+{
+	AbrController abr;
+	abr.SetBitrates( Ladder(), 4.0 );
+	CHECK_EQUAL( 0, abr.ChooseRendition( 0.0, 0.0 ) );
+	// 90% of 7 Mbps sustains 6 Mbps
+	CHECK_EQUAL( 3, abr.ChooseRendition( 0.0, 7e6 ) );
+	CHECK_EQUAL( 1, abr.ChooseRendition( 0.0, 2.5e6 ) );
+	CHECK_EQUAL( 2, abr.GetSwitches() );
+}
+
+UNIT_TEST( SwitchesUpOneStepAtATime )
+{
+	AbrController abr;
+	abr.SetBitrates( Ladder(), 4.0 );
+	CHECK_EQUAL( 0, abr.ChooseRendition( 0.0, 0.0 ) );
+	// a full buffer and plenty of throughput: one rendition up every other segment
+	int previous = 0;
+	int sinceSwitch = 0;
+	for ( int segment = 0; segment < 20; segment++ )
+	{
+		const int rendition = abr.ChooseRendition( 40.0, 100e6 );
+		CHECK( rendition == previous || ( rendition == previous + 1 && sinceSwitch >= 1 ) );
+		sinceSwitch = ( rendition == previous ) ? sinceSwitch + 1 : 0;
+		previous = rendition;
+	}
+	CHECK_EQUAL( LADDER_SIZE - 1, previous );
+
+	// never above what the throughput sustains
+	AbrController capped;
+	capped.SetBitrates( Ladder(), 4.0 );
+	for ( int segment = 0; segment < 20; segment++ )
+	{
+		capped.ChooseRendition( 40.0, 5e6 );
+	}
+	CHECK_EQUAL( 2, capped.GetCurrent() );
+}
+
+UNIT_TEST( SwitchesDownAtOnce )
+{
+	AbrController abr;
+	abr.SetBitrates( Ladder(), 4.0 );
+	abr.ChooseRendition( 0.0, 100e6 );
+	CHECK_EQUAL( LADDER_SIZE - 1, abr.GetCurrent() );
+	for ( int segment = 0; segment < 4; segment++ )
+	{
+		abr.ChooseRendition( 30.0, 100e6 );
+	}
+	CHECK_EQUAL( LADDER_SIZE - 1, abr.GetCurrent() );
+	// the buffer draining to a couple of segments drops several renditions in one go
+	CHECK( abr.ChooseRendition( 8.0, 3e6 ) <= 1 );
+}
+
+UNIT_TEST( StepTraceDoesNotStall )
+{
+	const Trace trace = StepTrace();
+	const Session session;
+	const SessionResult abr = Simulate( trace, POLICY_ABR, session );
+	const SessionResult highest = Simulate( trace, POLICY_HIGHEST, session );
+	CHECK( highest.RebufferRatio > 0.02 );
+	CHECK( abr.RebufferRatio < 0.001 );
+	// most of the session has 25 Mbps
+	CHECK( abr.AverageMbps > 10.0 );
+}
+
+UNIT_TEST( WifiTraceBeatsThroughputOnly )
+{
+	for ( UInt32 seed = 1; seed <= 5; seed++ )
+	{
+		const Trace trace = WifiTrace( seed );
+		const Session session;
+		const SessionResult abr = Simulate( trace, POLICY_ABR, session );
+		const SessionResult throughput = Simulate( trace, POLICY_THROUGHPUT, session );
+		CHECK( abr.RebufferRatio <= throughput.RebufferRatio );
+		CHECK( abr.RebufferRatio < 0.01 );
+		// hysteresis: far fewer switches than segments
+		CHECK( abr.Switches < 40 );
+		CHECK( abr.Switches <= throughput.Switches );
+	}
+}
+
+//==============================================================
+// Rebuffer ratio and average bitrate of each policy over the built in
+// traces and any recorded ones in $ABR_TRACE_DIR.
+
+static void ReportTrace( const Trace & trace )
+{
+	const Session session;
+	for ( int policy = 0; policy <= POLICY_HIGHEST; policy++ )
+	{
+		const SessionResult result = Simulate( trace, static_cast< ePolicy >( policy ), session );
+		OVR::UnitTest::Report( "%-16.16s %-10s rebuffer %6.2f%% (%5.1f s), %5.2f Mbps, %3i switches, %4.2f s startup",
+			trace.Name.ToCStr(), POLICY_NAMES[policy], result.RebufferRatio * 100.0, result.RebufferSeconds,
+			result.AverageMbps, result.Switches, result.StartupSeconds );
+	}
+}
+
+UNIT_BENCHMARK( BenchTraces )
+{
+	ReportTrace( StepTrace() );
+	ReportTrace( WifiTrace( 1 ) );
+
+	const double start = OVR::UnitTest::GetSeconds();
+	const Trace wifi = WifiTrace( 2 );
+	const int sessions = 200;
+	for ( int i = 0; i < sessions; i++ )
+	{
+		Simulate( wifi, POLICY_ABR, Session() );
+	}
+	OVR::UnitTest::Report( "%.1f us per simulated 10 minute session", ( OVR::UnitTest::GetSeconds() - start ) * 1e6 / sessions );
+
+	const char * dirName = getenv( "ABR_TRACE_DIR" );
+	DIR * dir = ( dirName != NULL ) ? opendir( dirName ) : NULL;
+	if ( dir == NULL )
+	{
+		return;
+	}
+	for ( struct dirent * entry = readdir( dir ); entry != NULL; entry = readdir( dir ) )
+	{
+		const String path = String( dirName ) + "/" + entry->d_name;
+		Trace trace;
+		if ( entry->d_name[0] != '.' && LoadTrace( path.ToCStr(), trace ) )
+		{
+			trace.Name = entry->d_name;
+			ReportTrace( trace );
+		}
+	}
+	closedir( dir );
+
+}
@@ -0,0 +1,527 @@
+/************************************************************************************
+
+Filename    :   TestAmbisonicRenderer.cpp
+Content     :   Ambisonic renderer against direct convolution, an offline golden
+				render from WAV, and the cost of a block against its budget
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Kernel/OVR_String.h"
+#include "AmbisonicRenderer.h"
+#include "AudioDsp.h"
+#include "WavFile.h"
+
+using namespace OVR;
+
+static const int	BLOCK = AmbisonicRenderer::BLOCK_FRAMES;
+static const int	CHANNELS = AmbisonicRenderer::CHANNELS;
+
+// Deterministic noise in -1 to 1, the same on every platform.
+static float Noise( UInt32 & state )
+{
+	state = state * 1664525u + 1013904223u;
+	return static_cast< int >( state >> 8 ) / 8388608.0f - 1.0f;
+}
+
+static String TempPath( const char * name )
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+}
+
+static void PutLE16( FILE * f, const int v )
+{
+	fputc( v & 255, f );
+	fputc( ( v >> 8 ) & 255, f );
+}
+
+static void PutLE32( FILE * f, const UInt32 v )
+{
+	PutLE16( f, v & 0xffff );
+	PutLE16( f, v >> 16 );
+}
+
+// bits 16 or 24 for PCM, 32 for float; extensible writes WAVE_FORMAT_EXTENSIBLE.
+static bool WriteWav( const String & path, const float * samples, const int frames, const int channels,
+		const int sampleRate, const int bits, const bool extensible = false )
+{
+	FILE * f = fopen( path.ToCStr(), "wb" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	const int formatTag = ( bits == 32 ) ? 3 : 1;
+	const int fmtBytes = extensible ? 40 : 16;
+	const int dataBytes = frames * channels * bits / 8;
+	fwrite( "RIFF", 1, 4, f );
+	PutLE32( f, 4 + 8 + fmtBytes + 8 + dataBytes );
+	fwrite( "WAVE", 1, 4, f );
+	fwrite( "fmt ", 1, 4, f );
+	PutLE32( f, fmtBytes );
+	PutLE16( f, extensible ? 0xfffe : formatTag );
+	PutLE16( f, channels );
+	PutLE32( f, sampleRate );
+	PutLE32( f, sampleRate * channels * bits / 8 );
+	PutLE16( f, channels * bits / 8 );
+	PutLE16( f, bits );
+	if ( extensible )
+	{
+		static const UByte guidTail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+		PutLE16( f, 22 );
+		PutLE16( f, bits );
+		PutLE32( f, 0 );
+		PutLE16( f, formatTag );
+		fwrite( guidTail, 1, sizeof( guidTail ), f );
+	}
+	// a chunk readers have to skip
+	fwrite( "LIST", 1, 4, f );
+	PutLE32( f, 3 );
+	fwrite( "abc\0", 1, 4, f );
+	fwrite( "data", 1, 4, f );
+	PutLE32( f, dataBytes );
+	for ( int i = 0; i < frames * channels; i++ )
+	{
+		const float s = Alg::Clamp( samples[i], -1.0f, 1.0f );
+		if ( bits == 32 )
+		{
+			UInt32 v;
+			memcpy( &v, &samples[i], 4 );
+			PutLE32( f, v );
+		}
+		else if ( bits == 24 )
+		{
+			const int v = static_cast< int >( floorf( s * 8388607.0f + 0.5f ) );
+			PutLE16( f, v & 0xffff );
+			fputc( ( v >> 16 ) & 255, f );
+		}
+		else
+		{
+			PutLE16( f, static_cast< int >( floorf( s * 32767.0f + 0.5f ) ) );
+		}
+	}
+	return fclose( f ) == 0;
+}
+
+// A view matrix for a head turned yaw radians to the left.
+static Matrix4f YawView( const float yaw )
+{
+	const float c = cosf( yaw );
+	const float s = sinf( yaw );
+	// the inverse, and so the transpose, of the head's rotation about +Y
+	return Matrix4f(
+		c, 0, -s, 0,
+		0, 1, 0, 0,
+		s, 0, c, 0,
+		0, 0, 0, 1 );
+}
+
+// Left and right energy of a click from direction ( x, y, z ), ambisonic axes.
+static void RenderClick( AmbisonicRenderer & renderer, const float x, const float y, const float z,
+		double & left, double & right )
+{
+	static float foa[BLOCK * CHANNELS];
+	static float stereo[BLOCK * 2];
+	renderer.Reset();
+	left = right = 0.0;
+	for ( int b = 0; b < 4; b++ )
+	{
+		memset( foa, 0, sizeof( foa ) );
+		if ( b == 0 )
+		{
+			foa[0] = 1.0f;
+			foa[1] = y;
+			foa[2] = z;
+			foa[3] = x;
+		}
+		renderer.Render( foa, stereo );
+		for ( int f = 0; f < BLOCK; f++ )
+		{
+			left += stereo[f * 2] * stereo[f * 2];
+			right += stereo[f * 2 + 1] * stereo[f * 2 + 1];
+		}
+	}
+}
+
+//==============================================================
+// DSP kernels
+
+UNIT_TEST( FftMatchesDirectDft )
+{
+	const int size = 64;
+	AudioFft fft;
+	fft.Init( size );
+	float re[size];
+	float im[size];
+	float inRe[size];
+	float inIm[size];
+	UInt32 state = 1;
+	for ( int i = 0; i < size; i++ )
+	{
+		inRe[i] = re[i] = Noise( state );
+		inIm[i] = im[i] = Noise( state );
+	}
+	fft.Forward( re, im );
+	for ( int k = 0; k < size; k++ )
+	{
+		double sumRe = 0.0;
+		double sumIm = 0.0;
+		for ( int n = 0; n < size; n++ )
+		{
+			const double a = -2.0 * M_PI * k * n / size;
+			sumRe += inRe[n] * cos( a ) - inIm[n] * sin( a );
+			sumIm += inRe[n] * sin( a ) + inIm[n] * cos( a );
+		}
+		CHECK_NEAR( sumRe, re[k], 1e-4 );
+		CHECK_NEAR( sumIm, im[k], 1e-4 );
+	}
+	fft.Inverse( re, im );
+	for ( int i = 0; i < size; i++ )
+	{
+		CHECK_NEAR( inRe[i], re[i], 1e-5 );
+		CHECK_NEAR( inIm[i], im[i], 1e-5 );
+	}
+}
+
+UNIT_TEST( SimdKernelsMatchScalar )
+{
+	// odd count, so the SIMD loop's tail is covered too
+	const int count = 515;
+	Array< float > data;
+	data.Resize( count * 6 );
+	UInt32 state = 7;
+	for ( int i = 0; i < data.GetSizeI(); i++ )
+	{
+		data[i] = Noise( state );
+	}
+	float * accRe = &data[0];
+	float * accIm = &data[count];
+	const float * aRe = &data[count * 2];
+	const float * aIm = &data[count * 3];
+	const float * bRe = &data[count * 4];
+	const float * bIm = &data[count * 5];
+	Array< float > expectRe;
+	Array< float > expectIm;
+	expectRe.Resize( count );
+	expectIm.Resize( count );
+	for ( int i = 0; i < count; i++ )
+	{
+		expectRe[i] = accRe[i] + aRe[i] * bRe[i] - aIm[i] * bIm[i];
+		expectIm[i] = accIm[i] + aRe[i] * bIm[i] + aIm[i] * bRe[i];
+	}
+	ComplexMultiplyAccumulate( accRe, accIm, aRe, aIm, bRe, bIm, count );
+	for ( int i = 0; i < count; i++ )
+	{
+		CHECK_NEAR( expectRe[i], accRe[i], 1e-6 );
+		CHECK_NEAR( expectIm[i], accIm[i], 1e-6 );
+	}
+
+	Array< float > stereo;
+	stereo.Resize( count * 2 );
+	for ( int i = 0; i < count * 2; i++ )
+	{
+		stereo[i] = Noise( state );
+	}
+	const Array< float > before = stereo;
+	MixMonoToStereo( stereo.GetDataPtr(), aRe, count, 0.25f, -0.5f );
+	for ( int i = 0; i < count; i++ )
+	{
+		CHECK_NEAR( before[i * 2] + aRe[i] * 0.25f, stereo[i * 2], 1e-6 );
+		CHECK_NEAR( before[i * 2 + 1] - aRe[i] * 0.5f, stereo[i * 2 + 1], 1e-6 );
+	}
+}
+
+UNIT_TEST( WavFileReadsEveryFormat )
+{
+	const int frames = 300;
+	float samples[frames * 2];
+	UInt32 state = 3;
+	for ( int i = 0; i < frames * 2; i++ )
+	{
+		samples[i] = Noise( state ) * 0.9f;
+	}
+	const int bits[4] = { 16, 24, 32, 24 };
+	// the reader scales by 1 / 32768, the writer by 32767
+	const double tolerance[4] = { 2.0 / 32767.0, 2.0 / 8388607.0, 0.0, 2.0 / 8388607.0 };
+	for ( int format = 0; format < 4; format++ )
+	{
+		const String path = TempPath( "format.wav" );
+		CHECK( WriteWav( path, samples, frames, 2, 44100, bits[format], format == 3 ) );
+		WavFile wav;
+		CHECK( wav.Open( path.ToCStr() ) );
+		CHECK_EQUAL( 2, wav.GetChannels() );
+		CHECK_EQUAL( 44100, wav.GetSampleRate() );
+		CHECK_EQUAL( frames, wav.GetFrameCount() );
+
+		// frames before and after the file are silence
+		float out[( frames + 20 ) * 2];
+		wav.ReadFrames( -10, frames + 20, out );
+		for ( int i = 0; i < 20; i++ )
+		{
+			CHECK_EQUAL( 0, out[i] );
+			CHECK_EQUAL( 0, out[( frames + 10 ) * 2 + i] );
+		}
+		for ( int i = 0; i < frames * 2; i++ )
+		{
+			CHECK_NEAR( samples[i], out[20 + i], tolerance[format] );
+		}
+	}
+
+	const char notWav[] = "RIFF\0\0\0\0AVI LIST";
+	CHECK( WriteWav( TempPath( "x.wav" ), samples, 0, 2, 44100, 8 ) );
+	WavFile wav;
+	CHECK( !wav.Open( TempPath( "x.wav" ).ToCStr() ) );
+	CHECK( !wav.OpenMemory( notWav, sizeof( notWav ), "notWav" ) );
+	CHECK( !wav.Open( TempPath( "missing.wav" ).ToCStr() ) );
+}
+
+//==============================================================
+// Renderer
+
+UNIT_TEST( PartitionedConvolutionMatchesDirect )
+{
+	// filters longer than a block, and not a multiple of it
+	const int taps = BLOCK * 3 + 77;
+	Array< float > filters;
+	filters.Resize( taps * CHANNELS );
+	UInt32 state = 11;
+	for ( int t = 0; t < taps; t++ )
+	{
+		const float decay = expf( -t / 200.0f ) * 0.5f;
+		for ( int c = 0; c < CHANNELS; c++ )
+		{
+			filters[t * CHANNELS + c] = Noise( state ) * decay;
+		}
+	}
+	const String filterPath = TempPath( "filters.wav" );
+	CHECK( WriteWav( filterPath, filters.GetDataPtr(), taps, CHANNELS, 48000, 32 ) );
+
+	AmbisonicRenderer renderer;
+	renderer.Init( 48000 );
+	CHECK( renderer.LoadFilters( filterPath.ToCStr() ) );
+
+	const int blocks = 12;
+	Array< float > foa;
+	Array< float > stereo;
+	foa.Resize( blocks * BLOCK * CHANNELS );
+	stereo.Resize( blocks * BLOCK * 2 );
+	for ( int i = 0; i < foa.GetSizeI(); i++ )
+	{
+		foa[i] = Noise( state ) * 0.5f;
+	}
+	for ( int b = 0; b < blocks; b++ )
+	{
+		renderer.Render( &foa[b * BLOCK * CHANNELS], &stereo[b * BLOCK * 2] );
+	}
+
+	// no latency, and the right ear is the left with Y negated
+	double maxError = 0.0;
+	for ( int n = 0; n < blocks * BLOCK; n++ )
+	{
+		double left = 0.0;
+		double right = 0.0;
+		for ( int t = 0; t < taps && t <= n; t++ )
+		{
+			for ( int c = 0; c < CHANNELS; c++ )
+			{
+				const double v = filters[t * CHANNELS + c] * foa[( n - t ) * CHANNELS + c];
+				left += v;
+				right += ( c == 1 ) ? -v : v;
+			}
+		}
+		maxError = Alg::Max( maxError, fabs( left - stereo[n * 2] ) );
+		maxError = Alg::Max( maxError, fabs( right - stereo[n * 2 + 1] ) );
+	}
+	CHECK( maxError < 1e-4 );
+	OVR::UnitTest::Report( "%i taps in %i partitions, max error %g", taps, ( taps + BLOCK - 1 ) / BLOCK, maxError );
+}
+
+UNIT_TEST( LoadFiltersChecksTheFormat )
+{
+	float filters[BLOCK * 2];
+	memset( filters, 0, sizeof( filters ) );
+	AmbisonicRenderer renderer;
+	renderer.Init( 48000 );
+	CHECK( WriteWav( TempPath( "stereo.wav" ), filters, BLOCK, 2, 48000, 16 ) );
+	CHECK( !renderer.LoadFilters( TempPath( "stereo.wav" ).ToCStr() ) );
+	CHECK( WriteWav( TempPath( "rate.wav" ), filters, BLOCK / 2, 4, 44100, 16 ) );
+	CHECK( !renderer.LoadFilters( TempPath( "rate.wav" ).ToCStr() ) );
+}
+
+UNIT_TEST( HeadModelPlacesSources )
+{
+	AmbisonicRenderer renderer;
+	renderer.Init( 48000 );
+	double left = 0.0;
+	double right = 0.0;
+
+	// ambisonic +Y is left
+	RenderClick( renderer, 0.0f, 1.0f, 0.0f, left, right );
+	CHECK( left > right * 2.0 );
+	RenderClick( renderer, 0.0f, -1.0f, 0.0f, left, right );
+	CHECK( right > left * 2.0 );
+	RenderClick( renderer, 1.0f, 0.0f, 0.0f, left, right );
+	CHECK_NEAR( 1.0, left / right, 1e-3 );
+}
+
+UNIT_TEST( HeadRotationTurnsTheField )
+{
+	AmbisonicRenderer renderer;
+	renderer.Init( 48000 );
+	double left = 0.0;
+	double right = 0.0;
+
+	// a source in front of the video is on the right once the head turns left
+	renderer.SetHeadRotation( YawView( static_cast< float >( M_PI * 0.5 ) ) );
+	RenderClick( renderer, 0.0f, 0.0f, 0.0f, left, right );
+	RenderClick( renderer, 1.0f, 0.0f, 0.0f, left, right );
+	CHECK( right > left * 2.0 );
+
+	// and a source on the left is in front
+	RenderClick( renderer, 0.0f, 1.0f, 0.0f, left, right );
+	CHECK_NEAR( 1.0, left / right, 1e-3 );
+
+	renderer.SetHeadRotation( YawView( 0.0f ) );
+	RenderClick( renderer, 0.0f, 0.0f, 0.0f, left, right );
+	RenderClick( renderer, 0.0f, 1.0f, 0.0f, left, right );
+	CHECK( left > right * 2.0 );
+}
+
+//==============================================================
+// Offline render of a WAV file, as it would be heard turning the head a
+// full circle, compared against tests/data. UPDATE_GOLDEN=1 rewrites it.
+
+static const int	GOLDEN_BLOCKS = 16;
+
+// A click train and a swept tone from the front, a noise bed from the left.
+static void WriteGoldenInput( const String & path )
+{
+	Array< float > foa;
+	foa.Resize( GOLDEN_BLOCKS * BLOCK * CHANNELS );
+	UInt32 state = 5;
+	for ( int f = 0; f < GOLDEN_BLOCKS * BLOCK; f++ )
+	{
+		const float t = f / 48000.0f;
+		const float front = ( ( f % 1024 ) == 0 ? 0.8f : 0.0f ) + 0.3f * sinf( 2.0f * static_cast< float >( M_PI ) * ( 200.0f + 4000.0f * t ) * t );
+		const float side = Noise( state ) * 0.1f;
+		foa[f * CHANNELS + 0] = front + side;
+		foa[f * CHANNELS + 1] = side;
+		foa[f * CHANNELS + 2] = 0.0f;
+		foa[f * CHANNELS + 3] = front;
+	}
+	WriteWav( path, foa.GetDataPtr(), GOLDEN_BLOCKS * BLOCK, CHANNELS, 48000, 32 );
+}
+
+static bool RenderWav( const String & inputPath, Array< float > & stereo )
+{
+	WavFile input;
+	if ( !input.Open( inputPath.ToCStr() ) || input.GetChannels() != CHANNELS )
+	{
+		return false;
+	}
+	AmbisonicRenderer renderer;
+	renderer.Init( input.GetSampleRate() );
+	const int blocks = static_cast< int >( ( input.GetFrameCount() + BLOCK - 1 ) / BLOCK );
+	stereo.Resize( blocks * BLOCK * 2 );
+	float foa[BLOCK * CHANNELS];
+	for ( int b = 0; b < blocks; b++ )
+	{
+		renderer.SetHeadRotation( YawView( 2.0f * static_cast< float >( M_PI ) * b / blocks ) );
+		input.ReadFrames( static_cast< SInt64 >( b ) * BLOCK, BLOCK, foa );
+		renderer.Render( foa, &stereo[b * BLOCK * 2] );
+	}
+	return true;
+}
+
+UNIT_TEST( OfflineRenderMatchesGolden )
+{
+	const String inputPath = TempPath( "input.ambix.wav" );
+	WriteGoldenInput( inputPath );
+	Array< float > stereo;
+	CHECK( RenderWav( inputPath, stereo ) );
+	CHECK_EQUAL( GOLDEN_BLOCKS * BLOCK * 2, stereo.GetSizeI() );
+
+	const String goldenPath = String( TEST_DATA_DIR ) + "/AmbisonicGolden.wav";
+	if ( getenv( "UPDATE_GOLDEN" ) != NULL )
+	{
+		CHECK( WriteWav( goldenPath, stereo.GetDataPtr(), GOLDEN_BLOCKS * BLOCK, 2, 48000, 32 ) );
+		OVR::UnitTest::Report( "wrote %s", goldenPath.ToCStr() );
+		return;
+	}
+
+	WavFile golden;
+	CHECK( golden.Open( goldenPath.ToCStr() ) );
+	CHECK_EQUAL( 2, golden.GetChannels() );
+	CHECK_EQUAL( GOLDEN_BLOCKS * BLOCK, golden.GetFrameCount() );
+	Array< float > expected;
+	golden.ReadAll( expected );
+
+	// FFT rounding differs between the SIMD kernels, nothing else may
+	double maxError = 0.0;
+	double energy = 0.0;
+	for ( int i = 0; i < stereo.GetSizeI(); i++ )
+	{
+		maxError = Alg::Max( maxError, static_cast< double >( fabsf( expected[i] - stereo[i] ) ) );
+		energy += expected[i] * expected[i];
+	}
+	CHECK( energy > 1.0 );
+	CHECK( maxError < 1e-4 );
+	OVR::UnitTest::Report( "max error %g against the golden render", maxError );
+}
+
+//==============================================================
+// Cost of a block against the 5.3 ms a 256 frame block lasts at 48 kHz.
+
+static void BenchFilters( const char * label, AmbisonicRenderer & renderer )
+{
+	const int blocks = 48000 * 10 / BLOCK;
+	float foa[BLOCK * CHANNELS];
+	float stereo[BLOCK * 2];
+	UInt32 state = 9;
+	renderer.ResetStats();
+	for ( int b = 0; b < blocks; b++ )
+	{
+		for ( int i = 0; i < BLOCK * CHANNELS; i++ )
+		{
+			foa[i] = Noise( state ) * 0.25f;
+		}
+		renderer.SetHeadRotation( YawView( b * 0.01f ) );
+		renderer.Render( foa, stereo );
+	}
+	const double budget = renderer.GetBlockBudgetSeconds();
+	OVR::UnitTest::Report( "%s: %.1f us average, %.1f us max per block, %.2f%% of the %.2f ms budget",
+		label, renderer.GetBlockSecondsAverage() * 1e6, renderer.GetBlockSecondsMax() * 1e6,
+		renderer.GetBlockSecondsAverage() / budget * 100.0, budget * 1000.0 );
+	CHECK( renderer.GetBlockSecondsAverage() < budget );
+}
+
+UNIT_BENCHMARK( BenchBlockCost )
+{
+	AmbisonicRenderer renderer;
+	renderer.Init( 48000 );
+	BenchFilters( "head model, 1 partition", renderer );
+
+	Array< float > filters;
+	filters.Resize( AmbisonicRenderer::MAX_FILTER_LENGTH * CHANNELS );
+	UInt32 state = 13;
+	for ( int i = 0; i < filters.GetSizeI(); i++ )
+	{
+		filters[i] = Noise( state ) * 0.01f;
+	}
+	const String path = TempPath( "filters.wav" );
+	CHECK( WriteWav( path, filters.GetDataPtr(), AmbisonicRenderer::MAX_FILTER_LENGTH, CHANNELS, 48000, 32 ) );
+	CHECK( renderer.LoadFilters( path.ToCStr() ) );
+	BenchFilters( "4096 taps, 16 partitions", renderer );
+}
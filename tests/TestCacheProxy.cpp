@@ -0,0 +1,497 @@
+/************************************************************************************
+
+Filename    :   TestCacheProxy.cpp
+Content     :   Read-through cache proxy against a local HTTP stand-in
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Kernel/OVR_String.h"
+#include "HttpTestServer.h"
+#include "HttpClient.h"
+#include "CacheProxy.h"
+
+using namespace OVR;
+
+static const int SEGMENT = CacheProxy::SEGMENT_BYTES;
+
+static void MakeVideo( Array< UByte > & data, const int size, const UInt32 seed )
+{
+	data.Resize( size );
+	UInt32 state = seed;
+	for ( int i = 0; i < size; i++ )
+	{
+		state = state * 1664525u + 1013904223u;
+		data[i] = static_cast< UByte >( state >> 24 );
+	}
+}
+
+static String CacheDir( const char * name )
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+}
+
+// Bytes of segment files under the cache directory.
+static SInt64 CachedBytes( const String & dir )
+{
+	SInt64 total = 0;
+	DIR * d = opendir( dir.ToCStr() );
+	if ( d == NULL )
+	{
+		return 0;
+	}
+	for ( struct dirent * entry = readdir( d ); entry != NULL; entry = readdir( d ) )
+	{
+		if ( entry->d_name[0] == '.' )
+		{
+			continue;
+		}
+		const String path = dir + "/" + entry->d_name;
+		struct stat st;
+		if ( stat( path.ToCStr(), &st ) != 0 )
+		{
+			continue;
+		}
+		if ( S_ISDIR( st.st_mode ) )
+		{
+			total += CachedBytes( path );
+		}
+		else if ( strstr( entry->d_name, ".seg" ) != NULL )
+		{
+			total += st.st_size;
+		}
+	}
+	closedir( d );
+	return total;
+}
+
+static bool RangeMatches( HttpConnection & connection, const String & url, const Array< UByte > & data,
+		const SInt64 first, const SInt64 last )
+{
+	Array< UByte > body;
+	HttpResponse response;
+	if ( !HttpFetch( connection, url.ToCStr(), first, last, body, &response ) || response.StatusCode != 206 ||
+		response.TotalLength != data.GetSizeI() || body.GetSizeI() != static_cast< int >( last - first + 1 ) )
+	{
+		return false;
+	}
+	return memcmp( &body[0], &data[static_cast< int >( first )], body.GetSize() ) == 0;
+}
+
+// Reads the whole file the way the player does, in consecutive ranges.
+static bool ReadThrough( HttpConnection & connection, const String & url, const Array< UByte > & data, const int chunk )
+{
+	for ( int first = 0; first < data.GetSizeI(); first += chunk )
+	{
+		const int last = ( first + chunk < data.GetSizeI() ) ? first + chunk - 1 : data.GetSizeI() - 1;
+		if ( !RangeMatches( connection, url, data, first, last ) )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static const int	HLS_SEGMENTS = 20;
+static const int	HLS_SEGMENT_BYTES = 64 * 1024;
+static const char	HLS_MASTER[] =
+	"#EXTM3U\n"
+	"#EXT-X-STREAM-INF:BANDWIDTH=500000,RESOLUTION=1920x960\nlow.m3u8\n"
+	"#EXT-X-STREAM-INF:BANDWIDTH=4000000,RESOLUTION=3840x1920\nhigh.m3u8\n";
+
+// A 500 kbps and a 4 Mbps variant of 2 s segments, each segment starting
+// with the name of its variant and its number. Segment 3 of the high
+// variant is skew seconds longer.
+static void AddHlsStream( HttpTestServer & server, const double skew )
+{
+	server.AddFile( "/hls/master.m3u8", HLS_MASTER, sizeof( HLS_MASTER ) - 1, "application/vnd.apple.mpegurl" );
+	const char * variants[] = { "low", "high" };
+	for ( int v = 0; v < 2; v++ )
+	{
+		String playlist( "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:3\n#EXT-X-MEDIA-SEQUENCE:0\n" );
+		for ( int i = 0; i < HLS_SEGMENTS; i++ )
+		{
+			char line[64];
+			snprintf( line, sizeof( line ), "#EXTINF:%.3f,\n%s%i.ts\n", 2.0 + ( ( v == 1 && i == 3 ) ? skew : 0.0 ), variants[v], i );
+			playlist += line;
+
+			Array< UByte > data;
+			MakeVideo( data, HLS_SEGMENT_BYTES, v * 100 + i );
+			snprintf( line, sizeof( line ), "%s-%02i", variants[v], i );
+			memcpy( &data[0], line, strlen( line ) + 1 );
+			snprintf( line, sizeof( line ), "/hls/%s%i.ts", variants[v], i );
+			server.AddFile( line, &data[0], data.GetSizeI(), "video/mp2t" );
+		}
+		playlist += "#EXT-X-ENDLIST\n";
+		char path[32];
+		snprintf( path, sizeof( path ), "/hls/%s.m3u8", variants[v] );
+		server.AddFile( path, playlist.ToCStr(), static_cast< int >( playlist.GetSize() ), "application/vnd.apple.mpegurl" );
+	}
+}
+
+static int CountLines( const String & text, const char * prefix )
+{
+	int count = 0;
+	for ( const char * line = text.ToCStr(); line != NULL && *line != 0; )
+	{
+		count += strncmp( line, prefix, strlen( prefix ) ) == 0;
+		line = strchr( line, '\n' );
+		line = ( line != NULL ) ? line + 1 : NULL;
+	}
+	return count;
+}
+
+//==============================================================
+
+UNIT_TEST( OnlyPlainHttpIsProxied )
+{
+	CacheProxy proxy;
+	const String stopped = proxy.GetProxyUrl( "http://example.com/a.mp4" );
+	CHECK_STRING( "http://example.com/a.mp4", stopped.ToCStr() );
+
+	CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 0 ) );
+	const String local = proxy.GetProxyUrl( "/sdcard/Oculus/360Videos/a.mp4" );
+	CHECK_STRING( "/sdcard/Oculus/360Videos/a.mp4", local.ToCStr() );
+	const String secure = proxy.GetProxyUrl( "https://example.com/a.mp4" );
+	CHECK_STRING( "https://example.com/a.mp4", secure.ToCStr() );
+
+	const String proxied = proxy.GetProxyUrl( "http://example.com/a.mp4" );
+	CHECK( strncmp( proxied.ToCStr(), "http://127.0.0.1:", 17 ) == 0 );
+	// the same url, the same key
+	CHECK( proxied == proxy.GetProxyUrl( "http://example.com/a.mp4" ) );
+	CHECK( !( proxied == proxy.GetProxyUrl( "http://example.com/b.mp4" ) ) );
+	CHECK( CacheProxy::IsPlaylistUrl( "http://example.com/live/master.m3u8?token=1" ) );
+	CHECK( !CacheProxy::IsPlaylistUrl( "http://example.com/a.mp4" ) );
+	proxy.Stop();
+}
+
+UNIT_TEST( ServesRangesByteExact )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 5 * SEGMENT + 12345, 1 );
+	server.AddFile( "/video.mp4", &data[0], data.GetSizeI(), "video/mp4" );
+
+	CacheProxy proxy;
+	CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 0 ) );
+	const String url = proxy.GetProxyUrl( server.GetUrl( "/video.mp4" ).ToCStr() );
+	HttpConnection connection;
+
+	// across segment boundaries, inside one, the last byte
+	CHECK( RangeMatches( connection, url, data, 100, 3 * SEGMENT + 7 ) );
+	CHECK( RangeMatches( connection, url, data, SEGMENT + 1, SEGMENT + 1 ) );
+	CHECK( RangeMatches( connection, url, data, data.GetSizeI() - 1, data.GetSizeI() - 1 ) );
+	CHECK( RangeMatches( connection, url, data, 2 * SEGMENT - 10, data.GetSizeI() - 1 ) );
+
+	// the whole file, with its type
+	Array< UByte > body;
+	HttpResponse response;
+	CHECK( HttpFetch( connection, url.ToCStr(), -1, -1, body, &response ) );
+	CHECK_EQUAL( 200, response.StatusCode );
+	CHECK_STRING( "video/mp4", response.ContentType.ToCStr() );
+	CHECK( body.GetSizeI() == data.GetSizeI() && memcmp( &body[0], &data[0], body.GetSize() ) == 0 );
+
+	// past the end, and a key the proxy never handed out
+	CHECK( !HttpFetch( connection, url.ToCStr(), data.GetSizeI(), data.GetSizeI() + 10, body, &response ) );
+	CHECK_EQUAL( 416, response.StatusCode );
+	const String unknown = url.Substring( 0, url.GetSize() - 1 ) + "x";
+	CHECK( !HttpFetch( connection, unknown.ToCStr(), -1, -1, body, &response ) );
+	CHECK_EQUAL( 404, response.StatusCode );
+	proxy.Stop();
+}
+
+UNIT_TEST( SecondPassIsServedFromTheCache )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 10 * SEGMENT + 999, 2 );
+	server.AddFile( "/video.mp4", &data[0], data.GetSizeI() );
+
+	CacheProxy proxy;
+	CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 0 ) );
+	const String url = proxy.GetProxyUrl( server.GetUrl( "/video.mp4" ).ToCStr() );
+	HttpConnection connection;
+	CHECK( ReadThrough( connection, url, data, 100 * 1024 ) );
+	// nothing was fetched twice, whether by the client or the read-ahead
+	CHECK_EQUAL( 11, server.GetRequests() );
+
+	int hits;
+	int misses;
+	SInt64 served;
+	double firstByte;
+	// the stats are counted just after the last byte goes out
+	for ( int wait = 0; wait < 100; wait++ )
+	{
+		proxy.GetStats( hits, misses, served, firstByte );
+		if ( served == data.GetSizeI() )
+		{
+			break;
+		}
+		usleep( 10 * 1000 );
+	}
+	CHECK_EQUAL( data.GetSizeI(), static_cast< int >( served ) );
+
+	server.ResetCounters();
+	CHECK( ReadThrough( connection, url, data, 100 * 1024 ) );
+	CHECK( RangeMatches( connection, url, data, 7 * SEGMENT + 3, 9 * SEGMENT ) );
+	CHECK_EQUAL( 0, server.GetRequests() );
+	int hits2;
+	int misses2;
+	proxy.GetStats( hits2, misses2, served, firstByte );
+	CHECK_EQUAL( misses, misses2 );
+	CHECK( hits2 > hits );
+	proxy.Stop();
+}
+
+UNIT_TEST( CacheOutlivesTheProxyAndTheServer )
+{
+	Array< UByte > data;
+	MakeVideo( data, 3 * SEGMENT + 5, 3 );
+	String upstream;
+	{
+		HttpTestServer server;
+		CHECK( server.Start() );
+		server.AddFile( "/video.mp4", &data[0], data.GetSizeI(), "video/mp4" );
+		upstream = server.GetUrl( "/video.mp4" );
+		CacheProxy proxy;
+		CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 0 ) );
+		const String url = proxy.GetProxyUrl( upstream.ToCStr() );
+		HttpConnection connection;
+		CHECK( ReadThrough( connection, url, data, SEGMENT ) );
+		proxy.Stop();
+	}
+
+	// offline now: the length, type and every segment come from the card
+	CacheProxy proxy;
+	CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 0 ) );
+	const String url = proxy.GetProxyUrl( upstream.ToCStr() );
+	HttpConnection connection;
+	CHECK( ReadThrough( connection, url, data, 64 * 1024 ) );
+	Array< UByte > body;
+	HttpResponse response;
+	CHECK( HttpFetch( connection, url.ToCStr(), -1, -1, body, &response ) );
+	CHECK_STRING( "video/mp4", response.ContentType.ToCStr() );
+	proxy.Stop();
+}
+
+UNIT_TEST( EvictsLeastRecentlyUsedOverBudget )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	// the smallest budget the proxy allows is four read-ahead windows
+	const SInt64 budget = static_cast< SInt64 >( SEGMENT ) * CacheProxy::READ_AHEAD_SEGMENTS * 4;
+	Array< UByte > first;
+	Array< UByte > second;
+	MakeVideo( first, static_cast< int >( budget * 3 / 4 ), 4 );
+	MakeVideo( second, static_cast< int >( budget * 3 / 4 ), 5 );
+	server.AddFile( "/first.mp4", &first[0], first.GetSizeI() );
+	server.AddFile( "/second.mp4", &second[0], second.GetSizeI() );
+
+	const String dir = CacheDir( "cache" );
+	CacheProxy proxy;
+	CHECK( proxy.Start( dir.ToCStr(), 1 ) );
+	const String firstUrl = proxy.GetProxyUrl( server.GetUrl( "/first.mp4" ).ToCStr() );
+	const String secondUrl = proxy.GetProxyUrl( server.GetUrl( "/second.mp4" ).ToCStr() );
+	HttpConnection connection;
+	CHECK( ReadThrough( connection, firstUrl, first, SEGMENT ) );
+	sleep( 1 );		// segment ages are file times
+	CHECK( ReadThrough( connection, secondUrl, second, SEGMENT ) );
+	proxy.Stop();
+	CHECK( CachedBytes( dir ) <= budget );
+
+	// the end of the second video is still there, the start of the first isn't
+	server.ResetCounters();
+	CHECK( proxy.Start( dir.ToCStr(), 1 ) );
+	CHECK( RangeMatches( connection, proxy.GetProxyUrl( server.GetUrl( "/second.mp4" ).ToCStr() ), second,
+		second.GetSizeI() - 10, second.GetSizeI() - 1 ) );
+	CHECK_EQUAL( 0, server.GetRequests() );
+	CHECK( RangeMatches( connection, proxy.GetProxyUrl( server.GetUrl( "/first.mp4" ).ToCStr() ), first, 0, 10 ) );
+	CHECK( server.GetRequests() > 0 );
+	proxy.Stop();
+}
+
+UNIT_TEST( UpstreamFailureIsABadGateway )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	CacheProxy proxy;
+	CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 0 ) );
+	const String url = proxy.GetProxyUrl( server.GetUrl( "/gone.mp4" ).ToCStr() );
+	HttpConnection connection;
+	Array< UByte > body;
+	HttpResponse response;
+	CHECK( !HttpFetch( connection, url.ToCStr(), 0, 100, body, &response ) );
+	CHECK_EQUAL( 502, response.StatusCode );
+	proxy.Stop();
+}
+
+// Plays the stream the way the player does an EVENT playlist: fetch what
+// is listed, reload, until the list ends. Halfway through the position
+// jumps ahead, as if the download had stalled, which has to switch down.
+UNIT_TEST( AdaptiveStreamListsEachSwitch )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	AddHlsStream( server, 0.0 );
+	CacheProxy proxy;
+	CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 0 ) );
+	proxy.SetPlayPosition( 0.0, false );
+	const String url = proxy.GetProxyUrl( server.GetUrl( "/hls/master.m3u8" ).ToCStr() );
+	const String base( url.ToCStr(), url.GetSize() - strlen( ".m3u8" ) );
+
+	HttpConnection connection;
+	Array< String > served;
+	String playlist;
+	for ( int reload = 0; reload < 100 && CountLines( playlist, "#EXT-X-ENDLIST" ) == 0; reload++ )
+	{
+		Array< UByte > body;
+		CHECK( HttpFetch( connection, url.ToCStr(), -1, -1, body ) );
+		playlist = String( reinterpret_cast< const char * >( body.GetDataPtr() ), body.GetSize() );
+		if ( reload == 0 )
+		{
+			// only the segments whose variant is picked are listed
+			CHECK_EQUAL( 1, CountLines( playlist, "#EXT-X-PLAYLIST-TYPE:EVENT" ) );
+			CHECK_EQUAL( 3, CountLines( playlist, "#EXTINF:2.000," ) );
+		}
+		const int listed = CountLines( playlist, "#EXTINF:" );
+		for ( int i = served.GetSizeI(); i < listed; i++ )
+		{
+			if ( i == 12 )
+			{
+				proxy.SetPlayPosition( 24.0, false );
+			}
+			char segmentUrl[128];
+			snprintf( segmentUrl, sizeof( segmentUrl ), "%s/%i.ts", base.ToCStr(), i );
+			CHECK( HttpFetch( connection, segmentUrl, -1, -1, body ) );
+			CHECK_EQUAL( HLS_SEGMENT_BYTES, body.GetSizeI() );
+			const String label( reinterpret_cast< const char * >( body.GetDataPtr() ) );
+			CHECK_EQUAL( i, atoi( label.ToCStr() + label.GetSize() - 2 ) );
+			served.PushBack( String( label.ToCStr(), label.GetSize() - 3 ) );
+		}
+	}
+	CHECK_EQUAL( 1, CountLines( playlist, "#EXT-X-ENDLIST" ) );
+	CHECK_EQUAL( 0, CountLines( playlist, "#EXT-X-PLAYLIST-TYPE" ) );
+	CHECK_EQUAL( HLS_SEGMENTS, served.GetSizeI() );
+
+	// up once the buffer is deep enough, down right after the jump
+	CHECK( served[0] == "low" );
+	CHECK( served[13] == "high" );
+	CHECK( served[14] == "low" );
+
+	// a discontinuity before every segment whose variant differs from the one before
+	int segment = 0;
+	bool discontinuity = false;
+	int switches = 0;
+	for ( const char * line = playlist.ToCStr(); line != NULL && *line != 0; )
+	{
+		if ( strncmp( line, "#EXT-X-DISCONTINUITY", 20 ) == 0 )
+		{
+			discontinuity = true;
+		}
+		else if ( strncmp( line, "#EXTINF:", 8 ) == 0 )
+		{
+			const bool changed = segment > 0 && !( served[segment] == served[segment - 1] );
+			CHECK_EQUAL( changed, discontinuity );
+			switches += changed;
+			discontinuity = false;
+			segment++;
+		}
+		line = strchr( line, '\n' );
+		line = ( line != NULL ) ? line + 1 : NULL;
+	}
+	CHECK( switches >= 2 );
+
+	// a seek back gets the variant it was listed with
+	Array< UByte > body;
+	const String again = base + "/11.ts";
+	CHECK( HttpFetch( connection, again.ToCStr(), -1, -1, body ) );
+	CHECK( strncmp( reinterpret_cast< const char * >( body.GetDataPtr() ), "high-11", 7 ) == 0 );
+	proxy.Stop();
+}
+
+UNIT_TEST( MisalignedVariantsPlayDirectly )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	// one segment half a second longer in one variant
+	AddHlsStream( server, 0.5 );
+	CacheProxy proxy;
+	CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 0 ) );
+	const String url = proxy.GetProxyUrl( server.GetUrl( "/hls/master.m3u8" ).ToCStr() );
+
+	// redirected to the master playlist itself
+	HttpConnection connection;
+	Array< UByte > body;
+	CHECK( HttpFetch( connection, url.ToCStr(), -1, -1, body ) );
+	CHECK_EQUAL( sizeof( HLS_MASTER ) - 1, body.GetSize() );
+	CHECK( memcmp( body.GetDataPtr(), HLS_MASTER, body.GetSize() ) == 0 );
+
+	HttpResponse response;
+	const String segmentUrl = String( url.ToCStr(), url.GetSize() - strlen( ".m3u8" ) ) + "/0.ts";
+	CHECK( !HttpFetch( connection, segmentUrl.ToCStr(), -1, -1, body, &response ) );
+	CHECK_EQUAL( 404, response.StatusCode );
+	proxy.Stop();
+}
+
+//==============================================================
+// A 16 MB video from a 20 ms away, 8 MB/s upstream, read by the player in
+// 512 KB ranges, then watched again: hit rate, throughput, and the time to
+// the first byte of each range.
+
+UNIT_BENCHMARK( BenchColdAndWarmPasses )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 16 * 1024 * 1024, 6 );
+	server.AddFile( "/video.mp4", &data[0], data.GetSizeI() );
+	server.SetLatencyMs( 20 );
+	server.SetBytesPerSecond( 8 * 1024 * 1024 );
+
+	CacheProxy proxy;
+	CHECK( proxy.Start( CacheDir( "cache" ).ToCStr(), 64 * 1024 * 1024 ) );
+	const String url = proxy.GetProxyUrl( server.GetUrl( "/video.mp4" ).ToCStr() );
+	HttpConnection connection;
+
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		int hits0;
+		int misses0;
+		SInt64 served0;
+		double firstByte0;
+		proxy.GetStats( hits0, misses0, served0, firstByte0 );
+		const double start = OVR::UnitTest::GetSeconds();
+		CHECK( ReadThrough( connection, url, data, 512 * 1024 ) );
+		const double seconds = OVR::UnitTest::GetSeconds() - start;
+		int hits;
+		int misses;
+		SInt64 served;
+		double firstByte;
+		proxy.GetStats( hits, misses, served, firstByte );
+		// GetStats averages over all requests so far; take this pass's share
+		const int requests = data.GetSizeI() / ( 512 * 1024 );
+		const double passFirstByte = ( firstByte * ( ( pass + 1 ) * requests ) - firstByte0 * ( pass * requests ) ) / requests;
+		OVR::UnitTest::Report( "%s pass: %.0f%% hits, %.1f MB/s, %.2f ms to first byte",
+			pass == 0 ? "cold" : "warm", 100.0 * ( hits - hits0 ) / Alg::Max( 1, hits - hits0 + misses - misses0 ),
+			data.GetSizeI() / ( 1024.0 * 1024.0 ) / seconds, passFirstByte * 1000.0 );
+	}
+	proxy.Stop();
+}
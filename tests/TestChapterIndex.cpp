@@ -0,0 +1,518 @@
+/************************************************************************************
+
+Filename    :   TestChapterIndex.cpp
+Content     :   Chapters from Nero chpl, QuickTime chapter tracks and Matroska
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Kernel/OVR_String.h"
+#include "Mp4Builder.h"
+#include "MediaContainer.h"
+#include "ChapterIndex.h"
+
+using namespace OVR;
+
+//==============================================================
+// EbmlBuilder
+//
+// Elements are opened and closed like Mp4Builder boxes. Sizes are
+// always written as 8 byte vints so they can be patched on Close().
+class EbmlBuilder
+{
+public:
+	void	Open( const UInt32 id )
+	{
+		Id( id );
+		Starts.PushBack( Bytes.GetSizeI() );
+		for ( int i = 0; i < 8; i++ )
+		{
+			Bytes.PushBack( 0 );
+		}
+	}
+
+	void	Close()
+	{
+		const int start = Starts.Back();
+		Starts.PopBack();
+		UInt64 size = static_cast< UInt64 >( Bytes.GetSizeI() - start - 8 );
+		for ( int i = 7; i >= 1; i-- )
+		{
+			Bytes[start + i] = static_cast< UByte >( size );
+			size >>= 8;
+		}
+		Bytes[start] = 0x01;
+	}
+
+	void	UInt( const UInt32 id, const UInt64 value )
+	{
+		Open( id );
+		for ( int shift = 56; shift >= 0; shift -= 8 )
+		{
+			Bytes.PushBack( static_cast< UByte >( value >> shift ) );
+		}
+		Close();
+	}
+
+	void	Text( const UInt32 id, const char * text )
+	{
+		Open( id );
+		for ( ; *text != '\0'; text++ )
+		{
+			Bytes.PushBack( static_cast< UByte >( *text ) );
+		}
+		Close();
+	}
+
+	void	Chapter( const UInt64 startNs, const char * title, const int hidden = -1, const int enabled = -1 )
+	{
+		Open( MKV_ID_CHAPTER_ATOM );
+		UInt( MKV_ID_CHAPTER_TIME_START, startNs );
+		if ( hidden >= 0 )
+		{
+			UInt( MKV_ID_CHAPTER_FLAG_HIDDEN, hidden );
+		}
+		if ( enabled >= 0 )
+		{
+			UInt( MKV_ID_CHAPTER_FLAG_ENABLED, enabled );
+		}
+		if ( title != NULL )
+		{
+			Open( MKV_ID_CHAPTER_DISPLAY );
+			Text( MKV_ID_CHAP_STRING, title );
+			Close();
+		}
+		Close();
+	}
+
+	bool	WriteFile( const char * path ) const
+	{
+		FILE * f = fopen( path, "wb" );
+		if ( f == NULL )
+		{
+			return false;
+		}
+		const bool written = fwrite( &Bytes[0], 1, Bytes.GetSize(), f ) == Bytes.GetSize();
+		return fclose( f ) == 0 && written;
+	}
+
+private:
+	Array< UByte >	Bytes;
+	Array< int >	Starts;
+
+	void	Id( const UInt32 id )
+	{
+		bool started = false;
+		for ( int shift = 24; shift >= 0; shift -= 8 )
+		{
+			const UByte b = static_cast< UByte >( id >> shift );
+			if ( started || b != 0 )
+			{
+				Bytes.PushBack( b );
+				started = true;
+			}
+		}
+	}
+};
+
+static String TempPath( const char * name )
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+}
+
+static void WriteFtyp( Mp4Builder & mp4 )
+{
+	mp4.Open( "ftyp" );
+	mp4.Chars( "isom" );
+	mp4.U32( 0 );
+	mp4.Close();
+}
+
+// Nero chapters, given in 100 ns units and not necessarily in order.
+static void WriteChpl( Mp4Builder & mp4, const UByte version, const int count, const UInt64 * starts, const char * const * titles )
+{
+	mp4.Open( "udta" );
+	mp4.OpenFull( "chpl", version );
+	if ( version == 1 )
+	{
+		mp4.U32( 0 );
+	}
+	mp4.U8( static_cast< UByte >( count ) );
+	for ( int i = 0; i < count; i++ )
+	{
+		mp4.U64( starts[i] );
+		mp4.U8( static_cast< UByte >( strlen( titles[i] ) ) );
+		mp4.Chars( titles[i] );
+	}
+	mp4.Close();
+	mp4.Close();
+}
+
+static void WriteTkhd( Mp4Builder & mp4, const UInt32 trackId )
+{
+	mp4.OpenFull( "tkhd" );
+	mp4.U32( 0 );			// creation_time
+	mp4.U32( 0 );			// modification_time
+	mp4.U32( trackId );
+	mp4.Zeros( 12 );
+	mp4.Close();
+}
+
+// A QuickTime chapter file: a video track pointing at a text track through
+// tref / chap. The text samples go in an mdat before the moov, two samples
+// to the first chunk and one to each after it.
+static String WriteQuickTimeChapters( const char * name, const int count, const UByte * const * samples, const int * sampleSizes,
+		const UInt32 * durations, const bool largeOffsets )
+{
+	const UInt32 timescale = 600;
+	Mp4Builder mp4;
+	WriteFtyp( mp4 );
+
+	Array< SInt64 > chunkOffsets;
+	mp4.Open( "mdat" );
+	for ( int i = 0; i < count; i++ )
+	{
+		if ( i == 0 || i >= 2 )
+		{
+			chunkOffsets.PushBack( mp4.GetSize() );
+		}
+		for ( int b = 0; b < sampleSizes[i]; b++ )
+		{
+			mp4.U8( samples[i][b] );
+		}
+	}
+	mp4.Close();
+
+	mp4.Open( "moov" );
+	mp4.Open( "trak" );
+	WriteTkhd( mp4, 1 );
+	mp4.Open( "tref" );
+	mp4.Open( "chap" );
+	mp4.U32( 7 );
+	mp4.Close();
+	mp4.Close();
+	mp4.OpenMedia( "vide", 90000, 0 );
+	mp4.Close();
+	mp4.Close();
+
+	mp4.Open( "trak" );
+	WriteTkhd( mp4, 7 );
+	mp4.OpenMedia( "text", timescale, 0 );
+	mp4.Open( "minf" );
+	mp4.Open( "stbl" );
+	mp4.OpenFull( "stts" );
+	mp4.U32( count );
+	for ( int i = 0; i < count; i++ )
+	{
+		mp4.U32( 1 );
+		mp4.U32( durations[i] * timescale / 1000 );
+	}
+	mp4.Close();
+	mp4.OpenFull( "stsz" );
+	mp4.U32( 0 );
+	mp4.U32( count );
+	for ( int i = 0; i < count; i++ )
+	{
+		mp4.U32( sampleSizes[i] );
+	}
+	mp4.Close();
+	mp4.OpenFull( "stsc" );
+	mp4.U32( 2 );
+	mp4.U32( 1 );
+	mp4.U32( 2 );
+	mp4.U32( 1 );
+	mp4.U32( 2 );
+	mp4.U32( 1 );
+	mp4.U32( 1 );
+	mp4.Close();
+	mp4.OpenFull( largeOffsets ? "co64" : "stco" );
+	mp4.U32( chunkOffsets.GetSize() );
+	for ( int i = 0; i < chunkOffsets.GetSizeI(); i++ )
+	{
+		if ( largeOffsets )
+		{
+			mp4.U64( chunkOffsets[i] );
+		}
+		else
+		{
+			mp4.U32( static_cast< UInt32 >( chunkOffsets[i] ) );
+		}
+	}
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+
+	const String path = TempPath( name );
+	return mp4.WriteFile( path.ToCStr() ) ? path : String();
+}
+
+static void WriteMkvHeader( EbmlBuilder & mkv )
+{
+	mkv.Open( MKV_ID_EBML );
+	mkv.Text( 0x4282, "matroska" );		// DocType
+	mkv.Close();
+}
+
+//==============================================================
+
+UNIT_TEST( ReadsNeroChapters )
+{
+	const UInt64 starts[] = { 0, 1200000000ULL, 600000000ULL };
+	const char * const titles[] = { "Opening", "Encore", "Main set" };
+	for ( UByte version = 0; version <= 1; version++ )
+	{
+		Mp4Builder mp4;
+		WriteFtyp( mp4 );
+		mp4.Open( "moov" );
+		WriteChpl( mp4, version, 3, starts, titles );
+		mp4.Close();
+		const String path = TempPath( "chpl.mp4" );
+		CHECK( mp4.WriteFile( path.ToCStr() ) );
+
+		ChapterIndex index;
+		CHECK( index.BuildFromFile( path.ToCStr() ) );
+		CHECK_EQUAL( 3, index.GetCount() );
+		CHECK_EQUAL( 0, index.GetStartMs( 0 ) );
+		CHECK_EQUAL( 60000, index.GetStartMs( 1 ) );
+		CHECK_EQUAL( 120000, index.GetStartMs( 2 ) );
+		CHECK_STRING( "Opening", index.GetTitle( 0 ) );
+		CHECK_STRING( "Main set", index.GetTitle( 1 ) );
+		CHECK_STRING( "Encore", index.GetTitle( 2 ) );
+	}
+}
+
+UNIT_TEST( ReadsQuickTimeChapterTracks )
+{
+	// 16 bit length, then the text, then a style box that isn't part of the title
+	const UByte plain[] = { 0, 5, 'I', 'n', 't', 'r', 'o', 0, 0, 0, 8, 'e', 'n', 'c', 'd' };
+	// UTF-16 big endian with a byte order mark: "Süd"
+	const UByte utf16[] = { 0, 8, 0xFE, 0xFF, 0x00, 'S', 0x00, 0xFC, 0x00, 'd' };
+	const UByte empty[] = { 0, 0 };
+	const UByte last[] = { 0, 3, 'E', 'n', 'd' };
+	const UByte * const samples[] = { plain, utf16, empty, last };
+	const int sizes[] = { sizeof( plain ), sizeof( utf16 ), sizeof( empty ), sizeof( last ) };
+	const UInt32 durations[] = { 30000, 45000, 5000, 60000 };
+
+	for ( int large = 0; large <= 1; large++ )
+	{
+		const String path = WriteQuickTimeChapters( "chap.mp4", 4, samples, sizes, durations, large != 0 );
+		ChapterIndex index;
+		CHECK( index.BuildFromFile( path.ToCStr() ) );
+		CHECK_EQUAL( 4, index.GetCount() );
+		CHECK_EQUAL( 0, index.GetStartMs( 0 ) );
+		CHECK_EQUAL( 30000, index.GetStartMs( 1 ) );
+		CHECK_EQUAL( 75000, index.GetStartMs( 2 ) );
+		CHECK_EQUAL( 80000, index.GetStartMs( 3 ) );
+		CHECK_STRING( "Intro", index.GetTitle( 0 ) );
+		CHECK_STRING( "S\xC3\xBC" "d", index.GetTitle( 1 ) );
+		CHECK_STRING( "", index.GetTitle( 2 ) );
+		CHECK_STRING( "End", index.GetTitle( 3 ) );
+	}
+}
+
+UNIT_TEST( NeroChaptersWinOverAChapterTrack )
+{
+	// tools that write both write the same chapters twice
+	const UInt64 starts[] = { 0, 100000000ULL };
+	const char * const titles[] = { "A", "B" };
+	Mp4Builder mp4;
+	WriteFtyp( mp4 );
+	mp4.Open( "moov" );
+	mp4.Open( "trak" );
+	WriteTkhd( mp4, 1 );
+	mp4.Open( "tref" );
+	mp4.Open( "chap" );
+	mp4.U32( 2 );
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	WriteChpl( mp4, 0, 2, starts, titles );
+	mp4.Close();
+	const String path = TempPath( "both.mp4" );
+	CHECK( mp4.WriteFile( path.ToCStr() ) );
+
+	ChapterIndex index;
+	CHECK( index.BuildFromFile( path.ToCStr() ) );
+	CHECK_EQUAL( 2, index.GetCount() );
+	CHECK_EQUAL( 10000, index.GetStartMs( 1 ) );
+}
+
+UNIT_TEST( ReadsTheFirstMatroskaEdition )
+{
+	EbmlBuilder mkv;
+	WriteMkvHeader( mkv );
+	mkv.Open( MKV_ID_SEGMENT );
+	mkv.Open( MKV_ID_INFO );
+	mkv.UInt( MKV_ID_TIMECODE_SCALE, 1000000 );
+	mkv.Close();
+	// a cluster before the chapters is skipped by its size
+	mkv.Open( MKV_ID_CLUSTER );
+	mkv.UInt( 0xE7, 0 );		// Timecode
+	mkv.Close();
+	mkv.Open( MKV_ID_CHAPTERS );
+	mkv.Open( MKV_ID_EDITION_ENTRY );
+	mkv.Chapter( 90000000000ULL, "Second" );
+	mkv.Chapter( 0, "First" );
+	mkv.Chapter( 30000000000ULL, "Hidden", 1 );
+	mkv.Chapter( 40000000000ULL, "Disabled", 0, 0 );
+	mkv.Chapter( 120000000000ULL, NULL, 0, 1 );
+	mkv.Close();
+	mkv.Open( MKV_ID_EDITION_ENTRY );
+	mkv.Chapter( 5000000000ULL, "Director's cut" );
+	mkv.Close();
+	mkv.Close();
+	mkv.Close();
+	const String path = TempPath( "chapters.mkv" );
+	CHECK( mkv.WriteFile( path.ToCStr() ) );
+
+	ChapterIndex index;
+	CHECK( index.BuildFromFile( path.ToCStr() ) );
+	CHECK_EQUAL( 3, index.GetCount() );
+	CHECK_EQUAL( 0, index.GetStartMs( 0 ) );
+	CHECK_EQUAL( 90000, index.GetStartMs( 1 ) );
+	CHECK_EQUAL( 120000, index.GetStartMs( 2 ) );
+	CHECK_STRING( "First", index.GetTitle( 0 ) );
+	CHECK_STRING( "Second", index.GetTitle( 1 ) );
+	CHECK_STRING( "", index.GetTitle( 2 ) );
+
+	CHECK_EQUAL( -1, index.FindChapter( -1 ) );
+	CHECK_EQUAL( 0, index.FindChapter( 0 ) );
+	CHECK_EQUAL( 0, index.FindChapter( 89999 ) );
+	CHECK_EQUAL( 1, index.FindChapter( 90000 ) );
+	CHECK_EQUAL( 2, index.FindChapter( 1000000 ) );
+}
+
+UNIT_TEST( FilesWithoutChaptersAreEmpty )
+{
+	ChapterIndex index;
+	CHECK( !index.BuildFromFile( TempPath( "missing.mp4" ).ToCStr() ) );
+
+	Mp4Builder mp4;
+	WriteFtyp( mp4 );
+	mp4.Open( "moov" );
+	mp4.Open( "trak" );
+	WriteTkhd( mp4, 1 );
+	mp4.Close();
+	mp4.Close();
+	const String mp4Path = TempPath( "plain.mp4" );
+	CHECK( mp4.WriteFile( mp4Path.ToCStr() ) );
+	CHECK( !index.BuildFromFile( mp4Path.ToCStr() ) );
+	CHECK( index.IsEmpty() );
+
+	EbmlBuilder mkv;
+	WriteMkvHeader( mkv );
+	mkv.Open( MKV_ID_SEGMENT );
+	mkv.Open( MKV_ID_INFO );
+	mkv.Close();
+	mkv.Close();
+	const String mkvPath = TempPath( "plain.mkv" );
+	CHECK( mkv.WriteFile( mkvPath.ToCStr() ) );
+	CHECK( !index.BuildFromFile( mkvPath.ToCStr() ) );
+
+	const String textPath = TempPath( "notes.txt" );
+	FILE * f = fopen( textPath.ToCStr(), "wb" );
+	CHECK( f != NULL );
+	fputs( "not a container at all", f );
+	fclose( f );
+	CHECK( !index.BuildFromFile( textPath.ToCStr() ) );
+	CHECK( index.IsEmpty() );
+}
+
+UNIT_TEST( CancelStopsAChapterTrack )
+{
+	const UByte sample[] = { 0, 1, 'x' };
+	const UByte * const samples[] = { sample, sample, sample };
+	const int sizes[] = { 3, 3, 3 };
+	const UInt32 durations[] = { 1000, 1000, 1000 };
+	const String path = WriteQuickTimeChapters( "cancel.mp4", 3, samples, sizes, durations, false );
+
+	const volatile bool cancel = true;
+	ChapterIndex index;
+	CHECK( !index.BuildFromFile( path.ToCStr(), &cancel ) );
+	CHECK( index.IsEmpty() );
+}
+
+//==============================================================
+// Parsing runs on the index loader thread, but shouldn't be noticeable
+// next to opening the file at all: a camera file with no chapters and a
+// 2 GB mdat ahead of the moov, and a concert with 200 Nero chapters.
+
+UNIT_BENCHMARK( BenchBuildCost )
+{
+	Mp4Builder mp4;
+	WriteFtyp( mp4 );
+	mp4.Open( "mdat" );
+	mp4.Close();
+	const int mdatHeader = mp4.GetSize() - 8;
+	const UInt32 mdatSize = 0x80000000u;
+	mp4.Patch32( mdatHeader, mdatSize );
+	const String plainPath = TempPath( "camera.mp4" );
+	CHECK( mp4.WriteFile( plainPath.ToCStr() ) );
+	{
+		// the moov after a sparse mdat
+		Mp4Builder moov;
+		moov.Open( "moov" );
+		moov.Open( "trak" );
+		WriteTkhd( moov, 1 );
+		moov.Close();
+		moov.Close();
+		FILE * f = fopen( plainPath.ToCStr(), "r+b" );
+		CHECK( f != NULL );
+		fseeko( f, mdatHeader + static_cast< off_t >( mdatSize ), SEEK_SET );
+		fwrite( moov.GetData(), 1, moov.GetSize(), f );
+		fclose( f );
+	}
+
+	const int chapters = 200;
+	UInt64 starts[chapters];
+	char titleText[chapters][32];
+	const char * titles[chapters];
+	for ( int i = 0; i < chapters; i++ )
+	{
+		starts[i] = static_cast< UInt64 >( i ) * 30 * 10000000;
+		snprintf( titleText[i], sizeof( titleText[i] ), "Song number %i", i + 1 );
+		titles[i] = titleText[i];
+	}
+	Mp4Builder concert;
+	WriteFtyp( concert );
+	concert.Open( "moov" );
+	WriteChpl( concert, 0, chapters, starts, titles );
+	concert.Close();
+	const String concertPath = TempPath( "concert.mp4" );
+	CHECK( concert.WriteFile( concertPath.ToCStr() ) );
+
+	const int runs = 200;
+	ChapterIndex index;
+	double start = OVR::UnitTest::GetSeconds();
+	for ( int i = 0; i < runs; i++ )
+	{
+		CHECK( !index.BuildFromFile( plainPath.ToCStr() ) );
+	}
+	const double plainSeconds = ( OVR::UnitTest::GetSeconds() - start ) / runs;
+
+	start = OVR::UnitTest::GetSeconds();
+	for ( int i = 0; i < runs; i++ )
+	{
+		CHECK( index.BuildFromFile( concertPath.ToCStr() ) );
+	}
+	const double concertSeconds = ( OVR::UnitTest::GetSeconds() - start ) / runs;
+	CHECK_EQUAL( chapters, index.GetCount() );
+
+	OVR::UnitTest::Report( "no chapters, moov after 2 GB: %.1f us", plainSeconds * 1e6 );
+	OVR::UnitTest::Report( "%i Nero chapters: %.1f us", chapters, concertSeconds * 1e6 );
+}
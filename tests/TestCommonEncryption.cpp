@@ -0,0 +1,502 @@
+/************************************************************************************
+
+Filename    :   TestCommonEncryption.cpp
+Content     :   AES known answers, CENC sample decryption and protected files
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Kernel/OVR_String.h"
+#include "CommonEncryption.h"
+#include "MediaContainer.h"
+#include "CencMp4.h"
+
+using namespace OVR;
+
+static void FromHex( const char * hex, UByte * out )
+{
+	for ( int i = 0; hex[i * 2] != '\0'; i++ )
+	{
+		char byte[3] = { hex[i * 2], hex[i * 2 + 1], '\0' };
+		out[i] = static_cast< UByte >( strtol( byte, NULL, 16 ) );
+	}
+}
+
+static bool Matches( const UByte * data, const char * hex )
+{
+	UByte expected[64];
+	FromHex( hex, expected );
+	return memcmp( data, expected, strlen( hex ) / 2 ) == 0;
+}
+
+// The tables everywhere, and the instructions where the CPU has them.
+static int NumImplementations()
+{
+	return Aes128::SetImplementation( "tables" ) && ( Aes128::SetImplementation( "aes-ni" ) ||
+		Aes128::SetImplementation( "armv8-ce" ) ) ? 2 : 1;
+}
+
+static const char * UseImplementation( const int index )
+{
+	Aes128::SetImplementation( "tables" );
+	if ( index > 0 && !Aes128::SetImplementation( "aes-ni" ) )
+	{
+		Aes128::SetImplementation( "armv8-ce" );
+	}
+	return Aes128::GetImplementation();
+}
+
+static const UByte TEST_KID[16] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f };
+static const UByte TEST_KEY[16] = { 0x3a, 0x2a, 0x1b, 0x68, 0xdd, 0x2b, 0xd9, 0xb2, 0xee, 0xb2, 0x5e, 0x84, 0xc4, 0x77, 0x6f, 0xa0 };
+
+static String WriteProtectedFile( const char * name, const int numFragments, CencMp4 & mp4 )
+{
+	mp4.WriteHeader();
+	for ( int i = 0; i < numFragments; i++ )
+	{
+		mp4.WriteFragment( i, 12 );
+	}
+	const String path = String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+	mp4.File.WriteFile( path.ToCStr() );
+	return path;
+}
+
+static bool ReadWholeFile( const String & path, Array< UByte > & out )
+{
+	MediaFile file;
+	return file.Open( path.ToCStr() ) && file.ReadArray( 0, static_cast< int >( file.GetSize() ), out );
+}
+
+static int CountMismatchedSamples( const CencMp4 & mp4, const Array< UByte > & file )
+{
+	int mismatched = 0;
+	for ( int i = 0; i < mp4.Samples.GetSizeI(); i++ )
+	{
+		const CencMp4::Sample & sample = mp4.Samples[i];
+		mismatched += memcmp( &file[sample.Offset], &sample.Clear[0], sample.Clear.GetSize() ) != 0;
+	}
+	return mismatched;
+}
+
+static CencKey TestKey()
+{
+	CencKey key;
+	memcpy( key.Kid, TEST_KID, 16 );
+	memcpy( key.Key, TEST_KEY, 16 );
+	return key;
+}
+
+//==============================================================
+// FIPS-197 appendix C.1 and NIST SP 800-38A F.2.2 and F.5.1
+
+static const char * SP800_KEY = "2b7e151628aed2a6abf7158809cf4f3c";
+static const char * SP800_PLAIN =
+	"6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+	"30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+
+UNIT_TEST( EncryptsTheFipsBlock )
+{
+	for ( int impl = 0; impl < NumImplementations(); impl++ )
+	{
+		UseImplementation( impl );
+		UByte key[16], counter[16], block[16];
+		FromHex( "000102030405060708090a0b0c0d0e0f", key );
+		FromHex( "00112233445566778899aabbccddeeff", counter );
+		memset( block, 0, sizeof( block ) );
+		Aes128 aes;
+		aes.SetKey( key );
+		// the key stream of the first block is the plaintext block encrypted
+		int blockOffset = 0;
+		aes.Ctr( block, 16, counter, blockOffset );
+		CHECK( Matches( block, "69c4e0d86a7b0430d8cdb78070b4c55a" ) );
+
+		UByte iv[16];
+		memset( iv, 0, sizeof( iv ) );
+		aes.DecryptCbc( block, 1, iv );
+		CHECK( Matches( block, "00112233445566778899aabbccddeeff" ) );
+	}
+}
+
+UNIT_TEST( MatchesTheCtrVectors )
+{
+	for ( int impl = 0; impl < NumImplementations(); impl++ )
+	{
+		UseImplementation( impl );
+		UByte key[16], data[64];
+		FromHex( SP800_KEY, key );
+		Aes128 aes;
+		aes.SetKey( key );
+		static const char * cipher =
+			"874d6191b620e3261bef6864990db6ce9806f66b7970fdff8617187bb9fffdff"
+			"5ae4df3edbd5d35e5b4f09020db03eab1e031dda2fbe03d1792170a0f3009cee";
+
+		// in one call, and in ranges that stop inside blocks
+		static const int splits[][4] = { { 64, 0, 0, 0 }, { 5, 11, 33, 15 }, { 1, 16, 46, 1 } };
+		for ( int s = 0; s < 3; s++ )
+		{
+			FromHex( SP800_PLAIN, data );
+			UByte counter[16];
+			FromHex( "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff", counter );
+			int blockOffset = 0;
+			int pos = 0;
+			for ( int i = 0; i < 4 && pos < 64; i++ )
+			{
+				aes.Ctr( data + pos, splits[s][i], counter, blockOffset );
+				pos += splits[s][i];
+			}
+			CHECK( Matches( data, cipher ) );
+		}
+	}
+}
+
+UNIT_TEST( MatchesTheCbcVectors )
+{
+	for ( int impl = 0; impl < NumImplementations(); impl++ )
+	{
+		UseImplementation( impl );
+		UByte key[16], data[64], iv[16];
+		FromHex( SP800_KEY, key );
+		FromHex( "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+				 "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7", data );
+		FromHex( "000102030405060708090a0b0c0d0e0f", iv );
+		Aes128 aes;
+		aes.SetKey( key );
+		// continued across calls through iv
+		aes.DecryptCbc( data, 1, iv );
+		aes.DecryptCbc( data + 16, 3, iv );
+		CHECK( Matches( data, SP800_PLAIN ) );
+		CHECK( Matches( iv, "3ff1caa1681fac09120eca307586e1a7" ) );
+	}
+}
+
+// Only the low 64 bits of the counter carry, as CENC specifies.
+UNIT_TEST( WrapsTheLowHalfOfTheCounter )
+{
+	for ( int impl = 0; impl < NumImplementations(); impl++ )
+	{
+		UseImplementation( impl );
+		UByte key[16], wrapped[32], expected[32], counter[16];
+		FromHex( SP800_KEY, key );
+		Aes128 aes;
+		aes.SetKey( key );
+		memset( wrapped, 0, sizeof( wrapped ) );
+		FromHex( "0123456789abcdefffffffffffffffff", counter );
+		int blockOffset = 0;
+		aes.Ctr( wrapped, 32, counter, blockOffset );
+		CHECK( Matches( counter, "0123456789abcdef0000000000000001" ) );
+
+		// the second block is the one for a counter whose high half didn't change
+		memset( expected, 0, sizeof( expected ) );
+		FromHex( "0123456789abcdef0000000000000000", counter );
+		blockOffset = 0;
+		aes.Ctr( expected, 16, counter, blockOffset );
+		CHECK( memcmp( wrapped + 16, expected, 16 ) == 0 );
+	}
+}
+
+// Both implementations agree on long runs, across the unrolled loops' tails.
+UNIT_TEST( ImplementationsAgree )
+{
+	if ( NumImplementations() < 2 )
+	{
+		return;
+	}
+	UByte key[16];
+	FromHex( SP800_KEY, key );
+	Array< UByte > results[2];
+	for ( int impl = 0; impl < 2; impl++ )
+	{
+		UseImplementation( impl );
+		Aes128 aes;
+		aes.SetKey( key );
+		results[impl].Resize( 16 * 1027 );
+		for ( int i = 0; i < results[impl].GetSizeI(); i++ )
+		{
+			results[impl][i] = static_cast< UByte >( i * 7 );
+		}
+		UByte counter[16];
+		FromHex( "f0f1f2f3f4f5f6f7fffffffffffffff0", counter );
+		int blockOffset = 0;
+		aes.Ctr( &results[impl][0], 16 * 515 + 3, counter, blockOffset );
+		UByte iv[16];
+		memset( iv, 0x5c, sizeof( iv ) );
+		aes.DecryptCbc( &results[impl][16 * 515], 511, iv );
+	}
+	UseImplementation( 1 );
+	CHECK( memcmp( &results[0][0], &results[1][0], results[0].GetSize() ) == 0 );
+}
+
+UNIT_TEST( ParsesKids )
+{
+	UByte kid[16];
+	CHECK( CencParseKid( "10111213-1415-1617-1819-1a1b1c1d1e1f", kid ) );
+	CHECK( memcmp( kid, TEST_KID, 16 ) == 0 );
+	CHECK( CencParseKid( "101112131415161718191A1B1C1D1E1F", kid ) );
+	CHECK( memcmp( kid, TEST_KID, 16 ) == 0 );
+	CHECK( !CencParseKid( "1011121314151617", kid ) );
+	CHECK( !CencParseKid( "10111213-1415-1617-1819-1a1b1c1d1e1f00", kid ) );
+	CHECK( !CencParseKid( "x0111213-1415-1617-1819-1a1b1c1d1e1f", kid ) );
+}
+
+//==============================================================
+// Segments and files
+
+UNIT_TEST( DecryptsSegmentsInMemory )
+{
+	CencMp4 mp4( TEST_KID, TEST_KEY );
+	mp4.WriteHeader();
+	const int initSize = mp4.File.GetSize();
+	mp4.WriteFragment( 0, 20 );
+	mp4.WriteFragment( 1, 20 );
+
+	Array< UByte > data;
+	data.Resize( mp4.File.GetSize() );
+	memcpy( &data[0], mp4.File.GetData(), data.GetSize() );
+
+	CencDecryptor decryptor;
+	CHECK( decryptor.ParseInit( &data[0], initSize ) );
+	CHECK( decryptor.IsProtected() );
+	CHECK( memcmp( decryptor.GetKid(), TEST_KID, 16 ) == 0 );
+	// no key yet
+	CHECK( !decryptor.DecryptSegment( &data[initSize], data.GetSizeI() - initSize, initSize ) );
+	Array< CencKey > keys;
+	CHECK( !decryptor.SetKey( keys ) );
+	keys.PushBack( TestKey() );
+	CHECK( decryptor.SetKey( keys ) );
+	// the segments as DASH would have them, apart from the init segment
+	CHECK( decryptor.DecryptSegment( &data[initSize], data.GetSizeI() - initSize, initSize ) );
+	CHECK_EQUAL( 0, CountMismatchedSamples( mp4, data ) );
+
+	// the clear track
+	CencDecryptor audio;
+	CHECK( audio.ParseInit( &data[0], initSize, CencMp4::AUDIO_TRACK ) );
+	CHECK( !audio.IsProtected() );
+}
+
+UNIT_TEST( RejectsMalformedSegments )
+{
+	CencMp4 mp4( TEST_KID, TEST_KEY );
+	mp4.WriteHeader();
+	const int initSize = mp4.File.GetSize();
+	mp4.WriteFragment( 0, 8 );
+	Array< CencKey > keys;
+	keys.PushBack( TestKey() );
+	CencDecryptor decryptor;
+	CHECK( decryptor.ParseInit( mp4.File.GetData(), initSize, CencMp4::VIDEO_TRACK ) );
+	CHECK( decryptor.SetKey( keys ) );
+
+	// cut short at every length: false or true, never out of bounds
+	const int size = mp4.File.GetSize() - initSize;
+	Array< UByte > data;
+	for ( int length = 0; length < size; length += 7 )
+	{
+		data.Resize( length + 1 );
+		memcpy( &data[0], mp4.File.GetData() + initSize, length );
+		decryptor.DecryptSegment( &data[0], length, initSize );
+	}
+	data.Resize( size );
+	memcpy( &data[0], mp4.File.GetData() + initSize, size );
+	// fewer senc entries than samples
+	for ( int i = 0; i + 8 <= size; i++ )
+	{
+		if ( memcmp( &data[i + 4], "senc", 4 ) == 0 )
+		{
+			WriteBE32( &data[i + 12], 3 );
+			break;
+		}
+	}
+	CHECK( !decryptor.DecryptSegment( &data[0], size, initSize ) );
+}
+
+UNIT_TEST( ReadsTheKidsOfAFile )
+{
+	CencMp4 mp4( TEST_KID, TEST_KEY );
+	const String path = WriteProtectedFile( "kids.mp4", 2, mp4 );
+	Array< CencKey > kids;
+	CHECK( CencReadFileKids( path.ToCStr(), kids ) );
+	CHECK_EQUAL( 1, kids.GetSizeI() );
+	CHECK( memcmp( kids[0].Kid, TEST_KID, 16 ) == 0 );
+
+	// not an MP4
+	const String other = String( OVR::UnitTest::GetTempDir() ) + "/kids.txt";
+	Mp4Builder text;
+	text.Chars( "not a video" );
+	text.WriteFile( other.ToCStr() );
+	kids.Clear();
+	CHECK( !CencReadFileKids( other.ToCStr(), kids ) );
+	CHECK_EQUAL( 0, kids.GetSizeI() );
+	unlink( path.ToCStr() );
+	unlink( other.ToCStr() );
+}
+
+UNIT_TEST( DecryptsFilesInPlace )
+{
+	CencMp4 mp4( TEST_KID, TEST_KEY );
+	const String path = WriteProtectedFile( "protected.mp4", 4, mp4 );
+	Array< UByte > before;
+	CHECK( ReadWholeFile( path, before ) );
+	CHECK( CountMismatchedSamples( mp4, before ) > 0 );
+
+	// without the key nothing is touched
+	Array< CencKey > keys;
+	CHECK( !CencDecryptFile( path.ToCStr(), keys ) );
+	Array< UByte > after;
+	CHECK( ReadWholeFile( path, after ) );
+	CHECK( after.GetSize() == before.GetSize() && memcmp( &after[0], &before[0], before.GetSize() ) == 0 );
+
+	keys.PushBack( TestKey() );
+	CHECK( CencDecryptFile( path.ToCStr(), keys ) );
+	CHECK( ReadWholeFile( path, after ) );
+	CHECK_EQUAL( before.GetSizeI(), after.GetSizeI() );
+	CHECK_EQUAL( 0, CountMismatchedSamples( mp4, after ) );
+
+	// a player sees a clear avc1 track and no encryption boxes
+	MediaFile file;
+	CHECK( file.Open( path.ToCStr() ) );
+	Mp4Box moov, trak, mdia, minf, stbl, stsd, entry;
+	CHECK( Mp4FindTopLevel( file, MP4_FOURCC( 'm', 'o', 'o', 'v' ), moov ) );
+	CHECK( Mp4FindTrack( file, moov, MP4_FOURCC( 'v', 'i', 'd', 'e' ), trak ) );
+	CHECK( Mp4FindChild( file, trak, MP4_FOURCC( 'm', 'd', 'i', 'a' ), mdia ) &&
+		Mp4FindChild( file, mdia, MP4_FOURCC( 'm', 'i', 'n', 'f' ), minf ) &&
+		Mp4FindChild( file, minf, MP4_FOURCC( 's', 't', 'b', 'l' ), stbl ) &&
+		Mp4FindChild( file, stbl, MP4_FOURCC( 's', 't', 's', 'd' ), stsd ) );
+	CHECK( Mp4ReadBox( file, stsd.DataOffset + 8, stsd.End, entry ) );
+	CHECK_EQUAL( MP4_FOURCC( 'a', 'v', 'c', '1' ), entry.Type );
+	Mp4Box box;
+	CHECK( !Mp4FindChild( file, entry, MP4_FOURCC( 's', 'i', 'n', 'f' ), box, 78 ) );
+	CHECK( !Mp4FindChild( file, moov, MP4_FOURCC( 'p', 's', 's', 'h' ), box ) );
+	Array< CencKey > kids;
+	CHECK( !CencReadFileKids( path.ToCStr(), kids ) );
+	file.Close();
+
+	// again, as after an interruption: nothing changes
+	Array< UByte > again;
+	CHECK( CencDecryptFile( path.ToCStr(), keys ) );
+	CHECK( ReadWholeFile( path, again ) );
+	CHECK( again.GetSize() == after.GetSize() && memcmp( &again[0], &after[0], after.GetSize() ) == 0 );
+	unlink( path.ToCStr() );
+}
+
+// Stopped after some fragments: those are skipped, the rest decrypted.
+UNIT_TEST( ContinuesAnInterruptedFile )
+{
+	CencMp4 mp4( TEST_KID, TEST_KEY );
+	const String path = WriteProtectedFile( "interrupted.mp4", 4, mp4 );
+	Array< UByte > data;
+	CHECK( ReadWholeFile( path, data ) );
+
+	// the same first two fragments decrypted, under the protected moov
+	const String first = String( OVR::UnitTest::GetTempDir() ) + "/first.mp4";
+	CencMp4 half( TEST_KID, TEST_KEY );
+	WriteProtectedFile( "first.mp4", 2, half );
+	Array< CencKey > keys;
+	keys.PushBack( TestKey() );
+	CHECK( CencDecryptFile( first.ToCStr(), keys ) );
+	Array< UByte > decrypted;
+	CHECK( ReadWholeFile( first, decrypted ) );
+	Mp4Box moovBox;
+	MediaFile file;
+	CHECK( file.Open( path.ToCStr() ) );
+	CHECK( Mp4FindTopLevel( file, MP4_FOURCC( 'm', 'o', 'o', 'v' ), moovBox ) );
+	file.Close();
+	memcpy( &data[static_cast< int >( moovBox.End )], &decrypted[static_cast< int >( moovBox.End )],
+		decrypted.GetSize() - static_cast< int >( moovBox.End ) );
+	Mp4Builder patched;
+	for ( int i = 0; i < data.GetSizeI(); i++ )
+	{
+		patched.U8( data[i] );
+	}
+	CHECK( patched.WriteFile( path.ToCStr() ) );
+
+	CHECK( CencDecryptFile( path.ToCStr(), keys ) );
+	Array< UByte > after;
+	CHECK( ReadWholeFile( path, after ) );
+	CHECK_EQUAL( 0, CountMismatchedSamples( mp4, after ) );
+	unlink( path.ToCStr() );
+	unlink( first.ToCStr() );
+}
+
+//==============================================================
+// 64 MB through each mode on each implementation, and CENC samples of a
+// few hundred bytes with clear headers, about the worst case per byte.
+
+UNIT_BENCHMARK( BenchAes )
+{
+	UByte key[16];
+	FromHex( SP800_KEY, key );
+	Array< UByte > data;
+	data.Resize( 64 * 1024 * 1024 );
+	memset( &data[0], 0x3c, data.GetSize() );
+	const double gb = data.GetSize() / ( 1024.0 * 1024.0 * 1024.0 );
+	for ( int impl = 0; impl < NumImplementations(); impl++ )
+	{
+		const char * name = UseImplementation( impl );
+		Aes128 aes;
+		aes.SetKey( key );
+		UByte counter[16];
+		memset( counter, 0, sizeof( counter ) );
+		int blockOffset = 0;
+		double start = OVR::UnitTest::GetSeconds();
+		aes.Ctr( &data[0], data.GetSizeI(), counter, blockOffset );
+		const double ctr = OVR::UnitTest::GetSeconds() - start;
+		UByte iv[16];
+		memset( iv, 0, sizeof( iv ) );
+		start = OVR::UnitTest::GetSeconds();
+		aes.DecryptCbc( &data[0], data.GetSizeI() / 16, iv );
+		const double cbc = OVR::UnitTest::GetSeconds() - start;
+		OVR::UnitTest::Report( "%-8s ctr %.2f GB/s, cbc decrypt %.2f GB/s", name, gb / ctr, gb / cbc );
+	}
+	UseImplementation( 1 );
+}
+
+UNIT_BENCHMARK( BenchSegments )
+{
+	CencMp4 mp4( TEST_KID, TEST_KEY );
+	mp4.WriteHeader();
+	const int initSize = mp4.File.GetSize();
+	for ( int i = 0; i < 16; i++ )
+	{
+		mp4.WriteFragment( i, 2000 );
+	}
+	Array< CencKey > keys;
+	keys.PushBack( TestKey() );
+	int numVideo = 0;
+	double videoMb = 0.0;
+	for ( int i = 0; i < mp4.Samples.GetSizeI(); i++ )
+	{
+		if ( mp4.Samples[i].Track == CencMp4::VIDEO_TRACK )
+		{
+			numVideo++;
+			videoMb += mp4.Samples[i].Clear.GetSizeI() / ( 1024.0 * 1024.0 );
+		}
+	}
+	for ( int impl = 0; impl < NumImplementations(); impl++ )
+	{
+		const char * name = UseImplementation( impl );
+		Array< UByte > data;
+		data.Resize( mp4.File.GetSize() );
+		memcpy( &data[0], mp4.File.GetData(), data.GetSize() );
+		CencDecryptor decryptor;
+		CHECK( decryptor.ParseInit( &data[0], initSize, CencMp4::VIDEO_TRACK ) && decryptor.SetKey( keys ) );
+		const double start = OVR::UnitTest::GetSeconds();
+		CHECK( decryptor.DecryptSegment( &data[initSize], data.GetSizeI() - initSize, initSize ) );
+		const double seconds = OVR::UnitTest::GetSeconds() - start;
+		CHECK_EQUAL( 0, CountMismatchedSamples( mp4, data ) );
+		OVR::UnitTest::Report( "%-8s %i video samples, %.1f MB in %.1f ms, %.2f GB/s", name, numVideo,
+			videoMb, seconds * 1000.0, videoMb / 1024.0 / seconds );
+	}
+	UseImplementation( 1 );
+}
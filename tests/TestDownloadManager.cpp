@@ -0,0 +1,399 @@
+/************************************************************************************
+
+Filename    :   TestDownloadManager.cpp
+Content     :   Parallel ranged downloads, dropped connections and resume
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <string.h>
+#include <unistd.h>
+
+#include "Kernel/OVR_String.h"
+#include "HttpTestServer.h"
+#include "HttpClient.h"
+#include "MediaContainer.h"
+#include "DownloadManager.h"
+#include "CencMp4.h"
+
+using namespace OVR;
+
+static const int CHUNK = DownloadManager::CHUNK_BYTES;
+
+static void MakeVideo( Array< UByte > & data, const int size, const UInt32 seed )
+{
+	data.Resize( size );
+	UInt32 state = seed;
+	for ( int i = 0; i < size; i++ )
+	{
+		state = state * 1664525u + 1013904223u;
+		data[i] = static_cast< UByte >( state >> 24 );
+	}
+}
+
+static String TempPath( const char * name )
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+}
+
+static bool Exists( const String & path )
+{
+	return access( path.ToCStr(), F_OK ) == 0;
+}
+
+static bool FileMatches( const String & path, const Array< UByte > & data )
+{
+	MediaFile file;
+	Array< UByte > contents;
+	return file.Open( path.ToCStr() ) && file.GetSize() == data.GetSizeI() &&
+		file.ReadArray( 0, data.GetSizeI(), contents ) && memcmp( &contents[0], &data[0], data.GetSize() ) == 0;
+}
+
+// Polls for a finished path, the way the VR thread does every frame.
+static bool WaitForFinished( DownloadManager & manager, const String & path, const double seconds )
+{
+	const double end = OVR::UnitTest::GetSeconds() + seconds;
+	while ( OVR::UnitTest::GetSeconds() < end )
+	{
+		Array< String > finished;
+		manager.TakeFinished( finished );
+		for ( int i = 0; i < finished.GetSizeI(); i++ )
+		{
+			if ( finished[i] == path )
+			{
+				return true;
+			}
+		}
+		usleep( 5 * 1000 );
+	}
+	return false;
+}
+
+static bool WaitForProgress( DownloadManager & manager, const float progress, const double seconds )
+{
+	const double end = OVR::UnitTest::GetSeconds() + seconds;
+	while ( OVR::UnitTest::GetSeconds() < end )
+	{
+		if ( manager.GetProgress() >= progress )
+		{
+			return true;
+		}
+		usleep( 5 * 1000 );
+	}
+	return false;
+}
+
+// A server that ignores Range, as some CDNs do for small objects.
+static bool IgnoreRanges( void * user, const HttpTestServer::Request & request, HttpTestServer::Reply & outReply )
+{
+	if ( !( request.Path == "/norange.mp4" ) )
+	{
+		return false;
+	}
+	const Array< UByte > & data = *static_cast< const Array< UByte > * >( user );
+	outReply.Body = data;
+	return true;
+}
+
+static const UByte LICENSE_KID[16] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f };
+static const UByte LICENSE_KEY[16] = { 0x3a, 0x2a, 0x1b, 0x68, 0xdd, 0x2b, 0xd9, 0xb2, 0xee, 0xb2, 0x5e, 0x84, 0xc4, 0x77, 0x6f, 0xa0 };
+
+// A ClearKey license server with the one key, counting its requests.
+static bool ServeLicense( void * user, const HttpTestServer::Request & request, HttpTestServer::Reply & outReply )
+{
+	if ( !( request.Path == "/license" ) || !( request.Method == "POST" ) )
+	{
+		return false;
+	}
+	( *static_cast< int * >( user ) )++;
+	outReply.ContentType = "application/json";
+	outReply.SetBody( "{\"keys\":[{\"kty\":\"oct\",\"kid\":\"EBESExQVFhcYGRobHB0eHw\",\"k\":\"OiobaN0r2bLusl6ExHdvoA\"}],\"type\":\"temporary\"}" );
+	return true;
+}
+
+static int CountClearSamples( const CencMp4 & mp4, const String & path )
+{
+	MediaFile file;
+	Array< UByte > contents;
+	if ( !file.Open( path.ToCStr() ) || !file.ReadArray( 0, static_cast< int >( file.GetSize() ), contents ) )
+	{
+		return -1;
+	}
+	int clear = 0;
+	for ( int i = 0; i < mp4.Samples.GetSizeI(); i++ )
+	{
+		clear += memcmp( &contents[mp4.Samples[i].Offset], &mp4.Samples[i].Clear[0], mp4.Samples[i].Clear.GetSize() ) == 0;
+	}
+	return clear;
+}
+
+//==============================================================
+
+UNIT_TEST( DownloadsOverParallelConnections )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 5 * CHUNK + 4321, 1 );
+	server.AddFile( "/video.mp4", &data[0], data.GetSizeI(), "video/mp4", "\"v1\"" );
+	// slow enough per connection that the chunks overlap
+	server.SetBytesPerSecond( 16 * 1024 * 1024 );
+
+	const String path = TempPath( "video.mp4" );
+	const String url = server.GetUrl( "/video.mp4" );
+	DownloadManager manager;
+	manager.Start();
+	CHECK( manager.GetProgress() < 0.0f );
+	manager.Enqueue( url.ToCStr(), path.ToCStr() );
+	// queued once
+	manager.Enqueue( url.ToCStr(), path.ToCStr() );
+	CHECK( manager.IsQueued( url.ToCStr() ) );
+	CHECK( WaitForFinished( manager, path, 20.0 ) );
+	CHECK( !manager.IsQueued( url.ToCStr() ) );
+	manager.Stop();
+
+	CHECK( FileMatches( path, data ) );
+	CHECK( !Exists( path + ".download" ) );
+	CHECK( !Exists( path + ".chunks" ) );
+	// a one byte probe, then each chunk once, over more than one connection
+	CHECK_EQUAL( 1 + 6, server.GetRequests() );
+	CHECK( server.GetConnections() > 1 && server.GetConnections() <= DownloadManager::CONNECTIONS );
+	CHECK_EQUAL( static_cast< SInt64 >( data.GetSizeI() + 1 ), server.GetBodyBytes() );
+
+	// a file that is already there isn't downloaded again
+	server.ResetCounters();
+	manager.Start();
+	manager.Enqueue( url.ToCStr(), path.ToCStr() );
+	CHECK( !manager.IsQueued( url.ToCStr() ) );
+	manager.Stop();
+	CHECK_EQUAL( 0, server.GetRequests() );
+}
+
+UNIT_TEST( SurvivesDroppedConnections )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 4 * CHUNK, 2 );
+	server.AddFile( "/video.mp4", &data[0], data.GetSizeI() );
+	// every third response is cut off part way through its body
+	server.SetDropEvery( 3, 100 * 1024 );
+
+	const String path = TempPath( "dropped.mp4" );
+	DownloadManager manager;
+	manager.Start();
+	manager.Enqueue( server.GetUrl( "/video.mp4" ).ToCStr(), path.ToCStr() );
+	CHECK( WaitForFinished( manager, path, 30.0 ) );
+	manager.Stop();
+	CHECK( server.GetDropped() > 0 );
+	CHECK( FileMatches( path, data ) );
+}
+
+UNIT_TEST( ResumesFromTheChunkBitmap )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 12 * CHUNK + 77, 3 );
+	server.AddFile( "/video.mp4", &data[0], data.GetSizeI(), "video/mp4", "\"v1\"" );
+	// a second per chunk, so Stop lands well before the last ones
+	server.SetBytesPerSecond( 1024 * 1024 );
+
+	const String path = TempPath( "resumed.mp4" );
+	const String url = server.GetUrl( "/video.mp4" );
+	{
+		DownloadManager manager;
+		manager.Start();
+		manager.Enqueue( url.ToCStr(), path.ToCStr() );
+		CHECK( WaitForProgress( manager, 0.25f, 20.0 ) );
+		manager.Stop();
+	}
+	CHECK( !Exists( path ) );
+	CHECK( Exists( path + ".download" ) );
+	CHECK( Exists( path + ".chunks" ) );
+	const SInt64 firstRun = server.GetBodyBytes();
+	CHECK( firstRun < data.GetSizeI() );
+
+	server.ResetCounters();
+	server.SetBytesPerSecond( 0 );
+	DownloadManager manager;
+	manager.Start();
+	manager.Enqueue( url.ToCStr(), path.ToCStr() );
+	CHECK( WaitForFinished( manager, path, 20.0 ) );
+	manager.Stop();
+	CHECK( FileMatches( path, data ) );
+	// at least a quarter of the chunks weren't fetched again
+	CHECK( server.GetBodyBytes() <= data.GetSizeI() - 3 * CHUNK + 1 );
+}
+
+UNIT_TEST( StartsOverWhenTheFileChanged )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 16 * CHUNK, 4 );
+	server.AddFile( "/video.mp4", &data[0], data.GetSizeI(), "video/mp4", "\"v1\"" );
+	server.SetBytesPerSecond( 1024 * 1024 );
+
+	const String path = TempPath( "changed.mp4" );
+	const String url = server.GetUrl( "/video.mp4" );
+	{
+		DownloadManager manager;
+		manager.Start();
+		manager.Enqueue( url.ToCStr(), path.ToCStr() );
+		CHECK( WaitForProgress( manager, 0.25f, 20.0 ) );
+		manager.Stop();
+	}
+
+	// a new version under the same url: the bitmap is for the old one
+	Array< UByte > changed;
+	MakeVideo( changed, 16 * CHUNK, 5 );
+	server.AddFile( "/video.mp4", &changed[0], changed.GetSizeI(), "video/mp4", "\"v2\"" );
+	server.SetBytesPerSecond( 0 );
+	server.ResetCounters();
+	DownloadManager manager;
+	manager.Start();
+	manager.Enqueue( url.ToCStr(), path.ToCStr() );
+	CHECK( WaitForFinished( manager, path, 20.0 ) );
+	manager.Stop();
+	CHECK( FileMatches( path, changed ) );
+	CHECK_EQUAL( static_cast< SInt64 >( changed.GetSizeI() + 1 ), server.GetBodyBytes() );
+}
+
+UNIT_TEST( RefusesServersWithoutRanges )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 3 * CHUNK, 6 );
+	server.SetHandler( IgnoreRanges, &data );
+	// slow enough that the whole body can't sit in the socket buffers by the time the probe gives up
+	server.SetBytesPerSecond( 4 * 1024 * 1024 );
+
+	const String path = TempPath( "norange.mp4" );
+	const String url = server.GetUrl( "/norange.mp4" );
+	DownloadManager manager;
+	manager.Start();
+	manager.Enqueue( url.ToCStr(), path.ToCStr() );
+	for ( int wait = 0; wait < 400 && manager.IsQueued( url.ToCStr() ); wait++ )
+	{
+		usleep( 5 * 1000 );
+	}
+	CHECK( !manager.IsQueued( url.ToCStr() ) );
+	manager.Stop();
+	CHECK( !Exists( path ) );
+	CHECK( !Exists( path + ".download" ) );
+	// the probe was closed without reading the whole video
+	CHECK( server.GetBodyBytes() < data.GetSizeI() );
+}
+
+// A protected video is handed over decrypted; without a key its chunks
+// are kept until it is queued again with one.
+UNIT_TEST( DecryptsProtectedDownloads )
+{
+	CencMp4 mp4( LICENSE_KID, LICENSE_KEY );
+	mp4.WriteHeader();
+	for ( int i = 0; i < 4; i++ )
+	{
+		mp4.WriteFragment( i, 1000 );
+	}
+	HttpTestServer server;
+	CHECK( server.Start() );
+	int licenseRequests = 0;
+	server.SetHandler( ServeLicense, &licenseRequests );
+	server.AddFile( "/protected.mp4", mp4.File.GetData(), mp4.File.GetSize(), "video/mp4", "\"v1\"" );
+	CHECK( mp4.File.GetSize() > 2 * CHUNK );
+
+	const String path = TempPath( "protected.mp4" );
+	const String url = server.GetUrl( "/protected.mp4" );
+	const String licenseUrl = server.GetUrl( "/license" );
+	{
+		DownloadManager manager;
+		manager.Start();
+		manager.Enqueue( url.ToCStr(), path.ToCStr() );
+		for ( int wait = 0; wait < 2000 && manager.IsQueued( url.ToCStr() ); wait++ )
+		{
+			usleep( 5 * 1000 );
+		}
+		CHECK( !manager.IsQueued( url.ToCStr() ) );
+		CHECK( !WaitForFinished( manager, path, 0.1 ) );
+		manager.Stop();
+	}
+	CHECK( !Exists( path ) );
+	CHECK( Exists( path + ".download" ) );
+	CHECK( Exists( path + ".chunks" ) );
+
+	server.ResetCounters();
+	DownloadManager manager;
+	manager.Start();
+	manager.Enqueue( url.ToCStr(), path.ToCStr(), licenseUrl.ToCStr() );
+	CHECK( WaitForFinished( manager, path, 20.0 ) );
+	manager.Stop();
+	CHECK_EQUAL( 1, licenseRequests );
+	// only the probe: every chunk was there already
+	CHECK_EQUAL( 1 + 1, server.GetRequests() );
+	CHECK_EQUAL( mp4.Samples.GetSizeI(), CountClearSamples( mp4, path ) );
+	CHECK( !Exists( path + ".download" ) );
+	unlink( path.ToCStr() );
+
+	// straight through, with the key from the start
+	const String second = TempPath( "protected2.mp4" );
+	manager.Start();
+	manager.Enqueue( url.ToCStr(), second.ToCStr(), licenseUrl.ToCStr() );
+	CHECK( WaitForFinished( manager, second, 20.0 ) );
+	manager.Stop();
+	CHECK_EQUAL( 2, licenseRequests );
+	CHECK_EQUAL( mp4.Samples.GetSizeI(), CountClearSamples( mp4, second ) );
+	unlink( second.ToCStr() );
+}
+
+//==============================================================
+// 32 MB from a server 10 ms away that gives each connection 4 MB/s, the
+// usual per-flow limit of a congested CDN edge: the manager's parallel
+// chunks against fetching the same chunks one after another.
+
+UNIT_BENCHMARK( BenchParallelSpeedup )
+{
+	HttpTestServer server;
+	CHECK( server.Start() );
+	Array< UByte > data;
+	MakeVideo( data, 32 * CHUNK, 7 );
+	server.AddFile( "/video.mp4", &data[0], data.GetSizeI() );
+	server.SetLatencyMs( 10 );
+	server.SetBytesPerSecond( 4 * 1024 * 1024 );
+	const String url = server.GetUrl( "/video.mp4" );
+
+	double start = OVR::UnitTest::GetSeconds();
+	HttpConnection connection;
+	Array< UByte > body;
+	for ( int i = 0; i < data.GetSizeI(); i += CHUNK )
+	{
+		CHECK( HttpFetch( connection, url.ToCStr(), i, i + CHUNK - 1, body ) );
+	}
+	const double sequential = OVR::UnitTest::GetSeconds() - start;
+
+	const String path = TempPath( "bench.mp4" );
+	start = OVR::UnitTest::GetSeconds();
+	DownloadManager manager;
+	manager.Start();
+	manager.Enqueue( url.ToCStr(), path.ToCStr() );
+	CHECK( WaitForFinished( manager, path, 60.0 ) );
+	const double parallel = OVR::UnitTest::GetSeconds() - start;
+	manager.Stop();
+	CHECK( FileMatches( path, data ) );
+	unlink( path.ToCStr() );
+
+	const double mb = data.GetSizeI() / ( 1024.0 * 1024.0 );
+	OVR::UnitTest::Report( "one connection: %.2f s, %.1f MB/s", sequential, mb / sequential );
+	OVR::UnitTest::Report( "%i connections: %.2f s, %.1f MB/s, %.1fx", DownloadManager::CONNECTIONS,
+		parallel, mb / parallel, sequential / parallel );
+}
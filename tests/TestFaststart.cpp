@@ -0,0 +1,530 @@
+/************************************************************************************
+
+Filename    :   TestFaststart.cpp
+Content     :   Moving moov in front of mdat, resuming and the background task
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "Kernel/OVR_String.h"
+#include "Mp4Builder.h"
+#include "MediaContainer.h"
+#include "Faststart.h"
+
+using namespace OVR;
+
+static String TempPath( const char * name )
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+}
+
+// Media bytes are a function of their offset in the source file, so a chunk
+// offset can be checked against the bytes it points at after the move.
+static UByte SourceByte( const SInt64 offset )
+{
+	const UInt32 x = static_cast< UInt32 >( offset ) * 2654435761u;
+	return static_cast< UByte >( ( x >> 13 ) ^ ( offset >> 32 ) );
+}
+
+static bool WritePattern( FILE * f, const SInt64 offset, const SInt64 count )
+{
+	static UByte block[65536];
+	for ( SInt64 at = 0; at < count; at += sizeof( block ) )
+	{
+		const int n = static_cast< int >( ( count - at < static_cast< SInt64 >( sizeof( block ) ) ) ? count - at : sizeof( block ) );
+		for ( int i = 0; i < n; i++ )
+		{
+			block[i] = SourceByte( offset + at + i );
+		}
+		if ( fwrite( block, 1, n, f ) != static_cast< size_t >( n ) )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void WriteMoov( Mp4Builder & mp4, const Array< UInt64 > & before, const Array< UInt64 > & after )
+{
+	mp4.Open( "moov" );
+	mp4.OpenFull( "mvhd" );
+	mp4.Zeros( 96 );
+	mp4.Close();
+	// a track with 32 bit offsets into the mdat before moov
+	mp4.Open( "trak" );
+	mp4.OpenMedia( "vide", 90000, 0 );
+	mp4.Open( "minf" );
+	mp4.Open( "stbl" );
+	mp4.OpenFull( "stsd" );
+	mp4.U32( 0 );
+	mp4.Close();
+	mp4.OpenFull( "stco" );
+	mp4.U32( before.GetSize() );
+	for ( int i = 0; i < before.GetSizeI(); i++ )
+	{
+		mp4.U32( static_cast< UInt32 >( before[i] ) );
+	}
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	// and one with 64 bit offsets into an mdat after it
+	mp4.Open( "trak" );
+	mp4.OpenMedia( "soun", 48000, 0 );
+	mp4.Open( "minf" );
+	mp4.Open( "stbl" );
+	mp4.OpenFull( "co64" );
+	mp4.U32( after.GetSize() );
+	for ( int i = 0; i < after.GetSizeI(); i++ )
+	{
+		mp4.U64( after[i] );
+	}
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Open( "udta" );
+	mp4.Chars( "kept as is" );
+	mp4.Close();
+	mp4.Close();
+}
+
+// ftyp, an mdat, moov, then a second mdat: the layout a camera leaves
+// when it appends a late track after finalizing.
+static bool WriteCameraFile( const char * path, const SInt64 mdatBytes, const int chunks )
+{
+	Mp4Builder head;
+	head.Open( "ftyp" );
+	head.Chars( "isom" );
+	head.U32( 0 );
+	head.Close();
+	const SInt64 mdatOffset = head.GetSize();
+
+	// the moov size only depends on the counts, so build it once to find the second mdat
+	Array< UInt64 > before;
+	Array< UInt64 > after;
+	before.Resize( chunks );
+	after.Resize( chunks );
+	Mp4Builder sized;
+	WriteMoov( sized, before, after );
+	const SInt64 moovOffset = mdatOffset + 8 + mdatBytes;
+	const SInt64 secondOffset = moovOffset + sized.GetSize();
+	const SInt64 secondBytes = 4096;
+	for ( int i = 0; i < chunks; i++ )
+	{
+		before[i] = static_cast< UInt64 >( mdatOffset + 8 + mdatBytes * i / chunks );
+		after[i] = static_cast< UInt64 >( secondOffset + 8 + secondBytes * i / chunks );
+	}
+	Mp4Builder moov;
+	WriteMoov( moov, before, after );
+
+	FILE * f = fopen( path, "wb" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	UByte header[8];
+	bool ok = fwrite( head.GetData(), 1, head.GetSize(), f ) == static_cast< size_t >( head.GetSize() );
+	WriteBE32( header, static_cast< UInt32 >( 8 + mdatBytes ) );
+	memcpy( header + 4, "mdat", 4 );
+	ok = ok && fwrite( header, 1, 8, f ) == 8 && WritePattern( f, mdatOffset + 8, mdatBytes );
+	ok = ok && fwrite( moov.GetData(), 1, moov.GetSize(), f ) == static_cast< size_t >( moov.GetSize() );
+	WriteBE32( header, static_cast< UInt32 >( 8 + secondBytes ) );
+	ok = ok && fwrite( header, 1, 8, f ) == 8 && WritePattern( f, secondOffset + 8, secondBytes );
+	return fclose( f ) == 0 && ok;
+}
+
+// Every chunk offset of every track in the file's moov.
+static bool ReadChunkOffsets( const MediaFile & file, Array< UInt64 > & out )
+{
+	out.Clear();
+	Mp4Box moov;
+	if ( !Mp4FindTopLevel( file, MP4_FOURCC( 'm', 'o', 'o', 'v' ), moov ) )
+	{
+		return false;
+	}
+	Mp4Box trak;
+	for ( SInt64 offset = moov.DataOffset; Mp4ReadBox( file, offset, moov.End, trak ); offset = trak.End )
+	{
+		Mp4Box mdia;
+		Mp4Box minf;
+		Mp4Box stbl;
+		Mp4Box table;
+		if ( trak.Type != MP4_FOURCC( 't', 'r', 'a', 'k' ) )
+		{
+			continue;
+		}
+		if ( !Mp4FindChild( file, trak, MP4_FOURCC( 'm', 'd', 'i', 'a' ), mdia ) ||
+			!Mp4FindChild( file, mdia, MP4_FOURCC( 'm', 'i', 'n', 'f' ), minf ) ||
+			!Mp4FindChild( file, minf, MP4_FOURCC( 's', 't', 'b', 'l' ), stbl ) )
+		{
+			return false;
+		}
+		bool large = false;
+		if ( !Mp4FindChild( file, stbl, MP4_FOURCC( 's', 't', 'c', 'o' ), table ) )
+		{
+			if ( !Mp4FindChild( file, stbl, MP4_FOURCC( 'c', 'o', '6', '4' ), table ) )
+			{
+				return false;
+			}
+			large = true;
+		}
+		Array< UByte > data;
+		if ( !file.ReadArray( table.DataOffset, static_cast< int >( table.GetDataSize() ), data ) )
+		{
+			return false;
+		}
+		const int count = static_cast< int >( ReadBE32( &data[4] ) );
+		for ( int i = 0; i < count; i++ )
+		{
+			out.PushBack( large ? ReadBE64( &data[8 + i * 8] ) : ReadBE32( &data[8 + i * 4] ) );
+		}
+	}
+	return true;
+}
+
+static bool FilesMatch( const char * a, const char * b )
+{
+	MediaFile fa;
+	MediaFile fb;
+	if ( !fa.Open( a ) || !fb.Open( b ) || fa.GetSize() != fb.GetSize() )
+	{
+		return false;
+	}
+	UByte ba[65536];
+	UByte bb[65536];
+	for ( SInt64 at = 0; at < fa.GetSize(); at += sizeof( ba ) )
+	{
+		const int n = static_cast< int >( ( fa.GetSize() - at < static_cast< SInt64 >( sizeof( ba ) ) ) ? fa.GetSize() - at : sizeof( ba ) );
+		if ( !fa.Read( at, ba, n ) || !fb.Read( at, bb, n ) || memcmp( ba, bb, n ) != 0 )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool CopyFile( const char * from, const char * to )
+{
+	MediaFile source;
+	FILE * f = fopen( to, "wb" );
+	if ( f == NULL || !source.Open( from ) )
+	{
+		if ( f != NULL )
+		{
+			fclose( f );
+		}
+		return false;
+	}
+	UByte block[65536];
+	bool ok = true;
+	for ( SInt64 at = 0; ok && at < source.GetSize(); at += sizeof( block ) )
+	{
+		const int n = static_cast< int >( ( source.GetSize() - at < static_cast< SInt64 >( sizeof( block ) ) ) ? source.GetSize() - at : sizeof( block ) );
+		ok = source.Read( at, block, n ) && fwrite( block, 1, n, f ) == static_cast< size_t >( n );
+	}
+	return fclose( f ) == 0 && ok;
+}
+
+static SInt64 FileSize( const char * path )
+{
+	struct stat st;
+	return stat( path, &st ) == 0 ? static_cast< SInt64 >( st.st_size ) : -1;
+}
+
+static pthread_mutex_t CommitMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//==============================================================
+
+UNIT_TEST( RewritesMoovToTheFront )
+{
+	const String path = TempPath( "camera.mp4" );
+	const SInt64 mdatBytes = 3 * 1024 * 1024 + 12345;
+	CHECK( WriteCameraFile( path.ToCStr(), mdatBytes, 40 ) );
+	const SInt64 sourceSize = FileSize( path.ToCStr() );
+
+	Array< UInt64 > oldOffsets;
+	{
+		MediaFile source;
+		CHECK( source.Open( path.ToCStr() ) );
+		CHECK( FaststartTask::NeedsFaststart( source ) );
+		CHECK( ReadChunkOffsets( source, oldOffsets ) );
+	}
+	// an old date, which the rewrite keeps
+	struct timeval times[2];
+	times[0].tv_sec = 1000000000;
+	times[0].tv_usec = 0;
+	times[1] = times[0];
+	CHECK( utimes( path.ToCStr(), times ) == 0 );
+
+	SInt64 copied = 0;
+	CHECK_EQUAL( FASTSTART_DONE, FaststartTask::RemuxFile( path.ToCStr(), NULL, &CommitMutex, copied ) );
+	CHECK_EQUAL( sourceSize, FileSize( path.ToCStr() ) );
+	CHECK_EQUAL( -1, FileSize( ( path + ".faststart" ).ToCStr() ) );
+	struct stat st;
+	CHECK( stat( path.ToCStr(), &st ) == 0 && st.st_mtime == 1000000000 );
+
+	MediaFile result;
+	CHECK( result.Open( path.ToCStr() ) );
+	CHECK( !FaststartTask::NeedsFaststart( result ) );
+	Mp4Box box;
+	CHECK( Mp4ReadBox( result, 0, result.GetSize(), box ) && box.Type == MP4_FOURCC( 'f', 't', 'y', 'p' ) );
+	CHECK( Mp4ReadBox( result, box.End, result.GetSize(), box ) && box.Type == MP4_FOURCC( 'm', 'o', 'o', 'v' ) );
+	const SInt64 headerSize = box.End;
+	CHECK( Mp4ReadBox( result, box.End, result.GetSize(), box ) && box.Type == MP4_FOURCC( 'm', 'd', 'a', 't' ) );
+	// the header is written before the copy starts
+	CHECK_EQUAL( sourceSize - headerSize, copied );
+
+	// every chunk still points at its own bytes
+	Array< UInt64 > newOffsets;
+	CHECK( ReadChunkOffsets( result, newOffsets ) );
+	CHECK_EQUAL( oldOffsets.GetSizeI(), newOffsets.GetSizeI() );
+	for ( int i = 0; i < newOffsets.GetSizeI(); i++ )
+	{
+		UByte bytes[16];
+		CHECK( result.Read( static_cast< SInt64 >( newOffsets[i] ), bytes, sizeof( bytes ) ) );
+		for ( int b = 0; b < 16; b++ )
+		{
+			CHECK_EQUAL( SourceByte( oldOffsets[i] + b ), bytes[b] );
+		}
+	}
+	result.Close();
+
+	CHECK_EQUAL( FASTSTART_NOT_NEEDED, FaststartTask::RemuxFile( path.ToCStr(), NULL, &CommitMutex, copied ) );
+	CHECK_EQUAL( 0, copied );
+}
+
+UNIT_TEST( LeavesOtherFilesAlone )
+{
+	SInt64 copied = 0;
+	CHECK_EQUAL( FASTSTART_NOT_NEEDED, FaststartTask::RemuxFile( TempPath( "absent.mp4" ).ToCStr(), NULL, &CommitMutex, copied ) );
+
+	// moov already first
+	Mp4Builder mp4;
+	mp4.Open( "ftyp" );
+	mp4.Chars( "isom" );
+	mp4.U32( 0 );
+	mp4.Close();
+	mp4.Open( "moov" );
+	mp4.Close();
+	mp4.Open( "mdat" );
+	mp4.Zeros( 64 );
+	mp4.Close();
+	const String first = TempPath( "first.mp4" );
+	CHECK( mp4.WriteFile( first.ToCStr() ) );
+	CHECK_EQUAL( FASTSTART_NOT_NEEDED, FaststartTask::RemuxFile( first.ToCStr(), NULL, &CommitMutex, copied ) );
+
+	// fragmented: mdat ahead of a moov is fine when moofs follow
+	Mp4Builder fragmented;
+	fragmented.Open( "ftyp" );
+	fragmented.Chars( "iso5" );
+	fragmented.U32( 0 );
+	fragmented.Close();
+	fragmented.Open( "moof" );
+	fragmented.Close();
+	fragmented.Open( "mdat" );
+	fragmented.Zeros( 64 );
+	fragmented.Close();
+	fragmented.Open( "moov" );
+	fragmented.Close();
+	const String fragmentedPath = TempPath( "fragmented.mp4" );
+	CHECK( fragmented.WriteFile( fragmentedPath.ToCStr() ) );
+	MediaFile file;
+	CHECK( file.Open( fragmentedPath.ToCStr() ) );
+	CHECK( !FaststartTask::NeedsFaststart( file ) );
+}
+
+UNIT_TEST( WidensTablesThatOverflow )
+{
+	// a moov at the end of a 4 GB file, whose growth pushes the last chunks past 32 bits
+	Array< UInt64 > before;
+	Array< UInt64 > after;
+	before.PushBack( 40 );
+	before.PushBack( 0xFFFFFF00ull );
+	after.PushBack( 0x100001000ull );
+	Mp4Builder moov;
+	WriteMoov( moov, before, after );
+	const SInt64 insertOffset = 32;
+	const SInt64 moovEnd = 0x100000000ll + 64;
+
+	Array< UByte > result;
+	CHECK( BuildFaststartMoov( moov.GetData(), moov.GetSize(), insertOffset, moovEnd, result ) );
+	const SInt64 newSize = result.GetSizeI();
+	// the stco became a co64: four more bytes per entry
+	CHECK_EQUAL( moov.GetSize() + 2 * 4, newSize );
+
+	const String path = TempPath( "widened.mp4" );
+	FILE * f = fopen( path.ToCStr(), "wb" );
+	CHECK( f != NULL );
+	fwrite( &result[0], 1, result.GetSize(), f );
+	fclose( f );
+	MediaFile file;
+	CHECK( file.Open( path.ToCStr() ) );
+	Array< UInt64 > offsets;
+	CHECK( ReadChunkOffsets( file, offsets ) );
+	CHECK_EQUAL( 3, offsets.GetSizeI() );
+	CHECK_EQUAL( 40 + newSize, static_cast< SInt64 >( offsets[0] ) );
+	CHECK_EQUAL( static_cast< SInt64 >( 0xFFFFFF00ull ) + newSize, static_cast< SInt64 >( offsets[1] ) );
+	CHECK_EQUAL( static_cast< SInt64 >( 0x100001000ull ) + newSize - moov.GetSize(), static_cast< SInt64 >( offsets[2] ) );
+
+	// a box size that runs past the moov is rejected
+	Array< UByte > broken;
+	broken.Resize( moov.GetSize() );
+	memcpy( &broken[0], moov.GetData(), moov.GetSize() );
+	WriteBE32( &broken[8], 0x7FFFFFFF );
+	CHECK( !BuildFaststartMoov( &broken[0], broken.GetSizeI(), insertOffset, moovEnd, result ) );
+}
+
+UNIT_TEST( ResumesAPartialFile )
+{
+	const String path = TempPath( "resume.mp4" );
+	const String reference = TempPath( "reference.mp4" );
+	const String partial = path + ".faststart";
+	CHECK( WriteCameraFile( path.ToCStr(), 5 * 1024 * 1024, 16 ) );
+	CHECK( CopyFile( path.ToCStr(), reference.ToCStr() ) );
+	const SInt64 totalSize = FileSize( path.ToCStr() );
+
+	SInt64 copied = 0;
+	CHECK_EQUAL( FASTSTART_DONE, FaststartTask::RemuxFile( reference.ToCStr(), NULL, &CommitMutex, copied ) );
+
+	// interrupted before the first block: only the header is written
+	const volatile bool interrupt = true;
+	CHECK_EQUAL( FASTSTART_INTERRUPTED, FaststartTask::RemuxFile( path.ToCStr(), &interrupt, &CommitMutex, copied ) );
+	CHECK_EQUAL( 0, copied );
+	const SInt64 headerSize = FileSize( partial.ToCStr() );
+	CHECK( headerSize > 0 && headerSize < 4096 );
+
+	// as if a later run was stopped two and a half blocks in
+	const SInt64 stoppedAt = headerSize + 2 * 1024 * 1024 + 512 * 1024;
+	CHECK( CopyFile( reference.ToCStr(), partial.ToCStr() ) );
+	CHECK( truncate( partial.ToCStr(), stoppedAt ) == 0 );
+	CHECK_EQUAL( FASTSTART_DONE, FaststartTask::RemuxFile( path.ToCStr(), NULL, &CommitMutex, copied ) );
+	CHECK_EQUAL( totalSize - stoppedAt, copied );
+	CHECK( FilesMatch( path.ToCStr(), reference.ToCStr() ) );
+}
+
+UNIT_TEST( RestartsWhenThePartialHeaderDiffers )
+{
+	const String path = TempPath( "restart.mp4" );
+	const String reference = TempPath( "restart-reference.mp4" );
+	const String partial = path + ".faststart";
+	CHECK( WriteCameraFile( path.ToCStr(), 3 * 1024 * 1024, 8 ) );
+	CHECK( CopyFile( path.ToCStr(), reference.ToCStr() ) );
+	SInt64 copied = 0;
+	CHECK_EQUAL( FASTSTART_DONE, FaststartTask::RemuxFile( reference.ToCStr(), NULL, &CommitMutex, copied ) );
+	const SInt64 fullCopy = copied;
+
+	// a partial from a different version of the file: one byte of the moov is off
+	CHECK( CopyFile( reference.ToCStr(), partial.ToCStr() ) );
+	CHECK( truncate( partial.ToCStr(), 2 * 1024 * 1024 ) == 0 );
+	FILE * f = fopen( partial.ToCStr(), "r+b" );
+	CHECK( f != NULL );
+	fseek( f, 100, SEEK_SET );
+	const int c = fgetc( f );
+	fseek( f, 100, SEEK_SET );
+	fputc( c ^ 0xFF, f );
+	fclose( f );
+
+	CHECK_EQUAL( FASTSTART_DONE, FaststartTask::RemuxFile( path.ToCStr(), NULL, &CommitMutex, copied ) );
+	CHECK_EQUAL( fullCopy, copied );
+	CHECK( FilesMatch( path.ToCStr(), reference.ToCStr() ) );
+}
+
+UNIT_TEST( TaskRunsOnlyWhileUnpaused )
+{
+	Array< String > paths;
+	paths.PushBack( TempPath( "task1.mp4" ) );
+	paths.PushBack( TempPath( "task2.m4v" ) );
+	paths.PushBack( TempPath( "task3.mkv" ) );		// not an MP4 family name
+	for ( int i = 0; i < paths.GetSizeI(); i++ )
+	{
+		CHECK( WriteCameraFile( paths[i].ToCStr(), 2 * 1024 * 1024, 4 ) );
+	}
+
+	FaststartTask task;
+	task.SetPaused( true );
+	task.Start( paths );
+	usleep( 50 * 1000 );
+	for ( int i = 0; i < paths.GetSizeI(); i++ )
+	{
+		MediaFile file;
+		CHECK( file.Open( paths[i].ToCStr() ) && FaststartTask::NeedsFaststart( file ) );
+	}
+
+	task.SetPaused( false );
+	bool done = false;
+	for ( int wait = 0; wait < 500 && !done; wait++ )
+	{
+		usleep( 10 * 1000 );
+		MediaFile a;
+		MediaFile b;
+		done = a.Open( paths[0].ToCStr() ) && !FaststartTask::NeedsFaststart( a ) &&
+			b.Open( paths[1].ToCStr() ) && !FaststartTask::NeedsFaststart( b );
+	}
+	CHECK( done );
+	task.Stop();
+
+	MediaFile skipped;
+	CHECK( skipped.Open( paths[2].ToCStr() ) && FaststartTask::NeedsFaststart( skipped ) );
+}
+
+//==============================================================
+// Remux throughput on a 256 MB file, and what prepare() has to read to
+// find moov before and after. The times are from the page cache; on an SD
+// card the seek to the tail of a multi-GB file is what the rewrite saves.
+
+static double TimeFindMoov( const char * path, SInt64 & outMoovOffset )
+{
+	const double start = OVR::UnitTest::GetSeconds();
+	MediaFile file;
+	Mp4Box moov;
+	Array< UByte > data;
+	outMoovOffset = -1;
+	if ( file.Open( path ) && Mp4FindTopLevel( file, MP4_FOURCC( 'm', 'o', 'o', 'v' ), moov ) &&
+		file.ReadArray( moov.Offset, static_cast< int >( moov.End - moov.Offset ), data ) )
+	{
+		outMoovOffset = moov.Offset;
+	}
+	return OVR::UnitTest::GetSeconds() - start;
+}
+
+UNIT_BENCHMARK( BenchRemuxThroughput )
+{
+	const String path = TempPath( "bench.mp4" );
+	const SInt64 mdatBytes = 256ll * 1024 * 1024;
+	CHECK( WriteCameraFile( path.ToCStr(), mdatBytes, 20000 ) );
+
+	SInt64 before = 0;
+	const double beforeSeconds = TimeFindMoov( path.ToCStr(), before );
+
+	SInt64 copied = 0;
+	const double start = OVR::UnitTest::GetSeconds();
+	CHECK_EQUAL( FASTSTART_DONE, FaststartTask::RemuxFile( path.ToCStr(), NULL, &CommitMutex, copied ) );
+	const double seconds = OVR::UnitTest::GetSeconds() - start;
+
+	SInt64 after = 0;
+	const double afterSeconds = TimeFindMoov( path.ToCStr(), after );
+	CHECK_EQUAL( 16, after );
+
+	OVR::UnitTest::Report( "remux: %.0f MB in %.2f s, %.0f MB/s", copied / ( 1024.0 * 1024.0 ), seconds, copied / ( 1024.0 * 1024.0 ) / seconds );
+	OVR::UnitTest::Report( "moov at %.0f MB, %.0f us to read -> at %lld bytes, %.0f us",
+		before / ( 1024.0 * 1024.0 ), beforeSeconds * 1e6, static_cast< long long >( after ), afterSeconds * 1e6 );
+	unlink( path.ToCStr() );
+}
@@ -0,0 +1,262 @@
+/************************************************************************************
+
+Filename    :   TestLocalizedStrings.cpp
+Content     :   LocalizedStrings against a fake activity string table
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "LocalizedStrings.h"
+
+using namespace OVR;
+
+//==============================================================
+// The activity's side of the JNI calls Load makes. The table is what
+// getStringTableFromNative returns: names and values as Resources
+// resolves them, xliff tags stripped.
+static const char *	ActivityTable[64];
+static int			ActivityTableLength = 0;
+static bool			ActivityHasTable = true;
+static int			LocalRefs = 0;
+static int			HeldChars = 0;
+static int			ExceptionsCleared = 0;
+
+static const size_t	STRING_BASE = 1000;
+
+jclass JNIEnv::GetObjectClass( jobject object )
+{
+	LocalRefs++;
+	return reinterpret_cast< jclass >( 1 );
+}
+
+jmethodID JNIEnv::GetMethodID( jclass clazz, const char * name, const char * signature )
+{
+	if ( !ActivityHasTable || strcmp( name, "getStringTableFromNative" ) != 0 || strcmp( signature, "()[Ljava/lang/String;" ) != 0 )
+	{
+		return NULL;
+	}
+	return reinterpret_cast< jmethodID >( 2 );
+}
+
+jobject JNIEnv::CallObjectMethod( jobject object, jmethodID method, ... )
+{
+	LocalRefs++;
+	return reinterpret_cast< jobject >( 3 );
+}
+
+jsize JNIEnv::GetArrayLength( jobject array )
+{
+	return ActivityTableLength;
+}
+
+jobject JNIEnv::GetObjectArrayElement( jobjectArray array, jsize index )
+{
+	LocalRefs++;
+	return reinterpret_cast< jobject >( STRING_BASE + index );
+}
+
+const char * JNIEnv::GetStringUTFChars( jstring string, jboolean * isCopy )
+{
+	HeldChars++;
+	return ActivityTable[reinterpret_cast< size_t >( string ) - STRING_BASE];
+}
+
+void JNIEnv::ReleaseStringUTFChars( jstring string, const char * utf )
+{
+	HeldChars--;
+}
+
+void JNIEnv::DeleteLocalRef( jobject object )
+{
+	LocalRefs--;
+}
+
+void JNIEnv::ExceptionClear()
+{
+	ExceptionsCleared++;
+}
+
+static void SetTable( const char * const * pairs, const int length )
+{
+	for ( int i = 0; i < length; i++ )
+	{
+		ActivityTable[i] = pairs[i];
+	}
+	ActivityTableLength = length;
+}
+
+static const char * ShippedTable[] =
+{
+	"app_name",			"Oculus 360 Videos",
+	"action_settings",	"Settings",
+	"media_not_found",	"There are no videos on your phone. Please insert the SD card included with your Gear VR.",
+	"playback_failed",	"Failed to load media for playback. Please check %1$s",
+	"previous_videos",	"Previous",
+	"more_videos",		"More",
+};
+
+static const int ShippedTableLength = sizeof( ShippedTable ) / sizeof( ShippedTable[0] );
+
+static bool LoadShipped( LocalizedStrings & strings )
+{
+	SetTable( ShippedTable, ShippedTableLength );
+	ActivityHasTable = true;
+	JNIEnv jni;
+	return strings.Load( &jni, reinterpret_cast< jobject >( 4 ) );
+}
+
+static String ReadText( const char * path )
+{
+	String text;
+	FILE * f = fopen( path, "rb" );
+	if ( f != NULL )
+	{
+		char buffer[4096];
+		size_t read;
+		while ( ( read = fread( buffer, 1, sizeof( buffer ), f ) ) > 0 )
+		{
+			text.AppendString( buffer, read );
+		}
+		fclose( f );
+	}
+	return text;
+}
+
+UNIT_TEST( LoadsTheActivityTable )
+{
+	LocalizedStrings strings;
+	CHECK( LoadShipped( strings ) );
+	CHECK_EQUAL( ShippedTableLength / 2, strings.GetCount() );
+	CHECK_STRING( "Oculus 360 Videos", strings.GetString( "@string/app_name", "default" ) );
+	CHECK_STRING( "More", strings.GetString( "more_videos", "default" ) );
+	CHECK_STRING( "default", strings.GetString( "@string/missing", "default" ) );
+	CHECK_STRING( "default", strings.GetString( "@string/", "default" ) );
+	CHECK_EQUAL( 0, LocalRefs );
+	CHECK_EQUAL( 0, HeldChars );
+}
+
+UNIT_TEST( WithoutTheTableStringsShowTheirDefaults )
+{
+	LocalizedStrings strings;
+	CHECK( LoadShipped( strings ) );
+	ActivityHasTable = false;
+	const int cleared = ExceptionsCleared;
+	JNIEnv jni;
+	CHECK( !strings.Load( &jni, reinterpret_cast< jobject >( 4 ) ) );
+	CHECK_EQUAL( cleared + 1, ExceptionsCleared );
+	CHECK_EQUAL( 0, strings.GetCount() );
+	CHECK_STRING( "@string/app_name", strings.GetString( "@string/app_name", "@string/app_name" ) );
+	CHECK_EQUAL( 0, LocalRefs );
+	ActivityHasTable = true;
+}
+
+UNIT_TEST( ReloadingReplacesTheTable )
+{
+	LocalizedStrings strings;
+	CHECK( LoadShipped( strings ) );
+	static const char * german[] = { "app_name", "Oculus 360 Videos", "more_videos", "Mehr" };
+	SetTable( german, 4 );
+	JNIEnv jni;
+	CHECK( strings.Load( &jni, reinterpret_cast< jobject >( 4 ) ) );
+	CHECK_EQUAL( 2, strings.GetCount() );
+	CHECK_STRING( "Mehr", strings.GetString( "@string/more_videos", "More" ) );
+	CHECK_STRING( "Previous", strings.GetString( "@string/previous_videos", "Previous" ) );
+
+	// an odd last name has no value and is left out
+	static const char * odd[] = { "app_name", "Oculus 360 Videos", "more_videos" };
+	SetTable( odd, 3 );
+	CHECK( strings.Load( &jni, reinterpret_cast< jobject >( 4 ) ) );
+	CHECK_EQUAL( 1, strings.GetCount() );
+	CHECK_EQUAL( 0, LocalRefs );
+}
+
+UNIT_TEST( FormatsXliffArguments )
+{
+	LocalizedStrings strings;
+	CHECK( LoadShipped( strings ) );
+	char out[LocalizedStrings::MAX_FORMATTED];
+	const int length = strings.Format( "@string/playback_failed", "@string/playback_failed", "Beach.mp4", out, sizeof( out ) );
+	CHECK_STRING( "Failed to load media for playback. Please check Beach.mp4", out );
+	CHECK_EQUAL( static_cast< int >( strlen( out ) ), length );
+
+	// a key the table lacks formats its default
+	CHECK_EQUAL( 9, strings.Format( "@string/missing", "100%% %1$s", "done", out, sizeof( out ) ) );
+	CHECK_STRING( "100% done", out );
+
+	// truncated to fit, argument included, and always terminated
+	char small[12];
+	CHECK_EQUAL( 11, strings.Format( "@string/playback_failed", "", "Beach.mp4", small, sizeof( small ) ) );
+	CHECK_STRING( "Failed to l", small );
+	CHECK_EQUAL( 5, strings.Format( "@string/missing", "ab%1$s", "cdefgh", small, 6 ) );
+	CHECK_STRING( "abcde", small );
+	CHECK_EQUAL( 0, strings.Format( "@string/app_name", "", "", small, 1 ) );
+	CHECK_STRING( "", small );
+}
+
+// The keys the app looks up must be names strings.xml defines, or the
+// panels show the key.
+UNIT_TEST( EveryKeyTheAppUsesIsShipped )
+{
+	const String resources = ReadText( TEST_DATA_DIR "/../../res/values/strings.xml" );
+	CHECK( !resources.IsEmpty() );
+	const char * sources[] = { "Oculus360Videos.cpp", "VideoBrowser.cpp", "VideoMenu.cpp" };
+	int keys = 0;
+	for ( int i = 0; i < static_cast< int >( sizeof( sources ) / sizeof( sources[0] ) ); i++ )
+	{
+		const String source = ReadText( ( String( TEST_DATA_DIR "/../../jni/" ) + sources[i] ).ToCStr() );
+		CHECK( !source.IsEmpty() );
+		for ( const char * p = strstr( source.ToCStr(), "\"@string/" ); p != NULL; p = strstr( p + 1, "\"@string/" ) )
+		{
+			const char * name = p + 9;
+			const char * end = strchr( name, '"' );
+			if ( end == NULL || end == name )
+			{
+				continue;
+			}
+			const String attribute = String( "name=\"" ) + String( name, end - name ) + "\"";
+			if ( strstr( resources.ToCStr(), attribute.ToCStr() ) == NULL )
+			{
+				printf( "    %s uses %s, which strings.xml doesn't define\n", sources[i], attribute.ToCStr() );
+				CHECK( false );
+			}
+			keys++;
+		}
+	}
+	CHECK( keys > 0 );
+}
+
+UNIT_BENCHMARK( BenchLookups )
+{
+	LocalizedStrings strings;
+	CHECK( LoadShipped( strings ) );
+	const char * keys[] = { "@string/app_name", "@string/previous_videos", "@string/more_videos", "@string/missing" };
+	const int calls = 200000;
+	int total = 0;
+	double start = OVR::UnitTest::GetSeconds();
+	for ( int i = 0; i < calls; i++ )
+	{
+		total += static_cast< int >( strings.GetString( keys[i & 3], "" )[0] );
+	}
+	const double lookup = ( OVR::UnitTest::GetSeconds() - start ) / calls;
+
+	char out[LocalizedStrings::MAX_FORMATTED];
+	start = OVR::UnitTest::GetSeconds();
+	for ( int i = 0; i < calls; i++ )
+	{
+		total += strings.Format( "@string/playback_failed", "", "Beach.mp4", out, sizeof( out ) );
+	}
+	const double format = ( OVR::UnitTest::GetSeconds() - start ) / calls;
+	OVR::UnitTest::Report( "GetString %.0f ns, Format %.0f ns (%i)", lookup * 1e9, format * 1e9, total & 1 );
+}
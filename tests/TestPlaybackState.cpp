@@ -0,0 +1,231 @@
+/************************************************************************************
+
+Filename    :   TestPlaybackState.cpp
+Content     :   Seqlock playback state tests with a stand-in player thread
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "PlaybackState.h"
+
+using namespace OVR;
+
+UNIT_TEST( PositionExtrapolatesWhilePlaying )
+{
+	PlaybackStateData data;
+	data.Playing = true;
+	data.PositionMs = 1000;
+	data.DurationMs = 5000;
+	data.UpdateTime = 10.0;
+	CHECK_EQUAL( 1000, data.GetPositionAt( 9.0 ) );
+	CHECK_EQUAL( 1500, data.GetPositionAt( 10.5 ) );
+	// never past the end
+	CHECK_EQUAL( 5000, data.GetPositionAt( 20.0 ) );
+
+	data.Playing = false;
+	CHECK_EQUAL( 1000, data.GetPositionAt( 10.5 ) );
+
+	// unknown duration, no clamp
+	data.Playing = true;
+	data.DurationMs = -1;
+	CHECK_EQUAL( 11000, data.GetPositionAt( 20.0 ) );
+}
+
+UNIT_TEST( UpdatesKeepFieldsTheyDontOwn )
+{
+	PlaybackStateBlock block;
+	const UInt32 sequence = block.GetSequence();
+	block.SetVideoSize( 3840, 1920 );
+	block.Update( true, 2000, 60000, 0, 9000 );
+	PlaybackStateData data = block.Read();
+	CHECK_EQUAL( 3840, data.VideoWidth );
+	CHECK_EQUAL( 1920, data.VideoHeight );
+	CHECK( data.Playing );
+	CHECK_EQUAL( 60000, data.DurationMs );
+	CHECK_EQUAL( 9000, data.BufferedEndMs );
+	// every write moves the sequence by two, even when it's done
+	CHECK_EQUAL( sequence + 4, block.GetSequence() );
+
+	block.SetPosition( 30000 );
+	data = block.Read();
+	CHECK_EQUAL( 30000, data.PositionMs );
+	CHECK_EQUAL( 60000, data.DurationMs );
+}
+
+UNIT_TEST( PausingFoldsExtrapolatedTime )
+{
+	PlaybackStateBlock block;
+	block.Update( true, 1000, 60000, 0, 0 );
+	const double start = PlaybackStateBlock::GetTimeInSeconds();
+	while ( PlaybackStateBlock::GetTimeInSeconds() - start < 0.02 )
+	{
+		sched_yield();
+	}
+	block.SetPlaying( false );
+	const PlaybackStateData data = block.Read();
+	CHECK( !data.Playing );
+	// the 20 ms played since the update aren't lost, and no more is added
+	CHECK( data.PositionMs >= 1020 );
+	CHECK_EQUAL( data.PositionMs, data.GetPositionAt( PlaybackStateBlock::GetTimeInSeconds() + 1.0 ) );
+}
+
+//==============================================================
+// A stand-in for the Java player, writing states whose fields all derive
+// from one counter, so a reader can tell a torn copy from a whole one.
+
+static const int WRITES = 200000;
+
+struct StandInPlayer
+{
+	PlaybackStateBlock *	Block;
+	volatile bool			Done;
+};
+
+static void FillState( const int i, PlaybackStateData & data )
+{
+	data.Playing = ( i & 1 ) != 0;
+	data.PositionMs = i;
+	data.DurationMs = i * 2;
+	data.BufferedStartMs = i + 1;
+	data.BufferedEndMs = i + 3;
+	data.VideoWidth = i ^ 0x5555;
+	data.VideoHeight = ~i;
+}
+
+static bool IsWhole( const PlaybackStateData & data )
+{
+	PlaybackStateData expected;
+	FillState( data.PositionMs, expected );
+	return data.Playing == expected.Playing && data.DurationMs == expected.DurationMs &&
+		data.BufferedStartMs == expected.BufferedStartMs && data.BufferedEndMs == expected.BufferedEndMs &&
+		data.VideoWidth == expected.VideoWidth && data.VideoHeight == expected.VideoHeight;
+}
+
+static void * PlayerThread( void * param )
+{
+	StandInPlayer * player = static_cast< StandInPlayer * >( param );
+	for ( int i = 1; i <= WRITES; i++ )
+	{
+		PlaybackStateData data;
+		FillState( i, data );
+		player->Block->Write( data );
+		if ( ( i & 63 ) == 0 )
+		{
+			sched_yield();
+		}
+	}
+	__atomic_store_n( &player->Done, true, __ATOMIC_RELEASE );
+	return NULL;
+}
+
+UNIT_TEST( ReaderNeverSeesATornState )
+{
+	PlaybackStateBlock block;
+	PlaybackStateData first;
+	FillState( 0, first );
+	block.Write( first );
+
+	StandInPlayer player = { &block, false };
+	pthread_t thread;
+	CHECK( pthread_create( &thread, NULL, PlayerThread, &player ) == 0 );
+
+	int reads = 0;
+	int torn = 0;
+	int backwards = 0;
+	int retries = 0;
+	int last = 0;
+	while ( !__atomic_load_n( &player.Done, __ATOMIC_ACQUIRE ) )
+	{
+		PlaybackStateData data;
+		if ( !block.TryRead( data ) )
+		{
+			retries++;
+			continue;
+		}
+		reads++;
+		torn += IsWhole( data ) ? 0 : 1;
+		backwards += ( data.PositionMs < last ) ? 1 : 0;
+		last = data.PositionMs;
+	}
+	pthread_join( thread, NULL );
+
+	CHECK_EQUAL( 0, torn );
+	CHECK_EQUAL( 0, backwards );
+	CHECK_EQUAL( WRITES, block.Read().PositionMs );
+	CHECK_EQUAL( ( WRITES + 1 ) * 2, static_cast< int >( block.GetSequence() ) );
+	OVR::UnitTest::Report( "%i reads during %i writes, %i gave up on a busy writer", reads, WRITES, retries );
+}
+
+static void * SetterThread( void * param )
+{
+	StandInPlayer * player = static_cast< StandInPlayer * >( param );
+	for ( int i = 0; i < WRITES / 4; i++ )
+	{
+		player->Block->SetVideoSize( 1000 + i, 1000 + i );
+	}
+	__atomic_store_n( &player->Done, true, __ATOMIC_RELEASE );
+	return NULL;
+}
+
+UNIT_TEST( ConcurrentWritersAreSerialized )
+{
+	// the Java thread's reports and the VR thread's optimistic updates
+	PlaybackStateBlock block;
+	StandInPlayer player = { &block, false };
+	pthread_t thread;
+	CHECK( pthread_create( &thread, NULL, SetterThread, &player ) == 0 );
+	for ( int i = 0; i < WRITES / 4; i++ )
+	{
+		block.Update( true, i, i * 2, 0, 0 );
+	}
+	pthread_join( thread, NULL );
+
+	const PlaybackStateData data = block.Read();
+	CHECK_EQUAL( WRITES / 4 - 1, data.PositionMs );
+	CHECK_EQUAL( 1000 + WRITES / 4 - 1, data.VideoWidth );
+	CHECK_EQUAL( data.VideoWidth, data.VideoHeight );
+	CHECK_EQUAL( WRITES, static_cast< int >( block.GetSequence() ) );
+}
+
+UNIT_BENCHMARK( BenchReadCost )
+{
+	PlaybackStateBlock block;
+	block.Update( true, 0, 60000, 0, 0 );
+	const int reads = 10000000;
+	long long sum = 0;
+	const double start = OVR::UnitTest::GetSeconds();
+	for ( int i = 0; i < reads; i++ )
+	{
+		sum += block.Read().DurationMs;
+	}
+	const double seconds = OVR::UnitTest::GetSeconds() - start;
+	CHECK_EQUAL( 60000LL * reads, sum );
+	OVR::UnitTest::Report( "uncontended read: %.1f ns", seconds / reads * 1e9 );
+
+	StandInPlayer player = { &block, false };
+	pthread_t thread;
+	CHECK( pthread_create( &thread, NULL, PlayerThread, &player ) == 0 );
+	int contended = 0;
+	const double contendedStart = OVR::UnitTest::GetSeconds();
+	while ( !__atomic_load_n( &player.Done, __ATOMIC_ACQUIRE ) )
+	{
+		sum += block.Read().PositionMs;
+		contended++;
+	}
+	const double contendedSeconds = OVR::UnitTest::GetSeconds() - contendedStart;
+	pthread_join( thread, NULL );
+	OVR::UnitTest::Report( "read against a writer: %.1f ns over %i reads", contendedSeconds / Alg::Max( contended, 1 ) * 1e9, contended );
+}
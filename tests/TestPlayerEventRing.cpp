@@ -0,0 +1,351 @@
+/************************************************************************************
+
+Filename    :   TestPlayerEventRing.cpp
+Content     :   SpscRing and PlayerEventRing tests, and a benchmark against text messages
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "PlayerEventRing.h"
+
+using namespace OVR;
+
+UNIT_TEST( RingKeepsOrderAndCapacity )
+{
+	SpscRing< int, 8 > ring;
+	int value = 0;
+	CHECK( ring.IsEmpty() );
+	CHECK( !ring.Pop( value ) );
+	for ( int i = 0; i < 8; i++ )
+	{
+		CHECK( ring.Push( i ) );
+	}
+	CHECK( !ring.Push( 8 ) );
+	for ( int i = 0; i < 8; i++ )
+	{
+		CHECK( ring.Pop( value ) );
+		CHECK_EQUAL( i, value );
+	}
+	CHECK( ring.IsEmpty() );
+}
+
+UNIT_TEST( RingWrapsIndices )
+{
+	// many times round a small ring, never more than half full
+	SpscRing< int, 4 > ring;
+	int value = 0;
+	for ( int i = 0; i < 100000; i++ )
+	{
+		CHECK( ring.Push( i ) );
+		CHECK( ring.Push( -i ) );
+		CHECK( ring.Pop( value ) );
+		CHECK_EQUAL( i, value );
+		CHECK( ring.Pop( value ) );
+		CHECK_EQUAL( -i, value );
+	}
+}
+
+UNIT_TEST( EventRingCountsDropsAndLatency )
+{
+	PlayerEventRing events;
+	for ( int i = 0; i < 64; i++ )
+	{
+		CHECK( events.Post( PLAYER_EVENT_VIDEO_SIZE, i, -i ) );
+	}
+	CHECK( !events.Post( PLAYER_EVENT_COMPLETION ) );
+	CHECK_EQUAL( 1, events.GetDropped() );
+
+	PlayerEvent event;
+	for ( int i = 0; i < 64; i++ )
+	{
+		CHECK( events.Next( event ) );
+		CHECK_EQUAL( PLAYER_EVENT_VIDEO_SIZE, event.Type );
+		CHECK_EQUAL( i, event.Arg0 );
+		CHECK_EQUAL( -i, event.Arg1 );
+	}
+	CHECK( !events.Next( event ) );
+	CHECK_EQUAL( 64, events.GetLatencyCount() );
+	CHECK( events.GetLatencyMax() >= events.GetLatencyAverage() );
+	CHECK( events.GetLatencyAverage() >= 0.0 );
+
+	events.ResetLatency();
+	CHECK_EQUAL( 0, events.GetLatencyCount() );
+}
+
+//==============================================================
+// Producer and consumer threads hammering one ring.
+
+static const int STRESS_EVENTS = 2000000;
+
+struct StressRing
+{
+	SpscRing< PlayerEvent, 64 >	Ring;
+	volatile int				ProducerSpins;
+};
+
+static void * StressProducer( void * param )
+{
+	StressRing * stress = static_cast< StressRing * >( param );
+	int spins = 0;
+	for ( int i = 0; i < STRESS_EVENTS; i++ )
+	{
+		PlayerEvent event;
+		event.Type = i % PLAYER_EVENT_MAX;
+		event.Arg0 = i;
+		event.Arg1 = ~i;
+		event.PostTime = i * 0.5;
+		while ( !stress->Ring.Push( event ) )
+		{
+			spins++;
+			if ( ( spins & 255 ) == 0 )
+			{
+				sched_yield();
+			}
+		}
+	}
+	stress->ProducerSpins = spins;
+	return NULL;
+}
+
+UNIT_TEST( RingSurvivesConcurrentProducer )
+{
+	StressRing stress;
+	stress.ProducerSpins = 0;
+	pthread_t producer;
+	CHECK( pthread_create( &producer, NULL, StressProducer, &stress ) == 0 );
+
+	// every event arrives once, in order, and was written whole
+	int expected = 0;
+	int torn = 0;
+	int spins = 0;
+	while ( expected < STRESS_EVENTS )
+	{
+		PlayerEvent event;
+		if ( !stress.Ring.Pop( event ) )
+		{
+			if ( ( ++spins & 255 ) == 0 )
+			{
+				sched_yield();
+			}
+			continue;
+		}
+		if ( event.Arg0 != expected )
+		{
+			break;
+		}
+		if ( event.Arg1 != ~expected || event.Type != expected % PLAYER_EVENT_MAX || event.PostTime != expected * 0.5 )
+		{
+			torn++;
+		}
+		expected++;
+	}
+	pthread_join( producer, NULL );
+	CHECK_EQUAL( STRESS_EVENTS, expected );
+	CHECK_EQUAL( 0, torn );
+	CHECK( stress.Ring.IsEmpty() );
+	OVR::UnitTest::Report( "%i events, producer waited on a full ring %i times", STRESS_EVENTS, stress.ProducerSpins );
+}
+
+struct DroppingProducer
+{
+	PlayerEventRing *	Events;
+	int					Posted;
+};
+
+static void * PostWithoutWaiting( void * param )
+{
+	DroppingProducer * producer = static_cast< DroppingProducer * >( param );
+	for ( int i = 0; i < STRESS_EVENTS / 4; i++ )
+	{
+		producer->Events->Post( PLAYER_EVENT_SEEK_COMPLETE, i );
+		__atomic_add_fetch( &producer->Posted, 1, __ATOMIC_RELEASE );
+	}
+	return NULL;
+}
+
+UNIT_TEST( EventRingAccountsForEveryPost )
+{
+	// a slow consumer: whatever doesn't fit is counted as dropped, never lost silently
+	PlayerEventRing events;
+	DroppingProducer producer = { &events, 0 };
+	pthread_t thread;
+	CHECK( pthread_create( &thread, NULL, PostWithoutWaiting, &producer ) == 0 );
+	int received = 0;
+	int last = -1;
+	bool ordered = true;
+	for ( ; ; )
+	{
+		PlayerEvent event;
+		if ( events.Next( event ) )
+		{
+			ordered = ordered && event.Arg0 > last;
+			last = event.Arg0;
+			received++;
+			continue;
+		}
+		sched_yield();
+		if ( __atomic_load_n( &producer.Posted, __ATOMIC_ACQUIRE ) == STRESS_EVENTS / 4 )
+		{
+			// drain what was pushed after the last look
+			while ( events.Next( event ) )
+			{
+				ordered = ordered && event.Arg0 > last;
+				last = event.Arg0;
+				received++;
+			}
+			break;
+		}
+	}
+	pthread_join( thread, NULL );
+	CHECK( ordered );
+	CHECK_EQUAL( STRESS_EVENTS / 4, received + events.GetDropped() );
+	OVR::UnitTest::Report( "%i received, %i dropped, %.3f ms max latency", received, events.GetDropped(),
+		events.GetLatencyMax() * 1000.0 );
+}
+
+//==============================================================
+// Benchmark against what MessageQueue::PostPrintf does for each message:
+// format into a buffer, copy it to the heap, queue it under a mutex, then
+// on the VR thread compare heads, sscanf the arguments and free it.
+
+struct TextQueue
+{
+	pthread_mutex_t		Mutex;
+	char *				Messages[64];
+	int					Head;
+	int					Tail;
+};
+
+static bool TextPost( TextQueue & queue, const char * format, const int a, const int b )
+{
+	char buffer[512];
+	snprintf( buffer, sizeof( buffer ), format, a, b );
+	char * message = strdup( buffer );
+	pthread_mutex_lock( &queue.Mutex );
+	const bool full = queue.Tail - queue.Head >= 64;
+	if ( !full )
+	{
+		queue.Messages[queue.Tail++ & 63] = message;
+	}
+	pthread_mutex_unlock( &queue.Mutex );
+	if ( full )
+	{
+		free( message );
+	}
+	return !full;
+}
+
+static char * TextNext( TextQueue & queue )
+{
+	pthread_mutex_lock( &queue.Mutex );
+	char * message = ( queue.Head != queue.Tail ) ? queue.Messages[queue.Head++ & 63] : NULL;
+	pthread_mutex_unlock( &queue.Mutex );
+	return message;
+}
+
+static bool MatchesHead( const char * head, const char * message )
+{
+	return strncmp( head, message, strlen( head ) ) == 0;
+}
+
+static const int BENCH_EVENTS = 2000000;
+
+static void * TextProducer( void * param )
+{
+	TextQueue * queue = static_cast< TextQueue * >( param );
+	for ( int i = 0; i < BENCH_EVENTS; i++ )
+	{
+		while ( !TextPost( *queue, "video %i %i", i, i + 1 ) )
+		{
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static void * RingProducer( void * param )
+{
+	PlayerEventRing * events = static_cast< PlayerEventRing * >( param );
+	for ( int i = 0; i < BENCH_EVENTS; i++ )
+	{
+		while ( !events->Post( PLAYER_EVENT_VIDEO_SIZE, i, i + 1 ) )
+		{
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+UNIT_BENCHMARK( BenchRingAgainstTextMessages )
+{
+	TextQueue queue;
+	pthread_mutex_init( &queue.Mutex, NULL );
+	queue.Head = 0;
+	queue.Tail = 0;
+
+	double start = OVR::UnitTest::GetSeconds();
+	pthread_t thread;
+	CHECK( pthread_create( &thread, NULL, TextProducer, &queue ) == 0 );
+	long long sum = 0;
+	for ( int received = 0; received < BENCH_EVENTS; )
+	{
+		char * message = TextNext( queue );
+		if ( message == NULL )
+		{
+			sched_yield();
+			continue;
+		}
+		if ( MatchesHead( "video ", message ) )
+		{
+			int width = 0;
+			int height = 0;
+			sscanf( message, "video %i %i", &width, &height );
+			sum += width;
+		}
+		free( message );
+		received++;
+	}
+	pthread_join( thread, NULL );
+	const double textSeconds = OVR::UnitTest::GetSeconds() - start;
+	pthread_mutex_destroy( &queue.Mutex );
+
+	PlayerEventRing events;
+	start = OVR::UnitTest::GetSeconds();
+	CHECK( pthread_create( &thread, NULL, RingProducer, &events ) == 0 );
+	long long ringSum = 0;
+	for ( int received = 0; received < BENCH_EVENTS; )
+	{
+		PlayerEvent event;
+		if ( !events.Next( event ) )
+		{
+			sched_yield();
+			continue;
+		}
+		if ( event.Type == PLAYER_EVENT_VIDEO_SIZE )
+		{
+			ringSum += event.Arg0;
+		}
+		received++;
+	}
+	pthread_join( thread, NULL );
+	const double ringSeconds = OVR::UnitTest::GetSeconds() - start;
+
+	CHECK_EQUAL( sum, ringSum );
+	OVR::UnitTest::Report( "text messages: %.1f ns per event, %.2f M events/s", textSeconds / BENCH_EVENTS * 1e9, BENCH_EVENTS / textSeconds * 1e-6 );
+	OVR::UnitTest::Report( "event ring:    %.1f ns per event, %.2f M events/s", ringSeconds / BENCH_EVENTS * 1e9, BENCH_EVENTS / ringSeconds * 1e-6 );
+	OVR::UnitTest::Report( "ring latency:  %.3f us average, %.3f us max", events.GetLatencyAverage() * 1e6, events.GetLatencyMax() * 1e6 );
+}
@@ -0,0 +1,200 @@
+/************************************************************************************
+
+Filename    :   TestPlaylistSession.cpp
+Content     :   PlaylistSession state machine tests against a fake player backend
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include "PlaylistSession.h"
+
+using namespace OVR;
+
+//==============================================================
+// Records what the session asked of the second player, and like the java
+// side only ever holds one preload at a time.
+class FakePlayerBackend : public PlaylistPlayerBackend
+{
+public:
+	FakePlayerBackend()
+		: Preloads( 0 )
+		, Promotes( 0 )
+		, Discards( 0 )
+		, LastGeneration( 0 )
+		, Holding( false )
+	{
+	}
+
+	virtual void PreloadVideo( const char * url, const int generation )
+	{
+		Preloads++;
+		LastUrl = url;
+		LastGeneration = generation;
+		Holding = true;
+	}
+
+	virtual void PromotePreload( const int generation )
+	{
+		Promotes++;
+		LastGeneration = generation;
+		Holding = false;
+	}
+
+	virtual void DiscardPreload( const int generation )
+	{
+		Discards++;
+		LastGeneration = generation;
+		Holding = false;
+	}
+
+	int		Preloads;
+	int		Promotes;
+	int		Discards;
+	String	LastUrl;
+	int		LastGeneration;
+	bool	Holding;
+};
+
+static Array< String > MakeItems( const char * a, const char * b, const char * c )
+{
+	Array< String > urls;
+	urls.PushBack( a );
+	urls.PushBack( b );
+	urls.PushBack( c );
+	return urls;
+}
+
+UNIT_TEST( PreloadsTheNextItemAndPromotesIt )
+{
+	FakePlayerBackend backend;
+	PlaylistSession session( backend );
+	session.SetItems( MakeItems( "a.mp4", "b.mp4", "c.mp4" ), 0 );
+	CHECK_EQUAL( 1, session.GetNextIndex() );
+
+	session.StartPreload();
+	CHECK_EQUAL( 1, backend.Preloads );
+	CHECK_STRING( "b.mp4", backend.LastUrl.ToCStr() );
+	CHECK_EQUAL( PlaylistSession::PRELOAD_PREPARING, session.GetPreloadState() );
+	// asking again while one is in flight changes nothing
+	session.StartPreload();
+	CHECK_EQUAL( 1, backend.Preloads );
+
+	session.OnPreloadReady( backend.LastGeneration );
+	CHECK_EQUAL( PlaylistSession::PRELOAD_READY, session.GetPreloadState() );
+	CHECK_EQUAL( PlaylistSession::ADVANCE_PROMOTED, session.Advance() );
+	CHECK_EQUAL( 1, backend.Promotes );
+	CHECK_EQUAL( 1, session.GetCurrentIndex() );
+	CHECK_EQUAL( PlaylistSession::PRELOAD_NONE, session.GetPreloadState() );
+
+	// the last item has nothing after it
+	session.StartPreload();
+	session.OnPreloadReady( backend.LastGeneration );
+	CHECK_EQUAL( PlaylistSession::ADVANCE_PROMOTED, session.Advance() );
+	session.StartPreload();
+	CHECK_EQUAL( 2, backend.Preloads );
+	CHECK_EQUAL( PlaylistSession::ADVANCE_END, session.Advance() );
+	CHECK( !backend.Holding );
+}
+
+UNIT_TEST( AdvanceWhilePreparingStartsCold )
+{
+	FakePlayerBackend backend;
+	PlaylistSession session( backend );
+	session.SetItems( MakeItems( "a.mp4", "b.mp4", "c.mp4" ), 0 );
+	session.StartPreload();
+	const int generation = backend.LastGeneration;
+	CHECK_EQUAL( PlaylistSession::ADVANCE_COLD, session.Advance() );
+	CHECK_EQUAL( 1, backend.Discards );
+	CHECK( !backend.Holding );
+
+	// the discarded player finishing preparing afterwards is ignored
+	CHECK( !session.IsActivePreload( generation ) );
+	session.OnPreloadReady( generation );
+	CHECK_EQUAL( PlaylistSession::PRELOAD_NONE, session.GetPreloadState() );
+	session.Clear();
+}
+
+UNIT_TEST( NewItemsKeepAPreloadThatStillFits )
+{
+	FakePlayerBackend backend;
+	PlaylistSession session( backend );
+	session.SetItems( MakeItems( "a.mp4", "b.mp4", "c.mp4" ), 0 );
+	session.StartPreload();
+	session.OnPreloadReady( backend.LastGeneration );
+
+	// same next item, the ready player is kept
+	session.SetItems( MakeItems( "x.mp4", "b.mp4", "c.mp4" ), 0 );
+	CHECK_EQUAL( PlaylistSession::PRELOAD_READY, session.GetPreloadState() );
+	CHECK_EQUAL( 0, backend.Discards );
+
+	// a different next item throws it away
+	session.SetItems( MakeItems( "a.mp4", "b.mp4", "c.mp4" ), 1 );
+	CHECK_EQUAL( PlaylistSession::PRELOAD_NONE, session.GetPreloadState() );
+	CHECK_EQUAL( 1, backend.Discards );
+	CHECK( !backend.Holding );
+
+	session.StartPreload();
+	CHECK_STRING( "c.mp4", backend.LastUrl.ToCStr() );
+	session.Clear();
+	CHECK_EQUAL( 2, backend.Discards );
+	CHECK_EQUAL( -1, session.GetNextIndex() );
+}
+
+UNIT_TEST( FailedItemIsNotRetried )
+{
+	FakePlayerBackend backend;
+	PlaylistSession session( backend );
+	session.SetItems( MakeItems( "a.mp4", "broken.mp4", "c.mp4" ), 0 );
+	session.StartPreload();
+	session.OnPreloadFailed( backend.LastGeneration );
+	CHECK_EQUAL( 1, backend.Discards );
+	session.StartPreload();
+	CHECK_EQUAL( 1, backend.Preloads );
+
+	// it still gets its cold start, and the item after it is preloaded
+	CHECK_EQUAL( PlaylistSession::ADVANCE_COLD, session.Advance() );
+	session.StartPreload();
+	CHECK_EQUAL( 2, backend.Preloads );
+	CHECK_STRING( "c.mp4", backend.LastUrl.ToCStr() );
+	session.Clear();
+}
+
+UNIT_TEST( ItemsWithoutAUrlAreNotPreloaded )
+{
+	FakePlayerBackend backend;
+	PlaylistSession session( backend );
+	session.SetItems( MakeItems( "a.mp4", "", "c.mp4" ), 0 );
+	session.StartPreload();
+	CHECK_EQUAL( 0, backend.Preloads );
+	CHECK_EQUAL( PlaylistSession::ADVANCE_COLD, session.Advance() );
+	CHECK_EQUAL( 0, backend.Discards );
+}
+
+UNIT_TEST( GenerationsNeverRepeat )
+{
+	// every preload gets a new generation, so a callback can't be credited to a later one
+	FakePlayerBackend backend;
+	PlaylistSession session( backend );
+	int last = 0;
+	for ( int i = 0; i < 100; i++ )
+	{
+		session.SetItems( MakeItems( "a.mp4", ( i & 1 ) ? "b.mp4" : "c.mp4", "d.mp4" ), 0 );
+		session.StartPreload();
+		CHECK( backend.LastGeneration > last );
+		last = backend.LastGeneration;
+		session.OnPreloadReady( last - 1 );
+		CHECK_EQUAL( PlaylistSession::PRELOAD_PREPARING, session.GetPreloadState() );
+	}
+	CHECK_EQUAL( 100, backend.Preloads );
+	CHECK_EQUAL( 99, backend.Discards );
+	session.Clear();
+}
@@ -0,0 +1,292 @@
+/************************************************************************************
+
+Filename    :   TestPositionJournal.cpp
+Content     :   PositionJournal tests, including a process killed while checkpointing
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "Kernel/OVR_Alg.h"
+
+#include "PositionJournal.h"
+
+using namespace OVR;
+
+static String JournalPath()
+{
+	String path = OVR::UnitTest::GetTempDir();
+	path += "/positions.journal";
+	return path;
+}
+
+static UInt64 VideoHash( const int video )
+{
+	char path[64];
+	snprintf( path, sizeof( path ), "/sdcard/Oculus/360Videos/video%i.mp4", video );
+	return PositionJournal::HashPath( path );
+}
+
+UNIT_TEST( PositionsSurviveReopening )
+{
+	const String path = JournalPath();
+	{
+		PositionJournal journal;
+		CHECK( journal.Open( path.ToCStr() ) );
+		journal.Checkpoint( VideoHash( 1 ), 1000, 60000 );
+		journal.Checkpoint( VideoHash( 2 ), 2000, -1 );
+		journal.Checkpoint( VideoHash( 1 ), 1500, 60000 );
+		// no Close(), as if the process died
+	}
+	PositionJournal journal;
+	CHECK( journal.Open( path.ToCStr() ) );
+	int position = 0;
+	int duration = 0;
+	CHECK( journal.GetPosition( VideoHash( 1 ), position, duration ) );
+	CHECK_EQUAL( 1500, position );
+	CHECK_EQUAL( 60000, duration );
+	CHECK( journal.GetPosition( VideoHash( 2 ), position, duration ) );
+	CHECK_EQUAL( 2000, position );
+	CHECK_EQUAL( -1, duration );
+	CHECK( !journal.GetPosition( VideoHash( 3 ), position, duration ) );
+}
+
+UNIT_TEST( TornRecordEndsTheJournal )
+{
+	const String path = JournalPath();
+	{
+		PositionJournal journal;
+		CHECK( journal.Open( path.ToCStr() ) );
+		journal.Checkpoint( VideoHash( 1 ), 1000, 60000 );
+		journal.Checkpoint( VideoHash( 1 ), 2000, 60000 );
+		journal.Checkpoint( VideoHash( 1 ), 3000, 60000 );
+	}
+	// flip a byte of the third record's position, 64 byte header and 24 byte records
+	const int fd = open( path.ToCStr(), O_RDWR );
+	CHECK( fd >= 0 );
+	UByte byte = 0;
+	CHECK( pread( fd, &byte, 1, 64 + 2 * 24 + 8 ) == 1 );
+	byte ^= 0x40;
+	CHECK( pwrite( fd, &byte, 1, 64 + 2 * 24 + 8 ) == 1 );
+	close( fd );
+
+	PositionJournal journal;
+	CHECK( journal.Open( path.ToCStr() ) );
+	int position = 0;
+	int duration = 0;
+	CHECK( journal.GetPosition( VideoHash( 1 ), position, duration ) );
+	CHECK_EQUAL( 2000, position );
+}
+
+UNIT_TEST( CompactionDropsTheStalestVideos )
+{
+	// More videos than a compacted journal keeps. Video 0 is seen first but
+	// watched again last, so it must outlive the videos updated after it.
+	const String path = JournalPath();
+	const int videos = 3000;
+	{
+		PositionJournal journal;
+		CHECK( journal.Open( path.ToCStr() ) );
+		for ( int i = 0; i < videos; i++ )
+		{
+			journal.Checkpoint( VideoHash( i ), i, 60000 );
+		}
+		journal.Checkpoint( VideoHash( 0 ), 4242, 60000 );
+	}
+	PositionJournal journal;
+	CHECK( journal.Open( path.ToCStr() ) );
+	int position = 0;
+	int duration = 0;
+	CHECK( journal.GetPosition( VideoHash( 0 ), position, duration ) );
+	CHECK_EQUAL( 4242, position );
+	CHECK( journal.GetPosition( VideoHash( videos - 1 ), position, duration ) );
+	CHECK_EQUAL( videos - 1, position );
+	// 2048 are kept: video 0 and the 2047 most recent of the rest
+	CHECK( journal.GetPosition( VideoHash( videos - 2047 ), position, duration ) );
+	CHECK( !journal.GetPosition( VideoHash( videos - 2048 ), position, duration ) );
+	CHECK( !journal.GetPosition( VideoHash( 1 ), position, duration ) );
+
+	// compacting again keeps the same set, now stored in update order
+	journal.Close();
+	CHECK( journal.Open( path.ToCStr() ) );
+	CHECK( journal.GetPosition( VideoHash( 0 ), position, duration ) );
+	CHECK_EQUAL( 4242, position );
+	CHECK( !journal.GetPosition( VideoHash( videos - 2048 ), position, duration ) );
+}
+
+UNIT_TEST( CompactionWhileFullKeepsRecentUpdates )
+{
+	// the background compaction as the mapping fills up uses the same order
+	const String path = JournalPath();
+	PositionJournal journal;
+	CHECK( journal.Open( path.ToCStr() ) );
+	for ( int round = 0; round < 3; round++ )
+	{
+		for ( int i = 0; i < 2500; i++ )
+		{
+			journal.Checkpoint( VideoHash( i ), round * 100000 + i, 60000 );
+		}
+		journal.Checkpoint( VideoHash( 7 ), round * 100000 + 7777, 60000 );
+	}
+	int position = 0;
+	int duration = 0;
+	CHECK( journal.GetPosition( VideoHash( 7 ), position, duration ) );
+	CHECK_EQUAL( 200000 + 7777, position );
+	journal.Close();
+	CHECK( journal.Open( path.ToCStr() ) );
+	CHECK( journal.GetPosition( VideoHash( 7 ), position, duration ) );
+	CHECK_EQUAL( 200000 + 7777, position );
+	CHECK( journal.GetPosition( VideoHash( 2499 ), position, duration ) );
+	CHECK_EQUAL( 200000 + 2499, position );
+}
+
+UNIT_TEST( CheckpointsWhileCompactingAreKept )
+{
+	// Past three quarters a worker compacts from a snapshot. Everything
+	// checkpointed after it, including what arrives once the old mapping is
+	// full, must end up in the journal that replaces it.
+	const String path = JournalPath();
+	PositionJournal journal;
+	CHECK( journal.Open( path.ToCStr() ) );
+	for ( int i = 0; i < 3072; i++ )
+	{
+		journal.Checkpoint( VideoHash( i % 100 ), i, 60000 );
+	}
+	for ( int i = 0; i < 1500; i++ )
+	{
+		journal.Checkpoint( VideoHash( 100 + i ), 500000 + i, 60000 );
+	}
+	journal.Checkpoint( VideoHash( 5 ), 4242, 60000 );
+	journal.Close();
+
+	CHECK( journal.Open( path.ToCStr() ) );
+	int position = 0;
+	int duration = 0;
+	CHECK( journal.GetPosition( VideoHash( 5 ), position, duration ) );
+	CHECK_EQUAL( 4242, position );
+	CHECK( journal.GetPosition( VideoHash( 99 ), position, duration ) );
+	CHECK_EQUAL( 2999, position );
+	int missing = 0;
+	for ( int i = 0; i < 1500; i++ )
+	{
+		missing += journal.GetPosition( VideoHash( 100 + i ), position, duration ) && position == 500000 + i ? 0 : 1;
+	}
+	CHECK_EQUAL( 0, missing );
+}
+
+//==============================================================
+// A child process checkpoints as fast as it can and is killed at a random
+// moment, over and over on the same journal, sometimes in the middle of
+// a compaction. Every position recovered must be one the child wrote, and
+// never older than what an earlier round recovered.
+
+static const int TORTURE_VIDEOS = 40;
+
+static void CheckpointForever( const char * path, const int round )
+{
+	PositionJournal journal;
+	if ( !journal.Open( path ) )
+	{
+		_exit( 2 );
+	}
+	// positions only grow, and encode the video they belong to
+	for ( int i = 0; ; i++ )
+	{
+		const int video = i % TORTURE_VIDEOS;
+		journal.Checkpoint( VideoHash( video ), ( round * 1000000 + i ) * TORTURE_VIDEOS + video, 60000 );
+	}
+}
+
+UNIT_TEST( SurvivesBeingKilledWhileCheckpointing )
+{
+	const String path = JournalPath();
+	int recovered[TORTURE_VIDEOS];
+	for ( int i = 0; i < TORTURE_VIDEOS; i++ )
+	{
+		recovered[i] = -1;
+	}
+	srand( 4321 );
+
+	int rounds = 0;
+	int bad = 0;
+	int regressions = 0;
+	for ( int round = 0; round < 40; round++ )
+	{
+		const pid_t child = fork();
+		CHECK( child >= 0 );
+		if ( child == 0 )
+		{
+			CheckpointForever( path.ToCStr(), round );
+		}
+		usleep( 1000 + rand() % 20000 );
+		kill( child, SIGKILL );
+		int status = 0;
+		waitpid( child, &status, 0 );
+		CHECK( WIFSIGNALED( status ) );
+		rounds++;
+
+		PositionJournal journal;
+		CHECK( journal.Open( path.ToCStr() ) );
+		for ( int video = 0; video < TORTURE_VIDEOS; video++ )
+		{
+			int position = 0;
+			int duration = 0;
+			if ( !journal.GetPosition( VideoHash( video ), position, duration ) )
+			{
+				bad += ( recovered[video] >= 0 ) ? 1 : 0;
+				continue;
+			}
+			if ( position % TORTURE_VIDEOS != video || duration != 60000 )
+			{
+				bad++;
+			}
+			if ( position < recovered[video] )
+			{
+				regressions++;
+			}
+			recovered[video] = position;
+		}
+	}
+	CHECK_EQUAL( 0, bad );
+	CHECK_EQUAL( 0, regressions );
+	int seen = 0;
+	for ( int video = 0; video < TORTURE_VIDEOS; video++ )
+	{
+		seen += ( recovered[video] >= 0 ) ? 1 : 0;
+	}
+	CHECK_EQUAL( TORTURE_VIDEOS, seen );
+	OVR::UnitTest::Report( "%i kills, latest recovered checkpoint %i", rounds, recovered[0] / TORTURE_VIDEOS % 1000000 );
+}
+
+UNIT_BENCHMARK( BenchCheckpoint )
+{
+	const String path = JournalPath();
+	PositionJournal journal;
+	CHECK( journal.Open( path.ToCStr() ) );
+	const int count = 1000000;
+	double slowest = 0.0;
+	const double start = OVR::UnitTest::GetSeconds();
+	for ( int i = 0; i < count; i++ )
+	{
+		const double before = OVR::UnitTest::GetSeconds();
+		journal.Checkpoint( VideoHash( i & 15 ), i, 60000 );
+		slowest = Alg::Max( slowest, OVR::UnitTest::GetSeconds() - before );
+	}
+	const double seconds = OVR::UnitTest::GetSeconds() - start;
+	OVR::UnitTest::Report( "%.1f ns per checkpoint, compactions included, slowest %.1f us",
+			seconds / count * 1e9, slowest * 1e6 );
+}
@@ -0,0 +1,381 @@
+/************************************************************************************
+
+Filename    :   TestSeekScheduler.cpp
+Content     :   Keyframe index and seek scheduler tests against a simulated player
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdlib.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "Mp4Builder.h"
+#include "KeyframeIndex.h"
+#include "SeekScheduler.h"
+#include "PlaybackState.h"
+
+using namespace OVR;
+
+// A 60 s, 30 fps video track with a keyframe every two seconds.
+static const UInt32 TIMESCALE = 90000;
+static const UInt32 SAMPLE_DELTA = 3000;
+static const UInt32 SAMPLES = 1800;
+static const UInt32 GOP = 60;
+
+static String WriteGopVideo()
+{
+	Array< UInt32 > sync;
+	for ( UInt32 sample = 1; sample <= SAMPLES; sample += GOP )
+	{
+		sync.PushBack( sample );
+	}
+	Mp4Builder mp4;
+	mp4.Open( "ftyp" );
+	mp4.Chars( "isom" );
+	mp4.U32( 0 );
+	mp4.Close();
+	mp4.Open( "moov" );
+	// a sound track first, the video track has to be searched for
+	mp4.Open( "trak" );
+	mp4.OpenMedia( "soun", 48000, 48000 * 60 );
+	mp4.Close();
+	mp4.Close();
+	mp4.Open( "trak" );
+	mp4.OpenMedia( "vide", TIMESCALE, SAMPLES * SAMPLE_DELTA );
+	mp4.Open( "minf" );
+	mp4.SampleTables( SAMPLES, SAMPLE_DELTA, sync );
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+	mp4.Close();
+
+	String path = OVR::UnitTest::GetTempDir();
+	path += "/gop.mp4";
+	return mp4.WriteFile( path.ToCStr() ) ? path : String();
+}
+
+UNIT_TEST( IndexesMp4SyncSamples )
+{
+	const String path = WriteGopVideo();
+	KeyframeIndex index;
+	CHECK( index.BuildFromFile( path.ToCStr() ) );
+	CHECK_EQUAL( 30, index.GetCount() );
+	CHECK_EQUAL( 0, index.GetKeyframeMs( 0 ) );
+	CHECK_EQUAL( 2000, index.GetKeyframeMs( 1 ) );
+	CHECK_EQUAL( 58000, index.GetKeyframeMs( 29 ) );
+
+	CHECK_EQUAL( 4000, index.Floor( 5999 ) );
+	CHECK_EQUAL( 6000, index.Floor( 6000 ) );
+	// nearest, but never back to where the seek started
+	CHECK_EQUAL( 6000, index.Snap( 6500, 1000 ) );
+	CHECK_EQUAL( 8000, index.Snap( 6500, 6000 ) );
+	CHECK_EQUAL( 4000, index.Snap( 5500, 6000 ) );
+
+	KeyframeIndex none;
+	CHECK( !none.BuildFromFile( "/nonexistent.mp4" ) );
+	CHECK_EQUAL( 1234, none.Snap( 1234, 0 ) );
+}
+
+//==============================================================
+// A simulated MediaPlayer. Seeks take SeekSeconds. A seekTo made while one
+// is running is queued, and the player reports only the last one, the way
+// Android's MediaPlayer does. Its completion reports carry the id java
+// recorded for the last seekTo.
+
+class SimulatedPlayer : public SeekBackend
+{
+public:
+	SimulatedPlayer( PlaybackStateBlock & state )
+		: State( state )
+		, SeekSeconds( 0.1 )
+		, Now( 0.0 )
+		, PositionMs( 0 )
+		, Seeking( false )
+		, TargetMs( 0 )
+		, QueuedMs( -1 )
+		, SeekDoneTime( 0.0 )
+		, LastSeekId( 0 )
+		, CompletedSeekId( 0 )
+		, Issued( 0 )
+		, Abandoned( 0 )
+	{
+	}
+
+	virtual void IssueSeek( const int positionMs, const int seekId )
+	{
+		Issued++;
+		LastSeekId = seekId;
+		if ( Seeking )
+		{
+			QueuedMs = positionMs;
+			return;
+		}
+		Seeking = true;
+		TargetMs = positionMs;
+		SeekDoneTime = Now + SeekSeconds;
+	}
+
+	virtual void AbandonSeek( const int seekId )
+	{
+		Abandoned++;
+		State.ReleasePosition( seekId );
+	}
+
+	// Advances the player to now. Returns true with the seek id when it
+	// reports a completion.
+	bool Advance( const double now, int & outSeekId )
+	{
+		Now = now;
+		if ( !Seeking || now < SeekDoneTime )
+		{
+			return false;
+		}
+		PositionMs = TargetMs;
+		if ( QueuedMs >= 0 )
+		{
+			TargetMs = QueuedMs;
+			QueuedMs = -1;
+			SeekDoneTime = now + SeekSeconds;
+			return false;
+		}
+		Seeking = false;
+		CompletedSeekId = LastSeekId;
+		outSeekId = CompletedSeekId;
+		return true;
+	}
+
+	// The periodic state report, paused so positions are easy to follow.
+	void Report()
+	{
+		State.Update( false, PositionMs, 60000, 0, 0, CompletedSeekId );
+	}
+
+	PlaybackStateBlock &	State;
+	double					SeekSeconds;
+	double					Now;
+	int						PositionMs;
+	bool					Seeking;
+	int						TargetMs;
+	int						QueuedMs;
+	double					SeekDoneTime;
+	int						LastSeekId;
+	int						CompletedSeekId;
+	int						Issued;
+	int						Abandoned;
+};
+
+// What Oculus360Videos::SeekTo does.
+static int RequestSeek( SeekScheduler & seeks, PlaybackStateBlock & state, const int targetMs, const double now )
+{
+	const int target = seeks.RequestSeek( targetMs, state.Read().PositionMs, now );
+	state.HoldPosition( target, seeks.GetTargetId() );
+	return target;
+}
+
+UNIT_TEST( BurstSendsFirstAndLatestOnly )
+{
+	PlaybackStateBlock state;
+	SimulatedPlayer player( state );
+	SeekScheduler seeks( player );
+	player.SeekSeconds = 0.5;
+	double now = 0.0;
+
+	for ( int i = 1; i <= 10; i++ )
+	{
+		RequestSeek( seeks, state, i * 1000, now );
+		seeks.Update( now );
+		now += 0.016;
+		int seekId;
+		if ( player.Advance( now, seekId ) )
+		{
+			seeks.OnSeekComplete( seekId, now );
+		}
+	}
+	CHECK_EQUAL( 1, player.Issued );
+	CHECK_EQUAL( 8, seeks.GetCoalescedCount() );
+	CHECK_EQUAL( 10000, seeks.GetTargetMs() );
+
+	for ( int frame = 0; frame < 100 && seeks.IsSeeking(); frame++ )
+	{
+		seeks.Update( now );
+		now += 0.016;
+		int seekId;
+		if ( player.Advance( now, seekId ) )
+		{
+			seeks.OnSeekComplete( seekId, now );
+		}
+	}
+	CHECK( !seeks.IsSeeking() );
+	CHECK_EQUAL( 2, player.Issued );
+	CHECK_EQUAL( 10000, player.PositionMs );
+	CHECK( seeks.IsAwaitingFrame() );
+	seeks.OnFrameLatched( now );
+	CHECK_EQUAL( 1, seeks.GetCompletedCount() );
+	CHECK( seeks.GetFirstFrameLatencyAverage() >= 1.0 );
+}
+
+UNIT_TEST( SnapsToKeyframes )
+{
+	const String path = WriteGopVideo();
+	KeyframeIndex index;
+	CHECK( index.BuildFromFile( path.ToCStr() ) );
+	PlaybackStateBlock state;
+	SimulatedPlayer player( state );
+	SeekScheduler seeks( player );
+	seeks.SetKeyframeIndex( &index );
+	CHECK_EQUAL( 10000, RequestSeek( seeks, state, 10700, 0.0 ) );
+	CHECK_EQUAL( 10000, state.Read().PositionMs );
+	seeks.Reset();
+	CHECK_EQUAL( 10700, RequestSeek( seeks, state, 10700, 0.0 ) );
+}
+
+UNIT_TEST( LateCompletionDoesntEndTheNextSeek )
+{
+	PlaybackStateBlock state;
+	SimulatedPlayer player( state );
+	SeekScheduler seeks( player );
+
+	RequestSeek( seeks, state, 5000, 0.0 );
+	seeks.Update( 0.0 );
+	const int first = player.LastSeekId;
+
+	// the player goes quiet past the timeout, and the user seeks again
+	RequestSeek( seeks, state, 9000, 2.5 );
+	seeks.Update( 2.5 );
+	CHECK_EQUAL( 1, seeks.GetTimedOutCount() );
+	CHECK_EQUAL( 2, seeks.GetIssuedCount() );
+	const int second = player.LastSeekId;
+	CHECK( second != first );
+
+	// the first seek's completion was already queued, it must not end the second
+	seeks.OnSeekComplete( first, 2.6 );
+	CHECK( seeks.IsSeeking() );
+	CHECK_EQUAL( 9000, seeks.GetTargetMs() );
+	CHECK_EQUAL( 1, seeks.GetStaleCount() );
+
+	seeks.OnSeekComplete( second, 2.7 );
+	CHECK( !seeks.IsSeeking() );
+	CHECK_NEAR( 0.2, seeks.GetSeekLatencyAverage(), 0.001 );
+}
+
+UNIT_TEST( PositionReportsWaitForTheSeek )
+{
+	PlaybackStateBlock state;
+	SimulatedPlayer player( state );
+	SeekScheduler seeks( player );
+	player.PositionMs = 1000;
+	player.Report();
+
+	RequestSeek( seeks, state, 30000, 0.0 );
+	seeks.Update( 0.0 );
+	const int seekId = player.LastSeekId;
+
+	// the periodic reports still carry the old position
+	player.Report();
+	CHECK_EQUAL( 30000, state.Read().PositionMs );
+	int completedId = 0;
+	CHECK( !player.Advance( 0.05, completedId ) );
+	player.Report();
+	CHECK_EQUAL( 30000, state.Read().PositionMs );
+
+	// once the player has done it, its reports count again
+	CHECK( player.Advance( 0.2, completedId ) );
+	CHECK_EQUAL( seekId, completedId );
+	seeks.OnSeekComplete( completedId, 0.2 );
+	player.PositionMs = 30040;
+	player.Report();
+	CHECK_EQUAL( 30040, state.Read().PositionMs );
+	// a full write, e.g. for a new video, drops any hold
+	RequestSeek( seeks, state, 40000, 0.3 );
+	state.Write( PlaybackStateData() );
+	player.Report();
+	CHECK_EQUAL( 30040, state.Read().PositionMs );
+}
+
+UNIT_TEST( AbandonedSeekGivesThePositionBack )
+{
+	PlaybackStateBlock state;
+	SimulatedPlayer player( state );
+	SeekScheduler seeks( player );
+	player.PositionMs = 1000;
+	RequestSeek( seeks, state, 30000, 0.0 );
+	seeks.Update( 0.0 );
+	player.Report();
+	CHECK_EQUAL( 30000, state.Read().PositionMs );
+
+	// the player never answers
+	seeks.Update( 2.5 );
+	CHECK_EQUAL( 1, player.Abandoned );
+	CHECK( !seeks.IsSeeking() );
+	player.Report();
+	CHECK_EQUAL( 1000, state.Read().PositionMs );
+}
+
+//==============================================================
+// Random swipes against the simulated player, some seeks hanging past the
+// timeout. The position the VR thread reads must never fall back to where
+// the player was before the latest request until that request completed.
+
+UNIT_TEST( RandomSwipesNeverShowAStalePosition )
+{
+	const String path = WriteGopVideo();
+	KeyframeIndex index;
+	CHECK( index.BuildFromFile( path.ToCStr() ) );
+	PlaybackStateBlock state;
+	SimulatedPlayer player( state );
+	SeekScheduler seeks( player );
+	seeks.SetKeyframeIndex( &index );
+	srand( 1234 );
+
+	int stale = 0;
+	int latestTarget = -1;
+	double now = 0.0;
+	for ( int frame = 0; frame < 200000; frame++ )
+	{
+		now += 1.0 / 60.0;
+		if ( ( rand() % 20 ) == 0 )
+		{
+			const int from = state.Read().PositionMs;
+			const int delta = ( ( rand() % 2 ) ? 1 : -1 ) * ( 1000 + rand() % 9000 );
+			latestTarget = RequestSeek( seeks, state, Alg::Clamp( from + delta, 0, 58000 ), now );
+		}
+		// every so often the player takes far too long
+		player.SeekSeconds = ( ( rand() % 50 ) == 0 ) ? 3.0 : 0.05 + ( rand() % 100 ) * 0.002;
+		seeks.Update( now );
+
+		int seekId;
+		if ( player.Advance( now, seekId ) )
+		{
+			seeks.OnSeekComplete( seekId, now );
+		}
+		if ( ( frame % 6 ) == 0 )
+		{
+			player.Report();
+		}
+		if ( seeks.IsSeeking() && state.Read().PositionMs != seeks.GetTargetMs() )
+		{
+			stale++;
+		}
+		if ( seeks.IsAwaitingFrame() )
+		{
+			seeks.OnFrameLatched( now );
+		}
+	}
+	CHECK( latestTarget >= 0 );
+	CHECK_EQUAL( 0, stale );
+	CHECK( seeks.GetTimedOutCount() > 0 );
+	CHECK( seeks.GetCompletedCount() > 0 );
+	OVR::UnitTest::Report( "%i issued, %i coalesced, %i timed out, %i stale completions ignored",
+		seeks.GetIssuedCount(), seeks.GetCoalescedCount(), seeks.GetTimedOutCount(), seeks.GetStaleCount() );
+	OVR::UnitTest::Report( "seek to first frame: %.1f ms average, %.1f ms max",
+		seeks.GetFirstFrameLatencyAverage() * 1000.0, seeks.GetFirstFrameLatencyMax() * 1000.0 );
+}
@@ -0,0 +1,286 @@
+/************************************************************************************
+
+Filename    :   TestSubtitles.cpp
+Content     :   SRT and WebVTT parsing, cue lookup and layout caching
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include "Kernel/OVR_Alg.h"
+#include "Kernel/OVR_String.h"
+#include "BitmapFont.h"
+#include "Subtitles.h"
+
+using namespace OVR;
+
+static bool ParseText( SubtitleTrack & track, const char * text )
+{
+	return track.Parse( text, static_cast< int >( strlen( text ) ) );
+}
+
+static String TempPath( const char * name )
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+}
+
+static bool WriteText( const String & path, const char * text )
+{
+	FILE * f = fopen( path.ToCStr(), "wb" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	fputs( text, f );
+	return fclose( f ) == 0;
+}
+
+//==============================================================
+
+UNIT_TEST( CueTimestampsInBothFormats )
+{
+	int ms = -1;
+	CHECK( ParseCueTimestamp( "01:02:03,456", ms ) );
+	CHECK_EQUAL( ( ( 1 * 60 + 2 ) * 60 + 3 ) * 1000 + 456, ms );
+	CHECK( ParseCueTimestamp( "  02:03.4", ms ) );
+	CHECK_EQUAL( ( 2 * 60 + 3 ) * 1000 + 400, ms );
+	CHECK( ParseCueTimestamp( "00:00:05", ms ) );
+	CHECK_EQUAL( 5000, ms );
+	// more than three digits of fraction are ignored
+	CHECK( ParseCueTimestamp( "00:01.23456", ms ) );
+	CHECK_EQUAL( 1234, ms );
+	// hours past two digits
+	CHECK( ParseCueTimestamp( "100:00:00.000", ms ) );
+	CHECK_EQUAL( 360000000, ms );
+
+	CHECK( !ParseCueTimestamp( "12", ms ) );
+	CHECK( !ParseCueTimestamp( "ab:cd", ms ) );
+	CHECK( !ParseCueTimestamp( "", ms ) );
+}
+
+UNIT_TEST( SrtCuesAndMarkup )
+{
+	SubtitleTrack track;
+	CHECK( ParseText( track,
+		"\xEF\xBB\xBF" "1\r\n"
+		"00:00:01,000 --> 00:00:02,500\r\n"
+		"<i>Hello</i> there\r\n"
+		"{\\an8}second &amp; line\r\n"
+		"\r\n"
+		"2\r\n"
+		"00:00:03,000 --> 00:00:04,000 X1:10 X2:20\r\n"
+		"<font color=\"#ff0000\">red</font>\r\n"
+		"\r\n"
+		"3\r\n"
+		"00:00:05,000 --> 00:00:04,000\r\n"
+		"ends before it starts\r\n"
+		"\r\n"
+		"4\r\n"
+		"00:00:06,000 --> 00:00:07,000\r\n"
+		"\r\n"
+		"5\r\n"
+		"00:00:08,000 --> 00:00:09,000\r\n"
+		"no blank line at the end" ) );
+	CHECK_EQUAL( 3, track.GetCueCount() );
+	CHECK_EQUAL( 1000, track.GetCue( 0 ).StartMs );
+	CHECK_EQUAL( 2500, track.GetCue( 0 ).EndMs );
+	CHECK_STRING( "Hello there\nsecond & line", track.GetCue( 0 ).Text.ToCStr() );
+	CHECK_STRING( "red", track.GetCue( 1 ).Text.ToCStr() );
+	CHECK_STRING( "no blank line at the end", track.GetCue( 2 ).Text.ToCStr() );
+}
+
+UNIT_TEST( WebVttCuesAndBlocks )
+{
+	SubtitleTrack track;
+	CHECK( ParseText( track,
+		"WEBVTT - a title\n"
+		"\n"
+		"NOTE this is a comment\n"
+		"that spans lines\n"
+		"\n"
+		"STYLE\n"
+		"::cue { color: yellow }\n"
+		"\n"
+		"intro\n"
+		"00:01.000 --> 00:02.000 align:start position:10%\n"
+		"<v Roger>Hi &lt;there&gt;</v>\n"
+		"\n"
+		"00:00:02.500 --> 00:00:03.000\n"
+		"<c.yellow>Two</c>&nbsp;words\n" ) );
+	CHECK_EQUAL( 2, track.GetCueCount() );
+	CHECK_STRING( "Hi <there>", track.GetCue( 0 ).Text.ToCStr() );
+	CHECK_EQUAL( 2500, track.GetCue( 1 ).StartMs );
+	CHECK_STRING( "Two words", track.GetCue( 1 ).Text.ToCStr() );
+
+	CHECK( !ParseText( track, "WEBVTT\n\nNOTE nothing else\n" ) );
+	CHECK( track.IsEmpty() );
+}
+
+UNIT_TEST( CuesAreSortedAndOverlapsFound )
+{
+	// out of order, and a long cue that outlasts the ones after it
+	SubtitleTrack track;
+	CHECK( ParseText( track,
+		"00:00:10.000 --> 00:00:12.000\nc\n\n"
+		"00:00:01.000 --> 00:00:30.000\nlong\n\n"
+		"00:00:05.000 --> 00:00:06.000\nb\n\n"
+		"00:00:40.000 --> 00:00:41.000\nd\n\n" ) );
+	CHECK_EQUAL( 4, track.GetCueCount() );
+	CHECK_STRING( "long", track.GetCue( 0 ).Text.ToCStr() );
+	CHECK_STRING( "b", track.GetCue( 1 ).Text.ToCStr() );
+
+	CHECK_EQUAL( -1, track.FindCue( 500 ) );
+	CHECK_EQUAL( 0, track.FindCue( 1000 ) );
+	// the latest to start wins
+	CHECK_EQUAL( 1, track.FindCue( 5500 ) );
+	CHECK_EQUAL( 0, track.FindCue( 6000 ) );
+	CHECK_EQUAL( 2, track.FindCue( 11000 ) );
+	// the long cue, behind one that has ended
+	CHECK_EQUAL( 0, track.FindCue( 20000 ) );
+	CHECK_EQUAL( -1, track.FindCue( 30000 ) );
+	CHECK_EQUAL( 3, track.FindCue( 40999 ) );
+	CHECK_EQUAL( -1, track.FindCue( 41000 ) );
+}
+
+UNIT_TEST( FindCueMatchesALinearScan )
+{
+	// random overlapping cues against the definition: the latest starting cue showing
+	String text;
+	UInt32 state = 17;
+	for ( int i = 0; i < 500; i++ )
+	{
+		state = state * 1664525u + 1013904223u;
+		const int start = ( state >> 8 ) % 600000;
+		state = state * 1664525u + 1013904223u;
+		const int length = 100 + ( state >> 8 ) % ( ( i % 10 == 0 ) ? 60000 : 4000 );
+		char cue[128];
+		snprintf( cue, sizeof( cue ), "00:%02i:%02i.%03i --> 00:%02i:%02i.%03i\ncue %i\n\n",
+			start / 60000, start / 1000 % 60, start % 1000,
+			( start + length ) / 60000, ( start + length ) / 1000 % 60, ( start + length ) % 1000, i );
+		text += cue;
+	}
+	SubtitleTrack track;
+	CHECK( ParseText( track, text.ToCStr() ) );
+	CHECK_EQUAL( 500, track.GetCueCount() );
+	for ( int position = 0; position < 720000; position += 97 )
+	{
+		int expected = -1;
+		for ( int i = 0; i < track.GetCueCount(); i++ )
+		{
+			const SubtitleCue & cue = track.GetCue( i );
+			if ( cue.StartMs <= position && cue.EndMs > position )
+			{
+				expected = i;
+			}
+		}
+		const int found = track.FindCue( position );
+		// cues starting together may be found in either order
+		CHECK( found == expected || ( found >= 0 && expected >= 0 &&
+			track.GetCue( found ).StartMs == track.GetCue( expected ).StartMs && track.GetCue( found ).EndMs > position ) );
+	}
+}
+
+UNIT_TEST( LayoutIsWrappedOnceForAWidth )
+{
+	SubtitleTrack track;
+	CHECK( ParseText( track, "00:00.000 --> 00:01.000\nthe quick brown fox jumps over\nthe dog\n" ) );
+	BitmapFont font;
+	// twelve characters to a line
+	const float width = 12.0f * BitmapFont::GetCharWidth();
+	const SubtitleCue & cue = track.GetLayout( 0, font, width );
+	CHECK_STRING( "the quick\nbrown fox\njumps over\nthe dog", cue.Layout.ToCStr() );
+	CHECK_EQUAL( 4, cue.LineCount );
+
+	// cached: a later change to the text isn't seen until the width changes
+	const_cast< SubtitleCue & >( cue ).Text = "changed";
+	CHECK_STRING( "the quick\nbrown fox\njumps over\nthe dog", track.GetLayout( 0, font, width ).Layout.ToCStr() );
+	CHECK_STRING( "changed", track.GetLayout( 0, font, width * 2.0f ).Layout.ToCStr() );
+	CHECK_EQUAL( 1, track.GetCue( 0 ).LineCount );
+}
+
+UNIT_TEST( LoadForVideoPrefersSrt )
+{
+	SubtitleTrack track;
+	const String video = TempPath( "movie.mp4" );
+	CHECK( !track.LoadForVideo( video.ToCStr() ) );
+	CHECK( !track.LoadForVideo( "movie.mp4" ) );
+
+	CHECK( WriteText( TempPath( "movie.vtt" ), "WEBVTT\n\n00:01.000 --> 00:02.000\nfrom vtt\n" ) );
+	CHECK( track.LoadForVideo( video.ToCStr() ) );
+	CHECK_STRING( "from vtt", track.GetCue( 0 ).Text.ToCStr() );
+
+	CHECK( WriteText( TempPath( "movie.srt" ), "1\n00:00:01,000 --> 00:00:02,000\nfrom srt\n" ) );
+	CHECK( track.LoadForVideo( video.ToCStr() ) );
+	CHECK_STRING( "from srt", track.GetCue( 0 ).Text.ToCStr() );
+
+	// an empty srt falls through to the vtt
+	CHECK( WriteText( TempPath( "movie.srt" ), "\n" ) );
+	CHECK( track.LoadForVideo( video.ToCStr() ) );
+	CHECK_STRING( "from vtt", track.GetCue( 0 ).Text.ToCStr() );
+}
+
+//==============================================================
+// A feature length SRT: parse time, and a lookup every frame against
+// scanning every cue.
+
+UNIT_BENCHMARK( BenchParseAndLookup )
+{
+	const int cues = 2000;
+	String text;
+	for ( int i = 0; i < cues; i++ )
+	{
+		const int start = i * 3000;
+		const int end = start + 2500;
+		char cue[256];
+		snprintf( cue, sizeof( cue ), "%i\r\n%02i:%02i:%02i,%03i --> %02i:%02i:%02i,%03i\r\n<i>Line %i of the film</i>\r\nand a second line\r\n\r\n",
+			i + 1, start / 3600000, start / 60000 % 60, start / 1000 % 60, start % 1000,
+			end / 3600000, end / 60000 % 60, end / 1000 % 60, end % 1000, i );
+		text += cue;
+	}
+	SubtitleTrack track;
+	const int parses = 20;
+	double start = OVR::UnitTest::GetSeconds();
+	for ( int i = 0; i < parses; i++ )
+	{
+		CHECK( ParseText( track, text.ToCStr() ) );
+	}
+	const double parseSeconds = ( OVR::UnitTest::GetSeconds() - start ) / parses;
+	CHECK_EQUAL( cues, track.GetCueCount() );
+
+	// 60 fps for the whole film
+	const int frames = cues * 3 * 60;
+	int found = 0;
+	start = OVR::UnitTest::GetSeconds();
+	for ( int f = 0; f < frames; f++ )
+	{
+		found += track.FindCue( f * 50 / 3 ) >= 0 ? 1 : 0;
+	}
+	const double findSeconds = OVR::UnitTest::GetSeconds() - start;
+
+	int scanned = 0;
+	start = OVR::UnitTest::GetSeconds();
+	for ( int f = 0; f < frames; f += 60 )
+	{
+		const int position = f * 50 / 3;
+		int cue = -1;
+		for ( int i = 0; i < track.GetCueCount(); i++ )
+		{
+			const SubtitleCue & c = track.GetCue( i );
+			cue = ( c.StartMs <= position && c.EndMs > position ) ? i : cue;
+		}
+		scanned += cue >= 0 ? 1 : 0;
+	}
+	const double scanSeconds = ( OVR::UnitTest::GetSeconds() - start ) * 60.0;
+	CHECK( found > 0 && scanned > 0 );
+
+	OVR::UnitTest::Report( "%i cues, %.0f KB: %.2f ms to parse", cues, text.GetSize() / 1024.0, parseSeconds * 1000.0 );
+	OVR::UnitTest::Report( "FindCue: %.1f ns per frame, a linear scan %.1f ns", findSeconds / frames * 1e9, scanSeconds / frames * 1e9 );
+}
@@ -0,0 +1,230 @@
+/************************************************************************************
+
+Filename    :   TestSurfaceTexturePool.cpp
+Content     :   SurfaceTexturePool tests, including textures taken while the event ring is full
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "SurfaceTexture.h"
+#include "SurfaceTexturePool.h"
+#include "PlayerEventRing.h"
+
+using namespace OVR;
+
+static int NextTextureId = 100;
+static int TexturesAlive = 0;
+
+OVR::SurfaceTexture::SurfaceTexture( JNIEnv * jni_ )
+	: textureId( NextTextureId++ )
+	, javaObject( reinterpret_cast< jobject >( static_cast< size_t >( textureId ) ) )
+	, jni( jni_ )
+	, nanoTimeStamp( 0 )
+{
+	TexturesAlive++;
+}
+
+OVR::SurfaceTexture::~SurfaceTexture()
+{
+	TexturesAlive--;
+}
+
+// What nativePrepareNewVideo does on the java UI thread.
+static jobject PrepareNewVideo( SurfaceTexturePool & pool, PlayerEventRing & events )
+{
+	jobject texobj;
+	const int index = pool.Take( texobj );
+	if ( index == SurfaceTexturePool::INVALID_INDEX )
+	{
+		return NULL;
+	}
+	if ( !events.Post( PLAYER_EVENT_SURFACE_TAKEN, index ) )
+	{
+		pool.Return( index );
+		return NULL;
+	}
+	return texobj;
+}
+
+// Takes everything the pool will publish, refilling as the VR thread would.
+static int TakeAll( SurfaceTexturePool & pool, int * taken )
+{
+	int count = 0;
+	for ( ; ; )
+	{
+		pool.Refill();
+		jobject texobj;
+		const int index = pool.Take( texobj );
+		if ( index == SurfaceTexturePool::INVALID_INDEX )
+		{
+			return count;
+		}
+		taken[count++] = index;
+	}
+}
+
+UNIT_TEST( PublishesOneTextureAtATime )
+{
+	SurfaceTexturePool pool;
+	pool.Init( NULL, 3 );
+	CHECK_EQUAL( 3, TexturesAlive );
+
+	jobject texobj;
+	const int first = pool.Take( texobj );
+	CHECK_EQUAL( 0, first );
+	CHECK( texobj == pool.Get( first )->javaObject );
+	// nothing more until the VR thread refills the slot
+	CHECK_EQUAL( SurfaceTexturePool::INVALID_INDEX, pool.Take( texobj ) );
+	CHECK( texobj == NULL );
+
+	pool.Refill();
+	CHECK_EQUAL( 1, pool.Take( texobj ) );
+
+	pool.Shutdown();
+	CHECK_EQUAL( 0, TexturesAlive );
+}
+
+UNIT_TEST( RecycledTexturesGoToTheBack )
+{
+	SurfaceTexturePool pool;
+	pool.Init( NULL, 3 );
+	jobject texobj;
+	CHECK_EQUAL( 0, pool.Take( texobj ) );
+	pool.Recycle( pool.Get( 0 ) );
+	int taken[8];
+	CHECK_EQUAL( 3, TakeAll( pool, taken ) );
+	CHECK_EQUAL( 1, taken[0] );
+	CHECK_EQUAL( 2, taken[1] );
+	CHECK_EQUAL( 0, taken[2] );
+	pool.Shutdown();
+}
+
+UNIT_TEST( ReturnedTextureIsPublishedAgain )
+{
+	SurfaceTexturePool pool;
+	pool.Init( NULL, 3 );
+
+	// fill the ring so the next surface event is dropped
+	PlayerEventRing events;
+	while ( events.Post( PLAYER_EVENT_VIDEO_SIZE, 1, 1 ) )
+	{
+	}
+	CHECK( PrepareNewVideo( pool, events ) == NULL );
+	CHECK_EQUAL( 2, events.GetDropped() );
+
+	// no surface event arrives, yet all three textures can still be taken
+	PlayerEvent event;
+	while ( events.Next( event ) )
+	{
+		CHECK( event.Type != PLAYER_EVENT_SURFACE_TAKEN );
+	}
+	int taken[8];
+	CHECK_EQUAL( 3, TakeAll( pool, taken ) );
+	CHECK_EQUAL( 0 + 1 + 2, taken[0] + taken[1] + taken[2] );
+
+	// out of range indices are ignored
+	pool.Return( -1 );
+	pool.Return( 3 );
+	CHECK_EQUAL( 0, TakeAll( pool, taken ) );
+	pool.Shutdown();
+}
+
+//==============================================================
+// A java thread starting videos as fast as it can, with bursts of other
+// events filling the ring, against a VR thread that drains it now and then.
+
+static const int STARTS = 50000;
+
+struct StandInJava
+{
+	SurfaceTexturePool *	Pool;
+	PlayerEventRing *		Events;
+	int						Started;
+	int						Retries;
+	volatile bool			Done;
+};
+
+static void * JavaThread( void * param )
+{
+	StandInJava * java = static_cast< StandInJava * >( param );
+	for ( int i = 0; java->Started < STARTS; i++ )
+	{
+		for ( int j = 0; j < ( i & 127 ); j++ )
+		{
+			java->Events->Post( PLAYER_EVENT_VIDEO_SIZE, i, j );
+		}
+		if ( PrepareNewVideo( *java->Pool, *java->Events ) != NULL )
+		{
+			java->Started++;
+		}
+		else
+		{
+			java->Retries++;
+			sched_yield();
+		}
+	}
+	__atomic_store_n( &java->Done, true, __ATOMIC_RELEASE );
+	return NULL;
+}
+
+UNIT_TEST( NoTextureLeaksWhenTheRingIsFull )
+{
+	SurfaceTexturePool pool;
+	pool.Init( NULL, 3 );
+	PlayerEventRing events;
+	StandInJava java = { &pool, &events, 0, 0, false };
+	pthread_t thread;
+	CHECK( pthread_create( &thread, NULL, JavaThread, &java ) == 0 );
+
+	// the VR thread holds the playing texture, recycling it when a new one arrives
+	SurfaceTexture * playing = NULL;
+	int surfaceEvents = 0;
+	for ( int frame = 0; ; frame++ )
+	{
+		const bool done = __atomic_load_n( &java.Done, __ATOMIC_ACQUIRE );
+		if ( ( frame % 3 ) == 0 || done )
+		{
+			PlayerEvent event;
+			while ( events.Next( event ) )
+			{
+				if ( event.Type == PLAYER_EVENT_SURFACE_TAKEN )
+				{
+					pool.Recycle( playing );
+					playing = pool.Get( event.Arg0 );
+					surfaceEvents++;
+				}
+			}
+			pool.Refill();
+		}
+		if ( done )
+		{
+			break;
+		}
+		sched_yield();
+	}
+	pthread_join( thread, NULL );
+
+	// everything but the playing texture is back in circulation
+	pool.Recycle( playing );
+	int taken[8] = { 0 };
+	const int circulating = TakeAll( pool, taken );
+	pool.Shutdown();
+
+	CHECK_EQUAL( STARTS, surfaceEvents );
+	CHECK( events.GetDropped() > 0 );
+	CHECK_EQUAL( 3, circulating );
+	CHECK_EQUAL( 0 + 1 + 2, taken[0] + taken[1] + taken[2] );
+	OVR::UnitTest::Report( "%i starts, %i dropped events, %i retries", STARTS, events.GetDropped(), java.Retries );
+}
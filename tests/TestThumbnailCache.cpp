@@ -0,0 +1,246 @@
+/************************************************************************************
+
+Filename    :   TestThumbnailCache.cpp
+Content     :   ThumbnailCache tests, replaying synthetic browsing traces
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ThumbnailCache.h"
+
+using namespace OVR;
+
+static const int THUMB_WIDTH = 8;
+static const int THUMB_HEIGHT = 4;
+static const int THUMB_BYTES = THUMB_WIDTH * THUMB_HEIGHT * 4;
+
+static const char * NO_THUMBNAIL = "assets/no_thumbnail.png";
+static const char * PAGE_THUMBNAIL = "assets/directory_thumbnail.png";
+
+static String ThumbPath( const int video )
+{
+	char path[64];
+	snprintf( path, sizeof( path ), "/sdcard/Oculus/Movies/%i.pvr", video );
+	return String( path );
+}
+
+// Hits that didn't copy out what was stored.
+static int BadCopies = 0;
+
+// What VideoBrowser::LoadThumbnail does: the cached copy, or a decode
+// that is cached. Returns true on a hit.
+static bool View( ThumbnailCache & cache, const char * filename )
+{
+	int width = 0;
+	int height = 0;
+	unsigned char * pixels = cache.Find( filename, width, height );
+	const bool hit = pixels != NULL;
+	if ( !hit )
+	{
+		// a decode, each thumbnail a different shade
+		pixels = static_cast< unsigned char * >( malloc( THUMB_BYTES ) );
+		memset( pixels, static_cast< int >( strlen( filename ) * 7 ), THUMB_BYTES );
+		cache.Store( filename, pixels, THUMB_WIDTH, THUMB_HEIGHT );
+	}
+	else
+	{
+		const int shade = static_cast< int >( strlen( filename ) * 7 ) & 0xff;
+		BadCopies += ( width != THUMB_WIDTH || height != THUMB_HEIGHT || pixels[THUMB_BYTES - 1] != shade ) ? 1 : 0;
+	}
+	free( pixels );
+	return hit;
+}
+
+// The cache as a list ordered from the least recently viewed, which is
+// what the trace is checked against.
+struct ReferenceLru
+{
+	Array< String >	Order;
+	int				Capacity;
+
+	bool View( const String & filename )
+	{
+		for ( int i = 0; i < Order.GetSizeI(); i++ )
+		{
+			if ( Order[i] == filename.ToCStr() )
+			{
+				Order.RemoveAt( i );
+				Order.PushBack( filename );
+				return true;
+			}
+		}
+		if ( Order.GetSizeI() == Capacity )
+		{
+			Order.RemoveAt( 0 );
+		}
+		Order.PushBack( filename );
+		return false;
+	}
+};
+
+// A browser pass: the panels in view at each step, a swipe at a time to
+// the right and back, with jumps between two categories.
+static void BuildTrace( Array< int > & trace, const int steps )
+{
+	unsigned int seed = 1234;
+	int category = 0;
+	int first = 0;
+	for ( int step = 0; step < steps; step++ )
+	{
+		seed = seed * 1103515245 + 12345;
+		const int r = ( seed >> 16 ) % 10;
+		if ( r < 5 )
+		{
+			first++;
+		}
+		else if ( r < 8 )
+		{
+			first = ( first > 0 ) ? first - 1 : 0;
+		}
+		else
+		{
+			category = 1 - category;
+		}
+		// six panels in view, one category's videos after the other's
+		for ( int i = 0; i < 6; i++ )
+		{
+			trace.PushBack( category * 1000 + first + i );
+		}
+	}
+}
+
+UNIT_TEST( EvictsTheLeastRecentlyViewed )
+{
+	ThumbnailCache cache( 3 * THUMB_BYTES );
+	CHECK( !View( cache, "a.pvr" ) );
+	CHECK( !View( cache, "b.pvr" ) );
+	CHECK( !View( cache, "c.pvr" ) );
+	CHECK( View( cache, "a.pvr" ) );
+
+	// b was viewed longest ago, though a was decoded first
+	CHECK( !View( cache, "d.pvr" ) );
+	CHECK( cache.Contains( "a.pvr" ) );
+	CHECK( !cache.Contains( "b.pvr" ) );
+	CHECK( cache.Contains( "c.pvr" ) );
+	CHECK( cache.Contains( "d.pvr" ) );
+	CHECK_EQUAL( 3 * THUMB_BYTES, cache.GetBytes() );
+
+	// a forgotten thumbnail is decoded again
+	cache.Forget( "c.pvr" );
+	CHECK_EQUAL( 2, cache.GetCount() );
+	CHECK( !View( cache, "c.pvr" ) );
+	CHECK_EQUAL( 3, cache.GetCount() );
+}
+
+UNIT_TEST( TraceMatchesLeastRecentlyViewed )
+{
+	const int capacity = 16;
+	ThumbnailCache cache( capacity * THUMB_BYTES );
+	ReferenceLru reference;
+	reference.Capacity = capacity;
+
+	Array< int > trace;
+	BuildTrace( trace, 2000 );
+
+	int hits = 0;
+	for ( int i = 0; i < trace.GetSizeI(); i++ )
+	{
+		const String path = ThumbPath( trace[i] );
+		const bool hit = View( cache, path.ToCStr() );
+		CHECK_EQUAL( reference.View( path ), hit );
+		CHECK( cache.GetBytes() <= capacity * THUMB_BYTES );
+		hits += hit ? 1 : 0;
+	}
+	CHECK_EQUAL( reference.Order.GetSizeI(), cache.GetCount() );
+	for ( int i = 0; i < reference.Order.GetSizeI(); i++ )
+	{
+		CHECK( cache.Contains( reference.Order[i].ToCStr() ) );
+	}
+	// most of a swipe is panels that were already in view
+	CHECK( hits > trace.GetSizeI() / 2 );
+	CHECK_EQUAL( 0, BadCopies );
+}
+
+UNIT_TEST( PlaceholdersAreSharedAndKept )
+{
+	ThumbnailCache cache( 4 * THUMB_BYTES );
+	cache.AddPlaceholder( NO_THUMBNAIL );
+	cache.AddPlaceholder( PAGE_THUMBNAIL );
+
+	// every panel without a thumbnail of its own, and every page panel,
+	// shows the one decode
+	Array< int > trace;
+	BuildTrace( trace, 300 );
+	int placeholderMisses = 0;
+	for ( int i = 0; i < trace.GetSizeI(); i++ )
+	{
+		const char * filename = ( trace[i] % 3 == 0 ) ? NO_THUMBNAIL : ( trace[i] % 7 == 0 ) ? PAGE_THUMBNAIL : NULL;
+		if ( filename != NULL )
+		{
+			placeholderMisses += View( cache, filename ) ? 0 : 1;
+		}
+		else
+		{
+			View( cache, ThumbPath( trace[i] ).ToCStr() );
+		}
+	}
+	CHECK_EQUAL( 2, placeholderMisses );
+
+	// they don't count against the budget, nor go with it
+	CHECK_EQUAL( 6, cache.GetCount() );
+	CHECK_EQUAL( 6 * THUMB_BYTES, cache.GetBytes() );
+	cache.SetBudget( 0 );
+	CHECK_EQUAL( 2, cache.GetCount() );
+	CHECK( cache.Contains( NO_THUMBNAIL ) );
+	CHECK( cache.Contains( PAGE_THUMBNAIL ) );
+	CHECK_EQUAL( 2 * THUMB_BYTES, cache.GetBytes() );
+}
+
+UNIT_TEST( BudgetShrinksAndGrows )
+{
+	ThumbnailCache cache( 8 * THUMB_BYTES );
+	cache.AddPlaceholder( NO_THUMBNAIL );
+	View( cache, NO_THUMBNAIL );
+	for ( int i = 0; i < 8; i++ )
+	{
+		View( cache, ThumbPath( i ).ToCStr() );
+	}
+	View( cache, ThumbPath( 0 ).ToCStr() );
+
+	// a smaller budget evicts from the least recently viewed
+	cache.SetBudget( 4 * THUMB_BYTES );
+	CHECK_EQUAL( 5, cache.GetCount() );
+	CHECK( cache.Contains( ThumbPath( 0 ).ToCStr() ) );
+	CHECK( !cache.Contains( ThumbPath( 1 ).ToCStr() ) );
+	CHECK( !cache.Contains( ThumbPath( 4 ).ToCStr() ) );
+	CHECK( cache.Contains( ThumbPath( 7 ).ToCStr() ) );
+
+	// nothing is kept without a budget
+	cache.SetBudget( 0 );
+	CHECK( !View( cache, ThumbPath( 9 ).ToCStr() ) );
+	CHECK( !cache.Contains( ThumbPath( 9 ).ToCStr() ) );
+	CHECK_EQUAL( 1, cache.GetCount() );
+
+	// and the cache fills again once the pressure is over
+	cache.SetBudget( 8 * THUMB_BYTES );
+	for ( int i = 0; i < 10; i++ )
+	{
+		View( cache, ThumbPath( i ).ToCStr() );
+	}
+	CHECK_EQUAL( 9, cache.GetCount() );
+	CHECK_EQUAL( 9 * THUMB_BYTES, cache.GetBytes() );
+	CHECK_EQUAL( 8 * THUMB_BYTES, cache.GetBudget() );
+}
@@ -0,0 +1,498 @@
+/************************************************************************************
+
+Filename    :   TestTrickPlay.cpp
+Content     :   Trick-play sidecar parsing, atlas packing, decode throughput and memory
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdlib.h>
+#include <sched.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "TrickPlay.h"
+#include "MediaContainer.h"
+#include "OVR_TurboJpeg.h"
+
+using namespace OVR;
+
+//==============================================================
+// GL without a context: each texture keeps a copy of what was uploaded.
+
+static const int	MAX_TEXTURES = 64;
+static UByte *		TexturePixels[MAX_TEXTURES];
+static bool			TextureLive[MAX_TEXTURES];
+static GLuint		BoundTexture = 0;
+
+extern "C" void glGenTextures( GLsizei n, GLuint * textures )
+{
+	for ( int i = 0; i < n; i++ )
+	{
+		textures[i] = 0;
+		for ( int t = 1; t < MAX_TEXTURES && textures[i] == 0; t++ )
+		{
+			if ( !TextureLive[t] )
+			{
+				TextureLive[t] = true;
+				textures[i] = t;
+			}
+		}
+	}
+}
+
+extern "C" void glDeleteTextures( GLsizei n, const GLuint * textures )
+{
+	for ( int i = 0; i < n; i++ )
+	{
+		free( TexturePixels[textures[i]] );
+		TexturePixels[textures[i]] = NULL;
+		TextureLive[textures[i]] = false;
+	}
+}
+
+extern "C" void glBindTexture( GLenum, GLuint texture )
+{
+	BoundTexture = texture;
+}
+
+extern "C" void glTexImage2D( GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum, GLenum, const GLvoid * pixels )
+{
+	free( TexturePixels[BoundTexture] );
+	TexturePixels[BoundTexture] = static_cast< UByte * >( malloc( width * height * 4 ) );
+	memcpy( TexturePixels[BoundTexture], pixels, width * height * 4 );
+}
+
+extern "C" void glTexParameteri( GLenum, GLenum, GLint )
+{
+}
+
+static int LiveTextures()
+{
+	int live = 0;
+	for ( int t = 0; t < MAX_TEXTURES; t++ )
+	{
+		live += TextureLive[t] ? 1 : 0;
+	}
+	return live;
+}
+
+//==============================================================
+// Fixtures: flat coloured frames, so a cell can be matched to its frame
+// through the JPEG loss.
+
+static void FrameColor( const int frame, UByte rgb[3] )
+{
+	rgb[0] = static_cast< UByte >( ( frame * 37 ) & 255 );
+	rgb[1] = static_cast< UByte >( ( frame * 101 + 64 ) & 255 );
+	rgb[2] = static_cast< UByte >( 255 - ( ( frame * 13 ) & 255 ) );
+}
+
+static bool MatchesColor( const UByte * pixel, const int frame )
+{
+	UByte rgb[3];
+	FrameColor( frame, rgb );
+	for ( int c = 0; c < 3; c++ )
+	{
+		if ( abs( pixel[c] - rgb[c] ) > 12 )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// A width x height image of tilesX x tilesY flat tiles, firstFrame onwards.
+static void EncodeMosaic( const int width, const int height, const int tilesX, const int tilesY,
+		const int firstFrame, Array< UByte > & jpeg )
+{
+	Array< UByte > pixels;
+	pixels.Resize( width * height * 4 );
+	for ( int y = 0; y < height; y++ )
+	{
+		for ( int x = 0; x < width; x++ )
+		{
+			UByte rgb[3];
+			FrameColor( firstFrame + ( y * tilesY / height ) * tilesX + x * tilesX / width, rgb );
+			UByte * p = &pixels[( y * width + x ) * 4];
+			p[0] = rgb[0];
+			p[1] = rgb[1];
+			p[2] = rgb[2];
+			p[3] = 255;
+		}
+	}
+	const String path = String( OVR::UnitTest::GetTempDir() ) + "/encode.jpg";
+	MediaFile file;
+	jpeg.Clear();
+	if ( WriteJpeg( path.ToCStr(), pixels.GetDataPtr(), width, height ) && file.Open( path.ToCStr() ) )
+	{
+		file.ReadArray( 0, static_cast< int >( file.GetSize() ), jpeg );
+	}
+}
+
+static String TempPath( const char * name )
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+}
+
+static bool WriteFile( const String & path, const void * data, const int size )
+{
+	FILE * f = fopen( path.ToCStr(), "wb" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	const bool ok = fwrite( data, 1, size, f ) == static_cast< size_t >( size );
+	return fclose( f ) == 0 && ok;
+}
+
+static void PutLE32( Array< UByte > & out, const int at, const UInt32 v )
+{
+	out[at + 0] = static_cast< UByte >( v );
+	out[at + 1] = static_cast< UByte >( v >> 8 );
+	out[at + 2] = static_cast< UByte >( v >> 16 );
+	out[at + 3] = static_cast< UByte >( v >> 24 );
+}
+
+// Roku's BIF: a 64 byte header, (timestamp, offset) pairs ending with
+// 0xffffffff and the end of the last image, then the JPEGs. Returns the
+// JPEG bytes written.
+static int WriteBif( const String & path, const int frames, const int intervalMs,
+		const int width, const int height )
+{
+	const int tableBytes = ( frames + 1 ) * 8;
+	Array< UByte > bif;
+	bif.Resize( 64 + tableBytes );
+	memset( bif.GetDataPtr(), 0, bif.GetSizeI() );
+	static const UByte magic[8] = { 0x89, 0x42, 0x49, 0x46, 0x0D, 0x0A, 0x1A, 0x0A };
+	memcpy( bif.GetDataPtr(), magic, 8 );
+	PutLE32( bif, 12, frames );
+	PutLE32( bif, 16, intervalMs );
+	int jpegBytes = 0;
+	for ( int i = 0; i < frames; i++ )
+	{
+		Array< UByte > jpeg;
+		EncodeMosaic( width, height, 1, 1, i, jpeg );
+		PutLE32( bif, 64 + i * 8, i );
+		PutLE32( bif, 64 + i * 8 + 4, bif.GetSizeI() );
+		bif.Append( jpeg.GetDataPtr(), jpeg.GetSizeI() );
+		jpegBytes += jpeg.GetSizeI();
+	}
+	PutLE32( bif, 64 + frames * 8, 0xffffffff );
+	PutLE32( bif, 64 + frames * 8 + 4, bif.GetSizeI() );
+	return WriteFile( path, bif.GetDataPtr(), bif.GetSizeI() ) ? jpegBytes : 0;
+}
+
+// A WebVTT track over mosaics of tilesX x tilesY frames, one cue per frame.
+static int WriteThumbsVtt( const String & path, const int frames, const int intervalMs,
+		const int tileWidth, const int tileHeight, const int tilesX, const int tilesY )
+{
+	const int perMosaic = tilesX * tilesY;
+	String vtt = "WEBVTT\n\n";
+	int jpegBytes = 0;
+	for ( int i = 0; i < frames; i++ )
+	{
+		const int mosaic = i / perMosaic;
+		const int tile = i % perMosaic;
+		if ( tile == 0 )
+		{
+			Array< UByte > jpeg;
+			EncodeMosaic( tileWidth * tilesX, tileHeight * tilesY, tilesX, tilesY, i, jpeg );
+			char name[64];
+			snprintf( name, sizeof( name ), "mosaic%03i.jpg", mosaic );
+			if ( !WriteFile( TempPath( name ), jpeg.GetDataPtr(), jpeg.GetSizeI() ) )
+			{
+				return 0;
+			}
+			jpegBytes += jpeg.GetSizeI();
+		}
+		const int start = i * intervalMs;
+		const int end = start + intervalMs;
+		char cue[256];
+		snprintf( cue, sizeof( cue ), "%02i:%02i:%02i.%03i --> %02i:%02i:%02i.%03i\nmosaic%03i.jpg#xywh=%i,%i,%i,%i\n\n",
+			start / 3600000, start / 60000 % 60, start / 1000 % 60, start % 1000,
+			end / 3600000, end / 60000 % 60, end / 1000 % 60, end % 1000,
+			mosaic, ( tile % tilesX ) * tileWidth, ( tile / tilesX ) * tileHeight, tileWidth, tileHeight );
+		vtt += cue;
+	}
+	return WriteFile( path, vtt.ToCStr(), static_cast< int >( vtt.GetSize() ) ) ? jpegBytes : 0;
+}
+
+// The VR thread: uploads pages as they finish until the worker is done
+// with every frame or the deadline passes. Returns the peak CPU bytes.
+static int RunUntilUploaded( TrickPlayAtlas & atlas, const int expectedFrames, const int expectedPages, const double seconds )
+{
+	int peakCpuBytes = 0;
+	const double deadline = OVR::UnitTest::GetSeconds() + seconds;
+	while ( OVR::UnitTest::GetSeconds() < deadline )
+	{
+		atlas.Frame();
+		peakCpuBytes = Alg::Max( peakCpuBytes, atlas.GetCpuBytes() );
+		if ( atlas.GetDecodedFrames() >= expectedFrames &&
+			atlas.GetGpuBytes() >= expectedPages * TrickPlayAtlas::PAGE_SIZE * TrickPlayAtlas::PAGE_SIZE * 4 )
+		{
+			break;
+		}
+		sched_yield();
+	}
+	return peakCpuBytes;
+}
+
+//==============================================================
+
+UNIT_TEST( BifIndexListsEveryFrame )
+{
+	const String path = TempPath( "video.bif" );
+	CHECK( WriteBif( path, 12, 10000, 64, 36 ) > 0 );
+
+	TrickPlayIndex index;
+	CHECK( index.LoadBif( path.ToCStr() ) );
+	CHECK_EQUAL( 12, index.Frames.GetSizeI() );
+	CHECK_EQUAL( 12, index.Images.GetSizeI() );
+	for ( int i = 0; i < 12; i++ )
+	{
+		CHECK_EQUAL( i * 10000, index.Frames[i].TimeMs );
+		CHECK_EQUAL( i, index.Frames[i].Image );
+		CHECK_EQUAL( 0, index.Frames[i].Width );
+		CHECK( index.Images[i].Length > 0 );
+	}
+	CHECK( index.Images[1].Offset == index.Images[0].Offset + index.Images[0].Length );
+
+	CHECK_EQUAL( -1, index.FindFrame( -1 ) );
+	CHECK_EQUAL( 0, index.FindFrame( 0 ) );
+	CHECK_EQUAL( 0, index.FindFrame( 9999 ) );
+	CHECK_EQUAL( 1, index.FindFrame( 10000 ) );
+	CHECK_EQUAL( 11, index.FindFrame( 1000000 ) );
+}
+
+UNIT_TEST( BifRejectsOtherFiles )
+{
+	const String path = TempPath( "video.bif" );
+	const char text[] = "WEBVTT\n\n00:00.000 --> 00:10.000\nthumb.jpg\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n";
+	CHECK( WriteFile( path, text, sizeof( text ) ) );
+	TrickPlayIndex index;
+	CHECK( !index.LoadBif( path.ToCStr() ) );
+	CHECK( !index.LoadBif( TempPath( "missing.bif" ).ToCStr() ) );
+	CHECK_EQUAL( 0, index.Frames.GetSizeI() );
+}
+
+UNIT_TEST( WebVttIndexSharesMosaics )
+{
+	const String path = TempPath( "video.thumbs.vtt" );
+	CHECK( WriteThumbsVtt( path, 10, 5000, 80, 45, 2, 2 ) > 0 );
+
+	TrickPlayIndex index;
+	CHECK( index.LoadWebVtt( path.ToCStr() ) );
+	CHECK_EQUAL( 10, index.Frames.GetSizeI() );
+	// four frames to a mosaic, relative to the track
+	CHECK_EQUAL( 3, index.Images.GetSizeI() );
+	const String mosaic = TempPath( "mosaic001.jpg" );
+	CHECK_STRING( mosaic.ToCStr(), index.Images[1].Path.ToCStr() );
+	CHECK_EQUAL( 0, index.Images[1].Length );
+	const TrickPlayFrame & frame = index.Frames[7];
+	CHECK_EQUAL( 35000, frame.TimeMs );
+	CHECK_EQUAL( 1, frame.Image );
+	CHECK_EQUAL( 80, frame.X );
+	CHECK_EQUAL( 45, frame.Y );
+	CHECK_EQUAL( 80, frame.Width );
+	CHECK_EQUAL( 45, frame.Height );
+	CHECK_EQUAL( 7, index.FindFrame( 39999 ) );
+}
+
+UNIT_TEST( WebVttSkipsRemoteAndOutOfOrderCues )
+{
+	const String path = TempPath( "video.thumbs.vtt" );
+	const char vtt[] =
+		"WEBVTT\r\n\r\n"
+		"00:00.000 --> 00:05.000\r\nhttp://example.com/a.jpg#xywh=0,0,10,10\r\n\r\n"
+		"00:05.000 --> 00:10.000\r\na.jpg#xywh=0,0,10,10\r\n\r\n"
+		"00:03.000 --> 00:04.000\r\na.jpg#xywh=10,0,10,10\r\n\r\n"
+		"not a timestamp --> either\r\nb.jpg\r\n\r\n"
+		"00:10.000 --> 00:15.000\r\n/abs/c.jpg\r\n";
+	CHECK( WriteFile( path, vtt, sizeof( vtt ) - 1 ) );
+
+	TrickPlayIndex index;
+	CHECK( index.LoadWebVtt( path.ToCStr() ) );
+	CHECK_EQUAL( 2, index.Frames.GetSizeI() );
+	CHECK_EQUAL( 5000, index.Frames[0].TimeMs );
+	CHECK_EQUAL( 10000, index.Frames[1].TimeMs );
+	CHECK_STRING( "/abs/c.jpg", index.Images[index.Frames[1].Image].Path.ToCStr() );
+	CHECK_EQUAL( 0, index.Frames[1].Width );
+}
+
+UNIT_TEST( LoadForVideoPrefersBif )
+{
+	const String video = TempPath( "movie.mp4" );
+	TrickPlayIndex index;
+	CHECK( !index.LoadForVideo( video.ToCStr() ) );
+	CHECK( !index.LoadForVideo( "relative/movie.mp4" ) );
+
+	CHECK( WriteThumbsVtt( TempPath( "movie.thumbs.vtt" ), 6, 1000, 32, 18, 2, 2 ) > 0 );
+	CHECK( index.LoadForVideo( video.ToCStr() ) );
+	CHECK_EQUAL( 6, index.Frames.GetSizeI() );
+
+	CHECK( WriteBif( TempPath( "movie.bif" ), 4, 1000, 32, 18 ) > 0 );
+	CHECK( index.LoadForVideo( video.ToCStr() ) );
+	CHECK_EQUAL( 4, index.Frames.GetSizeI() );
+	CHECK( index.Images[0].Length > 0 );
+}
+
+UNIT_TEST( DecimateKeepsEveryStridethFrame )
+{
+	TrickPlayIndex index;
+	for ( int i = 0; i < 100; i++ )
+	{
+		TrickPlayFrame frame = { i * 1000, i, 0, 0, 0, 0 };
+		index.Frames.PushBack( frame );
+	}
+	index.Decimate( 200 );
+	CHECK_EQUAL( 100, index.Frames.GetSizeI() );
+	index.Decimate( 30 );
+	CHECK_EQUAL( 25, index.Frames.GetSizeI() );
+	for ( int i = 0; i < 25; i++ )
+	{
+		CHECK_EQUAL( i * 4000, index.Frames[i].TimeMs );
+	}
+	CHECK_EQUAL( 2, index.FindFrame( 11999 ) );
+}
+
+UNIT_TEST( AtlasShowsTheFrameForTheSeekTarget )
+{
+	CHECK( WriteBif( TempPath( "movie.bif" ), 20, 10000, 320, 180 ) > 0 );
+	{
+		TrickPlayAtlas atlas;
+		GLuint texture = 0;
+		Matrix4f texm;
+		CHECK( !atlas.GetPreview( 0, texture, texm ) );
+		CHECK( atlas.Start( TempPath( "movie.mp4" ).ToCStr() ) );
+		RunUntilUploaded( atlas, 20, 1, 10.0 );
+		CHECK_EQUAL( 20, atlas.GetDecodedFrames() );
+		CHECK_EQUAL( 0, atlas.GetCpuBytes() );
+		CHECK_EQUAL( TrickPlayAtlas::PAGE_SIZE * TrickPlayAtlas::PAGE_SIZE * 4, atlas.GetGpuBytes() );
+		CHECK_EQUAL( 1, LiveTextures() );
+
+		// 320x180 frames become 256x144 cells, four to a row
+		CHECK( atlas.GetPreview( 75000, texture, texm ) );
+		CHECK( texture != 0 && TexturePixels[texture] != NULL );
+		CHECK_NEAR( 256.0 / 1024.0, texm.M[0][0], 1e-6 );
+		CHECK_NEAR( 144.0 / 1024.0, texm.M[1][1], 1e-6 );
+		CHECK_NEAR( 3 * 256.0 / 1024.0, texm.M[0][3], 1e-6 );
+		CHECK_NEAR( 1 * 144.0 / 1024.0, texm.M[1][3], 1e-6 );
+
+		// the centre of every cell is its frame's colour
+		for ( int frame = 0; frame < 20; frame++ )
+		{
+			CHECK( atlas.GetPreview( frame * 10000 + 5000, texture, texm ) );
+			const int x = static_cast< int >( ( texm.M[0][3] + texm.M[0][0] * 0.5f ) * 1024.0f );
+			const int y = static_cast< int >( ( texm.M[1][3] + texm.M[1][1] * 0.5f ) * 1024.0f );
+			CHECK( MatchesColor( TexturePixels[texture] + ( y * 1024 + x ) * 4, frame ) );
+		}
+	}
+	// the atlas deletes its textures with it
+	CHECK_EQUAL( 0, LiveTextures() );
+}
+
+UNIT_TEST( AtlasSlicesWebVttMosaics )
+{
+	CHECK( WriteThumbsVtt( TempPath( "movie.thumbs.vtt" ), 30, 2000, 160, 90, 5, 5 ) > 0 );
+	TrickPlayAtlas atlas;
+	CHECK( atlas.Start( TempPath( "movie.mp4" ).ToCStr() ) );
+	RunUntilUploaded( atlas, 30, 1, 10.0 );
+	CHECK_EQUAL( 30, atlas.GetDecodedFrames() );
+
+	GLuint texture = 0;
+	Matrix4f texm;
+	for ( int frame = 0; frame < 30; frame++ )
+	{
+		CHECK( atlas.GetPreview( frame * 2000, texture, texm ) );
+		const int x = static_cast< int >( ( texm.M[0][3] + texm.M[0][0] * 0.5f ) * 1024.0f );
+		const int y = static_cast< int >( ( texm.M[1][3] + texm.M[1][1] * 0.5f ) * 1024.0f );
+		CHECK( MatchesColor( TexturePixels[texture] + ( y * 1024 + x ) * 4, frame ) );
+	}
+	atlas.Stop();
+	CHECK_EQUAL( 0, LiveTextures() );
+	CHECK( !atlas.GetPreview( 0, texture, texm ) );
+}
+
+UNIT_TEST( AtlasStaysWithinItsPages )
+{
+	// 256x256 cells are 16 to a page; 200 frames don't fit in 6 pages
+	CHECK( WriteBif( TempPath( "movie.bif" ), 200, 1000, 256, 256 ) > 0 );
+	TrickPlayAtlas atlas;
+	CHECK( atlas.Start( TempPath( "movie.mp4" ).ToCStr() ) );
+	const int peakCpuBytes = RunUntilUploaded( atlas, 67, 5, 20.0 );
+	// every third frame kept
+	CHECK_EQUAL( 67, atlas.GetDecodedFrames() );
+	CHECK_EQUAL( 5 * TrickPlayAtlas::PAGE_SIZE * TrickPlayAtlas::PAGE_SIZE * 4, atlas.GetGpuBytes() );
+	CHECK( peakCpuBytes <= TrickPlayAtlas::MAX_PAGES * TrickPlayAtlas::PAGE_SIZE * TrickPlayAtlas::PAGE_SIZE * 4 );
+	CHECK_EQUAL( 0, atlas.GetCpuBytes() );
+
+	GLuint texture = 0;
+	Matrix4f texm;
+	CHECK( atlas.GetPreview( 199000, texture, texm ) );
+	const int x = static_cast< int >( ( texm.M[0][3] + texm.M[0][0] * 0.5f ) * 1024.0f );
+	const int y = static_cast< int >( ( texm.M[1][3] + texm.M[1][1] * 0.5f ) * 1024.0f );
+	CHECK( MatchesColor( TexturePixels[texture] + ( y * 1024 + x ) * 4, 198 ) );
+}
+
+UNIT_TEST( StopDuringDecodeFreesEverything )
+{
+	CHECK( WriteBif( TempPath( "movie.bif" ), 300, 1000, 320, 180 ) > 0 );
+	TrickPlayAtlas atlas;
+	for ( int round = 0; round < 10; round++ )
+	{
+		CHECK( atlas.Start( TempPath( "movie.mp4" ).ToCStr() ) );
+		for ( int i = 0; i < round * 20; i++ )
+		{
+			atlas.Frame();
+			sched_yield();
+		}
+		atlas.Stop();
+		CHECK_EQUAL( 0, atlas.GetCpuBytes() );
+		CHECK_EQUAL( 0, atlas.GetGpuBytes() );
+		CHECK_EQUAL( 0, LiveTextures() );
+	}
+}
+
+//==============================================================
+// A two hour video with a preview every 10 seconds, as BIF frames and
+// as WebVTT mosaics.
+
+static void BenchAtlas( const char * label, const int sidecarBytes, const int frames )
+{
+	TrickPlayAtlas atlas;
+	const double start = OVR::UnitTest::GetSeconds();
+	CHECK( atlas.Start( TempPath( "movie.mp4" ).ToCStr() ) );
+	const int peakCpuBytes = RunUntilUploaded( atlas, frames, TrickPlayAtlas::MAX_PAGES, 60.0 );
+	const double seconds = OVR::UnitTest::GetSeconds() - start;
+	const int decoded = atlas.GetDecodedFrames();
+	const double decodeSeconds = atlas.GetDecodeSeconds();
+	OVR::UnitTest::Report( "%s: %.1f MB of JPEG, %i frames on the atlas in %.1f ms, %.0f frames/s",
+		label, sidecarBytes / 1048576.0, decoded, seconds * 1000.0, decoded / seconds );
+	OVR::UnitTest::Report( "%s: %.1f ms of it decoding, %.3f ms per frame", label, decodeSeconds * 1000.0, decodeSeconds * 1000.0 / Alg::Max( decoded, 1 ) );
+	OVR::UnitTest::Report( "%s: peak CPU %.1f MB, GPU %.1f MB", label, peakCpuBytes / 1048576.0, atlas.GetGpuBytes() / 1048576.0 );
+}
+
+UNIT_BENCHMARK( BenchBifDecode )
+{
+	const int jpegBytes = WriteBif( TempPath( "movie.bif" ), 720, 10000, 320, 180 );
+	CHECK( jpegBytes > 0 );
+	// 28 cells to a page, 720 frames decimated to 144 on 6 pages
+	BenchAtlas( "BIF 320x180", jpegBytes, 144 );
+}
+
+UNIT_BENCHMARK( BenchWebVttDecode )
+{
+	const int jpegBytes = WriteThumbsVtt( TempPath( "movie.thumbs.vtt" ), 720, 10000, 160, 90, 10, 10 );
+	CHECK( jpegBytes > 0 );
+	// 160x90 cells are 66 to a page, 720 frames decimated to 360 on 6 pages
+	BenchAtlas( "WebVTT 10x10 of 160x90", jpegBytes, 360 );
+}
@@ -0,0 +1,329 @@
+/************************************************************************************
+
+Filename    :   TestUiSoundMixer.cpp
+Content     :   Interface sound loading, panning, voice limits and mix cost
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "Kernel/OVR_Alg.h"
+#include "UiSoundMixer.h"
+#include "WavFile.h"
+
+using namespace OVR;
+
+static const int	BUFFER = AudioOutput::BUFFER_FRAMES;
+
+static void PutLE( Array< UByte > & out, const UInt32 v, const int bytes )
+{
+	for ( int i = 0; i < bytes; i++ )
+	{
+		out.PushBack( static_cast< UByte >( v >> ( i * 8 ) ) );
+	}
+}
+
+// A 16 bit WAV in memory, as ovr_ReadFileFromApplicationPackage returns it.
+static void BuildWav( Array< UByte > & out, const Array< float > & samples, const int channels, const int sampleRate )
+{
+	const int dataBytes = samples.GetSizeI() * 2;
+	out.Clear();
+	out.Append( reinterpret_cast< const UByte * >( "RIFF" ), 4 );
+	PutLE( out, 36 + dataBytes, 4 );
+	out.Append( reinterpret_cast< const UByte * >( "WAVEfmt " ), 8 );
+	PutLE( out, 16, 4 );
+	PutLE( out, 1, 2 );
+	PutLE( out, channels, 2 );
+	PutLE( out, sampleRate, 4 );
+	PutLE( out, sampleRate * channels * 2, 4 );
+	PutLE( out, channels * 2, 2 );
+	PutLE( out, 16, 2 );
+	out.Append( reinterpret_cast< const UByte * >( "data" ), 4 );
+	PutLE( out, dataBytes, 4 );
+	for ( int i = 0; i < samples.GetSizeI(); i++ )
+	{
+		PutLE( out, static_cast< UInt32 >( static_cast< int >( floorf( samples[i] * 32767.0f + 0.5f ) ) ), 2 );
+	}
+}
+
+// A mono sound of frames samples of value at 48 kHz.
+static bool AddFlatSound( UiSoundMixer & mixer, const char * name, const int frames, const float value )
+{
+	Array< float > samples;
+	samples.Resize( frames );
+	for ( int i = 0; i < frames; i++ )
+	{
+		samples[i] = value;
+	}
+	Array< UByte > file;
+	BuildWav( file, samples, 1, AudioOutput::SAMPLE_RATE );
+	WavFile wav;
+	return wav.OpenMemory( file.GetDataPtr(), file.GetSizeI(), name ) && mixer.AddSound( name, wav );
+}
+
+// Mixes one buffer into silence.
+static void MixBuffer( UiSoundMixer & mixer, float * stereo )
+{
+	memset( stereo, 0, BUFFER * 2 * sizeof( float ) );
+	mixer.MixAudio( stereo, BUFFER );
+}
+
+//==============================================================
+
+UNIT_TEST( SoundsAreDownmixedAndResampled )
+{
+	// a second of stereo at 24 kHz, left and right differ
+	const int rate = 24000;
+	Array< float > samples;
+	samples.Resize( rate * 2 );
+	for ( int i = 0; i < rate; i++ )
+	{
+		samples[i * 2] = 0.5f;
+		samples[i * 2 + 1] = i < rate / 2 ? 0.1f : -0.1f;
+	}
+	Array< UByte > file;
+	BuildWav( file, samples, 2, rate );
+	WavFile wav;
+	CHECK( wav.OpenMemory( file.GetDataPtr(), file.GetSizeI(), "click" ) );
+	UiSoundMixer mixer;
+	CHECK( mixer.AddSound( "click", wav ) );
+	CHECK( mixer.HasSound( "click" ) );
+	CHECK( !mixer.HasSound( "clack" ) );
+
+	// a voice straight ahead at full gain plays the mono sound at 1/sqrt(2)
+	float stereo[BUFFER * 2];
+	CHECK( mixer.Play( "click", Vector3f( 0.0f, 0.0f, -1.0f ), Matrix4f() ) );
+	int frames = 0;
+	float first = 0.0f;
+	float last = 0.0f;
+	for ( int b = 0; b < 400; b++ )
+	{
+		MixBuffer( mixer, stereo );
+		for ( int f = 0; f < BUFFER; f++ )
+		{
+			if ( stereo[f * 2] != 0.0f )
+			{
+				first = ( frames == 0 ) ? stereo[f * 2] : first;
+				last = stereo[f * 2];
+				frames++;
+			}
+			CHECK_EQUAL( stereo[f * 2], stereo[f * 2 + 1] );
+		}
+	}
+	CHECK_NEAR( AudioOutput::SAMPLE_RATE, frames, 2 );
+	CHECK_NEAR( 0.3f * 0.70710678f, first, 1e-3 );
+	CHECK_NEAR( 0.2f * 0.70710678f, last, 1e-3 );
+}
+
+UNIT_TEST( AddSoundReplacesByName )
+{
+	UiSoundMixer mixer;
+	CHECK( AddFlatSound( mixer, "tap", 100, 0.5f ) );
+	CHECK( AddFlatSound( mixer, "tap", 100, 0.25f ) );
+	WavFile closed;
+	CHECK( !mixer.AddSound( "none", closed ) );
+	CHECK( !mixer.HasSound( "none" ) );
+
+	float stereo[BUFFER * 2];
+	CHECK( mixer.Play( "tap", Vector3f( 0.0f, 0.0f, -1.0f ), Matrix4f() ) );
+	MixBuffer( mixer, stereo );
+	CHECK_NEAR( 0.25f * 0.70710678f, stereo[0], 1e-3 );
+	CHECK_EQUAL( 0, stereo[200] );
+}
+
+UNIT_TEST( UnknownSoundsAreLeftToThePlatform )
+{
+	// LoadUiSound adds nothing for a sound missing from the package, and
+	// PlayUiSound hands anything the mixer doesn't know to app->PlaySound
+	UiSoundMixer mixer;
+	CHECK( !mixer.Play( "sv_select", Vector3f( 0.0f, 0.0f, -1.0f ), Matrix4f() ) );
+	float stereo[BUFFER * 2];
+	MixBuffer( mixer, stereo );
+	for ( int i = 0; i < BUFFER * 2; i++ )
+	{
+		CHECK_EQUAL( 0, stereo[i] );
+	}
+	CHECK_EQUAL( 0, mixer.GetMixCount() );
+}
+
+UNIT_TEST( VoicesArePannedAndAttenuated )
+{
+	UiSoundMixer mixer;
+	CHECK( AddFlatSound( mixer, "tap", BUFFER, 0.5f ) );
+	float stereo[BUFFER * 2];
+
+	// to the right of the head
+	CHECK( mixer.Play( "tap", Vector3f( 2.0f, 0.0f, 0.0f ), Matrix4f() ) );
+	MixBuffer( mixer, stereo );
+	CHECK_NEAR( 0.0, stereo[10], 1e-6 );
+	CHECK_NEAR( 0.5, stereo[11], 1e-3 );
+
+	// to the left and beyond the reference distance
+	CHECK( mixer.Play( "tap", Vector3f( -6.0f, 0.0f, 0.0f ), Matrix4f() ) );
+	MixBuffer( mixer, stereo );
+	CHECK_NEAR( 0.25, stereo[10], 1e-3 );
+	CHECK_NEAR( 0.0, stereo[11], 1e-6 );
+
+	// a head turned to face the menu hears it in front
+	const Matrix4f facingRight(
+		0, 0, 1, 0,
+		0, 1, 0, 0,
+		-1, 0, 0, 0,
+		0, 0, 0, 1 );
+	CHECK( mixer.Play( "tap", Vector3f( 2.0f, 0.0f, 0.0f ), facingRight, 0.5f ) );
+	MixBuffer( mixer, stereo );
+	CHECK_NEAR( 0.25 * 0.70710678, stereo[10], 1e-3 );
+	CHECK_NEAR( stereo[10], stereo[11], 1e-6 );
+}
+
+UNIT_TEST( VoicesSumAndFinish )
+{
+	UiSoundMixer mixer;
+	CHECK( AddFlatSound( mixer, "short", BUFFER / 2, 0.25f ) );
+	CHECK( AddFlatSound( mixer, "long", BUFFER * 3, 0.125f ) );
+	float stereo[BUFFER * 2];
+	CHECK( mixer.Play( "short", Vector3f( 1.0f, 0.0f, 0.0f ), Matrix4f() ) );
+	CHECK( mixer.Play( "long", Vector3f( 1.0f, 0.0f, 0.0f ), Matrix4f() ) );
+	MixBuffer( mixer, stereo );
+	CHECK_NEAR( 0.375, stereo[1], 1e-3 );
+	CHECK_NEAR( 0.125, stereo[BUFFER + 1], 1e-3 );
+	CHECK_EQUAL( 2, mixer.GetVoicesMax() );
+	MixBuffer( mixer, stereo );
+	MixBuffer( mixer, stereo );
+	CHECK_NEAR( 0.125, stereo[BUFFER * 2 - 1], 1e-3 );
+	MixBuffer( mixer, stereo );
+	CHECK_EQUAL( 0, stereo[1] );
+}
+
+UNIT_TEST( VoicesAreStolenAndQueueIsBounded )
+{
+	UiSoundMixer mixer;
+	CHECK( AddFlatSound( mixer, "tap", BUFFER * 8, 0.01f ) );
+	float stereo[BUFFER * 2];
+
+	// the queue holds MAX_PENDING between two buffers, the rest are refused
+	int queued = 0;
+	for ( int i = 0; i < UiSoundMixer::MAX_PENDING + 5; i++ )
+	{
+		queued += mixer.Play( "tap", Vector3f( 0.0f, 0.0f, -1.0f ), Matrix4f() ) ? 1 : 0;
+	}
+	CHECK_EQUAL( UiSoundMixer::MAX_PENDING, queued );
+	MixBuffer( mixer, stereo );
+	CHECK_NEAR( UiSoundMixer::MAX_PENDING * 0.01 * 0.70710678, stereo[0], 1e-3 );
+
+	// a new voice on a full mixer replaces the one furthest along
+	CHECK( mixer.Play( "tap", Vector3f( 0.0f, 0.0f, -1.0f ), Matrix4f(), 2.0f ) );
+	MixBuffer( mixer, stereo );
+	CHECK_NEAR( ( UiSoundMixer::MAX_VOICES + 1 ) * 0.01 * 0.70710678, stereo[0], 1e-3 );
+	CHECK_EQUAL( UiSoundMixer::MAX_VOICES, mixer.GetVoicesMax() );
+}
+
+//==============================================================
+// Taps from the VR thread while the audio thread mixes.
+
+struct Tapper
+{
+	UiSoundMixer *	Mixer;
+	int				Taps;
+	int				Refused;
+	volatile bool	Done;
+};
+
+static void * TapThread( void * param )
+{
+	Tapper * tapper = static_cast< Tapper * >( param );
+	for ( int i = 0; i < tapper->Taps; i++ )
+	{
+		if ( !tapper->Mixer->Play( "tap", Vector3f( 0.0f, 0.0f, -1.0f ), Matrix4f() ) )
+		{
+			tapper->Refused++;
+		}
+		if ( ( i & 7 ) == 0 )
+		{
+			sched_yield();
+		}
+	}
+	__atomic_store_n( &tapper->Done, true, __ATOMIC_RELEASE );
+	return NULL;
+}
+
+UNIT_TEST( PlayNeverBlocksTheMix )
+{
+	UiSoundMixer mixer;
+	CHECK( AddFlatSound( mixer, "tap", 64, 1.0f / 1024.0f ) );
+	Tapper tapper = { &mixer, 20000, 0, false };
+	pthread_t thread;
+	CHECK( pthread_create( &thread, NULL, TapThread, &tapper ) == 0 );
+
+	// every accepted tap is mixed exactly once: 64 frames of 1/1024
+	double total = 0.0;
+	float stereo[BUFFER * 2];
+	while ( !__atomic_load_n( &tapper.Done, __ATOMIC_ACQUIRE ) )
+	{
+		MixBuffer( mixer, stereo );
+		for ( int f = 0; f < BUFFER; f++ )
+		{
+			total += stereo[f * 2];
+		}
+		sched_yield();
+	}
+	pthread_join( thread, NULL );
+	for ( int b = 0; b < 2; b++ )
+	{
+		MixBuffer( mixer, stereo );
+		for ( int f = 0; f < BUFFER; f++ )
+		{
+			total += stereo[f * 2];
+		}
+	}
+	// a 64 frame voice finishes in the buffer it starts in, so none is stolen
+	const double perTap = 64.0 / 1024.0 * 0.70710678;
+	CHECK( tapper.Refused < tapper.Taps );
+	CHECK_NEAR( ( tapper.Taps - tapper.Refused ) * perTap, total, perTap * 0.5 );
+	OVR::UnitTest::Report( "%i taps, %i refused while the queue was full, %i voices max",
+		tapper.Taps, tapper.Refused, mixer.GetVoicesMax() );
+}
+
+//==============================================================
+
+UNIT_BENCHMARK( BenchMixCost )
+{
+	UiSoundMixer mixer;
+	CHECK( AddFlatSound( mixer, "tap", AudioOutput::SAMPLE_RATE, 0.01f ) );
+	float stereo[BUFFER * 2];
+	const int voices[3] = { 1, 8, UiSoundMixer::MAX_VOICES };
+	for ( int v = 0; v < 3; v++ )
+	{
+		mixer.ResetStats();
+		for ( int i = 0; i < voices[v]; i++ )
+		{
+			mixer.Play( "tap", Vector3f( static_cast< float >( i ), 0.0f, -1.0f ), Matrix4f() );
+		}
+		// a second of output, the sound lasts that long
+		for ( int b = 0; b < AudioOutput::SAMPLE_RATE / BUFFER; b++ )
+		{
+			MixBuffer( mixer, stereo );
+		}
+		const double budget = static_cast< double >( BUFFER ) / AudioOutput::SAMPLE_RATE;
+		OVR::UnitTest::Report( "%2i voices: %.2f us average, %.2f us max per buffer, %.3f%% of the %.2f ms budget",
+			mixer.GetVoicesMax(), mixer.GetMixSecondsAverage() * 1e6, mixer.GetMixSecondsMax() * 1e6,
+			mixer.GetMixSecondsAverage() / budget * 100.0, budget * 1000.0 );
+		// let the voices finish
+		for ( int b = 0; b < 4; b++ )
+		{
+			MixBuffer( mixer, stereo );
+		}
+	}
+}
@@ -0,0 +1,475 @@
+/************************************************************************************
+
+Filename    :   TestVideosMetaData.cpp
+Content     :   Category windows and page panels of OvrVideosMetaData
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "VideosMetaData.h"
+
+using namespace OVR;
+
+static const int POOL = 10;
+
+static String VideoUrl( const int i )
+{
+	char url[64];
+	snprintf( url, sizeof( url ), "/sdcard/Oculus/Movies/Video%02d.mp4", i );
+	return String( url );
+}
+
+static void Scan( OvrVideosMetaData & metaData, const int count, const char * categoryTag = "Movies", const int first = 0 )
+{
+	Array< String > urls;
+	for ( int i = first; i < first + count; i++ )
+	{
+		urls.PushBack( VideoUrl( i ) );
+	}
+	metaData.ScanUrls( categoryTag, urls );
+}
+
+static const OvrVideosMetaDatum & Datum( OvrVideosMetaData & metaData, const int id )
+{
+	return *static_cast< const OvrVideosMetaDatum * >( metaData.GetMetaData()[id] );
+}
+
+static String TempPath( const char * name )
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/" + name;
+}
+
+static void WriteFile( const String & path, const int size )
+{
+	FILE * f = fopen( path.ToCStr(), "wb" );
+	for ( int i = 0; i < size; i++ )
+	{
+		fputc( i, f );
+	}
+	fclose( f );
+}
+
+// The page of the panel at either end of the category, or 0 for a video.
+static int PanelPage( OvrVideosMetaData & metaData, const bool last )
+{
+	const Array< int > & ids = metaData.GetCategory( 0 ).DatumIndicies;
+	return Datum( metaData, last ? ids.Back() : ids[0] ).PanelPage;
+}
+
+UNIT_TEST( SmallCategoriesShowEveryVideo )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, POOL );
+	metaData.SetPanelPool( POOL );
+	CHECK_EQUAL( POOL, metaData.GetCategory( 0 ).DatumIndicies.GetSizeI() );
+	CHECK_EQUAL( POOL, metaData.GetMetaData().GetSizeI() );
+}
+
+UNIT_TEST( PagePanelsMoveTheWindow )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, 25 );
+	metaData.SetPanelPool( POOL );
+
+	OvrMetaData::Category & category = metaData.GetCategory( 0 );
+	CHECK_EQUAL( POOL + 1, category.DatumIndicies.GetSizeI() );
+	CHECK_EQUAL( 0, PanelPage( metaData, false ) );
+	CHECK_EQUAL( 1, PanelPage( metaData, true ) );
+
+	const OvrVideosMetaDatum & next = Datum( metaData, category.DatumIndicies.Back() );
+	int first;
+	int last;
+	metaData.GetPageRange( next, first, last );
+	CHECK_EQUAL( 11, first );
+	CHECK_EQUAL( 20, last );
+	category.Dirty = false;
+	CHECK( metaData.MovePanelWindow( next ) );
+	CHECK( category.Dirty );
+	CHECK_EQUAL( POOL + 2, category.DatumIndicies.GetSizeI() );
+	CHECK_EQUAL( -1, PanelPage( metaData, false ) );
+	const String firstShown = VideoUrl( 10 );
+	CHECK_STRING( firstShown.ToCStr(), metaData.GetMetaData()[category.DatumIndicies[1]]->Url.ToCStr() );
+
+	// the last page is full, so it starts short of a page on
+	metaData.GetPageRange( next, first, last );
+	CHECK_EQUAL( 16, first );
+	CHECK_EQUAL( 25, last );
+	CHECK( metaData.MovePanelWindow( next ) );
+	CHECK_EQUAL( POOL + 1, category.DatumIndicies.GetSizeI() );
+	CHECK_EQUAL( 0, PanelPage( metaData, true ) );
+	CHECK( !metaData.MovePanelWindow( next ) );
+
+	Array< const OvrMetaDatum * > videos;
+	metaData.GetCategoryVideos( category, videos );
+	CHECK_EQUAL( 25, videos.GetSizeI() );
+
+	// setting the pool again reuses the page panels
+	const int datums = metaData.GetMetaData().GetSizeI();
+	metaData.SetPanelPool( POOL );
+	CHECK_EQUAL( datums, metaData.GetMetaData().GetSizeI() );
+}
+
+UNIT_TEST( PagePanelsAreNotSaved )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, 25 );
+	metaData.SetPanelPool( POOL );
+	const Array< int > & ids = metaData.GetCategory( 0 ).DatumIndicies;
+	CHECK( metaData.MovePanelWindow( Datum( metaData, ids.Back() ) ) );
+
+	JSON * file = metaData.MetaDataToJson();
+	const JsonReader data( file->GetItemByName( "data" ) );
+	CHECK( data.IsArray() );
+	int videos = 0;
+	int pages = 0;
+	while ( !data.IsEndOfArray() )
+	{
+		const JsonReader datum( data.GetNextArrayElement() );
+		const JsonReader tags( datum.GetChildByName( "tags" ) );
+		if ( strncmp( datum.GetChildStringByName( "url" ).ToCStr(), "page://", 7 ) == 0 )
+		{
+			pages++;
+			continue;
+		}
+		videos++;
+		CHECK( !tags.IsEndOfArray() );
+		CHECK_STRING( "Movies", JsonReader( tags.GetNextArrayElement() ).GetChildStringByName( "category" ).ToCStr() );
+		CHECK( datum.GetChildByName( "title" ) != NULL );
+	}
+	CHECK_EQUAL( 25, videos );
+	CHECK_EQUAL( 0, pages );
+	file->Release();
+}
+
+UNIT_TEST( PagePanelsHaveNoUrl )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, 25 );
+	metaData.SetPanelPool( POOL );
+	const OvrVideosMetaDatum & next = Datum( metaData, metaData.GetCategory( 0 ).DatumIndicies.Back() );
+	CHECK( next.PanelPage == 1 );
+	CHECK( metaData.AddVideo( next.Url.ToCStr(), "Movies" ) == NULL );
+	CHECK( !metaData.RemoveVideo( next.Url.ToCStr() ) );
+	CHECK_EQUAL( 1, next.PanelPage );
+	CHECK( metaData.AddVideo( VideoUrl( 3 ).ToCStr(), "Movies" ) == NULL );
+}
+
+UNIT_TEST( RemovedUrlsCanComeBack )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, 25 );
+	metaData.SetPanelPool( POOL );
+	for ( int i = 0; i < 25; i += 2 )
+	{
+		CHECK( metaData.RemoveVideo( VideoUrl( i ).ToCStr() ) );
+		CHECK( !metaData.RemoveVideo( VideoUrl( i ).ToCStr() ) );
+	}
+	// the odd urls are still found past the removed ones
+	for ( int i = 1; i < 25; i += 2 )
+	{
+		CHECK( metaData.AddVideo( VideoUrl( i ).ToCStr(), "Movies" ) == NULL );
+	}
+	const OvrMetaDatum * added = metaData.AddVideo( VideoUrl( 4 ).ToCStr(), "Movies" );
+	CHECK( added != NULL );
+	CHECK( metaData.AddVideo( VideoUrl( 4 ).ToCStr(), "Movies" ) == NULL );
+
+	Array< const OvrMetaDatum * > videos;
+	metaData.GetCategoryVideos( metaData.GetCategory( 0 ), videos );
+	CHECK_EQUAL( 13, videos.GetSizeI() );
+	CHECK( videos.Back() == added );
+}
+
+UNIT_TEST( ChangesOnlyDirtyShownVideos )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, 25 );
+	metaData.SetPanelPool( POOL );
+	Array< OvrVideosMetaData::CategoryChanges > changes;
+	metaData.TakeChanges( changes );
+	CHECK_EQUAL( 0, changes.GetSizeI() );
+
+	OvrMetaData::Category & category = metaData.GetCategory( 0 );
+	category.Dirty = false;
+	metaData.MarkUpdated( Datum( metaData, 20 ) );
+	CHECK( !category.Dirty );
+	metaData.MarkUpdated( Datum( metaData, 3 ) );
+	CHECK( category.Dirty );
+
+	category.Dirty = false;
+	const OvrMetaDatum * added = metaData.AddVideo( VideoUrl( 40 ).ToCStr(), "Movies" );
+	CHECK( added != NULL );
+	CHECK( !category.Dirty );
+	CHECK( metaData.AddVideo( VideoUrl( 41 ).ToCStr(), "Clips" ) != NULL );
+
+	// adding Clips moved the categories
+	OvrMetaData::Category & movies = metaData.GetCategory( 0 );
+	movies.Dirty = false;
+	CHECK( metaData.RemoveVideo( VideoUrl( 22 ).ToCStr() ) );
+	CHECK( !movies.Dirty );
+	CHECK( metaData.RemoveVideo( VideoUrl( 5 ).ToCStr() ) );
+	CHECK( movies.Dirty );
+
+	metaData.TakeChanges( changes );
+	CHECK_EQUAL( 2, changes.GetSizeI() );
+	CHECK_STRING( "Movies", changes[0].CategoryTag.ToCStr() );
+	CHECK_EQUAL( 2, changes[0].Updated.GetSizeI() );
+	CHECK_EQUAL( 20, changes[0].Updated[0] );
+	CHECK_EQUAL( 3, changes[0].Updated[1] );
+	CHECK_EQUAL( 2, changes[0].Removed.GetSizeI() );
+	CHECK_EQUAL( 22, changes[0].Removed[0] );
+	CHECK_EQUAL( 5, changes[0].Removed[1] );
+	CHECK_EQUAL( 1, changes[0].Inserted.GetSizeI() );
+	CHECK_EQUAL( added->Id, changes[0].Inserted[0] );
+	CHECK_STRING( "Clips", changes[1].CategoryTag.ToCStr() );
+	CHECK_EQUAL( 1, changes[1].Inserted.GetSizeI() );
+
+	metaData.TakeChanges( changes );
+	CHECK_EQUAL( 0, changes.GetSizeI() );
+}
+
+UNIT_TEST( RemovalsKeepTheWindowOnItsVideos )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, 100 );
+	metaData.SetPanelPool( POOL );
+	OvrMetaData::Category & category = metaData.GetCategory( 0 );
+	CHECK( metaData.MovePanelWindow( Datum( metaData, category.DatumIndicies.Back() ) ) );
+	CHECK( metaData.MovePanelWindow( Datum( metaData, category.DatumIndicies.Back() ) ) );
+	CHECK_EQUAL( 20, category.DatumIndicies[1] );
+
+	// videos before, after and inside the window
+	category.Dirty = false;
+	for ( int i = 0; i < 100; i += 3 )
+	{
+		CHECK( metaData.RemoveVideo( VideoUrl( i ).ToCStr() ) );
+	}
+	CHECK( category.Dirty );
+	Array< OvrVideosMetaData::CategoryChanges > changes;
+	metaData.TakeChanges( changes );
+	CHECK_EQUAL( 34, changes[0].Removed.GetSizeI() );
+
+	// the 7 removed before it no longer count, so it still starts at video 20
+	CHECK_EQUAL( POOL + 2, category.DatumIndicies.GetSizeI() );
+	CHECK_EQUAL( 20, category.DatumIndicies[1] );
+	CHECK_EQUAL( 22, category.DatumIndicies[2] );
+	Array< const OvrMetaDatum * > videos;
+	metaData.GetCategoryVideos( category, videos );
+	CHECK_EQUAL( 66, videos.GetSizeI() );
+	int first;
+	int last;
+	metaData.GetPageRange( Datum( metaData, category.DatumIndicies[0] ), first, last );
+	CHECK_EQUAL( 4, first );
+	CHECK_EQUAL( 13, last );
+}
+
+UNIT_TEST( RescanFindsDeletedAndChangedFiles )
+{
+	Array< String > urls;
+	const char * names[] = { "RescanA.mp4", "RescanB.mp4", "RescanC.mp4" };
+	for ( int i = 0; i < 3; i++ )
+	{
+		urls.PushBack( TempPath( names[i] ) );
+		WriteFile( urls.Back(), 100 );
+	}
+	OvrVideosMetaData metaData;
+	metaData.ScanUrls( "Movies", urls );
+	CHECK( metaData.AddVideo( "http://host/share/Remote.mp4", "Share" ) != NULL );
+	Array< OvrVideosMetaData::CategoryChanges > changes;
+	metaData.TakeChanges( changes );
+
+	// the first rescan only records the files
+	metaData.RescanFiles();
+	metaData.TakeChanges( changes );
+	CHECK_EQUAL( 0, changes.GetSizeI() );
+
+	unlink( urls[0].ToCStr() );
+	WriteFile( urls[1], 200 );
+	metaData.RescanFiles();
+	metaData.TakeChanges( changes );
+	CHECK_EQUAL( 1, changes.GetSizeI() );
+	CHECK_EQUAL( 1, changes[0].Removed.GetSizeI() );
+	CHECK_EQUAL( 0, changes[0].Removed[0] );
+	CHECK_EQUAL( 1, changes[0].Updated.GetSizeI() );
+	CHECK_EQUAL( 1, changes[0].Updated[0] );
+	CHECK_EQUAL( 2, metaData.GetCategory( 0 ).DatumIndicies.GetSizeI() );
+
+	// nothing changed since, and a file that comes back is a new video
+	metaData.RescanFiles();
+	metaData.TakeChanges( changes );
+	CHECK_EQUAL( 0, changes.GetSizeI() );
+	WriteFile( urls[0], 100 );
+	CHECK( metaData.AddVideo( urls[0].ToCStr(), "Movies" ) != NULL );
+
+	for ( int i = 0; i < 3; i++ )
+	{
+		unlink( urls[i].ToCStr() );
+	}
+}
+
+UNIT_TEST( BudgetShrinksThePool )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, 100, "Movies", 0 );
+	Scan( metaData, 100, "Clips", 100 );
+	Scan( metaData, 5, "Trailers", 200 );
+	metaData.SetPanelPool( 64 );
+	CHECK_EQUAL( 64, metaData.GetPanelPool() );
+	CHECK_EQUAL( 65 + 65 + 5, metaData.GetShownPanelCount() );
+
+	// two windows with both page panels and the small category whole
+	metaData.SetPanelBudget( 96 );
+	CHECK_EQUAL( 43, metaData.GetPanelPool() );
+	CHECK_EQUAL( 44 + 44 + 5, metaData.GetShownPanelCount() );
+	OvrMetaData::Category & movies = metaData.GetCategory( 0 );
+	CHECK( metaData.MovePanelWindow( Datum( metaData, movies.DatumIndicies.Back() ) ) );
+	CHECK( metaData.GetShownPanelCount() <= 96 );
+
+	// under pressure, and back
+	metaData.SetPanelBudget( 24 );
+	CHECK_EQUAL( 7, metaData.GetPanelPool() );
+	CHECK( metaData.GetShownPanelCount() <= 24 );
+	Array< const OvrMetaDatum * > videos;
+	metaData.GetCategoryVideos( movies, videos );
+	CHECK_EQUAL( 100, videos.GetSizeI() );
+	metaData.SetPanelBudget( 0 );
+	CHECK_EQUAL( 64, metaData.GetPanelPool() );
+	CHECK( metaData.GetShownPanelCount() > 96 );
+}
+
+UNIT_TEST( AddedVideosRefitTheBudget )
+{
+	OvrVideosMetaData metaData;
+	Scan( metaData, 40 );
+	metaData.SetPanelPool( 64 );
+	metaData.SetPanelBudget( 45 );
+	CHECK_EQUAL( 64, metaData.GetPanelPool() );
+	CHECK_EQUAL( 40, metaData.GetShownPanelCount() );
+	for ( int i = 40; i < 50; i++ )
+	{
+		CHECK( metaData.AddVideo( VideoUrl( i ).ToCStr(), "Movies" ) != NULL );
+		CHECK( metaData.GetShownPanelCount() <= 45 );
+	}
+	CHECK_EQUAL( 43, metaData.GetPanelPool() );
+	CHECK_EQUAL( 44, metaData.GetShownPanelCount() );
+}
+
+//==============================================================
+// Building the browser's categories for one large category, with the pool
+// Oculus360Videos sets. The browser builds a panel per shown datum, each
+// with a 256x256 RGBA thumbnail, so the shown panels bound its memory.
+
+static const int APP_PANEL_POOL = 64;
+
+static size_t HeapBytes()
+{
+	const struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+UNIT_BENCHMARK( BenchLargeCategories )
+{
+	const int sizes[] = { 100, 10000, 100000 };
+	for ( int s = 0; s < 3; s++ )
+	{
+		const size_t heapBefore = HeapBytes();
+		OvrVideosMetaData * metaData = new OvrVideosMetaData();
+		const double start = OVR::UnitTest::GetSeconds();
+		Scan( *metaData, sizes[s] );
+		metaData->SetPanelPool( APP_PANEL_POOL );
+		const double built = OVR::UnitTest::GetSeconds();
+		const size_t heap = HeapBytes() - heapBefore;
+		const int panels = metaData->GetShownPanelCount();
+		CHECK( panels <= APP_PANEL_POOL + 2 );
+
+		// page to the end of the category and back
+		int pages = 0;
+		while ( PanelPage( *metaData, true ) == 1 && metaData->MovePanelWindow( Datum( *metaData, metaData->GetCategory( 0 ).DatumIndicies.Back() ) ) )
+		{
+			pages++;
+		}
+		while ( PanelPage( *metaData, false ) == -1 && metaData->MovePanelWindow( Datum( *metaData, metaData->GetCategory( 0 ).DatumIndicies[0] ) ) )
+		{
+			pages++;
+		}
+		const double paged = OVR::UnitTest::GetSeconds();
+		CHECK_EQUAL( 2 * ( ( sizes[s] + APP_PANEL_POOL - 1 ) / APP_PANEL_POOL - 1 ), pages );
+
+		OVR::UnitTest::Report( "%6i videos: %.2f ms to build, %i panels, %.1f MB thumbnails, %.1f MB metadata, %.2f us a page",
+				sizes[s], ( built - start ) * 1e3, panels, panels * 256.0 * 256.0 * 4.0 / ( 1024.0 * 1024.0 ),
+				heap / ( 1024.0 * 1024.0 ), pages > 0 ? ( paged - built ) * 1e6 / pages : 0.0 );
+		delete metaData;
+	}
+}
+
+//==============================================================
+// What a change costs as the category grows: AddVideo, RemoveVideo and
+// MarkUpdated each, then the TakeChanges that prunes the windows, and the
+// panels the browser rebuilds for the categories left dirty.
+
+UNIT_BENCHMARK( BenchChanges )
+{
+	const int sizes[] = { 100, 10000, 100000 };
+	const int changes = 1000;
+	for ( int s = 0; s < 3; s++ )
+	{
+		OvrVideosMetaData metaData;
+		Scan( metaData, sizes[s] );
+		metaData.SetPanelPool( APP_PANEL_POOL );
+		Array< OvrVideosMetaData::CategoryChanges > taken;
+		metaData.TakeChanges( taken );
+		OvrMetaData::Category & category = metaData.GetCategory( 0 );
+		category.Dirty = false;
+		// the first lookup indexes the scanned urls, once
+		CHECK( metaData.AddVideo( VideoUrl( 0 ).ToCStr(), "Movies" ) == NULL );
+
+		double start = OVR::UnitTest::GetSeconds();
+		for ( int i = 0; i < changes; i++ )
+		{
+			metaData.AddVideo( VideoUrl( sizes[s] + i ).ToCStr(), "Movies" );
+		}
+		const double add = OVR::UnitTest::GetSeconds() - start;
+
+		UInt32 random = 12345;
+		start = OVR::UnitTest::GetSeconds();
+		for ( int i = 0; i < changes; i++ )
+		{
+			random = random * 1664525 + 1013904223;
+			metaData.MarkUpdated( Datum( metaData, random % sizes[s] ) );
+		}
+		const double update = OVR::UnitTest::GetSeconds() - start;
+
+		// every other video, so the small category loses none twice
+		start = OVR::UnitTest::GetSeconds();
+		int removed = 0;
+		for ( int i = 0; i < changes && i * 2 < sizes[s]; i++ )
+		{
+			random = random * 1664525 + 1013904223;
+			removed += metaData.RemoveVideo( VideoUrl( ( random % ( sizes[s] / 2 ) ) * 2 ).ToCStr() ) ? 1 : 0;
+		}
+		const double remove = OVR::UnitTest::GetSeconds() - start;
+
+		start = OVR::UnitTest::GetSeconds();
+		metaData.TakeChanges( taken );
+		const double take = OVR::UnitTest::GetSeconds() - start;
+		const int rebuilt = category.Dirty ? category.DatumIndicies.GetSizeI() : 0;
+		CHECK( rebuilt <= APP_PANEL_POOL + 2 );
+
+		OVR::UnitTest::Report( "%6i videos: add %.2f us, update %.2f us, remove %.2f us, take %.1f us, %i panels rebuilt",
+				sizes[s], add * 1e6 / changes, update * 1e6 / changes, remove * 1e6 / Alg::Max( 1, removed ),
+				take * 1e6, rebuilt );
+	}
+}
@@ -0,0 +1,475 @@
+/************************************************************************************
+
+Filename    :   TestWebDavSource.cpp
+Content     :   Share walks, sidecar thumbnails and revalidated listings
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Kernel/OVR_String.h"
+#include "HttpTestServer.h"
+#include "MediaContainer.h"
+#include "WebDavSource.h"
+
+using namespace OVR;
+
+// A share held in memory. Children are names relative to their folder,
+// or absolute paths, with a trailing slash for folders.
+struct DavFolder
+{
+	String			Path;			// percent encoded, with the trailing slash
+	String			SelfHref;		// what the folder calls itself, Path when empty
+	String			ETag;
+	Array< String >	Children;
+};
+
+struct DavShare
+{
+	Array< DavFolder >	Folders;
+
+	DavFolder &		AddFolder( const char * path, const char * etag )
+	{
+		DavFolder folder;
+		folder.Path = path;
+		folder.ETag = etag;
+		Folders.PushBack( folder );
+		return Folders.Back();
+	}
+
+	DavFolder *		Find( const String & path )
+	{
+		for ( int i = 0; i < Folders.GetSizeI(); i++ )
+		{
+			if ( Folders[i].Path == path )
+			{
+				return &Folders[i];
+			}
+		}
+		return NULL;
+	}
+};
+
+static void AppendResponse( String & xml, const String & href, const bool collection, const String & etag )
+{
+	xml += "<D:response><D:href>";
+	xml += href;
+	xml += "</D:href><D:propstat><D:prop><D:resourcetype>";
+	if ( collection )
+	{
+		xml += "<D:collection/>";
+	}
+	xml += "</D:resourcetype>";
+	if ( !etag.IsEmpty() )
+	{
+		xml += "<D:getetag>";
+		xml += etag;
+		xml += "</D:getetag>";
+	}
+	xml += "</D:prop><D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>";
+}
+
+// Answers PROPFIND Depth: 1 the way Apache mod_dav does, and leaves GETs
+// of the sidecar thumbnails to the server's files.
+static bool ServeShare( void * user, const HttpTestServer::Request & request, HttpTestServer::Reply & outReply )
+{
+	if ( !( request.Method == "PROPFIND" ) )
+	{
+		return false;
+	}
+	DavShare & share = *static_cast< DavShare * >( user );
+	const DavFolder * folder = share.Find( request.Path );
+	if ( folder == NULL )
+	{
+		outReply.Status = 404;
+		return true;
+	}
+	if ( !( request.GetHeader( "Depth" ) == "1" ) )
+	{
+		outReply.Status = 403;
+		return true;
+	}
+	if ( !folder->ETag.IsEmpty() && request.GetHeader( "If-None-Match" ) == folder->ETag )
+	{
+		outReply.Status = 304;
+		return true;
+	}
+	String xml( "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<D:multistatus xmlns:D=\"DAV:\">" );
+	AppendResponse( xml, folder->SelfHref.IsEmpty() ? folder->Path : folder->SelfHref, true, folder->ETag );
+	for ( int i = 0; i < folder->Children.GetSizeI(); i++ )
+	{
+		const String & child = folder->Children[i];
+		const bool collection = child.ToCStr()[child.GetSize() - 1] == '/';
+		const String href = ( child.ToCStr()[0] == '/' ) ? child : folder->Path + child;
+		AppendResponse( xml, href, collection, collection ? String() : String( "\"" ) + child + "\"" );
+	}
+	xml += "</D:multistatus>\n";
+	outReply.Status = 207;
+	outReply.ContentType = "application/xml; charset=utf-8";
+	outReply.SetBody( xml.ToCStr() );
+	return true;
+}
+
+// A root with a video and two folders, one of them with sidecars, a
+// subfolder, a link back into the tree and one out of the share.
+static void BuildShare( DavShare & share )
+{
+	DavFolder & root = share.AddFolder( "/share/", "\"root-1\"" );
+	root.Children.PushBack( "Trips/" );
+	root.Children.PushBack( "Summer%20Trip/" );
+	root.Children.PushBack( "intro.mp4" );
+	root.Children.PushBack( "readme.txt" );
+
+	DavFolder & trips = share.AddFolder( "/share/Trips/", "\"trips-1\"" );
+	trips.Children.PushBack( "a.mp4" );
+	trips.Children.PushBack( "a.jpg" );
+	trips.Children.PushBack( "b.MKV" );
+	trips.Children.PushBack( "b.thm" );
+	trips.Children.PushBack( "c.mp4" );
+	trips.Children.PushBack( "c.mp4.part" );
+	trips.Children.PushBack( "Deep/" );
+
+	DavFolder & deep = share.AddFolder( "/share/Trips/Deep/", "\"deep-1\"" );
+	deep.Children.PushBack( "d.mp4" );
+
+	// IIS leaves the slash off the folder's own href
+	DavFolder & summer = share.AddFolder( "/share/Summer%20Trip/", "\"summer-1\"" );
+	summer.SelfHref = "/share/Summer%20Trip";
+	summer.Children.PushBack( "beach%20day.mp4" );
+	summer.Children.PushBack( "/share/Trips/" );
+	summer.Children.PushBack( "/other/" );
+}
+
+static const char THUMBNAIL_A[] = "jpeg bytes of a";
+static const char THUMBNAIL_B[] = "thm bytes of b";
+
+static void AddThumbnails( HttpTestServer & server )
+{
+	server.AddFile( "/share/Trips/a.jpg", reinterpret_cast< const UByte * >( THUMBNAIL_A ), sizeof( THUMBNAIL_A ) - 1, "image/jpeg", "\"a.jpg\"" );
+	server.AddFile( "/share/Trips/b.thm", reinterpret_cast< const UByte * >( THUMBNAIL_B ), sizeof( THUMBNAIL_B ) - 1, "image/jpeg", "\"b.thm\"" );
+}
+
+static Array< String > VideoExtensions()
+{
+	Array< String > extensions;
+	extensions.PushBack( ".mp4" );
+	extensions.PushBack( ".mkv" );
+	return extensions;
+}
+
+static String CacheDir()
+{
+	return String( OVR::UnitTest::GetTempDir() ) + "/webdav";
+}
+
+// Polls for entries the way the browser does every frame until the walk
+// is finished.
+static bool Walk( WebDavSource & source, Array< MediaSourceEntry > & outEntries, const double seconds )
+{
+	outEntries.Clear();
+	const double end = OVR::UnitTest::GetSeconds() + seconds;
+	while ( OVR::UnitTest::GetSeconds() < end )
+	{
+		Array< MediaSourceEntry > batch;
+		source.TakeEntries( batch );
+		for ( int i = 0; i < batch.GetSizeI(); i++ )
+		{
+			outEntries.PushBack( batch[i] );
+		}
+		if ( source.IsFinished() )
+		{
+			source.TakeEntries( batch );
+			return batch.GetSizeI() == 0;
+		}
+		usleep( 2 * 1000 );
+	}
+	return false;
+}
+
+static int FindEntry( const Array< MediaSourceEntry > & entries, const String & url )
+{
+	for ( int i = 0; i < entries.GetSizeI(); i++ )
+	{
+		if ( entries[i].Url == url )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static bool FileHolds( const String & path, const char * text )
+{
+	MediaFile file;
+	Array< UByte > contents;
+	const int length = static_cast< int >( strlen( text ) );
+	return file.Open( path.ToCStr() ) && file.GetSize() == length &&
+		file.ReadArray( 0, length, contents ) && memcmp( &contents[0], text, length ) == 0;
+}
+
+static int CountLogged( HttpTestServer & server, const char * method )
+{
+	Array< String > log;
+	server.GetLog( log );
+	int count = 0;
+	for ( int i = 0; i < log.GetSizeI(); i++ )
+	{
+		count += strncmp( log[i].ToCStr(), method, strlen( method ) ) == 0;
+	}
+	return count;
+}
+
+//==============================================================
+
+UNIT_TEST( WalksTheShare )
+{
+	DavShare share;
+	BuildShare( share );
+	HttpTestServer server;
+	server.SetHandler( ServeShare, &share );
+	CHECK( server.Start() );
+	AddThumbnails( server );
+
+	WebDavSource source( server.GetUrl( "/share" ).ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+	CHECK( source.Owns( server.GetUrl( "/share/Trips/a.mp4" ).ToCStr() ) );
+	CHECK( !source.Owns( server.GetUrl( "/other/x.mp4" ).ToCStr() ) );
+	source.Start();
+	Array< MediaSourceEntry > entries;
+	CHECK( Walk( source, entries, 20.0 ) );
+	source.Stop();
+
+	CHECK_EQUAL( 6, entries.GetSizeI() );
+	const char * videos[] = { "/share/intro.mp4", "/share/Trips/a.mp4", "/share/Trips/b.MKV", "/share/Trips/c.mp4",
+							"/share/Trips/Deep/d.mp4", "/share/Summer%20Trip/beach%20day.mp4" };
+	// each is named after its decoded folder name
+	const char * categories[] = { "share", "Trips", "Trips", "Trips", "Deep", "Summer Trip" };
+	for ( int i = 0; i < 6; i++ )
+	{
+		const int index = FindEntry( entries, server.GetUrl( videos[i] ) );
+		CHECK( index >= 0 );
+		if ( index >= 0 )
+		{
+			const String category = entries[index].Category;
+			CHECK_STRING( categories[i], category.ToCStr() );
+		}
+	}
+
+	// each folder once, even the one linked from elsewhere, and nothing outside the share
+	CHECK_EQUAL( 4, source.GetRequestCount() );
+	CHECK_EQUAL( 4, CountLogged( server, "PROPFIND " ) );
+	CHECK_EQUAL( 0, source.GetRevalidatedCount() );
+}
+
+UNIT_TEST( FetchesThumbnailsBeforeHandingOver )
+{
+	DavShare share;
+	BuildShare( share );
+	HttpTestServer server;
+	server.SetHandler( ServeShare, &share );
+	CHECK( server.Start() );
+	AddThumbnails( server );
+	// slow enough that the listing of Deep comes back before the sidecars of Trips
+	server.SetLatencyMs( 30 );
+
+	const String aUrl = server.GetUrl( "/share/Trips/a.mp4" );
+	const String bUrl = server.GetUrl( "/share/Trips/b.MKV" );
+	const String cUrl = server.GetUrl( "/share/Trips/c.mp4" );
+	WebDavSource source( server.GetUrl( "/share/" ).ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+	source.Start();
+	bool handedOver = false;
+	const double end = OVR::UnitTest::GetSeconds() + 20.0;
+	while ( !source.IsFinished() && OVR::UnitTest::GetSeconds() < end )
+	{
+		Array< MediaSourceEntry > batch;
+		source.TakeEntries( batch );
+		if ( FindEntry( batch, aUrl ) >= 0 )
+		{
+			// a thumbnail that shows up after the entry would leave a blank panel
+			CHECK( FileHolds( source.GetThumbnailPath( aUrl.ToCStr() ), THUMBNAIL_A ) );
+			CHECK( FileHolds( source.GetThumbnailPath( bUrl.ToCStr() ), THUMBNAIL_B ) );
+			handedOver = true;
+		}
+		usleep( 2 * 1000 );
+	}
+	source.Stop();
+	CHECK( handedOver );
+	CHECK( access( source.GetThumbnailPath( cUrl.ToCStr() ).ToCStr(), F_OK ) != 0 );
+	CHECK_EQUAL( 2, CountLogged( server, "GET " ) );
+}
+
+UNIT_TEST( RevalidatesCachedListings )
+{
+	DavShare share;
+	BuildShare( share );
+	HttpTestServer server;
+	server.SetHandler( ServeShare, &share );
+	CHECK( server.Start() );
+	AddThumbnails( server );
+	const String root = server.GetUrl( "/share/" );
+
+	Array< MediaSourceEntry > entries;
+	{
+		WebDavSource source( root.ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+		source.Start();
+		CHECK( Walk( source, entries, 20.0 ) );
+		source.Stop();
+	}
+
+	// nothing changed: every folder is a 304 and no thumbnail is fetched again
+	server.ResetCounters();
+	{
+		WebDavSource source( root.ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+		source.Start();
+		CHECK( Walk( source, entries, 20.0 ) );
+		source.Stop();
+		CHECK_EQUAL( 6, entries.GetSizeI() );
+		CHECK_EQUAL( 4, source.GetRequestCount() );
+		CHECK_EQUAL( 4, source.GetRevalidatedCount() );
+		CHECK_EQUAL( 0, CountLogged( server, "GET " ) );
+		CHECK( FileHolds( source.GetThumbnailPath( server.GetUrl( "/share/Trips/a.mp4" ).ToCStr() ), THUMBNAIL_A ) );
+	}
+
+	// a new video in one folder: only that folder is listed again
+	DavFolder * trips = share.Find( "/share/Trips/" );
+	trips->ETag = "\"trips-2\"";
+	trips->Children.PushBack( "e.mp4" );
+	server.ResetCounters();
+	{
+		WebDavSource source( root.ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+		source.Start();
+		CHECK( Walk( source, entries, 20.0 ) );
+		source.Stop();
+		CHECK_EQUAL( 7, entries.GetSizeI() );
+		CHECK( FindEntry( entries, server.GetUrl( "/share/Trips/e.mp4" ) ) >= 0 );
+		CHECK_EQUAL( 3, source.GetRevalidatedCount() );
+		CHECK_EQUAL( 0, CountLogged( server, "GET " ) );
+	}
+}
+
+UNIT_TEST( PipelinesOnOneConnection )
+{
+	DavShare share;
+	share.AddFolder( "/share/", "\"root\"" );
+	for ( int i = 0; i < 20; i++ )
+	{
+		char name[32];
+		snprintf( name, sizeof( name ), "folder%02i/", i );
+		// AddFolder can move the folders, so the root is looked up each time
+		share.Folders[0].Children.PushBack( name );
+		DavFolder & folder = share.AddFolder( ( String( "/share/" ) + name ).ToCStr(), "" );
+		folder.Children.PushBack( "video.mp4" );
+	}
+	HttpTestServer server;
+	server.SetHandler( ServeShare, &share );
+	CHECK( server.Start() );
+
+	WebDavSource source( server.GetUrl( "/share/" ).ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+	source.Start();
+	Array< MediaSourceEntry > entries;
+	CHECK( Walk( source, entries, 20.0 ) );
+	source.Stop();
+	CHECK_EQUAL( 20, entries.GetSizeI() );
+	CHECK_EQUAL( 21, server.GetRequests() );
+	CHECK_EQUAL( 1, server.GetConnections() );
+}
+
+UNIT_TEST( SurvivesDroppedConnections )
+{
+	DavShare share;
+	BuildShare( share );
+	HttpTestServer server;
+	server.SetHandler( ServeShare, &share );
+	CHECK( server.Start() );
+	AddThumbnails( server );
+	// every other response is cut off part way through the XML
+	server.SetDropEvery( 2, 64 );
+
+	WebDavSource source( server.GetUrl( "/share/" ).ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+	source.Start();
+	Array< MediaSourceEntry > entries;
+	CHECK( Walk( source, entries, 30.0 ) );
+	source.Stop();
+	CHECK( server.GetDropped() > 0 );
+	CHECK_EQUAL( 6, entries.GetSizeI() );
+}
+
+UNIT_TEST( FinishesOnAMissingShare )
+{
+	DavShare share;
+	BuildShare( share );
+	HttpTestServer server;
+	server.SetHandler( ServeShare, &share );
+	CHECK( server.Start() );
+
+	WebDavSource source( server.GetUrl( "/missing/" ).ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+	source.Start();
+	Array< MediaSourceEntry > entries;
+	CHECK( Walk( source, entries, 20.0 ) );
+	source.Stop();
+	CHECK_EQUAL( 0, entries.GetSizeI() );
+	CHECK_EQUAL( 1, source.GetRequestCount() );
+
+	// a url that isn't http never starts
+	WebDavSource unsupported( "ftp://example.com/share/", CacheDir().ToCStr(), VideoExtensions() );
+	unsupported.Start();
+	CHECK( unsupported.IsFinished() );
+	CHECK( !unsupported.Owns( "ftp://example.com/share/a.mp4" ) );
+}
+
+//==============================================================
+// A NAS share 5 ms away with 10,000 videos in 100 folders: the first
+// walk, and the next one that only revalidates the listings.
+
+UNIT_BENCHMARK( BenchListTenThousandFiles )
+{
+	DavShare share;
+	share.AddFolder( "/share/", "\"root\"" );
+	for ( int i = 0; i < 100; i++ )
+	{
+		char name[32];
+		snprintf( name, sizeof( name ), "folder%03i/", i );
+		share.Folders[0].Children.PushBack( name );
+		char etag[32];
+		snprintf( etag, sizeof( etag ), "\"f%i\"", i );
+		DavFolder & folder = share.AddFolder( ( String( "/share/" ) + name ).ToCStr(), etag );
+		for ( int j = 0; j < 100; j++ )
+		{
+			char video[32];
+			snprintf( video, sizeof( video ), "video%03i.mp4", j );
+			folder.Children.PushBack( video );
+		}
+	}
+	HttpTestServer server;
+	server.SetHandler( ServeShare, &share );
+	CHECK( server.Start() );
+	server.SetLatencyMs( 5 );
+	const String url = server.GetUrl( "/share/" );
+
+	for ( int pass = 0; pass < 2; pass++ )
+	{
+		server.ResetCounters();
+		WebDavSource source( url.ToCStr(), CacheDir().ToCStr(), VideoExtensions() );
+		const double start = OVR::UnitTest::GetSeconds();
+		source.Start();
+		Array< MediaSourceEntry > entries;
+		CHECK( Walk( source, entries, 60.0 ) );
+		const double seconds = OVR::UnitTest::GetSeconds() - start;
+		source.Stop();
+		CHECK_EQUAL( 10000, entries.GetSizeI() );
+		OVR::UnitTest::Report( "%s walk: %i files in %.2f s, %i requests on %i connections, %i unchanged",
+			pass == 0 ? "first" : "revalidated", entries.GetSizeI(), seconds, source.GetRequestCount(),
+			server.GetConnections(), source.GetRevalidatedCount() );
+	}
+}
@@ -0,0 +1,162 @@
+/************************************************************************************
+
+Filename    :   UnitTest.cpp
+Content     :   Minimal test registry for the host unit tests and benchmarks
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "UnitTest.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "Kernel/OVR_System.h"
+
+namespace OVR {
+namespace UnitTest {
+
+static TestCase *	First = NULL;
+static TestCase *	Last = NULL;
+static int			FailedChecks = 0;
+static char			TempDir[256];
+
+Registrar::Registrar( TestCase & testCase )
+{
+	testCase.Next = NULL;
+	if ( Last != NULL )
+	{
+		Last->Next = &testCase;
+	}
+	else
+	{
+		First = &testCase;
+	}
+	Last = &testCase;
+}
+
+void Fail( const char * file, const int line, const char * format, ... )
+{
+	va_list args;
+	va_start( args, format );
+	fprintf( stdout, "    %s:%i: FAILED ", file, line );
+	vfprintf( stdout, format, args );
+	fputc( '\n', stdout );
+	va_end( args );
+	fflush( stdout );
+	FailedChecks++;
+}
+
+double GetSeconds()
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void Report( const char * format, ... )
+{
+	va_list args;
+	va_start( args, format );
+	fputs( "    ", stdout );
+	vfprintf( stdout, format, args );
+	fputc( '\n', stdout );
+	va_end( args );
+}
+
+const char * GetTempDir()
+{
+	return TempDir;
+}
+
+static void ResetTempDir( const char * program, const char * test )
+{
+	const char * base = strrchr( program, '/' );
+	snprintf( TempDir, sizeof( TempDir ), "/tmp/%s.%i.%s", base != NULL ? base + 1 : program, ( int )getpid(), test );
+	char command[1024];
+	snprintf( command, sizeof( command ), "rm -rf '%s' && mkdir -p '%s'", TempDir, TempDir );
+	if ( system( command ) != 0 )
+	{
+		fprintf( stdout, "    couldn't create %s\n", TempDir );
+	}
+}
+
+static void RemoveTempDir()
+{
+	char command[1024];
+	snprintf( command, sizeof( command ), "rm -rf '%s'", TempDir );
+	if ( system( command ) != 0 )
+	{
+		fprintf( stdout, "    couldn't remove %s\n", TempDir );
+	}
+}
+
+}	// namespace UnitTest
+}	// namespace OVR
+
+using namespace OVR;
+using namespace OVR::UnitTest;
+
+// TestName [--bench] [name ...]
+int main( int argc, char * argv[] )
+{
+	bool benchmarks = false;
+	int firstName = 1;
+	if ( argc > 1 && strcmp( argv[1], "--bench" ) == 0 )
+	{
+		benchmarks = true;
+		firstName = 2;
+	}
+
+	// the stand-in servers write to sockets the client may have closed
+	signal( SIGPIPE, SIG_IGN );
+	System::Init( Log::ConfigureDefaultLog( LogMask_All ) );
+
+	int run = 0;
+	int failed = 0;
+	for ( TestCase * test = First; test != NULL; test = test->Next )
+	{
+		bool selected = ( argc <= firstName ) ? test->Benchmark == benchmarks : false;
+		for ( int i = firstName; i < argc; i++ )
+		{
+			selected = selected || strcmp( argv[i], test->Name ) == 0;
+		}
+		if ( !selected )
+		{
+			continue;
+		}
+		fprintf( stdout, "%s\n", test->Name );
+		fflush( stdout );
+		ResetTempDir( argv[0], test->Name );
+		const int before = FailedChecks;
+		const double start = GetSeconds();
+		test->Function();
+		const double seconds = GetSeconds() - start;
+		RemoveTempDir();
+		run++;
+		if ( FailedChecks != before )
+		{
+			failed++;
+		}
+		fprintf( stdout, "    %s, %.1f ms\n", FailedChecks != before ? "FAILED" : "ok", seconds * 1000.0 );
+		fflush( stdout );
+	}
+
+	const char * program = strrchr( argv[0], '/' );
+	fprintf( stdout, "%s: %i %s, %i failed\n", program != NULL ? program + 1 : argv[0], run,
+		benchmarks ? "benchmarks" : "tests", failed );
+
+	System::Destroy();
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+/************************************************************************************
+
+Filename    :   UnitTest.h
+Content     :   Minimal test registry for the host unit tests and benchmarks
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_UnitTest_h )
+#define OVR_UnitTest_h
+
+#include <stdio.h>
+#include <string.h>
+
+namespace OVR {
+namespace UnitTest {
+
+typedef void ( *TestFunction )();
+
+struct TestCase
+{
+	const char *	Name;
+	TestFunction	Function;
+	bool			Benchmark;
+	TestCase *		Next;
+};
+
+// Links the case into the list main() runs, in the order of the file.
+class Registrar
+{
+public:
+					Registrar( TestCase & testCase );
+};
+
+// Records a failed check of the running test.
+void				Fail( const char * file, const int line, const char * format, ... );
+
+// Monotonic seconds, for benchmarks.
+double				GetSeconds();
+
+// A line of results, printed under the running test.
+void				Report( const char * format, ... );
+
+// A scratch directory for the running test, emptied before it runs.
+const char *		GetTempDir();
+
+}	// namespace UnitTest
+}	// namespace OVR
+
+// A test is a void function; a failed CHECK returns from it.
+#define UNIT_TEST( name )		OVR_UNIT_CASE( name, false )
+
+// Benchmarks only run with --bench, and print what they measure with Report().
+#define UNIT_BENCHMARK( name )	OVR_UNIT_CASE( name, true )
+
+#define OVR_UNIT_CASE( name, benchmark ) \
+	static void name(); \
+	static OVR::UnitTest::TestCase name##Case = { #name, name, benchmark, NULL }; \
+	static OVR::UnitTest::Registrar name##Registrar( name##Case ); \
+	static void name()
+
+#define CHECK( expr ) \
+	do { if ( !( expr ) ) { OVR::UnitTest::Fail( __FILE__, __LINE__, "%s", #expr ); return; } } while ( 0 )
+
+#define CHECK_EQUAL( expected, actual ) \
+	do { const long long e_ = ( long long )( expected ); const long long a_ = ( long long )( actual ); \
+		if ( e_ != a_ ) { OVR::UnitTest::Fail( __FILE__, __LINE__, "%s == %s, %lld != %lld", #expected, #actual, e_, a_ ); return; } } while ( 0 )
+
+#define CHECK_NEAR( expected, actual, tolerance ) \
+	do { const double e_ = ( expected ); const double a_ = ( actual ); \
+		if ( !( a_ >= e_ - ( tolerance ) && a_ <= e_ + ( tolerance ) ) ) \
+		{ OVR::UnitTest::Fail( __FILE__, __LINE__, "%s ~= %s, %g != %g", #expected, #actual, e_, a_ ); return; } } while ( 0 )
+
+#define CHECK_STRING( expected, actual ) \
+	do { const char * e_ = ( expected ); const char * a_ = ( actual ); \
+		if ( strcmp( e_, a_ ) != 0 ) { OVR::UnitTest::Fail( __FILE__, __LINE__, "%s == %s, \"%s\" != \"%s\"", #expected, #actual, e_, a_ ); return; } } while ( 0 )
+
+#endif // OVR_UnitTest_h
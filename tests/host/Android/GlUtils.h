@@ -0,0 +1,46 @@
+/************************************************************************************
+
+Filename    :   GlUtils.h
+Content     :   Host stand-in for VRLib's GL header, for the unit tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_GlUtils_h )
+#define OVR_GlUtils_h
+
+// Only the types, enums and calls the tested modules use. There is no
+// context; the tests define the calls to keep track of what was created.
+typedef unsigned int	GLuint;
+typedef int				GLint;
+typedef unsigned int	GLenum;
+typedef int				GLsizei;
+typedef void			GLvoid;
+
+#define GL_TEXTURE_2D			0x0DE1
+#define GL_UNSIGNED_BYTE		0x1401
+#define GL_RGBA					0x1908
+#define GL_LINEAR				0x2601
+#define GL_TEXTURE_MAG_FILTER	0x2800
+#define GL_TEXTURE_MIN_FILTER	0x2801
+#define GL_TEXTURE_WRAP_S		0x2802
+#define GL_TEXTURE_WRAP_T		0x2803
+#define GL_CLAMP_TO_EDGE		0x812F
+
+extern "C" {
+void	glGenTextures( GLsizei n, GLuint * textures );
+void	glDeleteTextures( GLsizei n, const GLuint * textures );
+void	glBindTexture( GLenum target, GLuint texture );
+void	glTexImage2D( GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+			GLint border, GLenum format, GLenum type, const GLvoid * pixels );
+void	glTexParameteri( GLenum target, GLenum pname, GLint param );
+}
+
+#endif // OVR_GlUtils_h
@@ -0,0 +1,44 @@
+/************************************************************************************
+
+Filename    :   LogUtils.h
+Content     :   Host stand-in for VRLib's Android logging, for the unit tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_LogUtils_h )
+#define OVR_LogUtils_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+// The modules log as they would to logcat; the tests only show it when
+// TEST_VERBOSE is set, so a failing check isn't buried.
+inline void LogWithFileTag( const char * fileTag, const char * fmt, ... )
+{
+	static const bool verbose = getenv( "TEST_VERBOSE" ) != NULL;
+	if ( !verbose )
+	{
+		return;
+	}
+	va_list args;
+	va_start( args, fmt );
+	fprintf( stderr, "%s: ", fileTag );
+	vfprintf( stderr, fmt, args );
+	fputc( '\n', stderr );
+	va_end( args );
+}
+
+#define LOG( ... ) LogWithFileTag( __FILE__, __VA_ARGS__ )
+#define WARN( ... ) LogWithFileTag( __FILE__, __VA_ARGS__ )
+#define FAIL( ... ) { fprintf( stderr, __VA_ARGS__ ); fputc( '\n', stderr ); abort(); }
+
+#endif // OVR_LogUtils_h
@@ -0,0 +1,68 @@
+/************************************************************************************
+
+Filename    :   BitmapFont.h
+Content     :   Host stand-in for VRLib's BitmapFont, for the unit tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HostBitmapFont_h )
+#define OVR_HostBitmapFont_h
+
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+// A monospaced font with no glyphs: every character is GetCharWidth() meters
+// at scale 1, so the tests can tell exactly where a line must break.
+class BitmapFont
+{
+public:
+	static float		GetCharWidth() { return 0.05f; }
+
+	// Breaks at the last space that keeps a line within widthMeters.
+	bool				WordWrapText( String & inOutText, const float widthMeters, const float fontScale = 1.0f ) const
+	{
+		const int maxChars = static_cast< int >( widthMeters / ( GetCharWidth() * fontScale ) );
+		Array< char > text;
+		for ( const char * p = inOutText.ToCStr(); *p != 0; p++ )
+		{
+			text.PushBack( *p );
+		}
+		int lineStart = 0;
+		int lastSpace = -1;
+		for ( int i = 0; i < text.GetSizeI(); i++ )
+		{
+			if ( text[i] == '\n' )
+			{
+				lineStart = i + 1;
+				lastSpace = -1;
+			}
+			else if ( i - lineStart >= maxChars && lastSpace >= 0 )
+			{
+				text[lastSpace] = '\n';
+				lineStart = lastSpace + 1;
+				lastSpace = -1;
+			}
+			if ( text[i] == ' ' )
+			{
+				lastSpace = i;
+			}
+		}
+		text.PushBack( 0 );
+		inOutText = text.GetDataPtr();
+		return true;
+	}
+};
+
+}	// namespace OVR
+
+#endif // OVR_HostBitmapFont_h
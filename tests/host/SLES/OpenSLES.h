@@ -0,0 +1,29 @@
+/************************************************************************************
+
+Filename    :   OpenSLES.h
+Content     :   Host stand-in for the OpenSL ES header, for the unit tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HostOpenSLES_h )
+#define OVR_HostOpenSLES_h
+
+// Only the interface types AudioOutput.h declares members of; the sources
+// mixed into an output are tested without one.
+struct SLObjectItf_;
+struct SLEngineItf_;
+struct SLPlayItf_;
+
+typedef const struct SLObjectItf_ * const *	SLObjectItf;
+typedef const struct SLEngineItf_ * const *	SLEngineItf;
+typedef const struct SLPlayItf_ * const *	SLPlayItf;
+
+#endif // OVR_HostOpenSLES_h
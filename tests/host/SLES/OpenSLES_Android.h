@@ -0,0 +1,25 @@
+/************************************************************************************
+
+Filename    :   OpenSLES_Android.h
+Content     :   Host stand-in for the OpenSL ES Android header, for the unit tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HostOpenSLES_Android_h )
+#define OVR_HostOpenSLES_Android_h
+
+#include "OpenSLES.h"
+
+struct SLAndroidSimpleBufferQueueItf_;
+
+typedef const struct SLAndroidSimpleBufferQueueItf_ * const *	SLAndroidSimpleBufferQueueItf;
+
+#endif // OVR_HostOpenSLES_Android_h
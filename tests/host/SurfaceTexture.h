@@ -0,0 +1,39 @@
+/************************************************************************************
+
+Filename    :   SurfaceTexture.h
+Content     :   Stand-in for VRLib's SurfaceTexture in the host tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HostSurfaceTexture_h )
+#define OVR_HostSurfaceTexture_h
+
+#include <jni.h>
+
+namespace OVR {
+
+// No GL and no java object; the tests define the constructor and
+// destructor to hand out ids and count what is still alive.
+class SurfaceTexture
+{
+public:
+					SurfaceTexture( JNIEnv * jni_ );
+					~SurfaceTexture();
+
+	unsigned		textureId;
+	jobject			javaObject;
+	JNIEnv *		jni;
+	long long		nanoTimeStamp;
+};
+
+}	// namespace OVR
+
+#endif // OVR_HostSurfaceTexture_h
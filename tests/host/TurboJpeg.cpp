@@ -0,0 +1,125 @@
+/************************************************************************************
+
+Filename    :   TurboJpeg.cpp
+Content     :   Host stand-in for OVR_TurboJpeg.cpp on the system libjpeg, for the unit tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+*************************************************************************************/
+
+#include "OVR_TurboJpeg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+namespace OVR {
+
+struct JpegError
+{
+	jpeg_error_mgr	Manager;
+	jmp_buf			Jump;
+};
+
+static void ExitWithJump( j_common_ptr info )
+{
+	longjmp( reinterpret_cast< JpegError * >( info->err )->Jump, 1 );
+}
+
+static void IgnoreMessage( j_common_ptr )
+{
+}
+
+unsigned char * TurboJpegLoadFromMemory( const unsigned char * jpg, const int length, int * width, int * height )
+{
+	jpeg_decompress_struct info;
+	JpegError error;
+	info.err = jpeg_std_error( &error.Manager );
+	error.Manager.error_exit = ExitWithJump;
+	error.Manager.output_message = IgnoreMessage;
+	unsigned char * volatile pixels = NULL;
+	if ( setjmp( error.Jump ) != 0 )
+	{
+		jpeg_destroy_decompress( &info );
+		free( pixels );
+		return NULL;
+	}
+	jpeg_create_decompress( &info );
+	jpeg_mem_src( &info, const_cast< unsigned char * >( jpg ), static_cast< unsigned long >( length ) );
+	jpeg_read_header( &info, TRUE );
+	info.out_color_space = JCS_EXT_RGBX;
+	jpeg_start_decompress( &info );
+	pixels = static_cast< unsigned char * >( malloc( info.output_width * info.output_height * 4 ) );
+	while ( info.output_scanline < info.output_height )
+	{
+		JSAMPROW row = pixels + info.output_scanline * info.output_width * 4;
+		jpeg_read_scanlines( &info, &row, 1 );
+	}
+	*width = static_cast< int >( info.output_width );
+	*height = static_cast< int >( info.output_height );
+	jpeg_finish_decompress( &info );
+	jpeg_destroy_decompress( &info );
+	return pixels;
+}
+
+bool WriteJpeg( const char * destinationFile, const unsigned char * rgbxBuffer, int width, int height )
+{
+	FILE * f = fopen( destinationFile, "wb" );
+	if ( f == NULL )
+	{
+		return false;
+	}
+	jpeg_compress_struct info;
+	jpeg_error_mgr error;
+	info.err = jpeg_std_error( &error );
+	jpeg_create_compress( &info );
+	jpeg_stdio_dest( &info, f );
+	info.image_width = width;
+	info.image_height = height;
+	info.input_components = 4;
+	info.in_color_space = JCS_EXT_RGBX;
+	jpeg_set_defaults( &info );
+	jpeg_set_quality( &info, 90, TRUE );
+	// 4:4:4 like the device version
+	for ( int i = 0; i < info.num_components; i++ )
+	{
+		info.comp_info[i].h_samp_factor = 1;
+		info.comp_info[i].v_samp_factor = 1;
+	}
+	jpeg_start_compress( &info, TRUE );
+	while ( info.next_scanline < info.image_height )
+	{
+		JSAMPROW row = const_cast< unsigned char * >( rgbxBuffer ) + info.next_scanline * width * 4;
+		jpeg_write_scanlines( &info, &row, 1 );
+	}
+	jpeg_finish_compress( &info );
+	jpeg_destroy_compress( &info );
+	return fclose( f ) == 0;
+}
+
+unsigned char * TurboJpegLoadFromFile( const char * filename, int * width, int * height )
+{
+	FILE * f = fopen( filename, "rb" );
+	if ( f == NULL )
+	{
+		return NULL;
+	}
+	fseek( f, 0, SEEK_END );
+	const long length = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	unsigned char * jpg = static_cast< unsigned char * >( malloc( length > 0 ? length : 1 ) );
+	const bool read = length > 0 && fread( jpg, 1, length, f ) == static_cast< size_t >( length );
+	fclose( f );
+	unsigned char * pixels = read ? TurboJpegLoadFromMemory( jpg, static_cast< int >( length ), width, height ) : NULL;
+	free( jpg );
+	return pixels;
+}
+
+}	// namespace OVR
@@ -0,0 +1,132 @@
+/************************************************************************************
+
+Filename    :   MetaDataManager.h
+Content     :   Stand-in for VRLib's OvrMetaData in the host tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HostMetaDataManager_h )
+#define OVR_HostMetaDataManager_h
+
+#include "Kernel/OVR_Array.h"
+#include "Kernel/OVR_String.h"
+#include "Kernel/OVR_JSON.h"
+
+namespace OVR {
+
+struct OvrMetaDatum
+{
+	int					Id;
+	Array< String >		Tags;
+	String				Url;
+
+	virtual				~OvrMetaDatum() {}
+
+protected:
+						OvrMetaDatum() : Id( -1 ) {}
+};
+
+// Only what the app's subclass uses. ScanUrls leaves behind what
+// InitFromDirectory would for one folder, and MetaDataToJson writes each
+// datum the way VRLib's meta file does: the extended data, then the url
+// and the tags.
+class OvrMetaData
+{
+public:
+	struct Category
+	{
+		String			CategoryTag;
+		String			LocaleKey;
+		Array< int >	DatumIndicies;
+		bool			Dirty;
+
+		Category() : Dirty( true ) {}
+	};
+
+	virtual				~OvrMetaData()
+	{
+		for ( int i = 0; i < MetaData.GetSizeI(); i++ )
+		{
+			delete MetaData[i];
+		}
+	}
+
+	void				ScanUrls( const char * categoryTag, const Array< String > & urls )
+	{
+		AddCategory( categoryTag );
+		for ( int i = 0; i < urls.GetSizeI(); i++ )
+		{
+			OvrMetaDatum * datum = CreateMetaDatum( urls[i].ToCStr() );
+			datum->Id = MetaData.GetSizeI();
+			datum->Url = urls[i];
+			datum->Tags.PushBack( categoryTag );
+			MetaData.PushBack( datum );
+			Categories.Back().DatumIndicies.PushBack( datum->Id );
+		}
+	}
+
+	JSON *				MetaDataToJson() const
+	{
+		JSON * file = JSON::CreateObject();
+		JSON * data = JSON::CreateArray();
+		for ( int i = 0; i < MetaData.GetSizeI(); i++ )
+		{
+			JSON * datumObject = JSON::CreateObject();
+			ExtendedDataToJson( *MetaData[i], datumObject );
+			datumObject->AddStringItem( "url", MetaData[i]->Url.ToCStr() );
+			JSON * tags = JSON::CreateArray();
+			for ( int t = 0; t < MetaData[i]->Tags.GetSizeI(); t++ )
+			{
+				JSON * tag = JSON::CreateObject();
+				tag->AddStringItem( "category", MetaData[i]->Tags[t].ToCStr() );
+				tags->AddArrayElement( tag );
+			}
+			datumObject->AddItem( "tags", tags );
+			data->AddArrayElement( datumObject );
+		}
+		file->AddItem( "data", data );
+		return file;
+	}
+
+	const Array< Category > &	GetCategories() const 				{ return Categories; }
+	Category &			GetCategory( const int index ) 				{ return Categories[index]; }
+	void				AddCategory( const String & name )
+	{
+		Category category;
+		category.CategoryTag = name;
+		Categories.PushBack( category );
+	}
+
+	Array< OvrMetaDatum * > &	GetMetaData() 						{ return MetaData; }
+	const Array< OvrMetaDatum * > &	GetMetaData() const 			{ return MetaData; }
+	void				GetMetaData( const Category & category, Array< const OvrMetaDatum * > & outMetaData ) const
+	{
+		outMetaData.Clear();
+		for ( int i = 0; i < category.DatumIndicies.GetSizeI(); i++ )
+		{
+			outMetaData.PushBack( MetaData[category.DatumIndicies[i]] );
+		}
+	}
+
+protected:
+	virtual OvrMetaDatum *	CreateMetaDatum( const char * url ) const = 0;
+	virtual	void		ExtractExtendedData( const JsonReader & jsonDatum, OvrMetaDatum & outDatum ) const = 0;
+	virtual	void		ExtendedDataToJson( const OvrMetaDatum & datum, JSON * outDatumObject ) const = 0;
+	virtual void		SwapExtendedData( OvrMetaDatum * left, OvrMetaDatum * right ) const = 0;
+
+private:
+	Array< OvrMetaDatum * >	MetaData;
+	Array< Category >		Categories;
+};
+
+}	// namespace OVR
+
+#endif // OVR_HostMetaDataManager_h
@@ -0,0 +1,40 @@
+/************************************************************************************
+
+Filename    :   VrCommon.h
+Content     :   Stand-in for VRLib's VrCommon in the host tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HostVrCommon_h )
+#define OVR_HostVrCommon_h
+
+#include <string.h>
+
+#include "Kernel/OVR_String.h"
+
+namespace OVR {
+
+// The name without its directory and extension.
+inline String ExtractFileBase( const String & s )
+{
+	const char * name = s.ToCStr();
+	const char * slash = strrchr( name, '/' );
+	if ( slash != NULL )
+	{
+		name = slash + 1;
+	}
+	const char * dot = strrchr( name, '.' );
+	return String( name, ( dot != NULL ) ? dot - name : strlen( name ) );
+}
+
+}	// namespace OVR
+
+#endif // OVR_HostVrCommon_h
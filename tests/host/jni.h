@@ -0,0 +1,55 @@
+/************************************************************************************
+
+Filename    :   jni.h
+Content     :   Just enough of the JNI types for the host tests
+Created     :
+Authors     :
+
+Copyright   :   Copyright 2015 Oculus VR, LLC. All Rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the Oculus360Videos/ directory. An additional grant
+of patent rights can be found in the PATENTS file in the same directory.
+
+************************************************************************************/
+
+#if !defined( OVR_HostJni_h )
+#define OVR_HostJni_h
+
+// The modules only pass these around or call the JNIEnv members below;
+// a test that reaches one of the members defines it, everything else
+// fails to link, so nothing silently talks to a VM that isn't there.
+typedef unsigned char		jboolean;
+typedef int					jint;
+typedef long long			jlong;
+typedef float				jfloat;
+typedef jint				jsize;
+
+typedef struct _jobject *	jobject;
+typedef jobject				jclass;
+typedef jobject				jstring;
+typedef jobject				jobjectArray;
+typedef struct _jmethodID *	jmethodID;
+
+struct JNIEnv
+{
+	jclass			FindClass( const char * name );
+	jclass			GetObjectClass( jobject object );
+	jmethodID		GetMethodID( jclass clazz, const char * name, const char * signature );
+	jmethodID		GetStaticMethodID( jclass clazz, const char * name, const char * signature );
+	void			CallVoidMethod( jobject object, jmethodID method, ... );
+	jobject			CallObjectMethod( jobject object, jmethodID method, ... );
+	jobject			CallStaticObjectMethod( jclass clazz, jmethodID method, ... );
+	jobject			NewGlobalRef( jobject object );
+	void			DeleteGlobalRef( jobject object );
+	void			DeleteLocalRef( jobject object );
+	jstring			NewStringUTF( const char * utf );
+	const char *	GetStringUTFChars( jstring string, jboolean * isCopy );
+	void			ReleaseStringUTFChars( jstring string, const char * utf );
+	jsize			GetArrayLength( jobject array );
+	jobject			GetObjectArrayElement( jobjectArray array, jsize index );
+	jboolean		ExceptionCheck();
+	void			ExceptionClear();
+};
+
+#endif // OVR_HostJni_h